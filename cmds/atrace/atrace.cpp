@@ -14,10 +14,13 @@
  * limitations under the License.
  */
 
+#include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
 #include <getopt.h>
 #include <inttypes.h>
+#include <limits.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdbool.h>
@@ -26,6 +29,7 @@
 #include <string.h>
 #include <sys/sendfile.h>
 #include <time.h>
+#include <unistd.h>
 #include <zlib.h>
 
 #include <binder/IBinder.h>
@@ -46,6 +50,7 @@ enum { MAX_SYS_FILES = 10 };
 
 const char* k_traceTagsProperty = "debug.atrace.tags.enableflags";
 const char* k_traceAppCmdlineProperty = "debug.atrace.app_cmdlines";
+const char* k_snapshotProperty = "debug.atrace.snapshot";
 
 typedef enum { OPT, REQ } requiredness  ;
 
@@ -151,9 +156,12 @@ static bool g_nohup = false;
 static int g_initialSleepSecs = 0;
 static const char* g_kernelTraceFuncs = NULL;
 static const char* g_debugAppCmdLine = "";
+static const char* g_flightRecorderDir = NULL;
+static bool g_rawTrace = false;
 
 /* Global state */
 static bool g_traceAborted = false;
+static volatile sig_atomic_t g_snapshotRequested = 0;
 static bool g_categoryEnables[NELEM(k_categories)] = {};
 
 /* Sys file paths */
@@ -196,6 +204,9 @@ static const char* k_tracingOnPath =
 static const char* k_tracePath =
     "/sys/kernel/debug/tracing/trace";
 
+static const char* k_snapshotPath =
+    "/sys/kernel/debug/tracing/snapshot";
+
 static const char* k_traceMarkerPath =
     "/sys/kernel/debug/tracing/trace_marker";
 
@@ -650,12 +661,398 @@ static void stopTrace()
     setTracingEnabled(false);
 }
 
-// Read the current kernel trace and write it to stdout.
-static void dumpTrace()
+// A raw dump is the binary ring buffer pages of each CPU, as the kernel
+// keeps them, rather than the text the kernel formats them into when the
+// trace file is read.  That formatting, done on a single thread, is most of
+// the time it takes to dump a large buffer.  The dump starts with an
+// "ATRACE_RAW 1" line and is followed by records, each a
+// "<name> <flag> <length>" line and then <length> bytes of data:
+//
+//   events/header_page, events/header_event, saved_cmdlines, printk_formats
+//   and events/<system>/<event>/format for each enabled event describe how
+//   to decode the pages;
+//   cpuN records hold the pages of CPU N, in order, in as many records as
+//   it takes.
+//
+// The flag is '-' for plain data and 'z' for a zlib stream of it.
+// The CPUs are read in parallel, so their records are interleaved.
+// Uncompressed pages are spliced from the kernel to the output without
+// being copied through atrace.  raw2dat.py, next to this file, turns a raw
+// dump into a trace.dat file for trace-cmd and kernelshark.
+//
+// Unlike reading the trace file, reading trace_pipe_raw consumes the
+// buffer: the events dumped are gone from it, and a later dump of the same
+// trace (e.g. another --async_dump) only has what was traced since.
+
+static const char* k_tracingDir = "/sys/kernel/debug/tracing/";
+static const char* k_perCpuRawPath =
+    "/sys/kernel/debug/tracing/per_cpu/cpu%d/trace_pipe_raw";
+static const char* k_perCpuSnapshotRawPath =
+    "/sys/kernel/debug/tracing/per_cpu/cpu%d/snapshot_raw";
+
+// The most data that is put in a single cpuN record.
+static const size_t k_rawChunkSize = 1024*1024;
+
+struct RawDump {
+    int outFd;
+    const char* perCpuPath;
+    pthread_mutex_t lock;
+};
+
+struct RawCpuReader {
+    RawDump* dump;
+    int cpu;
+    pthread_t thread;
+};
+
+static bool writeAll(int fd, const void* buf, size_t len)
+{
+    const uint8_t* p = (const uint8_t*)buf;
+    while (len > 0) {
+        ssize_t n = TEMP_FAILURE_RETRY(write(fd, p, len));
+        if (n <= 0) {
+            fprintf(stderr, "error writing raw trace: %s (%d)\n",
+                    strerror(errno), errno);
+            return false;
+        }
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// Write a record header.  The caller holds dump->lock and writes len bytes of
+// data right after it.
+static bool writeRawRecordHeader(RawDump* dump, const char* name, char flag,
+        size_t len)
+{
+    char header[PATH_MAX + 32];
+    int n = snprintf(header, sizeof(header), "%s %c %zu\n", name, flag, len);
+    return writeAll(dump->outFd, header, n);
+}
+
+static bool writeRawRecord(RawDump* dump, const char* name, char flag,
+        const void* data, size_t len)
+{
+    pthread_mutex_lock(&dump->lock);
+    bool ok = writeRawRecordHeader(dump, name, flag, len) &&
+            writeAll(dump->outFd, data, len);
+    pthread_mutex_unlock(&dump->lock);
+    return ok;
+}
+
+// Write a file from the tracing directory as a plain record named after its
+// path within the directory.  Missing files are skipped.
+static void dumpRawFile(RawDump* dump, const char* name)
+{
+    String8 path(k_tracingDir);
+    path.append(name);
+    int fd = open(path.string(), O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        return;
+    }
+
+    // These files don't have a meaningful size, so read them to the end.
+    size_t size = 0;
+    size_t capacity = 16*1024;
+    uint8_t* buf = (uint8_t*)malloc(capacity);
+    ssize_t n;
+    while (buf != NULL &&
+            (n = TEMP_FAILURE_RETRY(read(fd, buf + size, capacity - size))) > 0) {
+        size += n;
+        if (size == capacity) {
+            capacity *= 2;
+            uint8_t* bigger = (uint8_t*)realloc(buf, capacity);
+            if (bigger == NULL) {
+                free(buf);
+            }
+            buf = bigger;
+        }
+    }
+    close(fd);
+
+    if (buf == NULL) {
+        fprintf(stderr, "out of memory reading %s\n", path.string());
+        return;
+    }
+    writeRawRecord(dump, name, '-', buf, size);
+    free(buf);
+}
+
+// Write the formats of the events an enable file turns on, whether it is the
+// enable of a single event or of a whole system of events.
+static void dumpRawEventFormats(RawDump* dump, const char* enablePath)
+{
+    size_t dirLen = strlen(k_tracingDir);
+    if (strncmp(enablePath, k_tracingDir, dirLen) != 0 ||
+            !fileExists(enablePath)) {
+        return;
+    }
+    String8 dir(enablePath + dirLen);
+    dir = dir.getPathDir();
+
+    String8 format(dir);
+    format.appendPath("format");
+    if (fileExists((String8(k_tracingDir) + format).string())) {
+        dumpRawFile(dump, format.string());
+        return;
+    }
+
+    DIR* d = opendir((String8(k_tracingDir) + dir).string());
+    if (d == NULL) {
+        return;
+    }
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        if (de->d_type != DT_DIR || de->d_name[0] == '.') {
+            continue;
+        }
+        format = dir;
+        format.appendPath(de->d_name);
+        format.appendPath("format");
+        dumpRawFile(dump, format.string());
+    }
+    closedir(d);
+}
+
+// Move the pages of a CPU to the output through a pipe, so they are never
+// copied to user space.  Splicing only moves full pages, so once it runs out
+// the partly filled last page is read.
+static void spliceRawCpu(RawDump* dump, int traceFD, const char* name,
+        size_t limit)
+{
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+    int pipeFds[2];
+    if (pipe2(pipeFds, O_CLOEXEC) == -1) {
+        fprintf(stderr, "error creating pipe: %s (%d)\n", strerror(errno),
+                errno);
+        return;
+    }
+    size_t chunkSize = 64*1024;
+    int pipeSize = fcntl(pipeFds[1], F_SETPIPE_SZ, k_rawChunkSize);
+    if (pipeSize > 0) {
+        chunkSize = pipeSize;
+    }
+
+    uint8_t* page = (uint8_t*)malloc(pageSize);
+    bool canSplice = true;
+    size_t total = 0;
+    bool done = false;
+    while (!done && total < limit) {
+        size_t chunk = 0;
+        while (chunk + pageSize <= chunkSize && total + chunk < limit) {
+            ssize_t n = splice(traceFD, NULL, pipeFds[1], NULL, pageSize,
+                    SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+            if (n <= 0) {
+                if (n < 0 && errno != EAGAIN) {
+                    fprintf(stderr, "error splicing %s: %s (%d)\n", name,
+                            strerror(errno), errno);
+                }
+                done = true;
+                break;
+            }
+            chunk += n;
+        }
+
+        if (chunk > 0) {
+            pthread_mutex_lock(&dump->lock);
+            bool ok = writeRawRecordHeader(dump, name, '-', chunk);
+            size_t left = chunk;
+            while (ok && left > 0) {
+                ssize_t n = -1;
+                if (canSplice) {
+                    n = splice(pipeFds[0], NULL, dump->outFd, NULL, left,
+                            SPLICE_F_MOVE);
+                    if (n < 0 && errno == EINVAL) {
+                        // The output can't be spliced to; copy instead.
+                        canSplice = false;
+                        continue;
+                    }
+                } else {
+                    n = TEMP_FAILURE_RETRY(read(pipeFds[0], page,
+                            left < pageSize ? left : pageSize));
+                    ok = n > 0 && writeAll(dump->outFd, page, n);
+                }
+                if (n <= 0) {
+                    fprintf(stderr, "error writing %s: %s (%d)\n", name,
+                            strerror(errno), errno);
+                    ok = false;
+                    break;
+                }
+                left -= n;
+            }
+            pthread_mutex_unlock(&dump->lock);
+            if (!ok) {
+                break;
+            }
+            total += chunk;
+        }
+    }
+
+    if (page != NULL && total < limit) {
+        ssize_t n = TEMP_FAILURE_RETRY(read(traceFD, page, pageSize));
+        if (n > 0) {
+            writeRawRecord(dump, name, '-', page, n);
+        }
+    }
+
+    free(page);
+    close(pipeFds[0]);
+    close(pipeFds[1]);
+}
+
+// Read the pages of a CPU and write them compressed, a chunk per record.
+static void compressRawCpu(RawDump* dump, int traceFD, const char* name,
+        size_t limit)
+{
+    const size_t pageSize = sysconf(_SC_PAGESIZE);
+    uLongf outSize = compressBound(k_rawChunkSize);
+    uint8_t* in = (uint8_t*)malloc(k_rawChunkSize);
+    uint8_t* out = (uint8_t*)malloc(outSize);
+    if (in == NULL || out == NULL) {
+        fprintf(stderr, "out of memory dumping %s\n", name);
+        free(in);
+        free(out);
+        return;
+    }
+
+    size_t total = 0;
+    bool done = false;
+    while (!done && total < limit) {
+        size_t chunk = 0;
+        while (chunk + pageSize <= k_rawChunkSize && total + chunk < limit) {
+            ssize_t n = TEMP_FAILURE_RETRY(read(traceFD, in + chunk, pageSize));
+            if (n <= 0) {
+                if (n < 0 && errno != EAGAIN) {
+                    fprintf(stderr, "error reading %s: %s (%d)\n", name,
+                            strerror(errno), errno);
+                }
+                done = true;
+                break;
+            }
+            chunk += n;
+        }
+        if (chunk == 0) {
+            break;
+        }
+
+        uLongf len = outSize;
+        int result = compress2(out, &len, in, chunk, Z_DEFAULT_COMPRESSION);
+        if (result != Z_OK) {
+            fprintf(stderr, "error deflating %s: %d\n", name, result);
+            break;
+        }
+        if (!writeRawRecord(dump, name, 'z', out, len)) {
+            break;
+        }
+        total += chunk;
+    }
+
+    free(in);
+    free(out);
+}
+
+static void* readRawCpu(void* arg)
 {
-    int traceFD = open(k_tracePath, O_RDWR);
+    RawCpuReader* reader = (RawCpuReader*)arg;
+    char path[PATH_MAX];
+    char name[16];
+    snprintf(path, sizeof(path), reader->dump->perCpuPath, reader->cpu);
+    snprintf(name, sizeof(name), "cpu%d", reader->cpu);
+
+    int traceFD = open(path, O_RDONLY | O_NONBLOCK | O_CLOEXEC);
     if (traceFD == -1) {
-        fprintf(stderr, "error opening %s: %s (%d)\n", k_tracePath,
+        // Offline CPUs may not have a buffer.
+        if (errno != ENOENT) {
+            fprintf(stderr, "error opening %s: %s (%d)\n", path,
+                    strerror(errno), errno);
+        }
+        return NULL;
+    }
+
+    // Reading consumes the buffer, so if tracing is still on, as it is for a
+    // flight recorder snapshot, stop after about a buffer's worth rather than
+    // chasing the writer.
+    size_t limit = (size_t)g_traceBufferSizeKB * 1024 * 2;
+    if (g_compress) {
+        compressRawCpu(reader->dump, traceFD, name, limit);
+    } else {
+        spliceRawCpu(reader->dump, traceFD, name, limit);
+    }
+
+    close(traceFD);
+    return NULL;
+}
+
+// Write a raw dump of the kernel trace, or of the snapshot buffer, to outFd,
+// reading the CPUs in parallel.
+static void dumpRawTrace(int outFd, bool fromSnapshot)
+{
+    RawDump dump;
+    dump.outFd = outFd;
+    dump.perCpuPath = fromSnapshot ? k_perCpuSnapshotRawPath : k_perCpuRawPath;
+    pthread_mutex_init(&dump.lock, NULL);
+
+    static const char header[] = "ATRACE_RAW 1\n";
+    if (!writeAll(outFd, header, sizeof(header) - 1)) {
+        pthread_mutex_destroy(&dump.lock);
+        return;
+    }
+
+    dumpRawFile(&dump, "events/header_page");
+    dumpRawFile(&dump, "events/header_event");
+    dumpRawFile(&dump, "saved_cmdlines");
+    dumpRawFile(&dump, "printk_formats");
+    // trace_marker writes, which is what userspace tracing is made of
+    dumpRawFile(&dump, "events/ftrace/print/format");
+    for (int i = 0; i < NELEM(k_categories); i++) {
+        if (g_categoryEnables[i]) {
+            const TracingCategory &c = k_categories[i];
+            for (int j = 0; j < MAX_SYS_FILES; j++) {
+                if (c.sysfiles[j].path != NULL) {
+                    dumpRawEventFormats(&dump, c.sysfiles[j].path);
+                }
+            }
+        }
+    }
+
+    int numCpus = sysconf(_SC_NPROCESSORS_CONF);
+    if (numCpus < 1) {
+        numCpus = 1;
+    }
+    RawCpuReader* readers = new RawCpuReader[numCpus];
+    for (int i = 0; i < numCpus; i++) {
+        readers[i].dump = &dump;
+        readers[i].cpu = i;
+        if (pthread_create(&readers[i].thread, NULL, readRawCpu,
+                &readers[i]) != 0) {
+            readRawCpu(&readers[i]);
+            readers[i].cpu = -1;
+        }
+    }
+    for (int i = 0; i < numCpus; i++) {
+        if (readers[i].cpu != -1) {
+            pthread_join(readers[i].thread, NULL);
+        }
+    }
+    delete[] readers;
+
+    pthread_mutex_destroy(&dump.lock);
+}
+
+// Read the current kernel trace, or the snapshot buffer, and write it to
+// outFd.  Reading the trace file stops tracing for as long as it is open.
+static void dumpTrace(int outFd, bool fromSnapshot)
+{
+    if (g_rawTrace) {
+        dumpRawTrace(outFd, fromSnapshot);
+        return;
+    }
+
+    const char* path = fromSnapshot ? k_snapshotPath : k_tracePath;
+    int traceFD = open(path, O_RDWR);
+    if (traceFD == -1) {
+        fprintf(stderr, "error opening %s: %s (%d)\n", path,
                 strerror(errno), errno);
         return;
     }
@@ -701,7 +1098,7 @@ static void dumpTrace()
 
             if (zs.avail_out == 0) {
                 // Need to write the output.
-                result = write(STDOUT_FILENO, out, bufSize);
+                result = write(outFd, out, bufSize);
                 if ((size_t)result < bufSize) {
                     fprintf(stderr, "error writing deflated trace: %s (%d)\n",
                             strerror(errno), errno);
@@ -721,7 +1118,7 @@ static void dumpTrace()
 
         if (zs.avail_out < bufSize) {
             size_t bytes = bufSize - zs.avail_out;
-            result = write(STDOUT_FILENO, out, bytes);
+            result = write(outFd, out, bytes);
             if ((size_t)result < bytes) {
                 fprintf(stderr, "error writing deflated trace: %s (%d)\n",
                         strerror(errno), errno);
@@ -737,7 +1134,7 @@ static void dumpTrace()
         free(out);
     } else {
         ssize_t sent = 0;
-        while ((sent = sendfile(STDOUT_FILENO, traceFD, NULL, 64*1024*1024)) > 0);
+        while ((sent = sendfile(outFd, traceFD, NULL, 64*1024*1024)) > 0);
         if (sent == -1) {
             fprintf(stderr, "error dumping trace: %s (%d)\n", strerror(errno),
                     errno);
@@ -754,6 +1151,11 @@ static void handleSignal(int /*signo*/)
     }
 }
 
+static void handleSnapshotSignal(int /*signo*/)
+{
+    g_snapshotRequested = 1;
+}
+
 static void registerSigHandler()
 {
     struct sigaction sa;
@@ -764,6 +1166,100 @@ static void registerSigHandler()
     sigaction(SIGINT, &sa, NULL);
     sigaction(SIGQUIT, &sa, NULL);
     sigaction(SIGTERM, &sa, NULL);
+    if (g_flightRecorderDir != NULL) {
+        sa.sa_handler = handleSnapshotSignal;
+        sigaction(SIGUSR1, &sa, NULL);
+    }
+}
+
+// Write a snapshot of the flight recorder buffer to the snapshot directory.
+// The newest snapshot is always trace.0.z; older ones are shifted up and the
+// oldest of k_maxSnapshots is dropped, so always-on tracing can't fill the
+// disk.  The snapshot is written to a temporary file first so a reader never
+// sees a partial one.
+//
+// Where the kernel supports it, the ring buffer is swapped with the snapshot
+// buffer and the snapshot buffer is dumped, so tracing goes on into the
+// fresh buffer meanwhile and each snapshot holds what was traced since the
+// previous one.  Otherwise the trace itself is dumped, and tracing pauses
+// while the trace file is open.
+static void snapshotTrace(const char* reason)
+{
+    static const int k_maxSnapshots = 5;
+    char tmpPath[PATH_MAX];
+    char path[PATH_MAX];
+    char oldPath[PATH_MAX];
+
+    snprintf(tmpPath, sizeof(tmpPath), "%s/trace.tmp", g_flightRecorderDir);
+    int fd = open(tmpPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0640);
+    if (fd == -1) {
+        fprintf(stderr, "error creating %s: %s (%d)\n", tmpPath,
+                strerror(errno), errno);
+        return;
+    }
+
+    // The clock sync marker lets the snapshot be lined up with other traces,
+    // like it is at the end of a regular capture.
+    writeClockSyncMarker();
+    static const char header[] = "TRACE:\n";
+    if (write(fd, header, sizeof(header) - 1) != sizeof(header) - 1) {
+        fprintf(stderr, "error writing %s: %s (%d)\n", tmpPath,
+                strerror(errno), errno);
+    }
+    nsecs_t start = systemTime(CLOCK_MONOTONIC);
+    bool fromSnapshot = fileIsWritable(k_snapshotPath) && writeStr(k_snapshotPath, "1");
+    dumpTrace(fd, fromSnapshot);
+    if (fromSnapshot) {
+        // Free the snapshot buffer until the next snapshot.
+        writeStr(k_snapshotPath, "0");
+    }
+    fsync(fd);
+    close(fd);
+
+    for (int i = k_maxSnapshots - 1; i > 0; i--) {
+        snprintf(oldPath, sizeof(oldPath), "%s/trace.%d.z", g_flightRecorderDir, i - 1);
+        snprintf(path, sizeof(path), "%s/trace.%d.z", g_flightRecorderDir, i);
+        rename(oldPath, path);
+    }
+    snprintf(path, sizeof(path), "%s/trace.0.z", g_flightRecorderDir);
+    if (rename(tmpPath, path) == -1) {
+        fprintf(stderr, "error renaming %s: %s (%d)\n", tmpPath,
+                strerror(errno), errno);
+        unlink(tmpPath);
+        return;
+    }
+
+    printf("snapshot (%s) written to %s in %" PRId64 "ms\n", reason, path,
+            (int64_t)ns2ms(systemTime(CLOCK_MONOTONIC) - start));
+    fflush(stdout);
+}
+
+// Keep tracing into the circular buffer until we are told to stop, taking a
+// snapshot each time one is asked for with SIGUSR1 or by setting the
+// debug.atrace.snapshot property (to a reason string, or just "1").  The
+// property is what a jank detector or other in-process trigger sets, since
+// it doesn't need to know our pid.
+static void runFlightRecorder()
+{
+    char value[PROPERTY_VALUE_MAX];
+
+    // Ignore a trigger left over from a previous run.
+    property_set(k_snapshotProperty, "");
+
+    while (!g_traceAborted) {
+        sleep(1);
+
+        if (g_snapshotRequested) {
+            g_snapshotRequested = 0;
+            snapshotTrace("signal");
+        }
+
+        property_get(k_snapshotProperty, value, "");
+        if (value[0] != '\0' && strcmp(value, "0") != 0) {
+            property_set(k_snapshotProperty, "");
+            snapshotTrace(value);
+        }
+    }
 }
 
 static bool setCategoryEnable(const char* name, bool enable)
@@ -814,10 +1310,18 @@ static void showHelp(const char *cmd)
                     "  -s N            sleep for N seconds before tracing [default 0]\n"
                     "  -t N            trace for N seconds [defualt 5]\n"
                     "  -z              compress the trace dump\n"
+                    "  --raw           dump the binary per-CPU trace buffers rather than\n"
+                    "                    text, which is much faster for large buffers;\n"
+                    "                    this empties the buffers, and raw2dat.py\n"
+                    "                    converts the dump for trace-cmd\n"
                     "  --async_start   start circular trace and return immediatly\n"
                     "  --async_dump    dump the current contents of circular trace buffer\n"
                     "  --async_stop    stop tracing and dump the current contents of circular\n"
                     "                    trace buffer\n"
+                    "  --flight_recorder dir\n"
+                    "                  trace into a circular buffer until killed, writing a\n"
+                    "                    compressed snapshot to dir on SIGUSR1 or when\n"
+                    "                    debug.atrace.snapshot is set\n"
                     "  --list_categories\n"
                     "                  list the available tracing categories\n"
             );
@@ -843,6 +1347,8 @@ int main(int argc, char **argv)
             {"async_stop",      no_argument, 0,  0 },
             {"async_dump",      no_argument, 0,  0 },
             {"list_categories", no_argument, 0,  0 },
+            {"flight_recorder", required_argument, 0, 0 },
+            {"raw",             no_argument, 0,  0 },
             {           0,                0, 0,  0 }
         };
 
@@ -908,6 +1414,12 @@ int main(int argc, char **argv)
                 } else if (!strcmp(long_options[option_index].name, "list_categories")) {
                     listSupportedCategories();
                     exit(0);
+                } else if (!strcmp(long_options[option_index].name, "flight_recorder")) {
+                    g_flightRecorderDir = optarg;
+                    g_traceOverwrite = true;
+                    g_compress = true;
+                } else if (!strcmp(long_options[option_index].name, "raw")) {
+                    g_rawTrace = true;
                 }
             break;
 
@@ -940,7 +1452,15 @@ int main(int argc, char **argv)
         // another.
         ok = clearTrace();
 
-        if (ok && !async) {
+        if (ok && g_flightRecorderDir != NULL) {
+            printf(" flight recorder running\n");
+            fflush(stdout);
+            runFlightRecorder();
+            // Being stopped is how the flight recorder normally ends, so
+            // don't report it as an aborted trace.
+            g_traceAborted = false;
+            traceDump = false;
+        } else if (ok && !async) {
             // Sleep to allow the trace to be captured.
             struct timespec timeLeft;
             timeLeft.tv_sec = g_traceDurationSeconds;
@@ -961,7 +1481,7 @@ int main(int argc, char **argv)
         if (!g_traceAborted) {
             printf(" done\nTRACE:\n");
             fflush(stdout);
-            dumpTrace();
+            dumpTrace(STDOUT_FILENO, false);
         } else {
             printf("\ntrace aborted.\n");
             fflush(stdout);
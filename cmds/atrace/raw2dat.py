@@ -0,0 +1,164 @@
+#!/usr/bin/env python
+#
+# Copyright (C) 2016 The Android Open Source Project
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      http://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+
+"""Converts the output of atrace --raw to a trace-cmd trace.dat file.
+
+usage: raw2dat.py [-p page_size] [-b] input output.dat
+
+The input is what atrace wrote, with or without -z, and with anything it
+printed before the "ATRACE_RAW 1" line.  The result can be read with
+"trace-cmd report" or kernelshark.  The page size defaults to 4096 and the
+byte order to little endian (-b for big endian); the size of a long is taken
+from the header_page format.
+"""
+
+import getopt
+import re
+import struct
+import sys
+import zlib
+
+MAGIC = b"ATRACE_RAW 1\n"
+
+
+def read_records(data):
+    """Returns the records of a raw dump as a list of (name, data)."""
+    start = data.find(MAGIC)
+    if start < 0:
+        raise ValueError("no ATRACE_RAW header found")
+    pos = start + len(MAGIC)
+    records = []
+    while pos < len(data):
+        end = data.find(b"\n", pos)
+        if end < 0:
+            raise ValueError("truncated record header at offset %d" % pos)
+        fields = data[pos:end].split(b" ")
+        if len(fields) != 3:
+            raise ValueError("bad record header at offset %d" % pos)
+        name, flag, length = fields[0].decode(), fields[1], int(fields[2])
+        pos = end + 1
+        payload = data[pos:pos + length]
+        if len(payload) != length:
+            raise ValueError("truncated record %s" % name)
+        pos += length
+        if flag == b"z":
+            payload = zlib.decompress(payload)
+        elif flag != b"-":
+            raise ValueError("bad flag in record %s" % name)
+        records.append((name, payload))
+    return records
+
+
+def write_dat(records, out, page_size, big_endian):
+    files = {}
+    cpus = {}
+    for name, payload in records:
+        # The CPUs were read in parallel, so their records are interleaved,
+        # but each CPU's own records are in order.
+        if re.match(r"cpu\d+$", name):
+            cpu = int(name[3:])
+            cpus.setdefault(cpu, []).append(payload)
+        else:
+            files[name] = payload
+
+    header_page = files.get("events/header_page", b"")
+    m = re.search(br"commit;\s*offset:\d+;\s*size:(\d+);", header_page)
+    long_size = int(m.group(1)) if m else 8
+
+    order = ">" if big_endian else "<"
+    u32 = lambda v: struct.pack(order + "I", v)
+    u64 = lambda v: struct.pack(order + "Q", v)
+
+    ftrace = []
+    systems = {}
+    for name in sorted(files):
+        m = re.match(r"events/([^/]+)/[^/]+/format$", name)
+        if not m:
+            continue
+        if m.group(1) == "ftrace":
+            ftrace.append(files[name])
+        else:
+            systems.setdefault(m.group(1), []).append(files[name])
+
+    out.write(b"\x17\x08\x44tracing6\0")
+    out.write(struct.pack("BB", 1 if big_endian else 0, long_size))
+    out.write(u32(page_size))
+    out.write(b"header_page\0" + u64(len(header_page)) + header_page)
+    header_event = files.get("events/header_event", b"")
+    out.write(b"header_event\0" + u64(len(header_event)) + header_event)
+
+    out.write(u32(len(ftrace)))
+    for fmt in ftrace:
+        out.write(u64(len(fmt)) + fmt)
+    out.write(u32(len(systems)))
+    for system in sorted(systems):
+        out.write(system.encode() + b"\0" + u32(len(systems[system])))
+        for fmt in systems[system]:
+            out.write(u64(len(fmt)) + fmt)
+
+    out.write(u32(0))  # kallsyms
+    printk = files.get("printk_formats", b"")
+    out.write(u32(len(printk)) + printk)
+    cmdlines = files.get("saved_cmdlines", b"")
+    out.write(u64(len(cmdlines)) + cmdlines)
+
+    num_cpus = max(cpus) + 1 if cpus else 0
+    out.write(u32(num_cpus))
+    out.write(b"flyrecord\0")
+
+    # The CPU data starts page aligned, after the offset and size of each.
+    buffers = []
+    for cpu in range(num_cpus):
+        buf = b"".join(cpus.get(cpu, []))
+        if len(buf) % page_size:
+            buf += b"\0" * (page_size - len(buf) % page_size)
+        buffers.append(buf)
+    offset = out.tell() + 16 * num_cpus
+    offset += -offset % page_size
+    for buf in buffers:
+        out.write(u64(offset) + u64(len(buf)))
+        offset += len(buf)
+    out.write(b"\0" * (-out.tell() % page_size))
+    for buf in buffers:
+        out.write(buf)
+
+
+def main(argv):
+    try:
+        opts, args = getopt.getopt(argv[1:], "p:b")
+    except getopt.GetoptError as e:
+        sys.stderr.write("%s\n%s" % (e, __doc__))
+        return 1
+    if len(args) != 2:
+        sys.stderr.write(__doc__)
+        return 1
+    page_size = 4096
+    big_endian = False
+    for opt, value in opts:
+        if opt == "-p":
+            page_size = int(value, 0)
+        elif opt == "-b":
+            big_endian = True
+
+    with open(args[0], "rb") as f:
+        records = read_records(f.read())
+    with open(args[1], "wb") as out:
+        write_dat(records, out, page_size, big_endian)
+    return 0
+
+
+if __name__ == "__main__":
+    sys.exit(main(sys.argv))
@@ -262,6 +262,14 @@ static unsigned long logcat_timeout(char *name) {
 /* End copy from system/core/logd/LogBuffer.cpp */
 
 /* dumps the current system state to stdout */
+/* Runs showmap for each process in a section of its own. */
+static void do_showmap_section(int pid, const char *name) {
+    if (start_section(NULL, 20)) {
+        do_showmap(pid, name);
+        end_section();
+    }
+}
+
 static void dumpstate() {
     unsigned long timeout;
     time_t now = time(NULL);
@@ -294,35 +302,65 @@ static void dumpstate() {
     printf("Command line: %s\n", strtok(cmdline_buf, "\n"));
     printf("\n");
 
-    dump_dev_files("TRUSTY VERSION", "/sys/bus/platform/drivers/trusty", "trusty_version");
-    run_command("UPTIME", 10, "uptime", NULL);
-    dump_files("UPTIME MMC PERF", mmcblk0, skip_not_stat, dump_stat_from_fd);
-    dump_file("MEMORY INFO", "/proc/meminfo");
-    run_command("CPU INFO", 10, "top", "-n", "1", "-d", "1", "-m", "30", "-t", NULL);
-    run_command("PROCRANK", 20, "procrank", NULL);
-    dump_file("VIRTUAL MEMORY STATS", "/proc/vmstat");
-    dump_file("VMALLOC INFO", "/proc/vmallocinfo");
-    dump_file("SLAB INFO", "/proc/slabinfo");
-    dump_file("ZONEINFO", "/proc/zoneinfo");
-    dump_file("PAGETYPEINFO", "/proc/pagetypeinfo");
-    dump_file("BUDDYINFO", "/proc/buddyinfo");
-    dump_file("FRAGMENTATION INFO", "/d/extfrag/unusable_index");
-
-    dump_file("KERNEL WAKELOCKS", "/proc/wakelocks");
-    dump_file("KERNEL WAKE SOURCES", "/d/wakeup_sources");
-    dump_file("KERNEL CPUFREQ", "/sys/devices/system/cpu/cpu0/cpufreq/stats/time_in_state");
-    dump_file("KERNEL SYNC", "/d/sync");
-
-    run_command("PROCESSES", 10, "ps", "-P", NULL);
-    run_command("PROCESSES AND THREADS", 10, "ps", "-t", "-p", "-P", NULL);
-    run_command("PROCESSES (SELINUX LABELS)", 10, "ps", "-Z", NULL);
-    run_command("LIBRANK", 10, "librank", NULL);
-
-    do_dmesg();
-
-    run_command("LIST OF OPEN FILES", 10, SU_PATH, "root", "lsof", NULL);
-    for_each_pid(do_showmap, "SMAPS OF ALL PROCESSES");
-    for_each_tid(show_wchan, "BLOCKED PROCESS WAIT-CHANNELS");
+    /* The sections below are independent: they run at the same time, and
+       are written out in this order. */
+    if (start_section("UPTIME", 30)) {
+        dump_dev_files("TRUSTY VERSION", "/sys/bus/platform/drivers/trusty", "trusty_version");
+        run_command("UPTIME", 10, "uptime", NULL);
+        dump_files("UPTIME MMC PERF", mmcblk0, skip_not_stat, dump_stat_from_fd);
+        dump_file("MEMORY INFO", "/proc/meminfo");
+        end_section();
+    }
+    if (start_section("CPU INFO", 20)) {
+        run_command("CPU INFO", 10, "top", "-n", "1", "-d", "1", "-m", "30", "-t", NULL);
+        end_section();
+    }
+    if (start_section("PROCRANK", 30)) {
+        run_command("PROCRANK", 20, "procrank", NULL);
+        end_section();
+    }
+    if (start_section("KERNEL MEMORY", 60)) {
+        dump_file("VIRTUAL MEMORY STATS", "/proc/vmstat");
+        dump_file("VMALLOC INFO", "/proc/vmallocinfo");
+        dump_file("SLAB INFO", "/proc/slabinfo");
+        dump_file("ZONEINFO", "/proc/zoneinfo");
+        dump_file("PAGETYPEINFO", "/proc/pagetypeinfo");
+        dump_file("BUDDYINFO", "/proc/buddyinfo");
+        dump_file("FRAGMENTATION INFO", "/d/extfrag/unusable_index");
+
+        dump_file("KERNEL WAKELOCKS", "/proc/wakelocks");
+        dump_file("KERNEL WAKE SOURCES", "/d/wakeup_sources");
+        dump_file("KERNEL CPUFREQ", "/sys/devices/system/cpu/cpu0/cpufreq/stats/time_in_state");
+        dump_file("KERNEL SYNC", "/d/sync");
+        end_section();
+    }
+    if (start_section("PROCESSES", 40)) {
+        run_command("PROCESSES", 10, "ps", "-P", NULL);
+        run_command("PROCESSES AND THREADS", 10, "ps", "-t", "-p", "-P", NULL);
+        run_command("PROCESSES (SELINUX LABELS)", 10, "ps", "-Z", NULL);
+        end_section();
+    }
+    if (start_section("LIBRANK", 20)) {
+        run_command("LIBRANK", 10, "librank", NULL);
+        end_section();
+    }
+    if (start_section("KERNEL LOG", 30)) {
+        do_dmesg();
+        end_section();
+    }
+    if (start_section("LIST OF OPEN FILES", 20)) {
+        run_command("LIST OF OPEN FILES", 10, SU_PATH, "root", "lsof", NULL);
+        end_section();
+    }
+    if (start_section("SMAPS", 600)) {
+        for_each_pid(do_showmap_section, "SMAPS OF ALL PROCESSES");
+        end_section();
+    }
+    if (start_section("WAIT CHANNELS", 60)) {
+        for_each_tid(show_wchan, "BLOCKED PROCESS WAIT-CHANNELS");
+        end_section();
+    }
+    flush_sections();
 
     if (screenshot_path[0]) {
         ALOGI("taking screenshot\n");
@@ -336,19 +374,31 @@ static void dumpstate() {
     if (timeout < 20000) {
         timeout = 20000;
     }
-    run_command("SYSTEM LOG", timeout / 1000, "logcat", "-v", "threadtime", "-d", "*:v", NULL);
+    if (start_section("SYSTEM LOG", timeout / 1000 + 10)) {
+        run_command("SYSTEM LOG", timeout / 1000, "logcat", "-v", "threadtime", "-d", "*:v", NULL);
+        end_section();
+    }
     timeout = logcat_timeout("events");
     if (timeout < 20000) {
         timeout = 20000;
     }
-    run_command("EVENT LOG", timeout / 1000, "logcat", "-b", "events", "-v", "threadtime", "-d", "*:v", NULL);
+    if (start_section("EVENT LOG", timeout / 1000 + 10)) {
+        run_command("EVENT LOG", timeout / 1000, "logcat", "-b", "events", "-v", "threadtime", "-d", "*:v", NULL);
+        end_section();
+    }
     timeout = logcat_timeout("radio");
     if (timeout < 20000) {
         timeout = 20000;
     }
-    run_command("RADIO LOG", timeout / 1000, "logcat", "-b", "radio", "-v", "threadtime", "-d", "*:v", NULL);
-
-    run_command("LOG STATISTICS", 10, "logcat", "-b", "all", "-S", NULL);
+    if (start_section("RADIO LOG", timeout / 1000 + 10)) {
+        run_command("RADIO LOG", timeout / 1000, "logcat", "-b", "radio", "-v", "threadtime", "-d", "*:v", NULL);
+        end_section();
+    }
+    if (start_section("LOG STATISTICS", 20)) {
+        run_command("LOG STATISTICS", 10, "logcat", "-b", "all", "-S", NULL);
+        end_section();
+    }
+    flush_sections();
 
     /* show the traces we collected in main(), if that was done */
     if (dump_traces_path != NULL) {
@@ -421,27 +471,39 @@ static void dumpstate() {
 
     /* The following have a tendency to get wedged when wifi drivers/fw goes belly-up. */
 
-    run_command("NETWORK INTERFACES", 10, "ip", "link", NULL);
-
-    run_command("IPv4 ADDRESSES", 10, "ip", "-4", "addr", "show", NULL);
-    run_command("IPv6 ADDRESSES", 10, "ip", "-6", "addr", "show", NULL);
+    if (start_section("NETWORK INTERFACES", 60)) {
+        run_command("NETWORK INTERFACES", 10, "ip", "link", NULL);
 
-    run_command("IP RULES", 10, "ip", "rule", "show", NULL);
-    run_command("IP RULES v6", 10, "ip", "-6", "rule", "show", NULL);
+        run_command("IPv4 ADDRESSES", 10, "ip", "-4", "addr", "show", NULL);
+        run_command("IPv6 ADDRESSES", 10, "ip", "-6", "addr", "show", NULL);
 
-    dump_route_tables();
-
-    run_command("ARP CACHE", 10, "ip", "-4", "neigh", "show", NULL);
-    run_command("IPv6 ND CACHE", 10, "ip", "-6", "neigh", "show", NULL);
-
-    run_command("NETWORK DIAGNOSTICS", 10, "dumpsys", "connectivity", "--diag", NULL);
-
-    run_command("IPTABLES", 10, SU_PATH, "root", "iptables", "-L", "-nvx", NULL);
-    run_command("IP6TABLES", 10, SU_PATH, "root", "ip6tables", "-L", "-nvx", NULL);
-    run_command("IPTABLE NAT", 10, SU_PATH, "root", "iptables", "-t", "nat", "-L", "-nvx", NULL);
-    /* no ip6 nat */
-    run_command("IPTABLE RAW", 10, SU_PATH, "root", "iptables", "-t", "raw", "-L", "-nvx", NULL);
-    run_command("IP6TABLE RAW", 10, SU_PATH, "root", "ip6tables", "-t", "raw", "-L", "-nvx", NULL);
+        run_command("IP RULES", 10, "ip", "rule", "show", NULL);
+        run_command("IP RULES v6", 10, "ip", "-6", "rule", "show", NULL);
+        end_section();
+    }
+    if (start_section("ROUTE TABLES", 60)) {
+        dump_route_tables();
+        end_section();
+    }
+    if (start_section("NEIGHBORS", 30)) {
+        run_command("ARP CACHE", 10, "ip", "-4", "neigh", "show", NULL);
+        run_command("IPv6 ND CACHE", 10, "ip", "-6", "neigh", "show", NULL);
+        end_section();
+    }
+    if (start_section("NETWORK DIAGNOSTICS", 20)) {
+        run_command("NETWORK DIAGNOSTICS", 10, "dumpsys", "connectivity", "--diag", NULL);
+        end_section();
+    }
+    if (start_section("IPTABLES", 60)) {
+        run_command("IPTABLES", 10, SU_PATH, "root", "iptables", "-L", "-nvx", NULL);
+        run_command("IP6TABLES", 10, SU_PATH, "root", "ip6tables", "-L", "-nvx", NULL);
+        run_command("IPTABLE NAT", 10, SU_PATH, "root", "iptables", "-t", "nat", "-L", "-nvx", NULL);
+        /* no ip6 nat */
+        run_command("IPTABLE RAW", 10, SU_PATH, "root", "iptables", "-t", "raw", "-L", "-nvx", NULL);
+        run_command("IP6TABLE RAW", 10, SU_PATH, "root", "ip6tables", "-t", "raw", "-L", "-nvx", NULL);
+        end_section();
+    }
+    flush_sections();
 
     run_command("WIFI NETWORKS", 20,
             SU_PATH, "root", "wpa_cli", "IFNAME=wlan0", "list_networks", NULL);
@@ -569,6 +631,7 @@ static void usage() {
     fprintf(stderr, "usage: dumpstate [-b soundfile] [-e soundfile] [-o file [-d] [-p] [-z]] [-s] [-q]\n"
             "  -o: write to file (instead of stdout)\n"
             "  -d: append date to filename (requires -o)\n"
+            "  -z: gzip output (adds .gz to the filename with -o)\n"
             "  -p: capture screenshot to filename.png (requires -o)\n"
             "  -s: write output to control socket (for init)\n"
             "  -b: play sound file instead of vibrate, at beginning of job\n"
@@ -596,6 +659,7 @@ int main(int argc, char *argv[]) {
     int use_socket = 0;
     int do_fb = 0;
     int do_broadcast = 0;
+    int do_compress = 0;
 
     if (getuid() != 0) {
         // Old versions of the adb client would call the
@@ -631,6 +695,7 @@ int main(int argc, char *argv[]) {
             case 'v': break;  // compatibility no-op
             case 'q': do_vibrate = 0;        break;
             case 'p': do_fb = 1;             break;
+            case 'z': do_compress = 1;       break;
             case 'B': do_broadcast = 1;      break;
             case '?': printf("\n");
             case 'h':
@@ -708,7 +773,6 @@ int main(int argc, char *argv[]) {
 
     /* redirect output if needed */
     char path[PATH_MAX], tmp_path[PATH_MAX];
-    pid_t gzip_pid = -1;
 
     if (!use_socket && use_outfile) {
         strlcpy(path, use_outfile, sizeof(path));
@@ -722,11 +786,14 @@ int main(int argc, char *argv[]) {
             strlcpy(screenshot_path, path, sizeof(screenshot_path));
             strlcat(screenshot_path, ".png", sizeof(screenshot_path));
         }
-        strlcat(path, ".txt", sizeof(path));
+        strlcat(path, do_compress ? ".txt.gz" : ".txt", sizeof(path));
         strlcpy(tmp_path, path, sizeof(tmp_path));
         strlcat(tmp_path, ".tmp", sizeof(tmp_path));
         redirect_to_file(stdout, tmp_path);
     }
+    if (do_compress && redirect_to_gzip(stdout) != 0) {
+        do_compress = 0;
+    }
 
     dumpstate();
 
@@ -739,10 +806,9 @@ int main(int argc, char *argv[]) {
         fclose(vibrator);
     }
 
-    /* wait for gzip to finish, otherwise it might get killed when we exit */
-    if (gzip_pid > 0) {
-        fclose(stdout);
-        waitpid(gzip_pid, NULL, 0);
+    /* wait for the compressed output to be written before renaming it */
+    if (do_compress) {
+        finish_gzip(stdout);
     }
 
     /* rename the (now complete) .tmp file to its final location */
@@ -48,6 +48,22 @@ int dump_files(const char *title, const char *dir,
 /* forks a command and waits for it to finish -- terminate args with NULL */
 int run_command(const char *title, int timeout_seconds, const char *command, ...);
 
+/* starts a section of output that runs at the same time as the following
+ * ones, in a child process killed after timeout_seconds. Returns true in the
+ * process that must produce the section, which then calls end_section(), and
+ * false in the caller. Sections are written out in the order they were
+ * started, each followed by its duration; nothing else may be printed until
+ * flush_sections() returns. "dumpstate.max_sections" limits how many run at
+ * once; 1 runs them one after the other in the caller.
+ */
+bool start_section(const char *name, int timeout_seconds);
+
+/* ends the section the current process produces */
+void end_section();
+
+/* waits for all sections started to be written out */
+void flush_sections();
+
 /* prints all the system properties */
 void print_properties();
 
@@ -57,6 +73,14 @@ void redirect_to_socket(FILE *redirect, const char *service);
 /* redirect output to a file */
 void redirect_to_file(FILE *redirect, char *path);
 
+/* compress output with gzip, on a thread of its own, before it goes to
+ * wherever it was redirected to */
+int redirect_to_gzip(FILE *redirect);
+
+/* ends the compressed output and waits for it to be written; later output to
+ * redirect is discarded */
+void finish_gzip(FILE *redirect);
+
 /* dump Dalvik and native stack traces, return the trace file location (NULL if none) */
 const char *dump_traces();
 
@@ -19,6 +19,7 @@
 #include <fcntl.h>
 #include <limits.h>
 #include <poll.h>
+#include <pthread.h>
 #include <signal.h>
 #include <stdarg.h>
 #include <stdio.h>
@@ -40,6 +41,8 @@
 
 #include <selinux/android.h>
 
+#include <zlib.h>
+
 #include "dumpstate.h"
 
 static const int64_t NANOS_PER_SEC = 1000000000;
@@ -514,6 +517,247 @@ int run_command(const char *title, int timeout_seconds, const char *command, ...
     return status;
 }
 
+/* Sections run in child processes writing their output to a pipe. The
+ * output of the oldest unfinished section is written out as it comes, the
+ * others are buffered until it is their turn.
+ */
+#define MAX_SECTIONS 32
+
+typedef struct {
+    char name[80];
+    pid_t pid;              /* 0 once reaped */
+    int fd;                 /* -1 at EOF */
+    char *buf;
+    size_t len, size;
+    uint64_t start, elapsed, deadline;
+    bool timed_out;
+    int status;
+} section_t;
+
+static section_t sections[MAX_SECTIONS];
+static size_t num_sections;
+static int max_running_sections = -1;
+static bool in_section_child;
+
+/* sections run in the caller, when they can't run in parallel */
+#define MAX_INLINE_SECTIONS 4
+static struct {
+    char name[80];
+    uint64_t start;
+} inline_sections[MAX_INLINE_SECTIONS];
+static size_t num_inline_sections;
+
+static size_t running_sections() {
+    size_t running = 0;
+    for (size_t i = 0; i < num_sections; i++) {
+        if (sections[i].pid > 0) running++;
+    }
+    return running;
+}
+
+static void section_output(section_t *section, const char *data, size_t len) {
+    if (section == &sections[0]) {
+        fwrite(data, len, 1, stdout);
+        return;
+    }
+    if (section->len + len > section->size) {
+        size_t size = section->size ? section->size * 2 : 65536;
+        while (size < section->len + len) size *= 2;
+        char *buf = realloc(section->buf, size);
+        if (buf == NULL) return;
+        section->buf = buf;
+        section->size = size;
+    }
+    memcpy(section->buf + section->len, data, len);
+    section->len += len;
+}
+
+static void section_printf(section_t *section, const char *fmt, ...) {
+    char line[256];
+    va_list ap;
+    va_start(ap, fmt);
+    int len = vsnprintf(line, sizeof(line), fmt, ap);
+    va_end(ap);
+    if (len > 0) {
+        section_output(section, line, (size_t) len < sizeof(line) ? (size_t) len : sizeof(line) - 1);
+    }
+}
+
+static void print_section_elapsed(const char *name, uint64_t elapsed) {
+    if (name[0]) printf("[%s section: %.3fs elapsed]\n\n", name, (float) elapsed / NANOS_PER_SEC);
+}
+
+/* Writes out the sections which are done, in the order they were started. */
+static void write_finished_sections() {
+    while (num_sections > 0 && sections[0].pid == 0) {
+        section_t *section = &sections[0];
+        if (section->timed_out) {
+            printf("*** %s: Timed out after %.3fs (killed)\n", section->name,
+                   (float) section->elapsed / NANOS_PER_SEC);
+        } else if (WIFSIGNALED(section->status)) {
+            printf("*** %s: Killed by signal %d\n", section->name, WTERMSIG(section->status));
+        }
+        print_section_elapsed(section->name, section->elapsed);
+        free(section->buf);
+        memmove(&sections[0], &sections[1], (num_sections - 1) * sizeof(section_t));
+        num_sections--;
+        if (num_sections > 0) {
+            fwrite(sections[0].buf, sections[0].len, 1, stdout);
+            sections[0].len = 0;
+        }
+    }
+    fflush(stdout);
+}
+
+/* Reads the output of running sections until one of them is done. */
+static void wait_for_sections() {
+    struct pollfd fds[MAX_SECTIONS];
+    size_t index[MAX_SECTIONS];
+    size_t nfds = 0;
+    uint64_t now = nanotime();
+    int timeout_ms = -1;
+
+    for (size_t i = 0; i < num_sections; i++) {
+        section_t *section = &sections[i];
+        if (section->fd < 0) continue;
+        if (now >= section->deadline) {
+            if (!section->timed_out) {
+                kill(section->pid, SIGKILL);
+                section->timed_out = true;
+                section->elapsed = now - section->start;
+                /* give what it started a few seconds to go away with it */
+                section->deadline = now + 5 * NANOS_PER_SEC;
+            } else {
+                /* something still holds the pipe: stop reading it */
+                close(section->fd);
+                section->fd = -1;
+                TEMP_FAILURE_RETRY(waitpid(section->pid, &section->status, 0));
+                section->pid = 0;
+                continue;
+            }
+        }
+        int ms = (section->deadline - now) / 1000000 + 1;
+        if (timeout_ms < 0 || ms < timeout_ms) timeout_ms = ms;
+        fds[nfds].fd = section->fd;
+        fds[nfds].events = POLLIN;
+        index[nfds++] = i;
+    }
+    if (nfds == 0) {
+        write_finished_sections();
+        return;
+    }
+
+    int ret = TEMP_FAILURE_RETRY(poll(fds, nfds, timeout_ms));
+    for (size_t n = 0; ret > 0 && n < nfds; n++) {
+        if (!fds[n].revents) continue;
+        section_t *section = &sections[index[n]];
+        char buffer[65536];
+        ssize_t bytes_read = TEMP_FAILURE_RETRY(read(section->fd, buffer, sizeof(buffer)));
+        if (bytes_read > 0) {
+            section_output(section, buffer, bytes_read);
+            continue;
+        }
+        if (bytes_read < 0) {
+            section_printf(section, "*** %s: Failed to read section output: %s\n",
+                           section->name, strerror(errno));
+        }
+        close(section->fd);
+        section->fd = -1;
+        if (TEMP_FAILURE_RETRY(waitpid(section->pid, &section->status, 0)) < 0) {
+            section->status = 0;
+        }
+        section->pid = 0;
+        if (!section->timed_out) section->elapsed = nanotime() - section->start;
+    }
+    write_finished_sections();
+}
+
+static void start_inline_section(const char *name) {
+    if (num_inline_sections < MAX_INLINE_SECTIONS) {
+        strlcpy(inline_sections[num_inline_sections].name, name ? name : "",
+                sizeof(inline_sections[0].name));
+        inline_sections[num_inline_sections].start = nanotime();
+    }
+    num_inline_sections++;
+}
+
+bool start_section(const char *name, int timeout_seconds) {
+    if (max_running_sections < 0) {
+        char value[PROPERTY_VALUE_MAX];
+        property_get("dumpstate.max_sections", value, "4");
+        max_running_sections = atoi(value);
+    }
+    if (max_running_sections <= 1) {
+        start_inline_section(name);
+        return true;
+    }
+    while (num_sections == MAX_SECTIONS
+            || running_sections() >= (size_t) max_running_sections) {
+        wait_for_sections();
+    }
+
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        flush_sections();
+        start_inline_section(name);
+        return true;
+    }
+    fflush(stdout);
+    pid_t pid = fork();
+    if (pid < 0) {
+        close(fds[0]);
+        close(fds[1]);
+        flush_sections();
+        start_inline_section(name);
+        return true;
+    }
+    if (pid == 0) {
+        /* make sure the section dies when dumpstate dies */
+        prctl(PR_SET_PDEATHSIG, SIGKILL);
+        TEMP_FAILURE_RETRY(dup2(fds[1], STDOUT_FILENO));
+        close(fds[0]);
+        close(fds[1]);
+        for (size_t i = 0; i < num_sections; i++) {
+            if (sections[i].fd >= 0) close(sections[i].fd);
+            free(sections[i].buf);
+        }
+        num_sections = 0;
+        num_inline_sections = 0;
+        in_section_child = true;
+        return true;
+    }
+
+    close(fds[1]);
+    section_t *section = &sections[num_sections++];
+    memset(section, 0, sizeof(*section));
+    strlcpy(section->name, name ? name : "", sizeof(section->name));
+    section->pid = pid;
+    section->fd = fds[0];
+    section->start = nanotime();
+    section->deadline = section->start + (uint64_t) timeout_seconds * NANOS_PER_SEC;
+    write_finished_sections();
+    return false;
+}
+
+void end_section() {
+    flush_sections();
+    if (num_inline_sections > 0) {
+        if (--num_inline_sections < MAX_INLINE_SECTIONS) {
+            print_section_elapsed(inline_sections[num_inline_sections].name,
+                                  nanotime() - inline_sections[num_inline_sections].start);
+        }
+    } else if (in_section_child) {
+        fflush(stdout);
+        _exit(0);
+    }
+}
+
+void flush_sections() {
+    while (num_sections > 0) {
+        wait_for_sections();
+    }
+}
+
 size_t num_props = 0;
 static char* props[2000];
 
@@ -600,6 +844,109 @@ void redirect_to_file(FILE *redirect, char *path) {
     close(fd);
 }
 
+static int gzip_in_fd = -1;
+static int gzip_out_fd = -1;
+static pthread_t gzip_thread;
+
+static bool write_fully(int fd, const void *data, size_t len) {
+    const char *p = data;
+    while (len > 0) {
+        ssize_t n = TEMP_FAILURE_RETRY(write(fd, p, len));
+        if (n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+static void *gzip_main(void *arg) {
+    static char in[65536], out[65536];
+    z_stream zs;
+    memset(&zs, 0, sizeof(zs));
+    /* 16 + MAX_WBITS: gzip header and trailer */
+    if (deflateInit2(&zs, Z_DEFAULT_COMPRESSION, Z_DEFLATED, 16 + MAX_WBITS, 8,
+                     Z_DEFAULT_STRATEGY) != Z_OK) {
+        /* pass the output through as is, rather than lose it */
+        fprintf(stderr, "deflateInit2 failed, not compressing\n");
+        ssize_t bytes_read;
+        while ((bytes_read = TEMP_FAILURE_RETRY(read(gzip_in_fd, in, sizeof(in)))) > 0) {
+            write_fully(gzip_out_fd, in, bytes_read);
+        }
+        close(gzip_in_fd);
+        close(gzip_out_fd);
+        return NULL;
+    }
+    bool ok = true;
+    int flush = Z_NO_FLUSH;
+    while (flush != Z_FINISH) {
+        ssize_t bytes_read = TEMP_FAILURE_RETRY(read(gzip_in_fd, in, sizeof(in)));
+        if (bytes_read <= 0) {
+            flush = Z_FINISH;
+            bytes_read = 0;
+        }
+        zs.next_in = (Bytef *) in;
+        zs.avail_in = bytes_read;
+        do {
+            zs.next_out = (Bytef *) out;
+            zs.avail_out = sizeof(out);
+            deflate(&zs, flush);
+            size_t len = sizeof(out) - zs.avail_out;
+            /* keep reading on errors, so that writers don't block */
+            if (ok && len > 0 && !write_fully(gzip_out_fd, out, len)) {
+                fprintf(stderr, "writing compressed output failed: %s\n", strerror(errno));
+                ok = false;
+            }
+        } while (zs.avail_out == 0);
+    }
+    deflateEnd(&zs);
+    close(gzip_in_fd);
+    close(gzip_out_fd);
+    return NULL;
+}
+
+/* compress what is written to redirect with gzip, on a thread of its own */
+int redirect_to_gzip(FILE *redirect) {
+    int fds[2];
+
+    fflush(redirect);
+    gzip_out_fd = fcntl(fileno(redirect), F_DUPFD_CLOEXEC, 0);
+    if (gzip_out_fd < 0) {
+        fprintf(stderr, "dup: %s\n", strerror(errno));
+        return -1;
+    }
+    if (pipe2(fds, O_CLOEXEC) < 0) {
+        fprintf(stderr, "pipe: %s\n", strerror(errno));
+        close(gzip_out_fd);
+        return -1;
+    }
+    gzip_in_fd = fds[0];
+    if (pthread_create(&gzip_thread, NULL, gzip_main, NULL) != 0) {
+        fprintf(stderr, "pthread_create failed\n");
+        close(fds[0]);
+        close(fds[1]);
+        close(gzip_out_fd);
+        return -1;
+    }
+    TEMP_FAILURE_RETRY(dup2(fds[1], fileno(redirect)));
+    close(fds[1]);
+    return 0;
+}
+
+/* end the compressed output of redirect and wait for it to be written; redirect
+ * itself stays open, on /dev/null, so it can still be written to afterwards */
+void finish_gzip(FILE *redirect) {
+    fflush(redirect);
+    int null_fd = TEMP_FAILURE_RETRY(open("/dev/null", O_WRONLY | O_CLOEXEC));
+    if (null_fd >= 0) {
+        /* replacing the pipe's write end closes it, which ends the gzip stream */
+        TEMP_FAILURE_RETRY(dup2(null_fd, fileno(redirect)));
+        close(null_fd);
+    } else {
+        close(fileno(redirect));
+    }
+    pthread_join(gzip_thread, NULL);
+}
+
 static bool should_dump_native_traces(const char* path) {
     for (const char** p = native_processes_to_dump; *p; p++) {
         if (!strcmp(*p, path)) {
@@ -10,15 +10,22 @@
 #include <binder/ProcessState.h>
 #include <binder/IServiceManager.h>
 #include <binder/TextOutput.h>
+#include <binder/TransactionStats.h>
+#include <utils/Timers.h>
 #include <utils/Vector.h>
 
+#include <fcntl.h>
 #include <getopt.h>
+#include <poll.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
 #include <unistd.h>
 #include <sys/time.h>
 
+#include <string>
+
 using namespace android;
 
 static int sort_func(const String16* lhs, const String16* rhs)
@@ -26,6 +33,115 @@ static int sort_func(const String16* lhs, const String16* rhs)
     return lhs->compare(*rhs);
 }
 
+// Services are dumped by threads of their own, each into a pipe, so a slow
+// service can be given up on once it times out.  The output is still written
+// in the order of the services: the pipe of the first unfinished service is
+// copied to stdout as it is read, and the others are buffered until their turn.
+//
+// Most services live in system_server, where dumping several at once makes
+// their dumps contend for the same locks and binder threads that the rest of
+// the system is waiting on.  There is no telling from here which process a
+// service is in, so by default they are dumped one at a time, and -j is only
+// meant for when the services dumped are known to be in different processes.
+struct DumpJob {
+    String16 name;
+    sp<IBinder> service;
+    Vector<String16> args;
+    int readFd;
+    int writeFd;
+    int err;
+    bool running;
+    bool done;
+    bool timedOut;
+    bool headerShown;
+    nsecs_t start;
+    nsecs_t elapsed;
+    pthread_t thread;
+    std::string buffer;
+};
+
+static const size_t MAX_JOBS_DEFAULT = 1;
+static const int TIMEOUT_DEFAULT_SECONDS = 10;
+
+static void* dump_thread(void* arg)
+{
+    DumpJob* job = (DumpJob*)arg;
+    job->err = job->service->dump(job->writeFd, job->args);
+    close(job->writeFd);
+    return NULL;
+}
+
+static bool start_job(DumpJob* job)
+{
+    int fds[2];
+    if (pipe2(fds, O_CLOEXEC) == -1) {
+        job->err = errno;
+        return false;
+    }
+    job->readFd = fds[0];
+    job->writeFd = fds[1];
+    nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    int err = pthread_create(&job->thread, NULL, dump_thread, job);
+    if (err != 0) {
+        close(fds[0]);
+        close(fds[1]);
+        job->readFd = -1;
+        job->err = err;
+        return false;
+    }
+    job->start = start;
+    job->running = true;
+    return true;
+}
+
+static void write_fully(int fd, const char* buf, size_t len)
+{
+    while (len > 0) {
+        ssize_t n = TEMP_FAILURE_RETRY(write(fd, buf, len));
+        if (n <= 0) {
+            return;
+        }
+        buf += n;
+        len -= n;
+    }
+}
+
+// Prints the binder transaction histograms kept by the service's process,
+// see TransactionStats.
+static void dump_binder_stats(const String16& name, const sp<IBinder>& service)
+{
+    Parcel data, reply;
+    data.writeInterfaceToken(service->getInterfaceDescriptor());
+    data.writeInt32(TransactionStats::CMD_DUMP);
+    status_t err = service->transact(IBinder::STATS_TRANSACTION, data, &reply);
+    if (err != NO_ERROR) {
+        aerr << "Error getting binder stats: (" << strerror(-err) << ") " << name << endl;
+        return;
+    }
+    aout << "BINDER STATS OF SERVICE " << name << ":" << endl;
+    aout << reply.readString16();
+}
+
+static void usage()
+{
+    fprintf(stderr,
+        "usage: dumpsys\n"
+        "         To dump all services.\n"
+        "or:\n"
+        "       dumpsys [-t TIMEOUT] [-j JOBS] [--proto] [-l | SERVICE [ARGS]]\n"
+        "or:\n"
+        "       dumpsys --binder-stats [SERVICE]\n"
+        "         To print the binder transaction latencies of the processes that\n"
+        "         host all services, or SERVICE, if they are being recorded.\n"
+        "         -t TIMEOUT: seconds to wait for each service to finish dumping (default %d)\n"
+        "         -j JOBS: number of services to dump at the same time (default %zu)\n"
+        "         --proto: ask the services for, and pass through, their binary dump;\n"
+        "             each service's dump is then framed as a \"NAME LENGTH\" line\n"
+        "             followed by LENGTH bytes, unless a single service is dumped\n"
+        "         -l: only list services, do not dump them\n",
+        TIMEOUT_DEFAULT_SECONDS, MAX_JOBS_DEFAULT);
+}
+
 int main(int argc, char* const argv[])
 {
     signal(SIGPIPE, SIG_IGN);
@@ -40,23 +156,72 @@ int main(int argc, char* const argv[])
     Vector<String16> services;
     Vector<String16> args;
     bool showListOnly = false;
-    if ((argc == 2) && (strcmp(argv[1], "-l") == 0)) {
-        showListOnly = true;
+    bool proto = false;
+    bool binderStats = false;
+    int timeoutSeconds = TIMEOUT_DEFAULT_SECONDS;
+    size_t maxJobs = MAX_JOBS_DEFAULT;
+
+    static struct option longOptions[] = {
+        {       "proto", no_argument, 0, 0 },
+        {"binder-stats", no_argument, 0, 0 },
+        {             0,           0, 0, 0 }
+    };
+    for (;;) {
+        int optionIndex = 0;
+        // "+" stops at the service name, so its arguments are left alone.
+        int c = getopt_long(argc, argv, "+hlj:t:", longOptions, &optionIndex);
+        if (c == -1) {
+            break;
+        }
+        switch (c) {
+        case 0:
+            if (optionIndex == 0) {
+                proto = true;
+            } else {
+                binderStats = true;
+            }
+            break;
+        case 'l':
+            showListOnly = true;
+            break;
+        case 'j':
+            maxJobs = atoi(optarg) > 0 ? atoi(optarg) : 1;
+            break;
+        case 't':
+            timeoutSeconds = atoi(optarg);
+            if (timeoutSeconds <= 0) {
+                fprintf(stderr, "Error: invalid timeout %s\n", optarg);
+                usage();
+                return -1;
+            }
+            break;
+        case 'h':
+            usage();
+            return 0;
+        default:
+            fprintf(stderr, "\n");
+            usage();
+            return -1;
+        }
     }
-    if ((argc == 1) || showListOnly) {
+
+    if ((optind == argc) || showListOnly) {
         services = sm->listServices();
         services.sort(sort_func);
         args.add(String16("-a"));
     } else {
-        services.add(String16(argv[1]));
-        for (int i=2; i<argc; i++) {
+        services.add(String16(argv[optind]));
+        for (int i=optind+1; i<argc; i++) {
             args.add(String16(argv[i]));
         }
     }
+    if (proto) {
+        args.add(String16("--proto"));
+    }
 
     const size_t N = services.size();
 
-    if (N > 1) {
+    if (N > 1 && !proto && !binderStats) {
         // first print a list of the current services
         aout << "Currently running services:" << endl;
     
@@ -72,23 +237,176 @@ int main(int argc, char* const argv[])
         return 0;
     }
 
+    if (binderStats) {
+        for (size_t i=0; i<N; i++) {
+            sp<IBinder> service = sm->checkService(services[i]);
+            if (service == NULL) {
+                aerr << "Can't find service: " << services[i] << endl;
+                continue;
+            }
+            dump_binder_stats(services[i], service);
+        }
+        return 0;
+    }
+
+    // With several services the binary dumps have to be framed, which needs
+    // the length of each up front, so they are all buffered.
+    const bool frame = proto && N > 1;
+    const bool decorate = !proto && N > 1;
+    const nsecs_t timeout = seconds_to_nanoseconds(timeoutSeconds);
+
+    Vector<DumpJob*> jobs;
     for (size_t i=0; i<N; i++) {
-        sp<IBinder> service = sm->checkService(services[i]);
-        if (service != NULL) {
-            if (N > 1) {
-                aout << "------------------------------------------------------------"
-                        "-------------------" << endl;
-                aout << "DUMP OF SERVICE " << services[i] << ":" << endl;
+        DumpJob* job = new DumpJob();
+        job->name = services[i];
+        job->service = sm->checkService(services[i]);
+        job->args = args;
+        job->readFd = -1;
+        job->writeFd = -1;
+        job->err = 0;
+        job->running = false;
+        job->done = false;
+        job->timedOut = false;
+        job->headerShown = false;
+        job->start = 0;
+        job->elapsed = 0;
+        jobs.add(job);
+    }
+
+    size_t nextStart = 0;
+    size_t nextOutput = 0;
+    size_t running = 0;
+    char buf[64*1024];
+    struct pollfd* pfds = new struct pollfd[maxJobs];
+    DumpJob** pjobs = new DumpJob*[maxJobs];
+
+    while (nextOutput < N) {
+        while (running < maxJobs && nextStart < N) {
+            DumpJob* job = jobs[nextStart++];
+            if (job->service != NULL && start_job(job)) {
+                running++;
+            } else {
+                job->done = true;
+            }
+        }
+
+        // Write out, in order, whatever has finished.  The first unfinished
+        // job is the one that gets streamed.
+        while (nextOutput < nextStart) {
+            DumpJob* job = jobs[nextOutput];
+            if (job->start == 0) {
+                if (job->service == NULL) {
+                    aerr << "Can't find service: " << job->name << endl;
+                } else {
+                    aerr << "Error dumping service info: (" << strerror(job->err)
+                            << ") " << job->name << endl;
+                }
+                delete job;
+                jobs.editItemAt(nextOutput++) = NULL;
+                continue;
+            }
+
+            if (!job->headerShown) {
+                job->headerShown = true;
+                if (decorate) {
+                    aout << "------------------------------------------------------------"
+                            "-------------------" << endl;
+                    aout << "DUMP OF SERVICE " << job->name << ":" << endl;
+                }
+            }
+            if (frame && job->done) {
+                String8 name(job->name);
+                char header[256];
+                int n = snprintf(header, sizeof(header), "%s %zu\n", name.string(),
+                        job->buffer.size());
+                write_fully(STDOUT_FILENO, header, n);
             }
-            int err = service->dump(STDOUT_FILENO, args);
-            if (err != 0) {
-                aerr << "Error dumping service info: (" << strerror(err)
-                        << ") " << services[i] << endl;
+            if (!frame || job->done) {
+                write_fully(STDOUT_FILENO, job->buffer.data(), job->buffer.size());
+                job->buffer.clear();
+            }
+            if (!job->done) {
+                break;
+            }
+
+            if (job->timedOut) {
+                (proto ? aerr : aout) << "*** SERVICE '" << job->name << "' DUMP TIMEOUT ("
+                        << timeoutSeconds << "s) EXPIRED ***" << endl;
+            } else if (job->err != 0) {
+                aerr << "Error dumping service info: (" << strerror(job->err)
+                        << ") " << job->name << endl;
+            }
+            if (decorate) {
+                char duration[32];
+                snprintf(duration, sizeof(duration), "%.3f", job->elapsed / 1e9);
+                aout << "--------- " << duration << "s was the duration of dumpsys "
+                        << job->name << endl;
+            }
+
+            // A job that timed out may still be stuck in its dump call, so
+            // its thread is left to it and the job is never freed.
+            if (!job->timedOut) {
+                delete job;
+            }
+            jobs.editItemAt(nextOutput++) = NULL;
+        }
+        if (nextOutput == N) {
+            break;
+        }
+
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        nsecs_t wait = timeout;
+        size_t count = 0;
+        for (size_t i=nextOutput; i<nextStart; i++) {
+            DumpJob* job = jobs[i];
+            if (job->running) {
+                if (job->start + timeout - now < wait) {
+                    wait = job->start + timeout - now;
+                }
+                pfds[count].fd = job->readFd;
+                pfds[count].events = POLLIN;
+                pfds[count].revents = 0;
+                pjobs[count++] = job;
+            }
+        }
+
+        int ready = poll(pfds, count, wait > 0 ? (int)ns2ms(wait) + 1 : 0);
+        if (ready == -1 && errno != EINTR) {
+            aerr << "dumpsys: poll failed: " << strerror(errno) << endl;
+            return 1;
+        }
+
+        now = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (size_t i=0; i<count; i++) {
+            DumpJob* job = pjobs[i];
+            if (pfds[i].revents != 0) {
+                ssize_t n = TEMP_FAILURE_RETRY(read(job->readFd, buf, sizeof(buf)));
+                if (n > 0) {
+                    if (job == jobs[nextOutput] && job->headerShown && !frame) {
+                        write_fully(STDOUT_FILENO, buf, n);
+                    } else {
+                        job->buffer.append(buf, n);
+                    }
+                    continue;
+                }
+                // The dump is over once the thread closes its end.
+                pthread_join(job->thread, NULL);
+            } else if (now - job->start < timeout) {
+                continue;
+            } else {
+                job->timedOut = true;
+                pthread_detach(job->thread);
             }
-        } else {
-            aerr << "Can't find service: " << services[i] << endl;
+            job->elapsed = now - job->start;
+            close(job->readFd);
+            job->readFd = -1;
+            job->running = false;
+            job->done = true;
+            running--;
         }
     }
 
+    delete[] pfds;
+    delete[] pjobs;
     return 0;
 }
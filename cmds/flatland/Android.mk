@@ -4,6 +4,8 @@ include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:=   \
     Composers.cpp   \
+    Composition.cpp \
+    Report.cpp      \
     GLHelper.cpp    \
     Renderers.cpp   \
     Main.cpp        \
@@ -18,6 +20,7 @@ LOCAL_MODULE_STEM_32 := flatland
 LOCAL_MODULE_STEM_64 := flatland64
 LOCAL_SHARED_LIBRARIES := \
     libEGL      \
+    libbinder   \
     libGLESv2   \
     libcutils   \
     libgui      \
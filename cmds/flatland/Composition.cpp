@@ -0,0 +1,515 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_ALWAYS
+
+#include <binder/IServiceManager.h>
+#include <gui/SurfaceControl.h>
+#include <ui/FrameStats.h>
+#include <utils/Timers.h>
+#include <utils/Trace.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <errno.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include "Flatland.h"
+#include "GLHelper.h"
+
+namespace android {
+
+// The composition scenarios don't measure flatland's own GLES compositing,
+// but SurfaceFlinger's: each layer is a real SurfaceFlinger layer, stacked
+// full screen above everything else, and redrawn every frame.  What
+// SurfaceFlinger's main thread did for those frames is read from its frame
+// trace (dumpsys SurfaceFlinger --frametrace -binary), and how the layers'
+// frames were presented from their FrameStats.
+
+struct CompositionDesc {
+    // The name of the scenario.
+    const char* name;
+
+    // The number of layers.
+    uint32_t numLayers;
+
+    // Whether the layers are translucent, and so have to be blended.
+    bool blend;
+
+    // The size of the layers' buffers relative to the display; they are
+    // scaled to fill it.
+    float bufferScale;
+
+    // The fraction of the rows of each layer redrawn every frame, and
+    // reported as damaged.
+    float damage;
+};
+
+static const CompositionDesc compositions[] = {
+    { "1 Opaque Layer",              1, false, 1.0f, 1.0f },
+    { "2 Opaque Layers",             2, false, 1.0f, 1.0f },
+    { "4 Opaque Layers",             4, false, 1.0f, 1.0f },
+    { "8 Opaque Layers",             8, false, 1.0f, 1.0f },
+    { "2 Blended Layers",            2, true,  1.0f, 1.0f },
+    { "4 Blended Layers",            4, true,  1.0f, 1.0f },
+    { "8 Blended Layers",            8, true,  1.0f, 1.0f },
+    { "4 Scaled Opaque Layers",      4, false, 0.5f, 1.0f },
+    { "4 Scaled Blended Layers",     4, true,  0.5f, 1.0f },
+    { "4 Opaque Layers, 10% Damage", 4, false, 1.0f, 0.1f },
+    { "4 Blended Layers, 10% Damage", 4, true, 1.0f, 0.1f },
+};
+
+// The frame trace only keeps SurfaceFlinger's last 128 frames.
+static const uint32_t kMeasuredFrames = 100;
+static const uint32_t kWarmUpFrames = 10;
+
+// The layers go above anything else on screen.
+static const uint32_t kBaseLayerZ = 0x7FFFFF00;
+
+// The frame trace binary dump format, see FrameTrace.cpp in SurfaceFlinger.
+static const uint32_t kFrameTraceMagic = 'sftr';
+static const uint32_t kFrameTraceVersion = 1;
+static const uint32_t kFrameTraceFlagRefresh = 0x2;
+
+struct CompositionResult {
+    uint32_t frames;
+    double mainThreadMeanMs;
+    double mainThreadP90Ms;
+    double hwcLayers;
+    double glesLayers;
+    double glesFramePercent;
+    uint64_t jankyFrames;
+    double presentLatencyP90Ms;
+};
+
+struct DumpReader {
+    int fd;
+    std::vector<uint8_t> data;
+};
+
+static void* readDump(void* arg) {
+    DumpReader* reader = static_cast<DumpReader*>(arg);
+    uint8_t buf[16*1024];
+    ssize_t n;
+    while ((n = TEMP_FAILURE_RETRY(read(reader->fd, buf, sizeof(buf)))) > 0) {
+        reader->data.insert(reader->data.end(), buf, buf + n);
+    }
+    return NULL;
+}
+
+// Get SurfaceFlinger's frame trace.  It's read by another thread while
+// SurfaceFlinger writes it, since it may not fit in the pipe.
+static bool dumpFrameTrace(std::vector<uint8_t>* out) {
+    sp<IBinder> sf = defaultServiceManager()->checkService(
+            String16("SurfaceFlinger"));
+    if (sf == NULL) {
+        fprintf(stderr, "SurfaceFlinger service not found.\n");
+        return false;
+    }
+
+    int fds[2];
+    if (pipe(fds) != 0) {
+        fprintf(stderr, "pipe error: %s\n", strerror(errno));
+        return false;
+    }
+
+    DumpReader reader;
+    reader.fd = fds[0];
+    pthread_t thread;
+    if (pthread_create(&thread, NULL, readDump, &reader) != 0) {
+        fprintf(stderr, "pthread_create error\n");
+        close(fds[0]);
+        close(fds[1]);
+        return false;
+    }
+
+    Vector<String16> args;
+    args.add(String16("--frametrace"));
+    args.add(String16("-binary"));
+    status_t err = sf->dump(fds[1], args);
+    close(fds[1]);
+    pthread_join(thread, NULL);
+    close(fds[0]);
+
+    if (err != NO_ERROR) {
+        fprintf(stderr, "SurfaceFlinger dump error: %#x\n", err);
+        return false;
+    }
+    out->swap(reader.data);
+    return true;
+}
+
+class FrameTraceParser {
+public:
+    FrameTraceParser(const std::vector<uint8_t>& data) :
+        mData(data), mPos(0), mOk(true) {}
+
+    template <typename T>
+    T read() {
+        T value = 0;
+        if (mPos + sizeof(T) > mData.size()) {
+            mOk = false;
+        } else {
+            memcpy(&value, &mData[mPos], sizeof(T));
+            mPos += sizeof(T);
+        }
+        return value;
+    }
+
+    void skip(size_t len) {
+        if (mPos + len > mData.size()) {
+            mOk = false;
+        } else {
+            mPos += len;
+        }
+    }
+
+    bool ok() const { return mOk; }
+
+private:
+    const std::vector<uint8_t>& mData;
+    size_t mPos;
+    bool mOk;
+};
+
+// Sum up what SurfaceFlinger's main thread did in the frames it woke up for
+// between start and end.
+static bool summarizeFrameTrace(const std::vector<uint8_t>& data,
+        nsecs_t start, nsecs_t end, CompositionResult* result) {
+    FrameTraceParser p(data);
+
+    if (p.read<uint32_t>() != kFrameTraceMagic ||
+            p.read<uint32_t>() != kFrameTraceVersion) {
+        fprintf(stderr, "SurfaceFlinger frame trace not recognized.\n");
+        return false;
+    }
+
+    std::vector<nsecs_t> mainThreadTimes;
+    uint64_t hwcLayers = 0, glesLayers = 0, glesFrames = 0;
+    uint32_t numFrames = p.read<uint32_t>();
+    for (uint32_t i = 0; i < numFrames && p.ok(); i++) {
+        p.read<uint64_t>();                         // frame number
+        uint32_t flags = p.read<uint32_t>();
+        nsecs_t wakeTime = p.read<int64_t>();
+        p.read<int64_t>();                          // refresh time
+        nsecs_t endTime = p.read<int64_t>();
+        p.read<int64_t>();                          // expected present time
+        p.read<int64_t>();                          // present time
+        p.read<int64_t>();                          // swap duration
+        p.read<int64_t>();                          // commit duration
+        uint32_t numHwcLayers = p.read<uint32_t>();
+        uint32_t numGlesLayers = p.read<uint32_t>();
+        uint32_t numLatches = p.read<uint32_t>();
+        p.read<uint32_t>();                         // latches not recorded
+        for (uint32_t j = 0; j < numLatches && p.ok(); j++) {
+            p.read<uint32_t>();                     // decision
+            p.read<uint64_t>();                     // frame number
+            p.read<int64_t>();                      // duration
+            p.skip(p.read<uint32_t>());             // layer name
+        }
+
+        if (wakeTime < start || wakeTime > end || endTime <= wakeTime ||
+                !(flags & kFrameTraceFlagRefresh)) {
+            continue;
+        }
+        mainThreadTimes.push_back(endTime - wakeTime);
+        hwcLayers += numHwcLayers;
+        glesLayers += numGlesLayers;
+        if (numGlesLayers > 0) {
+            glesFrames++;
+        }
+    }
+    if (!p.ok()) {
+        fprintf(stderr, "SurfaceFlinger frame trace truncated.\n");
+        return false;
+    }
+
+    size_t n = mainThreadTimes.size();
+    result->frames = n;
+    if (n == 0) {
+        return true;
+    }
+    std::sort(mainThreadTimes.begin(), mainThreadTimes.end());
+    double total = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        total += double(mainThreadTimes[i]);
+    }
+    result->mainThreadMeanMs = total / double(n) / 1e6;
+    result->mainThreadP90Ms = double(mainThreadTimes[(n - 1) * 9 / 10]) / 1e6;
+    result->hwcLayers = double(hwcLayers) / double(n);
+    result->glesLayers = double(glesLayers) / double(n);
+    result->glesFramePercent = 100.0 * double(glesFrames) / double(n);
+    return true;
+}
+
+class CompositionRunner {
+
+public:
+
+    CompositionRunner(const CompositionDesc& desc) :
+        mDesc(desc),
+        mGLHelper(NULL),
+        mDisplayWidth(0),
+        mDisplayHeight(0),
+        mBufferWidth(0),
+        mBufferHeight(0),
+        mFrame(0) {
+        for (size_t i = 0; i < MAX_NUM_LAYERS; i++) {
+            mSurfaces[i] = EGL_NO_SURFACE;
+        }
+    }
+
+    bool setUp() {
+        ATRACE_CALL();
+
+        bool result;
+
+        mGLHelper = new GLHelper();
+        result = mGLHelper->setUp(NULL, 0);
+        if (!result) {
+            return false;
+        }
+
+        result = mGLHelper->getDisplaySize(&mDisplayWidth, &mDisplayHeight);
+        if (!result) {
+            return false;
+        }
+        mBufferWidth = uint32_t(float(mDisplayWidth) * mDesc.bufferScale);
+        mBufferHeight = uint32_t(float(mDisplayHeight) * mDesc.bufferScale);
+
+        for (size_t i = 0; i < mDesc.numLayers; i++) {
+            result = mGLHelper->createLayerSurface(0, 0, kBaseLayerZ + i,
+                    mBufferWidth, mBufferHeight, 1.0f / mDesc.bufferScale,
+                    !mDesc.blend, &mSurfaceControls[i], &mSurfaces[i]);
+            if (!result) {
+                return false;
+            }
+        }
+
+        return true;
+    }
+
+    void tearDown() {
+        ATRACE_CALL();
+
+        if (mGLHelper != NULL) {
+            for (size_t i = 0; i < mDesc.numLayers; i++) {
+                if (mSurfaces[i] != EGL_NO_SURFACE) {
+                    mGLHelper->destroySurface(&mSurfaces[i]);
+                }
+                mSurfaceControls[i].clear();
+            }
+            mGLHelper->tearDown();
+            delete mGLHelper;
+            mGLHelper = NULL;
+        }
+    }
+
+    bool run(CompositionResult* result) {
+        ATRACE_CALL();
+
+        memset(result, 0, sizeof(*result));
+
+        for (uint32_t i = 0; i < kWarmUpFrames; i++) {
+            if (!doFrame()) {
+                return false;
+            }
+        }
+
+        for (size_t i = 0; i < mDesc.numLayers; i++) {
+            mSurfaceControls[i]->clearLayerFrameStats();
+        }
+
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (uint32_t i = 0; i < kMeasuredFrames; i++) {
+            if (!doFrame()) {
+                return false;
+            }
+        }
+        nsecs_t end = systemTime(SYSTEM_TIME_MONOTONIC);
+
+        // Let the last frames be composited and presented.
+        usleep(100 * 1000);
+
+        std::vector<uint8_t> trace;
+        if (!dumpFrameTrace(&trace) ||
+                !summarizeFrameTrace(trace, start, end, result)) {
+            return false;
+        }
+
+        for (size_t i = 0; i < mDesc.numLayers; i++) {
+            FrameStatsSummary summary;
+            status_t err = mSurfaceControls[i]->getLayerFrameStatsSummary(
+                    &summary);
+            if (err != NO_ERROR) {
+                fprintf(stderr, "getLayerFrameStatsSummary error: %#x\n", err);
+                return false;
+            }
+            result->jankyFrames += summary.jankyFrameCount;
+            // The 90th percentile is the second entry.
+            double latencyMs = double(summary.presentLatencyPercentilesNano[1])
+                    / 1e6;
+            if (latencyMs > result->presentLatencyP90Ms) {
+                result->presentLatencyP90Ms = latencyMs;
+            }
+        }
+
+        return true;
+    }
+
+private:
+
+    bool doFrame() {
+        // Redraw the damaged rows at the top of each layer in a new color.
+        EGLint damageHeight = EGLint(float(mBufferHeight) * mDesc.damage);
+        if (damageHeight < 1) {
+            damageHeight = 1;
+        }
+        EGLint damage[4] = {
+            0, EGLint(mBufferHeight) - damageHeight,
+            EGLint(mBufferWidth), damageHeight
+        };
+
+        for (size_t i = 0; i < mDesc.numLayers; i++) {
+            if (!mGLHelper->makeCurrent(mSurfaces[i])) {
+                return false;
+            }
+
+            float shade = float((mFrame + i) % 16) / 16.0f;
+            glEnable(GL_SCISSOR_TEST);
+            glScissor(damage[0], damage[1], damage[2], damage[3]);
+            glClearColor(shade, 1.0f - shade, 0.5f, mDesc.blend ? 0.5f : 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glDisable(GL_SCISSOR_TEST);
+
+            bool result = mDesc.damage < 1.0f ?
+                    mGLHelper->swapBuffersWithDamage(mSurfaces[i], damage, 1) :
+                    mGLHelper->swapBuffers(mSurfaces[i]);
+            if (!result) {
+                return false;
+            }
+        }
+        mFrame++;
+
+        return true;
+    }
+
+    const CompositionDesc& mDesc;
+
+    GLHelper* mGLHelper;
+
+    uint32_t mDisplayWidth;
+    uint32_t mDisplayHeight;
+    uint32_t mBufferWidth;
+    uint32_t mBufferHeight;
+
+    uint32_t mFrame;
+
+    sp<SurfaceControl> mSurfaceControls[MAX_NUM_LAYERS];
+    EGLSurface mSurfaces[MAX_NUM_LAYERS];
+};
+
+static size_t maxCompositionNameLen() {
+    size_t maxLen = strlen("Scenario");
+    for (size_t i = 0; i < NELEMS(compositions); i++) {
+        size_t len = strlen(compositions[i].name);
+        if (len > maxLen) {
+            maxLen = len;
+        }
+    }
+    return maxLen;
+}
+
+bool runCompositionTests(OutputFormat format) {
+    int nameLen = int(maxCompositionNameLen());
+
+    if (format == OUTPUT_CSV) {
+        printf("composition,scenario,layers,frames,sf_main_mean_ms,"
+                "sf_main_p90_ms,hwc_layers,gles_layers,gles_frame_pct,"
+                "janky_frames,present_latency_p90_ms,%s\n",
+                kDeviceStateCsvColumns);
+    } else if (format == OUTPUT_TEXT) {
+        printf(" %-*s | Frames | SF main thread (ms) | Layers HWC/GLES |"
+                " GLES frames | Janky | Latency p90 (ms)\n", nameLen,
+                "Scenario");
+        printf(" %*s |        |     mean      p90   |                 |"
+                "             |       |\n", nameLen, "");
+    }
+
+    for (size_t i = 0; i < NELEMS(compositions); i++) {
+        const CompositionDesc& c = compositions[i];
+        CompositionResult result;
+        DeviceState state;
+
+        CompositionRunner r(c);
+        bool ok = r.setUp() && r.run(&result);
+        r.tearDown();
+        if (!ok) {
+            fprintf(stderr, "error running composition scenario \"%s\".\n",
+                    c.name);
+            return false;
+        }
+        readDeviceState(&state);
+
+        if (format == OUTPUT_CSV) {
+            printf("composition,\"%s\",%u,%u,%.3f,%.3f,%.2f,%.2f,%.1f,%" PRIu64
+                    ",%.3f,", c.name, c.numLayers, result.frames,
+                    result.mainThreadMeanMs, result.mainThreadP90Ms,
+                    result.hwcLayers, result.glesLayers,
+                    result.glesFramePercent, result.jankyFrames,
+                    result.presentLatencyP90Ms);
+            printDeviceStateCsv(state);
+            printf("\n");
+        } else if (format == OUTPUT_JSON) {
+            printf("%s    { \"scenario\": ", i > 0 ? ",\n" : "");
+            printJsonString(c.name);
+            printf(", \"layers\": %u, \"blend\": %s, \"buffer_scale\": %.2f,"
+                    " \"damage\": %.2f,\n", c.numLayers,
+                    c.blend ? "true" : "false", c.bufferScale, c.damage);
+            printf("      \"frames\": %u, \"sf_main_mean_ms\": %.3f,"
+                    " \"sf_main_p90_ms\": %.3f,\n", result.frames,
+                    result.mainThreadMeanMs, result.mainThreadP90Ms);
+            printf("      \"hwc_layers\": %.2f, \"gles_layers\": %.2f,"
+                    " \"gles_frame_pct\": %.1f,\n", result.hwcLayers,
+                    result.glesLayers, result.glesFramePercent);
+            printf("      \"janky_frames\": %" PRIu64 ","
+                    " \"present_latency_p90_ms\": %.3f,\n",
+                    result.jankyFrames, result.presentLatencyP90Ms);
+            printf("      \"device\": ");
+            printDeviceStateJson(state);
+            printf(" }");
+        } else {
+            printf(" %-*s | %6u |   %6.3f   %6.3f   |  %5.2f / %5.2f  |"
+                    "    %5.1f%%   | %5" PRIu64 " | %8.3f\n", nameLen, c.name,
+                    result.frames, result.mainThreadMeanMs,
+                    result.mainThreadP90Ms, result.hwcLayers,
+                    result.glesLayers, result.glesFramePercent,
+                    result.jankyFrames, result.presentLatencyP90Ms);
+        }
+        fflush(stdout);
+    }
+
+    return true;
+}
+
+} // namespace android
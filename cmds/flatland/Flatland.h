@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <stddef.h>
 #include <stdint.h>
 
 #include <EGL/egl.h>
@@ -68,4 +69,52 @@ public:
 
 Renderer* staticGradient();
 
+enum OutputFormat {
+    OUTPUT_TEXT,
+    OUTPUT_CSV,
+    OUTPUT_JSON,
+};
+
+// The state of the clocks and thermals that a result depends on, sampled
+// from sysfs around each measurement.
+struct DeviceState {
+    // The current GPU frequency, or -1 if it couldn't be found.
+    int64_t gpuFreqHz;
+
+    // The hottest thermal zone; maxTempZone is empty if none could be read.
+    int64_t maxTempMilliC;
+    char maxTempZone[32];
+
+    // The number of cooling devices currently throttling something.
+    uint32_t activeCoolingDevices;
+};
+
+void readDeviceState(DeviceState* state);
+void printDeviceStateJson(const DeviceState& state);
+void printDeviceStateCsv(const DeviceState& state);
+extern const char* const kDeviceStateCsvColumns;
+
+void printJsonString(const char* s);
+
+struct SampleStats {
+    size_t count;
+    double mean;
+    double stddev;
+
+    // The half-width of the 95% confidence interval of the mean.
+    double ci95;
+
+    double min;
+    double max;
+    double p50;
+    double p90;
+    double p99;
+};
+
+void computeSampleStats(const double* samples, size_t n, SampleStats* stats);
+
+// Run the SurfaceFlinger composition scenarios and print their results.
+// JSON results are printed as the members of an array.
+bool runCompositionTests(OutputFormat format);
+
 } // namespace android
@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <EGL/eglext.h>
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 
@@ -186,6 +187,25 @@ bool GLHelper::swapBuffers(EGLSurface surface) {
     return true;
 }
 
+bool GLHelper::swapBuffersWithDamage(EGLSurface surface, EGLint* rects,
+        EGLint numRects) {
+    static PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC swapWithDamage =
+            (PFNEGLSWAPBUFFERSWITHDAMAGEKHRPROC)eglGetProcAddress(
+                    "eglSwapBuffersWithDamageKHR");
+    if (swapWithDamage == NULL) {
+        return swapBuffers(surface);
+    }
+
+    EGLint result;
+    result = swapWithDamage(mDisplay, surface, rects, numRects);
+    if (result != EGL_TRUE) {
+        fprintf(stderr, "eglSwapBuffersWithDamageKHR error: %#x\n",
+                eglGetError());
+        return false;
+    }
+    return true;
+}
+
 bool GLHelper::getShaderProgram(const char* name, GLuint* outPgm) {
     for (size_t i = 0; i < mNumShaders; i++) {
         if (strcmp(mShaderDescs[i].name, name) == 0) {
@@ -222,7 +242,23 @@ bool GLHelper::createNamedSurfaceTexture(GLuint name, uint32_t w, uint32_t h,
     return true;
 }
 
-bool GLHelper::computeWindowScale(uint32_t w, uint32_t h, float* scale) {
+bool GLHelper::setUpComposerClient() {
+    if (mSurfaceComposerClient == NULL) {
+        mSurfaceComposerClient = new SurfaceComposerClient;
+    }
+    status_t err = mSurfaceComposerClient->initCheck();
+    if (err != NO_ERROR) {
+        fprintf(stderr, "SurfaceComposerClient::initCheck error: %#x\n", err);
+        return false;
+    }
+    return true;
+}
+
+bool GLHelper::getDisplaySize(uint32_t* w, uint32_t* h) {
+    if (!setUpComposerClient()) {
+        return false;
+    }
+
     sp<IBinder> dpy = mSurfaceComposerClient->getBuiltInDisplay(0);
     if (dpy == NULL) {
         fprintf(stderr, "SurfaceComposer::getBuiltInDisplay failed.\n");
@@ -236,24 +272,82 @@ bool GLHelper::computeWindowScale(uint32_t w, uint32_t h, float* scale) {
         return false;
     }
 
-    float scaleX = float(info.w) / float(w);
-    float scaleY = float(info.h) / float(h);
+    *w = info.w;
+    *h = info.h;
+    return true;
+}
+
+bool GLHelper::computeWindowScale(uint32_t w, uint32_t h, float* scale) {
+    uint32_t dw, dh;
+    if (!getDisplaySize(&dw, &dh)) {
+        return false;
+    }
+
+    float scaleX = float(dw) / float(w);
+    float scaleY = float(dh) / float(h);
     *scale = scaleX < scaleY ? scaleX : scaleY;
 
     return true;
 }
 
-bool GLHelper::createWindowSurface(uint32_t w, uint32_t h,
+bool GLHelper::createLayerSurface(int32_t x, int32_t y, uint32_t z, uint32_t w,
+        uint32_t h, float scale, bool opaque,
         sp<SurfaceControl>* surfaceControl, EGLSurface* surface) {
-    bool result;
     status_t err;
 
-    if (mSurfaceComposerClient == NULL) {
-        mSurfaceComposerClient = new SurfaceComposerClient;
+    if (!setUpComposerClient()) {
+        return false;
     }
-    err = mSurfaceComposerClient->initCheck();
+
+    sp<SurfaceControl> sc = mSurfaceComposerClient->createSurface(
+            String8("Benchmark Layer"), w, h, PIXEL_FORMAT_RGBA_8888,
+            opaque ? ISurfaceComposerClient::eOpaque : 0);
+    if (sc == NULL || !sc->isValid()) {
+        fprintf(stderr, "Failed to create SurfaceControl.\n");
+        return false;
+    }
+
+    SurfaceComposerClient::openGlobalTransaction();
+    err = sc->setLayer(z);
     if (err != NO_ERROR) {
-        fprintf(stderr, "SurfaceComposerClient::initCheck error: %#x\n", err);
+        fprintf(stderr, "SurfaceComposer::setLayer error: %#x\n", err);
+        return false;
+    }
+    err = sc->setPosition(x, y);
+    if (err != NO_ERROR) {
+        fprintf(stderr, "SurfaceComposer::setPosition error: %#x\n", err);
+        return false;
+    }
+    err = sc->setMatrix(scale, 0.0f, 0.0f, scale);
+    if (err != NO_ERROR) {
+        fprintf(stderr, "SurfaceComposer::setMatrix error: %#x\n", err);
+        return false;
+    }
+    err = sc->show();
+    if (err != NO_ERROR) {
+        fprintf(stderr, "SurfaceComposer::show error: %#x\n", err);
+        return false;
+    }
+    SurfaceComposerClient::closeGlobalTransaction();
+
+    sp<ANativeWindow> anw = sc->getSurface();
+    EGLSurface s = eglCreateWindowSurface(mDisplay, mConfig, anw.get(), NULL);
+    if (s == EGL_NO_SURFACE) {
+        fprintf(stderr, "eglCreateWindowSurface error: %#x\n", eglGetError());
+        return false;
+    }
+
+    *surfaceControl = sc;
+    *surface = s;
+    return true;
+}
+
+bool GLHelper::createWindowSurface(uint32_t w, uint32_t h,
+        sp<SurfaceControl>* surfaceControl, EGLSurface* surface) {
+    bool result;
+    status_t err;
+
+    if (!setUpComposerClient()) {
         return false;
     }
 
@@ -58,10 +58,23 @@ public:
     bool createWindowSurface(uint32_t w, uint32_t h,
             sp<SurfaceControl>* surfaceControl, EGLSurface* surface);
 
+    // Create a SurfaceFlinger layer at position (x, y) and z order z, whose
+    // w x h buffers are scaled by scale when composited.
+    bool createLayerSurface(int32_t x, int32_t y, uint32_t z, uint32_t w,
+            uint32_t h, float scale, bool opaque,
+            sp<SurfaceControl>* surfaceControl, EGLSurface* surface);
+
+    bool getDisplaySize(uint32_t* w, uint32_t* h);
+
     void destroySurface(EGLSurface* surface);
 
     bool swapBuffers(EGLSurface surface);
 
+    // Swap, telling the compositor that only the rects, each x, y, w, h in
+    // GL coordinates, were updated.
+    bool swapBuffersWithDamage(EGLSurface surface, EGLint* rects,
+            EGLint numRects);
+
     bool getShaderProgram(const char* name, GLuint* outPgm);
 
     bool getDitherTexture(GLuint* outTexName);
@@ -71,6 +84,8 @@ private:
     bool createNamedSurfaceTexture(GLuint name, uint32_t w, uint32_t h,
             sp<GLConsumer>* surfaceTexture, EGLSurface* surface);
 
+    bool setUpComposerClient();
+
     bool computeWindowScale(uint32_t w, uint32_t h, float* scale);
 
     bool setUpShaders(const ShaderDesc* shaderDescs, size_t numShaders);
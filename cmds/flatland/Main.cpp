@@ -27,6 +27,7 @@
 #include <EGL/egl.h>
 #include <GLES2/gl2.h>
 
+#include <inttypes.h>
 #include <math.h>
 #include <getopt.h>
 
@@ -37,6 +38,10 @@ using namespace ::android;
 
 static uint32_t g_SleepBetweenSamplesMs = 0;
 static bool     g_PresentToWindow       = false;
+static OutputFormat g_OutputFormat      = OUTPUT_TEXT;
+static size_t   g_NumSamples            = 0;
+static bool     g_MeasureAll            = false;
+static bool     g_RunCompositions       = false;
 static size_t   g_BenchmarkNameLen      = 0;
 
 struct BenchmarkDesc {
@@ -592,17 +597,49 @@ static int cmpDouble(const double* lhs, const double* rhs) {
     return 0;
 }
 
-// Run a single benchmark and print the result.
-static bool runTest(const BenchmarkDesc b, size_t run) {
+struct BenchmarkResult {
+    // Why the scenario wasn't (or, with -a, shouldn't have been) measured:
+    // "fast", "slow" or "varies"; NULL if the result is good.
+    const char* flag;
+
+    // Whether the frame time samples below were taken.
+    bool measured;
+
+    // The per-frame time, ignoring the slowest samples as outliers.
+    double timeMs;
+
+    // The statistics of the per-frame time over all samples.
+    SampleStats stats;
+
+    // The state of the device before and after taking the samples.
+    DeviceState startState;
+    DeviceState endState;
+};
+
+// Return the per-frame time of the sorted samples, ignoring the slowest
+// 1/outlierFraction of them as potential outliers.
+static double robustSampleTime(const Vector<double>& samples,
+        uint32_t outlierFraction) {
+    size_t elem = (samples.size() * (outlierFraction-1) / outlierFraction);
+    if (elem == 0) {
+        return samples[0];
+    }
+    return (samples[elem-1] + samples[elem]) * 0.5;
+}
+
+// Run a single benchmark.
+static bool runTest(const BenchmarkDesc b, size_t run,
+        BenchmarkResult* benchResult) {
     bool success = true;
     double prevResult = 0.0, result = 0.0;
     Vector<double> samples;
+    Vector<double> frameTimes;
+    size_t maxSamples = g_NumSamples > 0 ? g_NumSamples : 512;
 
-    uint32_t runHeight = b.runHeights[run];
-    uint32_t runWidth = b.width * runHeight / b.height;
-    printf(" %-*s | %4d x %4d | ", static_cast<int>(g_BenchmarkNameLen), b.name,
-            runWidth, runHeight);
-    fflush(stdout);
+    benchResult->flag = NULL;
+    benchResult->measured = false;
+    benchResult->timeMs = 0.0;
+    memset(&benchResult->stats, 0, sizeof(benchResult->stats));
 
     BenchmarkRunner r(b, run);
     if (!r.setUp()) {
@@ -618,6 +655,8 @@ static bool runTest(const BenchmarkDesc b, size_t run) {
     uint32_t warmUpFrames = 1;
     uint32_t totalFrames = 5;
 
+    readDeviceState(&benchResult->startState);
+
     // Find the number of frames needed to run for over 100ms.
     double runTime = 0.0;
     while (true) {
@@ -633,23 +672,27 @@ static bool runTest(const BenchmarkDesc b, size_t run) {
 
     if (totalFrames - warmUpFrames > 16) {
         // The test runs too fast to get a stable result.  Skip it.
-        printf("  fast");
-        goto done;
+        benchResult->flag = "fast";
     } else if (totalFrames == 5 && runTime > 200e6) {
         // The test runs too slow to be very useful.  Skip it.
-        printf("  slow");
+        benchResult->flag = "slow";
+    }
+    if (benchResult->flag != NULL && !g_MeasureAll) {
         goto done;
     }
 
     do {
         size_t newSamples = samples.size();
-        if (newSamples == 0) {
+        if (g_NumSamples > 0) {
+            // Take exactly the requested number of samples.
+            newSamples = g_NumSamples;
+        } else if (newSamples == 0) {
             newSamples = 4*outlierFraction;
         }
 
-        if (newSamples > 512) {
-            printf("varies");
-            goto done;
+        if (samples.size() + newSamples > maxSamples) {
+            benchResult->flag = "varies";
+            break;
         }
 
         for (size_t i = 0; i < newSamples; i++) {
@@ -665,46 +708,165 @@ static bool runTest(const BenchmarkDesc b, size_t run) {
             }
 
             samples.add(sample);
+            frameTimes.add(sample / double(totalFrames - warmUpFrames) / 1e6);
         }
 
         samples.sort(cmpDouble);
 
         prevResult = result;
-        size_t elem = (samples.size() * (outlierFraction-1) / outlierFraction);
-        result = (samples[elem-1] + samples[elem]) * 0.5;
-    } while (fabs(result - prevResult) > threshold * result);
-
-    printf("%6.3f", result / double(totalFrames - warmUpFrames) / 1e6);
+        result = robustSampleTime(samples, outlierFraction);
+    } while (g_NumSamples == 0 && fabs(result - prevResult) > threshold * result);
+
+    if (!samples.isEmpty()) {
+        benchResult->measured = true;
+        benchResult->timeMs = result / double(totalFrames - warmUpFrames) / 1e6;
+        computeSampleStats(frameTimes.array(), frameTimes.size(),
+                &benchResult->stats);
+    }
 
 done:
 
-    printf("\n");
-    fflush(stdout);
+    readDeviceState(&benchResult->endState);
     r.tearDown();
 
     return success;
 }
 
+static void printTextResult(const BenchmarkDesc& b, uint32_t runWidth,
+        uint32_t runHeight, const BenchmarkResult& result) {
+    printf(" %-*s | %4d x %4d | ", static_cast<int>(g_BenchmarkNameLen),
+            b.name, runWidth, runHeight);
+    if (result.measured) {
+        const SampleStats& s = result.stats;
+        printf("%9.3f | %6.3f | %6.3f %6.3f %6.3f |", result.timeMs, s.ci95,
+                s.p50, s.p90, s.p99);
+    } else {
+        printf("%9s | %6s | %20s |", "", "", "");
+    }
+    printf(" %-6s |", result.flag != NULL ? result.flag : "");
+    const DeviceState& end = result.endState;
+    if (end.gpuFreqHz >= 0) {
+        printf(" %4" PRId64 " -> %4" PRId64,
+                result.startState.gpuFreqHz / 1000000,
+                end.gpuFreqHz / 1000000);
+    } else {
+        printf(" %12s", "");
+    }
+    if (end.maxTempZone[0] != '\0') {
+        printf(" | %5.1f C", double(end.maxTempMilliC) / 1000.0);
+    }
+    printf("\n");
+}
+
+static void printCsvResult(const BenchmarkDesc& b, uint32_t runWidth,
+        uint32_t runHeight, const BenchmarkResult& result) {
+    printf("gpu,\"%s\",%dx%d,", b.name, runWidth, runHeight);
+    if (result.measured) {
+        const SampleStats& s = result.stats;
+        printf("%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%.3f,%zu",
+                result.timeMs, s.mean, s.stddev, s.ci95, s.p50, s.p90, s.p99,
+                s.min, s.max, s.count);
+    } else {
+        printf(",,,,,,,,,0");
+    }
+    printf(",%s,", result.flag != NULL ? result.flag : "");
+    printDeviceStateCsv(result.startState);
+    printf(",");
+    printDeviceStateCsv(result.endState);
+    printf("\n");
+}
+
+static void printJsonResult(const BenchmarkDesc& b, uint32_t runWidth,
+        uint32_t runHeight, const BenchmarkResult& result, bool first) {
+    printf("%s    { \"scenario\": ", first ? "" : ",\n");
+    printJsonString(b.name);
+    printf(", \"width\": %u, \"height\": %u,\n", runWidth, runHeight);
+    printf("      \"flag\": ");
+    if (result.flag != NULL) {
+        printJsonString(result.flag);
+    } else {
+        printf("null");
+    }
+    printf(",\n");
+    if (result.measured) {
+        const SampleStats& s = result.stats;
+        printf("      \"time_ms\": %.3f, \"samples\": %zu,\n", result.timeMs,
+                s.count);
+        printf("      \"mean_ms\": %.3f, \"stddev_ms\": %.3f,"
+                " \"ci95_ms\": %.3f,\n", s.mean, s.stddev, s.ci95);
+        printf("      \"min_ms\": %.3f, \"p50_ms\": %.3f, \"p90_ms\": %.3f,"
+                " \"p99_ms\": %.3f, \"max_ms\": %.3f,\n", s.min, s.p50, s.p90,
+                s.p99, s.max);
+    }
+    printf("      \"device_start\": ");
+    printDeviceStateJson(result.startState);
+    printf(",\n      \"device_end\": ");
+    printDeviceStateJson(result.endState);
+    printf(" }");
+}
+
 static void printResultsTableHeader() {
+    if (g_OutputFormat == OUTPUT_CSV) {
+        printf("gpu,scenario,resolution,time_ms,mean_ms,stddev_ms,ci95_ms,"
+                "p50_ms,p90_ms,p99_ms,min_ms,max_ms,samples,flag");
+        // The device state columns, at the start and end of the run.
+        for (int i = 0; i < 2; i++) {
+            const char* prefix = i == 0 ? "start_" : "end_";
+            const char* col = kDeviceStateCsvColumns;
+            while (*col) {
+                const char* next = strchr(col, ',');
+                size_t len = next != NULL ? size_t(next - col) : strlen(col);
+                printf(",%s%.*s", prefix, static_cast<int>(len), col);
+                col += len + (next != NULL ? 1 : 0);
+            }
+        }
+        printf("\n");
+        return;
+    } else if (g_OutputFormat == OUTPUT_JSON) {
+        return;
+    }
     const char* scenario = "Scenario";
     size_t len = strlen(scenario);
     size_t leftPad = (g_BenchmarkNameLen - len) / 2;
     size_t rightPad = g_BenchmarkNameLen - len - leftPad;
-    printf(" %*s%s%*s | Resolution  | Time (ms)\n",
+    printf(" %*s%s%*s | Resolution  | Time (ms) | +-95%%  |"
+            "  p50    p90    p99   | Flag   | GPU MHz      | Temp\n",
             static_cast<int>(leftPad), "",
             "Scenario", static_cast<int>(rightPad), "");
 }
 
 // Run ALL the benchmarks!
 static bool runTests() {
+    bool first = true;
+
     printResultsTableHeader();
 
     for (size_t i = 0; i < NELEMS(benchmarks); i++) {
         const BenchmarkDesc& b = benchmarks[i];
         for (size_t j = 0; j < MAX_TEST_RUNS && b.runHeights[j]; j++) {
-            if (!runTest(b, j)) {
+            uint32_t runHeight = b.runHeights[j];
+            uint32_t runWidth = b.width * runHeight / b.height;
+            BenchmarkResult result;
+
+            if (!runTest(b, j, &result)) {
                 return false;
             }
+
+            switch (g_OutputFormat) {
+                case OUTPUT_TEXT:
+                    printTextResult(b, runWidth, runHeight, result);
+                break;
+
+                case OUTPUT_CSV:
+                    printCsvResult(b, runWidth, runHeight, result);
+                break;
+
+                case OUTPUT_JSON:
+                    printJsonResult(b, runWidth, runHeight, result, first);
+                break;
+            }
+            fflush(stdout);
+            first = false;
         }
     }
     return true;
@@ -729,6 +891,16 @@ static void showHelp(const char *cmd) {
     fprintf(stderr, "options include:\n"
                     "  -s N            sleep for N ms between samples\n"
                     "  -d              display the test frame to a window\n"
+                    "  -c              run the SurfaceFlinger composition\n"
+                    "                  scenarios instead of the GPU ones\n"
+                    "  -n N            take exactly N samples of each scenario\n"
+                    "                  instead of sampling until the result\n"
+                    "                  is stable\n"
+                    "  -a              measure the scenarios that are too fast\n"
+                    "                  or too slow to be measured reliably\n"
+                    "  -o FORMAT       print the results as text (the default),\n"
+                    "                  csv or json\n"
+                    "  -m              the same as -o csv\n"
                     "  --help          print this helpful message and exit\n"
             );
 }
@@ -747,7 +919,7 @@ int main(int argc, char** argv) {
             {     0,               0, 0,  0 }
         };
 
-        ret = getopt_long(argc, argv, "ds:",
+        ret = getopt_long(argc, argv, "acdmn:o:s:",
                           long_options, &option_index);
 
         if (ret < 0) {
@@ -759,6 +931,35 @@ int main(int argc, char** argv) {
                 g_PresentToWindow = true;
             break;
 
+            case 'c':
+                g_RunCompositions = true;
+            break;
+
+            case 'm':
+                g_OutputFormat = OUTPUT_CSV;
+            break;
+
+            case 'o':
+                if (!strcmp(optarg, "text")) {
+                    g_OutputFormat = OUTPUT_TEXT;
+                } else if (!strcmp(optarg, "csv")) {
+                    g_OutputFormat = OUTPUT_CSV;
+                } else if (!strcmp(optarg, "json")) {
+                    g_OutputFormat = OUTPUT_JSON;
+                } else {
+                    showHelp(argv[0]);
+                    exit(2);
+                }
+            break;
+
+            case 'n':
+                g_NumSamples = atoi(optarg);
+            break;
+
+            case 'a':
+                g_MeasureAll = true;
+            break;
+
             case 's':
                 g_SleepBetweenSamplesMs = atoi(optarg);
             break;
@@ -778,13 +979,32 @@ int main(int argc, char** argv) {
 
     g_BenchmarkNameLen = maxBenchmarkNameLen();
 
-    printf(" cmdline:");
-    for (int i = 0; i < argc; i++) {
-        printf(" %s", argv[i]);
+    if (g_OutputFormat == OUTPUT_TEXT) {
+        printf(" cmdline:");
+        for (int i = 0; i < argc; i++) {
+            printf(" %s", argv[i]);
+        }
+        printf("\n");
+    } else if (g_OutputFormat == OUTPUT_JSON) {
+        DeviceState state;
+        readDeviceState(&state);
+        printf("{\n  \"cmdline\": [");
+        for (int i = 0; i < argc; i++) {
+            printf(i > 0 ? ", " : " ");
+            printJsonString(argv[i]);
+        }
+        printf(" ],\n  \"device\": ");
+        printDeviceStateJson(state);
+        printf(",\n  \"%s\": [\n", g_RunCompositions ? "composition" : "gpu");
     }
-    printf("\n");
 
-    if (!runTests()) {
+    bool success = g_RunCompositions ?
+            runCompositionTests(g_OutputFormat) : runTests();
+
+    if (g_OutputFormat == OUTPUT_JSON) {
+        printf("\n  ]\n}\n");
+    }
+    if (!success) {
         fprintf(stderr, "exiting due to error.\n");
         return 1;
     }
@@ -0,0 +1,237 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <dirent.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+
+#include "Flatland.h"
+
+namespace android {
+
+static const char* const kDevfreqDir = "/sys/class/devfreq";
+static const char* const kKgslClockPath = "/sys/class/kgsl/kgsl-3d0/gpuclk";
+static const char* const kThermalDir = "/sys/class/thermal";
+
+// Read a small sysfs file into buf, without the trailing newline.
+static bool readSysfs(const char* path, char* buf, size_t size) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return false;
+    }
+    ssize_t n = TEMP_FAILURE_RETRY(read(fd, buf, size - 1));
+    close(fd);
+    if (n <= 0) {
+        return false;
+    }
+    while (n > 0 && (buf[n-1] == '\n' || buf[n-1] == ' ')) {
+        n--;
+    }
+    buf[n] = '\0';
+    return true;
+}
+
+static bool readSysfsInt(const char* path, int64_t* value) {
+    char buf[64];
+    char* end;
+    if (!readSysfs(path, buf, sizeof(buf))) {
+        return false;
+    }
+    *value = strtoll(buf, &end, 10);
+    return end != buf;
+}
+
+// There's no generic way to find the GPU; look for a devfreq device that's
+// named like one, and fall back to the Adreno driver's own clock node.
+static int64_t readGpuFreqHz() {
+    static const char* const gpuNames[] = { "gpu", "kgsl", "mali", "g3d" };
+
+    int64_t freq = -1;
+    DIR* d = opendir(kDevfreqDir);
+    if (d != NULL) {
+        struct dirent* de;
+        while (freq < 0 && (de = readdir(d)) != NULL) {
+            bool isGpu = false;
+            for (int i = 0; i < NELEMS(gpuNames); i++) {
+                if (strcasestr(de->d_name, gpuNames[i]) != NULL) {
+                    isGpu = true;
+                }
+            }
+            if (!isGpu) {
+                continue;
+            }
+            char path[PATH_MAX];
+            snprintf(path, sizeof(path), "%s/%s/cur_freq", kDevfreqDir,
+                    de->d_name);
+            if (!readSysfsInt(path, &freq)) {
+                freq = -1;
+            }
+        }
+        closedir(d);
+    }
+    if (freq < 0 && !readSysfsInt(kKgslClockPath, &freq)) {
+        freq = -1;
+    }
+    return freq;
+}
+
+static void readThermalState(DeviceState* state) {
+    DIR* d = opendir(kThermalDir);
+    if (d == NULL) {
+        return;
+    }
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        char path[PATH_MAX];
+        int64_t value;
+        if (!strncmp(de->d_name, "thermal_zone", 12)) {
+            snprintf(path, sizeof(path), "%s/%s/temp", kThermalDir,
+                    de->d_name);
+            if (!readSysfsInt(path, &value)) {
+                continue;
+            }
+            // Most drivers report millidegrees, but some report degrees.
+            if (value > -1000 && value < 1000) {
+                value *= 1000;
+            }
+            if (state->maxTempZone[0] == '\0' || value > state->maxTempMilliC) {
+                state->maxTempMilliC = value;
+                snprintf(path, sizeof(path), "%s/%s/type", kThermalDir,
+                        de->d_name);
+                if (!readSysfs(path, state->maxTempZone,
+                        sizeof(state->maxTempZone))) {
+                    snprintf(state->maxTempZone, sizeof(state->maxTempZone),
+                            "%s", de->d_name);
+                }
+            }
+        } else if (!strncmp(de->d_name, "cooling_device", 14)) {
+            snprintf(path, sizeof(path), "%s/%s/cur_state", kThermalDir,
+                    de->d_name);
+            if (readSysfsInt(path, &value) && value > 0) {
+                state->activeCoolingDevices++;
+            }
+        }
+    }
+    closedir(d);
+}
+
+void readDeviceState(DeviceState* state) {
+    memset(state, 0, sizeof(*state));
+    state->gpuFreqHz = readGpuFreqHz();
+    readThermalState(state);
+}
+
+void printJsonString(const char* s) {
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char c = *s;
+        if (c == '"' || c == '\\') {
+            printf("\\%c", c);
+        } else if (c < 0x20) {
+            printf("\\u%04x", c);
+        } else {
+            putchar(c);
+        }
+    }
+    putchar('"');
+}
+
+void printDeviceStateJson(const DeviceState& state) {
+    printf("{ \"gpu_freq_hz\": %" PRId64 ", ", state.gpuFreqHz);
+    if (state.maxTempZone[0] != '\0') {
+        printf("\"max_temp_c\": %.1f, \"max_temp_zone\": ",
+                double(state.maxTempMilliC) / 1000.0);
+        printJsonString(state.maxTempZone);
+        printf(", ");
+    }
+    printf("\"active_cooling_devices\": %u }", state.activeCoolingDevices);
+}
+
+void printDeviceStateCsv(const DeviceState& state) {
+    if (state.gpuFreqHz >= 0) {
+        printf("%.1f", double(state.gpuFreqHz) / 1e6);
+    }
+    putchar(',');
+    if (state.maxTempZone[0] != '\0') {
+        printf("%.1f,%s", double(state.maxTempMilliC) / 1000.0,
+                state.maxTempZone);
+    } else {
+        putchar(',');
+    }
+    printf(",%u", state.activeCoolingDevices);
+}
+
+const char* const kDeviceStateCsvColumns =
+        "gpu_freq_mhz,max_temp_c,max_temp_zone,active_cooling_devices";
+
+// 95% two-sided Student's t quantiles, for 1 to 30 degrees of freedom.
+static const double kT95[] = {
+    12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+    2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+    2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042,
+};
+
+static double percentile(const double* sorted, size_t n, double p) {
+    // Nearest rank.
+    size_t rank = size_t(ceil(p / 100.0 * double(n)));
+    return sorted[rank > 0 ? rank - 1 : 0];
+}
+
+void computeSampleStats(const double* samples, size_t n, SampleStats* stats) {
+    memset(stats, 0, sizeof(*stats));
+    stats->count = n;
+    if (n == 0) {
+        return;
+    }
+
+    double* sorted = new double[n];
+    std::copy(samples, samples + n, sorted);
+    std::sort(sorted, sorted + n);
+
+    double sum = 0.0;
+    for (size_t i = 0; i < n; i++) {
+        sum += sorted[i];
+    }
+    stats->mean = sum / double(n);
+    if (n > 1) {
+        double sq = 0.0;
+        for (size_t i = 0; i < n; i++) {
+            double d = sorted[i] - stats->mean;
+            sq += d * d;
+        }
+        stats->stddev = sqrt(sq / double(n - 1));
+        double t = n - 1 <= size_t(NELEMS(kT95)) ? kT95[n - 2] : 1.960;
+        stats->ci95 = t * stats->stddev / sqrt(double(n));
+    }
+    stats->min = sorted[0];
+    stats->max = sorted[n - 1];
+    stats->p50 = percentile(sorted, n, 50.0);
+    stats->p90 = percentile(sorted, n, 90.0);
+    stats->p99 = percentile(sorted, n, 99.0);
+
+    delete[] sorted;
+}
+
+} // namespace android
@@ -14,6 +14,7 @@ LOCAL_SRC_FILES := $(common_src_files)
 LOCAL_CFLAGS := $(common_cflags)
 LOCAL_SHARED_LIBRARIES := \
     libbase \
+    libcrypto \
     liblogwrap \
 
 LOCAL_ADDITIONAL_DEPENDENCIES += $(LOCAL_PATH)/Android.mk
@@ -31,6 +32,7 @@ LOCAL_CFLAGS := $(common_cflags)
 LOCAL_SRC_FILES := installd.cpp $(common_src_files)
 LOCAL_SHARED_LIBRARIES := \
     libbase \
+    libcrypto \
     libcutils \
     liblog \
     liblogwrap \
@@ -21,12 +21,22 @@
 #include <cutils/sched_policy.h>
 #include <diskusage/dirsize.h>
 #include <logwrap/logwrap.h>
+#include <openssl/sha.h>
 #include <system/thread_defs.h>
 #include <selinux/android.h>
 
+#include <algorithm>
 #include <inttypes.h>
+#include <map>
+#include <pthread.h>
 #include <sys/capability.h>
 #include <sys/file.h>
+#include <sys/inotify.h>
+#include <sys/ioctl.h>
+#include <sys/sendfile.h>
+#include <sys/syscall.h>
+#include <sys/xattr.h>
+#include <time.h>
 #include <unistd.h>
 
 using android::base::StringPrintf;
@@ -47,6 +57,8 @@ dir_rec_t android_app_vital_dir;
 
 static const char* kCpPath = "/system/bin/cp";
 
+static int copy_fd(int src_fd, int dest_fd);
+
 int install(const char *uuid, const char *pkgname, uid_t uid, gid_t gid, const char *seinfo)
 {
     if ((uid < AID_SYSTEM) || (gid < AID_SYSTEM)) {
@@ -90,7 +102,7 @@ int uninstall(const char *uuid, const char *pkgname, userid_t userid)
     remove_profile_file(pkgname);
 
     /* delete contents AND directory, no exceptions */
-    return delete_dir_contents(pkgdir, 1, NULL);
+    return delete_dir_deferred(pkgdir);
 }
 
 int renamepkg(const char *oldpkgname, const char *newpkgname)
@@ -376,6 +388,13 @@ int free_cache(const char *uuid, int64_t free_size)
     ALOGI("free_cache(%" PRId64 ") avail %" PRId64 "\n", free_size, avail);
     if (avail >= free_size) return 0;
 
+    // Compiled oat files can always be regenerated, so they go first.
+    if (uuid == nullptr && delete_dir_contents(OAT_CACHE_DIR, 0, NULL) == 0) {
+        avail = data_disk_free(data_path);
+        ALOGI("free_cache: emptied the oat cache, avail %" PRId64 "\n", avail);
+        if (avail >= free_size) return 0;
+    }
+
     cache = start_cache_collection();
 
     // Special case for owner on internal storage
@@ -471,9 +490,75 @@ int move_dex(const char *src, const char *dst, const char *instruction_set)
     }
 }
 
+/*
+ * Drops the oat cache entries that are hard links of the given removed oat
+ * files, when nothing but the cache still links them. Entries the cache has
+ * its own copy of can't be told apart from others, and are left to
+ * free_cache().
+ */
+static void oat_cache_evict(const std::vector<struct stat>& removed)
+{
+    if (removed.empty()) {
+        return;
+    }
+    DIR* d = opendir(OAT_CACHE_DIR);
+    if (d == NULL) {
+        return;
+    }
+    struct dirent* de;
+    while ((de = readdir(d)) != NULL) {
+        struct stat st;
+        if (de->d_name[0] == '.' || fstatat(dirfd(d), de->d_name, &st, AT_SYMLINK_NOFOLLOW) < 0) {
+            continue;
+        }
+        for (const struct stat& r : removed) {
+            if (r.st_dev == st.st_dev && r.st_ino == st.st_ino) {
+                ALOGV("evicting %s from the oat cache\n", de->d_name);
+                unlinkat(dirfd(d), de->d_name, 0);
+                break;
+            }
+        }
+    }
+    closedir(d);
+}
+
+/* Collects the oat files of a package's code directory that only the oat cache also links. */
+static void oat_cache_collect(const char* apk_path, std::vector<struct stat>* removed)
+{
+    char oat_path[PKG_PATH_MAX];
+    snprintf(oat_path, sizeof(oat_path), "%s/oat", apk_path);
+    DIR* oat_dir = opendir(oat_path);
+    if (oat_dir == NULL) {
+        return;
+    }
+    struct dirent* isa;
+    while ((isa = readdir(oat_dir)) != NULL) {
+        if (isa->d_name[0] == '.') {
+            continue;
+        }
+        int isa_fd = openat(dirfd(oat_dir), isa->d_name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        DIR* isa_dir = isa_fd < 0 ? NULL : fdopendir(isa_fd);
+        if (isa_dir == NULL) {
+            if (isa_fd >= 0) close(isa_fd);
+            continue;
+        }
+        struct dirent* de;
+        while ((de = readdir(isa_dir)) != NULL) {
+            struct stat st;
+            if (fstatat(isa_fd, de->d_name, &st, AT_SYMLINK_NOFOLLOW) == 0
+                    && S_ISREG(st.st_mode) && st.st_nlink == 2) {
+                removed->push_back(st);
+            }
+        }
+        closedir(isa_dir);
+    }
+    closedir(oat_dir);
+}
+
 int rm_dex(const char *path, const char *instruction_set)
 {
     char dex_path[PKG_PATH_MAX];
+    struct stat st;
 
     if (validate_apk_path(path) && validate_system_app_path(path)) {
         ALOGE("invalid apk path '%s' (bad prefix)\n", path);
@@ -483,17 +568,26 @@ int rm_dex(const char *path, const char *instruction_set)
     if (create_cache_path(dex_path, path, instruction_set)) return -1;
 
     ALOGV("unlink %s\n", dex_path);
+    bool cached = lstat(dex_path, &st) == 0 && st.st_nlink == 2;
     if (unlink(dex_path) < 0) {
         if (errno != ENOENT) {
             ALOGE("Couldn't unlink %s: %s\n", dex_path, strerror(errno));
         }
         return -1;
     } else {
+        if (cached) {
+            oat_cache_evict(std::vector<struct stat>(1, st));
+        }
         return 0;
     }
 }
 
-int get_size(const char *uuid, const char *pkgname, int userid, const char *apkpath,
+/* Threads each directory tree is sized with.  The trees of an app are small
+ * enough that more don't help, and getsizes already sizes several apps at
+ * once. */
+#define DIR_SIZE_THREADS 2
+
+static int compute_size(const char *uuid, const char *pkgname, int userid, const char *apkpath,
              const char *libdirpath, const char *fwdlock_apkpath, const char *asecpath,
              const char *instruction_set, int64_t *_codesize, int64_t *_datasize,
              int64_t *_cachesize, int64_t* _asecsize)
@@ -516,11 +610,9 @@ int get_size(const char *uuid, const char *pkgname, int userid, const char *apkp
         if (stat(apkpath, &s) == 0) {
             codesize += stat_size(&s);
             if (S_ISDIR(s.st_mode)) {
-                d = opendir(apkpath);
-                if (d != NULL) {
-                    dfd = dirfd(d);
-                    codesize += calculate_dir_size(dfd);
-                    closedir(d);
+                dfd = open(apkpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (dfd >= 0) {
+                    codesize += calculate_dir_size_parallel(dfd, DIR_SIZE_THREADS);
                 }
             }
         }
@@ -542,11 +634,9 @@ int get_size(const char *uuid, const char *pkgname, int userid, const char *apkp
 
     /* add in size of any libraries */
     if (libdirpath != NULL && libdirpath[0] != '!') {
-        d = opendir(libdirpath);
-        if (d != NULL) {
-            dfd = dirfd(d);
-            codesize += calculate_dir_size(dfd);
-            closedir(d);
+        dfd = open(libdirpath, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (dfd >= 0) {
+            codesize += calculate_dir_size_parallel(dfd, DIR_SIZE_THREADS);
         }
     }
 
@@ -577,15 +667,17 @@ int get_size(const char *uuid, const char *pkgname, int userid, const char *apkp
 
         /* most stuff in the pkgdir is data, except for the "cache"
          * directory and below, which is cache, and the "lib" directory
-         * and below, which is code...
+         * and below, which is code...  The subdirectories are all sized
+         * together once they have been listed.
          */
+        std::vector<int> subfds;
+        std::vector<int64_t*> subtotals;
         while ((de = readdir(d))) {
             const char *name = de->d_name;
 
             if (de->d_type == DT_DIR) {
-                int subfd;
                 int64_t statsize = 0;
-                int64_t dirsize = 0;
+                int64_t* total;
                     /* always skip "." and ".." */
                 if (name[0] == '.') {
                     if (name[1] == 0) continue;
@@ -594,17 +686,16 @@ int get_size(const char *uuid, const char *pkgname, int userid, const char *apkp
                 if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
                     statsize = stat_size(&s);
                 }
-                subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY);
-                if (subfd >= 0) {
-                    dirsize = calculate_dir_size(subfd);
-                }
                 if(!strcmp(name,"lib")) {
-                    codesize += dirsize + statsize;
+                    total = &codesize;
                 } else if(!strcmp(name,"cache")) {
-                    cachesize += dirsize + statsize;
+                    total = &cachesize;
                 } else {
-                    datasize += dirsize + statsize;
+                    total = &datasize;
                 }
+                *total += statsize;
+                subfds.push_back(openat(dfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC));
+                subtotals.push_back(total);
             } else if (de->d_type == DT_LNK && !strcmp(name,"lib")) {
                 // This is the symbolic link to the application's library
                 // code.  We'll count this as code instead of data, since
@@ -619,6 +710,13 @@ int get_size(const char *uuid, const char *pkgname, int userid, const char *apkp
             }
         }
         closedir(d);
+
+        std::vector<int64_t> dirsizes(subfds.size());
+        calculate_dir_sizes(subfds.data(), dirsizes.data(), subfds.size(),
+                DIR_SIZE_THREADS);
+        for (size_t i = 0; i < subfds.size(); i++) {
+            *subtotals[i] += dirsizes[i];
+        }
     }
     *_codesize = codesize;
     *_datasize = datasize;
@@ -627,6 +725,261 @@ int get_size(const char *uuid, const char *pkgname, int userid, const char *apkp
     return 0;
 }
 
+/*
+ * Sizes computed for a single user are cached, and invalidated through
+ * inotify watches on every directory and file they were computed from:
+ * a change anywhere in a package's trees is reported on the watch of the
+ * directory holding it. Pending events are read before every lookup, so a
+ * cached size is never older than the last change made before the query.
+ * A package the watches can't be set up for (e.g. the inotify watch limit
+ * was reached) is computed on every query, as before.
+ *
+ * The watch limit is shared with every other process of the user, so the
+ * cache keeps to half of it. Once a watch fails for lack of room, the cache
+ * stops at the number of watches it has, and only sets up new entries again
+ * after giving up a quarter of them, rather than walking every new package's
+ * trees only to fail again.
+ */
+struct size_cache_entry {
+    bool valid;
+    int64_t codesize, datasize, cachesize, asecsize;
+    std::vector<int> wds;
+};
+
+static const uint32_t kSizeCacheMask = IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE
+        | IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF;
+
+static pthread_mutex_t size_cache_lock = PTHREAD_MUTEX_INITIALIZER;
+static int size_cache_fd = -2;      /* -2 not opened yet, -1 unavailable */
+static size_t size_cache_max_watches = SIZE_MAX;
+static bool size_cache_full = false;
+static std::map<std::string, size_cache_entry> size_cache;
+static std::map<int, std::vector<std::string>> size_cache_watches;
+
+/* Called with size_cache_lock held. */
+static void size_cache_drop(const std::string& key) {
+    auto it = size_cache.find(key);
+    if (it == size_cache.end()) {
+        return;
+    }
+    for (int wd : it->second.wds) {
+        auto w = size_cache_watches.find(wd);
+        if (w == size_cache_watches.end()) {
+            continue;
+        }
+        std::vector<std::string>& keys = w->second;
+        keys.erase(std::remove(keys.begin(), keys.end(), key), keys.end());
+        if (keys.empty()) {
+            inotify_rm_watch(size_cache_fd, wd);
+            size_cache_watches.erase(w);
+        }
+    }
+    size_cache.erase(it);
+}
+
+/* Invalidates the entries changed since the last call.
+ * Called with size_cache_lock held. */
+static void size_cache_poll() {
+    char buf[4096] __attribute__((aligned(__alignof__(struct inotify_event))));
+    for (;;) {
+        ssize_t len = read(size_cache_fd, buf, sizeof(buf));
+        if (len <= 0) {
+            break;
+        }
+        for (char *p = buf; p < buf + len; ) {
+            const struct inotify_event *event = (const struct inotify_event *) p;
+            p += sizeof(struct inotify_event) + event->len;
+            if (event->mask & IN_Q_OVERFLOW) {
+                while (!size_cache.empty()) {
+                    size_cache_drop(size_cache.begin()->first);
+                }
+                continue;
+            }
+            auto w = size_cache_watches.find(event->wd);
+            if (w != size_cache_watches.end()) {
+                std::vector<std::string> keys(w->second);
+                for (const std::string& key : keys) {
+                    size_cache_drop(key);
+                }
+            }
+        }
+    }
+}
+
+/* Watches path, or its parent directory if it doesn't exist yet.
+ * Called with size_cache_lock held. */
+static bool size_cache_watch(const std::string& key, size_cache_entry& entry,
+                             const std::string& path) {
+    int wd = inotify_add_watch(size_cache_fd, path.c_str(), kSizeCacheMask);
+    if (wd < 0 && errno == ENOENT) {
+        size_t slash = path.rfind('/');
+        if (slash != std::string::npos && slash > 0) {
+            wd = inotify_add_watch(size_cache_fd, path.substr(0, slash).c_str(), kSizeCacheMask);
+        }
+    }
+    if (wd < 0) {
+        if (errno == ENOSPC) {
+            size_cache_full = true;
+        }
+        return false;
+    }
+    if (std::find(entry.wds.begin(), entry.wds.end(), wd) == entry.wds.end()) {
+        entry.wds.push_back(wd);
+        size_cache_watches[wd].push_back(key);
+    }
+    return true;
+}
+
+/* Watches path and, if it is a directory, every directory below it.
+ * Called with size_cache_lock held. */
+static bool size_cache_watch_tree(const std::string& key, size_cache_entry& entry,
+                                  const std::string& path) {
+    if (!size_cache_watch(key, entry, path)) {
+        return false;
+    }
+    DIR *d = opendir(path.c_str());
+    if (d == NULL) {
+        return true;
+    }
+    bool ok = true;
+    struct dirent *de;
+    while (ok && (de = readdir(d))) {
+        const char *name = de->d_name;
+        if (de->d_type != DT_DIR || !strcmp(name, ".") || !strcmp(name, "..")) {
+            continue;
+        }
+        ok = size_cache_watch_tree(key, entry, path + "/" + name);
+    }
+    closedir(d);
+    return ok;
+}
+
+/* Sets up the watches of an entry.
+ * Called with size_cache_lock held. */
+static bool size_cache_add(const std::string& key, const char *uuid, const char *pkgname,
+                           int userid, const char *apkpath, const char *libdirpath,
+                           const char *fwdlock_apkpath, const char *asecpath,
+                           const char *instruction_set) {
+    if (size_cache_full) {
+        if (size_cache_watches.size() >= size_cache_max_watches / 4 * 3) {
+            return false;
+        }
+        size_cache_full = false;
+    }
+    if (size_cache_watches.size() >= size_cache_max_watches) {
+        return false;
+    }
+    size_cache_entry& entry = size_cache[key];
+    entry.valid = false;
+
+    char path[PKG_PATH_MAX];
+    bool ok = size_cache_watch_tree(key, entry, apkpath);
+    if (ok && fwdlock_apkpath != NULL && fwdlock_apkpath[0] != '!') {
+        ok = size_cache_watch(key, entry, fwdlock_apkpath);
+    }
+    if (ok && !create_cache_path(path, apkpath, instruction_set)) {
+        ok = size_cache_watch(key, entry, path);
+    }
+    if (ok && libdirpath != NULL && libdirpath[0] != '!') {
+        ok = size_cache_watch_tree(key, entry, libdirpath);
+    }
+    if (ok && asecpath != NULL && asecpath[0] != '!') {
+        ok = size_cache_watch(key, entry, asecpath);
+    }
+    if (ok) {
+        ok = size_cache_watch_tree(key, entry,
+                create_data_user_package_path(uuid, userid, pkgname));
+    }
+    if (size_cache_watches.size() > size_cache_max_watches) {
+        ok = false;
+    }
+    if (!ok) {
+        size_cache_drop(key);
+        if (size_cache_full) {
+            size_cache_max_watches = size_cache_watches.size();
+            ALOGW("no room for more inotify watches, caching the sizes of %zu entries\n",
+                  size_cache.size());
+        }
+    }
+    return ok;
+}
+
+/* Half of the inotify watches the user may have, or SIZE_MAX if unknown. */
+static size_t size_cache_watch_limit() {
+    FILE *fp = fopen("/proc/sys/fs/inotify/max_user_watches", "re");
+    if (fp == NULL) {
+        return SIZE_MAX;
+    }
+    unsigned long max_watches;
+    size_t limit = SIZE_MAX;
+    if (fscanf(fp, "%lu", &max_watches) == 1) {
+        limit = max_watches / 2;
+    }
+    fclose(fp);
+    return limit;
+}
+
+int get_size(const char *uuid, const char *pkgname, int userid, const char *apkpath,
+             const char *libdirpath, const char *fwdlock_apkpath, const char *asecpath,
+             const char *instruction_set, int64_t *codesize, int64_t *datasize,
+             int64_t *cachesize, int64_t* asecsize)
+{
+    // Sizes summed over all users would also have to track the users.
+    if (userid == -1) {
+        return compute_size(uuid, pkgname, userid, apkpath, libdirpath, fwdlock_apkpath,
+                            asecpath, instruction_set, codesize, datasize, cachesize, asecsize);
+    }
+
+    std::string key = StringPrintf("%s %s %d %s %s %s %s %s", uuid ? uuid : "!", pkgname,
+            userid, apkpath, libdirpath, fwdlock_apkpath, asecpath, instruction_set);
+
+    pthread_mutex_lock(&size_cache_lock);
+    if (size_cache_fd == -2) {
+        size_cache_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+        if (size_cache_fd < 0) {
+            ALOGW("inotify_init1 failed, package sizes won't be cached: %s\n", strerror(errno));
+        }
+        size_cache_max_watches = size_cache_watch_limit();
+    }
+    bool cached = false;
+    if (size_cache_fd >= 0) {
+        size_cache_poll();
+        auto it = size_cache.find(key);
+        if (it == size_cache.end()) {
+            cached = size_cache_add(key, uuid, pkgname, userid, apkpath, libdirpath,
+                                    fwdlock_apkpath, asecpath, instruction_set);
+        } else if (it->second.valid) {
+            *codesize = it->second.codesize;
+            *datasize = it->second.datasize;
+            *cachesize = it->second.cachesize;
+            *asecsize = it->second.asecsize;
+            pthread_mutex_unlock(&size_cache_lock);
+            return 0;
+        }
+    }
+    pthread_mutex_unlock(&size_cache_lock);
+
+    // The watches are set up first, so that a change made while the sizes
+    // are computed invalidates them.
+    int res = compute_size(uuid, pkgname, userid, apkpath, libdirpath, fwdlock_apkpath,
+                           asecpath, instruction_set, codesize, datasize, cachesize, asecsize);
+
+    if (cached) {
+        pthread_mutex_lock(&size_cache_lock);
+        size_cache_poll();
+        auto it = size_cache.find(key);
+        if (it != size_cache.end()) {
+            it->second.valid = true;
+            it->second.codesize = *codesize;
+            it->second.datasize = *datasize;
+            it->second.cachesize = *cachesize;
+            it->second.asecsize = *asecsize;
+        }
+        pthread_mutex_unlock(&size_cache_lock);
+    }
+    return res;
+}
+
 int create_cache_path(char path[PKG_PATH_MAX], const char *src, const char *instruction_set)
 {
     char *tmp;
@@ -699,8 +1052,142 @@ static int split(char *buf, const char **argv)
   return count;
 }
 
-static void run_patchoat(int input_fd, int oat_fd, const char* input_file_name,
-    const char* output_file_name, const char *pkgname __unused, const char *instruction_set)
+int update_oom_score_adj(pid_t pid, int oom_score_adj) {
+    int result = 0;
+    int oom_fd = -1;
+    char oom_adj[128] = {0};
+
+    sprintf(oom_adj, "/proc/%d/oom_score_adj", pid);
+    oom_fd = open(oom_adj, O_WRONLY | O_CLOEXEC);
+
+    if (-1 == oom_fd) {
+        ALOGD("update_process_adj, open adj file: %s failed. error: %s", oom_adj, strerror(errno));
+        result = -1;
+    } else {
+        sprintf(oom_adj, "%d", oom_score_adj);
+        if (write(oom_fd, oom_adj, strlen(oom_adj)) == -1) {
+            result = -1;
+            ALOGD("update_process_adj, process[%d] to adj[%d] failed. error: %s\n", pid, oom_score_adj, strerror(errno));
+        }
+        close(oom_fd);
+    }
+
+    ALOGD("installd, update_process_adj sucess.");
+    return result;
+}
+
+/*
+ * What a child does between fork and exec. The commands run on worker threads, so the child
+ * of a fork may find any lock held by a thread that no longer exists in it, and must stick to
+ * async-signal-safe calls until it execs: no logging, property reads or allocations. Whatever
+ * needs those is done by the parent, before forking or on the child's behalf while the child
+ * waits for it; failures in the child are reported through its exit status only.
+ */
+struct exec_child {
+    uid_t uid;              // uid and gid to run as
+    int lock_fd;            // file to flock, or -1
+    const int *fds;         // fds the executable is handed, opened O_CLOEXEC
+    size_t fd_count;
+    bool drop_caps;
+    bool background;        // run in the background cgroup, at background priority
+    bool reset_oom_adj;     // set the oom_score_adj back to 0
+};
+
+// Exit statuses of an exec_child that failed before exec
+enum {
+    EXEC_CHILD_SETGID = 64,
+    EXEC_CHILD_SETUID = 65,
+    EXEC_CHILD_CAPSET = 66,
+    EXEC_CHILD_FLOCK = 67,
+    EXEC_CHILD_EXEC = 68,
+    EXEC_CHILD_FDS = 69,
+    EXEC_CHILD_SCHED = 70,
+    EXEC_CHILD_PRIORITY = 71,
+};
+
+/*
+ * Forks a child that sets itself up as described by child and execs path with argv. Returns
+ * the pid of the child, or -1 if it couldn't be started.
+ */
+static pid_t fork_exec(const char *path, char * const *argv, const exec_child &child)
+{
+    int start_fds[2];
+    if (pipe2(start_fds, O_CLOEXEC) != 0) {
+        ALOGE("pipe2 failed: %s\n", strerror(errno));
+        return -1;
+    }
+
+    pid_t pid = fork();
+    if (pid == 0) {
+        /* child -- wait for the parent to set up our scheduling, then drop privileges */
+        char status;
+        close(start_fds[1]);
+        if (TEMP_FAILURE_RETRY(read(start_fds[0], &status, 1)) != 1) {
+            _exit(EXEC_CHILD_SCHED);
+        }
+        if (status != 0) {
+            _exit(status);
+        }
+        for (size_t i = 0; i < child.fd_count; i++) {
+            int flags = fcntl(child.fds[i], F_GETFD);
+            if (flags < 0 || fcntl(child.fds[i], F_SETFD, flags & ~FD_CLOEXEC) < 0) {
+                _exit(EXEC_CHILD_FDS);
+            }
+        }
+        if (setgid(child.uid) != 0) {
+            _exit(EXEC_CHILD_SETGID);
+        }
+        if (setuid(child.uid) != 0) {
+            _exit(EXEC_CHILD_SETUID);
+        }
+        if (child.drop_caps) {
+            struct __user_cap_header_struct capheader;
+            struct __user_cap_data_struct capdata[2];
+            memset(&capheader, 0, sizeof(capheader));
+            memset(&capdata, 0, sizeof(capdata));
+            capheader.version = _LINUX_CAPABILITY_VERSION_3;
+            if (capset(&capheader, &capdata[0]) < 0) {
+                _exit(EXEC_CHILD_CAPSET);
+            }
+        }
+        if (child.lock_fd >= 0 && flock(child.lock_fd, LOCK_EX | LOCK_NB) != 0) {
+            _exit(EXEC_CHILD_FLOCK);
+        }
+        execv(path, argv);
+        _exit(EXEC_CHILD_EXEC);
+    }
+
+    close(start_fds[0]);
+    if (pid < 0) {
+        ALOGE("fork failed: %s\n", strerror(errno));
+        close(start_fds[1]);
+        return -1;
+    }
+
+    char status = 0;
+    if (child.background) {
+        if (set_sched_policy(pid, SP_BACKGROUND) < 0) {
+            ALOGE("set_sched_policy failed: %s\n", strerror(errno));
+            status = EXEC_CHILD_SCHED;
+        } else if (setpriority(PRIO_PROCESS, pid, ANDROID_PRIORITY_BACKGROUND) < 0) {
+            ALOGE("setpriority failed: %s\n", strerror(errno));
+            status = EXEC_CHILD_PRIORITY;
+        }
+    }
+    if (status == 0 && child.reset_oom_adj && update_oom_score_adj(pid, 0) == -1) {
+        ALOGD("installd failed to update process adj to 0.");
+    }
+    TEMP_FAILURE_RETRY(write(start_fds[1], &status, 1));
+    close(start_fds[1]);
+    if (status == 0) {
+        ALOGV("Running %s as uid %d\n", path, child.uid);
+    }
+    return pid;
+}
+
+static pid_t run_patchoat(int input_fd, int oat_fd, const char* input_file_name,
+    const char* output_file_name, const char *pkgname __unused, const char *instruction_set,
+    const exec_child &child)
 {
     static const int MAX_INT_LEN = 12;      // '-'+10dig+'\0' -OR- 0x+8dig
     static const unsigned int MAX_INSTRUCTION_SET_LEN = 7;
@@ -709,7 +1196,7 @@ static void run_patchoat(int input_fd, int oat_fd, const char* input_file_name,
     if (strlen(instruction_set) >= MAX_INSTRUCTION_SET_LEN) {
         ALOGE("Instruction set %s longer than max length of %d",
               instruction_set, MAX_INSTRUCTION_SET_LEN);
-        return;
+        return -1;
     }
 
     /* input_file_name/input_fd should be the .odex/.oat file that is precompiled. I think*/
@@ -735,8 +1222,7 @@ static void run_patchoat(int input_fd, int oat_fd, const char* input_file_name,
     argv[5] = input_oat_fd_arg;
     argv[6] = NULL;
 
-    execv(PATCHOAT_BIN, (char* const *)argv);
-    ALOGE("execv(%s) failed: %s\n", PATCHOAT_BIN, strerror(errno));
+    return fork_exec(PATCHOAT_BIN, (char* const *)argv, child);
 }
 
 static bool check_boolean_property(const char* property_name, bool default_value = false) {
@@ -748,16 +1234,16 @@ static bool check_boolean_property(const char* property_name, bool default_value
     return strcmp(tmp_property_value, "true") == 0;
 }
 
-static void run_dex2oat(int zip_fd, int oat_fd, const char* input_file_name,
+static pid_t run_dex2oat(int zip_fd, int oat_fd, const char* input_file_name,
     const char* output_file_name, int swap_fd, const char *pkgname, const char *instruction_set,
-    bool vm_safe_mode, bool debuggable)
+    bool vm_safe_mode, bool debuggable, const exec_child &child)
 {
     static const unsigned int MAX_INSTRUCTION_SET_LEN = 7;
 
     if (strlen(instruction_set) >= MAX_INSTRUCTION_SET_LEN) {
         ALOGE("Instruction set %s longer than max length of %d",
               instruction_set, MAX_INSTRUCTION_SET_LEN);
-        return;
+        return -1;
     }
 
     char prop_buf[PROPERTY_VALUE_MAX];
@@ -957,8 +1443,7 @@ static void run_dex2oat(int zip_fd, int oat_fd, const char* input_file_name,
     // Do not add after dex2oat_flags, they should override others for debugging.
     argv[i] = NULL;
 
-    execv(DEX2OAT_BIN, (char * const *)argv);
-    ALOGE("execv(%s) failed: %s\n", DEX2OAT_BIN, strerror(errno));
+    return fork_exec(DEX2OAT_BIN, (char * const *)argv, child);
 }
 
 static int wait_child(pid_t pid)
@@ -1071,28 +1556,216 @@ static bool calculate_odex_file_path(char path[PKG_PATH_MAX],
     return true;
 }
 
-int update_oom_score_adj(pid_t pid, int oom_score_adj) {
-    int result = 0;
-    int oom_fd = -1;
-    char oom_adj[128] = {0};
+/*
+ * Compilation cache: oat files dex2oat produced, named after the SHA-256 of
+ * the apk contents and of everything else its output depends on, so that
+ * reinstalling an identical apk, or installing it for another user, doesn't
+ * run dex2oat again. Enabled by persist.installd.oat_cache. Entries go when
+ * the last package linking them is removed, and free_cache() empties it
+ * before any app's cache.
+ */
+static bool oat_cache_enabled() {
+    if (!check_boolean_property("persist.installd.oat_cache")) {
+        return false;
+    }
+    // Profile guided compilation depends on more than we can reasonably hash, and there's
+    // nothing worth keeping when booting without the real /data.
+    char prop_buf[PROPERTY_VALUE_MAX];
+    if ((property_get("dalvik.vm.profiler", prop_buf, "0") > 0) && (prop_buf[0] == '1')) {
+        return false;
+    }
+    return property_get("vold.decrypt", prop_buf, "") <= 0;
+}
 
-    sprintf(oom_adj, "/proc/%d/oom_score_adj", pid);
-    oom_fd = open(oom_adj, O_WRONLY);
+/*
+ * Apk hashes already computed, by inode. An entry is only used while the
+ * apk's size, mtime and ctime are still the ones it was hashed at, so that
+ * dexopting the same apk again, e.g. for another instruction set, doesn't
+ * read it all again.
+ */
+struct oat_cache_apk_hash {
+    off_t size;
+    struct timespec mtime;
+    struct timespec ctime;
+    SHA256_CTX ctx;
+};
 
-    if (-1 == oom_fd) {
-        ALOGD("update_process_adj, open adj file: %s failed. error: %s", oom_adj, strerror(errno));
-        result = -1;
-    } else {
-        sprintf(oom_adj, "%d", oom_score_adj);
-        if (write(oom_fd, oom_adj, strlen(oom_adj)) == -1) {
-            result = -1;
-            ALOGD("update_process_adj, process[%d] to adj[%d] failed. error: %s\n", pid, oom_score_adj, strerror(errno));
+#define OAT_CACHE_MAX_APK_HASHES 1024
+
+static pthread_mutex_t oat_cache_apk_hashes_lock = PTHREAD_MUTEX_INITIALIZER;
+static std::map<std::pair<dev_t, ino_t>, oat_cache_apk_hash> oat_cache_apk_hashes;
+
+static bool same_time(const struct timespec& a, const struct timespec& b) {
+    return a.tv_sec == b.tv_sec && a.tv_nsec == b.tv_nsec;
+}
+
+static bool oat_cache_hash_apk(int apk_fd, SHA256_CTX* ctx) {
+    struct stat st;
+    if (fstat(apk_fd, &st) < 0) {
+        ALOGE("cannot stat apk for the oat cache: %s\n", strerror(errno));
+        return false;
+    }
+    const std::pair<dev_t, ino_t> key(st.st_dev, st.st_ino);
+
+    pthread_mutex_lock(&oat_cache_apk_hashes_lock);
+    auto it = oat_cache_apk_hashes.find(key);
+    bool hit = it != oat_cache_apk_hashes.end() && it->second.size == st.st_size
+            && same_time(it->second.mtime, st.st_mtim) && same_time(it->second.ctime, st.st_ctim);
+    if (hit) {
+        *ctx = it->second.ctx;
+    }
+    pthread_mutex_unlock(&oat_cache_apk_hashes_lock);
+    if (hit) {
+        return true;
+    }
+
+    char buf[64 * 1024];
+    off_t offset = 0;
+    SHA256_Init(ctx);
+    for (;;) {
+        ssize_t n = TEMP_FAILURE_RETRY(pread(apk_fd, buf, sizeof(buf), offset));
+        if (n < 0) {
+            ALOGE("cannot read apk for the oat cache: %s\n", strerror(errno));
+            return false;
         }
-        close(oom_fd);
+        if (n == 0) {
+            break;
+        }
+        SHA256_Update(ctx, buf, n);
+        offset += n;
     }
 
-    ALOGD("installd, update_process_adj sucess.");
-    return result;
+    pthread_mutex_lock(&oat_cache_apk_hashes_lock);
+    if (oat_cache_apk_hashes.size() >= OAT_CACHE_MAX_APK_HASHES) {
+        oat_cache_apk_hashes.clear();
+    }
+    oat_cache_apk_hash& entry = oat_cache_apk_hashes[key];
+    entry.size = st.st_size;
+    entry.mtime = st.st_mtim;
+    entry.ctime = st.st_ctim;
+    entry.ctx = *ctx;
+    pthread_mutex_unlock(&oat_cache_apk_hashes_lock);
+    return true;
+}
+
+static void oat_cache_hash_property(SHA256_CTX* ctx, const char* name) {
+    char value[PROPERTY_VALUE_MAX];
+    int len = property_get(name, value, "");
+    SHA256_Update(ctx, name, strlen(name) + 1);
+    SHA256_Update(ctx, value, len + 1);
+}
+
+/*
+ * Computes the cache entry for an apk whose contents were hashed into apk_ctx,
+ * when compiled with the given options and the current dex2oat configuration.
+ */
+static void oat_cache_path(char path[PKG_PATH_MAX], const SHA256_CTX* apk_ctx,
+        const char* instruction_set, bool vm_safe_mode, bool debuggable) {
+    SHA256_CTX ctx = *apk_ctx;
+    char key[PROPERTY_KEY_MAX];
+
+    SHA256_Update(&ctx, instruction_set, strlen(instruction_set) + 1);
+    SHA256_Update(&ctx, &vm_safe_mode, sizeof(vm_safe_mode));
+    SHA256_Update(&ctx, &debuggable, sizeof(debuggable));
+    oat_cache_hash_property(&ctx, "ro.build.fingerprint");
+    oat_cache_hash_property(&ctx, "dalvik.vm.dex2oat-filter");
+    oat_cache_hash_property(&ctx, "dalvik.vm.dex2oat-flags");
+    oat_cache_hash_property(&ctx, "dalvik.vm.always_debuggable");
+    oat_cache_hash_property(&ctx, "debug.usejit");
+    oat_cache_hash_property(&ctx, "debug.generate-debug-info");
+    snprintf(key, sizeof(key), "dalvik.vm.isa.%s.features", instruction_set);
+    oat_cache_hash_property(&ctx, key);
+    snprintf(key, sizeof(key), "dalvik.vm.isa.%s.variant", instruction_set);
+    oat_cache_hash_property(&ctx, key);
+
+    // The oat file is only valid against the boot image it was compiled with.
+    char image_path[PKG_PATH_MAX];
+    struct stat image_stat;
+    memset(&image_stat, 0, sizeof(image_stat));
+    snprintf(image_path, sizeof(image_path), DALVIK_CACHE_PREFIX "%s/system@framework@boot.art",
+             instruction_set);
+    stat(image_path, &image_stat);
+    SHA256_Update(&ctx, &image_stat.st_ino, sizeof(image_stat.st_ino));
+    SHA256_Update(&ctx, &image_stat.st_size, sizeof(image_stat.st_size));
+    SHA256_Update(&ctx, &image_stat.st_mtime, sizeof(image_stat.st_mtime));
+
+    uint8_t digest[SHA256_DIGEST_LENGTH];
+    SHA256_Final(digest, &ctx);
+    int len = snprintf(path, PKG_PATH_MAX, "%s/", OAT_CACHE_DIR);
+    for (size_t i = 0; i < sizeof(digest); i++) {
+        len += snprintf(path + len, PKG_PATH_MAX - len, "%02x", digest[i]);
+    }
+}
+
+/*
+ * Puts the cached oat file at out_path, hard-linked if it already has the
+ * owner and mode dexopt would give it, else copied. Returns 0 on a hit.
+ */
+static int oat_cache_fetch(const char* cache_path, const char* out_path, uid_t uid,
+        bool is_public) {
+    const mode_t mode = S_IRUSR | S_IWUSR | S_IRGRP | (is_public ? S_IROTH : 0);
+    struct stat st;
+    if (stat(cache_path, &st) < 0) {
+        return -1;
+    }
+
+    unlink(out_path);
+    if (st.st_uid == AID_SYSTEM && st.st_gid == uid && (st.st_mode & ALLPERMS) == mode
+            && link(cache_path, out_path) == 0) {
+        return 0;
+    }
+
+    int cache_fd = open(cache_path, O_RDONLY | O_CLOEXEC);
+    if (cache_fd < 0) {
+        return -1;
+    }
+    int out_fd = open(out_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, mode);
+    int res = -1;
+    if (out_fd >= 0) {
+        if (fchmod(out_fd, mode) == 0 && fchown(out_fd, AID_SYSTEM, uid) == 0) {
+            res = copy_fd(cache_fd, out_fd);
+        }
+        close(out_fd);
+        if (res != 0) {
+            ALOGE("cannot copy '%s' to '%s': %s\n", cache_path, out_path, strerror(errno));
+            unlink(out_path);
+        }
+    }
+    close(cache_fd);
+    return res;
+}
+
+/* Adds a freshly compiled oat file to the cache, by hard link where possible. */
+static void oat_cache_store(const char* out_path, const char* cache_path) {
+    if (fs_prepare_dir(OAT_CACHE_DIR, 0700, AID_SYSTEM, AID_SYSTEM) != 0) {
+        return;
+    }
+    if (link(out_path, cache_path) == 0 || errno == EEXIST) {
+        return;
+    }
+    if (errno != EXDEV) {
+        ALOGW("cannot link '%s' into the oat cache: %s\n", out_path, strerror(errno));
+        return;
+    }
+
+    // The oat file is on another volume; copy it into a temporary file first, so that the
+    // cache never has a partial entry.
+    char tmp_path[PKG_PATH_MAX];
+    snprintf(tmp_path, sizeof(tmp_path), "%s.tmp%d", cache_path, gettid());
+    int out_fd = open(out_path, O_RDONLY | O_CLOEXEC);
+    if (out_fd < 0) {
+        return;
+    }
+    int tmp_fd = open(tmp_path, O_WRONLY | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+    if (tmp_fd >= 0) {
+        int res = copy_fd(out_fd, tmp_fd);
+        close(tmp_fd);
+        if (res != 0 || rename(tmp_path, cache_path) != 0) {
+            ALOGW("cannot copy '%s' into the oat cache: %s\n", out_path, strerror(errno));
+            unlink(tmp_path);
+        }
+    }
+    close(out_fd);
 }
 
 int dexopt(const char *apk_path, uid_t uid, bool is_public,
@@ -1106,6 +1779,12 @@ int dexopt(const char *apk_path, uid_t uid, bool is_public,
     const char *input_file;
     char in_odex_path[PKG_PATH_MAX];
     int res, input_fd=-1, out_fd=-1, swap_fd=-1;
+    bool use_oat_cache;
+    SHA256_CTX apk_ctx;
+    char cache_path[PKG_PATH_MAX];
+    exec_child child;
+    int child_fds[3];
+    pid_t pid;
 
     // Early best-effort check whether we can fit the the path into our buffers.
     // Note: the cache path will require an additional 5 bytes for ".swap", but we'll try to run
@@ -1153,14 +1832,31 @@ int dexopt(const char *apk_path, uid_t uid, bool is_public,
     memset(&input_stat, 0, sizeof(input_stat));
     stat(input_file, &input_stat);
 
-    input_fd = open(input_file, O_RDONLY, 0);
+    input_fd = open(input_file, O_RDONLY | O_CLOEXEC, 0);
     if (input_fd < 0) {
         ALOGE("installd cannot open '%s' for input during dexopt\n", input_file);
         return -1;
     }
 
+    use_oat_cache = dexopt_needed == DEXOPT_DEX2OAT_NEEDED && oat_cache_enabled()
+            && oat_cache_hash_apk(input_fd, &apk_ctx);
+    if (use_oat_cache) {
+        oat_cache_path(cache_path, &apk_ctx, instruction_set, vm_safe_mode, debuggable);
+        if (oat_cache_fetch(cache_path, out_path, uid, is_public) == 0) {
+            ALOGV("DexInv: '%s' found in the oat cache\n", input_file);
+            if (strcmp(pkgname, "*") != 0) {
+                create_profile_file(pkgname, uid);
+            }
+            ut.actime = input_stat.st_atime;
+            ut.modtime = input_stat.st_mtime;
+            utime(out_path, &ut);
+            close(input_fd);
+            return 0;
+        }
+    }
+
     unlink(out_path);
-    out_fd = open(out_path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    out_fd = open(out_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
     if (out_fd < 0) {
         ALOGE("installd cannot open '%s' for output during dexopt\n", out_path);
         goto fail;
@@ -1189,7 +1885,7 @@ int dexopt(const char *apk_path, uid_t uid, bool is_public,
             strcpy(swap_file_name, out_path);
             strcpy(swap_file_name + strlen(out_path), ".swap");
             unlink(swap_file_name);
-            swap_fd = open(swap_file_name, O_RDWR | O_CREAT | O_EXCL, 0600);
+            swap_fd = open(swap_file_name, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
             if (swap_fd < 0) {
                 // Could not create swap file. Optimistically go on and hope that we can compile
                 // without it.
@@ -1207,86 +1903,59 @@ int dexopt(const char *apk_path, uid_t uid, bool is_public,
     ALOGV("DexInv: --- BEGIN '%s' ---\n", input_file);
 
 dex2oat_killed_by_signal:
-    pid_t pid;
-    pid = fork();
-    if (pid == 0) {
-
-        // update dex2oat process adj to 0, if we are not in vm_safe_mode
-        if (!vm_safe_mode && dexopt_needed == DEXOPT_DEX2OAT_NEEDED) {
-            if (update_oom_score_adj(getpid(), 0) == -1) {
-                ALOGD("installd failed to update process adj to 0.");
-            }
-        }
-
-        /* child -- drop privileges before continuing */
-        if (setgid(uid) != 0) {
-            ALOGE("setgid(%d) failed in installd during dexopt\n", uid);
-            exit(64);
-        }
-        if (setuid(uid) != 0) {
-            ALOGE("setuid(%d) failed in installd during dexopt\n", uid);
-            exit(65);
-        }
-        // drop capabilities
-        struct __user_cap_header_struct capheader;
-        struct __user_cap_data_struct capdata[2];
-        memset(&capheader, 0, sizeof(capheader));
-        memset(&capdata, 0, sizeof(capdata));
-        capheader.version = _LINUX_CAPABILITY_VERSION_3;
-        if (capset(&capheader, &capdata[0]) < 0) {
-            ALOGE("capset failed: %s\n", strerror(errno));
-            exit(66);
-        }
-        if (set_sched_policy(0, SP_BACKGROUND) < 0) {
-            ALOGE("set_sched_policy failed: %s\n", strerror(errno));
-            exit(70);
-        }
-        if (setpriority(PRIO_PROCESS, 0, ANDROID_PRIORITY_BACKGROUND) < 0) {
-            ALOGE("setpriority failed: %s\n", strerror(errno));
-            exit(71);
-        }
-        if (flock(out_fd, LOCK_EX | LOCK_NB) != 0) {
-            ALOGE("flock(%s) failed: %s\n", out_path, strerror(errno));
-            exit(67);
-        }
-
-        if (dexopt_needed == DEXOPT_PATCHOAT_NEEDED
-            || dexopt_needed == DEXOPT_SELF_PATCHOAT_NEEDED) {
-            run_patchoat(input_fd, out_fd, input_file, out_path, pkgname, instruction_set);
-        } else if (dexopt_needed == DEXOPT_DEX2OAT_NEEDED) {
-            const char *input_file_name = strrchr(input_file, '/');
-            if (input_file_name == NULL) {
-                input_file_name = input_file;
-            } else {
-                input_file_name++;
-            }
-            run_dex2oat(input_fd, out_fd, input_file_name, out_path, swap_fd, pkgname,
-                        instruction_set, vm_safe_mode, debuggable);
-        } else {
-            ALOGE("Invalid dexopt needed: %d\n", dexopt_needed);
-            exit(73);
-        }
-        exit(68);   /* only get here on exec failure */
+    child_fds[0] = input_fd;
+    child_fds[1] = out_fd;
+    child_fds[2] = swap_fd;
+    child.uid = uid;
+    child.lock_fd = out_fd;
+    child.fds = child_fds;
+    child.fd_count = swap_fd >= 0 ? 3 : 2;
+    child.drop_caps = true;
+    child.background = true;
+    // dex2oat gets the same oom_score_adj as a foreground app, unless in vm_safe_mode
+    child.reset_oom_adj = !vm_safe_mode && dexopt_needed == DEXOPT_DEX2OAT_NEEDED;
+
+    if (dexopt_needed == DEXOPT_PATCHOAT_NEEDED
+        || dexopt_needed == DEXOPT_SELF_PATCHOAT_NEEDED) {
+        pid = run_patchoat(input_fd, out_fd, input_file, out_path, pkgname, instruction_set,
+                           child);
     } else {
-        res = wait_child(pid);
-        if (res == 0) {
-            ALOGV("DexInv: --- END '%s' (success) ---\n", input_file);
-        } else if (WIFSIGNALED(res)) {
-            if (!vm_safe_mode && dexopt_needed == DEXOPT_DEX2OAT_NEEDED) {
-                vm_safe_mode = true;
-                ALOGD("dex2oat process[%d] killed by signal [%d], retry with vm_safe_mode.", pid, WTERMSIG(res));
-                goto dex2oat_killed_by_signal;
-            }
+        const char *input_file_name = strrchr(input_file, '/');
+        if (input_file_name == NULL) {
+            input_file_name = input_file;
         } else {
-            ALOGE("DexInv: --- END '%s' --- status=0x%04x, process failed\n", input_file, res);
-            goto fail;
+            input_file_name++;
+        }
+        pid = run_dex2oat(input_fd, out_fd, input_file_name, out_path, swap_fd, pkgname,
+                          instruction_set, vm_safe_mode, debuggable, child);
+    }
+    if (pid < 0) {
+        goto fail;
+    }
+    res = wait_child(pid);
+    if (res == 0) {
+        ALOGV("DexInv: --- END '%s' (success) ---\n", input_file);
+    } else if (WIFSIGNALED(res)) {
+        if (!vm_safe_mode && dexopt_needed == DEXOPT_DEX2OAT_NEEDED) {
+            vm_safe_mode = true;
+            ALOGD("dex2oat process[%d] killed by signal [%d], retry with vm_safe_mode.", pid, WTERMSIG(res));
+            goto dex2oat_killed_by_signal;
         }
+    } else {
+        ALOGE("DexInv: --- END '%s' --- status=0x%04x, process failed\n", input_file, res);
+        goto fail;
     }
 
     ut.actime = input_stat.st_atime;
     ut.modtime = input_stat.st_mtime;
     utime(out_path, &ut);
 
+    if (use_oat_cache) {
+        // vm_safe_mode may have changed if dex2oat had to be retried.
+        oat_cache_path(cache_path, &apk_ctx, instruction_set, vm_safe_mode, debuggable);
+        oat_cache_store(out_path, cache_path);
+    }
+
     close(out_fd);
     close(input_fd);
     if (swap_fd != -1) {
@@ -1305,6 +1974,305 @@ fail:
     return -1;
 }
 
+/*
+ * Calls fn(i, arg) for every i below count, on up to the given number of
+ * threads, the calling one included.
+ */
+struct parallel_work {
+    size_t count;
+    size_t next;
+    void (*fn)(size_t i, void *arg);
+    void *arg;
+    pthread_mutex_t lock;
+};
+
+static void *parallel_thread(void *arg) {
+    parallel_work *work = (parallel_work *) arg;
+    pthread_mutex_lock(&work->lock);
+    while (work->next < work->count) {
+        size_t i = work->next++;
+        pthread_mutex_unlock(&work->lock);
+        work->fn(i, work->arg);
+        pthread_mutex_lock(&work->lock);
+    }
+    pthread_mutex_unlock(&work->lock);
+    return NULL;
+}
+
+static void run_parallel(size_t count, int threads, void (*fn)(size_t i, void *arg), void *arg) {
+    parallel_work work;
+    work.count = count;
+    work.next = 0;
+    work.fn = fn;
+    work.arg = arg;
+    pthread_mutex_init(&work.lock, NULL);
+
+    std::vector<pthread_t> workers;
+    for (int i = 1; i < threads && (size_t) i < count; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, parallel_thread, &work) == 0) {
+            workers.push_back(thread);
+        }
+    }
+    parallel_thread(&work);
+    for (pthread_t thread : workers) {
+        pthread_join(thread, NULL);
+    }
+    pthread_mutex_destroy(&work.lock);
+}
+
+/*
+ * Batch dexopt, used to compile every package after an OTA.
+ *
+ * The list file has one package per line: a priority, then the arguments of
+ * the dexopt command. Packages are compiled in increasing priority order, the
+ * caller giving core apps the lowest one, by as many dex2oat children at once
+ * as there are cores and memory for them. "dalvik.vm.dexopt-batch-jobs"
+ * overrides the limit; "dalvik.vm.dexopt-batch-mem" is the memory budget of
+ * one child in MB (256 by default).
+ */
+struct dexopt_job {
+    int priority;
+    size_t index;
+    std::string apk_path;
+    uid_t uid;
+    bool is_public;
+    std::string pkgname;
+    std::string instruction_set;
+    int dexopt_needed;
+    bool vm_safe_mode;
+    bool debuggable;
+    std::string oat_dir;
+    int res;
+};
+
+static int64_t now_ms() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (int64_t) ts.tv_sec * 1000 + ts.tv_nsec / 1000000;
+}
+
+static bool parse_dexopt_job(char *line, dexopt_job *job) {
+    char *arg[10];
+    char *save = NULL;
+    int n = 0;
+    for (char *tok = strtok_r(line, " \t\n", &save); tok != NULL;
+            tok = strtok_r(NULL, " \t\n", &save)) {
+        if (n == 10) {
+            return false;
+        }
+        arg[n++] = tok;
+    }
+    if (n != 10) {
+        return false;
+    }
+    job->priority = atoi(arg[0]);
+    job->apk_path = arg[1];
+    job->uid = atoi(arg[2]);
+    job->is_public = atoi(arg[3]);
+    job->pkgname = arg[4];
+    job->instruction_set = arg[5];
+    job->dexopt_needed = atoi(arg[6]);
+    job->vm_safe_mode = atoi(arg[7]);
+    job->debuggable = atoi(arg[8]);
+    job->oat_dir = arg[9];
+    // dexopt() exits on an unknown value, reject it here instead.
+    return job->dexopt_needed == DEXOPT_DEX2OAT_NEEDED
+            || job->dexopt_needed == DEXOPT_PATCHOAT_NEEDED
+            || job->dexopt_needed == DEXOPT_SELF_PATCHOAT_NEEDED;
+}
+
+/* Available memory in kB, or -1 if unknown. */
+static int64_t get_available_memory() {
+    FILE *fp = fopen("/proc/meminfo", "re");
+    if (fp == NULL) {
+        return -1;
+    }
+    char line[128];
+    int64_t available = -1, free_kb = 0, cached = 0, value;
+    while (fgets(line, sizeof(line), fp)) {
+        if (sscanf(line, "MemAvailable: %" SCNd64, &value) == 1) {
+            available = value;
+        } else if (sscanf(line, "MemFree: %" SCNd64, &value) == 1) {
+            free_kb = value;
+        } else if (sscanf(line, "Cached: %" SCNd64, &value) == 1) {
+            cached = value;
+        }
+    }
+    fclose(fp);
+    if (available < 0 && free_kb > 0) {
+        available = free_kb + cached;
+    }
+    return available;
+}
+
+static int dexopt_batch_concurrency() {
+    char buf[PROPERTY_VALUE_MAX];
+    if (property_get("dalvik.vm.dexopt-batch-jobs", buf, "") > 0 && atoi(buf) > 0) {
+        return atoi(buf);
+    }
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    int jobs = cores > 0 ? cores : 1;
+    property_get("dalvik.vm.dexopt-batch-mem", buf, "256");
+    int64_t budget_kb = (int64_t) std::max(atoi(buf), 1) * 1024;
+    int64_t available_kb = get_available_memory();
+    if (available_kb >= 0 && available_kb / budget_kb < jobs) {
+        jobs = available_kb / budget_kb;
+    }
+    if (check_boolean_property("ro.config.low_ram")) {
+        jobs = 1;
+    }
+    return std::max(jobs, 1);
+}
+
+static void dexopt_batch_job(size_t i, void *arg) {
+    dexopt_job& job = (*(std::vector<dexopt_job> *) arg)[i];
+    lock_package(job.pkgname.c_str());
+    int64_t start = now_ms();
+    job.res = dexopt(job.apk_path.c_str(), job.uid, job.is_public, job.pkgname.c_str(),
+                     job.instruction_set.c_str(), job.dexopt_needed, job.vm_safe_mode,
+                     job.debuggable, job.oat_dir.c_str());
+    unlock_package(job.pkgname.c_str());
+    ALOGI("dexopt batch: %s (%s) %s in %" PRId64 " ms\n", job.pkgname.c_str(),
+          job.apk_path.c_str(), job.res == 0 ? "done" : "failed", now_ms() - start);
+}
+
+int dexopt_batch(const char *list_path, int *succeeded, int *failed, int64_t *elapsed_ms)
+{
+    std::vector<dexopt_job> jobs;
+    *succeeded = 0;
+    *failed = 0;
+
+    FILE *fp = fopen(list_path, "re");
+    if (fp == NULL) {
+        ALOGE("cannot open dexopt list '%s': %s\n", list_path, strerror(errno));
+        return -1;
+    }
+    char line[PKG_PATH_MAX * 3];
+    while (fgets(line, sizeof(line), fp)) {
+        if (line[0] == '\n' || line[0] == '#') {
+            continue;
+        }
+        dexopt_job job;
+        if (!parse_dexopt_job(line, &job)) {
+            ALOGE("invalid line in dexopt list '%s'\n", list_path);
+            (*failed)++;
+            continue;
+        }
+        job.index = jobs.size();
+        jobs.push_back(job);
+    }
+    fclose(fp);
+
+    std::sort(jobs.begin(), jobs.end(),
+              [](const dexopt_job& a, const dexopt_job& b) {
+                  return a.priority != b.priority ? a.priority < b.priority : a.index < b.index;
+              });
+
+    int64_t start = now_ms();
+    int threads = dexopt_batch_concurrency();
+    ALOGI("dexopt batch: %zu packages, %d at a time\n", jobs.size(), threads);
+    run_parallel(jobs.size(), threads, dexopt_batch_job, &jobs);
+
+    for (const dexopt_job& job : jobs) {
+        if (job.res == 0) {
+            (*succeeded)++;
+        } else {
+            (*failed)++;
+        }
+    }
+    *elapsed_ms = now_ms() - start;
+    ALOGI("dexopt batch: %d done, %d failed in %" PRId64 " ms\n",
+          *succeeded, *failed, *elapsed_ms);
+    return 0;
+}
+
+/*
+ * Bulk get_size. The list file has the arguments of getsize for one package
+ * per line; the sizes are computed in parallel and written to out_path as
+ * "<pkgname> <userid> <result> <code> <data> <cache> <asec>" lines, in the
+ * order of the list.
+ */
+struct size_job {
+    std::string args[8];
+    int res;
+    int64_t codesize, datasize, cachesize, asecsize;
+};
+
+static void get_sizes_job(size_t i, void *arg) {
+    size_job& job = (*(std::vector<size_job> *) arg)[i];
+    const char *uuid = job.args[0] == "!" ? NULL : job.args[0].c_str();
+    job.codesize = job.datasize = job.cachesize = job.asecsize = 0;
+    job.res = get_size(uuid, job.args[1].c_str(), atoi(job.args[2].c_str()),
+                       job.args[3].c_str(), job.args[4].c_str(), job.args[5].c_str(),
+                       job.args[6].c_str(), job.args[7].c_str(), &job.codesize,
+                       &job.datasize, &job.cachesize, &job.asecsize);
+}
+
+int get_sizes(const char *list_path, const char *out_path, int *count)
+{
+    std::vector<size_job> jobs;
+
+    FILE *fp = fopen(list_path, "re");
+    if (fp == NULL) {
+        ALOGE("cannot open size list '%s': %s\n", list_path, strerror(errno));
+        return -1;
+    }
+    char line[PKG_PATH_MAX * 6];
+    while (fgets(line, sizeof(line), fp)) {
+        size_job job;
+        char *save = NULL;
+        int n = 0;
+        for (char *tok = strtok_r(line, " \t\n", &save); tok != NULL && n < 9;
+                tok = strtok_r(NULL, " \t\n", &save)) {
+            if (n < 8) {
+                job.args[n] = tok;
+            }
+            n++;
+        }
+        if (n == 0) {
+            continue;
+        }
+        if (n != 8) {
+            ALOGE("invalid line in size list '%s'\n", list_path);
+            fclose(fp);
+            return -1;
+        }
+        jobs.push_back(job);
+    }
+    fclose(fp);
+
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    run_parallel(jobs.size(), cores > 0 ? cores : 1, get_sizes_job, &jobs);
+
+    int fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC | O_NOFOLLOW | O_CLOEXEC, 0640);
+    if (fd < 0) {
+        ALOGE("cannot create '%s': %s\n", out_path, strerror(errno));
+        return -1;
+    }
+    if (fchown(fd, AID_SYSTEM, AID_SYSTEM) < 0) {
+        ALOGE("cannot chown '%s': %s\n", out_path, strerror(errno));
+        close(fd);
+        return -1;
+    }
+    FILE *out = fdopen(fd, "w");
+    if (out == NULL) {
+        close(fd);
+        return -1;
+    }
+    for (const size_job& job : jobs) {
+        fprintf(out, "%s %s %d %" PRId64 " %" PRId64 " %" PRId64 " %" PRId64 "\n",
+                job.args[1].c_str(), job.args[2].c_str(), job.res, job.codesize,
+                job.datasize, job.cachesize, job.asecsize);
+    }
+    if (fclose(out) != 0) {
+        ALOGE("cannot write '%s': %s\n", out_path, strerror(errno));
+        return -1;
+    }
+    *count = jobs.size();
+    return 0;
+}
+
 int mark_boot_complete(const char* instruction_set)
 {
   char boot_marker_path[PKG_PATH_MAX];
@@ -1646,7 +2614,8 @@ out:
     return rc;
 }
 
-static void run_idmap(const char *target_apk, const char *overlay_apk, int idmap_fd)
+static pid_t run_idmap(const char *target_apk, const char *overlay_apk, int idmap_fd,
+                       uid_t uid)
 {
     static const char *IDMAP_BIN = "/system/bin/idmap";
     static const size_t MAX_INT_LEN = 32;
@@ -1654,8 +2623,16 @@ static void run_idmap(const char *target_apk, const char *overlay_apk, int idmap
 
     snprintf(idmap_str, sizeof(idmap_str), "%d", idmap_fd);
 
-    execl(IDMAP_BIN, IDMAP_BIN, "--fd", target_apk, overlay_apk, idmap_str, (char*)NULL);
-    ALOGE("execl(%s) failed: %s\n", IDMAP_BIN, strerror(errno));
+    const char *argv[] = { IDMAP_BIN, "--fd", target_apk, overlay_apk, idmap_str, NULL };
+    exec_child child;
+    child.uid = uid;
+    child.lock_fd = idmap_fd;
+    child.fds = &idmap_fd;
+    child.fd_count = 1;
+    child.drop_caps = false;
+    child.background = false;
+    child.reset_oom_adj = false;
+    return fork_exec(IDMAP_BIN, (char * const *)argv, child);
 }
 
 // Transform string /a/b/c.apk to (prefix)/a@b@c.apk@(suffix)
@@ -1707,7 +2684,7 @@ int idmap(const char *target_apk, const char *overlay_apk, uid_t uid)
     }
 
     unlink(idmap_path);
-    idmap_fd = open(idmap_path, O_RDWR | O_CREAT | O_EXCL, 0644);
+    idmap_fd = open(idmap_path, O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0644);
     if (idmap_fd < 0) {
         ALOGE("idmap cannot open '%s' for output: %s\n", idmap_path, strerror(errno));
         goto fail;
@@ -1722,30 +2699,15 @@ int idmap(const char *target_apk, const char *overlay_apk, uid_t uid)
     }
 
     pid_t pid;
-    pid = fork();
-    if (pid == 0) {
-        /* child -- drop privileges before continuing */
-        if (setgid(uid) != 0) {
-            ALOGE("setgid(%d) failed during idmap\n", uid);
-            exit(1);
-        }
-        if (setuid(uid) != 0) {
-            ALOGE("setuid(%d) failed during idmap\n", uid);
-            exit(1);
-        }
-        if (flock(idmap_fd, LOCK_EX | LOCK_NB) != 0) {
-            ALOGE("flock(%s) failed during idmap: %s\n", idmap_path, strerror(errno));
-            exit(1);
-        }
-
-        run_idmap(target_apk, overlay_apk, idmap_fd);
-        exit(1); /* only if exec call to idmap failed */
-    } else {
-        int status = wait_child(pid);
-        if (status != 0) {
-            ALOGE("idmap failed, status=0x%04x\n", status);
-            goto fail;
-        }
+    pid = run_idmap(target_apk, overlay_apk, idmap_fd, uid);
+    if (pid < 0) {
+        goto fail;
+    }
+    int status;
+    status = wait_child(pid);
+    if (status != 0) {
+        ALOGE("idmap failed, status=0x%04x\n", status);
+        goto fail;
     }
 
     close(idmap_fd);
@@ -1758,30 +2720,40 @@ fail:
     return -1;
 }
 
-int restorecon_data(const char* uuid, const char* pkgName,
-                    const char* seinfo, uid_t uid)
+/*
+ * A package data directory for restorecon to relabel, with the seinfo and uid
+ * it's labeled for.
+ */
+struct restorecon_dir {
+    std::string path;
+    std::string pkgname;
+    std::string seinfo;
+    uid_t uid;
+    bool skipped;
+    int res;
+};
+
+/*
+ * Adds the data directories of a package to relabel: the owner's on internal
+ * storage, and those of every secondary user that has it.
+ */
+static int add_restorecon_dirs(const char* uuid, const char* pkgName, const char* seinfo,
+                               uid_t uid, std::vector<restorecon_dir>* dirs)
 {
     struct dirent *entry;
     DIR *d;
     struct stat s;
-    int ret = 0;
-
-    // SELINUX_ANDROID_RESTORECON_DATADATA flag is set by libselinux. Not needed here.
-    unsigned int flags = SELINUX_ANDROID_RESTORECON_RECURSE;
-
-    if (!pkgName || !seinfo) {
-        ALOGE("Package name or seinfo tag is null when trying to restorecon.");
-        return -1;
-    }
+    restorecon_dir dir;
+    dir.pkgname = pkgName;
+    dir.seinfo = seinfo;
+    dir.skipped = false;
+    dir.res = 0;
 
     // Special case for owner on internal storage
     if (uuid == nullptr) {
-        std::string path(create_data_user_package_path(nullptr, 0, pkgName));
-
-        if (selinux_android_restorecon_pkgdir(path.c_str(), seinfo, uid, flags) < 0) {
-            PLOG(ERROR) << "restorecon failed for " << path;
-            ret |= -1;
-        }
+        dir.path = create_data_user_package_path(nullptr, 0, pkgName);
+        dir.uid = uid;
+        dirs->push_back(dir);
     }
 
     // Relabel package directory for all secondary users.
@@ -1808,21 +2780,186 @@ int restorecon_data(const char* uuid, const char* pkgName,
             continue;
         }
 
-        std::string pkgdir(StringPrintf("%s%s/%s", userdir.c_str(), user, pkgName));
-        if (stat(pkgdir.c_str(), &s) < 0) {
+        dir.path = StringPrintf("%s%s/%s", userdir.c_str(), user, pkgName);
+        if (stat(dir.path.c_str(), &s) < 0) {
             continue;
         }
+        dir.uid = s.st_uid;
+        dirs->push_back(dir);
+    }
+
+    closedir(d);
+    return 0;
+}
 
-        if (selinux_android_restorecon_pkgdir(pkgdir.c_str(), seinfo, s.st_uid, flags) < 0) {
-            PLOG(ERROR) << "restorecon failed for " << pkgdir;
-            ret |= -1;
+/*
+ * After relabeling a package directory, restorecon stores a hash of the
+ * policy files that decide its labels, of its seinfo and of its uid in an
+ * xattr of the directory, so that restorecon_data_batch() can skip it until
+ * any of them changes.
+ */
+static const char* kRestoreconHashXattr = "security.restorecon_pkgdir";
+
+static const char* kRestoreconPolicyFiles[] = {
+    "/seapp_contexts",
+    "/file_contexts",
+    "/data/security/current/seapp_contexts",
+    "/data/security/current/file_contexts",
+};
+
+static void get_restorecon_policy_hash(SHA256_CTX* ctx) {
+    SHA256_Init(ctx);
+    for (size_t i = 0; i < ARRAY_SIZE(kRestoreconPolicyFiles); i++) {
+        int fd = open(kRestoreconPolicyFiles[i], O_RDONLY | O_CLOEXEC);
+        if (fd < 0) {
+            continue;
+        }
+        SHA256_Update(ctx, kRestoreconPolicyFiles[i], strlen(kRestoreconPolicyFiles[i]) + 1);
+        char buf[16 * 1024];
+        ssize_t n;
+        while ((n = TEMP_FAILURE_RETRY(read(fd, buf, sizeof(buf)))) > 0) {
+            SHA256_Update(ctx, buf, n);
         }
+        close(fd);
     }
+}
 
-    closedir(d);
+static void restorecon_one(restorecon_dir* dir, const SHA256_CTX* policy_ctx,
+                           bool skip_unchanged) {
+    // SELINUX_ANDROID_RESTORECON_DATADATA flag is set by libselinux. Not needed here.
+    unsigned int flags = SELINUX_ANDROID_RESTORECON_RECURSE;
+
+    SHA256_CTX ctx = *policy_ctx;
+    uint8_t hash[SHA256_DIGEST_LENGTH];
+    SHA256_Update(&ctx, dir->seinfo.c_str(), dir->seinfo.size() + 1);
+    SHA256_Update(&ctx, &dir->uid, sizeof(dir->uid));
+    SHA256_Final(hash, &ctx);
+
+    if (skip_unchanged) {
+        uint8_t last[SHA256_DIGEST_LENGTH];
+        if (getxattr(dir->path.c_str(), kRestoreconHashXattr, last, sizeof(last))
+                == (ssize_t) sizeof(last) && memcmp(last, hash, sizeof(hash)) == 0) {
+            dir->skipped = true;
+            dir->res = 0;
+            return;
+        }
+    }
+
+    if (selinux_android_restorecon_pkgdir(dir->path.c_str(), dir->seinfo.c_str(), dir->uid,
+                                          flags) < 0) {
+        PLOG(ERROR) << "restorecon failed for " << dir->path;
+        dir->res = -1;
+        return;
+    }
+    if (setxattr(dir->path.c_str(), kRestoreconHashXattr, hash, sizeof(hash), 0) < 0) {
+        PLOG(WARNING) << "cannot record restorecon hash of " << dir->path;
+    }
+    dir->res = 0;
+}
+
+int restorecon_data(const char* uuid, const char* pkgName,
+                    const char* seinfo, uid_t uid)
+{
+    int ret = 0;
+
+    if (!pkgName || !seinfo) {
+        ALOGE("Package name or seinfo tag is null when trying to restorecon.");
+        return -1;
+    }
+
+    std::vector<restorecon_dir> dirs;
+    ret = add_restorecon_dirs(uuid, pkgName, seinfo, uid, &dirs);
+
+    SHA256_CTX policy_ctx;
+    get_restorecon_policy_hash(&policy_ctx);
+    for (restorecon_dir& dir : dirs) {
+        // An explicit request always relabels.
+        restorecon_one(&dir, &policy_ctx, false);
+        ret |= dir.res;
+    }
     return ret;
 }
 
+/*
+ * Bulk restorecon_data, used after a policy update. The list file has the
+ * arguments of restorecondata for one package per line ("!" for a null
+ * uuid). The data directories of all packages and users are relabeled in
+ * parallel, one thread per core, skipping those already labeled for the
+ * current policy, seinfo and uid. Each directory is relabeled with its
+ * package locked, so other commands on the package wait for it, but only
+ * for it.
+ */
+struct restorecon_batch {
+    std::vector<restorecon_dir> dirs;
+    SHA256_CTX policy_ctx;
+};
+
+static void restorecon_batch_job(size_t i, void *arg) {
+    restorecon_batch* batch = (restorecon_batch *) arg;
+    restorecon_dir& dir = batch->dirs[i];
+    lock_package(dir.pkgname.c_str());
+    restorecon_one(&dir, &batch->policy_ctx, true);
+    unlock_package(dir.pkgname.c_str());
+}
+
+int restorecon_data_batch(const char *list_path, int *relabeled, int *skipped, int *failed)
+{
+    restorecon_batch batch;
+    *relabeled = 0;
+    *skipped = 0;
+    *failed = 0;
+
+    FILE *fp = fopen(list_path, "re");
+    if (fp == NULL) {
+        ALOGE("cannot open restorecon list '%s': %s\n", list_path, strerror(errno));
+        return -1;
+    }
+    char line[PKG_PATH_MAX * 3];
+    while (fgets(line, sizeof(line), fp)) {
+        char *arg[4];
+        char *save = NULL;
+        int n = 0;
+        for (char *tok = strtok_r(line, " \t\n", &save); tok != NULL && n < 5;
+                tok = strtok_r(NULL, " \t\n", &save)) {
+            if (n < 4) {
+                arg[n] = tok;
+            }
+            n++;
+        }
+        if (n == 0) {
+            continue;
+        }
+        if (n != 4) {
+            ALOGE("invalid line in restorecon list '%s'\n", list_path);
+            (*failed)++;
+            continue;
+        }
+        const char *uuid = strcmp(arg[0], "!") == 0 ? NULL : arg[0];
+        if (add_restorecon_dirs(uuid, arg[1], arg[2], atoi(arg[3]), &batch.dirs) != 0) {
+            (*failed)++;
+        }
+    }
+    fclose(fp);
+
+    int64_t start = now_ms();
+    long cores = sysconf(_SC_NPROCESSORS_ONLN);
+    get_restorecon_policy_hash(&batch.policy_ctx);
+    run_parallel(batch.dirs.size(), cores > 0 ? cores : 1, restorecon_batch_job, &batch);
+
+    for (const restorecon_dir& dir : batch.dirs) {
+        if (dir.res != 0) {
+            (*failed)++;
+        } else if (dir.skipped) {
+            (*skipped)++;
+        } else {
+            (*relabeled)++;
+        }
+    }
+    ALOGI("restorecon batch: %d relabeled, %d unchanged, %d failed in %" PRId64 " ms\n",
+          *relabeled, *skipped, *failed, now_ms() - start);
+    return 0;
+}
+
 int create_oat_dir(const char* oat_dir, const char* instruction_set)
 {
     char oat_instr_dir[PKG_PATH_MAX];
@@ -1851,7 +2988,14 @@ int rm_package_dir(const char* apk_path)
         ALOGE("invalid apk path '%s' (bad prefix)\n", apk_path);
         return -1;
     }
-    return delete_dir_contents(apk_path, 1 /* also_delete_dir */ , NULL /* exclusion_predicate */);
+    // The directory may only be renamed away here, so look for its cached oat files first.
+    std::vector<struct stat> removed;
+    oat_cache_collect(apk_path, &removed);
+    int res = delete_dir_deferred(apk_path);
+    if (res == 0) {
+        oat_cache_evict(removed);
+    }
+    return res;
 }
 
 int link_file(const char* relative_path, const char* from_base, const char* to_base) {
@@ -1907,24 +3051,90 @@ int calculate_oat_file_path(char path[PKG_PATH_MAX], const char *oat_dir, const
 }
 
 //SPRD: add for backup app @{
+#ifndef FICLONE
+#define FICLONE _IOW(0x94, 9, int)
+#endif
+
+#define COPY_BUFFER_SIZE (256*1024)
+#define COPY_THREADS_MAX 4
+
+/* Copies the contents of a file: by sharing its extents where the filesystem
+ * can (reflink), else in the kernel, else through a large buffer. */
+static int copy_fd(int src_fd, int dest_fd) {
+	if (ioctl(dest_fd, FICLONE, src_fd) == 0) {
+		return 0;
+	}
+	struct stat st;
+	if (fstat(src_fd, &st) < 0) {
+		return -1;
+	}
+	off_t remaining = st.st_size;
+#ifdef __NR_copy_file_range
+	while (remaining > 0) {
+		ssize_t n = syscall(__NR_copy_file_range, src_fd, NULL, dest_fd, NULL,
+				(size_t) remaining, 0);
+		if (n <= 0) {
+			break;
+		}
+		remaining -= n;
+	}
+#endif
+	while (remaining > 0) {
+		ssize_t n = sendfile(dest_fd, src_fd, NULL,
+				remaining < COPY_BUFFER_SIZE * 16 ? remaining : COPY_BUFFER_SIZE * 16);
+		if (n <= 0) {
+			break;
+		}
+		remaining -= n;
+	}
+	// Whatever the kernel didn't copy, or the file grew by since.
+	char* buf = (char*) malloc(COPY_BUFFER_SIZE);
+	if (buf == NULL) {
+		return -1;
+	}
+	int res = 0;
+	for (;;) {
+		ssize_t n = TEMP_FAILURE_RETRY(read(src_fd, buf, COPY_BUFFER_SIZE));
+		if (n <= 0) {
+			res = n;
+			break;
+		}
+		char* p = buf;
+		while (n > 0) {
+			ssize_t written = TEMP_FAILURE_RETRY(write(dest_fd, p, n));
+			if (written <= 0) {
+				res = -1;
+				break;
+			}
+			p += written;
+			n -= written;
+		}
+		if (res < 0) {
+			break;
+		}
+	}
+	free(buf);
+	return res;
+}
+
 static int copy_file(const char* src, const char* dest, arg_chown* arg) {
-	FILE *fpSrc, *fpDest;
-	fpSrc = fopen(src, "rb");
-	if (fpSrc == NULL) {
+	int src_fd = open(src, O_RDONLY | O_CLOEXEC);
+	if (src_fd < 0) {
 		ALOGE( "Source file open failure.\n");
 		return -1;
 	}
-	fpDest = fopen(dest, "wb");
-	if (fpDest == NULL) {
+	int dest_fd = open(dest, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+	if (dest_fd < 0) {
 		ALOGE("Destination file open failure.\n");
+		close(src_fd);
 		return -1;
 	}
-	int c;
-	while ((c = fgetc(fpSrc)) != EOF) {
-		fputc(c, fpDest);
+	int res = copy_fd(src_fd, dest_fd);
+	if (res < 0) {
+		ALOGE("cannot copy '%s' to '%s': %s\n", src, dest, strerror(errno));
 	}
-	fclose(fpSrc);
-	fclose(fpDest);
+	close(src_fd);
+	close(dest_fd);
 	if (arg != NULL) {
 		if (chmod(dest, arg->mode) < 0) {
 			ALOGE("cannot chmod file '%s': %s\n", dest, strerror(errno));
@@ -1933,7 +3143,7 @@ static int copy_file(const char* src, const char* dest, arg_chown* arg) {
 			ALOGE("cannot chown file '%s': %s\n", dest, strerror(errno));
 		}
 	}
-	return 0;
+	return res;
 }
 
 static inline int is_dir(const char* path) {
@@ -1970,8 +3180,29 @@ static int create_dir(const char* name, arg_chown* arg) {
 	return 0;
 }
 
+struct copy_job {
+	std::string src;
+	std::string dest;
+};
+
+struct copy_work {
+	std::vector<copy_job> files;
+	arg_chown* arg;
+};
+
+static void copy_folder_file(size_t i, void *_work) {
+	copy_work* work = (copy_work*) _work;
+	const copy_job& job = work->files[i];
+	if (copy_file(job.src.c_str(), job.dest.c_str(), work->arg) < 0) {
+		ALOGW(
+				"copy file from %s to %s failed\n", job.src.c_str(), job.dest.c_str());
+	}
+}
+
+/* Creates the directories of the copy, and lists the files to copy. */
 static int _copy_folder(const char* src, const char* dest, char is_copy_lib,
-		arg_chown* arg) {
+		copy_work* work) {
+	arg_chown* arg = work->arg;
 	if (!is_dir(src)) {
 		ALOGE("file: %s is not a folder!\n", src);
 		return -2;
@@ -2007,14 +3238,11 @@ static int _copy_folder(const char* src, const char* dest, char is_copy_lib,
 		case DT_DIR:
 			if (access(destfile_name, 0) == 0
 					|| create_dir(destfile_name, arg) >= 0) {
-				_copy_folder(srcfile_name, destfile_name, 1, arg);
+				_copy_folder(srcfile_name, destfile_name, 1, work);
 			}
 			break;
 		case DT_REG:
-			if (copy_file(srcfile_name, destfile_name, arg) < 0) {
-				ALOGW(
-						"copy file from %s to %s failed\n", srcfile_name, destfile_name);
-			}
+			work->files.push_back({ srcfile_name, destfile_name });
 			break;
 		}
 	}
@@ -2028,7 +3256,15 @@ static int copy_folder(const char* src, const char* dest, char is_copy_lib,
 	if (arg->uid < 0 || arg->gid < 0) {
 		arg = NULL;
 	}
-	return _copy_folder(src, dest, is_copy_lib, arg);
+	copy_work work;
+	work.arg = arg;
+	int res = _copy_folder(src, dest, is_copy_lib, &work);
+	if (res == 0) {
+		long cores = sysconf(_SC_NPROCESSORS_ONLN);
+		run_parallel(work.files.size(), cores < COPY_THREADS_MAX ? (cores > 0 ? cores : 1)
+				: COPY_THREADS_MAX, copy_folder_file, &work);
+	}
+	return res;
 }
 
 int backup_app(const char* pkgname, const char* dest_path, int uid, int gid) {
@@ -18,6 +18,8 @@
 
 #include <base/logging.h>
 
+#include <algorithm>
+#include <pthread.h>
 #include <sys/capability.h>
 #include <sys/prctl.h>
 #include <selinux/android.h>
@@ -26,6 +28,8 @@
 #define BUFFER_MAX    1024  /* input buffer for commands */
 #define TOKEN_MAX     16    /* max number of arguments in buffer */
 #define REPLY_MAX     256   /* largest reply allowed */
+#define WORKERS_MAX   4     /* commands executed at the same time */
+#define PENDING_MAX   16    /* commands read ahead of their reply on a connection */
 
 static char* parse_null(char* arg) {
     if (strcmp(arg, "!") == 0) {
@@ -53,6 +57,20 @@ static int do_dexopt(char **arg, char reply[REPLY_MAX] __unused)
                   atoi(arg[6]), atoi(arg[7]), arg[8]);
 }
 
+static int do_dexopt_batch(char **arg, char reply[REPLY_MAX])
+{
+    int succeeded, failed;
+    int64_t elapsed_ms;
+    int res;
+
+    /* list_path */
+    res = dexopt_batch(arg[0], &succeeded, &failed, &elapsed_ms);
+    if (res == 0) {
+        snprintf(reply, REPLY_MAX, "%d %d %" PRId64, succeeded, failed, elapsed_ms);
+    }
+    return res;
+}
+
 static int do_mark_boot_complete(char **arg, char reply[REPLY_MAX] __unused)
 {
     return mark_boot_complete(arg[0] /* instruction set */);
@@ -119,6 +137,17 @@ static int do_get_size(char **arg, char reply[REPLY_MAX])
     return res;
 }
 
+static int do_get_sizes(char **arg, char reply[REPLY_MAX])
+{
+    int count = 0;
+    int res;
+
+        /* list_path, out_path */
+    res = get_sizes(arg[0], arg[1], &count);
+    snprintf(reply, REPLY_MAX, "%d", count);
+    return res;
+}
+
 static int do_rm_user_data(char **arg, char reply[REPLY_MAX] __unused)
 {
     return delete_user_data(parse_null(arg[0]), arg[1], atoi(arg[2])); /* uuid, pkgname, userid */
@@ -167,6 +196,19 @@ static int do_restorecon_data(char **arg, char reply[REPLY_MAX] __attribute__((u
                              /* uuid, pkgName, seinfo, uid*/
 }
 
+static int do_restorecon_data_batch(char **arg, char reply[REPLY_MAX])
+{
+    int relabeled, skipped, failed;
+    int res;
+
+    /* list_path */
+    res = restorecon_data_batch(arg[0], &relabeled, &skipped, &failed);
+    if (res == 0) {
+        snprintf(reply, REPLY_MAX, "%d %d %d", relabeled, skipped, failed);
+    }
+    return res;
+}
+
 static int do_create_oat_dir(char **arg, char reply[REPLY_MAX] __unused)
 {
     /* oat_dir, instruction_set */
@@ -197,42 +239,56 @@ static int do_restore_app(char **arg, char reply[REPLY_MAX] __unused)
 }
 //@}
 
+/* Commands for the same package are executed in the order they were read,
+ * commands for different packages can be executed at the same time.
+ * 'pkgarg' is the index of the package name in the arguments, or one of:
+ */
+#define PKG_NONE      -1    /* doesn't touch any package, never waits */
+#define PKG_ALL       -2    /* may touch any package, executed alone */
+#define PKG_BATCH     -3    /* works through a list of packages, locking each in
+                             * turn with lock_package; one batch at a time */
+
 struct cmdinfo {
     const char *name;
     unsigned numargs;
     int (*func)(char **arg, char reply[REPLY_MAX]);
+    int pkgarg;
+    bool serial;    /* executed one at a time, whatever the package */
 };
 
 struct cmdinfo cmds[] = {
-    { "ping",                 0, do_ping },
-    { "install",              5, do_install },
-    { "dexopt",               9, do_dexopt },
-    { "markbootcomplete",     1, do_mark_boot_complete },
-    { "movedex",              3, do_move_dex },
-    { "rmdex",                2, do_rm_dex },
-    { "remove",               3, do_remove },
-    { "rename",               2, do_rename },
-    { "fixuid",               4, do_fixuid },
-    { "freecache",            2, do_free_cache },
-    { "rmcache",              3, do_rm_cache },
-    { "rmcodecache",          3, do_rm_code_cache },
-    { "getsize",              8, do_get_size },
-    { "rmuserdata",           3, do_rm_user_data },
-    { "cpcompleteapp",        6, do_cp_complete_app },
-    { "movefiles",            0, do_movefiles },
-    { "linklib",              4, do_linklib },
-    { "mkuserdata",           5, do_mk_user_data },
-    { "mkuserconfig",         1, do_mk_user_config },
-    { "rmuser",               2, do_rm_user },
-    { "idmap",                3, do_idmap },
-    { "restorecondata",       4, do_restorecon_data },
-    { "createoatdir",         2, do_create_oat_dir },
+    { "ping",                 0, do_ping,               PKG_NONE, false },
+    { "install",              5, do_install,            1,        false },
+    { "dexopt",               9, do_dexopt,             3,        true  },
+    { "dexoptbatch",          1, do_dexopt_batch,       PKG_BATCH, true },
+    { "markbootcomplete",     1, do_mark_boot_complete, PKG_ALL,  false },
+    { "movedex",              3, do_move_dex,           PKG_ALL,  false },
+    { "rmdex",                2, do_rm_dex,             PKG_ALL,  false },
+    { "remove",               3, do_remove,             1,        false },
+    { "rename",               2, do_rename,             PKG_ALL,  false },
+    { "fixuid",               4, do_fixuid,             1,        false },
+    { "freecache",            2, do_free_cache,         PKG_ALL,  false },
+    { "rmcache",              3, do_rm_cache,           1,        false },
+    { "rmcodecache",          3, do_rm_code_cache,      1,        false },
+    { "getsize",              8, do_get_size,           1,        false },
+    { "getsizes",             2, do_get_sizes,          PKG_ALL,  false },
+    { "rmuserdata",           3, do_rm_user_data,       1,        false },
+    { "cpcompleteapp",        6, do_cp_complete_app,    2,        false },
+    { "movefiles",            0, do_movefiles,          PKG_ALL,  false },
+    { "linklib",              4, do_linklib,            1,        false },
+    { "mkuserdata",           5, do_mk_user_data,       1,        false },
+    { "mkuserconfig",         1, do_mk_user_config,     PKG_ALL,  false },
+    { "rmuser",               2, do_rm_user,            PKG_ALL,  false },
+    { "idmap",                3, do_idmap,              PKG_ALL,  false },
+    { "restorecondata",       4, do_restorecon_data,    1,        false },
+    { "restorecondatabatch",  1, do_restorecon_data_batch, PKG_BATCH, false },
+    { "createoatdir",         2, do_create_oat_dir,     PKG_ALL,  false },
     //SPRD: add for backup app @{
-    { "backupapp", 4, do_backup_app },
-    { "restoreapp", 4, do_restore_app },
+    { "backupapp", 4, do_backup_app, 0, false },
+    { "restoreapp", 4, do_restore_app, 1, false },
     // @}
-    { "rmpackagedir",         1, do_rm_package_dir },
-    { "linkfile",             3, do_link_file }
+    { "rmpackagedir",         1, do_rm_package_dir,     PKG_ALL,  false },
+    { "linkfile",             3, do_link_file,          PKG_ALL,  false }
 };
 
 static int readx(int s, void *_buf, int count)
@@ -274,34 +330,70 @@ static int writex(int s, const void *_buf, int count)
 }
 
 
-/* Tokenize the command buffer, locate a matching command,
- * ensure that the required number of arguments are provided,
- * call the function(), return the result.
+/* A command read from a connection. Commands are executed by a pool of
+ * worker threads but replied to in the order they were read, which is all
+ * the protocol has to match a reply with its command.
  */
-static int execute(int s, char cmd[BUFFER_MAX])
-{
-    char reply[REPLY_MAX];
+enum {
+    JOB_QUEUED,
+    JOB_RUNNING,
+    JOB_DONE
+};
+
+struct connection;
+
+struct job {
+    struct connection *conn;
+    const struct cmdinfo *info;     /* NULL if the command is invalid */
     char *arg[TOKEN_MAX+1];
+    char key[PKG_NAME_MAX];         /* package of the command, if any */
+    bool reload;                    /* reload the seapp contexts first */
+    int state;
+    unsigned short count;           /* length of the reply in buf */
+    struct job *prev, *next;        /* unfinished jobs, in the order read */
+    struct job *reply_next;         /* jobs of conn, in the order read */
+    char buf[BUFFER_MAX];
+};
+
+struct connection {
+    int s;
+    int pending;                    /* jobs not replied to yet */
+    bool flushing;                  /* a thread is writing replies */
+    bool error;                     /* a reply couldn't be written */
+    struct job *reply_head, *reply_tail;
+    pthread_cond_t cond;
+};
+
+static pthread_mutex_t jobs_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t jobs_cond = PTHREAD_COND_INITIALIZER;
+static struct job *jobs_head, *jobs_tail;
+static std::vector<std::string> locked_packages;   /* by batch commands */
+static bool selinux_enabled;
+
+/* Tokenize the command buffer, locate a matching command and
+ * ensure that the required number of arguments are provided.
+ */
+static void parse(struct job *j)
+{
+    char *cmd = j->buf;
     unsigned i;
     unsigned n = 0;
-    unsigned short count;
-    int ret = -1;
 
     // ALOGI("execute('%s')\n", cmd);
 
-        /* default reply is "" */
-    reply[0] = 0;
+    j->info = NULL;
+    j->key[0] = 0;
 
         /* n is number of args (not counting arg[0]) */
-    arg[0] = cmd;
+    j->arg[0] = cmd;
     while (*cmd) {
         if (isspace(*cmd)) {
             *cmd++ = 0;
             n++;
-            arg[n] = cmd;
+            j->arg[n] = cmd;
             if (n == TOKEN_MAX) {
                 ALOGE("too many arguments\n");
-                goto done;
+                return;
             }
         }
         if (*cmd) {
@@ -310,31 +402,236 @@ static int execute(int s, char cmd[BUFFER_MAX])
     }
 
     for (i = 0; i < sizeof(cmds) / sizeof(cmds[0]); i++) {
-        if (!strcmp(cmds[i].name,arg[0])) {
+        if (!strcmp(cmds[i].name, j->arg[0])) {
             if (n != cmds[i].numargs) {
                 ALOGE("%s requires %d arguments (%d given)\n",
                      cmds[i].name, cmds[i].numargs, n);
             } else {
-                ret = cmds[i].func(arg + 1, reply);
+                j->info = &cmds[i];
+                if (cmds[i].pkgarg >= 0) {
+                    strlcpy(j->key, j->arg[cmds[i].pkgarg + 1], sizeof(j->key));
+                }
             }
-            goto done;
+            return;
         }
     }
-    ALOGE("unsupported command '%s'\n", arg[0]);
+    ALOGE("unsupported command '%s'\n", j->arg[0]);
+}
+
+/* Call the function() of a parsed command, leave the reply in its buffer.
+ */
+static void execute(struct job *j)
+{
+    char reply[REPLY_MAX];
+    unsigned n;
+    int ret = -1;
+
+        /* default reply is "" */
+    reply[0] = 0;
+
+    if (j->info) {
+        ret = j->info->func(j->arg + 1, reply);
+    }
 
-done:
     if (reply[0]) {
-        n = snprintf(cmd, BUFFER_MAX, "%d %s", ret, reply);
+        n = snprintf(j->buf, BUFFER_MAX, "%d %s", ret, reply);
     } else {
-        n = snprintf(cmd, BUFFER_MAX, "%d", ret);
+        n = snprintf(j->buf, BUFFER_MAX, "%d", ret);
     }
     if (n > BUFFER_MAX) n = BUFFER_MAX;
-    count = n;
+    j->count = n;
 
-    // ALOGI("reply: '%s'\n", cmd);
-    if (writex(s, &count, sizeof(count))) return -1;
-    if (writex(s, cmd, count)) return -1;
-    return 0;
+    // ALOGI("reply: '%s'\n", j->buf);
+}
+
+/* Whether a command must wait for an earlier one to finish. Commands on
+ * different packages can run together, unless either may touch any package
+ * or both are serial. A batch runs alongside the commands on single
+ * packages, which it keeps out of its way with lock_package. */
+static bool conflicts(const struct job *earlier, const struct job *j)
+{
+    int a = earlier->info ? earlier->info->pkgarg : PKG_NONE;
+    int b = j->info ? j->info->pkgarg : PKG_NONE;
+
+    if (earlier->reload || j->reload) return true;
+    if (a == PKG_NONE || b == PKG_NONE) return false;
+    if (a == PKG_ALL || b == PKG_ALL) return true;
+    if (a == PKG_BATCH && b == PKG_BATCH) return true;
+    if (earlier->info->serial && j->info->serial) return true;
+    if (a == PKG_BATCH || b == PKG_BATCH) return false;
+    return !strcmp(earlier->key, j->key);
+}
+
+/* Called with jobs_lock held. */
+static bool is_package_locked(const char *pkgname)
+{
+    return std::find(locked_packages.begin(), locked_packages.end(), pkgname)
+            != locked_packages.end();
+}
+
+/* Called with jobs_lock held. */
+static bool is_package_running(const char *pkgname)
+{
+    for (struct job *j = jobs_head; j; j = j->next) {
+        if (j->state == JOB_RUNNING && j->key[0] && !strcmp(j->key, pkgname)) return true;
+    }
+    return false;
+}
+
+/* Called with jobs_lock held. */
+static struct job *next_runnable()
+{
+    for (struct job *j = jobs_head; j; j = j->next) {
+        if (j->state != JOB_QUEUED) continue;
+        if (j->key[0] && is_package_locked(j->key)) continue;
+        struct job *e = jobs_head;
+        while (e != j && !conflicts(e, j)) e = e->next;
+        if (e == j) return j;
+    }
+    return NULL;
+}
+
+/* Waits for the commands running on the package to finish, and keeps new ones
+ * from starting until unlock_package. The commands queued meanwhile run after
+ * the batch is done with the package, whenever they were read. */
+void lock_package(const char *pkgname)
+{
+    pthread_mutex_lock(&jobs_lock);
+    while (is_package_locked(pkgname) || is_package_running(pkgname)) {
+        pthread_cond_wait(&jobs_cond, &jobs_lock);
+    }
+    locked_packages.push_back(pkgname);
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+void unlock_package(const char *pkgname)
+{
+    pthread_mutex_lock(&jobs_lock);
+    auto it = std::find(locked_packages.begin(), locked_packages.end(), pkgname);
+    if (it != locked_packages.end()) {
+        locked_packages.erase(it);
+    }
+    pthread_cond_broadcast(&jobs_cond);
+    pthread_mutex_unlock(&jobs_lock);
+}
+
+/* Write out the replies of the connection which are ready, in order.
+ * Called with jobs_lock held, which is dropped while writing. */
+static void flush_replies(struct connection *conn)
+{
+    if (conn->flushing) return;
+    conn->flushing = true;
+    struct job *j;
+    while ((j = conn->reply_head) != NULL && j->state == JOB_DONE) {
+        conn->reply_head = j->reply_next;
+        if (!conn->reply_head) conn->reply_tail = NULL;
+        if (!conn->error) {
+            pthread_mutex_unlock(&jobs_lock);
+            bool failed = writex(conn->s, &j->count, sizeof(j->count)) ||
+                    writex(conn->s, j->buf, j->count);
+            pthread_mutex_lock(&jobs_lock);
+            if (failed) conn->error = true;
+        }
+        free(j);
+        conn->pending--;
+    }
+    conn->flushing = false;
+    pthread_cond_signal(&conn->cond);
+}
+
+static void *worker_thread(void *)
+{
+    pthread_mutex_lock(&jobs_lock);
+    for (;;) {
+        struct job *j = next_runnable();
+        if (!j) {
+            pthread_cond_wait(&jobs_cond, &jobs_lock);
+            continue;
+        }
+        j->state = JOB_RUNNING;
+        pthread_mutex_unlock(&jobs_lock);
+
+        if (j->reload) {
+            selinux_android_seapp_context_reload();
+        }
+        execute(j);
+
+        pthread_mutex_lock(&jobs_lock);
+        j->state = JOB_DONE;
+        if (j->prev) j->prev->next = j->next; else jobs_head = j->next;
+        if (j->next) j->next->prev = j->prev; else jobs_tail = j->prev;
+        pthread_cond_broadcast(&jobs_cond);
+        flush_replies(j->conn);
+    }
+    return NULL;
+}
+
+/* Reads the commands of a connection and queues them, until the connection
+ * is closed and every command read has been replied to. */
+static void *connection_thread(void *arg)
+{
+    struct connection *conn = (struct connection *) arg;
+    int s = conn->s;
+
+    for (;;) {
+        pthread_mutex_lock(&jobs_lock);
+        while (conn->pending >= PENDING_MAX && !conn->error) {
+            pthread_cond_wait(&conn->cond, &jobs_lock);
+        }
+        bool error = conn->error;
+        pthread_mutex_unlock(&jobs_lock);
+        if (error) break;
+
+        unsigned short count;
+        if (readx(s, &count, sizeof(count))) {
+            ALOGE("failed to read size\n");
+            break;
+        }
+        if ((count < 1) || (count >= BUFFER_MAX)) {
+            ALOGE("invalid size %d\n", count);
+            break;
+        }
+        struct job *j = (struct job *) calloc(1, sizeof(*j));
+        if (!j) {
+            ALOGE("out of memory\n");
+            break;
+        }
+        if (readx(s, j->buf, count)) {
+            ALOGE("failed to read command\n");
+            free(j);
+            break;
+        }
+        j->buf[count] = 0;
+        j->conn = conn;
+        parse(j);
+
+        pthread_mutex_lock(&jobs_lock);
+        if (selinux_enabled && selinux_status_updated() > 0) {
+            j->reload = true;
+        }
+        j->state = JOB_QUEUED;
+        j->prev = jobs_tail;
+        if (jobs_tail) jobs_tail->next = j; else jobs_head = j;
+        jobs_tail = j;
+        if (conn->reply_tail) conn->reply_tail->reply_next = j;
+        else conn->reply_head = j;
+        conn->reply_tail = j;
+        conn->pending++;
+        pthread_cond_broadcast(&jobs_cond);
+        pthread_mutex_unlock(&jobs_lock);
+    }
+
+    pthread_mutex_lock(&jobs_lock);
+    while (conn->pending > 0 || conn->flushing) {
+        pthread_cond_wait(&conn->cond, &jobs_lock);
+    }
+    pthread_mutex_unlock(&jobs_lock);
+
+    ALOGI("closing connection\n");
+    close(s);
+    pthread_cond_destroy(&conn->cond);
+    free(conn);
+    return NULL;
 }
 
 /**
@@ -684,11 +981,13 @@ static int log_callback(int type, const char *fmt, ...) {
 }
 
 int main(const int argc __unused, char *argv[]) {
-    char buf[BUFFER_MAX];
     struct sockaddr addr;
     socklen_t alen;
     int lsocket, s;
-    int selinux_enabled = (is_selinux_enabled() > 0);
+    pthread_attr_t attr;
+    pthread_t thread;
+
+    selinux_enabled = (is_selinux_enabled() > 0);
 
     setenv("ANDROID_LOG_TAGS", "*:v", 1);
     android::base::InitLogging(argv);
@@ -709,6 +1008,8 @@ int main(const int argc __unused, char *argv[]) {
         exit(1);
     }
 
+    empty_trash();
+
     if (selinux_enabled && selinux_status_open(true) < 0) {
         ALOGE("Could not open selinux status; exiting.\n");
         exit(1);
@@ -725,6 +1026,15 @@ int main(const int argc __unused, char *argv[]) {
     }
     fcntl(lsocket, F_SETFD, FD_CLOEXEC);
 
+    pthread_attr_init(&attr);
+    pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+    for (int i = 0; i < WORKERS_MAX; i++) {
+        if (pthread_create(&thread, &attr, worker_thread, NULL)) {
+            ALOGE("Could not start worker thread; exiting.\n");
+            exit(1);
+        }
+    }
+
     for (;;) {
         alen = sizeof(addr);
         s = accept(lsocket, &addr, &alen);
@@ -735,28 +1045,20 @@ int main(const int argc __unused, char *argv[]) {
         fcntl(s, F_SETFD, FD_CLOEXEC);
 
         ALOGI("new connection\n");
-        for (;;) {
-            unsigned short count;
-            if (readx(s, &count, sizeof(count))) {
-                ALOGE("failed to read size\n");
-                break;
-            }
-            if ((count < 1) || (count >= BUFFER_MAX)) {
-                ALOGE("invalid size %d\n", count);
-                break;
-            }
-            if (readx(s, buf, count)) {
-                ALOGE("failed to read command\n");
-                break;
-            }
-            buf[count] = 0;
-            if (selinux_enabled && selinux_status_updated() > 0) {
-                selinux_android_seapp_context_reload();
-            }
-            if (execute(s, buf)) break;
+        struct connection *conn = (struct connection *) calloc(1, sizeof(*conn));
+        if (!conn) {
+            ALOGE("out of memory\n");
+            close(s);
+            continue;
+        }
+        conn->s = s;
+        pthread_cond_init(&conn->cond, NULL);
+        if (pthread_create(&thread, &attr, connection_thread, conn)) {
+            ALOGE("Could not start connection thread\n");
+            pthread_cond_destroy(&conn->cond);
+            free(conn);
+            close(s);
         }
-        ALOGI("closing connection\n");
-        close(s);
     }
 
     return 0;
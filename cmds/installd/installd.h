@@ -77,6 +77,8 @@
 #define DALVIK_CACHE_PREFIX    "/data/dalvik-cache/"
 #define DALVIK_CACHE_POSTFIX   "/classes.dex"
 
+#define OAT_CACHE_DIR          DALVIK_CACHE_PREFIX "oat-cache" // see dexopt()
+
 #define UPDATE_COMMANDS_DIR_PREFIX  "/system/etc/updatecmds/"
 
 #define IDMAP_PREFIX           "/data/resource-cache/"
@@ -136,6 +138,7 @@ typedef struct cache_dir_struct {
 typedef struct {
     cache_dir_t* dir;
     time_t modTime;
+    int64_t size;
     char name[];
 } cache_file_t;
 
@@ -192,6 +195,9 @@ int delete_dir_contents(const char *pathname,
 
 int delete_dir_contents_fd(int dfd, const char *name);
 
+int delete_dir_deferred(const char *pathname);
+void empty_trash();
+
 int copy_dir_files(const char *srcname, const char *dstname, uid_t owner, gid_t group);
 
 int lookup_media_dir(char basepath[PATH_MAX], const char *dir);
@@ -228,6 +234,13 @@ int ensure_config_user_dirs(userid_t userid);
 int create_profile_file(const char *pkgname, gid_t gid);
 void remove_profile_file(const char *pkgname);
 
+/* installd.cpp */
+
+/* The batch commands lock each package they touch for as long as they work on
+ * it, instead of running alone; see PKG_BATCH. */
+void lock_package(const char *pkgname);
+void unlock_package(const char *pkgname);
+
 /* commands.c */
 
 int install(const char *uuid, const char *pkgname, uid_t uid, gid_t gid, const char *seinfo);
@@ -252,15 +265,18 @@ int get_size(const char *uuid, const char *pkgname, int userid,
         const char *fwdlock_apkpath, const char *asecpath,
         const char *instruction_set, int64_t *codesize, int64_t *datasize,
         int64_t *cachesize, int64_t *asecsize);
+int get_sizes(const char *list_path, const char *out_path, int *count);
 int free_cache(const char *uuid, int64_t free_size);
 int dexopt(const char *apk_path, uid_t uid, bool is_public, const char *pkgName,
            const char *instruction_set, int dexopt_needed, bool vm_safe_mode,
            bool debuggable, const char* oat_dir);
+int dexopt_batch(const char *list_path, int *succeeded, int *failed, int64_t *elapsed_ms);
 int mark_boot_complete(const char *instruction_set);
 int movefiles();
 int linklib(const char* uuid, const char* pkgname, const char* asecLibDir, int userId);
 int idmap(const char *target_path, const char *overlay_path, uid_t uid);
 int restorecon_data(const char *uuid, const char* pkgName, const char* seinfo, uid_t uid);
+int restorecon_data_batch(const char *list_path, int *relabeled, int *skipped, int *failed);
 int create_oat_dir(const char* oat_dir, const char *instruction_set);
 int rm_package_dir(const char* apk_path);
 int calculate_oat_file_path(char path[PKG_PATH_MAX], const char *oat_dir, const char *apk_path,
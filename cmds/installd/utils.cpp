@@ -19,6 +19,11 @@
 #include <base/stringprintf.h>
 #include <base/logging.h>
 
+#include <cutils/atomic.h>
+
+#include <algorithm>
+#include <pthread.h>
+
 #define CACHE_NOISY(x) //x
 
 using android::base::StringPrintf;
@@ -288,6 +293,193 @@ static int _delete_dir_contents(DIR *d,
     return result;
 }
 
+/*
+ * Large trees are deleted by several threads taking directories off a shared
+ * stack; a directory is removed by the thread that finishes the last entry
+ * below it. Taking the most recently found directory first keeps the number
+ * of directories open at once close to the number of threads times the depth.
+ */
+#define DELETE_THREADS_MAX 4
+
+struct delete_dir {
+    struct delete_dir *parent;
+    DIR *d;
+    int32_t pending;    /* subdirectories left, plus one while being read */
+    bool failed;        /* couldn't be opened, don't try to remove it */
+    char name[];
+};
+
+struct delete_work {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    std::vector<delete_dir*> stack;
+    std::vector<pthread_t> threads;
+    int idle;
+    bool done;
+    int result;
+    int (*exclusion_predicate)(const char *name, const int is_dir);
+};
+
+static void delete_failed(delete_work *work)
+{
+    pthread_mutex_lock(&work->lock);
+    work->result = -1;
+    pthread_mutex_unlock(&work->lock);
+}
+
+/* Called once a directory has been read, and once per subdirectory removed. */
+static void delete_release(delete_work *work, delete_dir *dir)
+{
+    while (android_atomic_dec(&dir->pending) == 1) {
+        delete_dir *parent = dir->parent;
+        if (parent == NULL) {
+            pthread_mutex_lock(&work->lock);
+            work->done = true;
+            pthread_cond_broadcast(&work->cond);
+            pthread_mutex_unlock(&work->lock);
+            return;
+        }
+        if (dir->d != NULL) {
+            closedir(dir->d);
+        }
+        if (!dir->failed && unlinkat(dirfd(parent->d), dir->name, AT_REMOVEDIR) < 0) {
+            ALOGE("Couldn't unlinkat %s: %s\n", dir->name, strerror(errno));
+            delete_failed(work);
+        }
+        free(dir);
+        dir = parent;
+    }
+}
+
+static void *delete_thread(void *arg);
+
+static void delete_read_dir(delete_work *work, delete_dir *dir)
+{
+    struct dirent *de;
+    int dfd = dirfd(dir->d);
+
+    while ((de = readdir(dir->d))) {
+        const char *name = de->d_name;
+
+            /* check using the exclusion predicate, if provided */
+        if (work->exclusion_predicate
+                && work->exclusion_predicate(name, (de->d_type == DT_DIR))) {
+            continue;
+        }
+
+        if (de->d_type == DT_DIR) {
+                /* always skip "." and ".." */
+            if (name[0] == '.') {
+                if (name[1] == 0) continue;
+                if ((name[1] == '.') && (name[2] == 0)) continue;
+            }
+
+            delete_dir *subdir = (delete_dir *) malloc(sizeof(delete_dir) + strlen(name) + 1);
+            if (subdir == NULL) {
+                ALOGE("Couldn't allocate %s\n", name);
+                delete_failed(work);
+                continue;
+            }
+            subdir->parent = dir;
+            subdir->d = NULL;
+            subdir->pending = 1;
+            subdir->failed = false;
+            strcpy(subdir->name, name);
+            android_atomic_inc(&dir->pending);
+
+            pthread_mutex_lock(&work->lock);
+            work->stack.push_back(subdir);
+            if (work->idle > 0) {
+                pthread_cond_signal(&work->cond);
+            } else if (work->threads.size() + 1 < DELETE_THREADS_MAX) {
+                pthread_t thread;
+                if (pthread_create(&thread, NULL, delete_thread, work) == 0) {
+                    work->threads.push_back(thread);
+                }
+            }
+            pthread_mutex_unlock(&work->lock);
+        } else {
+            if (unlinkat(dfd, name, 0) < 0) {
+                ALOGE("Couldn't unlinkat %s: %s\n", name, strerror(errno));
+                delete_failed(work);
+            }
+        }
+    }
+    delete_release(work, dir);
+}
+
+static void *delete_thread(void *arg)
+{
+    delete_work *work = (delete_work *) arg;
+
+    pthread_mutex_lock(&work->lock);
+    while (!work->done) {
+        if (work->stack.empty()) {
+            work->idle++;
+            pthread_cond_wait(&work->cond, &work->lock);
+            work->idle--;
+            continue;
+        }
+        delete_dir *dir = work->stack.back();
+        work->stack.pop_back();
+        pthread_mutex_unlock(&work->lock);
+
+        int subfd = openat(dirfd(dir->parent->d), dir->name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+        if (subfd < 0) {
+            ALOGE("Couldn't openat %s: %s\n", dir->name, strerror(errno));
+        } else if ((dir->d = fdopendir(subfd)) == NULL) {
+            ALOGE("Couldn't fdopendir %s: %s\n", dir->name, strerror(errno));
+            close(subfd);
+        }
+        if (dir->d != NULL) {
+            delete_read_dir(work, dir);
+        } else {
+            dir->failed = true;
+            delete_failed(work);
+            delete_release(work, dir);
+        }
+
+        pthread_mutex_lock(&work->lock);
+    }
+    pthread_mutex_unlock(&work->lock);
+    return NULL;
+}
+
+static int _delete_dir_contents_parallel(DIR *d,
+        int (*exclusion_predicate)(const char *name, const int is_dir))
+{
+    if (dirfd(d) < 0) return -1;
+
+    delete_work work;
+    pthread_mutex_init(&work.lock, NULL);
+    pthread_cond_init(&work.cond, NULL);
+    work.idle = 0;
+    work.done = false;
+    work.result = 0;
+    work.exclusion_predicate = exclusion_predicate;
+
+    delete_dir *root = (delete_dir *) malloc(sizeof(delete_dir) + 1);
+    if (root == NULL) {
+        return _delete_dir_contents(d, exclusion_predicate);
+    }
+    root->parent = NULL;
+    root->d = d;
+    root->pending = 1;
+    root->failed = false;
+    root->name[0] = 0;
+
+    delete_read_dir(&work, root);
+    delete_thread(&work);
+    for (pthread_t thread : work.threads) {
+        pthread_join(thread, NULL);
+    }
+
+    free(root);
+    pthread_cond_destroy(&work.cond);
+    pthread_mutex_destroy(&work.lock);
+    return work.result;
+}
+
 int delete_dir_contents(const char *pathname,
                         int also_delete_dir,
                         int (*exclusion_predicate)(const char*, const int))
@@ -300,7 +492,7 @@ int delete_dir_contents(const char *pathname,
         ALOGE("Couldn't opendir %s: %s\n", pathname, strerror(errno));
         return -errno;
     }
-    res = _delete_dir_contents(d, exclusion_predicate);
+    res = _delete_dir_contents_parallel(d, exclusion_predicate);
     closedir(d);
     if (also_delete_dir) {
         if (rmdir(pathname)) {
@@ -327,11 +519,113 @@ int delete_dir_contents_fd(int dfd, const char *name)
         close(fd);
         return -1;
     }
-    res = _delete_dir_contents(d, 0);
+    res = _delete_dir_contents_parallel(d, 0);
     closedir(d);
     return res;
 }
 
+/*
+ * Deferred deletion, enabled by "installd.deferred_delete": the tree is
+ * renamed into a trash directory on /data and deleted by a background
+ * thread, so that uninstalling returns right away. Trees that can't be
+ * renamed there (e.g. on adopted storage) are deleted in place. Whatever
+ * is left in the trash when installd starts is deleted then.
+ */
+static pthread_mutex_t trash_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t trash_cond = PTHREAD_COND_INITIALIZER;
+static std::vector<std::string> trash_queue;
+static bool trash_thread_started;
+static unsigned trash_count;
+
+static std::string trash_path()
+{
+    return StringPrintf("%s.installd_trash", android_data_dir.path);
+}
+
+static void *trash_thread(void *)
+{
+    pthread_mutex_lock(&trash_lock);
+    for (;;) {
+        while (trash_queue.empty()) {
+            pthread_cond_wait(&trash_cond, &trash_lock);
+        }
+        std::string path(trash_queue.back());
+        trash_queue.pop_back();
+        pthread_mutex_unlock(&trash_lock);
+
+        delete_dir_contents(path.c_str(), 1, NULL);
+
+        pthread_mutex_lock(&trash_lock);
+    }
+    return NULL;
+}
+
+/* Called with trash_lock held. */
+static bool queue_trash(const std::string& path)
+{
+    if (!trash_thread_started) {
+        pthread_attr_t attr;
+        pthread_t thread;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        trash_thread_started = pthread_create(&thread, &attr, trash_thread, NULL) == 0;
+        pthread_attr_destroy(&attr);
+        if (!trash_thread_started) {
+            return false;
+        }
+    }
+    trash_queue.push_back(path);
+    pthread_cond_signal(&trash_cond);
+    return true;
+}
+
+int delete_dir_deferred(const char *pathname)
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("installd.deferred_delete", value, "false");
+    if (strcmp(value, "true") != 0) {
+        return delete_dir_contents(pathname, 1, NULL);
+    }
+
+    std::string trash(trash_path());
+    if (mkdir(trash.c_str(), 0700) < 0 && errno != EEXIST) {
+        PLOG(WARNING) << "Couldn't create " << trash;
+        return delete_dir_contents(pathname, 1, NULL);
+    }
+
+    pthread_mutex_lock(&trash_lock);
+    std::string path(StringPrintf("%s/%d.%u", trash.c_str(), getpid(), trash_count++));
+    bool queued = rename(pathname, path.c_str()) == 0;
+    if (queued && !queue_trash(path)) {
+        // Put it back, so that the caller can retry.
+        rename(path.c_str(), pathname);
+        queued = false;
+    }
+    pthread_mutex_unlock(&trash_lock);
+    if (!queued) {
+        return delete_dir_contents(pathname, 1, NULL);
+    }
+    return 0;
+}
+
+void empty_trash()
+{
+    std::string trash(trash_path());
+    DIR *d = opendir(trash.c_str());
+    if (d == NULL) {
+        return;
+    }
+    struct dirent *de;
+    pthread_mutex_lock(&trash_lock);
+    while ((de = readdir(d))) {
+        if (de->d_type == DT_DIR && strcmp(de->d_name, ".") && strcmp(de->d_name, "..")) {
+            queue_trash(trash + "/" + de->d_name);
+        }
+    }
+    pthread_mutex_unlock(&trash_lock);
+    closedir(d);
+}
+
 static int _copy_owner_permissions(int srcfd, int dstfd)
 {
     struct stat st;
@@ -594,13 +888,14 @@ static cache_dir_t* _add_cache_dir_t(cache_t* cache, cache_dir_t* parent, const
 }
 
 static cache_file_t* _add_cache_file_t(cache_t* cache, cache_dir_t* dir, time_t modTime,
-        const char *name)
+        int64_t size, const char *name)
 {
     size_t nameLen = strlen(name);
     cache_file_t* file = (cache_file_t*)_cache_malloc(cache, sizeof(cache_file_t)+nameLen+1);
     if (file != NULL) {
         file->dir = dir;
         file->modTime = modTime;
+        file->size = size;
         strcpy(file->name, name);
         if (cache->numFiles >= cache->availFiles) {
             size_t newAvail = cache->availFiles < 1000 ? 1000 : cache->availFiles*2;
@@ -711,8 +1006,9 @@ static int _add_cache_files(cache_t *cache, cache_dir_t *parentDir, const char *
                 CACHE_NOISY(ALOGI("Collecting file %s\n", pathBase));
                 if (finallen < pathAvailLen) {
                     struct stat s;
-                    if (stat(pathBase, &s) >= 0) {
-                        _add_cache_file_t(cache, cacheDir, s.st_mtime, name);
+                    if (fstatat(dfd, name, &s, 0) >= 0) {
+                        _add_cache_file_t(cache, cacheDir, s.st_mtime,
+                                (int64_t) s.st_blocks * 512, name);
                     } else {
                         ALOGW("Unable to stat cache file %s; deleting\n", pathBase);
                         if (unlink(pathBase) < 0) {
@@ -837,25 +1133,28 @@ static void delete_cache_dir(char path[PATH_MAX], cache_dir_t* dir)
     }
 }
 
-static int cache_modtime_sort(const void *lhsP, const void *rhsP)
+static bool cache_modtime_newer(const cache_file_t *lhs, const cache_file_t *rhs)
 {
-    const cache_file_t *lhs = *(const cache_file_t**)lhsP;
-    const cache_file_t *rhs = *(const cache_file_t**)rhsP;
-    return lhs->modTime < rhs->modTime ? -1 : (lhs->modTime > rhs->modTime ? 1 : 0);
+    return lhs->modTime > rhs->modTime;
 }
 
 void clear_cache_files(const std::string& data_path, cache_t* cache, int64_t free_size)
 {
     size_t i;
-    int skip = 0;
+    int skip = 10;
     char path[PATH_MAX];
 
     ALOGI("Collected cache files: %zd directories, %zd files",
         cache->numDirs, cache->numFiles);
 
-    CACHE_NOISY(ALOGI("Sorting files..."));
-    qsort(cache->files, cache->numFiles, sizeof(cache_file_t*),
-            cache_modtime_sort);
+    // Only the oldest files are deleted, usually few of them: rather than
+    // sorting them all, they are taken oldest first off a heap. The disk
+    // isn't checked until the files deleted add up to what was missing.
+    CACHE_NOISY(ALOGI("Building heap..."));
+    std::make_heap(cache->files, cache->files + cache->numFiles, cache_modtime_newer);
+    int64_t avail = data_disk_free(data_path);
+    int64_t needed = avail >= 0 ? free_size - avail : 0;
+    int64_t freed = 0;
 
     CACHE_NOISY(ALOGI("Cleaning empty directories..."));
     for (i=cache->numDirs; i>0; i--) {
@@ -866,19 +1165,24 @@ void clear_cache_files(const std::string& data_path, cache_t* cache, int64_t fre
     }
 
     CACHE_NOISY(ALOGI("Trimming files..."));
-    for (i=0; i<cache->numFiles; i++) {
-        skip++;
-        if (skip > 10) {
-            if (data_disk_free(data_path) > free_size) {
-                return;
+    for (i=cache->numFiles; i>0; i--) {
+        if (freed >= needed) {
+            skip++;
+            if (skip > 10) {
+                if (data_disk_free(data_path) > free_size) {
+                    return;
+                }
+                skip = 0;
             }
-            skip = 0;
         }
-        cache_file_t* file = cache->files[i];
+        std::pop_heap(cache->files, cache->files + i, cache_modtime_newer);
+        cache_file_t* file = cache->files[i-1];
         strcpy(create_dir_path(path, file->dir), file->name);
         ALOGI("DEL (mod %d) %s\n", (int)file->modTime, path);
         if (unlink(path) < 0) {
             ALOGE("Couldn't unlink %s: %s\n", path, strerror(errno));
+        } else {
+            freed += file->size;
         }
         file->dir->childCount--;
         if (file->dir->childCount <= 0) {
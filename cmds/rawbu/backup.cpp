@@ -12,9 +12,11 @@
 #include <assert.h>
 #include <ctype.h>
 #include <utime.h>
+#include <pthread.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <stdint.h>
+#include <zlib.h>
 
 #include <cutils/properties.h>
 
@@ -37,12 +39,28 @@ namespace android {
 static char nameBuffer[PATH_MAX];
 static struct stat statBuffer;
 
-static char copyBuffer[8192];
+// Large files are copied through this in big blocks, and the backup file
+// itself is read and written with a buffer of STREAM_BUFFER_SIZE.
+#define COPY_BUFFER_SIZE (256*1024)
+#define STREAM_BUFFER_SIZE (1024*1024)
+
+static char copyBuffer[COPY_BUFFER_SIZE];
 static char *backupFilePath = NULL;
 
 static uint32_t inputFileVersion;
 
 static int opt_backupAll;
+static int opt_compress;
+
+// Files up to this size are read ahead of the backup file being written by
+// IO_THREADS threads, at most PREFETCH_WINDOW files ahead, and are written
+// back by the same number of threads on restore.  /data is mostly small
+// files, and reading or writing them one at a time leaves the storage idle
+// waiting on each open and close.
+#define SMALL_FILE_SIZE (64*1024)
+#define IO_THREADS 4
+#define PREFETCH_WINDOW 256
+#define RESTORE_QUEUE_SIZE 64
 
 #define SPECIAL_NO_TOUCH 0
 #define SPECIAL_NO_BACKUP 1
@@ -171,6 +189,55 @@ static int wipe (const char *path)
     return 1;
 }
 
+static int gz_stream_read(void* cookie, char* buf, int len)
+{
+    return gzread((gzFile)cookie, buf, len);
+}
+
+static int gz_stream_write(void* cookie, const char* buf, int len)
+{
+    return gzwrite((gzFile)cookie, buf, len);
+}
+
+static int gz_stream_close(void* cookie)
+{
+    return gzclose((gzFile)cookie) == Z_OK ? 0 : -1;
+}
+
+// Wrap a dup of fd in a stream, compressed or not.  Closing the stream
+// leaves fd open, so it can still be synced once everything is flushed.
+static FILE* open_stream(int fd, bool write, bool compress)
+{
+    int streamFd = dup(fd);
+    if (streamFd < 0) {
+        return NULL;
+    }
+    FILE* fh;
+    if (compress) {
+        // Fast compression, so the backup is still bound by the storage.
+        gzFile gz = gzdopen(streamFd, write ? "wb1" : "rb");
+        if (gz == NULL) {
+            close(streamFd);
+            return NULL;
+        }
+        gzbuffer(gz, STREAM_BUFFER_SIZE);
+        fh = funopen(gz, write ? NULL : gz_stream_read,
+                write ? gz_stream_write : NULL, NULL, gz_stream_close);
+        if (fh == NULL) {
+            gzclose(gz);
+            return NULL;
+        }
+    } else {
+        fh = fdopen(streamFd, write ? "w" : "r");
+        if (fh == NULL) {
+            close(streamFd);
+            return NULL;
+        }
+    }
+    setvbuf(fh, NULL, _IOFBF, STREAM_BUFFER_SIZE);
+    return fh;
+}
+
 static int write_int32(FILE* fh, int32_t val)
 {
     int res = fwrite(&val, 1, sizeof(val), fh);
@@ -253,11 +320,70 @@ static int write_header(FILE* fh, int type, const char* path, const struct stat*
     return 1;
 }
 
-static int backup_dir(FILE* fh, const char* srcPath)
+enum {
+    ENTRY_PENDING,
+    ENTRY_READY,
+    ENTRY_FAILED,
+};
+
+struct backup_entry {
+    char* path;
+    struct stat st;
+    // The contents of a small file, once it has been read ahead.
+    char* data;
+    int state;
+};
+
+struct backup_list {
+    backup_entry* entries;
+    size_t count;
+    size_t capacity;
+};
+
+struct prefetch_state {
+    backup_list* list;
+    size_t next;
+    size_t written;
+    bool stop;
+    // Without any threads, small files are copied like the others.
+    int threads;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static bool is_prefetched(const backup_entry* entry)
+{
+    return S_ISREG(entry->st.st_mode) && entry->st.st_size <= SMALL_FILE_SIZE;
+}
+
+static int add_entry(backup_list* list, char* path, const struct stat* st)
+{
+    if (list->count == list->capacity) {
+        size_t capacity = list->capacity ? list->capacity * 2 : 1024;
+        backup_entry* entries = (backup_entry*)realloc(list->entries,
+                capacity * sizeof(backup_entry));
+        if (entries == NULL) {
+            fprintf(stderr, "out of memory listing '%s'\n", path);
+            free(path);
+            return 0;
+        }
+        list->entries = entries;
+        list->capacity = capacity;
+    }
+    backup_entry* entry = &list->entries[list->count++];
+    entry->path = path;
+    entry->st = *st;
+    entry->data = NULL;
+    entry->state = ENTRY_PENDING;
+    return 1;
+}
+
+// List the directories and regular files under srcPath, in the order they
+// are written to the backup.
+static int scan_dir(backup_list* list, const char* srcPath)
 {
     DIR *dir;
     struct dirent *de;
-    char* fullPath = NULL;
     int srcLen = strlen(srcPath);
     int result = 1;
     int i;
@@ -284,10 +410,7 @@ static int backup_dir(FILE* fh, const char* srcPath)
             continue;
         }
 
-        if (fullPath != NULL) {
-            free(fullPath);
-        }
-        fullPath = (char*)malloc(srcLen + strlen(de->d_name) + 2);
+        char* fullPath = (char*)malloc(srcLen + strlen(de->d_name) + 2);
         strcpy(fullPath, srcPath);
         fullPath[srcLen] = '/';
         strcpy(fullPath+srcLen+1, de->d_name);
@@ -300,6 +423,7 @@ static int backup_dir(FILE* fh, const char* srcPath)
                 }
             }
             if (SKIP_PATHS[i].path != NULL) {
+                free(fullPath);
                 continue;
             }
         }
@@ -309,63 +433,203 @@ static int backup_dir(FILE* fh, const char* srcPath)
         if (ret != 0) {
             fprintf(stderr, "stat() error on '%s': %s\n", 
                     fullPath, strerror(errno));
+            free(fullPath);
             result = 0;
-            goto done;
+            break;
         }
 
         if(S_ISDIR(statBuffer.st_mode)) {
-            printf("Saving dir %s...\n", fullPath);
-            
-            if (write_header(fh, TYPE_DIR, fullPath, &statBuffer) == 0) {
-                result = 0;
-                goto done;
-            }
-            if (backup_dir(fh, fullPath) == 0) {
+            if (!add_entry(list, fullPath, &statBuffer) ||
+                    !scan_dir(list, fullPath)) {
                 result = 0;
-                goto done;
+                break;
             }
         } else if (S_ISREG(statBuffer.st_mode)) {
             // Skip the backup file
             if (backupFilePath && strcmp(fullPath, backupFilePath) == 0) {
                 printf("Skipping backup file %s...\n", backupFilePath);
+                free(fullPath);
                 continue;
-            } else {
-                printf("Saving file %s...\n", fullPath);
             }
-            if (write_header(fh, TYPE_FILE, fullPath, &statBuffer) == 0) {
+            if (!add_entry(list, fullPath, &statBuffer)) {
                 result = 0;
-                goto done;
+                break;
             }
-            
-            off_t size = statBuffer.st_size;
-            if (!write_int64(fh, size)) {
-                result = 0;
-                goto done;
+        } else {
+            free(fullPath);
+        }
+    }
+
+    closedir(dir);
+    
+    return result;
+}
+
+static int read_fully(int fd, char* buf, off_t size, const char* srcName)
+{
+    off_t done = 0;
+    while (done < size) {
+        ssize_t readLen = TEMP_FAILURE_RETRY(read(fd, buf + done, size - done));
+        if (readLen <= 0) {
+            fprintf(stderr, "unable to read source (%ld of %ld bytes) file '%s': %s\n",
+                (long)(size - done), (long)size, srcName,
+                readLen < 0 ? strerror(errno) : "unexpected EOF");
+            return 0;
+        }
+        done += readLen;
+    }
+    return 1;
+}
+
+// Read the small files of the list, in order, up to PREFETCH_WINDOW entries
+// ahead of the one being written.
+static void* prefetch_thread(void* arg)
+{
+    prefetch_state* ps = (prefetch_state*)arg;
+    backup_list* list = ps->list;
+
+    pthread_mutex_lock(&ps->lock);
+    for (;;) {
+        while (ps->next < list->count && !is_prefetched(&list->entries[ps->next])) {
+            ps->next++;
+        }
+        if (ps->stop || ps->next >= list->count) {
+            break;
+        }
+        if (ps->next >= ps->written + PREFETCH_WINDOW) {
+            pthread_cond_wait(&ps->cond, &ps->lock);
+            continue;
+        }
+        backup_entry* entry = &list->entries[ps->next++];
+        pthread_mutex_unlock(&ps->lock);
+
+        off_t size = entry->st.st_size;
+        char* data = (char*)malloc(size > 0 ? size : 1);
+        int ok = 0;
+        if (data == NULL) {
+            fprintf(stderr, "out of memory reading '%s'\n", entry->path);
+        } else {
+            int fd = open(entry->path, O_RDONLY | O_CLOEXEC);
+            if (fd < 0) {
+                fprintf(stderr, "unable to open source file '%s': %s\n",
+                    entry->path, strerror(errno));
+            } else {
+                ok = read_fully(fd, data, size, entry->path);
+                close(fd);
             }
+        }
+        if (!ok) {
+            free(data);
+            data = NULL;
+        }
+
+        pthread_mutex_lock(&ps->lock);
+        entry->data = data;
+        entry->state = ok ? ENTRY_READY : ENTRY_FAILED;
+        pthread_cond_broadcast(&ps->cond);
+    }
+    pthread_mutex_unlock(&ps->lock);
+    return NULL;
+}
+
+static int backup_entry_data(FILE* fh, prefetch_state* ps, backup_entry* entry)
+{
+    off_t size = entry->st.st_size;
+
+    if (!is_prefetched(entry) || ps->threads == 0) {
+        FILE* src = fopen(entry->path, "r");
+        if (src == NULL) {
+            fprintf(stderr, "unable to open source file '%s': %s\n",
+                entry->path, strerror(errno));
+            return 0;
+        }
+        
+        int copyres = copy_file(fh, src, size, NULL, entry->path);
+        fclose(src);
+        return copyres;
+    }
+
+    pthread_mutex_lock(&ps->lock);
+    while (entry->state == ENTRY_PENDING) {
+        pthread_cond_wait(&ps->cond, &ps->lock);
+    }
+    pthread_mutex_unlock(&ps->lock);
+    if (entry->state == ENTRY_FAILED) {
+        return 0;
+    }
+
+    int res = 1;
+    size_t writeLen = fwrite(entry->data, 1, size, fh);
+    if (writeLen != (size_t)size) {
+        fprintf(stderr, "unable to write buffer (%d of %d bytes): '%s'\n",
+            (int)writeLen, (int)size, strerror(errno));
+        res = 0;
+    }
+    free(entry->data);
+    entry->data = NULL;
+    return res;
+}
+
+static int backup_dir(FILE* fh, const char* srcPath)
+{
+    backup_list list;
+    memset(&list, 0, sizeof(list));
+    int result = scan_dir(&list, srcPath);
+
+    prefetch_state ps;
+    ps.list = &list;
+    ps.next = 0;
+    ps.written = 0;
+    ps.stop = false;
+    ps.threads = 0;
+    pthread_mutex_init(&ps.lock, NULL);
+    pthread_cond_init(&ps.cond, NULL);
+
+    pthread_t threads[IO_THREADS];
+    while (result && ps.threads < IO_THREADS &&
+            pthread_create(&threads[ps.threads], NULL, prefetch_thread, &ps) == 0) {
+        ps.threads++;
+    }
+
+    for (size_t i = 0; result && i < list.count; i++) {
+        backup_entry* entry = &list.entries[i];
+
+        if (S_ISDIR(entry->st.st_mode)) {
+            printf("Saving dir %s...\n", entry->path);
             
-            FILE* src = fopen(fullPath, "r");
-            if (src == NULL) {
-                fprintf(stderr, "unable to open source file '%s': %s\n",
-                    fullPath, strerror(errno));
+            if (write_header(fh, TYPE_DIR, entry->path, &entry->st) == 0) {
                 result = 0;
-                goto done;
             }
-            
-            int copyres = copy_file(fh, src, size, NULL, fullPath);
-            fclose(src);
-            if (!copyres) {
+        } else {
+            printf("Saving file %s...\n", entry->path);
+            if (write_header(fh, TYPE_FILE, entry->path, &entry->st) == 0 ||
+                    !write_int64(fh, entry->st.st_size) ||
+                    !backup_entry_data(fh, &ps, entry)) {
                 result = 0;
-                goto done;
             }
         }
+
+        pthread_mutex_lock(&ps.lock);
+        ps.written = i + 1;
+        pthread_cond_broadcast(&ps.cond);
+        pthread_mutex_unlock(&ps.lock);
     }
 
-done:
-    if (fullPath != NULL) {
-        free(fullPath);
+    pthread_mutex_lock(&ps.lock);
+    ps.stop = true;
+    pthread_cond_broadcast(&ps.cond);
+    pthread_mutex_unlock(&ps.lock);
+    for (int i = 0; i < ps.threads; i++) {
+        pthread_join(threads[i], NULL);
     }
-    
-    closedir(dir);
+    pthread_mutex_destroy(&ps.lock);
+    pthread_cond_destroy(&ps.cond);
+
+    for (size_t i = 0; i < list.count; i++) {
+        free(list.entries[i].path);
+        free(list.entries[i].data);
+    }
+    free(list.entries);
     
     return result;
 }
@@ -374,14 +638,19 @@ static int backup_data(const char* destPath)
 {
     int res = -1;
     
-    FILE* fh = fopen(destPath, "w");
+    int fd = open(destPath, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    FILE* fh = fd < 0 ? NULL : open_stream(fd, true, opt_compress);
     if (fh == NULL) {
         fprintf(stderr, "unable to open destination '%s': %s\n",
                 destPath, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
         return -1;
     }
     
-    printf("Backing up /data to %s...\n", destPath);
+    printf("Backing up /data to %s%s...\n", destPath,
+            opt_compress ? " (compressed)" : "");
 
     // The path that shouldn't be backed up
     backupFilePath = strdup(destPath);
@@ -394,22 +663,23 @@ static int backup_data(const char* destPath)
     res = 0;
     
 done:
-    if (fflush(fh) != 0) {
+    // Closing the stream flushes it, and finishes the compressed stream.
+    if (fclose(fh) != 0) {
         fprintf(stderr, "error flushing destination '%s': %s\n",
             destPath, strerror(errno));
         res = -1;
         goto donedone;
     }
-    if (fsync(fileno(fh)) != 0) {
+    if (fsync(fd) != 0) {
         fprintf(stderr, "error syncing destination '%s': %s\n",
             destPath, strerror(errno));
         res = -1;
         goto donedone;
     }
-    fclose(fh);
     sync();
 
 donedone:    
+    close(fd);
     return res;
 }
 
@@ -500,16 +770,159 @@ static int read_header(FILE* fh, int* type, char** path, struct stat* st)
     return 1;
 }
 
+static int restore_attrs(const char* path, const char* typeName,
+        const struct stat* st)
+{
+    if (chmod(path, st->st_mode&(S_IRWXU|S_IRWXG|S_IRWXO)) != 0) {
+        fprintf(stderr, "unable to chmod destination %s '%s' to 0x%x: %s\n",
+            typeName, path, st->st_mode, strerror(errno));
+        return 0;
+    }
+    
+    if (chown(path, st->st_uid, st->st_gid) != 0) {
+        fprintf(stderr, "unable to chown destination %s '%s' to uid %d / gid %d: %s\n",
+            typeName, path, (int)st->st_uid, (int)st->st_gid, strerror(errno));
+        return 0;
+    }
+    
+    struct utimbuf timbuf;
+    timbuf.actime = st->st_atime;
+    timbuf.modtime = st->st_mtime;
+    if (utime(path, &timbuf) != 0) {
+        fprintf(stderr, "unable to utime destination %s '%s': %s\n",
+            typeName, path, strerror(errno));
+        return 0;
+    }
+
+    return 1;
+}
+
+// A small file read from the restore file, waiting to be written out by one
+// of the restore threads.
+struct restore_job {
+    char* path;
+    struct stat st;
+    char* data;
+    off_t size;
+};
+
+struct restore_queue {
+    restore_job jobs[RESTORE_QUEUE_SIZE];
+    size_t head;
+    size_t count;
+    bool done;
+    bool failed;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
+static int restore_small_file(const restore_job* job)
+{
+    int fd = open(job->path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) {
+        fprintf(stderr, "unable to open destination file '%s': %s\n",
+            job->path, strerror(errno));
+        return 0;
+    }
+    off_t done = 0;
+    while (done < job->size) {
+        ssize_t writeLen = TEMP_FAILURE_RETRY(write(fd, job->data + done,
+                job->size - done));
+        if (writeLen <= 0) {
+            fprintf(stderr, "unable to write file (%d of %d bytes) '%s': '%s'\n",
+                (int)done, (int)job->size, job->path, strerror(errno));
+            close(fd);
+            return 0;
+        }
+        done += writeLen;
+    }
+    close(fd);
+    return restore_attrs(job->path, "file", &job->st);
+}
+
+static void* restore_thread(void* arg)
+{
+    restore_queue* q = (restore_queue*)arg;
+
+    pthread_mutex_lock(&q->lock);
+    for (;;) {
+        while (q->count == 0 && !q->done) {
+            pthread_cond_wait(&q->cond, &q->lock);
+        }
+        if (q->count == 0) {
+            break;
+        }
+        restore_job job = q->jobs[q->head];
+        q->head = (q->head + 1) % RESTORE_QUEUE_SIZE;
+        q->count--;
+        pthread_cond_broadcast(&q->cond);
+        pthread_mutex_unlock(&q->lock);
+
+        int ok = restore_small_file(&job);
+        free(job.path);
+        free(job.data);
+
+        pthread_mutex_lock(&q->lock);
+        if (!ok) {
+            q->failed = true;
+        }
+    }
+    pthread_mutex_unlock(&q->lock);
+    return NULL;
+}
+
+// Hand a small file to the restore threads, which take ownership of its
+// path and data.  Returns 0 if one of them has failed.
+static int queue_small_file(restore_queue* q, char* path, const struct stat* st,
+        char* data, off_t size)
+{
+    pthread_mutex_lock(&q->lock);
+    while (q->count == RESTORE_QUEUE_SIZE && !q->failed) {
+        pthread_cond_wait(&q->cond, &q->lock);
+    }
+    if (q->failed) {
+        pthread_mutex_unlock(&q->lock);
+        free(path);
+        free(data);
+        return 0;
+    }
+    restore_job* job = &q->jobs[(q->head + q->count) % RESTORE_QUEUE_SIZE];
+    job->path = path;
+    job->st = *st;
+    job->data = data;
+    job->size = size;
+    q->count++;
+    pthread_cond_broadcast(&q->cond);
+    pthread_mutex_unlock(&q->lock);
+    return 1;
+}
+
 static int restore_data(const char* srcPath)
 {
     int res = -1;
+    unsigned char magic[2];
+    restore_queue queue;
+    pthread_t threads[IO_THREADS];
+    int numThreads = 0;
     
-    FILE* fh = fopen(srcPath, "r");
+    int fd = open(srcPath, O_RDONLY | O_CLOEXEC);
+    // Compressed backups are recognized by the gzip magic.
+    bool compressed = fd >= 0 && pread(fd, magic, sizeof(magic), 0) == sizeof(magic) &&
+            magic[0] == 0x1f && magic[1] == 0x8b;
+    FILE* fh = fd < 0 ? NULL : open_stream(fd, false, compressed);
     if (fh == NULL) {
         fprintf(stderr, "Unable to open source '%s': %s\n",
                 srcPath, strerror(errno));
+        if (fd >= 0) {
+            close(fd);
+        }
         return -1;
     }
+    close(fd);
+
+    memset(&queue, 0, sizeof(queue));
+    pthread_mutex_init(&queue.lock, NULL);
+    pthread_cond_init(&queue.cond, NULL);
     
     inputFileVersion = read_int32(fh, 0);
     if (inputFileVersion < FILE_VERSION_1 || inputFileVersion > FILE_VERSION) {
@@ -533,6 +946,11 @@ static int restore_data(const char* srcPath)
 
     printf("Restoring from %s to /data...\n", srcPath);
 
+    while (numThreads < IO_THREADS &&
+            pthread_create(&threads[numThreads], NULL, restore_thread, &queue) == 0) {
+        numThreads++;
+    }
+
     while (1) {
         int type;
         char* path = NULL;
@@ -569,6 +987,24 @@ static int restore_data(const char* srcPath)
             }
             
             printf("Restoring file %s...\n", path);
+
+            if (size <= SMALL_FILE_SIZE && numThreads > 0) {
+                // The directories a file is in always come before it, so
+                // it can be written out by another thread.
+                char* data = (char*)malloc(size > 0 ? size : 1);
+                if (data == NULL || fread(data, 1, size, fh) != (size_t)size) {
+                    fprintf(stderr, "unable to read buffer (%ld bytes) for '%s': %s\n",
+                        (long)size, path, data == NULL ? "out of memory" :
+                        errno != 0 ? strerror(errno) : "unexpected EOF");
+                    free(data);
+                    free(path);
+                    goto done;
+                }
+                if (!queue_small_file(&queue, path, &statBuffer, data, size)) {
+                    goto done;
+                }
+                continue;
+            }
             
             FILE* dest = fopen(path, "w");
             if (dest == NULL) {
@@ -592,37 +1028,30 @@ static int restore_data(const char* srcPath)
         
         // Do this even for directories, since the dir may have already existed
         // so we need to make sure it gets the correct mode.    
-        if (chmod(path, statBuffer.st_mode&(S_IRWXU|S_IRWXG|S_IRWXO)) != 0) {
-            fprintf(stderr, "unable to chmod destination %s '%s' to 0x%x: %s\n",
-                typeName, path, statBuffer.st_mode, strerror(errno));
-            free(path);
-            goto done;
-        }
-        
-        if (chown(path, statBuffer.st_uid, statBuffer.st_gid) != 0) {
-            fprintf(stderr, "unable to chown destination %s '%s' to uid %d / gid %d: %s\n",
-                typeName, path, (int)statBuffer.st_uid, (int)statBuffer.st_gid, strerror(errno));
-            free(path);
-            goto done;
-        }
-        
-        struct utimbuf timbuf;
-        timbuf.actime = statBuffer.st_atime;
-        timbuf.modtime = statBuffer.st_mtime;
-        if (utime(path, &timbuf) != 0) {
-            fprintf(stderr, "unable to utime destination %s '%s': %s\n",
-                typeName, path, strerror(errno));
+        if (!restore_attrs(path, typeName, &statBuffer)) {
             free(path);
             goto done;
         }
         
-        
         free(path);
     }
     
     res = 0;
         
 done:    
+    pthread_mutex_lock(&queue.lock);
+    queue.done = true;
+    pthread_cond_broadcast(&queue.cond);
+    pthread_mutex_unlock(&queue.lock);
+    for (int i = 0; i < numThreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+    if (queue.failed) {
+        res = -1;
+    }
+    pthread_mutex_destroy(&queue.lock);
+    pthread_cond_destroy(&queue.cond);
+
     fclose(fh);
     
     return res;
@@ -638,7 +1067,8 @@ static void show_help(const char *cmd)
                     "  restore         Perform a restore of /data.\n");
     fprintf(stderr, "options include:\n"
                     "  -h              Show this help text.\n"
-                    "  -a              Backup all files.\n");
+                    "  -a              Backup all files.\n"
+                    "  -z              Compress the backup (detected on restore).\n");
     fprintf(stderr, "\n backup-file-path Defaults to /sdcard/backup.dat .\n"
                     "                  On devices that emulate the sdcard, you will need to\n"
                     "                  explicitly specify the directory it is mapped to,\n"
@@ -689,7 +1119,7 @@ int main (int argc, char **argv)
     for (;;) {
         int ret;
 
-        ret = getopt(argc, argv, "ah");
+        ret = getopt(argc, argv, "ahz");
 
         if (ret < 0) {
             break;
@@ -700,6 +1130,10 @@ int main (int argc, char **argv)
                 android::opt_backupAll = 1;
                 if (restore) fprintf(stderr, "Warning: -a option ignored on restore\n");
                 break;
+            case 'z':
+                android::opt_compress = 1;
+                if (restore) fprintf(stderr, "Warning: -z option ignored on restore\n");
+                break;
             case 'h':
                 android::show_help(argv[0]);
                 exit(0);
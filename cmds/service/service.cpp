@@ -18,8 +18,10 @@
 #include <binder/ProcessState.h>
 #include <binder/IServiceManager.h>
 #include <binder/TextOutput.h>
+#include <utils/Mutex.h>
 
 #include <getopt.h>
+#include <pthread.h>
 #include <stdlib.h>
 #include <stdio.h>
 #include <string.h>
@@ -53,6 +55,56 @@ static String16 get_interface_name(sp<IBinder> service)
     return String16();
 }
 
+// The number of threads asking the listed services for their interfaces,
+// so one slow service doesn't hold up the rest.
+#define LIST_THREADS 8
+
+struct InterfaceQueries {
+    const Vector<sp<IBinder> >* services;
+    String16* interfaces;
+    Mutex lock;
+    size_t next;
+};
+
+static void* query_interfaces(void* arg)
+{
+    InterfaceQueries* q = (InterfaceQueries*) arg;
+    for (;;) {
+        size_t i;
+        {
+            AutoMutex _l(q->lock);
+            i = q->next++;
+        }
+        if (i >= q->services->size()) {
+            return NULL;
+        }
+        q->interfaces[i] = get_interface_name(q->services->itemAt(i));
+    }
+}
+
+// get the interface names of all the services, a few at a time
+static void get_interface_names(const Vector<sp<IBinder> >& services,
+        String16* interfaces)
+{
+    InterfaceQueries q;
+    q.services = &services;
+    q.interfaces = interfaces;
+    q.next = 0;
+
+    pthread_t threads[LIST_THREADS];
+    size_t nthreads = 0;
+    while (nthreads < LIST_THREADS && nthreads + 1 < services.size()) {
+        if (pthread_create(&threads[nthreads], NULL, query_interfaces, &q) != 0) {
+            break;
+        }
+        nthreads++;
+    }
+    query_interfaces(&q);
+    for (size_t i = 0; i < nthreads; i++) {
+        pthread_join(threads[i], NULL);
+    }
+}
+
 static String8 good_old_string(const String16& src)
 {
     String8 name8;
@@ -112,16 +164,19 @@ int main(int argc, char* const argv[])
             }
         }
         else if (strcmp(argv[optind], "list") == 0) {
-            Vector<String16> services = sm->listServices();
-            aout << "Found " << services.size() << " services:" << endl;
-            for (unsigned i = 0; i < services.size(); i++) {
-                String16 name = services[i];
-                sp<IBinder> service = sm->checkService(name);
+            Vector<String16> names;
+            Vector<sp<IBinder> > services;
+            sm->listServicesWithBinders(&names, &services);
+            String16* interfaces = new String16[services.size()];
+            get_interface_names(services, interfaces);
+            aout << "Found " << names.size() << " services:" << endl;
+            for (unsigned i = 0; i < names.size(); i++) {
                 aout << i 
-                     << "\t" << good_old_string(name) 
-                     << ": [" << good_old_string(get_interface_name(service)) << "]"
+                     << "\t" << good_old_string(names[i]) 
+                     << ": [" << good_old_string(interfaces[i]) << "]"
                      << endl;
             }
+            delete[] interfaces;
         } else if (strcmp(argv[optind], "call") == 0) {
             optind++;
             if (optind+1 < argc) {
@@ -244,6 +244,8 @@ int binder_parse(struct binder_state *bs, struct binder_io *bio,
                 bio_init_from_txn(&msg, txn);
                 res = func(bs, txn, &msg, &reply);
                 binder_send_reply(bs, &reply, txn->data.ptr.buffer, res);
+                if (reply.flags & BIO_F_MALLOCED)
+                    free(reply.offs0);
             }
             ptr += sizeof(*txn);
             break;
@@ -434,6 +436,22 @@ void bio_init(struct binder_io *bio, void *data,
     bio->flags = 0;
 }
 
+int bio_init_alloc(struct binder_io *bio, size_t maxdata, size_t maxoffs)
+{
+    size_t n = maxoffs * sizeof(size_t);
+    void *data = malloc(n + maxdata);
+
+    if (!data) {
+        bio->flags = BIO_F_OVERFLOW;
+        bio->data_avail = 0;
+        bio->offs_avail = 0;
+        return -1;
+    }
+    bio_init(bio, data, n + maxdata, maxoffs);
+    bio->flags |= BIO_F_MALLOCED;
+    return 0;
+}
+
 static void *bio_alloc(struct binder_io *bio, size_t size)
 {
     size = (size + 3) & (~3);
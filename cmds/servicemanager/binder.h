@@ -39,8 +39,13 @@ enum {
     SVC_MGR_CHECK_SERVICE,
     SVC_MGR_ADD_SERVICE,
     SVC_MGR_LIST_SERVICES,
+    /* 5 and 6 are used by the Java IServiceManager */
+    SVC_MGR_LIST_SERVICES_BULK = 7,
 };
 
+/* SVC_MGR_LIST_SERVICES_BULK flags */
+#define SVC_MGR_LIST_WITH_BINDERS 0x1
+
 typedef int (*binder_handler)(struct binder_state *bs,
                               struct binder_transaction_data *txn,
                               struct binder_io *msg,
@@ -81,6 +86,11 @@ int binder_become_context_manager(struct binder_state *bs);
 void bio_init(struct binder_io *bio, void *data,
            size_t maxdata, size_t maxobjects);
 
+/* the same, but with a malloc()'d working buffer for replies that don't
+ * fit on the stack; binder_parse() frees it once the reply is sent
+ */
+int bio_init_alloc(struct binder_io *bio, size_t maxdata, size_t maxobjects);
+
 void bio_put_obj(struct binder_io *bio, void *ptr);
 void bio_put_ref(struct binder_io *bio, uint32_t handle);
 void bio_put_uint32(struct binder_io *bio, uint32_t n);
@@ -83,9 +83,83 @@ static bool check_mac_perms_from_getcon(pid_t spid, const char *perm)
     return check_mac_perms(spid, service_manager_context, perm, NULL);
 }
 
+/*
+ * Cache of granted (source context, permission, service) decisions, so that
+ * repeated lookups skip selabel_lookup() and selinux_check_access().  It is
+ * keyed on the caller's context rather than its pid, since pids get reused,
+ * and only remembers grants so denials keep being audited.  It is flushed
+ * whenever the policy is reloaded or the enforcing mode changes.
+ */
+#define PERM_CACHE_SIZE 256
+
+struct perm_cache_entry
+{
+    uint32_t hash;
+    const char *perm;
+    char *sctx;
+    char *name;
+};
+
+static struct perm_cache_entry perm_cache[PERM_CACHE_SIZE];
+
+static uint32_t perm_cache_hash(const char *sctx, const char *perm, const char *name)
+{
+    uint32_t hash = 2166136261u;
+    const char *p;
+
+    for (p = sctx; *p; p++)
+        hash = (hash ^ (uint8_t) *p) * 16777619u;
+    for (p = name; *p; p++)
+        hash = (hash ^ (uint8_t) *p) * 16777619u;
+    return hash ^ (uint32_t) (uintptr_t) perm;
+}
+
+static bool perm_cache_lookup(const char *sctx, const char *perm, const char *name)
+{
+    uint32_t hash = perm_cache_hash(sctx, perm, name);
+    struct perm_cache_entry *e = &perm_cache[hash % PERM_CACHE_SIZE];
+
+    return e->sctx && e->hash == hash && e->perm == perm &&
+            !strcmp(e->sctx, sctx) && !strcmp(e->name, name);
+}
+
+static void perm_cache_insert(const char *sctx, const char *perm, const char *name)
+{
+    uint32_t hash = perm_cache_hash(sctx, perm, name);
+    struct perm_cache_entry *e = &perm_cache[hash % PERM_CACHE_SIZE];
+    char *sctx_copy = strdup(sctx);
+    char *name_copy = strdup(name);
+
+    if (!sctx_copy || !name_copy) {
+        free(sctx_copy);
+        free(name_copy);
+        return;
+    }
+
+    free(e->sctx);
+    free(e->name);
+    e->hash = hash;
+    e->perm = perm;
+    e->sctx = sctx_copy;
+    e->name = name_copy;
+}
+
+static void perm_cache_flush(void)
+{
+    size_t i;
+
+    for (i = 0; i < PERM_CACHE_SIZE; i++) {
+        free(perm_cache[i].sctx);
+        free(perm_cache[i].name);
+        perm_cache[i].sctx = NULL;
+        perm_cache[i].name = NULL;
+    }
+}
+
 static bool check_mac_perms_from_lookup(pid_t spid, const char *perm, const char *name)
 {
     bool allowed;
+    char *sctx = NULL;
     char *tctx = NULL;
 
     if (selinux_enabled <= 0) {
@@ -97,20 +171,40 @@ static bool check_mac_perms_from_lookup(pid_t spid, const char *perm, const char
         abort();
     }
 
+    if (getpidcon(spid, &sctx) < 0) {
+        ALOGE("SELinux: getpidcon(pid=%d) failed to retrieve pid context.\n", spid);
+        return false;
+    }
+
+    if (perm_cache_lookup(sctx, perm, name)) {
+        freecon(sctx);
+        return true;
+    }
+
     if (selabel_lookup(sehandle, &tctx, name, 0) != 0) {
         ALOGE("SELinux: No match for %s in service_contexts.\n", name);
+        freecon(sctx);
         return false;
     }
 
-    allowed = check_mac_perms(spid, tctx, perm, name);
+    allowed = (selinux_check_access(sctx, tctx, "service_manager", perm,
+            (void *) name) == 0);
+    if (allowed) {
+        perm_cache_insert(sctx, perm, name);
+    }
+
     freecon(tctx);
+    freecon(sctx);
     return allowed;
 }
 
+// perm_cache compares permissions by address, so they must be these strings.
+static const char perm_add[] = "add";
+static const char perm_find[] = "find";
+
 static int svc_can_register(const uint16_t *name, size_t name_len, pid_t spid)
 {
-    const char *perm = "add";
-    return check_mac_perms_from_lookup(spid, perm, str8(name, name_len)) ? 1 : 0;
+    return check_mac_perms_from_lookup(spid, perm_add, str8(name, name_len)) ? 1 : 0;
 }
 
 static int svc_can_list(pid_t spid)
@@ -121,13 +215,14 @@ static int svc_can_list(pid_t spid)
 
 static int svc_can_find(const uint16_t *name, size_t name_len, pid_t spid)
 {
-    const char *perm = "find";
-    return check_mac_perms_from_lookup(spid, perm, str8(name, name_len)) ? 1 : 0;
+    return check_mac_perms_from_lookup(spid, perm_find, str8(name, name_len)) ? 1 : 0;
 }
 
 struct svcinfo
 {
     struct svcinfo *next;
+    struct svcinfo *hash_next;
+    uint32_t hash;
     uint32_t handle;
     struct binder_death death;
     int allow_isolated;
@@ -135,14 +230,30 @@ struct svcinfo
     uint16_t name[0];
 };
 
+// svclist keeps registration order for SVC_MGR_LIST_SERVICES, svchash
+// indexes the same entries by name for lookups.
+#define SVC_HASH_SIZE 256
+
 struct svcinfo *svclist = NULL;
+static struct svcinfo *svchash[SVC_HASH_SIZE];
+
+static uint32_t svc_hash(const uint16_t *s16, size_t len)
+{
+    uint32_t hash = 2166136261u;
+    size_t i;
+
+    for (i = 0; i < len; i++)
+        hash = (hash ^ s16[i]) * 16777619u;
+    return hash;
+}
 
 struct svcinfo *find_svc(const uint16_t *s16, size_t len)
 {
     struct svcinfo *si;
+    uint32_t hash = svc_hash(s16, len);
 
-    for (si = svclist; si; si = si->next) {
-        if ((len == si->len) &&
+    for (si = svchash[hash % SVC_HASH_SIZE]; si; si = si->hash_next) {
+        if ((hash == si->hash) && (len == si->len) &&
             !memcmp(s16, si->name, len * sizeof(uint16_t))) {
             return si;
         }
@@ -167,10 +278,8 @@ uint16_t svcmgr_id[] = {
 };
 
 
-uint32_t do_find_service(struct binder_state *bs, const uint16_t *s, size_t len, uid_t uid, pid_t spid)
+static uint32_t svc_find_handle(struct svcinfo *si, uid_t uid, pid_t spid)
 {
-    struct svcinfo *si = find_svc(s, len);
-
     if (!si || !si->handle) {
         return 0;
     }
@@ -184,13 +293,57 @@ uint32_t do_find_service(struct binder_state *bs, const uint16_t *s, size_t len,
         }
     }
 
-    if (!svc_can_find(s, len, spid)) {
+    if (!svc_can_find(si->name, si->len, spid)) {
         return 0;
     }
 
     return si->handle;
 }
 
+uint32_t do_find_service(struct binder_state *bs, const uint16_t *s, size_t len, uid_t uid, pid_t spid)
+{
+    return svc_find_handle(find_svc(s, len), uid, spid);
+}
+
+/*
+ * List every service in one reply: the count, then each name, and if
+ * SVC_MGR_LIST_WITH_BINDERS is set, a uint32 telling whether the caller may
+ * use the service followed by its handle if so.  This replaces one
+ * SVC_MGR_LIST_SERVICES call per name, each walking svclist from the start,
+ * and a SVC_MGR_CHECK_SERVICE per name for callers that want the services.
+ */
+int do_list_services(struct binder_io *reply, uint32_t flags, uid_t uid, pid_t spid)
+{
+    struct svcinfo *si;
+    size_t count = 0, size = sizeof(uint32_t);
+    int with_binders = flags & SVC_MGR_LIST_WITH_BINDERS;
+    uint32_t handle;
+
+    for (si = svclist; si; si = si->next) {
+        count++;
+        size += sizeof(uint32_t) + (((si->len + 1) * sizeof(uint16_t) + 3) & ~3);
+        if (with_binders)
+            size += sizeof(uint32_t) + sizeof(struct flat_binder_object);
+    }
+
+    if (bio_init_alloc(reply, size, with_binders ? count : 0)) {
+        ALOGE("list_services() uid=%d - OUT OF MEMORY\n", uid);
+        return -1;
+    }
+
+    bio_put_uint32(reply, count);
+    for (si = svclist; si; si = si->next) {
+        bio_put_string16(reply, si->name);
+        if (!with_binders)
+            continue;
+        handle = svc_find_handle(si, uid, spid);
+        bio_put_uint32(reply, handle ? 1 : 0);
+        if (handle)
+            bio_put_ref(reply, handle);
+    }
+    return 0;
+}
+
 int do_add_service(struct binder_state *bs,
                    const uint16_t *s, size_t len,
                    uint32_t handle, uid_t uid, int allow_isolated,
@@ -234,6 +387,9 @@ int do_add_service(struct binder_state *bs,
         si->allow_isolated = allow_isolated;
         si->next = svclist;
         svclist = si;
+        si->hash = svc_hash(s, len);
+        si->hash_next = svchash[si->hash % SVC_HASH_SIZE];
+        svchash[si->hash % SVC_HASH_SIZE] = si;
     }
 
     binder_acquire(bs, handle);
@@ -284,6 +440,7 @@ int svcmgr_handler(struct binder_state *bs,
             selabel_close(sehandle);
             sehandle = tmp_sehandle;
         }
+        perm_cache_flush();
     }
 
     switch(txn->code) {
@@ -328,6 +485,16 @@ int svcmgr_handler(struct binder_state *bs,
         }
         return -1;
     }
+    case SVC_MGR_LIST_SERVICES_BULK: {
+        uint32_t flags = bio_get_uint32(msg);
+
+        if (!svc_can_list(txn->sender_pid)) {
+            ALOGE("list_services() uid=%d - PERMISSION DENIED\n",
+                    txn->sender_euid);
+            return -1;
+        }
+        return do_list_services(reply, flags, txn->sender_euid, txn->sender_pid);
+    }
     default:
         ALOGE("unknown code %d\n", txn->code);
         return -1;
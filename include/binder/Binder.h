@@ -57,6 +57,12 @@ public:
 
     virtual BBinder*    localBinder();
 
+    // Lets synchronous calls from system callers running at a real-time
+    // priority be served at that priority, when the calling thread asked
+    // for it with IPCThreadState::setPropagateRtPriority().
+            void        setInheritRtPriority(bool inherit);
+            bool        getInheritRtPriority() const;
+
 protected:
     virtual             ~BBinder();
 
@@ -71,6 +77,8 @@ private:
 
     class Extras;
 
+            Extras*     getOrCreateExtras();
+
     atomic_uintptr_t    mExtras;  // should be atomic<Extras *>
             void*       mReserved0;
 };
@@ -36,7 +36,11 @@ public:
 
     // flags returned by getFlags()
     enum {
-        READ_ONLY   = 0x00000001
+        READ_ONLY   = 0x00000001,
+        // fault the whole heap in when it's mapped, in this process and in
+        // the clients; meant for large heaps that are streamed through
+        // (audio, media) and would otherwise take a page fault every 4K.
+        POPULATE    = 0x00000400
     };
 
     virtual int         getHeapID() const = 0;
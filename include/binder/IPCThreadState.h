@@ -48,6 +48,12 @@ public:
             void                setLastTransactionBinderFlags(int32_t flags);
             int32_t             getLastTransactionBinderFlags() const;
 
+            // While enabled, synchronous transactions made by this thread
+            // when it runs SCHED_FIFO or SCHED_RR carry its real-time
+            // priority, which targets that called
+            // BBinder::setInheritRtPriority() serve them at.
+            void                setPropagateRtPriority(bool propagate);
+
             int64_t             clearCallingIdentity();
             void                restoreCallingIdentity(int64_t token);
             
@@ -64,6 +70,14 @@ public:
                                          uint32_t code, const Parcel& data,
                                          Parcel* reply, uint32_t flags);
 
+            // Between these calls, oneway transactions issued by this thread
+            // are queued up and handed to the driver together in a single
+            // BINDER_WRITE_READ when the outermost batch ends (or before the
+            // next synchronous transaction).  endOnewayBatch() returns the
+            // first error reported for any of the queued transactions.
+            void                beginOnewayBatch();
+            status_t            endOnewayBatch();
+
             void                incStrongHandle(int32_t handle);
             void                decStrongHandle(int32_t handle);
             void                incWeakHandle(int32_t handle);
@@ -92,6 +106,9 @@ private:
                                 IPCThreadState();
                                 ~IPCThreadState();
 
+            status_t            doTransact(int32_t handle,
+                                           uint32_t code, const Parcel& data,
+                                           Parcel* reply, uint32_t flags);
             status_t            sendReply(const Parcel& reply, uint32_t flags);
             status_t            waitForResponse(Parcel *reply,
                                                 status_t *acquireResult=NULL);
@@ -102,6 +119,9 @@ private:
                                                      uint32_t code,
                                                      const Parcel& data,
                                                      status_t* statusBuffer);
+            status_t            flushOnewayBatch();
+            void                writeRefCommand(int32_t cmd, int32_t handle);
+            bool                cancelRefCommand(int32_t incCmd, int32_t handle);
             status_t            getAndExecuteCommand();
             status_t            executeCommand(int32_t command);
             void                processPendingDerefs();
@@ -126,6 +146,15 @@ private:
             uid_t               mCallingUid;
             int32_t             mStrictModePolicy;
             int32_t             mLastTransactionBinderFlags;
+            int32_t             mOnewayBatchDepth;
+            // First failure of a batch flushed early by a synchronous call.
+            status_t            mOnewayBatchError;
+            Vector<Parcel*>     mOnewayBatch;
+            // Bounds in mOut of the trailing run of BC_ACQUIRE/BC_RELEASE/
+            // BC_INCREFS/BC_DECREFS commands, for cancelRefCommand().
+            size_t              mRefRunStart;
+            size_t              mRefRunEnd;
+            bool                mPropagateRtPriority;
 };
 
 }; // namespace android
@@ -55,11 +55,25 @@ public:
      */
     virtual Vector<String16>    listServices() = 0;
 
+    /**
+     * Return list of all existing services along with the services
+     * themselves, NULL for the ones the caller may not use.
+     */
+    virtual status_t            listServicesWithBinders(Vector<String16>* names,
+                                            Vector<sp<IBinder> >* services);
+
     enum {
         GET_SERVICE_TRANSACTION = IBinder::FIRST_CALL_TRANSACTION,
         CHECK_SERVICE_TRANSACTION,
         ADD_SERVICE_TRANSACTION,
         LIST_SERVICES_TRANSACTION,
+        // FIRST_CALL_TRANSACTION + 4 and 5 are used by the Java interface.
+        LIST_SERVICES_BULK_TRANSACTION = IBinder::FIRST_CALL_TRANSACTION + 6,
+    };
+
+    // LIST_SERVICES_BULK_TRANSACTION flags.
+    enum {
+        LIST_WITH_BINDERS = 0x1,
     };
 };
 
@@ -28,14 +28,24 @@ namespace android {
 // ----------------------------------------------------------------------------
 
 class SimpleBestFitAllocator;
+class SlabAllocator;
 
 // ----------------------------------------------------------------------------
 
 class MemoryDealer : public RefBase
 {
 public:
+    enum {
+        // Serve allocations of up to 4KB from per-size-class slabs, with
+        // constant-time allocate/deallocate and a lock per size class.
+        // Suited to users that allocate many small buffers of a few sizes.
+        // Larger allocations still use the best-fit allocator.
+        POLICY_SLAB = 0x00000001
+    };
+
     MemoryDealer(size_t size, const char* name = 0,
-            uint32_t flags = 0 /* or bits such as MemoryHeapBase::READ_ONLY */ );
+            uint32_t flags = 0 /* or bits such as MemoryHeapBase::READ_ONLY */,
+            uint32_t policy = 0 /* or POLICY_SLAB */);
 
     virtual sp<IMemory> allocate(size_t size);
     virtual void        deallocate(size_t offset);
@@ -52,6 +62,7 @@ private:
 
     sp<IMemoryHeap>             mHeap;
     SimpleBestFitAllocator*     mAllocator;
+    SlabAllocator*              mSlabAllocator;
 };
 
 
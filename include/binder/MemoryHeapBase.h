@@ -35,7 +35,8 @@ public:
         // memory won't be mapped locally, but will be mapped in the remote
         // process.
         DONT_MAP_LOCALLY = 0x00000100,
-        NO_CACHING = 0x00000200
+        NO_CACHING = 0x00000200,
+        POPULATE = IMemoryHeap::POPULATE
     };
 
     /*
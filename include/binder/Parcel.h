@@ -18,6 +18,7 @@
 #define ANDROID_PARCEL_H
 
 #include <cutils/native_handle.h>
+#include <utils/Debug.h>
 #include <utils/Errors.h>
 #include <utils/RefBase.h>
 #include <utils/String16.h>
@@ -115,6 +116,12 @@ public:
     template<typename T>
     status_t            write(const LightFlattenable<T>& val);
 
+    // Writes count values of a plain type, such as int32_t, float or a struct
+    // of those, in a single copy and without a length.  The result is the same
+    // as writing the values one at a time, since their size is a multiple of 4.
+    template<typename T>
+    status_t            writeArray(const T* values, size_t count);
+
 
     // Place a native_handle into the parcel (the native_handle's file-
     // descriptors are dup'ed, so it is safe to delete the native_handle
@@ -183,6 +190,10 @@ public:
     template<typename T>
     status_t            read(LightFlattenable<T>& val) const;
 
+    // Reads count values written by writeArray, or one at a time.
+    template<typename T>
+    status_t            readArray(T* outValues, size_t count) const;
+
     // Like Parcel.java's readExceptionCode().  Reads the first int32
     // off of a Parcel's header, returning 0 or the negative error
     // code on exceptions, but also deals with skipping over rich
@@ -214,6 +225,11 @@ public:
     static size_t       getGlobalAllocSize();
     static size_t       getGlobalAllocCount();
 
+    // Debugging: get metrics on the per-thread buffer pool used for the
+    // initial storage of small Parcels.
+    static size_t       getPoolHitCount();
+    static size_t       getPoolMissCount();
+
 private:
     typedef void        (*release_func)(Parcel* parcel,
                                         const uint8_t* data, size_t dataSize,
@@ -341,6 +357,9 @@ public:
     };
 
 private:
+    // Variable-size LightFlattenables larger than this are written as blobs.
+    enum { LIGHT_FLATTENABLE_BLOB_LIMIT = 16 * 1024 };
+
     size_t mBlobAshmemSize;
 
 public:
@@ -363,6 +382,17 @@ status_t Parcel::write(const LightFlattenable<T>& val) {
         if (err != NO_ERROR) {
             return err;
         }
+        if (size > LIGHT_FLATTENABLE_BLOB_LIMIT) {
+            // Large variable-size objects (long frame stats histories,
+            // complex regions) are sent out of line so they neither eat
+            // into the binder buffer nor get copied through it.
+            WritableBlob blob;
+            err = writeBlob(size, false, &blob);
+            if (err != NO_ERROR) {
+                return err;
+            }
+            return val.flatten(blob.data(), size);
+        }
     }
     if (size) {
         void* buffer = writeInplace(size);
@@ -391,6 +421,14 @@ status_t Parcel::read(LightFlattenable<T>& val) const {
             return err;
         }
         size = s;
+        if (size > LIGHT_FLATTENABLE_BLOB_LIMIT) {
+            ReadableBlob blob;
+            err = readBlob(size, &blob);
+            if (err != NO_ERROR) {
+                return err;
+            }
+            return val.unflatten(blob.data(), size);
+        }
     }
     if (size) {
         void const* buffer = readInplace(size);
@@ -400,6 +438,24 @@ status_t Parcel::read(LightFlattenable<T>& val) const {
     return NO_ERROR;
 }
 
+template<typename T>
+status_t Parcel::writeArray(const T* values, size_t count) {
+    COMPILE_TIME_ASSERT_FUNCTION_SCOPE(sizeof(T) % 4 == 0);
+    if (count > INT32_MAX / sizeof(T)) {
+        return BAD_VALUE;
+    }
+    return count ? write(values, count * sizeof(T)) : NO_ERROR;
+}
+
+template<typename T>
+status_t Parcel::readArray(T* outValues, size_t count) const {
+    COMPILE_TIME_ASSERT_FUNCTION_SCOPE(sizeof(T) % 4 == 0);
+    if (count > INT32_MAX / sizeof(T)) {
+        return BAD_VALUE;
+    }
+    return count ? read(outValues, count * sizeof(T)) : NO_ERROR;
+}
+
 // ---------------------------------------------------------------------------
 
 inline TextOutput& operator<<(TextOutput& to, const Parcel& parcel)
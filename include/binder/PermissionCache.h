@@ -21,8 +21,11 @@
 #include <unistd.h>
 
 #include <utils/String16.h>
+#include <utils/String8.h>
 #include <utils/Singleton.h>
 #include <utils/SortedVector.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
 
 namespace android {
 // ---------------------------------------------------------------------------
@@ -30,8 +33,9 @@ namespace android {
 /*
  * PermissionCache caches permission checks for a given uid.
  *
- * Currently the cache is not updated when there is a permission change,
- * for instance when an application is uninstalled.
+ * The cache is not updated by itself when there is a permission change,
+ * for instance when an application is uninstalled; nothing tells native
+ * services about those. Entries expire after a few minutes instead.
  *
  * IMPORTANT: for the reason stated above, only system permissions are safe
  * to cache. This restriction may be lifted at a later time.
@@ -42,17 +46,34 @@ class PermissionCache : Singleton<PermissionCache> {
     struct Entry {
         String16    name;
         uid_t       uid;
+        uint32_t    hash;
         bool        granted;
-        inline bool operator < (const Entry& e) const {
-            return (uid == e.uid) ? (name < e.name) : (uid < e.uid);
-        }
+        nsecs_t     time;       // when the permission was checked
     };
+
+    // The cache is a hash table split in a few shards, each with its own
+    // lock, so that binder threads checking different permissions don't
+    // serialize on a single lock. Each shard is small and bounded, the
+    // oldest entry is evicted when it's full.
+    enum {
+        NUM_SHARDS = 8,
+        MAX_ENTRIES_PER_SHARD = 32
+    };
+    struct Shard {
+        mutable Mutex   lock;
+        Vector<Entry>   entries;
+    };
+    Shard mShards[NUM_SHARDS];
+
     mutable Mutex mLock;
     // we pool all the permission names we see, as many permissions checks
     // will have identical names
     SortedVector< String16 > mPermissionNamesPool;
-    // this is our cache per say. it stores pooled names.
-    SortedVector< Entry > mCache;
+
+    mutable volatile int32_t mHits;
+    mutable volatile int32_t mMisses;
+    mutable volatile int32_t mExpired;
+    volatile int32_t mEvictions;
 
     // free the whole cache, but keep the permission name pool
     void purge();
@@ -72,6 +93,8 @@ public:
 
     static bool checkPermission(const String16& permission,
             pid_t pid, uid_t uid);
+
+    static void dump(String8& result);
 };
 
 // ---------------------------------------------------------------------------
@@ -62,6 +62,19 @@ public:
             void                spawnPooledThread(bool isMain);
             
             status_t            setThreadPoolMaxThreadCount(size_t maxThreads);
+
+            // Minimum number of threads kept in the pool.  They are started
+            // along with the pool (or right away if it is already running)
+            // and never leave it, so a burst of incoming calls does not have
+            // to wait for the driver to request new threads one at a time.
+            // Threads the driver asks for under load come on top of these,
+            // up to the maximum set with setThreadPoolMaxThreadCount().
+            status_t            setThreadPoolMinThreadCount(size_t minThreads);
+
+            // Highest number of pool threads seen executing a command at
+            // once, useful to pick the limits above.
+            size_t              getThreadPoolPeakExecutingCount();
+
             void                giveThreadPoolName();
 
 private:
@@ -73,12 +86,29 @@ private:
                                 ProcessState(const ProcessState& o);
             ProcessState&       operator=(const ProcessState& o);
             String8             makeBinderThreadName();
+            void                spawnMinPooledThreadsLocked();
 
             struct handle_entry {
                 IBinder* binder;
                 RefBase::weakref_type* refs;
             };
 
+            // The handle table is split in shards, each with its own lock,
+            // so that threads resolving different handles do not contend.
+            // Handle h lives in shard (h % HANDLE_SHARD_COUNT), at index
+            // (h / HANDLE_SHARD_COUNT).
+            enum { HANDLE_SHARD_COUNT = 8 };
+
+            struct handle_shard {
+                Mutex lock;
+                Vector<handle_entry> entries;
+            };
+
+            inline handle_shard& shardForHandle(int32_t handle) {
+                return mHandleShards[uint32_t(handle) % HANDLE_SHARD_COUNT];
+            }
+
+            // Must be called with the lock of the handle's shard held.
             handle_entry*       lookupHandleLocked(int32_t handle);
 
             int                 mDriverFD;
@@ -91,10 +121,12 @@ private:
             size_t              mExecutingThreadsCount;
             // Maximum number for binder threads allowed for this process.
             size_t              mMaxThreads;
+            // Highest value mExecutingThreadsCount has reached.
+            size_t              mPeakExecutingThreadsCount;
 
-    mutable Mutex               mLock;  // protects everything below.
+            handle_shard        mHandleShards[HANDLE_SHARD_COUNT];
 
-            Vector<handle_entry>mHandleToObject;
+    mutable Mutex               mLock;  // protects everything below.
 
             bool                mManagesContexts;
             context_check_func  mBinderContextCheckFunc;
@@ -106,6 +138,9 @@ private:
 
             String8             mRootDir;
             bool                mThreadPoolStarted;
+            // Pool threads to keep, and how many of them have been started.
+            size_t              mMinThreads;
+            size_t              mMinThreadsStarted;
     volatile int32_t            mThreadPoolSeq;
 };
     
@@ -0,0 +1,109 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_TRANSACTION_STATS_H
+#define ANDROID_TRANSACTION_STATS_H
+
+#include <stdint.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
+#include <utils/Singleton.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+class Parcel;
+
+/*
+ * TransactionStats keeps per-(interface descriptor, code) latency histograms
+ * of the binder transactions made and served by this process.
+ *
+ * Recording is off by default; it is enabled when ProcessState is created
+ * if the debug.binder.stats property is 1, or at runtime with
+ * setEnabled().  The histograms can be retrieved from any process with
+ *
+ *   service call <service> 1599361876 i32 0
+ *
+ * (IBinder::STATS_TRANSACTION), where the argument selects what to do:
+ * 0 to dump, 1 to enable, 2 to disable and 3 to reset, or printed with
+ *
+ *   dumpsys --binder-stats [service]
+ */
+class TransactionStats : Singleton<TransactionStats> {
+public:
+    enum side_t {
+        CLIENT = 0,
+        SERVER = 1,
+    };
+
+    enum command_t {
+        CMD_DUMP = 0,
+        CMD_ENABLE = 1,
+        CMD_DISABLE = 2,
+        CMD_RESET = 3,
+    };
+
+    // Latencies are bucketed by powers of two microseconds, the first
+    // bucket holding everything below 16us and the last everything above
+    // ~0.5s.
+    enum { NUM_BUCKETS = 16 };
+
+    TransactionStats();
+
+    // Enables recording if requested by the debug.binder.stats property.
+    static void initialize();
+
+    static inline bool isEnabled() { return sEnabled; }
+    static void setEnabled(bool enabled);
+
+    // Accounts one transaction. The interface descriptor is taken from the
+    // interface token at the start of data, when there is one.
+    static void record(side_t side, const Parcel& data, uint32_t code,
+            nsecs_t duration);
+
+    static void dump(String8& result);
+    static void reset();
+
+    // Runs one of the command_t requests and writes the answer to reply.
+    // data holds the interface token of the binder, descriptor, followed
+    // by an optional command, CMD_DUMP if there is none.
+    static status_t handleTransaction(const String16& descriptor,
+            const Parcel& data, Parcel* reply);
+
+private:
+    struct Entry {
+        String16    descriptor;
+        uint32_t    code;
+        uint32_t    count;
+        nsecs_t     total;
+        nsecs_t     max;
+        uint32_t    buckets[NUM_BUCKETS];
+    };
+
+    static volatile bool sEnabled;
+
+    mutable Mutex mLock;
+    KeyedVector<uint64_t, Entry> mEntries[2];
+};
+
+// ---------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_TRANSACTION_STATS_H
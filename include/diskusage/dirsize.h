@@ -18,13 +18,28 @@
 #ifndef __LIBDISKUSAGE_DIRSIZE_H
 #define __LIBDISKUSAGE_DIRSIZE_H
 
+#include <stddef.h>
 #include <stdint.h>
 
 __BEGIN_DECLS
 
+#define MAX_DIR_SIZE_THREADS 16
+
 int64_t stat_size(struct stat *s);
+
+/* Returns the disk usage of everything under dfd, which is closed. */
 int64_t calculate_dir_size(int dfd);
 
+/* Like calculate_dir_size, but the tree is scanned by up to max_threads
+ * threads, the calling one included. */
+int64_t calculate_dir_size_parallel(int dfd, int max_threads);
+
+/* Sets sizes[i] to the disk usage under dfds[i], for count directories
+ * scanned together by up to max_threads threads, the calling one included.
+ * The directories are closed; negative fds are skipped and get a size of 0. */
+void calculate_dir_sizes(const int *dfds, int64_t *sizes, size_t count,
+        int max_threads);
+
 __END_DECLS
 
 #endif /* __LIBDISKUSAGE_DIRSIZE_H */
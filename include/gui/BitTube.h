@@ -66,6 +66,24 @@ public:
         return recvObjects(tube, events, count, sizeof(T));
     }
 
+    // send objects as a batch of messages of at most objectsPerMessage
+    // objects each, using a single system call. Each message is written whole
+    // or not at all; returns the number of objects in the messages written.
+    template <typename T>
+    static ssize_t sendObjectsBatch(const sp<BitTube>& tube,
+            T const* events, size_t count, size_t objectsPerMessage) {
+        return sendObjectsBatch(tube, events, count, sizeof(T), objectsPerMessage);
+    }
+
+    // receive as many messages as fit in events using a single system call.
+    // The sender must never write more than objectsPerMessage objects per
+    // message; excess data in a message is discarded, as with recvObjects.
+    template <typename T>
+    static ssize_t recvObjectsBatch(const sp<BitTube>& tube,
+            T* events, size_t count, size_t objectsPerMessage) {
+        return recvObjectsBatch(tube, events, count, sizeof(T), objectsPerMessage);
+    }
+
     // parcels this BitTube
     status_t writeToParcel(Parcel* reply) const;
 
@@ -88,6 +106,14 @@ private:
     static ssize_t recvObjects(const sp<BitTube>& tube,
             void* events, size_t count, size_t objSize);
 
+    static ssize_t sendObjectsBatch(const sp<BitTube>& tube,
+            void const* events, size_t count, size_t objSize,
+            size_t objectsPerMessage);
+
+    static ssize_t recvObjectsBatch(const sp<BitTube>& tube,
+            void* events, size_t count, size_t objSize,
+            size_t objectsPerMessage);
+
     void setSocketName(int socket0, int socket1);
 };
 
@@ -123,6 +123,13 @@ class BufferItem : public Flattenable<BufferItem> {
     // Describes the portion of the surface that has been modified since the
     // previous frame
     Region mSurfaceDamage;
+
+    // mCoalescedFrames is set by acquireBuffer when the consumer enabled
+    // frame-available coalescing (see
+    // IGraphicBufferConsumer::setFrameAvailableCoalescing). It's the number
+    // of buffers still queued behind this one, which the consumer should
+    // acquire without waiting for another onFrameAvailable.
+    uint32_t mCoalescedFrames;
 };
 
 } // namespace android
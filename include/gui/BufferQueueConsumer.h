@@ -145,6 +145,24 @@ public:
     // NATIVE_WINDOW_TRANSFORM_ROT_90.  The default is 0 (no transform).
     virtual status_t setTransformHint(uint32_t hint);
 
+    // See IGraphicBufferConsumer::setBufferPreallocation
+    virtual status_t setBufferPreallocation(bool enabled);
+
+    // See IGraphicBufferConsumer::setFrameCompositionInfo
+    virtual status_t setFrameCompositionInfo(uint64_t frameNumber,
+            nsecs_t latchTime, const sp<Fence>& presentFence,
+            nsecs_t presentTime);
+
+    // See IGraphicBufferConsumer::getBufferMemoryUsage
+    virtual status_t getBufferMemoryUsage(uint32_t* outBufferCount,
+            uint64_t* outBytes);
+
+    // See IGraphicBufferConsumer::discardFreeBuffers
+    virtual status_t discardFreeBuffers();
+
+    // See IGraphicBufferConsumer::setFrameAvailableCoalescing
+    virtual status_t setFrameAvailableCoalescing(bool enabled);
+
     // Retrieve the sideband buffer stream, if any.
     virtual sp<NativeHandle> getSidebandStream() const;
 
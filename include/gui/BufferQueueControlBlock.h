@@ -0,0 +1,110 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_BUFFERQUEUECONTROLBLOCK_H
+#define ANDROID_GUI_BUFFERQUEUECONTROLBLOCK_H
+
+#include <stdint.h>
+
+#include <utils/Errors.h>
+#include <utils/RefBase.h>
+#include <utils/StrongPointer.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class IMemoryHeap;
+
+/*
+ * BufferQueueControlBlock is a page of shared memory through which a
+ * BufferQueue publishes the state its producer would otherwise have to
+ * query() over binder, such as the default size, the consumer usage bits
+ * or the age of the last dequeued buffer.
+ *
+ * BufferQueueCore owns the writable side and updates it with its mutex
+ * held; Surface maps it read-only and reads it without locking, using a
+ * sequence counter to detect concurrent updates.  Slot ownership itself
+ * still goes through binder, since dequeue and queue have to carry fence
+ * file descriptors.
+ */
+class BufferQueueControlBlock : public RefBase {
+public:
+    struct State {
+        uint32_t defaultWidth;
+        uint32_t defaultHeight;
+        int32_t defaultFormat;
+        int32_t defaultDataSpace;
+        uint32_t transformHint;
+        uint32_t numPendingBuffers;
+        uint32_t consumerUsageBits;
+        int32_t minUndequeuedBuffers;
+        int32_t bufferAge;
+        int32_t isAbandoned;
+        // The frame number of the last buffer queued
+        uint64_t frameCounter;
+    };
+
+    // Creates a new control block backed by ashmem, for BufferQueueCore
+    static sp<BufferQueueControlBlock> create();
+
+    // Maps an existing control block read-only, for the producer side
+    static sp<BufferQueueControlBlock> attach(const sp<IMemoryHeap>& heap);
+
+    const sp<IMemoryHeap>& getHeap() const { return mHeap; }
+
+    // publish replaces the published state. It must only be called on a
+    // block returned by create(), and never concurrently with itself.
+    void publish(const State& state);
+
+    // read copies the published state. It returns false if the state could
+    // not be read consistently, in which case the caller should fall back
+    // to binder.
+    bool read(State* outState) const;
+
+    // query answers IGraphicBufferProducer::query() for the values that are
+    // published here. It returns false if what isn't one of them, or if the
+    // BufferQueue has been abandoned.
+    bool query(int what, int* outValue) const;
+
+    // completeQueue records the result of the asynchronous queueBuffer
+    // numbered serial and wakes any producer waiting for it in
+    // waitForQueue(). Like publish(), it is only called on the writable side.
+    void completeQueue(int32_t serial, status_t error);
+
+    // getQueueSerial returns the serial of the last asynchronous queueBuffer
+    // processed. The block outlives producer connections, so a producer
+    // numbers its calls from here rather than from zero.
+    int32_t getQueueSerial() const;
+
+    // waitForQueue blocks until the asynchronous queueBuffer numbered serial
+    // (or a later one) has been processed, and returns the result of the
+    // most recently processed one. It returns TIMED_OUT if that doesn't
+    // happen within timeout.
+    status_t waitForQueue(int32_t serial, nsecs_t timeout) const;
+
+private:
+    struct SharedBlock;
+
+    BufferQueueControlBlock(const sp<IMemoryHeap>& heap, SharedBlock* block);
+    virtual ~BufferQueueControlBlock();
+
+    sp<IMemoryHeap> mHeap;
+    SharedBlock* mBlock;
+};
+
+} // namespace android
+
+#endif
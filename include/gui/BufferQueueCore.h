@@ -20,6 +20,7 @@
 #include <gui/BufferItem.h>
 #include <gui/BufferQueueDefs.h>
 #include <gui/BufferSlot.h>
+#include <gui/FrameTimestamps.h>
 
 #include <utils/Condition.h>
 #include <utils/Mutex.h>
@@ -49,6 +50,7 @@
 
 namespace android {
 
+class BufferQueueControlBlock;
 class IConsumerListener;
 class IGraphicBufferAlloc;
 class IProducerListener;
@@ -115,6 +117,13 @@ private:
     // given slot.
     void freeBufferLocked(int slot);
 
+    // recycleBufferLocked offers the given slot's GraphicBuffer back to
+    // mAllocator, along with the slot's release fence, before the slot lets
+    // go of it. It must only be called for slots that neither the producer
+    // nor the consumer own, and it does nothing for buffers the queue didn't
+    // allocate itself or has handed out (see BufferSlot::mAllocatedByQueue).
+    void recycleBufferLocked(int slot);
+
     // freeAllBuffersLocked frees the GraphicBuffer and sync resources for
     // all slots.
     void freeAllBuffersLocked();
@@ -127,9 +136,22 @@ private:
     void waitWhileAllocatingLocked() const;
 
     // validateConsistencyLocked ensures that the free lists are in sync with
-    // the information stored in mSlots
+    // the information stored in mSlots. It walks every slot and the free
+    // lists with mMutex held, stalling whichever side of the queue is waiting
+    // for the lock, so it only does anything when BufferQueueCore.cpp is
+    // built with VALIDATE_CONSISTENCY set to 1.
     void validateConsistencyLocked() const;
 
+    // publishStateLocked copies the state that the producer can query into
+    // mControlBlock, if one has been handed out.
+    void publishStateLocked();
+
+    // requestPreallocationLocked asks the producer's allocator thread to
+    // fill the free slots with buffers of the current default size, format
+    // and usage. It does nothing unless mPreallocateBuffers is set and a
+    // producer is connected.
+    void requestPreallocationLocked();
+
     // mAllocator is the connection to SurfaceFlinger that is used to allocate
     // new GraphicBuffer objects.
     sp<IGraphicBufferAlloc> mAllocator;
@@ -280,6 +302,51 @@ private:
     // number will fail.
     uint32_t mGenerationNumber;
 
+    // mControlBlock is the shared memory through which the state answered
+    // by query() is published to the producer. It is created on the first
+    // call to BufferQueueProducer::getControlBlock.
+    sp<BufferQueueControlBlock> mControlBlock;
+
+    // mPreallocateBuffers is set by the consumer with setBufferPreallocation.
+    // While it is set, the producer connected to this BufferQueue
+    // pre-allocates buffers on a background thread whenever it connects or
+    // the default size, format or usage change, so that dequeueBuffer doesn't
+    // have to.
+    bool mPreallocateBuffers;
+
+    // mPreallocationRequested is set by requestPreallocationLocked and
+    // cleared by the allocator thread when it starts allocating.
+    // mPreallocationCondition is signaled when it is set, and when the
+    // allocator thread should check whether it needs to exit.
+    bool mPreallocationRequested;
+    mutable Condition mPreallocationCondition;
+
+    // mPreallocationUsage and mPreallocationFormat are the usage and format
+    // the producer last dequeued with, which pre-allocated buffers must
+    // match to be usable. mPreallocationUsesDefaultSize is false when the
+    // producer last asked for a size other than the default, in which case
+    // there's nothing sensible to pre-allocate.
+    uint32_t mPreallocationUsage;
+    PixelFormat mPreallocationFormat;
+    bool mPreallocationUsesDefaultSize;
+
+    // mProducerUid is the uid of the last producer to connect. Buffers are
+    // recycled on its behalf, so that they are only ever reused by the same
+    // uid.
+    uid_t mProducerUid;
+
+    // mFrameEventHistory records the FrameTimestamps of the most recently
+    // queued frames, see IGraphicBufferProducer::getFrameTimestamps.
+    FrameEventHistory mFrameEventHistory;
+
+    // mCoalesceFrameAvailable is set by the consumer with
+    // setFrameAvailableCoalescing. While it is set, mFrameAvailablePending
+    // is true from the time onFrameAvailable is called until the consumer
+    // next calls acquireBuffer, and the buffers queued in between don't
+    // trigger another onFrameAvailable.
+    bool mCoalesceFrameAvailable;
+    bool mFrameAvailablePending;
+
 }; // class BufferQueueCore
 
 } // namespace android
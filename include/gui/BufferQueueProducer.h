@@ -181,10 +181,30 @@ public:
     // See IGraphicBufferProducer::getConsumerName
     virtual String8 getConsumerName() const override;
 
+    // See IGraphicBufferProducer::getControlBlock
+    virtual status_t getControlBlock(sp<IMemoryHeap>* outHeap) override;
+
+    // See IGraphicBufferProducer::queueBufferAsync
+    virtual status_t queueBufferAsync(int slot, const QueueBufferInput& input,
+            int32_t serial) override;
+
+    // See IGraphicBufferProducer::getFrameTimestamps
+    virtual status_t getFrameTimestamps(uint64_t frameNumber,
+            FrameTimestamps* outTimestamps) override;
+
 private:
+    // Preallocator is the thread that runs preallocateBuffers when
+    // BufferQueueCore::requestPreallocationLocked asks for it.
+    class Preallocator;
+
     // This is required by the IBinder::DeathRecipient interface
     virtual void binderDied(const wp<IBinder>& who);
 
+    // preallocateBuffers frees the FREE slots' buffers that no longer match
+    // what the producer last dequeued, then fills the empty slots with
+    // allocateBuffers.
+    void preallocateBuffers();
+
     // waitForFreeSlotThenRelock finds the oldest slot in the FREE state. It may
     // block if there are no available slots and we are not in non-blocking
     // mode (producer and consumer controlled by the application). If it blocks,
@@ -221,6 +241,11 @@ private:
     int mCurrentCallbackTicket; // Protected by mCallbackMutex
     Condition mCallbackCondition;
 
+    // mPreallocator is started on the first connect after the consumer
+    // enables buffer pre-allocation, and runs until this producer is
+    // destroyed or the BufferQueue is abandoned.
+    sp<Preallocator> mPreallocator; // Protected by mCore->mMutex
+
 }; // class BufferQueueProducer
 
 } // namespace android
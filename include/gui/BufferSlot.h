@@ -36,10 +36,13 @@ struct BufferSlot {
       mBufferState(BufferSlot::FREE),
       mRequestBufferCalled(false),
       mFrameNumber(0),
+      mDequeueTime(0),
       mEglFence(EGL_NO_SYNC_KHR),
       mAcquireCalled(false),
       mNeedsCleanupOnRelease(false),
-      mAttachedByConsumer(false) {
+      mAttachedByConsumer(false),
+      mNeedsReallocation(false),
+      mAllocatedByQueue(false) {
     }
 
     // mGraphicBuffer points to the buffer allocated for this slot or is NULL
@@ -105,6 +108,10 @@ struct BufferSlot {
     // may be released before their release fence is signaled).
     uint64_t mFrameNumber;
 
+    // mDequeueTime is when the producer last dequeued or attached this slot,
+    // for the frame's FrameTimestamps.
+    nsecs_t mDequeueTime;
+
     // mEglFence is the EGL sync object that must signal before the buffer
     // associated with this buffer slot may be dequeued. It is initialized
     // to EGL_NO_SYNC_KHR when the buffer is created and may be set to a
@@ -135,6 +142,19 @@ struct BufferSlot {
     // If so, it needs to set the BUFFER_NEEDS_REALLOCATION flag when dequeued
     // to prevent the producer from using a stale cached buffer.
     bool mAttachedByConsumer;
+
+    // Indicates whether the buffer was allocated by allocateBuffers rather
+    // than in dequeueBuffer. Like mAttachedByConsumer, it makes the next
+    // dequeue set BUFFER_NEEDS_REALLOCATION so that the producer doesn't
+    // keep using the buffer it had cached for this slot.
+    bool mNeedsReallocation;
+
+    // Indicates whether mGraphicBuffer was allocated by this BufferQueue and
+    // never handed to anyone but its producer and consumer, which is what
+    // makes it safe to recycle (see BufferQueueCore::recycleBufferLocked).
+    // Attached buffers, and buffers given away by detachNextBuffer, can
+    // still be in use elsewhere.
+    bool mAllocatedByQueue;
 };
 
 } // namespace android
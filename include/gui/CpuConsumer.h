@@ -22,6 +22,7 @@
 #include <ui/GraphicBuffer.h>
 
 #include <utils/String8.h>
+#include <utils/Timers.h>
 #include <utils/Vector.h>
 #include <utils/threads.h>
 
@@ -91,16 +92,50 @@ class CpuConsumer : public ConsumerBase
     // by calling unlockBuffer before more buffers can be acquired.
     status_t lockNextBuffer(LockedBuffer *nativeBuffer);
 
+    // Locks up to maxBuffers of the buffers queued by the producer in one
+    // call, filling in nativeBuffers[0..*outCount) in queue order. This
+    // takes the CpuConsumer lock once for the whole batch, so it is cheaper
+    // than calling lockNextBuffer in a loop. Returns BAD_VALUE if no new
+    // buffer is available and NOT_ENOUGH_DATA if the maximum number of
+    // buffers is already locked; otherwise, the buffers that were locked
+    // before any error occurred are returned and the call succeeds.
+    status_t lockNextBuffers(LockedBuffer *nativeBuffers, size_t maxBuffers,
+            size_t *outCount);
+
     // Returns a locked buffer to the queue, allowing it to be reused. Since
     // only a fixed number of buffers may be locked at a time, old buffers must
     // be released by calling unlockBuffer to ensure new buffers can be acquired by
     // lockNextBuffer.
     status_t unlockBuffer(const LockedBuffer &nativeBuffer);
 
+    // Timing of the buffers locked by this CpuConsumer, for profiling CPU
+    // readback. lockTime covers acquiring and mapping a buffer, and holdTime
+    // is how long the buffers were kept locked by the user.
+    struct LockStats {
+        uint64_t    lockedFrames;
+        nsecs_t     totalLockTime;
+        nsecs_t     maxLockTime;
+        nsecs_t     totalHoldTime;
+        nsecs_t     maxHoldTime;
+    };
+
+    // Returns the timing of the buffers locked since the CpuConsumer was
+    // created or the stats were last reset.
+    void getLockStats(LockStats *outStats) const;
+
+    void resetLockStats();
+
+  protected:
+    // dumpLocked overrides the ConsumerBase method to dump the locked
+    // buffers and the lock timing.
+    virtual void dumpLocked(String8& result, const char* prefix) const;
+
   private:
     // Maximum number of buffers that can be locked at a time
     size_t mMaxLockedBuffers;
 
+    status_t lockNextBufferLocked(LockedBuffer *nativeBuffer);
+
     status_t releaseAcquiredBufferLocked(size_t lockedIdx);
 
     virtual void freeBufferLocked(int slotIndex);
@@ -113,10 +148,13 @@ class CpuConsumer : public ConsumerBase
         int mSlot;
         sp<GraphicBuffer> mGraphicBuffer;
         void *mBufferPointer;
+        // When the buffer was handed to the user, for LockStats::holdTime
+        nsecs_t mLockedTime;
 
         AcquiredBuffer() :
                 mSlot(BufferQueue::INVALID_BUFFER_SLOT),
-                mBufferPointer(NULL) {
+                mBufferPointer(NULL),
+                mLockedTime(0) {
         }
     };
     Vector<AcquiredBuffer> mAcquiredBuffers;
@@ -124,6 +162,8 @@ class CpuConsumer : public ConsumerBase
     // Count of currently locked buffers
     size_t mCurrentLockedBuffers;
 
+    LockStats mLockStats;
+
 };
 
 } // namespace android
@@ -0,0 +1,79 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_DISPLAYEVENTCONTROLBLOCK_H
+#define ANDROID_GUI_DISPLAYEVENTCONTROLBLOCK_H
+
+#include <stdint.h>
+
+#include <utils/RefBase.h>
+#include <utils/StrongPointer.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class IMemoryHeap;
+
+/*
+ * DisplayEventControlBlock is a page of shared memory in which an
+ * EventThread publishes the timestamp, count and period of the latest vsync
+ * of each built-in display, so that clients can read them without a syscall.
+ * Updates come from SurfaceFlinger's vsync model whether or not any
+ * connection has vsync events enabled, and readers extrapolate with the
+ * period in between.
+ *
+ * EventThread owns the writable side and updates it with its lock held;
+ * DisplayEventReceiver maps it read-only and reads it without locking,
+ * using a sequence counter to detect concurrent updates.  The BitTube is
+ * still what wakes clients up.
+ */
+class DisplayEventControlBlock : public RefBase {
+public:
+    // One entry per built-in display, see ISurfaceComposer::eDisplayIdMain
+    enum { NUM_DISPLAYS = 2 };
+
+    // Creates a new control block backed by ashmem, for EventThread
+    static sp<DisplayEventControlBlock> create();
+
+    // Maps an existing control block read-only, for the client side
+    static sp<DisplayEventControlBlock> attach(const sp<IMemoryHeap>& heap);
+
+    const sp<IMemoryHeap>& getHeap() const { return mHeap; }
+
+    // publishVsync records a vsync of display. It must only be called on a
+    // block returned by create(), and never concurrently with itself.
+    void publishVsync(int32_t display, nsecs_t timestamp, uint32_t count,
+            nsecs_t period);
+
+    // readVsync copies the latest published vsync of display. It returns
+    // false if the display is invalid or the values could not be read
+    // consistently.
+    bool readVsync(int32_t display, nsecs_t* outTimestamp,
+            uint32_t* outCount, nsecs_t* outPeriod) const;
+
+private:
+    struct SharedBlock;
+
+    DisplayEventControlBlock(const sp<IMemoryHeap>& heap, SharedBlock* block);
+    virtual ~DisplayEventControlBlock();
+
+    sp<IMemoryHeap> mHeap;
+    SharedBlock* mBlock;
+};
+
+} // namespace android
+
+#endif
@@ -33,6 +33,7 @@ namespace android {
 // ----------------------------------------------------------------------------
 
 class BitTube;
+class DisplayEventControlBlock;
 class IDisplayEventConnection;
 
 // ----------------------------------------------------------------------------
@@ -54,6 +55,9 @@ public:
 
         struct VSync {
             uint32_t count;
+            // The time of the refresh at which a frame started on this
+            // event is expected to be presented, or 0 if unknown
+            nsecs_t expectedPresentTime __attribute__((aligned(8)));
         };
 
         struct Hotplug {
@@ -107,7 +111,8 @@ public:
 
     /*
      * sendEvents write events to the queue and returns how many events were
-     * written.
+     * written. Each event is sent as a separate message, which is what
+     * allows getEvents() to read several of them per system call.
      */
     static ssize_t sendEvents(const sp<BitTube>& dataChannel,
             Event const* events, size_t count);
@@ -126,9 +131,25 @@ public:
      */
     status_t requestNextVsync();
 
+    /*
+     * getLatestVsync() returns the timestamp, count and period of the latest
+     * vsync of the given built-in display (see
+     * ISurfaceComposer::eDisplayIdMain), extrapolated from the last one
+     * SurfaceFlinger published in shared memory. This works whether or not
+     * vsync events are enabled and doesn't need any syscall, so it is a cheap
+     * way to find out where the display is in its vsync cycle without waiting
+     * for the next event. Returns
+     * NO_INIT if the shared memory isn't available, BAD_VALUE if the
+     * display is invalid and WOULD_BLOCK if the values were being updated
+     * and couldn't be read; getEvents() still works in all these cases.
+     */
+    status_t getLatestVsync(int32_t displayId, nsecs_t* outTimestamp,
+            uint32_t* outCount, nsecs_t* outPeriod) const;
+
 private:
     sp<IDisplayEventConnection> mEventConnection;
     sp<BitTube> mDataChannel;
+    sp<DisplayEventControlBlock> mControlBlock;
 };
 
 // ----------------------------------------------------------------------------
@@ -0,0 +1,112 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_FRAMETIMESTAMPS_H
+#define ANDROID_GUI_FRAMETIMESTAMPS_H
+
+#include <stdint.h>
+
+#include <utils/Flattenable.h>
+#include <utils/StrongPointer.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class Fence;
+
+// FrameTimestamps records when a frame went through each stage of its trip
+// from the producer to the display. Times are from the monotonic clock; a
+// time of 0 means the frame hasn't reached that stage yet (or its fence
+// hasn't signaled).
+struct FrameTimestamps : public LightFlattenablePod<FrameTimestamps> {
+    FrameTimestamps() :
+        frameNumber(0),
+        requestedPresentTime(0),
+        dequeueTime(0),
+        queueTime(0),
+        acquireTime(0),
+        latchTime(0),
+        presentTime(0),
+        releaseTime(0) {}
+
+    uint64_t frameNumber;
+
+    // The timestamp the producer passed to queueBuffer
+    nsecs_t requestedPresentTime;
+
+    // When the producer dequeued and queued the buffer
+    nsecs_t dequeueTime;
+    nsecs_t queueTime;
+
+    // When the consumer acquired the buffer
+    nsecs_t acquireTime;
+
+    // When SurfaceFlinger latched the buffer, and when the composition it
+    // was latched for reached the display
+    nsecs_t latchTime;
+    nsecs_t presentTime;
+
+    // When the consumer was done with the buffer
+    nsecs_t releaseTime;
+};
+
+// FrameEventHistory keeps the FrameTimestamps of the last MAX_FRAME_HISTORY
+// frames queued to a BufferQueue. Present and release times are kept as
+// fences and only resolved when the timestamps are read.
+//
+// FrameEventHistory isn't thread-safe; BufferQueueCore guards it with its
+// mutex.
+class FrameEventHistory {
+public:
+    enum { MAX_FRAME_HISTORY = 16 };
+
+    FrameEventHistory();
+
+    void addQueue(uint64_t frameNumber, nsecs_t dequeueTime,
+            nsecs_t queueTime, nsecs_t requestedPresentTime);
+    void addAcquire(uint64_t frameNumber, nsecs_t acquireTime);
+
+    // presentTime is used if presentFence isn't valid, for displays that
+    // don't provide present fences
+    void addComposition(uint64_t frameNumber, nsecs_t latchTime,
+            const sp<Fence>& presentFence, nsecs_t presentTime);
+
+    // releaseTime is used if releaseFence isn't valid
+    void addRelease(uint64_t frameNumber, const sp<Fence>& releaseFence,
+            nsecs_t releaseTime);
+
+    // getFrameTimestamps returns false if frameNumber is no longer, or not
+    // yet, in the history.
+    bool getFrameTimestamps(uint64_t frameNumber,
+            FrameTimestamps* outTimestamps) const;
+
+private:
+    struct Event {
+        FrameTimestamps timestamps;
+        sp<Fence> presentFence;
+        sp<Fence> releaseFence;
+    };
+
+    // Returns NULL if frameNumber's event has been overwritten
+    Event* getEvent(uint64_t frameNumber);
+    const Event* getEvent(uint64_t frameNumber) const;
+
+    Event mEvents[MAX_FRAME_HISTORY];
+};
+
+} // namespace android
+
+#endif
@@ -26,6 +26,7 @@
 
 #include <ui/GraphicBuffer.h>
 
+#include <utils/Looper.h>
 #include <utils/String8.h>
 #include <utils/Vector.h>
 #include <utils/threads.h>
@@ -229,6 +230,25 @@ public:
     // current at the time of the last call to detachFromContext.
     status_t attachToContext(uint32_t tex);
 
+    // setEglImageCacheSize sets how many EGLImages GLConsumer keeps after
+    // the BufferQueue frees their buffer slots.  When a freed buffer comes
+    // back (for example a producer that attaches the same GraphicBuffer
+    // again for every frame, as StreamSplitter does), its EGLImage is reused
+    // instead of being created again.  Each cached image keeps its buffer
+    // alive, so this defaults to 0, which disables the cache.
+    void setEglImageCacheSize(size_t maxImages);
+
+    // setFenceWaitLooper makes updateTexImage stop blocking on acquire fences
+    // when EGL_KHR_wait_sync isn't available.  Without that extension, the
+    // fence of a newly latched buffer has to be waited for on the CPU.  With
+    // a looper set, updateTexImage instead leaves a buffer whose fence hasn't
+    // signaled yet pending, keeps the current texture contents, and returns
+    // NO_ERROR.  The fence is then polled on looper, and once it signals the
+    // FrameAvailableListener is called again so that the next updateTexImage
+    // call can latch the buffer without waiting.  Passing NULL restores the
+    // default blocking behavior.
+    void setFenceWaitLooper(const sp<Looper>& looper);
+
 protected:
 
     // abandonLocked overrides the ConsumerBase method to clear
@@ -330,11 +350,41 @@ private:
 
     // freeBufferLocked frees up the given buffer slot. If the slot has been
     // initialized this will release the reference to the GraphicBuffer in that
-    // slot and destroy the EGLImage in that slot.  Otherwise it has no effect.
+    // slot and destroy the EGLImage in that slot, unless the EGLImage is kept
+    // in mEglImageCache.  Otherwise it has no effect.
     //
     // This method must be called with mMutex locked.
     virtual void freeBufferLocked(int slotIndex);
 
+    // takeCachedEglImageLocked removes the EglImage wrapping graphicBuffer
+    // from mEglImageCache and returns it, or returns NULL if there is none.
+    //
+    // This method must be called with mMutex locked.
+    sp<EglImage> takeCachedEglImageLocked(const sp<GraphicBuffer>& graphicBuffer);
+
+    // FenceWaitCallback polls the fence of mPendingItem on
+    // mFenceWaitLooper.  It is defined in GLConsumer.cpp.
+    class FenceWaitCallback;
+
+    // shouldDeferLatchLocked returns whether updateTexImage should leave item
+    // pending rather than waiting for its fence on the CPU.
+    //
+    // This method must be called with mMutex locked.
+    bool shouldDeferLatchLocked(const BufferItem& item) const;
+
+    // deferLatchLocked makes item the pending buffer and starts polling its
+    // fence.  clearPendingItemLocked stops polling and forgets the pending
+    // buffer, without releasing it.
+    //
+    // These methods must be called with mMutex locked.
+    void deferLatchLocked(const BufferItem& item);
+    void clearPendingItemLocked();
+
+    // onPendingFenceSignaled is called by FenceWaitCallback once the fence of
+    // the pending buffer has signaled.  It must be called without mMutex
+    // locked.
+    void onPendingFenceSignaled();
+
     // computeCurrentTransformMatrixLocked computes the transform matrix for the
     // current texture.  It uses mCurrentTransform and the current GraphicBuffer
     // to compute this matrix and stores it in mCurrentTransformMatrix.
@@ -465,6 +515,29 @@ private:
     // reset mCurrentTexture to INVALID_BUFFER_SLOT.
     int mCurrentTexture;
 
+    // mCurrentTextureBound indicates whether mCurrentTextureImage has already
+    // been bound to mTexName and waited for in the current context.  When it
+    // is set, bindTextureImageLocked only binds mTexName, which makes
+    // rebinding the same frame (as SurfaceFlinger does on every composition)
+    // cheap.  It is cleared whenever the current image, the texture or the
+    // context changes.
+    bool mCurrentTextureBound;
+
+    // mEglImageCache holds the EGLImages of recently freed buffer slots,
+    // oldest first, up to mEglImageCacheSize of them.  See
+    // setEglImageCacheSize.
+    size_t mEglImageCacheSize;
+    Vector<sp<EglImage> > mEglImageCache;
+
+    // mFenceWaitLooper is the looper set by setFenceWaitLooper.  While
+    // mHasPendingItem is set, mPendingItem is acquired but not latched yet
+    // because its fence hasn't signaled, and mFenceWaitCallback is polling
+    // that fence on mFenceWaitLooper.
+    sp<Looper> mFenceWaitLooper;
+    sp<FenceWaitCallback> mFenceWaitCallback;
+    bool mHasPendingItem;
+    BufferItem mPendingItem;
+
     // mAttached indicates whether the ConsumerBase is currently attached to
     // an OpenGL ES context.  For legacy reasons, this is initialized to true,
     // indicating that the ConsumerBase is considered to be attached to
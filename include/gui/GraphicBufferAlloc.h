@@ -36,6 +36,16 @@ public:
     virtual sp<GraphicBuffer> createGraphicBuffer(uint32_t width,
             uint32_t height, PixelFormat format, uint32_t usage,
             status_t* error);
+
+    // Buffers recycled here go to a pool shared by every GraphicBufferAlloc
+    // in the process, bounded by the ro.sf.buffer_pool_kb property (0, the
+    // default, disables the pool). createGraphicBuffer takes a buffer from
+    // the pool when one matches the requested size, format and usage
+    // exactly, has been recycled by the calling uid, and is no longer
+    // referenced or pending a release fence. Buffers left unused in the pool
+    // for more than a few seconds are freed.
+    virtual void recycleGraphicBuffer(const sp<GraphicBuffer>& buffer,
+            const sp<Fence>& releaseFence, uid_t owner);
 };
 
 
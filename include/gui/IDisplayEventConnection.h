@@ -29,6 +29,7 @@ namespace android {
 // ----------------------------------------------------------------------------
 
 class BitTube;
+class IMemoryHeap;
 
 class IDisplayEventConnection : public IInterface
 {
@@ -54,6 +55,13 @@ public:
      * if the vsync rate is > 0.
      */
     virtual void requestNextVsync() = 0;    // asynchronous
+
+    /*
+     * getControlBlock() returns the shared memory in which the latest vsync
+     * of each display is published (see DisplayEventControlBlock), or NULL
+     * if there is none.
+     */
+    virtual sp<IMemoryHeap> getControlBlock() const = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -27,6 +27,7 @@
 namespace android {
 // ----------------------------------------------------------------------------
 
+class Fence;
 class GraphicBuffer;
 
 class IGraphicBufferAlloc : public IInterface
@@ -38,6 +39,17 @@ public:
      */
     virtual sp<GraphicBuffer> createGraphicBuffer(uint32_t w, uint32_t h,
             PixelFormat format, uint32_t usage, status_t* error) = 0;
+
+    /* Offer a buffer that is no longer needed back to the allocator, so that
+     * a later createGraphicBuffer on behalf of the same owner uid can reuse
+     * it instead of allocating. releaseFence must signal before the buffer
+     * can be reused.
+     *
+     * This only has an effect on an allocator living in the calling process;
+     * the default implementation does nothing.
+     */
+    virtual void recycleGraphicBuffer(const sp<GraphicBuffer>& buffer,
+            const sp<Fence>& releaseFence, uid_t owner);
 };
 
 // ----------------------------------------------------------------------------
@@ -253,6 +253,55 @@ public:
     // Return of a value other than NO_ERROR means an unknown error has occurred.
     virtual status_t setTransformHint(uint32_t hint) = 0;
 
+    // setBufferPreallocation enables or disables pre-allocation of buffers.
+    // When enabled, the producer allocates buffers for all of its slots on a
+    // background thread when it connects and whenever the default size,
+    // format or consumer usage bits change, so that the first frames after
+    // e.g. a rotation don't wait for allocation in dequeueBuffer. It takes
+    // effect the next time a producer connects, and is disabled by default.
+    //
+    // Return of a value other than NO_ERROR means an unknown error has occurred.
+    virtual status_t setBufferPreallocation(bool enabled) = 0;
+
+    // setFrameCompositionInfo records, for the producer's FrameTimestamps
+    // (see IGraphicBufferProducer::getFrameTimestamps), when the frame
+    // frameNumber was latched for composition and when that composition
+    // reached the display: when presentFence signals or, if presentFence
+    // isn't valid, at presentTime.
+    //
+    // Return of a value other than NO_ERROR means an unknown error has occurred.
+    virtual status_t setFrameCompositionInfo(uint64_t frameNumber,
+            nsecs_t latchTime, const sp<Fence>& presentFence,
+            nsecs_t presentTime) = 0;
+
+    // getBufferMemoryUsage returns the number of buffers allocated in the
+    // BufferQueue's slots, whatever their state, and an estimate of the
+    // memory they take in bytes, from their stride, height and format.
+    //
+    // Return of a value other than NO_ERROR means an unknown error has occurred.
+    virtual status_t getBufferMemoryUsage(uint32_t* outBufferCount,
+            uint64_t* outBytes) = 0;
+
+    // discardFreeBuffers frees the buffers of all the FREE slots. The
+    // producer will have to allocate new ones the next time it dequeues
+    // these slots. The consumer listener's onBuffersReleased is called if
+    // any buffer was freed.
+    //
+    // Return of a value other than NO_ERROR means an error has occurred:
+    // * NO_INIT - the buffer queue has been abandoned.
+    virtual status_t discardFreeBuffers() = 0;
+
+    // setFrameAvailableCoalescing enables or disables frame-available
+    // coalescing. While it's enabled, onFrameAvailable is only called for
+    // the first buffer queued after the consumer last called acquireBuffer;
+    // the buffers queued after it are reported by BufferItem::mCoalescedFrames
+    // when the consumer acquires. This saves a callback, and a binder
+    // transaction for remote consumers, for every frame the consumer hasn't
+    // gotten to yet. Disabled by default.
+    //
+    // Return of a value other than NO_ERROR means an unknown error has occurred.
+    virtual status_t setFrameAvailableCoalescing(bool enabled) = 0;
+
     // Retrieve the sideband buffer stream, if any.
     virtual sp<NativeHandle> getSidebandStream() const = 0;
 
@@ -33,6 +33,8 @@
 namespace android {
 // ----------------------------------------------------------------------------
 
+class IMemoryHeap;
+struct FrameTimestamps;
 class IProducerListener;
 class NativeHandle;
 class Surface;
@@ -326,7 +328,7 @@ public:
 
     // QueueBufferOutput must be a POD structure
     struct __attribute__ ((__packed__)) QueueBufferOutput {
-        inline QueueBufferOutput() { }
+        inline QueueBufferOutput() : frameNumber(0) { }
         // outWidth - filled with default width applied to the buffer
         // outHeight - filled with default height applied to the buffer
         // outTransformHint - filled with default transform applied to the buffer
@@ -348,11 +350,18 @@ public:
             transformHint = inTransformHint;
             numPendingBuffers = inNumPendingBuffers;
         }
+        // getFrameNumber - the frame number given to the queued buffer, for
+        //                  getFrameTimestamps (0 if unknown)
+        inline uint64_t getFrameNumber() const { return frameNumber; }
+        inline void setFrameNumber(uint64_t inFrameNumber) {
+            frameNumber = inFrameNumber;
+        }
     private:
         uint32_t width;
         uint32_t height;
         uint32_t transformHint;
         uint32_t numPendingBuffers;
+        uint64_t frameNumber;
     };
 
     virtual status_t queueBuffer(int slot,
@@ -483,6 +492,49 @@ public:
 
     // Returns the name of the connected consumer.
     virtual String8 getConsumerName() const = 0;
+
+    // getControlBlock returns the shared memory through which the
+    // BufferQueue publishes the values answered by query() (see
+    // BufferQueueControlBlock), so that the producer can read them without
+    // a binder transaction.
+    //
+    // Return of a value other than NO_ERROR means an error has occurred:
+    // * NO_INIT - the buffer queue has been abandoned.
+    // * INVALID_OPERATION - this producer doesn't publish a control block;
+    //                       query() must be used instead.
+    // * NO_MEMORY - the control block couldn't be allocated.
+    virtual status_t getControlBlock(sp<IMemoryHeap>* outHeap);
+
+    // queueBufferAsync is a variant of queueBuffer that doesn't wait for the
+    // buffer to be queued. Across binder it is a oneway transaction; the
+    // QueueBufferOutput values are instead published in the control block
+    // returned by getControlBlock, and the result is reported there by
+    // BufferQueueControlBlock::completeQueue with the given serial. The
+    // producer must wait for it (see BufferQueueControlBlock::waitForQueue)
+    // before making any other call that depends on the buffer having been
+    // queued.
+    //
+    // Producers that don't publish a control block queue the buffer
+    // synchronously and discard the output.
+    //
+    // Return of a value other than NO_ERROR means the request never got to
+    // the BufferQueue, e.g. because the transaction failed, and nothing
+    // will be reported for serial.
+    virtual status_t queueBufferAsync(int slot, const QueueBufferInput& input,
+            int32_t serial);
+
+    // getFrameTimestamps returns the FrameTimestamps recorded for the frame
+    // that queueBuffer numbered frameNumber (see
+    // QueueBufferOutput::getFrameNumber). Only the most recent frames are
+    // kept, so this should be called soon after the frame is presented.
+    //
+    // Return of a value other than NO_ERROR means an error has occurred:
+    // * NO_INIT - the buffer queue has been abandoned.
+    // * BAD_VALUE - outTimestamps was NULL, or frameNumber isn't in the
+    //               history.
+    // * INVALID_OPERATION - this producer doesn't keep frame timestamps.
+    virtual status_t getFrameTimestamps(uint64_t frameNumber,
+            FrameTimestamps* outTimestamps);
 };
 
 // ----------------------------------------------------------------------------
@@ -29,6 +29,7 @@ namespace android {
 // ----------------------------------------------------------------------------
 
 class BitTube;
+class IMemoryHeap;
 
 class ISensorEventConnection : public IInterface
 {
@@ -40,6 +41,15 @@ public:
                                    nsecs_t maxBatchReportLatencyNs, int reservedFlags) = 0;
     virtual status_t setEventRate(int handle, nsecs_t ns) = 0;
     virtual status_t flush() = 0;
+
+    /*
+     * createDirectChannel() returns the shared memory of a SensorEventRing of
+     * numEvents events, into which the events of the non wake-up sensors
+     * enabled on this connection are then written instead of the sensor
+     * channel, or NULL if it couldn't be created. A connection only has one;
+     * if it already exists, it is returned regardless of numEvents.
+     */
+    virtual sp<IMemoryHeap> createDirectChannel(size_t numEvents) = 0;
 };
 
 // ----------------------------------------------------------------------------
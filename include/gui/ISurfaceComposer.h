@@ -157,6 +157,14 @@ public:
      * Requires the ACCESS_SURFACE_FLINGER permission.
      */
     virtual status_t getAnimationFrameStats(FrameStats* outStats) const = 0;
+
+    /* Gets the summary of the frame statistics for animations, which is much
+     * smaller than the statistics themselves.
+     *
+     * Requires the ACCESS_SURFACE_FLINGER permission.
+     */
+    virtual status_t getAnimationFrameStatsSummary(
+            FrameStatsSummary* outSummary) const = 0;
 };
 
 // ----------------------------------------------------------------------------
@@ -184,6 +192,7 @@ public:
         GET_ANIMATION_FRAME_STATS,
         SET_POWER_MODE,
         GET_DISPLAY_STATS,
+        GET_ANIMATION_FRAME_STATS_SUMMARY,
     };
 
     virtual status_t onTransact(uint32_t code, const Parcel& data,
@@ -78,6 +78,15 @@ public:
      * Requires ACCESS_SURFACE_FLINGER permission
      */
     virtual status_t getLayerFrameStats(const sp<IBinder>& handle, FrameStats* outStats) const = 0;
+
+    /*
+     * Gets the summary of the frame stats of a layer, which is much smaller
+     * than the stats themselves.
+     *
+     * Requires ACCESS_SURFACE_FLINGER permission
+     */
+    virtual status_t getLayerFrameStatsSummary(const sp<IBinder>& handle,
+            FrameStatsSummary* outSummary) const = 0;
 };
 
 // ----------------------------------------------------------------------------
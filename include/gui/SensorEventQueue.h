@@ -43,6 +43,7 @@ namespace android {
 
 class ISensorEventConnection;
 class Sensor;
+class SensorEventRing;
 class Looper;
 
 // ----------------------------------------------------------------------------
@@ -64,6 +65,39 @@ public:
 
     ssize_t read(ASensorEvent* events, size_t numEvents);
 
+    // Like read(), but without copying the events: points *outEvents to the
+    // events received and not consumed yet, receiving more if there are none,
+    // and returns their number. They stay valid until the next call to
+    // consume(), read() or setReadBatchCount(). Must not be called
+    // concurrently with those.
+    ssize_t peek(ASensorEvent const** outEvents);
+
+    // Marks the first numEvents events returned by peek() as read. The wake
+    // up sensor events among them are acked, in a single message once all the
+    // events received have been consumed, so sendAck() isn't needed for them.
+    void consume(size_t numEvents);
+
+    // Sets how many messages read() may drain from the sensor channel with
+    // a single system call. Each message can hold up to
+    // MAX_RECEIVE_BUFFER_EVENT_COUNT events, so this grows the receive
+    // buffer by that much per message; the default is 1. Must not be called
+    // concurrently with read().
+    status_t setReadBatchCount(size_t numMessages);
+
+    // Has the events of the non wake-up sensors delivered through a shared
+    // ring of numEvents events instead of the sensor channel, from then on.
+    // They are then read with readDirect(), which needs no system call; the
+    // sensor channel still carries the others, and wakes no one up for the
+    // ones in the ring. Meant for high rate sensors that are polled, such as
+    // those used for head tracking.
+    status_t enableDirectChannel(size_t numEvents);
+
+    // Reads up to numEvents events from the direct channel. If the ring
+    // wrapped around since the last read, the oldest events are lost and
+    // *outNumLost, if not NULL, is set to their number. Returns NO_INIT if
+    // there is no direct channel.
+    ssize_t readDirect(ASensorEvent* events, size_t numEvents, uint32_t* outNumLost);
+
     status_t waitForEvent() const;
     status_t wake() const;
 
@@ -82,14 +116,22 @@ public:
     status_t injectSensorEvent(const ASensorEvent& event);
 private:
     sp<Looper> getLooper() const;
+    // Receives events from the sensor channel if all of those received
+    // before have been read. Returns the number of events available.
+    ssize_t receiveIfNeeded();
+    // Sends the acks counted in mNumAcksToSend, if any.
+    void sendPendingAcks();
     sp<ISensorEventConnection> mSensorEventConnection;
     sp<BitTube> mSensorChannel;
     mutable Mutex mLock;
     mutable sp<Looper> mLooper;
     ASensorEvent* mRecBuffer;
+    size_t mRecBufferMessages;
     size_t mAvailable;
     size_t mConsumed;
     uint32_t mNumAcksToSend;
+    sp<SensorEventRing> mDirectRing;
+    uint32_t mDirectPosition;
 };
 
 // ----------------------------------------------------------------------------
@@ -0,0 +1,90 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_GUI_SENSOREVENTRING_H
+#define ANDROID_GUI_SENSOREVENTRING_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/RefBase.h>
+#include <utils/StrongPointer.h>
+
+struct ASensorEvent;
+
+namespace android {
+
+class IMemoryHeap;
+
+/*
+ * SensorEventRing is a ring buffer of sensor events in shared memory, through
+ * which SensorService delivers the events of a direct channel without a
+ * socket write per batch.
+ *
+ * SensorService owns the writable side and is its only writer. Each client
+ * maps it read-only and reads it without locking, from its own position: the
+ * writer never waits for readers, so a reader that falls behind by more than
+ * the capacity of the ring loses the oldest events, and is told how many.
+ * There is no wakeup; clients poll, typically once per frame.
+ */
+class SensorEventRing : public RefBase {
+public:
+    // Creates a ring of numEvents events backed by ashmem, for SensorService
+    static sp<SensorEventRing> create(size_t numEvents);
+
+    // Maps an existing ring read-only, for the client side
+    static sp<SensorEventRing> attach(const sp<IMemoryHeap>& heap);
+
+    const sp<IMemoryHeap>& getHeap() const { return mHeap; }
+
+    size_t getCapacity() const { return mCapacity; }
+
+    // write appends events to the ring, overwriting the oldest ones if it is
+    // full. It must only be called on a ring returned by create(), and never
+    // concurrently with itself.
+    void write(const ASensorEvent* events, size_t numEvents);
+
+    // getPosition returns the position of the next event to be written, from
+    // which a reader starts to only get the events written after that.
+    uint32_t getPosition() const;
+
+    // read copies up to numEvents events from *ioPosition on, advances
+    // *ioPosition past them and returns how many were copied. If the events
+    // at *ioPosition were already overwritten, the reader skips to the oldest
+    // available one and *outNumLost, if not NULL, is set to the number of
+    // events skipped; it is set to 0 otherwise.
+    size_t read(uint32_t* ioPosition, ASensorEvent* events, size_t numEvents,
+            uint32_t* outNumLost) const;
+
+private:
+    struct SharedBlock;
+
+    SensorEventRing(const sp<IMemoryHeap>& heap, SharedBlock* block,
+            size_t capacity);
+    virtual ~SensorEventRing();
+
+    ASensorEvent* getEvents() const;
+
+    sp<IMemoryHeap> mHeap;
+    SharedBlock* mBlock;
+    // Read once at creation or attach, so that a writer can't make a reader
+    // index outside of the mapping
+    const size_t mCapacity;
+};
+
+} // namespace android
+
+#endif
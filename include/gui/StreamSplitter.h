@@ -17,6 +17,7 @@
 #ifndef ANDROID_GUI_STREAMSPLITTER_H
 #define ANDROID_GUI_STREAMSPLITTER_H
 
+#include <gui/BufferItem.h>
 #include <gui/IConsumerListener.h>
 #include <gui/IProducerListener.h>
 
@@ -24,6 +25,8 @@
 #include <utils/KeyedVector.h>
 #include <utils/Mutex.h>
 #include <utils/StrongPointer.h>
+#include <utils/Thread.h>
+#include <utils/Vector.h>
 
 namespace android {
 
@@ -66,14 +69,36 @@ public:
     // setName sets the consumer name of the input queue
     void setName(const String8& name);
 
+    // setAsyncOutputs controls how buffers are queued to the outputs. By
+    // default, onFrameAvailable attaches and queues each buffer to every
+    // output in turn, so one output that is slow to accept a buffer delays
+    // all of the others. When enabled, each output instead gets a worker
+    // thread that attaches and queues buffers to it, and onFrameAvailable
+    // only hands the buffer to those threads. Like addOutput, this must be
+    // called before any buffers are queued on the input.
+    void setAsyncOutputs(bool enabled);
+
+    // setDropSlowOutputs changes what happens when an output holds on to
+    // its buffers. By default, once MAX_OUTSTANDING_BUFFERS buffers are
+    // waiting to be released by any output, the splitter stops acquiring
+    // from the input, throttling every output to the slowest one. When
+    // enabled, an output that already has MAX_OUTSTANDING_BUFFERS buffers
+    // in flight skips new buffers instead, and the splitter only stops
+    // acquiring when every output is in that state.
+    void setDropSlowOutputs(bool enabled);
+
 private:
+    class BufferTracker;
+    class Output;
+
     // From IConsumerListener
     //
     // During this callback, we store some tracking information, detach the
     // buffer from the input, and attach it to each of the outputs. This call
     // can block if there are too many outstanding buffers. If it blocks, it
     // will resume when onBufferReleasedByOutput releases a buffer back to the
-    // input.
+    // input. With asynchronous outputs, the attaching is left to each output's
+    // worker thread.
     virtual void onFrameAvailable(const BufferItem& item);
 
     // From IConsumerListener
@@ -95,7 +120,29 @@ private:
     // last output releasing the buffer, and if so, release it to the input.
     // If we release the buffer to the input, we allow a blocked
     // onFrameAvailable call to proceed.
-    void onBufferReleasedByOutput(const sp<IGraphicBufferProducer>& from);
+    void onBufferReleasedByOutput(const sp<Output>& from);
+
+    // Attaches and queues a buffer to one output. This is called without
+    // mMutex held, either from onFrameAvailable or from the output's worker
+    // thread.
+    void queueToOutput(const sp<Output>& output, const BufferItem& item);
+
+    // Records that output is done with a buffer, merging its release fence.
+    // If this was the last output holding the buffer, it stops being tracked
+    // and its tracker is returned so that the caller can pass it to
+    // releaseToInput once mMutex has been unlocked; otherwise NULL is
+    // returned. This must be called with mMutex locked.
+    sp<BufferTracker> releaseFromOutputLocked(const sp<Output>& output,
+            uint64_t bufferId, const sp<Fence>& fence);
+
+    // Attaches and releases a buffer that every output is done with back
+    // to the input, and lets a blocked onFrameAvailable call proceed. This
+    // must be called without mMutex held.
+    void releaseToInput(const sp<BufferTracker>& tracker);
+
+    // Returns whether onFrameAvailable may acquire another buffer from the
+    // input. This must be called with mMutex locked.
+    bool canAcquireLocked() const;
 
     // When this is called, the splitter disconnects from (i.e., abandons) its
     // input queue and signals any waiting onFrameAvailable calls to wake up.
@@ -112,7 +159,7 @@ private:
                            public IBinder::DeathRecipient {
     public:
         OutputListener(const sp<StreamSplitter>& splitter,
-                const sp<IGraphicBufferProducer>& output);
+                const sp<Output>& output);
         virtual ~OutputListener();
 
         // From IProducerListener
@@ -123,7 +170,41 @@ private:
 
     private:
         sp<StreamSplitter> mSplitter;
-        sp<IGraphicBufferProducer> mOutput;
+        sp<Output> mOutput;
+    };
+
+    // Output tracks one output BufferQueue. Its thread is only run when
+    // asynchronous outputs are enabled, in which case it queues the buffers
+    // handed to it by onFrameAvailable to the output in order.
+    class Output : public Thread {
+    public:
+        Output(const wp<StreamSplitter>& splitter,
+                const sp<IGraphicBufferProducer>& producer);
+        virtual ~Output();
+
+        const sp<IGraphicBufferProducer>& getProducer() const {
+            return mProducer;
+        }
+
+        // Hands a buffer to the worker thread
+        void enqueue(const BufferItem& item);
+
+        // Stops the worker thread without waiting for it
+        void stop();
+
+        // The number of buffers queued to this output that it hasn't
+        // released yet. Only accessed while StreamSplitter::mMutex is held.
+        int mInFlight;
+
+    private:
+        virtual bool threadLoop();
+
+        wp<StreamSplitter> mSplitter;
+        sp<IGraphicBufferProducer> mProducer;
+
+        Mutex mMutex;
+        Condition mCondition;
+        Vector<BufferItem> mPending;
     };
 
     class BufferTracker : public LightRefBase<BufferTracker> {
@@ -167,11 +248,22 @@ private:
     // communicate with it further.
     bool mIsAbandoned;
 
+    // See setAsyncOutputs and setDropSlowOutputs
+    bool mAsyncOutputs;
+    bool mDropSlowOutputs;
+
+    // mFrameMutex keeps onFrameAvailable calls from interleaving, so that
+    // every output receives the buffers in the order they were queued to the
+    // input. It is held across the binder calls made to the outputs, which
+    // is why those aren't made under mMutex: that would block
+    // onBufferReleasedByOutput for every other output meanwhile.
+    Mutex mFrameMutex;
+
     Mutex mMutex;
     Condition mReleaseCondition;
     int mOutstandingBuffers;
     sp<IGraphicBufferConsumer> mInput;
-    Vector<sp<IGraphicBufferProducer> > mOutputs;
+    Vector<sp<Output> > mOutputs;
 
     // Map of GraphicBuffer IDs (GraphicBuffer::getId()) to buffer tracking
     // objects (which are mostly for counting how many outputs have released the
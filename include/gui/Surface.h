@@ -31,6 +31,9 @@ struct ANativeWindow_Buffer;
 
 namespace android {
 
+class BufferQueueControlBlock;
+struct FrameTimestamps;
+
 /*
  * An implementation of ANativeWindow that feeds graphics buffers into a
  * BufferQueue.
@@ -109,6 +112,36 @@ public:
     // See IGraphicBufferProducer::getConsumerName
     String8 getConsumerName() const;
 
+    /* Enables or disables asynchronous queueBuffer.
+     *
+     * When enabled, and the producer publishes a control block, queueBuffer
+     * returns without waiting for the BufferQueue to process the buffer (see
+     * IGraphicBufferProducer::queueBufferAsync). The next dequeueBuffer or
+     * disconnect waits for it instead, and that is where an error queuing
+     * the buffer is reported. Disabled by default. */
+    void setAsyncQueueBuffer(bool async);
+
+    // Returns the frame number of the last buffer queued, to pass to
+    // getFrameTimestamps, or 0 if it isn't known yet
+    uint64_t getLastQueuedFrameNumber() const;
+
+    // See IGraphicBufferProducer::getFrameTimestamps
+    status_t getFrameTimestamps(uint64_t frameNumber,
+            FrameTimestamps* outTimestamps) const;
+
+    /* Enables or disables dequeue-ahead.
+     *
+     * When enabled, each successful queueBuffer asks a helper thread to
+     * dequeue the next buffer from the producer right away, so that the IPC
+     * and any wait for a free buffer are overlapped with the rendering of
+     * the next frame. The next dequeueBuffer then returns that buffer, with
+     * the fence and buffer age the producer gave it, provided the requested
+     * dimensions, format, usage and swap interval haven't changed in the
+     * meantime; otherwise the buffer is cancelled and a new one dequeued.
+     * This keeps one more buffer dequeued between frames, so it needs a
+     * queue with a spare buffer. Disabled by default. */
+    void setDequeueAhead(bool enabled);
+
 protected:
     virtual ~Surface();
 
@@ -186,6 +219,21 @@ public:
     virtual int lock(ANativeWindow_Buffer* outBuffer, ARect* inOutDirtyBounds);
     virtual int unlockAndPost();
 
+    enum {
+        // lock leaves the buffer as it was outside of the dirty bounds,
+        // instead of copying the previous frame there. The caller redraws
+        // what changed since the frame the buffer's age says it holds.
+        LOCK_NO_COPY_BACK = 0x1,
+    };
+
+    // lock with LOCK_* flags, which also returns the age of the content of
+    // the buffer in outBufferAge: 0 if it's undefined and the whole buffer
+    // must be drawn, 1 if it's the previous frame, and N if it's the frame
+    // N-1 frames before that, as with NATIVE_WINDOW_BUFFER_AGE. Without
+    // LOCK_NO_COPY_BACK, the age is 0 or 1.
+    virtual int lock(ANativeWindow_Buffer* outBuffer, ARect* inOutDirtyBounds,
+            uint32_t flags, int* outBufferAge);
+
     virtual int connect(int api, const sp<IProducerListener>& listener);
     virtual int detachNextBuffer(sp<GraphicBuffer>* outBuffer,
             sp<Fence>* outFence);
@@ -199,11 +247,100 @@ private:
     void freeAllBuffers();
     int getSlotFromBufferLocked(android_native_buffer_t* buffer) const;
 
+    // waitForAsyncQueueLocked waits for the last asynchronous queueBuffer,
+    // if any, to complete and picks up its output from the control block.
+    // It returns the error the BufferQueue reported for that queue.
+    status_t waitForAsyncQueueLocked();
+
     struct BufferSlot {
         sp<GraphicBuffer> buffer;
         Region dirtyRegion;
     };
 
+    // The parameters of an IGraphicBufferProducer::dequeueBuffer call
+    struct DequeueRequest {
+        uint32_t width;
+        uint32_t height;
+        PixelFormat format;
+        uint32_t usage;
+        bool async;
+
+        bool operator==(const DequeueRequest& other) const {
+            return width == other.width && height == other.height &&
+                    format == other.format && usage == other.usage &&
+                    async == other.async;
+        }
+    };
+
+    // getDequeueRequestLocked returns the parameters the next dequeueBuffer
+    // will pass to the producer.
+    DequeueRequest getDequeueRequestLocked() const;
+
+    // dropStaleBufferLocked forgets the buffers a dequeueBuffer that we
+    // didn't use reported as reallocated, according to its result flags.
+    void dropStaleBufferLocked(int slot, status_t result);
+
+    // discardDequeueAheadLocked drops the buffer dequeued ahead, if any.
+    void discardDequeueAheadLocked(bool cancel);
+
+    // DequeueAheadThread makes the dequeueBuffer calls requested by
+    // queueBuffer when dequeue-ahead is enabled, and holds on to the result
+    // until Surface::dequeueBuffer takes it.
+    class DequeueAheadThread : public Thread {
+    public:
+        explicit DequeueAheadThread(
+                const sp<IGraphicBufferProducer>& producer);
+        virtual ~DequeueAheadThread();
+
+        // Starts dequeuing a buffer with the given parameters, unless a
+        // buffer is already being dequeued or waiting to be taken. If
+        // controlBlock is set, the thread first waits for the asynchronous
+        // queueBuffer numbered queueSerial, so that the buffer age it gets
+        // accounts for that queue.
+        void request(const DequeueRequest& request,
+                const sp<BufferQueueControlBlock>& controlBlock,
+                int32_t queueSerial);
+
+        // Waits for any dequeue in flight and, if it succeeded with the
+        // given parameters, hands its result over and returns true.
+        // Otherwise false is returned, and a buffer dequeued with other
+        // parameters is cancelled; its slot and dequeueBuffer result are
+        // returned in outStaleSlot and outStaleResult so that the caller can
+        // handle the reallocation flags.
+        bool take(const DequeueRequest& request, int* outSlot,
+                sp<Fence>* outFence, status_t* outResult,
+                int* outStaleSlot, status_t* outStaleResult);
+
+        // Waits for any dequeue in flight and drops its result, cancelling
+        // the buffer if cancel is set. The slot and result of a successful
+        // dequeue are returned as with take.
+        void discard(bool cancel, int* outSlot, status_t* outResult);
+
+        // Stops the thread without waiting for it. A buffer it dequeues
+        // afterwards is cancelled.
+        void stop();
+
+    private:
+        enum State { IDLE, REQUESTED, DEQUEUEING, DONE };
+
+        virtual bool threadLoop();
+
+        // Waits for the state to become IDLE or DONE
+        void waitForResultLocked();
+
+        sp<IGraphicBufferProducer> mProducer;
+
+        Mutex mMutex;
+        Condition mCondition;
+        State mState;
+        DequeueRequest mRequest;
+        sp<BufferQueueControlBlock> mControlBlock;
+        int32_t mQueueSerial;
+        int mSlot;
+        sp<Fence> mFence;
+        status_t mResult;
+    };
+
     // mSurfaceTexture is the interface to the surface texture server. All
     // operations on the surface texture client ultimately translate into
     // interactions with the server using this interface.
@@ -317,6 +454,27 @@ private:
     // Stores the current generation number. See setGenerationNumber and
     // IGraphicBufferProducer::setGenerationNumber for more information.
     uint32_t mGenerationNumber;
+
+    // mControlBlock is the BufferQueue's published state, used to answer
+    // query() without a binder transaction. It is NULL while disconnected
+    // or if the producer doesn't provide one.
+    sp<BufferQueueControlBlock> mControlBlock;
+
+    // mAsyncQueueBuffer is set by setAsyncQueueBuffer. mQueueSerial numbers
+    // the asynchronous queueBuffer calls, carrying on from the control
+    // block's serial at connect, and mAsyncQueuePending is true while the
+    // last of them may not have completed yet.
+    bool mAsyncQueueBuffer;
+    uint32_t mQueueSerial;
+    bool mAsyncQueuePending;
+
+    // mLastQueuedFrameNumber is the frame number the BufferQueue gave the
+    // last buffer queued, as returned by getLastQueuedFrameNumber.
+    uint64_t mLastQueuedFrameNumber;
+
+    // mDequeueAhead is the helper thread used when dequeue-ahead is enabled
+    // by setDequeueAhead, NULL otherwise.
+    sp<DequeueAheadThread> mDequeueAhead;
 };
 
 }; // namespace android
@@ -138,9 +138,12 @@ public:
 
     status_t clearLayerFrameStats(const sp<IBinder>& token) const;
     status_t getLayerFrameStats(const sp<IBinder>& token, FrameStats* outStats) const;
+    status_t getLayerFrameStatsSummary(const sp<IBinder>& token,
+            FrameStatsSummary* outSummary) const;
 
     static status_t clearAnimationFrameStats();
     static status_t getAnimationFrameStats(FrameStats* outStats);
+    static status_t getAnimationFrameStatsSummary(FrameStatsSummary* outSummary);
 
     static void setDisplaySurface(const sp<IBinder>& token,
             const sp<IGraphicBufferProducer>& bufferProducer);
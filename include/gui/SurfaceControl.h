@@ -76,6 +76,7 @@ public:
 
     status_t clearLayerFrameStats() const;
     status_t getLayerFrameStats(FrameStats* outStats) const;
+    status_t getLayerFrameStatsSummary(FrameStatsSummary* outSummary) const;
 
 private:
     // can't be copied
@@ -95,21 +95,45 @@ struct InputMessage {
             float xPrecision;
             float yPrecision;
             uint32_t pointerCount;
+            // The number of samples of the move, which all have the same pointers.
+            // The pointers of each sample follow those of the previous one, and are
+            // followed by the sequence number and event time of the samples after the
+            // first, which are those of seq and eventTime.
+            uint32_t sampleCount;
             // Note that PointerCoords requires 8 byte alignment.
             struct Pointer {
                 PointerProperties properties;
                 PointerCoords coords;
             } pointers[MAX_POINTERS];
 
+            struct Sample {
+                uint32_t seq;
+                nsecs_t eventTime __attribute__((aligned(8)));
+            };
+
             int32_t getActionId() const {
                 uint32_t index = (action & AMOTION_EVENT_ACTION_POINTER_INDEX_MASK)
                         >> AMOTION_EVENT_ACTION_POINTER_INDEX_SHIFT;
                 return pointers[index].properties.id;
             }
 
+            // The samples after the first
+            inline Sample* getSamples() {
+                return reinterpret_cast<Sample*>(&pointers[sampleCount * pointerCount]);
+            }
+            inline const Sample* getSamples() const {
+                return reinterpret_cast<const Sample*>(&pointers[sampleCount * pointerCount]);
+            }
+
+            static inline size_t getMaxSampleCount(uint32_t pointerCount) {
+                return (sizeof(Pointer) * MAX_POINTERS + sizeof(Sample))
+                        / (sizeof(Pointer) * pointerCount + sizeof(Sample));
+            }
+
             inline size_t size() const {
                 return sizeof(Motion) - sizeof(Pointer) * MAX_POINTERS
-                        + sizeof(Pointer) * pointerCount;
+                        + sizeof(Pointer) * pointerCount * sampleCount
+                        + sizeof(Sample) * (sampleCount - 1);
             }
         } motion;
 
@@ -177,6 +201,19 @@ public:
      */
     status_t receiveMessage(InputMessage* msg);
 
+    /* Receives as many of the messages sent by the other endpoint as are present, up to
+     * maxCount (at most MAX_RECEIVE_MESSAGES), in a single system call.
+     *
+     * Returns OK on success, with the number of messages received in *outCount,
+     * which is at least 1.
+     * Otherwise returns the same errors as receiveMessage(). When an invalid message
+     * follows valid ones, the valid ones are returned first and the next call
+     * returns BAD_VALUE; anything read after the invalid message is dropped with it.
+     */
+    status_t receiveMessages(InputMessage* msgs, size_t maxCount, size_t* outCount);
+
+    enum { MAX_RECEIVE_MESSAGES = 8 };
+
     /* Returns a new object that has a duplicate of this channel's fd. */
     sp<InputChannel> dup() const;
     // SPRD: Switch debug log by command
@@ -185,6 +222,8 @@ public:
 private:
     String8 mName;
     int mFd;
+    // Error of a message received along with valid ones, for the next receiveMessages().
+    status_t mDeferredReceiveError;
 
     static void setSocketName(int socket0, int socket1);
 };
@@ -252,6 +291,102 @@ public:
             const PointerProperties* pointerProperties,
             const PointerCoords* pointerCoords);
 
+    /* Publishes several samples of a move in a single message, which the consumer
+     * takes as that many motion events: sample i has the sequence number seqs[i],
+     * the event time eventTimes[i] and the pointer coordinates
+     * pointerCoords[i * pointerCount] to pointerCoords[(i + 1) * pointerCount - 1].
+     *
+     * Returns OK on success.
+     * Returns WOULD_BLOCK if the channel is full.
+     * Returns DEAD_OBJECT if the channel's peer has been closed.
+     * Returns BAD_VALUE if one of the seqs is 0, if pointerCount is less than 1 or
+     * greater than MAX_POINTERS or if sampleCount is less than 1 or greater than
+     * getMaxSampleCount(pointerCount).
+     * Other errors probably indicate that the channel is broken.
+     */
+    status_t publishMotionSamples(
+            size_t sampleCount,
+            const uint32_t* seqs,
+            const nsecs_t* eventTimes,
+            int32_t deviceId,
+            int32_t source,
+            int32_t action,
+            int32_t actionButton,
+            int32_t flags,
+            int32_t edgeFlags,
+            int32_t metaState,
+            int32_t buttonState,
+            float xOffset,
+            float yOffset,
+            float xPrecision,
+            float yPrecision,
+            nsecs_t downTime,
+            uint32_t pointerCount,
+            const PointerProperties* pointerProperties,
+            const PointerCoords* pointerCoords);
+
+    /* Returns the number of samples of pointerCount pointers that fit in a message. */
+    static size_t getMaxSampleCount(uint32_t pointerCount);
+
+    /* Builds the message publishKeyEvent would send, without sending it, so that
+     * it can be published to several channels with publishMessage.
+     *
+     * Returns OK on success.
+     * Returns BAD_VALUE if seq is 0.
+     */
+    static status_t buildKeyMessage(
+            InputMessage* msg,
+            uint32_t seq,
+            int32_t deviceId,
+            int32_t source,
+            int32_t action,
+            int32_t flags,
+            int32_t keyCode,
+            int32_t scanCode,
+            int32_t metaState,
+            int32_t repeatCount,
+            nsecs_t downTime,
+            nsecs_t eventTime);
+
+    /* Builds the message publishMotionSamples would send, without sending it, so that
+     * it can be published to several channels with publishMessage.
+     *
+     * Returns OK on success.
+     * Returns BAD_VALUE under the same conditions as publishMotionSamples.
+     */
+    static status_t buildMotionMessage(
+            InputMessage* msg,
+            size_t sampleCount,
+            const uint32_t* seqs,
+            const nsecs_t* eventTimes,
+            int32_t deviceId,
+            int32_t source,
+            int32_t action,
+            int32_t actionButton,
+            int32_t flags,
+            int32_t edgeFlags,
+            int32_t metaState,
+            int32_t buttonState,
+            float xOffset,
+            float yOffset,
+            float xPrecision,
+            float yPrecision,
+            nsecs_t downTime,
+            uint32_t pointerCount,
+            const PointerProperties* pointerProperties,
+            const PointerCoords* pointerCoords);
+
+    /* Publishes a key or motion message made by buildKeyMessage or buildMotionMessage.
+     * The consumer finishes it with the sequence numbers it was built with.
+     *
+     * Returns OK on success.
+     * Returns WOULD_BLOCK if the channel is full.
+     * Returns DEAD_OBJECT if the channel's peer has been closed.
+     * Returns BAD_VALUE if the message is neither a key nor a motion message.
+     * Other errors probably indicate that the channel is broken.
+     */
+    status_t publishMessage(const InputMessage* msg);
+
     /* Receives the finished signal from the consumer in reply to the original dispatch signal.
      * If a signal was received, returns the message sequence number,
      * and whether the consumer handled the message.
@@ -358,6 +493,16 @@ private:
     // call to consume and that still needs to be handled.
     bool mMsgDeferred;
 
+    // Messages received from the channel but not handled yet.  When motion samples come
+    // in faster than the consumer runs, they are read several at a time, which saves
+    // a system call per sample.  They count as deferred events, see hasDeferredEvent().
+    enum { RECEIVE_BUFFER_SIZE = 4 };
+    InputMessage mReceivedMsgs[RECEIVE_BUFFER_SIZE];
+    size_t mNumReceivedMsgs;
+    size_t mNextReceivedMsg;
+    // The next sample of mReceivedMsgs[mNextReceivedMsg], when it has several.
+    uint32_t mNextReceivedSample;
+
     // Batched motion events per device and source.
     struct Batch {
         Vector<InputMessage> samples;
@@ -427,6 +572,7 @@ private:
     };
     Vector<SeqChain> mSeqChains;
 
+    status_t receiveMessage(InputMessage* msg);
     status_t consumeBatch(InputEventFactoryInterface* factory,
             nsecs_t frameTime, uint32_t* outSeq, InputEvent** outEvent);
     status_t consumeSamples(InputEventFactoryInterface* factory,
@@ -26,6 +26,7 @@
 #include <input/Input.h>
 #include <utils/Errors.h>
 #include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
 #include <utils/Tokenizer.h>
 #include <utils/String8.h>
 #include <utils/Unicode.h>
@@ -68,7 +69,8 @@ public:
         int32_t metaState;
     };
 
-    /* Loads a key character map from a file. */
+    /* Loads a key character map from a file.
+     * The map is shared with the earlier loads of the same file, if it hasn't changed. */
     static status_t load(const String8& filename, Format format, sp<KeyCharacterMap>* outMap);
 
     /* Loads a key character map from its string contents. */
@@ -128,7 +130,8 @@ public:
     /* Reads a key map from a parcel. */
     static sp<KeyCharacterMap> readFromParcel(Parcel* parcel);
 
-    /* Writes a key map to a parcel. */
+    /* Writes a key map to a parcel.
+     * The map is flattened the first time and the result reused afterwards. */
     void writeToParcel(Parcel* parcel) const;
 #endif
 
@@ -169,6 +172,12 @@ private:
         Behavior* firstBehavior;
     };
 
+    /* The key and meta key modifiers that generate a character. */
+    struct CharacterKey {
+        int32_t keyCode;
+        int32_t metaState;
+    };
+
     class Parser {
         enum State {
             STATE_TOP = 0,
@@ -219,6 +228,18 @@ private:
     KeyedVector<int32_t, int32_t> mKeysByScanCode;
     KeyedVector<int32_t, int32_t> mKeysByUsageCode;
 
+    /* The reverse map of mKeys, for findKey. */
+    KeyedVector<char16_t, CharacterKey> mKeysByCharacter;
+
+#if HAVE_ANDROID_OS
+    /* The words writeToParcel writes, built on first use.  The map is sent to
+     * applications with every InputDeviceInfo, and it doesn't change once loaded. */
+    mutable Mutex mParcelDataLock;
+    mutable Vector<int32_t> mParcelData;
+
+    void flattenLocked(Vector<int32_t>* outData) const;
+#endif
+
     KeyCharacterMap();
     KeyCharacterMap(const KeyCharacterMap& other);
 
@@ -228,6 +249,7 @@ private:
     static bool matchesMetaState(int32_t eventMetaState, int32_t behaviorMetaState);
 
     bool findKey(char16_t ch, int32_t* outKeyCode, int32_t* outMetaState) const;
+    void updateKeysByCharacter();
 
     static status_t load(Tokenizer* tokenizer, Format format, sp<KeyCharacterMap>* outMap);
 
@@ -62,6 +62,7 @@ struct AxisInfo {
  */
 class KeyLayoutMap : public RefBase {
 public:
+    // The map is shared with the earlier loads of the same file, if it hasn't changed.
     static status_t load(const String8& filename, sp<KeyLayoutMap>* outMap);
 
     status_t mapKey(int32_t scanCode, int32_t usageCode,
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _LIBINPUT_TOUCH_PREDICTOR_H
+#define _LIBINPUT_TOUCH_PREDICTOR_H
+
+#include <input/Input.h>
+#include <input/VelocityTracker.h>
+#include <utils/BitSet.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+/*
+ * Predicts where the pointers of a gesture will be a short time ahead, typically at the
+ * time the frame being drawn for them will be displayed, so that content dragged by a
+ * finger or stylus can be drawn where the pointer is rather than where it was.
+ *
+ * The prediction extrapolates the polynomial that a velocity tracker strategy fits to
+ * the recent movement of each pointer, so the predictor takes the same strategy names
+ * as VelocityTracker: "lsq2" follows accelerations, while linear fits such as "lsq1" or
+ * "int1" overshoot less when the pointer stops or turns.
+ */
+class TouchPredictor {
+public:
+    // How far past the most recent sample of a pointer its position is predicted.
+    // Further ahead, the extrapolation errors outweigh the latency it hides.
+    static const nsecs_t MAX_PREDICTION = 20 * 1000000LL;
+
+    // Creates a predictor using the specified velocity tracker strategy.
+    // If strategy is NULL, uses the default strategy for the platform.
+    TouchPredictor(const char* strategy = NULL);
+
+    // Resets the predictor state.
+    void clear();
+
+    // Adds the movement of the pointers in a MotionEvent, including historical samples.
+    void addMovement(const MotionEvent* event);
+
+    // Predicts the position of the specified pointer id at predictionTime, which is
+    // clamped to the range from the time of its most recent sample to MAX_PREDICTION past
+    // it.  Until the pointer has moved, that's its current position.  Returns false if
+    // the pointer isn't down.
+    bool predict(uint32_t id, nsecs_t predictionTime, float* outX, float* outY) const;
+
+    // Returns the time at which a frame started at frameTime is expected to be displayed,
+    // given the number of vsyncs between the start of a frame and its display.
+    static nsecs_t getPresentTime(nsecs_t frameTime, nsecs_t vsyncPeriod,
+            uint32_t framesOfLatency);
+
+private:
+    VelocityTracker mVelocityTracker;
+
+    // The pointers that are down; those that went up aren't predicted.
+    BitSet32 mDownIdBits;
+};
+
+} // namespace android
+
+#endif // _LIBINPUT_TOUCH_PREDICTOR_H
@@ -0,0 +1,34 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_PRIVATE_EGL_PRELOAD_H
+#define ANDROID_PRIVATE_EGL_PRELOAD_H
+
+#include <EGL/egl.h>
+
+extern "C" {
+
+/*
+ * Loads the EGL and GLES drivers and fills in the hook tables, for the
+ * zygote to do before it forks the applications. Loading runs the drivers'
+ * constructors and resolves the GL entry points through the driver's
+ * eglGetProcAddress; no display is created or initialized.
+ */
+EGLBoolean EGLAPI preloadEGLDrivers();
+
+};
+
+#endif // ANDROID_PRIVATE_EGL_PRELOAD_H
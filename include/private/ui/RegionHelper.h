@@ -76,6 +76,17 @@ public:
         do {
             SpannerInner spannerInner(spanner.lhs, spanner.rhs);
             int inside = spanner.next(current.top, current.bottom);
+            if (inside != SpannerBase::lhs_coincide_rhs) {
+                // Only one of the operands covers this band, so the result
+                // is either nothing or that operand's rects: no need to
+                // merge them with the other's
+                if ((op_mask >> inside) & 1) {
+                    copySpan(inside == SpannerBase::lhs_before_rhs ?
+                            spannerInner.lhs : spannerInner.rhs,
+                            current, rasterizer);
+                }
+                continue;
+            }
             spannerInner.prepare(inside);
             do {
                 TYPE left, right;
@@ -93,6 +104,25 @@ public:
 private:    
     uint32_t op_mask;
 
+    // Rasterizes the rects of reg's current span, within current's top and
+    // bottom
+    static inline void copySpan(const region& reg, RECT& current,
+            region_rasterizer& rasterizer) {
+        if (!reg.count || current.top >= current.bottom) {
+            return;
+        }
+        RECT const* rects = reg.rects;
+        RECT const* const end = rects + reg.count;
+        const TYPE top = rects->top;
+        for ( ; rects != end && rects->top == top; rects++) {
+            current.left  = rects->left  + reg.dx;
+            current.right = rects->right + reg.dx;
+            if (current.left < current.right) {
+                rasterizer(current);
+            }
+        }
+    }
+
     class SpannerBase
     {
     public:
@@ -219,6 +249,7 @@ private:
 
     class SpannerInner : protected SpannerBase 
     {
+        friend class region_operator;
         region lhs;
         region rhs;
         
@@ -20,12 +20,15 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <atomic>
+
 #include <ui/ANativeObjectBase.h>
 #include <ui/PixelFormat.h>
 #include <ui/Rect.h>
 #include <utils/Flattenable.h>
 #include <utils/String8.h>
 #include <utils/Timers.h>
+#include <utils/Vector.h>
 
 struct ANativeWindowBuffer;
 
@@ -82,6 +85,15 @@ public:
     static sp<Fence> merge(const String8& name, const sp<Fence>& f1,
             const sp<Fence>& f2);
 
+    // mergeMany combines any number of Fence objects into one that becomes
+    // signaled when all of them are. Unlike merge, it leaves out the fences
+    // that are invalid, duplicated or already signaled, and returns the only
+    // one left as is, so that no kernel object is created when there's
+    // nothing to merge. It returns NO_FENCE if no fence is left, and NULL
+    // if merging failed.
+    static sp<Fence> mergeMany(const String8& name,
+            const Vector< sp<Fence> >& fences);
+
     // Return a duplicate of the fence file descriptor. The caller is
     // responsible for closing the returned file descriptor. On error, -1 will
     // be returned and errno will indicate the problem.
@@ -90,7 +102,8 @@ public:
     // getSignalTime returns the system monotonic clock time at which the
     // fence transitioned to the signaled state.  If the fence is not signaled
     // then INT64_MAX is returned.  If the fence is invalid or if an error
-    // occurs then -1 is returned.
+    // occurs then -1 is returned.  Once the fence has signaled, the time is
+    // kept, so that later calls don't query the kernel again.
     nsecs_t getSignalTime() const;
 
     // Flattenable interface
@@ -110,6 +123,9 @@ private:
     const Fence& operator = (const Fence& rhs) const;
 
     int mFenceFd;
+
+    // The signal time, once known, or INT64_MAX
+    mutable std::atomic<nsecs_t> mSignalTime;
 };
 
 }; // namespace android
@@ -23,6 +23,50 @@
 
 namespace android {
 
+/*
+ * A summary of FrameStats, computed where the stats are kept so that clients
+ * which only need the aggregates don't have to fetch every timestamp. Only
+ * frames that were presented are counted.
+ */
+struct FrameStatsSummary : public LightFlattenablePod<FrameStatsSummary> {
+    enum {
+        // Number of buckets of frameIntervalHistogram
+        NUM_BUCKETS = 8,
+        // Number of entries of the percentile arrays: the 50th, 90th, 95th
+        // and 99th percentiles
+        NUM_PERCENTILES = 4,
+    };
+
+    FrameStatsSummary();
+
+    /*
+     * Approximate refresh time, in nanoseconds.
+     */
+    nsecs_t refreshPeriodNano;
+
+    /*
+     * The number of frames presented, how many of them were presented more
+     * than one refresh after the previous one, and how many refreshes showed
+     * the previous frame again because of that.
+     */
+    uint64_t frameCount;
+    uint64_t jankyFrameCount;
+    uint64_t missedRefreshCount;
+
+    /*
+     * The number of frames presented i refreshes after the previous one, for
+     * each bucket i; the last bucket counts all the longer intervals.
+     */
+    uint64_t frameIntervalHistogram[NUM_BUCKETS];
+
+    /*
+     * Percentiles of the times in nanoseconds between consecutive presents,
+     * and between when frames should have been and were presented.
+     */
+    nsecs_t frameIntervalPercentilesNano[NUM_PERCENTILES];
+    nsecs_t presentLatencyPercentilesNano[NUM_PERCENTILES];
+};
+
 class FrameStats : public LightFlattenable<FrameStats> {
 public:
 
@@ -51,6 +95,11 @@ public:
     */
     Vector<nsecs_t> frameReadyTimesNano;
 
+    /*
+     * Computes the summary of these stats.
+     */
+    void summarize(FrameStatsSummary* outSummary) const;
+
     // LightFlattenable
     bool isFixedSize() const;
     size_t getFlattenedSize() const;
@@ -139,6 +139,9 @@ private:
         ownNone   = 0,
         ownHandle = 1,
         ownData   = 2,
+        // like ownHandle, but the handle is shared through the import cache
+        // with the other GraphicBuffers of this process for the same buffer
+        ownImported = 3,
     };
 
     inline const GraphicBufferMapper& getBufferMapper() const {
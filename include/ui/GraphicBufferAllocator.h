@@ -26,6 +26,7 @@
 #include <utils/KeyedVector.h>
 #include <utils/threads.h>
 #include <utils/Singleton.h>
+#include <utils/Timers.h>
 
 #include <ui/PixelFormat.h>
 
@@ -79,8 +80,38 @@ private:
         size_t size;
     };
 
+    // Number of buffers and bytes currently allocated, and their highest
+    // values so far
+    struct totals_t {
+        size_t count;
+        size_t size;
+        size_t peakCount;
+        size_t peakSize;
+    };
+
+    // Limits of the allocation latency buckets but the last, in microseconds
+    enum { NUM_LATENCY_BUCKETS = 7 };
+    static const nsecs_t LATENCY_BUCKETS_US[NUM_LATENCY_BUCKETS - 1];
+
+    struct stats_t {
+        uint64_t allocs;
+        uint64_t frees;
+        uint64_t failures;
+        totals_t totals;
+        nsecs_t maxLatency;
+        uint64_t latencyHistogram[NUM_LATENCY_BUCKETS];
+    };
+
+    static void addTotals(totals_t& totals, size_t size);
+    static void removeTotals(totals_t& totals, size_t size);
+    static void addAllocLocked(buffer_handle_t handle, const alloc_rec_t& rec);
+    static void removeAllocLocked(size_t index);
+
     static Mutex sLock;
     static KeyedVector<buffer_handle_t, alloc_rec_t> sAllocList;
+    static stats_t sStats;
+    static KeyedVector<PixelFormat, totals_t> sFormatTotals;
+    static KeyedVector<uint32_t, totals_t> sUsageTotals;
 
     friend class Singleton<GraphicBufferAllocator>;
     GraphicBufferAllocator();
@@ -55,6 +55,10 @@ public:
             bool        contains(const Point& point) const;
             bool        contains(int x, int y) const;
 
+            // returns true if the region and rect share at least one pixel,
+            // without computing their intersection
+            bool        intersects(const Rect& rect) const;
+
             // the region becomes its bounds
             Region&     makeBoundsSelf();
 
@@ -100,6 +104,11 @@ public:
     const   Region      intersect(const Region& rhs, int dx, int dy) const;
     const   Region      subtract(const Region& rhs, int dx, int dy) const;
 
+            // mirrors the region horizontally and/or vertically, then
+            // translates it: a rect (l, t, r, b) flipped horizontally
+            // becomes (dx - r, t + dy, dx - l, b + dy).
+    const   Region      flip(bool flipH, bool flipV, int dx, int dy) const;
+
     // convenience operators overloads
     inline  const Region      operator | (const Region& rhs) const;
     inline  const Region      operator ^ (const Region& rhs) const;
@@ -170,8 +179,12 @@ private:
     static void boolean_operation(int op, Region& dst,
             const Region& lhs, const Rect& rhs);
 
+    static bool trivial_operation(int op, Region& dst,
+            const Region& lhs, const Rect& rhs);
+
     static void translate(Region& reg, int dx, int dy);
     static void translate(Region& dst, const Region& reg, int dx, int dy);
+    static Rect flip(const Rect& r, bool flipH, bool flipV, int dx, int dy);
 
     static bool validate(const Region& reg,
             const char* name, bool silent = false);
@@ -180,6 +193,10 @@ private:
     // with an extra Rect as the last element which is set to the
     // bounds of the region. However, if the region is
     // a simple Rect then mStorage contains only that rect.
+    // Spans are sorted by top and don't overlap, so their bottoms are sorted
+    // too, and the rects of a span by left and right, which lets queries find
+    // the span and rect they need by binary search.
+    // All empty regions share the same storage until they're modified.
     Vector<Rect> mStorage;
 };
 
@@ -57,7 +57,7 @@ inline float   PURE trace(float v)  { return v; }
 inline double  PURE trace(double v) { return v; }
 
 template<typename MATRIX>
-MATRIX PURE inverse(const MATRIX& src) {
+MATRIX PURE gaussJordanInverse(const MATRIX& src) {
 
     COMPILE_TIME_ASSERT_FUNCTION_SCOPE( MATRIX::COL_SIZE == MATRIX::ROW_SIZE );
 
@@ -107,6 +107,78 @@ MATRIX PURE inverse(const MATRIX& src) {
     return inverse;
 }
 
+// 4x4 inverse by cofactor expansion: the adjugate is made of the 2x2 minors
+// of the top and bottom pairs of rows, divided by the determinant. Unlike
+// Gauss-Jordan elimination it has no pivot search and no row swaps, so it
+// compiles to straight-line code the compiler can keep in (vector) registers.
+// Since the inverse of the transpose is the transpose of the inverse, this
+// works whatever the subscripts of MATRIX index first.
+template<typename MATRIX>
+MATRIX PURE cofactorInverse4(const MATRIX& m) {
+    typedef typename MATRIX::value_type T;
+
+    const T s0 = m[0][0] * m[1][1] - m[1][0] * m[0][1];
+    const T s1 = m[0][0] * m[1][2] - m[1][0] * m[0][2];
+    const T s2 = m[0][0] * m[1][3] - m[1][0] * m[0][3];
+    const T s3 = m[0][1] * m[1][2] - m[1][1] * m[0][2];
+    const T s4 = m[0][1] * m[1][3] - m[1][1] * m[0][3];
+    const T s5 = m[0][2] * m[1][3] - m[1][2] * m[0][3];
+
+    const T c5 = m[2][2] * m[3][3] - m[3][2] * m[2][3];
+    const T c4 = m[2][1] * m[3][3] - m[3][1] * m[2][3];
+    const T c3 = m[2][1] * m[3][2] - m[3][1] * m[2][2];
+    const T c2 = m[2][0] * m[3][3] - m[3][0] * m[2][3];
+    const T c1 = m[2][0] * m[3][2] - m[3][0] * m[2][2];
+    const T c0 = m[2][0] * m[3][1] - m[3][0] * m[2][1];
+
+    const T det = s0 * c5 - s1 * c4 + s2 * c3 + s3 * c2 - s4 * c1 + s5 * c0;
+    const T invdet = 1 / det;
+
+    MATRIX inverse(MATRIX::NO_INIT);
+    inverse[0][0] = ( m[1][1] * c5 - m[1][2] * c4 + m[1][3] * c3) * invdet;
+    inverse[0][1] = (-m[0][1] * c5 + m[0][2] * c4 - m[0][3] * c3) * invdet;
+    inverse[0][2] = ( m[3][1] * s5 - m[3][2] * s4 + m[3][3] * s3) * invdet;
+    inverse[0][3] = (-m[2][1] * s5 + m[2][2] * s4 - m[2][3] * s3) * invdet;
+
+    inverse[1][0] = (-m[1][0] * c5 + m[1][2] * c2 - m[1][3] * c1) * invdet;
+    inverse[1][1] = ( m[0][0] * c5 - m[0][2] * c2 + m[0][3] * c1) * invdet;
+    inverse[1][2] = (-m[3][0] * s5 + m[3][2] * s2 - m[3][3] * s1) * invdet;
+    inverse[1][3] = ( m[2][0] * s5 - m[2][2] * s2 + m[2][3] * s1) * invdet;
+
+    inverse[2][0] = ( m[1][0] * c4 - m[1][1] * c2 + m[1][3] * c0) * invdet;
+    inverse[2][1] = (-m[0][0] * c4 + m[0][1] * c2 - m[0][3] * c0) * invdet;
+    inverse[2][2] = ( m[3][0] * s4 - m[3][1] * s2 + m[3][3] * s0) * invdet;
+    inverse[2][3] = (-m[2][0] * s4 + m[2][1] * s2 - m[2][3] * s0) * invdet;
+
+    inverse[3][0] = (-m[1][0] * c3 + m[1][1] * c1 - m[1][2] * c0) * invdet;
+    inverse[3][1] = ( m[0][0] * c3 - m[0][1] * c1 + m[0][2] * c0) * invdet;
+    inverse[3][2] = (-m[3][0] * s3 + m[3][1] * s1 - m[3][2] * s0) * invdet;
+    inverse[3][3] = ( m[2][0] * s3 - m[2][1] * s1 + m[2][2] * s0) * invdet;
+    return inverse;
+}
+
+// picks the closed form for 4x4 matrices, and Gauss-Jordan elimination for
+// the other sizes
+template<typename MATRIX, size_t N = MATRIX::COL_SIZE>
+struct inverter {
+    static MATRIX PURE inverse(const MATRIX& src) {
+        return gaussJordanInverse(src);
+    }
+};
+
+template<typename MATRIX>
+struct inverter<MATRIX, 4> {
+    static MATRIX PURE inverse(const MATRIX& src) {
+        COMPILE_TIME_ASSERT_FUNCTION_SCOPE( MATRIX::ROW_SIZE == 4 );
+        return cofactorInverse4(src);
+    }
+};
+
+template<typename MATRIX>
+MATRIX PURE inverse(const MATRIX& src) {
+    return inverter<MATRIX>::inverse(src);
+}
+
 template<typename MATRIX_R, typename MATRIX_A, typename MATRIX_B>
 MATRIX_R PURE multiply(const MATRIX_A& lhs, const MATRIX_B& rhs) {
     // pre-requisite:
@@ -340,9 +340,12 @@ tmat44<T> tmat44<T>::rotate(A radian, const tvec3<B>& about) {
 // matrix * vector, result is a vector of the same type than the input vector
 template <typename T, typename U>
 typename tmat44<U>::col_type PURE operator *(const tmat44<T>& lv, const tvec4<U>& rv) {
-    typename tmat44<U>::col_type result;
-    for (size_t r=0 ; r<tmat44<T>::row_size() ; r++)
-        result += rv[r]*lv[r];
+    // each component is written out as a single expression: this sums in the
+    // same order as accumulating the columns would, but leaves the compiler
+    // free to compute all four at once (it's the inner loop of mat4 * mat4)
+    typename tmat44<U>::col_type result(tmat44<U>::col_type::NO_INIT);
+    for (size_t i=0 ; i<tmat44<T>::col_size() ; i++)
+        result[i] = rv[0]*lv[0][i] + rv[1]*lv[1][i] + rv[2]*lv[2][i] + rv[3]*lv[3][i];
     return result;
 }
 
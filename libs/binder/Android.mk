@@ -37,6 +37,7 @@ sources := \
     ProcessState.cpp \
     Static.cpp \
     TextOutput.cpp \
+    TransactionStats.cpp \
 
 LOCAL_PATH:= $(call my-dir)
 $(warning sec:${USE_PROJECT_SEC})
@@ -21,6 +21,7 @@
 #include <binder/BpBinder.h>
 #include <binder/IInterface.h>
 #include <binder/Parcel.h>
+#include <binder/TransactionStats.h>
 
 #include <stdio.h>
 
@@ -64,8 +65,11 @@ bool IBinder::checkSubclass(const void* /*subclassID*/) const
 class BBinder::Extras
 {
 public:
+    Extras() : mInheritRtPriority(false) { }
+
     Mutex mLock;
     BpBinder::ObjectManager mObjects;
+    volatile bool mInheritRtPriority;
 };
 
 // ---------------------------------------------------------------------------
@@ -104,6 +108,10 @@ status_t BBinder::transact(
         case PING_TRANSACTION:
             reply->writeInt32(pingBinder());
             break;
+        case STATS_TRANSACTION:
+            err = TransactionStats::handleTransaction(getInterfaceDescriptor(),
+                    data, reply);
+            break;
         default:
             err = onTransact(code, data, reply, flags);
             break;
@@ -135,9 +143,7 @@ status_t BBinder::unlinkToDeath(
     return NO_ERROR;
 }
 
-void BBinder::attachObject(
-    const void* objectID, void* object, void* cleanupCookie,
-    object_cleanup_func func)
+BBinder::Extras* BBinder::getOrCreateExtras()
 {
     Extras* e = reinterpret_cast<Extras*>(
                     atomic_load_explicit(&mExtras, memory_order_acquire));
@@ -153,8 +159,16 @@ void BBinder::attachObject(
             delete e;
             e = reinterpret_cast<Extras*>(expected);  // Filled in by CAS
         }
-        if (e == 0) return; // out of memory
     }
+    return e;
+}
+
+void BBinder::attachObject(
+    const void* objectID, void* object, void* cleanupCookie,
+    object_cleanup_func func)
+{
+    Extras* e = getOrCreateExtras();
+    if (e == 0) return; // out of memory
 
     AutoMutex _l(e->mLock);
     e->mObjects.attach(objectID, object, cleanupCookie, func);
@@ -193,6 +207,20 @@ BBinder* BBinder::localBinder()
     return this;
 }
 
+void BBinder::setInheritRtPriority(bool inherit)
+{
+    Extras* e = getOrCreateExtras();
+    if (e == 0) return; // out of memory
+    e->mInheritRtPriority = inherit;
+}
+
+bool BBinder::getInheritRtPriority() const
+{
+    Extras* e = reinterpret_cast<Extras*>(
+                    load_const_atomic(&mExtras, memory_order_acquire));
+    return e ? e->mInheritRtPriority : false;
+}
+
 BBinder::~BBinder()
 {
     Extras* e = reinterpret_cast<Extras*>(
@@ -35,6 +35,10 @@
 
 #define VERBOSE   0
 
+// heaps mapped with IMemoryHeap::POPULATE at least this large are also
+// advertised as candidates for transparent huge pages.
+#define HUGE_PAGE_SIZE  (2*1024*1024)
+
 namespace android {
 // ---------------------------------------------------------------------------
 
@@ -320,16 +324,27 @@ void BpMemoryHeap::assertReallyMapped() const
         if (!(flags & READ_ONLY)) {
             access |= PROT_WRITE;
         }
+        int mapFlags = MAP_SHARED;
+        if (flags & POPULATE) {
+            mapFlags |= MAP_POPULATE;
+        }
 
         Mutex::Autolock _l(mLock);
         if (mHeapId == -1) {
             mRealHeap = true;
-            mBase = mmap(0, size, access, MAP_SHARED, fd, offset);
+            mBase = mmap(0, size, access, mapFlags, fd, offset);
             if (mBase == MAP_FAILED) {
                 ALOGE("cannot map BpMemoryHeap (binder=%p), size=%zd, fd=%d (%s)",
                         IInterface::asBinder(this).get(), size, fd, strerror(errno));
                 close(fd);
             } else {
+#ifdef MADV_HUGEPAGE
+                if ((flags & POPULATE) && size >= HUGE_PAGE_SIZE) {
+                    // only a hint, not every kernel can back shared memory
+                    // with huge pages.
+                    madvise(mBase, size, MADV_HUGEPAGE);
+                }
+#endif
                 mSize = size;
                 mFlags = flags;
                 mOffset = offset;
@@ -21,11 +21,13 @@
 #include <binder/Binder.h>
 #include <binder/BpBinder.h>
 #include <binder/TextOutput.h>
+#include <binder/TransactionStats.h>
 
 #include <cutils/sched_policy.h>
 #include <utils/Log.h>
 #include <utils/threads.h>
 
+#include <private/android_filesystem_config.h>
 #include <private/binder/binder_module.h>
 #include <private/binder/Static.h>
 
@@ -34,6 +36,7 @@
 #include <sched.h>
 #include <signal.h>
 #include <stdio.h>
+#include <string.h>
 #include <sys/ioctl.h>
 #include <sys/resource.h>
 #include <unistd.h>
@@ -58,6 +61,12 @@
 
 #endif
 
+// Transaction flag bits that the driver hands to the target untouched,
+// used to carry the caller's real-time priority for setPropagateRtPriority().
+#define TF_INHERIT_RT       0x00000100
+#define TF_RT_PRIO_SHIFT    16
+#define TF_RT_PRIO_MASK     0x00ff0000
+
 // ---------------------------------------------------------------------------
 
 namespace android {
@@ -279,6 +288,30 @@ static pthread_key_t gTLS = 0;
 static bool gShutdown = false;
 static bool gDisableBackgroundScheduling = false;
 
+// Moves thread tid to SCHED_FIFO at priority, unless it already runs at
+// least that urgently. Returns the policy to restore with *outParam, or -1
+// if nothing was changed.
+static int inheritRtPriority(pid_t tid, int priority, struct sched_param* outParam)
+{
+    const int policy = sched_getscheduler(tid);
+    if (policy < 0 || sched_getparam(tid, outParam) != 0) {
+        return -1;
+    }
+    if ((policy == SCHED_FIFO || policy == SCHED_RR) &&
+            outParam->sched_priority >= priority) {
+        // Already running at least as urgently as the caller.
+        return -1;
+    }
+    struct sched_param param;
+    param.sched_priority = priority;
+    if (sched_setscheduler(tid, SCHED_FIFO, &param) != 0) {
+        // Typically this process lacks CAP_SYS_NICE / RLIMIT_RTPRIO.
+        ALOGV("Cannot inherit real-time priority %d: %s", priority, strerror(errno));
+        return -1;
+    }
+    return policy;
+}
+
 IPCThreadState* IPCThreadState::self()
 {
     if (gHaveTLS) {
@@ -382,6 +415,11 @@ int32_t IPCThreadState::getLastTransactionBinderFlags() const
     return mLastTransactionBinderFlags;
 }
 
+void IPCThreadState::setPropagateRtPriority(bool propagate)
+{
+    mPropagateRtPriority = propagate;
+}
+
 void IPCThreadState::restoreCallingIdentity(int64_t token)
 {
     mCallingUid = (int)(token>>32);
@@ -430,6 +468,9 @@ status_t IPCThreadState::getAndExecuteCommand()
 
         pthread_mutex_lock(&mProcess->mThreadCountLock);
         mProcess->mExecutingThreadsCount++;
+        if (mProcess->mExecutingThreadsCount > mProcess->mPeakExecutingThreadsCount) {
+            mProcess->mPeakExecutingThreadsCount = mProcess->mExecutingThreadsCount;
+        }
         pthread_mutex_unlock(&mProcess->mThreadCountLock);
 
         result = executeCommand(cmd);
@@ -550,11 +591,35 @@ void IPCThreadState::stopProcess(bool /*immediate*/)
 status_t IPCThreadState::transact(int32_t handle,
                                   uint32_t code, const Parcel& data,
                                   Parcel* reply, uint32_t flags)
+{
+    if (TransactionStats::isEnabled()) {
+        const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        status_t err = doTransact(handle, code, data, reply, flags);
+        TransactionStats::record(TransactionStats::CLIENT, data, code,
+                systemTime(SYSTEM_TIME_MONOTONIC) - start);
+        return err;
+    }
+    return doTransact(handle, code, data, reply, flags);
+}
+
+status_t IPCThreadState::doTransact(int32_t handle,
+                                    uint32_t code, const Parcel& data,
+                                    Parcel* reply, uint32_t flags)
 {
     status_t err = data.errorCheck();
 
     flags |= TF_ACCEPT_FDS;
 
+    if (mPropagateRtPriority && (flags & TF_ONE_WAY) == 0) {
+        struct sched_param param;
+        const int policy = sched_getscheduler(mMyThreadId);
+        if ((policy == SCHED_FIFO || policy == SCHED_RR) &&
+                sched_getparam(mMyThreadId, &param) == 0) {
+            flags |= TF_INHERIT_RT |
+                    ((param.sched_priority << TF_RT_PRIO_SHIFT) & TF_RT_PRIO_MASK);
+        }
+    }
+
     IF_LOG_TRANSACTIONS() {
         TextOutput::Bundle _b(alog);
         alog << "BC_TRANSACTION thr " << (void*)pthread_self() << " / hand "
@@ -577,6 +642,35 @@ status_t IPCThreadState::transact(int32_t handle,
         }
     }
    #endif
+    if (err == NO_ERROR && mOnewayBatchDepth > 0) {
+        if ((flags & TF_ONE_WAY) != 0) {
+            // The caller is free to destroy data as soon as we return, so
+            // keep a copy around until the batch has been sent.
+            Parcel* copy = new Parcel;
+            err = copy->appendFrom(&data, 0, data.dataSize());
+            if (err == NO_ERROR) {
+                LOG_ONEWAY(">>>> QUEUE from pid %d uid %d ONE WAY", getpid(), getuid());
+                err = writeTransactionData(BC_TRANSACTION, flags, handle, code, *copy, NULL);
+            }
+            if (err != NO_ERROR) {
+                delete copy;
+                return (mLastError = err);
+            }
+            mOnewayBatch.push(copy);
+            return NO_ERROR;
+        }
+        // Errors for queued oneway transactions must not be mistaken for
+        // the result of this call, so send them first; the outermost
+        // endOnewayBatch() reports them.
+        status_t batchErr = flushOnewayBatch();
+        if (batchErr != NO_ERROR) {
+            ALOGW("Queued oneway transaction failed: %s (%d)", strerror(-batchErr), batchErr);
+            if (mOnewayBatchError == NO_ERROR) {
+                mOnewayBatchError = batchErr;
+            }
+        }
+    }
+
     if (err == NO_ERROR) {
         LOG_ONEWAY(">>>> SEND from pid %d uid %d %s", getpid(), getuid(),
             (flags & TF_ONE_WAY) == 0 ? "READ REPLY" : "ONE WAY");
@@ -624,32 +718,113 @@ status_t IPCThreadState::transact(int32_t handle,
     return err;
 }
 
+void IPCThreadState::beginOnewayBatch()
+{
+    mOnewayBatchDepth++;
+}
+
+status_t IPCThreadState::endOnewayBatch()
+{
+    LOG_ALWAYS_FATAL_IF(mOnewayBatchDepth <= 0,
+            "endOnewayBatch() called without beginOnewayBatch()");
+    if (--mOnewayBatchDepth > 0) {
+        return NO_ERROR;
+    }
+    status_t err = flushOnewayBatch();
+    if (mOnewayBatchError != NO_ERROR) {
+        err = mOnewayBatchError;
+        mOnewayBatchError = NO_ERROR;
+    }
+    return err;
+}
+
+status_t IPCThreadState::flushOnewayBatch()
+{
+    status_t result = NO_ERROR;
+    const size_t N = mOnewayBatch.size();
+
+    // The driver answers every queued BC_TRANSACTION with its own
+    // BR_TRANSACTION_COMPLETE (or a failure), so collect one per transaction.
+    // Only the first waitForResponse() actually writes mOut.
+    for (size_t i = 0; i < N; i++) {
+        status_t err = waitForResponse(NULL, NULL);
+        if (err != NO_ERROR && result == NO_ERROR) {
+            result = err;
+        }
+    }
+    for (size_t i = 0; i < N; i++) {
+        delete mOnewayBatch[i];
+    }
+    mOnewayBatch.clear();
+    return result;
+}
+
 void IPCThreadState::incStrongHandle(int32_t handle)
 {
     LOG_REMOTEREFS("IPCThreadState::incStrongHandle(%d)\n", handle);
-    mOut.writeInt32(BC_ACQUIRE);
-    mOut.writeInt32(handle);
+    writeRefCommand(BC_ACQUIRE, handle);
 }
 
 void IPCThreadState::decStrongHandle(int32_t handle)
 {
     LOG_REMOTEREFS("IPCThreadState::decStrongHandle(%d)\n", handle);
-    mOut.writeInt32(BC_RELEASE);
-    mOut.writeInt32(handle);
+    if (cancelRefCommand(BC_ACQUIRE, handle)) return;
+    writeRefCommand(BC_RELEASE, handle);
 }
 
 void IPCThreadState::incWeakHandle(int32_t handle)
 {
     LOG_REMOTEREFS("IPCThreadState::incWeakHandle(%d)\n", handle);
-    mOut.writeInt32(BC_INCREFS);
-    mOut.writeInt32(handle);
+    writeRefCommand(BC_INCREFS, handle);
 }
 
 void IPCThreadState::decWeakHandle(int32_t handle)
 {
     LOG_REMOTEREFS("IPCThreadState::decWeakHandle(%d)\n", handle);
-    mOut.writeInt32(BC_DECREFS);
+    if (cancelRefCommand(BC_INCREFS, handle)) return;
+    writeRefCommand(BC_DECREFS, handle);
+}
+
+void IPCThreadState::writeRefCommand(int32_t cmd, int32_t handle)
+{
+    // Start a new run unless this directly follows the previous one.
+    if (mOut.dataSize() != mRefRunEnd) {
+        mRefRunStart = mOut.dataSize();
+    }
+    mOut.writeInt32(cmd);
     mOut.writeInt32(handle);
+    mRefRunEnd = mOut.dataSize();
+}
+
+bool IPCThreadState::cancelRefCommand(int32_t incCmd, int32_t handle)
+{
+    // Only the run of reference commands at the end of mOut can be looked
+    // at, since other commands can't be parsed backwards.  An increment
+    // followed by the matching decrement is a no-op for the driver, while
+    // the opposite order is not: the decrement may free the reference.
+    if (mOut.dataSize() != mRefRunEnd || mRefRunEnd == mRefRunStart) {
+        return false;
+    }
+    const int32_t* cmds = reinterpret_cast<const int32_t*>(mOut.data() + mRefRunStart);
+    const size_t N = (mRefRunEnd - mRefRunStart) / (2 * sizeof(int32_t));
+    for (size_t i = N; i > 0; i--) {
+        const int32_t* c = cmds + 2 * (i - 1);
+        if (c[0] == incCmd && c[1] == handle) {
+            const size_t pos = mRefRunStart + (i - 1) * 2 * sizeof(int32_t);
+            const size_t len = 2 * sizeof(int32_t);
+            if (pos + len < mRefRunEnd) {
+                memmove(const_cast<uint8_t*>(mOut.data()) + pos,
+                        mOut.data() + pos + len, mRefRunEnd - pos - len);
+            }
+            mOut.setDataSize(mRefRunEnd - len);
+            mOut.setDataPosition(mRefRunEnd - len);
+            mRefRunEnd -= len;
+            LOG_REMOTEREFS("IPCThreadState cancelled pending %s for handle %d\n",
+                    incCmd == BC_ACQUIRE ? "BC_ACQUIRE" : "BC_INCREFS", handle);
+            return true;
+        }
+    }
+    return false;
 }
 
 status_t IPCThreadState::attemptIncStrongHandle(int32_t handle)
@@ -704,7 +879,12 @@ IPCThreadState::IPCThreadState()
     : mProcess(ProcessState::self()),
       mMyThreadId(gettid()),
       mStrictModePolicy(0),
-      mLastTransactionBinderFlags(0)
+      mLastTransactionBinderFlags(0),
+      mOnewayBatchDepth(0),
+      mOnewayBatchError(NO_ERROR),
+      mRefRunStart(0),
+      mRefRunEnd(0),
+      mPropagateRtPriority(false)
 {
     pthread_setspecific(gTLS, this);
     clearCaller();
@@ -714,6 +894,9 @@ IPCThreadState::IPCThreadState()
 
 IPCThreadState::~IPCThreadState()
 {
+    for (size_t i = 0; i < mOnewayBatch.size(); i++) {
+        delete mOnewayBatch[i];
+    }
 }
 
 status_t IPCThreadState::sendReply(const Parcel& reply, uint32_t flags)
@@ -897,6 +1080,8 @@ status_t IPCThreadState::talkWithDriver(bool doReceive)
                 mOut.remove(0, bwr.write_consumed);
             else
                 mOut.setDataSize(0);
+            // What is left in mOut has moved, forget the reference run.
+            mRefRunStart = mRefRunEnd = 0;
         }
         if (bwr.read_consumed > 0) {
             mIn.setDataSize(bwr.read_consumed);
@@ -1047,6 +1232,13 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
             ALOG_ASSERT(result == NO_ERROR,
                 "Not enough command data for brTRANSACTION");
             if (result != NO_ERROR) break;
+
+            // Only honour priority requests from system callers; apps must
+            // not be able to push a service thread into real-time.
+            const int rtPriority = ((tr.flags & TF_INHERIT_RT) != 0 &&
+                    tr.sender_euid < AID_APP)
+                    ? (tr.flags & TF_RT_PRIO_MASK) >> TF_RT_PRIO_SHIFT : 0;
+            tr.flags &= ~(TF_INHERIT_RT | TF_RT_PRIO_MASK);
             
             Parcel buffer;
             buffer.ipcSetDataReference(
@@ -1086,6 +1278,8 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
 
             //ALOGI(">>>> TRANSACT from pid %d uid %d\n", mCallingPid, mCallingUid);
 
+            const nsecs_t transactStart = TransactionStats::isEnabled()
+                    ? systemTime(SYSTEM_TIME_MONOTONIC) : 0;
             Parcel reply;
             status_t error;
             IF_LOG_TRANSACTIONS() {
@@ -1105,6 +1299,13 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
                 if (reinterpret_cast<RefBase::weakref_type*>(
                         tr.target.ptr)->attemptIncStrong(this)) {
 
+                    int origPolicy = -1;
+                    struct sched_param origParam;
+                    if (rtPriority > 0 &&
+                            reinterpret_cast<BBinder*>(tr.cookie)->getInheritRtPriority()) {
+                        origPolicy = inheritRtPriority(mMyThreadId, rtPriority, &origParam);
+                    }
+
 #ifdef USE_PROJECT_SEC
                     //ALOGI("SPRD Security begin to judge");
                     bool bFind = doJudge(mCallingUid, reinterpret_cast<BBinder*>(tr.cookie), tr.code, buffer,reply);
@@ -1118,6 +1319,9 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
                     error = reinterpret_cast<BBinder*>(tr.cookie)->transact(tr.code, buffer,
                             &reply, tr.flags);
 #endif
+                    if (origPolicy >= 0) {
+                        sched_setscheduler(mMyThreadId, origPolicy, &origParam);
+                    }
                     reinterpret_cast<BBinder*>(tr.cookie)->decStrong(this);
                 } else {
                     error = UNKNOWN_TRANSACTION;
@@ -1126,6 +1330,11 @@ status_t IPCThreadState::executeCommand(int32_t cmd)
                 error = the_context_object->transact(tr.code, buffer, &reply, tr.flags);
             }
 
+            if (transactStart != 0) {
+                TransactionStats::record(TransactionStats::SERVER, buffer, tr.code,
+                        systemTime(SYSTEM_TIME_MONOTONIC) - transactStart);
+            }
+
             //ALOGI("<<<< TRANSACT from pid %d restore pid %d uid %d\n",
             //     mCallingPid, origPid, origUid);
             
@@ -21,6 +21,7 @@
 #include <utils/Log.h>
 #include <binder/IPCThreadState.h>
 #include <binder/Parcel.h>
+#include <utils/KeyedVector.h>
 #include <utils/String8.h>
 #include <utils/SystemClock.h>
 
@@ -123,43 +124,130 @@ bool checkPermission(const String16& permission, pid_t pid, uid_t uid)
 
 // ----------------------------------------------------------------------
 
+/*
+ * Remembers the remote services found by BpServiceManager, and forgets
+ * them as soon as their process dies so the next lookup asks the service
+ * manager again.
+ */
+class ServiceCache : public IBinder::DeathRecipient
+{
+public:
+    sp<IBinder> lookup(const String16& name)
+    {
+        AutoMutex _l(mLock);
+        ssize_t index = mServices.indexOfKey(name);
+        if (index < 0) return NULL;
+        sp<IBinder> service = mServices.valueAt(index);
+        // The process may be gone with its obituary still on the way.
+        if (!service->isBinderAlive()) {
+            removeLocked(service.get());
+            return NULL;
+        }
+        return service;
+    }
+
+    void add(const String16& name, const sp<IBinder>& service)
+    {
+        // Local binders never send obituaries, and a dead one would never
+        // be evicted.
+        if (service->remoteBinder() == NULL) {
+            return;
+        }
+        AutoMutex _l(mLock);
+        ssize_t index = mServices.indexOfKey(name);
+        if (index >= 0) {
+            if (mServices.valueAt(index) == service) return;
+            // The name now belongs to another binder.
+            sp<IBinder> old = mServices.valueAt(index);
+            mServices.removeItemsAt(index);
+            if (!isCachedLocked(old.get())) {
+                old->unlinkToDeath(this);
+            }
+        }
+        // Link once per binder, however many names or racing lookups found it.
+        if (!isCachedLocked(service.get()) && service->linkToDeath(this) != NO_ERROR) {
+            return;
+        }
+        mServices.add(name, service);
+    }
+
+    virtual void binderDied(const wp<IBinder>& who)
+    {
+        AutoMutex _l(mLock);
+        removeLocked(who.unsafe_get());
+    }
+
+private:
+    bool isCachedLocked(const IBinder* service) const
+    {
+        for (size_t i = 0; i < mServices.size(); i++) {
+            if (mServices.valueAt(i).get() == service) return true;
+        }
+        return false;
+    }
+
+    void removeLocked(const IBinder* service)
+    {
+        for (size_t i = mServices.size(); i > 0; i--) {
+            if (mServices.valueAt(i - 1).get() == service) {
+                mServices.removeItemsAt(i - 1);
+            }
+        }
+    }
+
+    mutable Mutex mLock;
+    KeyedVector<String16, sp<IBinder> > mServices;
+};
+
 class BpServiceManager : public BpInterface<IServiceManager>
 {
 public:
     BpServiceManager(const sp<IBinder>& impl)
-        : BpInterface<IServiceManager>(impl)
+        : BpInterface<IServiceManager>(impl),
+          mCache(new ServiceCache())
     {
     }
 
     virtual sp<IBinder> getService(const String16& name) const
     {
-        unsigned n;
-        for (n = 0; n < 5; n++){
-            sp<IBinder> svc = checkService(name);
+        sp<IBinder> svc = checkService(name);
+        if (svc != NULL) return svc;
+        #ifdef USE_PROJECT_SEC
+            if (!strcmp("security",String8(name).string())) {
+                ALOGI("Waiting for service %s no sleep...\n", String8(name).string());
+                return NULL;
+            }
+        #endif
+        ALOGI("Waiting for service %s...\n", String8(name).string());
+
+        // Most services show up shortly after being asked for at boot, so
+        // poll quickly at first and back off to the old one second period.
+        const int64_t startTime = uptimeMillis();
+        useconds_t delay = GET_SERVICE_MIN_DELAY_US;
+        while (uptimeMillis() - startTime < GET_SERVICE_TIMEOUT_MS) {
+            usleep(delay);
+            svc = checkService(name);
             if (svc != NULL) return svc;
-            #ifndef USE_PROJECT_SEC
-                ALOGI("Waiting for service %s...\n", String8(name).string());
-                sleep(1);
-            #else
-                if (strcmp("security",String8(name).string())) {
-                        ALOGI("Waiting for service %s...\n", String8(name).string());
-                        sleep(1);
-                }else{
-                        ALOGI("Waiting for service %s no sleep...\n", String8(name).string());
-                        break;
-                }
-            #endif
+            delay = delay * 2 < GET_SERVICE_MAX_DELAY_US ?
+                    delay * 2 : GET_SERVICE_MAX_DELAY_US;
         }
         return NULL;
     }
 
     virtual sp<IBinder> checkService( const String16& name) const
     {
+        sp<IBinder> svc = mCache->lookup(name);
+        if (svc != NULL) return svc;
+
         Parcel data, reply;
         data.writeInterfaceToken(IServiceManager::getInterfaceDescriptor());
         data.writeString16(name);
         remote()->transact(CHECK_SERVICE_TRANSACTION, data, &reply);
-        return reply.readStrongBinder();
+        svc = reply.readStrongBinder();
+        if (svc != NULL) {
+            mCache->add(name, svc);
+        }
+        return svc;
     }
 
     virtual status_t addService(const String16& name, const sp<IBinder>& service,
@@ -179,6 +267,12 @@ public:
         Vector<String16> res;
         int n = 0;
 
+        if (listServicesBulk(0, &res, NULL) == NO_ERROR) {
+            return res;
+        }
+
+        // The service manager predates LIST_SERVICES_BULK_TRANSACTION; ask
+        // for the names one at a time.
         for (;;) {
             Parcel data, reply;
             data.writeInterfaceToken(IServiceManager::getInterfaceDescriptor());
@@ -190,10 +284,83 @@ public:
         }
         return res;
     }
+
+    virtual status_t listServicesWithBinders(Vector<String16>* names,
+            Vector<sp<IBinder> >* services)
+    {
+        status_t err = listServicesBulk(LIST_WITH_BINDERS, names, services);
+        if (err != NO_ERROR) {
+            return IServiceManager::listServicesWithBinders(names, services);
+        }
+        for (size_t i = 0; i < names->size(); i++) {
+            if (services->itemAt(i) != NULL) {
+                mCache->add(names->itemAt(i), services->itemAt(i));
+            }
+        }
+        return NO_ERROR;
+    }
+
+private:
+    // Get the names of all services, and the services too if flags has
+    // LIST_WITH_BINDERS, in one transaction.
+    status_t listServicesBulk(uint32_t flags, Vector<String16>* names,
+            Vector<sp<IBinder> >* services)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(IServiceManager::getInterfaceDescriptor());
+        data.writeInt32(flags);
+        status_t err = remote()->transact(LIST_SERVICES_BULK_TRANSACTION, data,
+                &reply);
+        if (err != NO_ERROR) {
+            return err;
+        }
+
+        int32_t n = reply.readInt32();
+        if (n < 0 || size_t(n) > reply.dataAvail() / sizeof(int32_t)) {
+            return BAD_VALUE;
+        }
+        names->clear();
+        names->setCapacity(n);
+        if (flags & LIST_WITH_BINDERS) {
+            services->clear();
+            services->setCapacity(n);
+        }
+        for (int32_t i = 0; i < n; i++) {
+            names->add(reply.readString16());
+            if (flags & LIST_WITH_BINDERS) {
+                sp<IBinder> service;
+                if (reply.readInt32()) {
+                    service = reply.readStrongBinder();
+                }
+                services->add(service);
+            }
+        }
+        return NO_ERROR;
+    }
+
+    enum {
+        GET_SERVICE_TIMEOUT_MS = 5000,
+        GET_SERVICE_MIN_DELAY_US = 10000,
+        GET_SERVICE_MAX_DELAY_US = 1000000,
+    };
+
+    const sp<ServiceCache> mCache;
 };
 
 IMPLEMENT_META_INTERFACE(ServiceManager, "android.os.IServiceManager");
 
+status_t IServiceManager::listServicesWithBinders(Vector<String16>* names,
+        Vector<sp<IBinder> >* services)
+{
+    *names = listServices();
+    services->clear();
+    services->setCapacity(names->size());
+    for (size_t i = 0; i < names->size(); i++) {
+        services->add(checkService(names->itemAt(i)));
+    }
+    return NO_ERROR;
+}
+
 // ----------------------------------------------------------------------
 
 status_t BnServiceManager::onTransact(
@@ -233,6 +400,32 @@ status_t BnServiceManager::onTransact(
             }
             return NO_ERROR;
         } break;
+        case LIST_SERVICES_BULK_TRANSACTION: {
+            CHECK_INTERFACE(IServiceManager, data, reply);
+            bool withBinders = data.readInt32() & LIST_WITH_BINDERS;
+            Vector<String16> list;
+            Vector<sp<IBinder> > services;
+            if (withBinders) {
+                status_t err = listServicesWithBinders(&list, &services);
+                if (err != NO_ERROR) {
+                    return err;
+                }
+            } else {
+                list = listServices();
+            }
+            const size_t N = list.size();
+            reply->writeInt32(N);
+            for (size_t i=0; i<N; i++) {
+                reply->writeString16(list[i]);
+                if (withBinders) {
+                    reply->writeInt32(services[i] != NULL ? 1 : 0);
+                    if (services[i] != NULL) {
+                        reply->writeStrongBinder(services[i]);
+                    }
+                }
+            }
+            return NO_ERROR;
+        } break;
         default:
             return BBinder::onTransact(code, data, reply, flags);
     }
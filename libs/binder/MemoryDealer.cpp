@@ -159,6 +159,61 @@ private:
     size_t              mHeapSize;
 };
 
+/*
+ * Hands out fixed-size chunks carved from slabs that are themselves
+ * allocated from a SimpleBestFitAllocator.  Each size class keeps its slabs,
+ * with a bitmap of free chunks per slab, behind its own lock.  A directory
+ * of slab ranges lets deallocate() find the owning class from an offset.
+ * Slabs stay with their size class once created.
+ */
+class SlabAllocator
+{
+public:
+    SlabAllocator(SimpleBestFitAllocator* backing);
+
+    // Returns NO_MEMORY if size is too large for slabs or no slab could be
+    // obtained, in which case the caller should fall back to best-fit.
+    ssize_t     allocate(size_t size);
+    // Returns NAME_NOT_FOUND if offset does not belong to a slab.
+    status_t    deallocate(size_t offset);
+    void        dump(String8& res) const;
+
+private:
+    enum {
+        MIN_CHUNK_SIZE = 32,    // the best-fit allocator's alignment
+        NUM_SIZE_CLASSES = 8,   // 32 bytes to 4KB
+        CHUNKS_PER_SLAB = 32
+    };
+
+    struct slab_t {
+        size_t      start;
+        uint32_t    freeMask;   // bit i is set when chunk i is free
+    };
+
+    struct size_class_t {
+        mutable Mutex   lock;
+        size_t          chunkSize;
+        Vector<slab_t>  slabs;
+        size_t          hint;   // index of a slab likely to have free chunks
+        size_t          used;   // number of chunks handed out
+    };
+
+    struct slab_range_t {
+        size_t start;
+        size_t end;
+        size_t sizeClass;
+        size_t slab;
+        inline bool operator < (const slab_range_t& o) const {
+            return start < o.start;
+        }
+    };
+
+    SimpleBestFitAllocator* mBacking;
+    size_class_t            mClasses[NUM_SIZE_CLASSES];
+    mutable Mutex           mDirectoryLock;
+    SortedVector<slab_range_t> mDirectory;
+};
+
 // ----------------------------------------------------------------------------
 
 Allocation::Allocation(
@@ -225,21 +280,33 @@ Allocation::~Allocation()
 
 // ----------------------------------------------------------------------------
 
-MemoryDealer::MemoryDealer(size_t size, const char* name, uint32_t flags)
+MemoryDealer::MemoryDealer(size_t size, const char* name, uint32_t flags,
+        uint32_t policy)
     : mHeap(new MemoryHeapBase(size, flags, name)),
-    mAllocator(new SimpleBestFitAllocator(size))
+    mAllocator(new SimpleBestFitAllocator(size)),
+    mSlabAllocator(NULL)
 {    
+    if (policy & POLICY_SLAB) {
+        mSlabAllocator = new SlabAllocator(mAllocator);
+    }
 }
 
 MemoryDealer::~MemoryDealer()
 {
+    delete mSlabAllocator;
     delete mAllocator;
 }
 
 sp<IMemory> MemoryDealer::allocate(size_t size)
 {
     sp<IMemory> memory;
-    const ssize_t offset = allocator()->allocate(size);
+    ssize_t offset = NO_MEMORY;
+    if (mSlabAllocator && size) {
+        offset = mSlabAllocator->allocate(size);
+    }
+    if (offset < 0) {
+        offset = allocator()->allocate(size);
+    }
     if (offset >= 0) {
         memory = new Allocation(this, heap(), offset, size);
     }
@@ -248,12 +315,20 @@ sp<IMemory> MemoryDealer::allocate(size_t size)
 
 void MemoryDealer::deallocate(size_t offset)
 {
+    if (mSlabAllocator && mSlabAllocator->deallocate(offset) == NO_ERROR) {
+        return;
+    }
     allocator()->deallocate(offset);
 }
 
 void MemoryDealer::dump(const char* what) const
 {
     allocator()->dump(what);
+    if (mSlabAllocator) {
+        String8 result;
+        mSlabAllocator->dump(result);
+        ALOGD("%s", result.string());
+    }
 }
 
 const sp<IMemoryHeap>& MemoryDealer::heap() const {
@@ -429,6 +504,9 @@ void SimpleBestFitAllocator::dump_l(String8& result,
         const char* what) const
 {
     size_t size = 0;
+    size_t freeSize = 0;
+    size_t freeChunks = 0;
+    size_t largestFree = 0;
     int32_t i = 0;
     chunk_t const* cur = mList.head();
     
@@ -453,8 +531,16 @@ void SimpleBestFitAllocator::dump_l(String8& result,
         
         result.append(buffer);
 
-        if (!cur->free)
+        if (!cur->free) {
             size += cur->size*kMemoryAlign;
+        } else {
+            const size_t chunkSize = cur->size*kMemoryAlign;
+            freeSize += chunkSize;
+            freeChunks++;
+            if (chunkSize > largestFree) {
+                largestFree = chunkSize;
+            }
+        }
 
         i++;
         cur = cur->next;
@@ -462,6 +548,134 @@ void SimpleBestFitAllocator::dump_l(String8& result,
     snprintf(buffer, SIZE,
             "  size allocated: %u (%u KB)\n", int(size), int(size/1024));
     result.append(buffer);
+
+    // Share of the free space that cannot be handed out in one allocation.
+    snprintf(buffer, SIZE,
+            "  free: %u bytes in %u chunks, largest %u, fragmentation %u%%\n",
+            int(freeSize), int(freeChunks), int(largestFree),
+            freeSize ? int(100 - (largestFree * 100) / freeSize) : 0);
+    result.append(buffer);
+}
+
+// ----------------------------------------------------------------------------
+
+SlabAllocator::SlabAllocator(SimpleBestFitAllocator* backing)
+    : mBacking(backing)
+{
+    for (size_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        mClasses[i].chunkSize = size_t(MIN_CHUNK_SIZE) << i;
+        mClasses[i].hint = 0;
+        mClasses[i].used = 0;
+    }
+}
+
+ssize_t SlabAllocator::allocate(size_t size)
+{
+    size_t sizeClass = 0;
+    while ((size_t(MIN_CHUNK_SIZE) << sizeClass) < size) {
+        if (++sizeClass >= NUM_SIZE_CLASSES) {
+            return NO_MEMORY;
+        }
+    }
+
+    size_class_t& cls(mClasses[sizeClass]);
+    Mutex::Autolock _l(cls.lock);
+
+    const size_t N = cls.slabs.size();
+    for (size_t n = 0; n < N; n++) {
+        const size_t i = (cls.hint + n) % N;
+        slab_t& slab(cls.slabs.editItemAt(i));
+        if (slab.freeMask) {
+            const int chunk = __builtin_ctz(slab.freeMask);
+            slab.freeMask &= ~(1u << chunk);
+            cls.hint = i;
+            cls.used++;
+            return slab.start + chunk * cls.chunkSize;
+        }
+    }
+
+    // Every slab of this class is full, get a new one.
+    const size_t slabSize = cls.chunkSize * CHUNKS_PER_SLAB;
+    const ssize_t start = mBacking->allocate(slabSize);
+    if (start < 0) {
+        return NO_MEMORY;
+    }
+
+    slab_t slab;
+    slab.start = start;
+    slab.freeMask = ~1u;    // chunk 0 is returned right away
+    const ssize_t index = cls.slabs.add(slab);
+    if (index < 0) {
+        mBacking->deallocate(start);
+        return NO_MEMORY;
+    }
+
+    slab_range_t range;
+    range.start = start;
+    range.end = start + slabSize;
+    range.sizeClass = sizeClass;
+    range.slab = index;
+    {
+        Mutex::Autolock _d(mDirectoryLock);
+        mDirectory.add(range);
+    }
+
+    cls.hint = index;
+    cls.used++;
+    return start;
+}
+
+status_t SlabAllocator::deallocate(size_t offset)
+{
+    slab_range_t range;
+    {
+        Mutex::Autolock _d(mDirectoryLock);
+        // find the last slab starting at or before offset
+        ssize_t lo = 0;
+        ssize_t hi = ssize_t(mDirectory.size()) - 1;
+        ssize_t found = -1;
+        while (lo <= hi) {
+            const ssize_t mid = (lo + hi) / 2;
+            if (mDirectory.itemAt(mid).start <= offset) {
+                found = mid;
+                lo = mid + 1;
+            } else {
+                hi = mid - 1;
+            }
+        }
+        if (found < 0 || offset >= mDirectory.itemAt(found).end) {
+            return NAME_NOT_FOUND;
+        }
+        range = mDirectory.itemAt(found);
+    }
+
+    size_class_t& cls(mClasses[range.sizeClass]);
+    Mutex::Autolock _l(cls.lock);
+    slab_t& slab(cls.slabs.editItemAt(range.slab));
+    const size_t chunk = (offset - slab.start) / cls.chunkSize;
+    LOG_FATAL_IF(slab.freeMask & (1u << chunk),
+            "chunk at offset 0x%08zX of size 0x%08zX already freed",
+            offset, cls.chunkSize);
+    slab.freeMask |= 1u << chunk;
+    cls.hint = range.slab;
+    cls.used--;
+    return NO_ERROR;
+}
+
+void SlabAllocator::dump(String8& result) const
+{
+    result.append("  slabs:\n");
+    for (size_t i = 0; i < NUM_SIZE_CLASSES; i++) {
+        const size_class_t& cls(mClasses[i]);
+        Mutex::Autolock _l(cls.lock);
+        if (cls.slabs.isEmpty()) {
+            continue;
+        }
+        const size_t total = cls.slabs.size() * CHUNKS_PER_SLAB;
+        result.appendFormat("  %5zu bytes: %zu slabs, %zu/%zu chunks used (%zu%%)\n",
+                cls.chunkSize, cls.slabs.size(), cls.used, total,
+                (cls.used * 100) / total);
+    }
 }
 
 
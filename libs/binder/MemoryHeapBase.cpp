@@ -110,8 +110,12 @@ status_t MemoryHeapBase::mapfd(int fd, size_t size, uint32_t offset)
     }
 
     if ((mFlags & DONT_MAP_LOCALLY) == 0) {
+        int mapFlags = MAP_SHARED;
+        if (mFlags & POPULATE) {
+            mapFlags |= MAP_POPULATE;
+        }
         void* base = (uint8_t*)mmap(0, size,
-                PROT_READ|PROT_WRITE, MAP_SHARED, fd, offset);
+                PROT_READ|PROT_WRITE, mapFlags, fd, offset);
         if (base == MAP_FAILED) {
             ALOGE("mmap(fd=%d, size=%u) failed (%s)",
                     fd, uint32_t(size), strerror(errno));
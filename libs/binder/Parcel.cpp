@@ -37,11 +37,13 @@
 #include <private/binder/binder_module.h>
 #include <private/binder/Static.h>
 
+#include <atomic>
 #include <inttypes.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <sys/mman.h>
+#include <unistd.h>
 
 #ifndef INT32_MAX
 #define INT32_MAX ((int32_t)(2147483647))
@@ -89,6 +91,174 @@ static size_t gParcelGlobalAllocCount = 0;
 // Maximum size of a blob to transfer in-place.
 static const size_t BLOB_INPLACE_LIMIT = 16 * 1024;
 
+// Parcels whose capacity reaches this size keep their data in an anonymous
+// mapping instead of the heap.  The binder driver needs the data to be one
+// contiguous buffer, so growing a large Parcel is done with mremap(), which
+// moves pages rather than copying the whole buffer like realloc() would.
+static const size_t PARCEL_MMAP_THRESHOLD = 128 * 1024;
+
+static inline bool isMappedCapacity(size_t capacity) {
+    return capacity >= PARCEL_MMAP_THRESHOLD;
+}
+
+// Small Parcels start out with a buffer of this size taken from a per-thread
+// free list, so the common short transaction (and its reply) neither goes
+// through malloc() nor reallocs its way up from a few bytes.
+static const size_t PARCEL_POOL_BUFFER_SIZE = 1024;
+static const size_t PARCEL_POOL_MAX_BUFFERS = 8;
+
+// Hits and misses are only written by the pool's own thread, and summed
+// over all the live pools by getPoolHitCount()/getPoolMissCount(), so that
+// the fast path never touches a shared cache line.
+struct parcel_pool {
+    size_t count;
+    uint8_t* buffers[PARCEL_POOL_MAX_BUFFERS];
+    std::atomic<size_t> hits;
+    std::atomic<size_t> misses;
+    parcel_pool* prev;
+    parcel_pool* next;
+};
+
+static pthread_once_t gParcelPoolOnce = PTHREAD_ONCE_INIT;
+static pthread_key_t gParcelPoolKey;
+static pthread_mutex_t gParcelPoolListLock = PTHREAD_MUTEX_INITIALIZER;
+static parcel_pool* gParcelPools = NULL;
+// Counts of the threads that have exited.
+static size_t gParcelPoolExitedHits = 0;
+static size_t gParcelPoolExitedMisses = 0;
+
+static inline void bumpParcelPoolCounter(std::atomic<size_t>& counter)
+{
+    counter.store(counter.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+}
+
+// Runs at thread exit: frees the pooled buffers and keeps the thread's counts.
+static void destroyParcelPool(void* st)
+{
+    parcel_pool* pool = reinterpret_cast<parcel_pool*>(st);
+    for (size_t i = 0; i < pool->count; i++) {
+        free(pool->buffers[i]);
+    }
+    pthread_mutex_lock(&gParcelPoolListLock);
+    gParcelPoolExitedHits += pool->hits.load(std::memory_order_relaxed);
+    gParcelPoolExitedMisses += pool->misses.load(std::memory_order_relaxed);
+    if (pool->prev) pool->prev->next = pool->next;
+    else gParcelPools = pool->next;
+    if (pool->next) pool->next->prev = pool->prev;
+    pthread_mutex_unlock(&gParcelPoolListLock);
+    delete pool;
+}
+
+static void createParcelPoolKey()
+{
+    pthread_key_create(&gParcelPoolKey, destroyParcelPool);
+}
+
+static parcel_pool* getParcelPool()
+{
+    pthread_once(&gParcelPoolOnce, createParcelPoolKey);
+    parcel_pool* pool = reinterpret_cast<parcel_pool*>(pthread_getspecific(gParcelPoolKey));
+    if (pool == NULL) {
+        pool = new parcel_pool;
+        pool->count = 0;
+        pool->hits.store(0, std::memory_order_relaxed);
+        pool->misses.store(0, std::memory_order_relaxed);
+        pool->prev = NULL;
+        pthread_mutex_lock(&gParcelPoolListLock);
+        pool->next = gParcelPools;
+        if (gParcelPools) gParcelPools->prev = pool;
+        gParcelPools = pool;
+        pthread_mutex_unlock(&gParcelPoolListLock);
+        pthread_setspecific(gParcelPoolKey, pool);
+    }
+    return pool;
+}
+
+static uint8_t* allocPooledParcelData()
+{
+    parcel_pool* pool = getParcelPool();
+    if (pool->count > 0) {
+        bumpParcelPoolCounter(pool->hits);
+        return pool->buffers[--pool->count];
+    }
+    bumpParcelPoolCounter(pool->misses);
+    return (uint8_t*)malloc(PARCEL_POOL_BUFFER_SIZE);
+}
+
+static void freePooledParcelData(uint8_t* data)
+{
+    parcel_pool* pool = getParcelPool();
+    if (pool->count < PARCEL_POOL_MAX_BUFFERS) {
+        pool->buffers[pool->count++] = data;
+    } else {
+        free(data);
+    }
+}
+
+// Resizes a Parcel data buffer of the given capacity, preserving its
+// contents up to the smaller of the two sizes.  On success the new capacity
+// (which may be rounded up to a page multiple) is returned in outCapacity.
+// On failure NULL is returned and the original buffer is left untouched.
+static uint8_t* reallocParcelData(uint8_t* data, size_t capacity, size_t desired,
+        size_t* outCapacity)
+{
+    const bool wasMapped = data != NULL && isMappedCapacity(capacity);
+
+    if (data == NULL && desired <= PARCEL_POOL_BUFFER_SIZE) {
+        uint8_t* pooled = allocPooledParcelData();
+        if (pooled) *outCapacity = PARCEL_POOL_BUFFER_SIZE;
+        return pooled;
+    }
+
+    if (!isMappedCapacity(desired)) {
+        if (!wasMapped) {
+            uint8_t* heap = (uint8_t*)realloc(data, desired);
+            if (heap) *outCapacity = desired;
+            return heap;
+        }
+        uint8_t* heap = (uint8_t*)malloc(desired);
+        if (heap) {
+            memcpy(heap, data, desired);
+            ::munmap(data, capacity);
+            *outCapacity = desired;
+        }
+        return heap;
+    }
+
+    const size_t pageSize = getpagesize();
+    if (desired > SIZE_T_MAX - pageSize) {
+        return NULL;
+    }
+    const size_t mapped = (desired + pageSize - 1) & ~(pageSize - 1);
+
+    void* ptr;
+    if (wasMapped) {
+        ptr = ::mremap(data, capacity, mapped, MREMAP_MAYMOVE);
+        if (ptr == MAP_FAILED) return NULL;
+    } else {
+        ptr = ::mmap(NULL, mapped, PROT_READ | PROT_WRITE,
+                MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (ptr == MAP_FAILED) return NULL;
+        if (data) {
+            memcpy(ptr, data, capacity < desired ? capacity : desired);
+            free(data);
+        }
+    }
+    *outCapacity = mapped;
+    return (uint8_t*)ptr;
+}
+
+static void freeParcelData(uint8_t* data, size_t capacity)
+{
+    if (isMappedCapacity(capacity)) {
+        ::munmap(data, capacity);
+    } else if (capacity == PARCEL_POOL_BUFFER_SIZE) {
+        freePooledParcelData(data);
+    } else {
+        free(data);
+    }
+}
+
 enum {
     BLOB_INPLACE = 0,
     BLOB_ASHMEM_IMMUTABLE = 1,
@@ -338,6 +508,26 @@ size_t Parcel::getGlobalAllocCount() {
     return count;
 }
 
+size_t Parcel::getPoolHitCount() {
+    pthread_mutex_lock(&gParcelPoolListLock);
+    size_t hits = gParcelPoolExitedHits;
+    for (parcel_pool* pool = gParcelPools; pool != NULL; pool = pool->next) {
+        hits += pool->hits.load(std::memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&gParcelPoolListLock);
+    return hits;
+}
+
+size_t Parcel::getPoolMissCount() {
+    pthread_mutex_lock(&gParcelPoolListLock);
+    size_t misses = gParcelPoolExitedMisses;
+    for (parcel_pool* pool = gParcelPools; pool != NULL; pool = pool->next) {
+        misses += pool->misses.load(std::memory_order_relaxed);
+    }
+    pthread_mutex_unlock(&gParcelPoolListLock);
+    return misses;
+}
+
 const uint8_t* Parcel::data() const
 {
     return mData;
@@ -581,12 +771,17 @@ bool Parcel::enforceInterface(const String16& interface,
     } else {
       threadState->setStrictModePolicy(strictPolicy);
     }
-    const String16 str(readString16());
-    if (str == interface) {
+    // Compare the token in place; this runs on every incoming transaction
+    // and building a String16 from it would cost a heap allocation.
+    size_t len;
+    const char16_t* str = readString16Inplace(&len);
+    if (str != NULL && len == interface.size() &&
+            memcmp(str, interface.string(), len * sizeof(char16_t)) == 0) {
         return true;
     } else {
         ALOGW("**** enforceInterface() expected '%s' but read '%s'",
-                String8(interface).string(), String8(str).string());
+                String8(interface).string(),
+                str ? String8(str, len).string() : "");
         return false;
     }
 }
@@ -919,6 +1114,9 @@ status_t Parcel::writeBlob(size_t len, bool mutableCopy, WritableBlob* outBlob)
         return NO_ERROR;
     }
 
+    // Every blob gets a region of its own. The receiver keeps the fd and
+    // its mapping for as long as it likes, and an immutable region can't be
+    // made writable again, so a region can't safely be handed out twice.
     ALOGV("writeBlob: write to ashmem");
     int fd = ashmem_create_region("Parcel Blob", len);
     if (fd < 0) return NO_MEMORY;
@@ -1054,9 +1252,23 @@ status_t Parcel::writeNoException()
     return writeInt32(0);
 }
 
-void Parcel::remove(size_t /*start*/, size_t /*amt*/)
+void Parcel::remove(size_t start, size_t amt)
 {
-    LOG_ALWAYS_FATAL("Parcel::remove() not yet implemented!");
+    // Only plain data can be removed; this is what IPCThreadState needs when
+    // the driver consumes just part of a batch of queued commands.
+    if (mObjectsSize != 0 || mOwner != NULL
+            || start > mDataSize || amt > mDataSize - start) {
+        LOG_ALWAYS_FATAL("Parcel::remove() not supported for this parcel!");
+    }
+
+    memmove(mData + start, mData + start + amt, mDataSize - start - amt);
+    mDataSize -= amt;
+    if (mDataPos >= start + amt) {
+        mDataPos -= amt;
+    } else if (mDataPos > start) {
+        mDataPos = start;
+    }
+    ALOGV("remove Setting data size of %p to %zu", this, mDataSize);
 }
 
 status_t Parcel::read(void* outData, size_t len) const
@@ -1654,7 +1866,7 @@ void Parcel::freeDataNoInit()
             gParcelGlobalAllocSize -= mDataCapacity;
             gParcelGlobalAllocCount--;
             pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
-            free(mData);
+            freeParcelData(mData, mDataCapacity);
         }
         if (mObjects) free(mObjects);
     }
@@ -1687,7 +1899,8 @@ status_t Parcel::restartWrite(size_t desired)
         return continueWrite(desired);
     }
 
-    uint8_t* data = (uint8_t*)realloc(mData, desired);
+    size_t capacity = desired;
+    uint8_t* data = reallocParcelData(mData, mDataCapacity, desired, &capacity);
     if (!data && desired > mDataCapacity) {
         mError = NO_MEMORY;
         return NO_MEMORY;
@@ -1696,13 +1909,13 @@ status_t Parcel::restartWrite(size_t desired)
     releaseObjects();
 
     if (data) {
-        LOG_ALLOC("Parcel %p: restart from %zu to %zu capacity", this, mDataCapacity, desired);
+        LOG_ALLOC("Parcel %p: restart from %zu to %zu capacity", this, mDataCapacity, capacity);
         pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
-        gParcelGlobalAllocSize += desired;
+        gParcelGlobalAllocSize += capacity;
         gParcelGlobalAllocSize -= mDataCapacity;
         pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
         mData = data;
-        mDataCapacity = desired;
+        mDataCapacity = capacity;
     }
 
     mDataSize = mDataPos = 0;
@@ -1752,7 +1965,8 @@ status_t Parcel::continueWrite(size_t desired)
 
         // If there is a different owner, we need to take
         // posession.
-        uint8_t* data = (uint8_t*)malloc(desired);
+        size_t capacity = desired;
+        uint8_t* data = reallocParcelData(NULL, 0, desired, &capacity);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
@@ -1762,7 +1976,7 @@ status_t Parcel::continueWrite(size_t desired)
         if (objectsSize) {
             objects = (binder_size_t*)calloc(objectsSize, sizeof(binder_size_t));
             if (!objects) {
-                free(data);
+                freeParcelData(data, capacity);
 
                 mError = NO_MEMORY;
                 return NO_MEMORY;
@@ -1786,9 +2000,9 @@ status_t Parcel::continueWrite(size_t desired)
         mOwner(this, mData, mDataSize, mObjects, mObjectsSize, mOwnerCookie);
         mOwner = NULL;
 
-        LOG_ALLOC("Parcel %p: taking ownership of %zu capacity", this, desired);
+        LOG_ALLOC("Parcel %p: taking ownership of %zu capacity", this, capacity);
         pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
-        gParcelGlobalAllocSize += desired;
+        gParcelGlobalAllocSize += capacity;
         gParcelGlobalAllocCount++;
         pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
 
@@ -1796,7 +2010,7 @@ status_t Parcel::continueWrite(size_t desired)
         mObjects = objects;
         mDataSize = (mDataSize < desired) ? mDataSize : desired;
         ALOGV("continueWrite Setting data size of %p to %zu", this, mDataSize);
-        mDataCapacity = desired;
+        mDataCapacity = capacity;
         mObjectsSize = mObjectsCapacity = objectsSize;
         mNextObjectHint = 0;
 
@@ -1822,18 +2036,20 @@ status_t Parcel::continueWrite(size_t desired)
             mNextObjectHint = 0;
         }
 
-        // We own the data, so we can just do a realloc().
+        // We own the data, so we can just do a realloc() (or an mremap()
+        // for large buffers, which avoids copying them).
         if (desired > mDataCapacity) {
-            uint8_t* data = (uint8_t*)realloc(mData, desired);
+            size_t capacity = desired;
+            uint8_t* data = reallocParcelData(mData, mDataCapacity, desired, &capacity);
             if (data) {
                 LOG_ALLOC("Parcel %p: continue from %zu to %zu capacity", this, mDataCapacity,
-                        desired);
+                        capacity);
                 pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
-                gParcelGlobalAllocSize += desired;
+                gParcelGlobalAllocSize += capacity;
                 gParcelGlobalAllocSize -= mDataCapacity;
                 pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
                 mData = data;
-                mDataCapacity = desired;
+                mDataCapacity = capacity;
             } else if (desired > mDataCapacity) {
                 mError = NO_MEMORY;
                 return NO_MEMORY;
@@ -1851,7 +2067,8 @@ status_t Parcel::continueWrite(size_t desired)
 
     } else {
         // This is the first data.  Easy!
-        uint8_t* data = (uint8_t*)malloc(desired);
+        size_t capacity = desired;
+        uint8_t* data = reallocParcelData(NULL, 0, desired, &capacity);
         if (!data) {
             mError = NO_MEMORY;
             return NO_MEMORY;
@@ -1862,9 +2079,9 @@ status_t Parcel::continueWrite(size_t desired)
             ALOGE("continueWrite: %zu/%p/%zu/%zu", mDataCapacity, mObjects, mObjectsCapacity, desired);
         }
 
-        LOG_ALLOC("Parcel %p: allocating with %zu capacity", this, desired);
+        LOG_ALLOC("Parcel %p: allocating with %zu capacity", this, capacity);
         pthread_mutex_lock(&gParcelGlobalAllocSizeLock);
-        gParcelGlobalAllocSize += desired;
+        gParcelGlobalAllocSize += capacity;
         gParcelGlobalAllocCount++;
         pthread_mutex_unlock(&gParcelGlobalAllocSizeLock);
 
@@ -1872,7 +2089,7 @@ status_t Parcel::continueWrite(size_t desired)
         mDataSize = mDataPos = 0;
         ALOGV("continueWrite Setting data size of %p to %zu", this, mDataSize);
         ALOGV("continueWrite Setting data pos of %p to %zu", this, mDataPos);
-        mDataCapacity = desired;
+        mDataCapacity = capacity;
     }
 
     return NO_ERROR;
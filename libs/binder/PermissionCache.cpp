@@ -17,6 +17,8 @@
 #define LOG_TAG "PermissionCache"
 
 #include <stdint.h>
+#include <utils/Atomic.h>
+#include <utils/JenkinsHash.h>
 #include <utils/Log.h>
 #include <binder/IPCThreadState.h>
 #include <binder/IServiceManager.h>
@@ -29,49 +31,114 @@ namespace android {
 
 ANDROID_SINGLETON_STATIC_INSTANCE(PermissionCache) ;
 
+// how long a permission check is trusted for, so that permission changes
+// we aren't told about are eventually picked up.
+static const nsecs_t TIME_TO_LIVE = s2ns(5 * 60);
+
+static uint32_t hashOf(const String16& permission, uid_t uid) {
+    uint32_t hash = JenkinsHashMixBytes(0,
+            reinterpret_cast<const uint8_t*>(permission.string()),
+            permission.size() * sizeof(char16_t));
+    hash = JenkinsHashMix(hash, uint32_t(uid));
+    return JenkinsHashWhiten(hash);
+}
+
 // ----------------------------------------------------------------------------
 
-PermissionCache::PermissionCache() {
+PermissionCache::PermissionCache()
+    : mHits(0), mMisses(0), mExpired(0), mEvictions(0) {
 }
 
 status_t PermissionCache::check(bool* granted,
         const String16& permission, uid_t uid) const {
-    Mutex::Autolock _l(mLock);
-    Entry e;
-    e.name = permission;
-    e.uid  = uid;
-    ssize_t index = mCache.indexOf(e);
-    if (index >= 0) {
-        *granted = mCache.itemAt(index).granted;
-        return NO_ERROR;
+    const uint32_t hash = hashOf(permission, uid);
+    const Shard& shard(mShards[hash % NUM_SHARDS]);
+    const nsecs_t now = systemTime();
+    Mutex::Autolock _l(shard.lock);
+    const size_t count = shard.entries.size();
+    for (size_t i=0 ; i<count ; i++) {
+        const Entry& e(shard.entries[i]);
+        if (e.hash == hash && e.uid == uid && e.name == permission) {
+            if (now - e.time > TIME_TO_LIVE) {
+                // cache() will refresh it
+                android_atomic_inc(&mExpired);
+                return NAME_NOT_FOUND;
+            }
+            android_atomic_inc(&mHits);
+            *granted = e.granted;
+            return NO_ERROR;
+        }
     }
+    android_atomic_inc(&mMisses);
     return NAME_NOT_FOUND;
 }
 
 void PermissionCache::cache(const String16& permission,
         uid_t uid, bool granted) {
-    Mutex::Autolock _l(mLock);
     Entry e;
-    ssize_t index = mPermissionNamesPool.indexOf(permission);
-    if (index > 0) {
-        e.name = mPermissionNamesPool.itemAt(index);
-    } else {
-        mPermissionNamesPool.add(permission);
-        e.name = permission;
+    {
+        Mutex::Autolock _l(mLock);
+        ssize_t index = mPermissionNamesPool.indexOf(permission);
+        if (index >= 0) {
+            e.name = mPermissionNamesPool.itemAt(index);
+        } else {
+            mPermissionNamesPool.add(permission);
+            e.name = permission;
+        }
     }
     // note, we don't need to store the pid, which is not actually used in
     // permission checks
     e.uid  = uid;
+    e.hash = hashOf(permission, uid);
     e.granted = granted;
-    index = mCache.indexOf(e);
-    if (index < 0) {
-        mCache.add(e);
+    e.time = systemTime();
+
+    Shard& shard(mShards[e.hash % NUM_SHARDS]);
+    Mutex::Autolock _l(shard.lock);
+    const size_t count = shard.entries.size();
+    size_t oldest = 0;
+    for (size_t i=0 ; i<count ; i++) {
+        Entry& cur(shard.entries.editItemAt(i));
+        if (cur.hash == e.hash && cur.uid == uid && cur.name == permission) {
+            cur.granted = granted;
+            cur.time = e.time;
+            return;
+        }
+        if (cur.time < shard.entries[oldest].time) {
+            oldest = i;
+        }
     }
+    if (count >= size_t(MAX_ENTRIES_PER_SHARD)) {
+        shard.entries.removeAt(oldest);
+        android_atomic_inc(&mEvictions);
+    }
+    shard.entries.add(e);
 }
 
 void PermissionCache::purge() {
-    Mutex::Autolock _l(mLock);
-    mCache.clear();
+    for (size_t i=0 ; i<size_t(NUM_SHARDS) ; i++) {
+        Mutex::Autolock _l(mShards[i].lock);
+        mShards[i].entries.clear();
+    }
+}
+
+void PermissionCache::dump(String8& result) {
+    PermissionCache& pc(PermissionCache::getInstance());
+    size_t entries = 0;
+    for (size_t i=0 ; i<size_t(NUM_SHARDS) ; i++) {
+        Mutex::Autolock _l(pc.mShards[i].lock);
+        entries += pc.mShards[i].entries.size();
+    }
+    const int32_t hits = android_atomic_acquire_load(&pc.mHits);
+    const int32_t lookups = hits
+            + android_atomic_acquire_load(&pc.mMisses)
+            + android_atomic_acquire_load(&pc.mExpired);
+    result.appendFormat("PermissionCache: %zu entries (max %d), "
+            "%d lookups, %.1f%% hits, %d expired, %d evicted\n",
+            entries, NUM_SHARDS * MAX_ENTRIES_PER_SHARD, lookups,
+            lookups ? 100.0 * hits / lookups : 0.0,
+            android_atomic_acquire_load(&pc.mExpired),
+            android_atomic_acquire_load(&pc.mEvictions));
 }
 
 bool PermissionCache::checkCallingPermission(const String16& permission) {
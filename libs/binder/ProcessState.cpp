@@ -26,6 +26,7 @@
 #include <utils/Log.h>
 #include <utils/String8.h>
 #include <binder/IServiceManager.h>
+#include <binder/TransactionStats.h>
 #include <utils/String8.h>
 #include <utils/threads.h>
 
@@ -135,6 +136,19 @@ void ProcessState::startThreadPool()
     if (!mThreadPoolStarted) {
         mThreadPoolStarted = true;
         spawnPooledThread(true);
+        mMinThreadsStarted = 1;
+        spawnMinPooledThreadsLocked();
+    }
+}
+
+void ProcessState::spawnMinPooledThreadsLocked()
+{
+    // These threads enter the looper on their own (like the main one)
+    // rather than being requested by the driver, so they do not count
+    // against the driver's maximum.
+    while (mMinThreadsStarted < mMinThreads) {
+        spawnPooledThread(true);
+        mMinThreadsStarted++;
     }
 }
 
@@ -165,22 +179,24 @@ bool ProcessState::becomeContextManager(context_check_func checkFunc, void* user
 
 ProcessState::handle_entry* ProcessState::lookupHandleLocked(int32_t handle)
 {
-    const size_t N=mHandleToObject.size();
-    if (N <= (size_t)handle) {
+    Vector<handle_entry>& entries = shardForHandle(handle).entries;
+    const size_t index = uint32_t(handle) / HANDLE_SHARD_COUNT;
+    const size_t N=entries.size();
+    if (N <= index) {
         handle_entry e;
         e.binder = NULL;
         e.refs = NULL;
-        status_t err = mHandleToObject.insertAt(e, N, handle+1-N);
+        status_t err = entries.insertAt(e, N, index+1-N);
         if (err < NO_ERROR) return NULL;
     }
-    return &mHandleToObject.editItemAt(handle);
+    return &entries.editItemAt(index);
 }
 
 sp<IBinder> ProcessState::getStrongProxyForHandle(int32_t handle)
 {
     sp<IBinder> result;
 
-    AutoMutex _l(mLock);
+    AutoMutex _l(shardForHandle(handle).lock);
 
     handle_entry* e = lookupHandleLocked(handle);
 
@@ -237,7 +253,7 @@ wp<IBinder> ProcessState::getWeakProxyForHandle(int32_t handle)
 {
     wp<IBinder> result;
 
-    AutoMutex _l(mLock);
+    AutoMutex _l(shardForHandle(handle).lock);
 
     handle_entry* e = lookupHandleLocked(handle);
 
@@ -245,7 +261,7 @@ wp<IBinder> ProcessState::getWeakProxyForHandle(int32_t handle)
         // We need to create a new BpBinder if there isn't currently one, OR we
         // are unable to acquire a weak reference on this current one.  The
         // attemptIncWeak() is safe because we know the BpBinder destructor will always
-        // call expungeHandle(), which acquires the same lock we are holding now.
+        // call expungeHandle(), which acquires the same shard lock we are holding now.
         // We need to do this because there is a race condition between someone
         // releasing a reference on this BpBinder, and a new reference on its handle
         // arriving from the driver.
@@ -266,7 +282,7 @@ wp<IBinder> ProcessState::getWeakProxyForHandle(int32_t handle)
 
 void ProcessState::expungeHandle(int32_t handle, IBinder* binder)
 {
-    AutoMutex _l(mLock);
+    AutoMutex _l(shardForHandle(handle).lock);
     
     handle_entry* e = lookupHandleLocked(handle);
 
@@ -304,6 +320,22 @@ status_t ProcessState::setThreadPoolMaxThreadCount(size_t maxThreads) {
     return result;
 }
 
+status_t ProcessState::setThreadPoolMinThreadCount(size_t minThreads) {
+    AutoMutex _l(mLock);
+    mMinThreads = minThreads;
+    if (mThreadPoolStarted) {
+        spawnMinPooledThreadsLocked();
+    }
+    return NO_ERROR;
+}
+
+size_t ProcessState::getThreadPoolPeakExecutingCount() {
+    pthread_mutex_lock(&mThreadCountLock);
+    size_t peak = mPeakExecutingThreadsCount;
+    pthread_mutex_unlock(&mThreadCountLock);
+    return peak;
+}
+
 void ProcessState::giveThreadPoolName() {
     androidSetThreadName( makeBinderThreadName().string() );
 }
@@ -343,10 +375,13 @@ ProcessState::ProcessState()
     , mThreadCountDecrement(PTHREAD_COND_INITIALIZER)
     , mExecutingThreadsCount(0)
     , mMaxThreads(DEFAULT_MAX_BINDER_THREADS)
+    , mPeakExecutingThreadsCount(0)
     , mManagesContexts(false)
     , mBinderContextCheckFunc(NULL)
     , mBinderContextUserData(NULL)
     , mThreadPoolStarted(false)
+    , mMinThreads(1)
+    , mMinThreadsStarted(0)
     , mThreadPoolSeq(1)
 {
     if (mDriverFD >= 0) {
@@ -368,6 +403,8 @@ ProcessState::ProcessState()
     }
 
     LOG_ALWAYS_FATAL_IF(mDriverFD < 0, "Binder driver could not be opened.  Terminating.");
+
+    TransactionStats::initialize();
 }
 
 ProcessState::~ProcessState()
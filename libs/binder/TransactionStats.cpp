@@ -0,0 +1,209 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TransactionStats"
+#define ATRACE_TAG ATRACE_TAG_ALWAYS
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include <binder/IPCThreadState.h>
+#include <binder/Parcel.h>
+#include <binder/TransactionStats.h>
+
+#include <cutils/properties.h>
+#include <utils/Log.h>
+#include <utils/Trace.h>
+
+#include <private/android_filesystem_config.h>
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+ANDROID_SINGLETON_STATIC_INSTANCE(TransactionStats) ;
+
+volatile bool TransactionStats::sEnabled = false;
+
+// FNV-1a over the UTF-16 descriptor; collisions only merge two histograms.
+static uint32_t hashDescriptor(const char16_t* str, size_t len) {
+    uint32_t hash = 2166136261u;
+    for (size_t i = 0; i < len; i++) {
+        hash = (hash ^ str[i]) * 16777619u;
+    }
+    return hash;
+}
+
+static const char16_t* peekInterfaceDescriptor(const Parcel& data, size_t* outLen) {
+    const size_t pos = data.dataPosition();
+    const char16_t* descriptor = NULL;
+    int32_t strictPolicy;
+    data.setDataPosition(0);
+    if (data.readInt32(&strictPolicy) == NO_ERROR) {
+        descriptor = data.readString16Inplace(outLen);
+    }
+    data.setDataPosition(pos);
+    return descriptor;
+}
+
+static size_t bucketFor(nsecs_t duration) {
+    nsecs_t us = ns2us(duration) >> 4;
+    size_t bucket = 0;
+    while (us > 0 && bucket < TransactionStats::NUM_BUCKETS - 1) {
+        us >>= 1;
+        bucket++;
+    }
+    return bucket;
+}
+
+// ----------------------------------------------------------------------------
+
+TransactionStats::TransactionStats() {
+}
+
+void TransactionStats::initialize() {
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.binder.stats", value, "0");
+    if (atoi(value) != 0) {
+        setEnabled(true);
+    }
+}
+
+void TransactionStats::setEnabled(bool enabled) {
+    // Make sure the singleton exists before the first record().
+    getInstance();
+    sEnabled = enabled;
+}
+
+void TransactionStats::record(side_t side, const Parcel& data, uint32_t code,
+        nsecs_t duration) {
+    size_t len = 0;
+    const char16_t* descriptor = peekInterfaceDescriptor(data, &len);
+    if (descriptor == NULL) {
+        len = 0;
+    }
+    const uint64_t key = (uint64_t(hashDescriptor(descriptor, len)) << 32) | code;
+    const size_t bucket = bucketFor(duration);
+
+    TransactionStats& stats(getInstance());
+    {
+        Mutex::Autolock _l(stats.mLock);
+        KeyedVector<uint64_t, Entry>& entries(stats.mEntries[side]);
+        ssize_t index = entries.indexOfKey(key);
+        if (index < 0) {
+            Entry e;
+            memset(e.buckets, 0, sizeof(e.buckets));
+            e.descriptor = descriptor ? String16(descriptor, len) : String16();
+            e.code = code;
+            e.count = 0;
+            e.total = 0;
+            e.max = 0;
+            index = entries.add(key, e);
+            if (index < 0) {
+                return;
+            }
+        }
+        Entry& e(entries.editValueAt(index));
+        e.count++;
+        e.total += duration;
+        if (duration > e.max) {
+            e.max = duration;
+        }
+        e.buckets[bucket]++;
+    }
+
+    if (ATRACE_ENABLED()) {
+        ATRACE_INT(side == CLIENT ? "binder client us" : "binder server us",
+                int32_t(ns2us(duration)));
+    }
+}
+
+void TransactionStats::dump(String8& result) {
+    TransactionStats& stats(getInstance());
+    Mutex::Autolock _l(stats.mLock);
+
+    result.appendFormat("Binder transaction stats (%s):\n",
+            sEnabled ? "enabled" : "disabled");
+    static const char* const sideNames[2] = { "client", "server" };
+    for (size_t s = 0; s < 2; s++) {
+        const KeyedVector<uint64_t, Entry>& entries(stats.mEntries[s]);
+        result.appendFormat("  %s side: %zu entries\n", sideNames[s], entries.size());
+        for (size_t i = 0; i < entries.size(); i++) {
+            const Entry& e(entries.valueAt(i));
+            result.appendFormat("    %s code=%u count=%u avg=%.1fus max=%.1fus\n      ",
+                    e.descriptor.size() ? String8(e.descriptor).string() : "<none>",
+                    e.code, e.count,
+                    e.count ? (e.total / 1000.0) / e.count : 0.0,
+                    e.max / 1000.0);
+            for (size_t b = 0; b < NUM_BUCKETS; b++) {
+                result.appendFormat(" <%uus:%u", 16u << b, e.buckets[b]);
+            }
+            result.append("\n");
+        }
+    }
+}
+
+void TransactionStats::reset() {
+    TransactionStats& stats(getInstance());
+    Mutex::Autolock _l(stats.mLock);
+    stats.mEntries[CLIENT].clear();
+    stats.mEntries[SERVER].clear();
+}
+
+status_t TransactionStats::handleTransaction(const String16& descriptor,
+        const Parcel& data, Parcel* reply) {
+    const uid_t uid = IPCThreadState::self()->getCallingUid();
+    if (uid != AID_ROOT && uid != AID_SYSTEM && uid != AID_SHELL) {
+        return PERMISSION_DENIED;
+    }
+    // Like any other call, the request starts with the interface token
+    // ("service call" always writes one); the command comes after it.
+    if (!data.enforceInterface(descriptor)) {
+        return PERMISSION_DENIED;
+    }
+
+    int32_t command = CMD_DUMP;
+    if (data.dataAvail() >= sizeof(int32_t)) {
+        command = data.readInt32();
+    }
+
+    switch (command) {
+        case CMD_DUMP:
+            break;
+        case CMD_ENABLE:
+            setEnabled(true);
+            break;
+        case CMD_DISABLE:
+            setEnabled(false);
+            break;
+        case CMD_RESET:
+            reset();
+            break;
+        default:
+            return BAD_VALUE;
+    }
+
+    if (reply != NULL) {
+        String8 result;
+        dump(result);
+        reply->writeString16(String16(result));
+    }
+    return NO_ERROR;
+}
+
+// ---------------------------------------------------------------------------
+}; // namespace android
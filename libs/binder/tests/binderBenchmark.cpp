@@ -0,0 +1,369 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Binder microbenchmarks: round-trip latency, oneway throughput, Parcel
+ * marshalling cost, fd passing and multi-threaded contention.
+ *
+ * usage: binderBenchmark [-i iterations] [-t threads]
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <binder/Binder.h>
+#include <binder/IBinder.h>
+#include <binder/IPCThreadState.h>
+#include <binder/IServiceManager.h>
+#include <binder/Parcel.h>
+#include <binder/ProcessState.h>
+#include <utils/String16.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+static const String16 kServiceName("binderBenchmark.server");
+
+enum BinderBenchmarkTransactionCode {
+    BENCHMARK_NOP_TRANSACTION = IBinder::FIRST_CALL_TRANSACTION,
+    BENCHMARK_PAYLOAD_TRANSACTION,
+    BENCHMARK_FD_TRANSACTION,
+    BENCHMARK_EXIT_TRANSACTION,
+};
+
+// ---------------------------------------------------------------------------
+
+class BenchmarkServer : public BBinder
+{
+public:
+    virtual status_t onTransact(uint32_t code, const Parcel& data,
+            Parcel* reply, uint32_t flags = 0) {
+        switch (code) {
+            case BENCHMARK_NOP_TRANSACTION:
+                return NO_ERROR;
+            case BENCHMARK_PAYLOAD_TRANSACTION: {
+                int32_t size = data.readInt32();
+                if (size < 0 || data.readInplace(size) == NULL) {
+                    return BAD_VALUE;
+                }
+                return NO_ERROR;
+            }
+            case BENCHMARK_FD_TRANSACTION:
+                return data.readFileDescriptor() >= 0 ? NO_ERROR : BAD_VALUE;
+            case BENCHMARK_EXIT_TRANSACTION:
+                if (reply != NULL) {
+                    reply->writeInt32(NO_ERROR);
+                }
+                exit(EXIT_SUCCESS);
+            default:
+                return BBinder::onTransact(code, data, reply, flags);
+        }
+    }
+};
+
+static int runServer(int readyFd, size_t threads)
+{
+    sp<IServiceManager> sm = defaultServiceManager();
+    status_t err = sm->addService(kServiceName, new BenchmarkServer());
+    write(readyFd, &err, sizeof(err));
+    close(readyFd);
+    if (err != NO_ERROR) {
+        return EXIT_FAILURE;
+    }
+    ProcessState::self()->setThreadPoolMaxThreadCount(threads);
+    ProcessState::self()->startThreadPool();
+    IPCThreadState::self()->joinThreadPool();
+    return EXIT_SUCCESS;
+}
+
+// ---------------------------------------------------------------------------
+
+struct Results {
+    std::vector<nsecs_t> samples;
+
+    void add(nsecs_t t) { samples.push_back(t); }
+
+    nsecs_t percentile(size_t p) const {
+        if (samples.empty()) return 0;
+        return samples[std::min(samples.size() - 1, samples.size() * p / 100)];
+    }
+
+    void print(const char* name) {
+        std::sort(samples.begin(), samples.end());
+        nsecs_t total = 0;
+        for (size_t i = 0; i < samples.size(); i++) {
+            total += samples[i];
+        }
+        printf("%-28s n=%-7zu avg=%8.2fus p50=%8.2fus p90=%8.2fus "
+                "p99=%8.2fus max=%8.2fus\n",
+                name, samples.size(),
+                samples.empty() ? 0.0 : total / 1000.0 / samples.size(),
+                percentile(50) / 1000.0, percentile(90) / 1000.0,
+                percentile(99) / 1000.0,
+                samples.empty() ? 0.0 : samples.back() / 1000.0);
+    }
+};
+
+static void benchRoundTrip(const sp<IBinder>& server, size_t iterations)
+{
+    Results r;
+    for (size_t i = 0; i < iterations; i++) {
+        Parcel data, reply;
+        nsecs_t start = systemTime();
+        server->transact(BENCHMARK_NOP_TRANSACTION, data, &reply);
+        r.add(systemTime() - start);
+    }
+    r.print("round-trip");
+}
+
+static void benchOneway(const sp<IBinder>& server, size_t iterations)
+{
+    nsecs_t start = systemTime();
+    for (size_t i = 0; i < iterations; i++) {
+        Parcel data;
+        server->transact(BENCHMARK_NOP_TRANSACTION, data, NULL,
+                IBinder::FLAG_ONEWAY);
+    }
+    // A synchronous call is only served once the oneway queue has drained.
+    Parcel data, reply;
+    server->transact(BENCHMARK_NOP_TRANSACTION, data, &reply);
+    nsecs_t elapsed = systemTime() - start;
+    printf("%-28s n=%-7zu %10.0f transactions/s\n", "oneway", iterations,
+            iterations / (elapsed / 1e9));
+}
+
+static void benchPayload(const sp<IBinder>& server, size_t iterations)
+{
+    static const int32_t sizes[] = { 16, 256, 4096, 65536 };
+    std::vector<uint8_t> buffer(sizes[3], 0xa5);
+    for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+        Results r;
+        for (size_t i = 0; i < iterations; i++) {
+            Parcel data, reply;
+            nsecs_t start = systemTime();
+            data.writeInt32(sizes[s]);
+            data.write(&buffer[0], sizes[s]);
+            server->transact(BENCHMARK_PAYLOAD_TRANSACTION, data, &reply);
+            r.add(systemTime() - start);
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "round-trip %6d bytes", sizes[s]);
+        r.print(name);
+    }
+}
+
+static void benchFd(const sp<IBinder>& server, size_t iterations)
+{
+    int fd = open("/dev/null", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        printf("fd passing: cannot open /dev/null (%s)\n", strerror(errno));
+        return;
+    }
+    Results r;
+    for (size_t i = 0; i < iterations; i++) {
+        Parcel data, reply;
+        nsecs_t start = systemTime();
+        data.writeFileDescriptor(fd);
+        server->transact(BENCHMARK_FD_TRANSACTION, data, &reply);
+        r.add(systemTime() - start);
+    }
+    close(fd);
+    r.print("fd passing");
+}
+
+// Parcel marshalling without any IPC.
+static void benchMarshal(size_t iterations)
+{
+    static const size_t counts[] = { 1, 16, 256, 4096 };
+    const String16 str("android.os.IBinderBenchmarkString");
+
+    for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); c++) {
+        const size_t n = counts[c];
+        Results w32, r32, w64, r64, wstr, rstr;
+        for (size_t i = 0; i < iterations; i++) {
+            Parcel p;
+            nsecs_t start = systemTime();
+            for (size_t k = 0; k < n; k++) p.writeInt32(k);
+            w32.add(systemTime() - start);
+            p.setDataPosition(0);
+            start = systemTime();
+            for (size_t k = 0; k < n; k++) p.readInt32();
+            r32.add(systemTime() - start);
+
+            Parcel q;
+            start = systemTime();
+            for (size_t k = 0; k < n; k++) q.writeInt64(k);
+            w64.add(systemTime() - start);
+            q.setDataPosition(0);
+            start = systemTime();
+            for (size_t k = 0; k < n; k++) q.readInt64();
+            r64.add(systemTime() - start);
+
+            Parcel s;
+            start = systemTime();
+            for (size_t k = 0; k < n; k++) s.writeString16(str);
+            wstr.add(systemTime() - start);
+            s.setDataPosition(0);
+            start = systemTime();
+            for (size_t k = 0; k < n; k++) s.readString16();
+            rstr.add(systemTime() - start);
+        }
+        char name[64];
+        snprintf(name, sizeof(name), "write int32 x%zu", n);
+        w32.print(name);
+        snprintf(name, sizeof(name), "read int32 x%zu", n);
+        r32.print(name);
+        snprintf(name, sizeof(name), "write int64 x%zu", n);
+        w64.print(name);
+        snprintf(name, sizeof(name), "read int64 x%zu", n);
+        r64.print(name);
+        snprintf(name, sizeof(name), "write String16 x%zu", n);
+        wstr.print(name);
+        snprintf(name, sizeof(name), "read String16 x%zu", n);
+        rstr.print(name);
+    }
+}
+
+struct ContentionArgs {
+    sp<IBinder> server;
+    size_t iterations;
+    Results results;
+};
+
+static void* contentionThread(void* arg)
+{
+    ContentionArgs* args = static_cast<ContentionArgs*>(arg);
+    for (size_t i = 0; i < args->iterations; i++) {
+        Parcel data, reply;
+        nsecs_t start = systemTime();
+        args->server->transact(BENCHMARK_NOP_TRANSACTION, data, &reply);
+        args->results.add(systemTime() - start);
+    }
+    return NULL;
+}
+
+static void benchContention(const sp<IBinder>& server, size_t iterations,
+        size_t threads)
+{
+    std::vector<ContentionArgs> args(threads);
+    std::vector<pthread_t> tids(threads);
+
+    nsecs_t start = systemTime();
+    for (size_t t = 0; t < threads; t++) {
+        args[t].server = server;
+        args[t].iterations = iterations;
+        pthread_create(&tids[t], NULL, contentionThread, &args[t]);
+    }
+    Results all;
+    for (size_t t = 0; t < threads; t++) {
+        pthread_join(tids[t], NULL);
+        all.samples.insert(all.samples.end(),
+                args[t].results.samples.begin(), args[t].results.samples.end());
+    }
+    nsecs_t elapsed = systemTime() - start;
+
+    char name[64];
+    snprintf(name, sizeof(name), "contention %zu threads", threads);
+    all.print(name);
+    printf("%-28s %10.0f transactions/s\n", "",
+            all.samples.size() / (elapsed / 1e9));
+}
+
+// ---------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    size_t iterations = 10000;
+    size_t threads = 4;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:t:")) != -1) {
+        switch (opt) {
+            case 'i':
+                iterations = strtoul(optarg, NULL, 0);
+                break;
+            case 't':
+                threads = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-i iterations] [-t threads]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (threads == 0) {
+        threads = 1;
+    }
+
+    // The server has to be forked before this process opens the driver.
+    int pipefd[2];
+    if (pipe(pipefd) < 0) {
+        fprintf(stderr, "pipe failed, %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        fprintf(stderr, "fork failed, %s\n", strerror(errno));
+        return EXIT_FAILURE;
+    }
+    if (pid == 0) {
+        close(pipefd[0]);
+        _exit(runServer(pipefd[1], threads));
+    }
+    close(pipefd[1]);
+    status_t status = NO_INIT;
+    read(pipefd[0], &status, sizeof(status));
+    close(pipefd[0]);
+    if (status != NO_ERROR) {
+        fprintf(stderr, "server failed to start (%d)\n", status);
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return EXIT_FAILURE;
+    }
+
+    sp<IBinder> server = defaultServiceManager()->getService(kServiceName);
+    if (server == NULL) {
+        fprintf(stderr, "cannot find %s\n", String8(kServiceName).string());
+        kill(pid, SIGKILL);
+        waitpid(pid, NULL, 0);
+        return EXIT_FAILURE;
+    }
+    ProcessState::self()->startThreadPool();
+
+    printf("binderBenchmark: %zu iterations, %zu threads\n", iterations, threads);
+    benchRoundTrip(server, iterations);
+    benchOneway(server, iterations);
+    benchPayload(server, iterations);
+    benchFd(server, iterations);
+    benchMarshal(iterations / 10 ? iterations / 10 : 1);
+    benchContention(server, iterations, threads);
+
+    Parcel data, reply;
+    server->transact(BENCHMARK_EXIT_TRANSACTION, data, &reply);
+    waitpid(pid, NULL, 0);
+    return EXIT_SUCCESS;
+}
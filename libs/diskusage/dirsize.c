@@ -17,11 +17,44 @@
 
 #include <dirent.h>
 #include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
 #include <sys/stat.h>
+#include <sys/syscall.h>
 #include <unistd.h>
 
 #include <diskusage/dirsize.h>
 
+/* Directory entries are read this many bytes at a time with getdents64. */
+#define DIRENT_BUFFER_SIZE (32 * 1024)
+
+/* At most this many opened directories wait for a thread to scan them;
+ * beyond that, whoever finds a directory scans it itself. */
+#define MAX_QUEUED_DIRS 128
+
+struct linux_dirent64 {
+    uint64_t d_ino;
+    int64_t d_off;
+    unsigned short d_reclen;
+    unsigned char d_type;
+    char d_name[];
+};
+
+struct dir_work {
+    int dfd;
+    size_t root;
+};
+
+struct dir_walk {
+    int64_t *sizes;
+    int threads;
+    struct dir_work queue[MAX_QUEUED_DIRS];
+    size_t queued;
+    int busy;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+};
+
 int64_t stat_size(struct stat *s)
 {
     int64_t blksize = s->st_blksize;
@@ -36,41 +69,159 @@ int64_t stat_size(struct stat *s)
     return size;
 }
 
-int64_t calculate_dir_size(int dfd)
+static int queue_dir(struct dir_walk *w, int dfd, size_t root)
+{
+    int queued = 0;
+
+    if (w->threads > 1) {
+        pthread_mutex_lock(&w->lock);
+        if (w->queued < MAX_QUEUED_DIRS) {
+            w->queue[w->queued].dfd = dfd;
+            w->queue[w->queued].root = root;
+            w->queued++;
+            pthread_cond_signal(&w->cond);
+            queued = 1;
+        }
+        pthread_mutex_unlock(&w->lock);
+    }
+    return queued;
+}
+
+/* Add up the sizes of everything in dfd, including "." and "..", and close
+ * it.  Subdirectories are handed to other threads when they can take them,
+ * and their sizes added to the root's total when they're done. */
+static int64_t scan_dir(struct dir_walk *w, int dfd, size_t root)
 {
     int64_t size = 0;
     struct stat s;
-    DIR *d;
-    struct dirent *de;
+    char *buf;
+    long n;
 
-    d = fdopendir(dfd);
-    if (d == NULL) {
+    buf = malloc(DIRENT_BUFFER_SIZE);
+    if (buf == NULL) {
         close(dfd);
         return 0;
     }
 
-    while ((de = readdir(d))) {
-        const char *name = de->d_name;
-        if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
-            size += stat_size(&s);
-        }
-        if (de->d_type == DT_DIR) {
-            int subfd;
-
-            /* always skip "." and ".." */
-            if (name[0] == '.') {
-                if (name[1] == 0)
-                    continue;
-                if ((name[1] == '.') && (name[2] == 0))
-                    continue;
+    while ((n = syscall(__NR_getdents64, dfd, buf, DIRENT_BUFFER_SIZE)) > 0) {
+        long pos;
+        for (pos = 0; pos < n; ) {
+            struct linux_dirent64 *de = (struct linux_dirent64 *)(buf + pos);
+            const char *name = de->d_name;
+
+            pos += de->d_reclen;
+
+            if (fstatat(dfd, name, &s, AT_SYMLINK_NOFOLLOW) == 0) {
+                size += stat_size(&s);
             }
+            if (de->d_type == DT_DIR) {
+                int subfd;
 
-            subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY);
-            if (subfd >= 0) {
-                size += calculate_dir_size(subfd);
+                /* always skip "." and ".." */
+                if (name[0] == '.') {
+                    if (name[1] == 0)
+                        continue;
+                    if ((name[1] == '.') && (name[2] == 0))
+                        continue;
+                }
+
+                subfd = openat(dfd, name, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+                if (subfd >= 0 && !queue_dir(w, subfd, root)) {
+                    size += scan_dir(w, subfd, root);
+                }
             }
         }
     }
-    closedir(d);
+    free(buf);
+    close(dfd);
+    return size;
+}
+
+static void *walk_thread(void *arg)
+{
+    struct dir_walk *w = arg;
+
+    pthread_mutex_lock(&w->lock);
+    for (;;) {
+        while (w->queued == 0 && w->busy > 0) {
+            pthread_cond_wait(&w->cond, &w->lock);
+        }
+        if (w->queued == 0) {
+            /* Nothing queued and nobody left to queue more: done. */
+            pthread_cond_broadcast(&w->cond);
+            break;
+        }
+        struct dir_work work = w->queue[--w->queued];
+        w->busy++;
+        pthread_mutex_unlock(&w->lock);
+
+        int64_t size = scan_dir(w, work.dfd, work.root);
+
+        pthread_mutex_lock(&w->lock);
+        w->sizes[work.root] += size;
+        w->busy--;
+    }
+    pthread_mutex_unlock(&w->lock);
+    return NULL;
+}
+
+void calculate_dir_sizes(const int *dfds, int64_t *sizes, size_t count,
+        int max_threads)
+{
+    struct dir_walk w;
+    pthread_t threads[MAX_DIR_SIZE_THREADS];
+    int started = 0;
+    size_t i;
+
+    if (max_threads > MAX_DIR_SIZE_THREADS) {
+        max_threads = MAX_DIR_SIZE_THREADS;
+    } else if (max_threads < 1) {
+        max_threads = 1;
+    }
+    w.sizes = sizes;
+    w.threads = max_threads;
+    w.queued = 0;
+    w.busy = 0;
+    pthread_mutex_init(&w.lock, NULL);
+    pthread_cond_init(&w.cond, NULL);
+
+    for (i = 0; i < count; i++) {
+        sizes[i] = 0;
+        if (dfds[i] < 0) {
+            continue;
+        }
+        /* Roots that don't fit in the queue are scanned up front. */
+        if (w.queued < MAX_QUEUED_DIRS) {
+            w.queue[w.queued].dfd = dfds[i];
+            w.queue[w.queued].root = i;
+            w.queued++;
+        } else {
+            sizes[i] = scan_dir(&w, dfds[i], i);
+        }
+    }
+
+    /* The calling thread is one of the walkers. */
+    while (started < max_threads - 1 &&
+            pthread_create(&threads[started], NULL, walk_thread, &w) == 0) {
+        started++;
+    }
+    walk_thread(&w);
+    for (i = 0; i < (size_t)started; i++) {
+        pthread_join(threads[i], NULL);
+    }
+
+    pthread_mutex_destroy(&w.lock);
+    pthread_cond_destroy(&w.cond);
+}
+
+int64_t calculate_dir_size_parallel(int dfd, int max_threads)
+{
+    int64_t size;
+    calculate_dir_sizes(&dfd, &size, 1, max_threads);
     return size;
 }
+
+int64_t calculate_dir_size(int dfd)
+{
+    return calculate_dir_size_parallel(dfd, 1);
+}
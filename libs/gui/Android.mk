@@ -44,12 +44,15 @@ LOCAL_SRC_FILES := \
 	BufferItemConsumer.cpp \
 	BufferQueue.cpp \
 	BufferQueueConsumer.cpp \
+	BufferQueueControlBlock.cpp \
 	BufferQueueCore.cpp \
 	BufferQueueProducer.cpp \
 	BufferSlot.cpp \
 	ConsumerBase.cpp \
 	CpuConsumer.cpp \
+	DisplayEventControlBlock.cpp \
 	DisplayEventReceiver.cpp \
+	FrameTimestamps.cpp \
 	GLConsumer.cpp \
 	GraphicBufferAlloc.cpp \
 	GuiConfig.cpp \
@@ -64,6 +67,7 @@ LOCAL_SRC_FILES := \
 	LayerState.cpp \
 	Sensor.cpp \
 	SensorEventQueue.cpp \
+	SensorEventRing.cpp \
 	SensorManager.cpp \
 	StreamSplitter.cpp \
 	Surface.cpp \
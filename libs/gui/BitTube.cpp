@@ -22,6 +22,8 @@
 #include <fcntl.h>
 #include <unistd.h>
 
+#include <string.h>
+
 #include <utils/Errors.h>
 #include <cutils/properties.h>
 
@@ -36,6 +38,10 @@ namespace android {
 // we really need.  So we make it smaller.
 static const size_t DEFAULT_SOCKET_BUFFER_SIZE = 4 * 1024;
 
+// Upper bound on the number of messages moved by one sendmmsg/recvmmsg call,
+// so that the message headers can live on the stack.
+static const size_t MAX_BATCH_MESSAGES = 32;
+
 
 BitTube::BitTube()
     : mSendFd(-1), mReceiveFd(-1)
@@ -181,6 +187,116 @@ ssize_t BitTube::recvObjects(const sp<BitTube>& tube,
     return size < 0 ? size : size / static_cast<ssize_t>(objSize);
 }
 
+ssize_t BitTube::sendObjectsBatch(const sp<BitTube>& tube,
+        void const* events, size_t count, size_t objSize,
+        size_t objectsPerMessage)
+{
+    if (objectsPerMessage == 0) {
+        return BAD_VALUE;
+    }
+    if (count <= objectsPerMessage) {
+        return sendObjects(tube, events, count, objSize);
+    }
+
+    const size_t messageSize = objectsPerMessage * objSize;
+    size_t numMessages = (count + objectsPerMessage - 1) / objectsPerMessage;
+    if (numMessages > MAX_BATCH_MESSAGES) {
+        numMessages = MAX_BATCH_MESSAGES;
+    }
+
+    char* vaddr = const_cast<char*>(reinterpret_cast<const char*>(events));
+    size_t remaining = count * objSize;
+    struct iovec iov[MAX_BATCH_MESSAGES];
+    struct mmsghdr msgs[MAX_BATCH_MESSAGES];
+    memset(msgs, 0, sizeof(msgs[0]) * numMessages);
+    for (size_t i = 0; i < numMessages; i++) {
+        iov[i].iov_base = vaddr + i * messageSize;
+        iov[i].iov_len = remaining < messageSize ? remaining : messageSize;
+        remaining -= iov[i].iov_len;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int sent, err;
+    do {
+        sent = ::sendmmsg(tube->mSendFd, msgs, static_cast<unsigned int>(numMessages),
+                MSG_DONTWAIT | MSG_NOSIGNAL);
+        err = sent < 0 ? errno : 0;
+    } while (err == EINTR);
+    if (err != 0) {
+        return -err;
+    }
+
+    size_t size = 0;
+    for (size_t i = 0; i < static_cast<size_t>(sent); i++) {
+        // should never happen because of SOCK_SEQPACKET
+        LOG_ALWAYS_FATAL_IF(msgs[i].msg_len != iov[i].iov_len,
+                "BitTube::sendObjectsBatch(count=%zu, size=%zu), res=%u (partial events were sent!)",
+                count, objSize, msgs[i].msg_len);
+        size += msgs[i].msg_len;
+    }
+    return static_cast<ssize_t>(size / objSize);
+}
+
+ssize_t BitTube::recvObjectsBatch(const sp<BitTube>& tube,
+        void* events, size_t count, size_t objSize,
+        size_t objectsPerMessage)
+{
+    if (objectsPerMessage == 0) {
+        return BAD_VALUE;
+    }
+    size_t numMessages = count / objectsPerMessage;
+    if (numMessages <= 1) {
+        return recvObjects(tube, events, count, objSize);
+    }
+    if (numMessages > MAX_BATCH_MESSAGES) {
+        numMessages = MAX_BATCH_MESSAGES;
+    }
+
+    const size_t messageSize = objectsPerMessage * objSize;
+    char* vaddr = reinterpret_cast<char*>(events);
+    struct iovec iov[MAX_BATCH_MESSAGES];
+    struct mmsghdr msgs[MAX_BATCH_MESSAGES];
+    memset(msgs, 0, sizeof(msgs[0]) * numMessages);
+    for (size_t i = 0; i < numMessages; i++) {
+        iov[i].iov_base = vaddr + i * messageSize;
+        iov[i].iov_len = messageSize;
+        msgs[i].msg_hdr.msg_iov = &iov[i];
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int received, err;
+    do {
+        received = ::recvmmsg(tube->mReceiveFd, msgs,
+                static_cast<unsigned int>(numMessages), MSG_DONTWAIT, NULL);
+        err = received < 0 ? errno : 0;
+    } while (err == EINTR);
+    if (err == EAGAIN || err == EWOULDBLOCK) {
+        return 0;
+    }
+    if (err != 0) {
+        return -err;
+    }
+
+    // Messages shorter than a slot leave gaps; pack the objects together.
+    size_t size = 0;
+    for (size_t i = 0; i < static_cast<size_t>(received); i++) {
+        const size_t len = msgs[i].msg_len;
+        // should never happen because of SOCK_SEQPACKET
+        LOG_ALWAYS_FATAL_IF(len % objSize,
+                "BitTube::recvObjectsBatch(count=%zu, size=%zu), res=%zu (partial events were received!)",
+                count, objSize, len);
+        ALOGE_IF(msgs[i].msg_hdr.msg_flags & MSG_TRUNC,
+                "BitTube::recvObjectsBatch: message larger than %zu objects truncated",
+                objectsPerMessage);
+        if (size != i * messageSize) {
+            memmove(vaddr + size, vaddr + i * messageSize, len);
+        }
+        size += len;
+    }
+    return static_cast<ssize_t>(size / objSize);
+}
+
 static const int FILE_NAME_LEN = 1024;
 static const int SOCKET_NAME_LEN = 108;
 
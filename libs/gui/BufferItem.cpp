@@ -33,7 +33,8 @@ BufferItem::BufferItem() :
     mSlot(INVALID_BUFFER_SLOT),
     mIsDroppable(false),
     mAcquireCalled(false),
-    mTransformToDisplayInverse(false) {
+    mTransformToDisplayInverse(false),
+    mCoalescedFrames(0) {
     mCrop.makeInvalid();
 }
 
@@ -60,6 +61,7 @@ size_t BufferItem::getPodSize() const {
     addAligned(size, mIsDroppable);
     addAligned(size, mAcquireCalled);
     addAligned(size, mTransformToDisplayInverse);
+    addAligned(size, mCoalescedFrames);
     return size;
 }
 
@@ -145,6 +147,7 @@ status_t BufferItem::flatten(
     writeAligned(buffer, size, mIsDroppable);
     writeAligned(buffer, size, mAcquireCalled);
     writeAligned(buffer, size, mTransformToDisplayInverse);
+    writeAligned(buffer, size, mCoalescedFrames);
 
     return NO_ERROR;
 }
@@ -201,6 +204,7 @@ status_t BufferItem::unflatten(
     readAligned(buffer, size, mIsDroppable);
     readAligned(buffer, size, mAcquireCalled);
     readAligned(buffer, size, mTransformToDisplayInverse);
+    readAligned(buffer, size, mCoalescedFrames);
 
     return NO_ERROR;
 }
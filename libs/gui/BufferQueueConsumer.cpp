@@ -30,6 +30,9 @@
 #include <binder/PermissionCache.h>
 #include <private/android_filesystem_config.h>
 
+#include <ui/GraphicBuffer.h>
+#include <ui/PixelFormat.h>
+
 namespace android {
 
 BufferQueueConsumer::BufferQueueConsumer(const sp<BufferQueueCore>& core) :
@@ -64,6 +67,10 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
             return INVALID_OPERATION;
         }
 
+        // Whatever happens next, the consumer has reacted to the last
+        // onFrameAvailable
+        mCore->mFrameAvailablePending = false;
+
         // Check if the queue is empty.
         // In asynchronous mode the list is guaranteed to be one buffer deep,
         // while in synchronous mode we use the oldest buffer.
@@ -142,6 +149,7 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
                 mCore->mQueue.erase(front);
                 front = mCore->mQueue.begin();
             }
+            mCore->publishStateLocked();
 
             // See if the front buffer is ready to be acquired
             nsecs_t desiredPresent = front->mTimestamp;
@@ -187,7 +195,13 @@ status_t BufferQueueConsumer::acquireBuffer(BufferItem* outBuffer,
             outBuffer->mGraphicBuffer = NULL;
         }
 
+        mCore->mFrameEventHistory.addAcquire(outBuffer->mFrameNumber,
+                systemTime(SYSTEM_TIME_MONOTONIC));
         mCore->mQueue.erase(front);
+        mCore->publishStateLocked();
+
+        outBuffer->mCoalescedFrames = mCore->mCoalesceFrameAvailable ?
+                static_cast<uint32_t>(mCore->mQueue.size()) : 0;
 
         // We might have freed a slot while dropping old buffers, or the producer
         // may be blocked waiting for the number of buffers in the queue to
@@ -292,6 +306,7 @@ status_t BufferQueueConsumer::attachBuffer(int* outSlot,
     BQ_LOGV("attachBuffer(C): returning slot %d", *outSlot);
 
     mSlots[*outSlot].mGraphicBuffer = buffer;
+    mSlots[*outSlot].mAllocatedByQueue = false;
     mSlots[*outSlot].mBufferState = BufferSlot::ACQUIRED;
     mSlots[*outSlot].mAttachedByConsumer = true;
     mSlots[*outSlot].mNeedsCleanupOnRelease = false;
@@ -360,6 +375,8 @@ status_t BufferQueueConsumer::releaseBuffer(int slot, uint64_t frameNumber,
             mSlots[slot].mFence = releaseFence;
             mSlots[slot].mBufferState = BufferSlot::FREE;
             mCore->mFreeBuffers.push_back(slot);
+            mCore->mFrameEventHistory.addRelease(frameNumber, releaseFence,
+                    systemTime(SYSTEM_TIME_MONOTONIC));
             listener = mCore->mConnectedProducerListener;
             BQ_LOGV("releaseBuffer: releasing slot %d", slot);
         } else if (mSlots[slot].mNeedsCleanupOnRelease) {
@@ -406,6 +423,8 @@ status_t BufferQueueConsumer::connect(
 
     mCore->mConsumerListener = consumerListener;
     mCore->mConsumerControlledByApp = controlledByApp;
+    mCore->mFrameAvailablePending = false;
+    mCore->publishStateLocked();
 
     return NO_ERROR;
 }
@@ -426,7 +445,9 @@ status_t BufferQueueConsumer::disconnect() {
     mCore->mConsumerListener = NULL;
     mCore->mQueue.clear();
     mCore->freeAllBuffersLocked();
+    mCore->publishStateLocked();
     mCore->mDequeueCondition.broadcast();
+    mCore->mPreallocationCondition.broadcast();
     return NO_ERROR;
 }
 
@@ -481,8 +502,14 @@ status_t BufferQueueConsumer::setDefaultBufferSize(uint32_t width,
     BQ_LOGV("setDefaultBufferSize: width=%u height=%u", width, height);
 
     Mutex::Autolock lock(mCore->mMutex);
+    bool changed = mCore->mDefaultWidth != width ||
+            mCore->mDefaultHeight != height;
     mCore->mDefaultWidth = width;
     mCore->mDefaultHeight = height;
+    mCore->publishStateLocked();
+    if (changed) {
+        mCore->requestPreallocationLocked();
+    }
     return NO_ERROR;
 }
 
@@ -504,6 +531,7 @@ status_t BufferQueueConsumer::disableAsyncBuffer() {
 
     BQ_LOGV("disableAsyncBuffer");
     mCore->mUseAsyncBuffer = false;
+    mCore->publishStateLocked();
     return NO_ERROR;
 }
 
@@ -527,6 +555,7 @@ status_t BufferQueueConsumer::setMaxAcquiredBufferCount(
 
     BQ_LOGV("setMaxAcquiredBufferCount: %d", maxAcquiredBuffers);
     mCore->mMaxAcquiredBufferCount = maxAcquiredBuffers;
+    mCore->publishStateLocked();
     return NO_ERROR;
 }
 
@@ -542,7 +571,12 @@ status_t BufferQueueConsumer::setDefaultBufferFormat(PixelFormat defaultFormat)
     ATRACE_CALL();
     BQ_LOGV("setDefaultBufferFormat: %u", defaultFormat);
     Mutex::Autolock lock(mCore->mMutex);
+    bool changed = mCore->mDefaultBufferFormat != defaultFormat;
     mCore->mDefaultBufferFormat = defaultFormat;
+    mCore->publishStateLocked();
+    if (changed) {
+        mCore->requestPreallocationLocked();
+    }
     return NO_ERROR;
 }
 
@@ -552,6 +586,7 @@ status_t BufferQueueConsumer::setDefaultBufferDataSpace(
     BQ_LOGV("setDefaultBufferDataSpace: %u", defaultDataSpace);
     Mutex::Autolock lock(mCore->mMutex);
     mCore->mDefaultBufferDataSpace = defaultDataSpace;
+    mCore->publishStateLocked();
     return NO_ERROR;
 }
 
@@ -559,7 +594,12 @@ status_t BufferQueueConsumer::setConsumerUsageBits(uint32_t usage) {
     ATRACE_CALL();
     BQ_LOGV("setConsumerUsageBits: %#x", usage);
     Mutex::Autolock lock(mCore->mMutex);
+    bool changed = mCore->mConsumerUsageBits != usage;
     mCore->mConsumerUsageBits = usage;
+    mCore->publishStateLocked();
+    if (changed) {
+        mCore->requestPreallocationLocked();
+    }
     return NO_ERROR;
 }
 
@@ -568,6 +608,93 @@ status_t BufferQueueConsumer::setTransformHint(uint32_t hint) {
     BQ_LOGV("setTransformHint: %#x", hint);
     Mutex::Autolock lock(mCore->mMutex);
     mCore->mTransformHint = hint;
+    mCore->publishStateLocked();
+    return NO_ERROR;
+}
+
+status_t BufferQueueConsumer::setFrameCompositionInfo(uint64_t frameNumber,
+        nsecs_t latchTime, const sp<Fence>& presentFence,
+        nsecs_t presentTime) {
+    ATRACE_CALL();
+    Mutex::Autolock lock(mCore->mMutex);
+    mCore->mFrameEventHistory.addComposition(frameNumber, latchTime,
+            presentFence, presentTime);
+    return NO_ERROR;
+}
+
+status_t BufferQueueConsumer::setBufferPreallocation(bool enabled) {
+    ATRACE_CALL();
+    BQ_LOGV("setBufferPreallocation: %s", enabled ? "true" : "false");
+    Mutex::Autolock lock(mCore->mMutex);
+    mCore->mPreallocateBuffers = enabled;
+    return NO_ERROR;
+}
+
+status_t BufferQueueConsumer::setFrameAvailableCoalescing(bool enabled) {
+    ATRACE_CALL();
+    BQ_LOGV("setFrameAvailableCoalescing: %s", enabled ? "true" : "false");
+    Mutex::Autolock lock(mCore->mMutex);
+    mCore->mCoalesceFrameAvailable = enabled;
+    mCore->mFrameAvailablePending = false;
+    return NO_ERROR;
+}
+
+status_t BufferQueueConsumer::getBufferMemoryUsage(uint32_t* outBufferCount,
+        uint64_t* outBytes) {
+    ATRACE_CALL();
+    Mutex::Autolock lock(mCore->mMutex);
+    uint32_t count = 0;
+    uint64_t bytes = 0;
+    for (int s = 0; s < BufferQueueDefs::NUM_BUFFER_SLOTS; ++s) {
+        const sp<GraphicBuffer>& buffer(mSlots[s].mGraphicBuffer);
+        if (buffer == NULL) {
+            continue;
+        }
+        uint32_t bpp = bytesPerPixel(buffer->getPixelFormat());
+        if (bpp == 0) {
+            // YUV and other formats without a fixed pixel size; 2 bytes is
+            // an upper bound for the common 4:2:0 layouts
+            bpp = 2;
+        }
+        bytes += static_cast<uint64_t>(buffer->getStride()) *
+                buffer->getHeight() * bpp;
+        count++;
+    }
+    *outBufferCount = count;
+    *outBytes = bytes;
+    return NO_ERROR;
+}
+
+status_t BufferQueueConsumer::discardFreeBuffers() {
+    ATRACE_CALL();
+    sp<IConsumerListener> listener;
+    { // Autolock scope
+        Mutex::Autolock lock(mCore->mMutex);
+
+        if (mCore->mIsAbandoned) {
+            BQ_LOGE("discardFreeBuffers: BufferQueue has been abandoned");
+            return NO_INIT;
+        }
+
+        // Copy the list, freeBufferLocked removes the slots from it
+        std::list<int> freeBuffers(mCore->mFreeBuffers);
+        for (std::list<int>::const_iterator it = freeBuffers.begin();
+                it != freeBuffers.end(); ++it) {
+            // The point is to give the memory back, so the buffers don't go
+            // to the allocator's recycle pool
+            mSlots[*it].mAllocatedByQueue = false;
+            mCore->freeBufferLocked(*it);
+        }
+        BQ_LOGV("discardFreeBuffers: freed %zu buffers", freeBuffers.size());
+        if (!freeBuffers.empty()) {
+            listener = mCore->mConsumerListener;
+        }
+    } // Autolock scope
+
+    // Call back without lock held
+    if (listener != NULL) {
+        listener->onBuffersReleased();
+    }
     return NO_ERROR;
 }
 
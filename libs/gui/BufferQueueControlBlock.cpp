@@ -0,0 +1,186 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "BufferQueueControlBlock"
+//#define LOG_NDEBUG 0
+
+#include <limits.h>
+#include <linux/futex.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+#include <gui/BufferQueueControlBlock.h>
+
+#include <binder/IMemory.h>
+#include <binder/MemoryHeapBase.h>
+
+#include <cutils/atomic.h>
+
+#include <system/window.h>
+
+#include <utils/Log.h>
+
+namespace android {
+
+struct BufferQueueControlBlock::SharedBlock {
+    // Odd while publish() is updating state
+    volatile int32_t sequence;
+    State state;
+
+    // Serial and result of the last asynchronous queueBuffer processed.
+    // These are outside the seqlock so that producers can futex-wait on
+    // queueSerial.
+    volatile int32_t queueSerial;
+    volatile int32_t queueError;
+};
+
+// A reader racing with publish() retries this many times before giving up
+static const int MAX_READ_ATTEMPTS = 4;
+
+sp<BufferQueueControlBlock> BufferQueueControlBlock::create() {
+    sp<MemoryHeapBase> heap = new MemoryHeapBase(sizeof(SharedBlock),
+            MemoryHeapBase::READ_ONLY, "BufferQueueControlBlock");
+    if (heap->getHeapID() < 0 || heap->getBase() == MAP_FAILED) {
+        ALOGE("create: failed to allocate control block");
+        return NULL;
+    }
+    SharedBlock* block = static_cast<SharedBlock*>(heap->getBase());
+    memset(block, 0, sizeof(SharedBlock));
+    return new BufferQueueControlBlock(heap, block);
+}
+
+sp<BufferQueueControlBlock> BufferQueueControlBlock::attach(
+        const sp<IMemoryHeap>& heap) {
+    if (heap == NULL || heap->getHeapID() < 0 ||
+            heap->getBase() == MAP_FAILED ||
+            heap->getSize() < sizeof(SharedBlock)) {
+        ALOGE("attach: invalid control block");
+        return NULL;
+    }
+    return new BufferQueueControlBlock(heap,
+            static_cast<SharedBlock*>(heap->getBase()));
+}
+
+BufferQueueControlBlock::BufferQueueControlBlock(const sp<IMemoryHeap>& heap,
+        SharedBlock* block) :
+    mHeap(heap),
+    mBlock(block) {}
+
+BufferQueueControlBlock::~BufferQueueControlBlock() {}
+
+void BufferQueueControlBlock::publish(const State& state) {
+    // android_atomic_inc is a full barrier, so the state stores can't move
+    // ahead of the first increment or behind the second
+    android_atomic_inc(&mBlock->sequence);
+    mBlock->state = state;
+    android_atomic_inc(&mBlock->sequence);
+}
+
+bool BufferQueueControlBlock::read(State* outState) const {
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; ++attempt) {
+        int32_t sequence = android_atomic_acquire_load(&mBlock->sequence);
+        if (sequence & 1) {
+            continue;
+        }
+        *outState = mBlock->state;
+        android_memory_barrier();
+        if (android_atomic_acquire_load(&mBlock->sequence) == sequence) {
+            return true;
+        }
+    }
+    ALOGV("read: gave up after %d attempts", MAX_READ_ATTEMPTS);
+    return false;
+}
+
+bool BufferQueueControlBlock::query(int what, int* outValue) const {
+    State state;
+    if (!read(&state) || state.isAbandoned) {
+        return false;
+    }
+
+    switch (what) {
+        case NATIVE_WINDOW_WIDTH:
+            *outValue = static_cast<int>(state.defaultWidth);
+            return true;
+        case NATIVE_WINDOW_HEIGHT:
+            *outValue = static_cast<int>(state.defaultHeight);
+            return true;
+        case NATIVE_WINDOW_FORMAT:
+            *outValue = state.defaultFormat;
+            return true;
+        case NATIVE_WINDOW_MIN_UNDEQUEUED_BUFFERS:
+            *outValue = state.minUndequeuedBuffers;
+            return true;
+        case NATIVE_WINDOW_CONSUMER_RUNNING_BEHIND:
+            *outValue = state.numPendingBuffers > 1;
+            return true;
+        case NATIVE_WINDOW_CONSUMER_USAGE_BITS:
+            *outValue = static_cast<int>(state.consumerUsageBits);
+            return true;
+        case NATIVE_WINDOW_DEFAULT_DATASPACE:
+            *outValue = state.defaultDataSpace;
+            return true;
+        case NATIVE_WINDOW_BUFFER_AGE:
+            *outValue = state.bufferAge;
+            return true;
+        default:
+            return false;
+    }
+}
+
+void BufferQueueControlBlock::completeQueue(int32_t serial, status_t error) {
+    mBlock->queueError = error;
+    android_atomic_release_store(serial, &mBlock->queueSerial);
+    // The mapping is shared between processes, so this can't be a
+    // FUTEX_PRIVATE_FLAG operation
+    syscall(__NR_futex, &mBlock->queueSerial, FUTEX_WAKE, INT_MAX,
+            NULL, NULL, 0);
+}
+
+int32_t BufferQueueControlBlock::getQueueSerial() const {
+    return android_atomic_acquire_load(&mBlock->queueSerial);
+}
+
+status_t BufferQueueControlBlock::waitForQueue(int32_t serial,
+        nsecs_t timeout) const {
+    const nsecs_t deadline = systemTime(SYSTEM_TIME_MONOTONIC) + timeout;
+    for (;;) {
+        int32_t current = android_atomic_acquire_load(&mBlock->queueSerial);
+        // Serials wrap around, so compare their difference
+        if (static_cast<int32_t>(static_cast<uint32_t>(current) -
+                static_cast<uint32_t>(serial)) >= 0) {
+            return mBlock->queueError;
+        }
+
+        nsecs_t remaining = deadline - systemTime(SYSTEM_TIME_MONOTONIC);
+        if (remaining <= 0) {
+            ALOGE("waitForQueue: timed out waiting for queue %d (at %d)",
+                    serial, current);
+            return TIMED_OUT;
+        }
+        struct timespec ts;
+        ts.tv_sec = static_cast<time_t>(remaining / 1000000000);
+        ts.tv_nsec = static_cast<long>(remaining % 1000000000);
+        // Returns immediately if queueSerial already moved on from current
+        syscall(__NR_futex, &mBlock->queueSerial, FUTEX_WAIT, current,
+                &ts, NULL, 0);
+    }
+}
+
+} // namespace android
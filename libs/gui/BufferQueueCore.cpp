@@ -20,9 +20,13 @@
 
 #define EGL_EGLEXT_PROTOTYPES
 
+// Set to 1 to check the free lists after every change to the slots
+#define VALIDATE_CONSISTENCY 0
+
 #include <inttypes.h>
 
 #include <gui/BufferItem.h>
+#include <gui/BufferQueueControlBlock.h>
 #include <gui/BufferQueueCore.h>
 #include <gui/IConsumerListener.h>
 #include <gui/IGraphicBufferAlloc.h>
@@ -72,7 +76,18 @@ BufferQueueCore::BufferQueueCore(const sp<IGraphicBufferAlloc>& allocator) :
     mIsAllocatingCondition(),
     mAllowAllocation(true),
     mBufferAge(0),
-    mGenerationNumber(0)
+    mGenerationNumber(0),
+    mControlBlock(),
+    mPreallocateBuffers(false),
+    mPreallocationRequested(false),
+    mPreallocationCondition(),
+    mPreallocationUsage(0),
+    mPreallocationFormat(PIXEL_FORMAT_UNKNOWN),
+    mPreallocationUsesDefaultSize(true),
+    mProducerUid(static_cast<uid_t>(-1)),
+    mFrameEventHistory(),
+    mCoalesceFrameAvailable(false),
+    mFrameAvailablePending(false)
 {
     if (allocator == NULL) {
         sp<ISurfaceComposer> composer(ComposerService::getComposerService());
@@ -199,7 +214,11 @@ status_t BufferQueueCore::setDefaultMaxBufferCountLocked(int count) {
 void BufferQueueCore::freeBufferLocked(int slot) {
     BQ_LOGV("freeBufferLocked: slot %d", slot);
     bool hadBuffer = mSlots[slot].mGraphicBuffer != NULL;
+    if (hadBuffer && mSlots[slot].mBufferState == BufferSlot::FREE) {
+        recycleBufferLocked(slot);
+    }
     mSlots[slot].mGraphicBuffer.clear();
+    mSlots[slot].mAllocatedByQueue = false;
     if (mSlots[slot].mBufferState == BufferSlot::ACQUIRED) {
         mSlots[slot].mNeedsCleanupOnRelease = true;
     }
@@ -224,6 +243,16 @@ void BufferQueueCore::freeBufferLocked(int slot) {
     validateConsistencyLocked();
 }
 
+void BufferQueueCore::recycleBufferLocked(int slot) {
+    if (mSlots[slot].mGraphicBuffer == NULL ||
+            !mSlots[slot].mAllocatedByQueue ||
+            mProducerUid == static_cast<uid_t>(-1)) {
+        return;
+    }
+    mAllocator->recycleGraphicBuffer(mSlots[slot].mGraphicBuffer,
+            mSlots[slot].mFence, mProducerUid);
+}
+
 void BufferQueueCore::freeAllBuffersLocked() {
     mBufferHasBeenQueued = false;
     for (int s = 0; s < BufferQueueDefs::NUM_BUFFER_SLOTS; ++s) {
@@ -255,6 +284,7 @@ void BufferQueueCore::waitWhileAllocatingLocked() const {
 }
 
 void BufferQueueCore::validateConsistencyLocked() const {
+#if VALIDATE_CONSISTENCY
     static const useconds_t PAUSE_TIME = 0;
     for (int slot = 0; slot < BufferQueueDefs::NUM_BUFFER_SLOTS; ++slot) {
         bool isInFreeSlots = mFreeSlots.count(slot) != 0;
@@ -296,6 +326,38 @@ void BufferQueueCore::validateConsistencyLocked() const {
             }
         }
     }
+#endif
+}
+
+void BufferQueueCore::publishStateLocked() {
+    if (mControlBlock == NULL) {
+        return;
+    }
+
+    BufferQueueControlBlock::State state;
+    state.defaultWidth = mDefaultWidth;
+    state.defaultHeight = mDefaultHeight;
+    state.defaultFormat = static_cast<int32_t>(mDefaultBufferFormat);
+    state.defaultDataSpace = static_cast<int32_t>(mDefaultBufferDataSpace);
+    state.transformHint = mTransformHint;
+    state.numPendingBuffers = static_cast<uint32_t>(mQueue.size());
+    state.consumerUsageBits = mConsumerUsageBits;
+    state.minUndequeuedBuffers = getMinUndequeuedBufferCountLocked(false);
+    state.bufferAge = mBufferAge > INT32_MAX ?
+            0 : static_cast<int32_t>(mBufferAge);
+    state.frameCounter = mFrameCounter;
+    state.isAbandoned = mIsAbandoned;
+    mControlBlock->publish(state);
+}
+
+void BufferQueueCore::requestPreallocationLocked() {
+    if (!mPreallocateBuffers || mIsAbandoned || !mAllowAllocation ||
+            mConnectedApi == NO_CONNECTED_API ||
+            !mPreallocationUsesDefaultSize) {
+        return;
+    }
+    mPreallocationRequested = true;
+    mPreallocationCondition.broadcast();
 }
 
 } // namespace android
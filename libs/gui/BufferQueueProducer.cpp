@@ -22,7 +22,10 @@
 
 #define EGL_EGLEXT_PROTOTYPES
 
+#include <binder/IPCThreadState.h>
+
 #include <gui/BufferItem.h>
+#include <gui/BufferQueueControlBlock.h>
 #include <gui/BufferQueueCore.h>
 #include <gui/BufferQueueProducer.h>
 #include <gui/IConsumerListener.h>
@@ -30,10 +33,54 @@
 #include <gui/IProducerListener.h>
 
 #include <utils/Log.h>
+#include <utils/Thread.h>
 #include <utils/Trace.h>
 
 namespace android {
 
+class BufferQueueProducer::Preallocator : public Thread {
+public:
+    Preallocator(const sp<BufferQueueCore>& core,
+            const wp<BufferQueueProducer>& producer);
+    virtual ~Preallocator();
+
+private:
+    virtual bool threadLoop();
+
+    sp<BufferQueueCore> mCore;
+    wp<BufferQueueProducer> mProducer;
+};
+
+BufferQueueProducer::Preallocator::Preallocator(
+        const sp<BufferQueueCore>& core,
+        const wp<BufferQueueProducer>& producer) :
+    Thread(false),
+    mCore(core),
+    mProducer(producer) {}
+
+BufferQueueProducer::Preallocator::~Preallocator() {}
+
+bool BufferQueueProducer::Preallocator::threadLoop() {
+    { // Autolock scope
+        Mutex::Autolock lock(mCore->mMutex);
+        while (!mCore->mPreallocationRequested && !mCore->mIsAbandoned &&
+                !exitPending()) {
+            mCore->mPreallocationCondition.wait(mCore->mMutex);
+        }
+        if (mCore->mIsAbandoned || exitPending()) {
+            return false;
+        }
+        mCore->mPreallocationRequested = false;
+    } // Autolock scope
+
+    sp<BufferQueueProducer> producer(mProducer.promote());
+    if (producer == NULL) {
+        return false;
+    }
+    producer->preallocateBuffers();
+    return true;
+}
+
 BufferQueueProducer::BufferQueueProducer(const sp<BufferQueueCore>& core) :
     mCore(core),
     mSlots(core->mSlots),
@@ -45,7 +92,13 @@ BufferQueueProducer::BufferQueueProducer(const sp<BufferQueueCore>& core) :
     mCurrentCallbackTicket(0),
     mCallbackCondition() {}
 
-BufferQueueProducer::~BufferQueueProducer() {}
+BufferQueueProducer::~BufferQueueProducer() {
+    Mutex::Autolock lock(mCore->mMutex);
+    if (mPreallocator != NULL) {
+        mPreallocator->requestExit();
+        mCore->mPreallocationCondition.broadcast();
+    }
+}
 
 status_t BufferQueueProducer::requestBuffer(int slot, sp<GraphicBuffer>* buf) {
     ATRACE_CALL();
@@ -256,11 +309,6 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
         sp<android::Fence> *outFence, bool async,
         uint32_t width, uint32_t height, PixelFormat format, uint32_t usage) {
     ATRACE_CALL();
-    { // Autolock scope
-        Mutex::Autolock lock(mCore->mMutex);
-        mConsumerName = mCore->mConsumerName;
-    } // Autolock scope
-
     BQ_LOGV("dequeueBuffer: async=%s w=%u h=%u format=%#x, usage=%#x",
             async ? "true" : "false", width, height, format, usage);
 
@@ -273,11 +321,19 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
     EGLDisplay eglDisplay = EGL_NO_DISPLAY;
     EGLSyncKHR eglFence = EGL_NO_SYNC_KHR;
     bool attachedByConsumer = false;
+    bool needsReallocation = false;
 
     { // Autolock scope
         Mutex::Autolock lock(mCore->mMutex);
+        mConsumerName = mCore->mConsumerName;
         mCore->waitWhileAllocatingLocked();
 
+        // Remember what to pre-allocate, before the defaults are applied
+        const bool useDefaultSize = !width && !height;
+        mCore->mPreallocationFormat = format;
+        mCore->mPreallocationUsage = usage;
+        mCore->mPreallocationUsesDefaultSize = useDefaultSize;
+
         if (format == 0) {
             format = mCore->mDefaultBufferFormat;
         }
@@ -285,7 +341,6 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
         // Enable the usage bits the consumer requested
         usage |= mCore->mConsumerUsageBits;
 
-        const bool useDefaultSize = !width && !height;
         if (useDefaultSize) {
             width = mCore->mDefaultWidth;
             height = mCore->mDefaultHeight;
@@ -324,15 +379,22 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
         ATRACE_BUFFER_INDEX(found);
 
         attachedByConsumer = mSlots[found].mAttachedByConsumer;
+        needsReallocation = mSlots[found].mNeedsReallocation;
+        mSlots[found].mNeedsReallocation = false;
 
         mSlots[found].mBufferState = BufferSlot::DEQUEUED;
+        mSlots[found].mDequeueTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
         const sp<GraphicBuffer>& buffer(mSlots[found].mGraphicBuffer);
         if ((buffer == NULL) ||
                 buffer->needsReallocation(width, height, format, usage))
         {
+            // The slot was FREE until just now, so its old buffer can go
+            // back to the allocator
+            mCore->recycleBufferLocked(found);
             mSlots[found].mAcquireCalled = false;
             mSlots[found].mGraphicBuffer = NULL;
+            mSlots[found].mAllocatedByQueue = false;
             mSlots[found].mRequestBufferCalled = false;
             mSlots[found].mEglDisplay = EGL_NO_DISPLAY;
             mSlots[found].mEglFence = EGL_NO_SYNC_KHR;
@@ -349,6 +411,7 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
 
         BQ_LOGV("dequeueBuffer: setting buffer age to %" PRIu64,
                 mCore->mBufferAge);
+        mCore->publishStateLocked();
 
         if (CC_UNLIKELY(mSlots[found].mFence == NULL)) {
             BQ_LOGE("dequeueBuffer: about to return a NULL fence - "
@@ -385,10 +448,11 @@ status_t BufferQueueProducer::dequeueBuffer(int *outSlot,
 
             graphicBuffer->setGenerationNumber(mCore->mGenerationNumber);
             mSlots[*outSlot].mGraphicBuffer = graphicBuffer;
+            mSlots[*outSlot].mAllocatedByQueue = true;
         } // Autolock scope
     }
 
-    if (attachedByConsumer) {
+    if (attachedByConsumer || needsReallocation) {
         returnFlags |= BUFFER_NEEDS_REALLOCATION;
     }
 
@@ -478,6 +542,8 @@ status_t BufferQueueProducer::detachNextBuffer(sp<GraphicBuffer>* outBuffer,
 
     *outBuffer = mSlots[found].mGraphicBuffer;
     *outFence = mSlots[found].mFence;
+    // the caller owns the buffer now, so it mustn't be recycled
+    mSlots[found].mAllocatedByQueue = false;
     mCore->freeBufferLocked(found);
     mCore->validateConsistencyLocked();
 
@@ -529,7 +595,9 @@ status_t BufferQueueProducer::attachBuffer(int* outSlot,
             *outSlot, returnFlags);
 
     mSlots[*outSlot].mGraphicBuffer = buffer;
+    mSlots[*outSlot].mAllocatedByQueue = false;
     mSlots[*outSlot].mBufferState = BufferSlot::DEQUEUED;
+    mSlots[*outSlot].mDequeueTime = systemTime(SYSTEM_TIME_MONOTONIC);
     mSlots[*outSlot].mEglFence = EGL_NO_SYNC_KHR;
     mSlots[*outSlot].mFence = Fence::NO_FENCE;
     mSlots[*outSlot].mRequestBufferCalled = true;
@@ -636,6 +704,9 @@ status_t BufferQueueProducer::queueBuffer(int slot,
         mSlots[slot].mBufferState = BufferSlot::QUEUED;
         ++mCore->mFrameCounter;
         mSlots[slot].mFrameNumber = mCore->mFrameCounter;
+        mCore->mFrameEventHistory.addQueue(mCore->mFrameCounter,
+                mSlots[slot].mDequeueTime, systemTime(SYSTEM_TIME_MONOTONIC),
+                timestamp);
 
         item.mAcquireCalled = mSlots[slot].mAcquireCalled;
         item.mGraphicBuffer = mSlots[slot].mGraphicBuffer;
@@ -681,12 +752,24 @@ status_t BufferQueueProducer::queueBuffer(int slot,
             }
         }
 
+        if (frameAvailableListener != NULL && mCore->mCoalesceFrameAvailable) {
+            if (mCore->mFrameAvailablePending) {
+                // The consumer hasn't acquired since the last callback, it
+                // will find this buffer through BufferItem::mCoalescedFrames
+                frameAvailableListener.clear();
+            } else {
+                mCore->mFrameAvailablePending = true;
+            }
+        }
+
         mCore->mBufferHasBeenQueued = true;
         mCore->mDequeueCondition.broadcast();
 
         output->inflate(mCore->mDefaultWidth, mCore->mDefaultHeight,
                 mCore->mTransformHint,
                 static_cast<uint32_t>(mCore->mQueue.size()));
+        output->setFrameNumber(mCore->mFrameCounter);
+        mCore->publishStateLocked();
 
         ATRACE_INT(mCore->mConsumerName.string(), mCore->mQueue.size());
 
@@ -880,6 +963,16 @@ status_t BufferQueueProducer::connect(const sp<IProducerListener>& listener,
     mCore->mDequeueBufferCannotBlock =
             mCore->mConsumerControlledByApp && producerControlledByApp;
     mCore->mAllowAllocation = true;
+    mCore->mProducerUid = IPCThreadState::self()->getCallingUid();
+    mCore->publishStateLocked();
+
+    if (status == NO_ERROR && mCore->mPreallocateBuffers) {
+        if (mPreallocator == NULL) {
+            mPreallocator = new Preallocator(mCore, this);
+            mPreallocator->run("BufferQueuePreallocator", PRIORITY_BACKGROUND);
+        }
+        mCore->requestPreallocationLocked();
+    }
 
     return status;
 }
@@ -1054,7 +1147,9 @@ void BufferQueueProducer::allocateBuffers(bool async, uint32_t width,
                 }
                 mCore->freeBufferLocked(slot); // Clean up the slot first
                 mSlots[slot].mGraphicBuffer = buffers[i];
+                mSlots[slot].mAllocatedByQueue = true;
                 mSlots[slot].mFence = Fence::NO_FENCE;
+                mSlots[slot].mNeedsReallocation = true;
 
                 // freeBufferLocked puts this slot on the free slots list. Since
                 // we then attached a buffer, move the slot to free buffer list.
@@ -1071,6 +1166,44 @@ void BufferQueueProducer::allocateBuffers(bool async, uint32_t width,
     }
 }
 
+void BufferQueueProducer::preallocateBuffers() {
+    ATRACE_CALL();
+    PixelFormat format = PIXEL_FORMAT_UNKNOWN;
+    uint32_t usage = 0;
+    { // Autolock scope
+        Mutex::Autolock lock(mCore->mMutex);
+        mCore->waitWhileAllocatingLocked();
+
+        if (mCore->mIsAbandoned || !mCore->mAllowAllocation ||
+                mCore->mConnectedApi == BufferQueueCore::NO_CONNECTED_API) {
+            return;
+        }
+
+        format = mCore->mPreallocationFormat;
+        usage = mCore->mPreallocationUsage;
+        PixelFormat checkFormat = format != 0 ?
+                format : mCore->mDefaultBufferFormat;
+        uint32_t checkUsage = usage | mCore->mConsumerUsageBits;
+
+        // Free the buffers that dequeueBuffer would have to reallocate anyway
+        // (e.g. the old size after a rotation); freeBufferLocked modifies
+        // mFreeBuffers, so walk a copy of it
+        std::list<int> freeBuffers(mCore->mFreeBuffers);
+        for (int slot : freeBuffers) {
+            const sp<GraphicBuffer>& buffer(mSlots[slot].mGraphicBuffer);
+            if (buffer != NULL && buffer->needsReallocation(
+                    mCore->mDefaultWidth, mCore->mDefaultHeight,
+                    checkFormat, checkUsage)) {
+                BQ_LOGV("preallocateBuffers: freeing stale buffer in slot %d",
+                        slot);
+                mCore->freeBufferLocked(slot);
+            }
+        }
+    } // Autolock scope
+
+    allocateBuffers(false, 0, 0, format, usage);
+}
+
 status_t BufferQueueProducer::allowAllocation(bool allow) {
     ATRACE_CALL();
     BQ_LOGV("allowAllocation: %s", allow ? "true" : "false");
@@ -1095,6 +1228,76 @@ String8 BufferQueueProducer::getConsumerName() const {
     return mConsumerName;
 }
 
+status_t BufferQueueProducer::getControlBlock(sp<IMemoryHeap>* outHeap) {
+    ATRACE_CALL();
+    Mutex::Autolock lock(mCore->mMutex);
+
+    if (mCore->mIsAbandoned) {
+        BQ_LOGE("getControlBlock: BufferQueue has been abandoned");
+        return NO_INIT;
+    }
+
+    if (outHeap == NULL) {
+        BQ_LOGE("getControlBlock: outHeap was NULL");
+        return BAD_VALUE;
+    }
+
+    if (mCore->mControlBlock == NULL) {
+        mCore->mControlBlock = BufferQueueControlBlock::create();
+        if (mCore->mControlBlock == NULL) {
+            return NO_MEMORY;
+        }
+        mCore->publishStateLocked();
+    }
+
+    *outHeap = mCore->mControlBlock->getHeap();
+    return NO_ERROR;
+}
+
+status_t BufferQueueProducer::getFrameTimestamps(uint64_t frameNumber,
+        FrameTimestamps* outTimestamps) {
+    ATRACE_CALL();
+    Mutex::Autolock lock(mCore->mMutex);
+
+    if (mCore->mIsAbandoned) {
+        BQ_LOGE("getFrameTimestamps: BufferQueue has been abandoned");
+        return NO_INIT;
+    }
+
+    if (outTimestamps == NULL) {
+        BQ_LOGE("getFrameTimestamps: outTimestamps was NULL");
+        return BAD_VALUE;
+    }
+
+    if (!mCore->mFrameEventHistory.getFrameTimestamps(frameNumber,
+            outTimestamps)) {
+        BQ_LOGV("getFrameTimestamps: frame %" PRIu64 " is not in the history",
+                frameNumber);
+        return BAD_VALUE;
+    }
+    return NO_ERROR;
+}
+
+status_t BufferQueueProducer::queueBufferAsync(int slot,
+        const QueueBufferInput& input, int32_t serial) {
+    ATRACE_CALL();
+    // queueBuffer publishes the output to the control block itself
+    QueueBufferOutput output;
+    status_t result = queueBuffer(slot, input, &output);
+
+    sp<BufferQueueControlBlock> controlBlock;
+    { // Autolock scope
+        Mutex::Autolock lock(mCore->mMutex);
+        controlBlock = mCore->mControlBlock;
+    }
+    if (controlBlock == NULL) {
+        BQ_LOGE("queueBufferAsync: no control block to report to");
+        return result;
+    }
+    controlBlock->completeQueue(serial, result);
+    return NO_ERROR;
+}
+
 void BufferQueueProducer::binderDied(const wp<android::IBinder>& /* who */) {
     // If we're here, it means that a producer we were connected to died.
     // We're guaranteed that we are still connected to it because we remove
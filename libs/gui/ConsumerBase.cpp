@@ -270,9 +270,13 @@ status_t ConsumerBase::addReleaseFenceLocked(int slot,
     if (!mSlots[slot].mFence.get()) {
         mSlots[slot].mFence = fence;
     } else {
-        sp<Fence> mergedFence = Fence::merge(
-                String8::format("%.28s:%d", mName.string(), slot),
-                mSlots[slot].mFence, fence);
+        // Skips the merge when either fence has already signaled, which is
+        // common for buffers shown on several displays
+        Vector< sp<Fence> > fences;
+        fences.add(mSlots[slot].mFence);
+        fences.add(fence);
+        sp<Fence> mergedFence = Fence::mergeMany(
+                String8::format("%.28s:%d", mName.string(), slot), fences);
         if (!mergedFence.get()) {
             CB_LOGE("failed to merge release fences");
             // synchronization is broken, the best we can do is hope fences
@@ -18,6 +18,9 @@
 #define LOG_TAG "CpuConsumer"
 //#define ATRACE_TAG ATRACE_TAG_GRAPHICS
 
+#include <inttypes.h>
+#include <string.h>
+
 #include <cutils/compiler.h>
 #include <utils/Log.h>
 #include <gui/BufferItem.h>
@@ -37,6 +40,8 @@ CpuConsumer::CpuConsumer(const sp<IGraphicBufferConsumer>& bq,
     mMaxLockedBuffers(maxLockedBuffers),
     mCurrentLockedBuffers(0)
 {
+    memset(&mLockStats, 0, sizeof(mLockStats));
+
     // Create tracking entries for locked buffers
     mAcquiredBuffers.insertAt(0, maxLockedBuffers);
 
@@ -83,9 +88,36 @@ static bool isPossiblyYUV(PixelFormat format) {
 }
 
 status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
+    if (!nativeBuffer) return BAD_VALUE;
+
+    Mutex::Autolock _l(mMutex);
+    return lockNextBufferLocked(nativeBuffer);
+}
+
+status_t CpuConsumer::lockNextBuffers(LockedBuffer *nativeBuffers,
+        size_t maxBuffers, size_t *outCount) {
+    if (!nativeBuffers || !outCount || maxBuffers == 0) return BAD_VALUE;
+    *outCount = 0;
+
+    Mutex::Autolock _l(mMutex);
+    while (*outCount < maxBuffers) {
+        status_t err = lockNextBufferLocked(&nativeBuffers[*outCount]);
+        if (err != OK) {
+            // Running out of buffers or lock slots ends the batch; only
+            // report it if nothing was locked at all
+            return (*outCount > 0) ? OK : err;
+        }
+        (*outCount)++;
+        if (mCurrentLockedBuffers == mMaxLockedBuffers) {
+            break;
+        }
+    }
+    return OK;
+}
+
+status_t CpuConsumer::lockNextBufferLocked(LockedBuffer *nativeBuffer) {
     status_t err;
 
-    if (!nativeBuffer) return BAD_VALUE;
     if (mCurrentLockedBuffers == mMaxLockedBuffers) {
         CC_LOGW("Max buffers have been locked (%zd), cannot lock anymore.",
                 mMaxLockedBuffers);
@@ -93,8 +125,7 @@ status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
     }
 
     BufferItem b;
-
-    Mutex::Autolock _l(mMutex);
+    const nsecs_t lockStart = systemTime(SYSTEM_TIME_MONOTONIC);
 
     err = acquireBufferLocked(&b, 0);
     if (err != OK) {
@@ -172,6 +203,7 @@ status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
     ab.mSlot = buf;
     ab.mBufferPointer = bufferPointer;
     ab.mGraphicBuffer = mSlots[buf].mGraphicBuffer;
+    ab.mLockedTime = systemTime(SYSTEM_TIME_MONOTONIC);
 
     nativeBuffer->data   =
             reinterpret_cast<uint8_t*>(bufferPointer);
@@ -197,6 +229,13 @@ status_t CpuConsumer::lockNextBuffer(LockedBuffer *nativeBuffer) {
 
     mCurrentLockedBuffers++;
 
+    const nsecs_t lockTime = ab.mLockedTime - lockStart;
+    mLockStats.lockedFrames++;
+    mLockStats.totalLockTime += lockTime;
+    if (lockTime > mLockStats.maxLockTime) {
+        mLockStats.maxLockTime = lockTime;
+    }
+
     return OK;
 }
 
@@ -246,16 +285,57 @@ status_t CpuConsumer::releaseAcquiredBufferLocked(size_t lockedIdx) {
     }
 
     AcquiredBuffer &ab = mAcquiredBuffers.editItemAt(lockedIdx);
+    const nsecs_t holdTime = systemTime(SYSTEM_TIME_MONOTONIC) -
+            ab.mLockedTime;
+    mLockStats.totalHoldTime += holdTime;
+    if (holdTime > mLockStats.maxHoldTime) {
+        mLockStats.maxHoldTime = holdTime;
+    }
+
     ab.mSlot = BufferQueue::INVALID_BUFFER_SLOT;
     ab.mBufferPointer = NULL;
     ab.mGraphicBuffer.clear();
+    ab.mLockedTime = 0;
 
     mCurrentLockedBuffers--;
     return OK;
 }
 
+void CpuConsumer::getLockStats(LockStats *outStats) const {
+    if (!outStats) return;
+    Mutex::Autolock _l(mMutex);
+    *outStats = mLockStats;
+}
+
+void CpuConsumer::resetLockStats() {
+    Mutex::Autolock _l(mMutex);
+    memset(&mLockStats, 0, sizeof(mLockStats));
+}
+
 void CpuConsumer::freeBufferLocked(int slotIndex) {
     ConsumerBase::freeBufferLocked(slotIndex);
 }
 
+static double toMicroseconds(nsecs_t time) {
+    return static_cast<double>(time) / 1000.0;
+}
+
+void CpuConsumer::dumpLocked(String8& result, const char* prefix) const {
+    const uint64_t frames = mLockStats.lockedFrames;
+    result.appendFormat(
+            "%smCurrentLockedBuffers=%zu mMaxLockedBuffers=%zu\n"
+            "%slocked frames=%" PRIu64 " lock avg=%.1fus max=%.1fus"
+            " hold avg=%.1fus max=%.1fus\n",
+            prefix, mCurrentLockedBuffers, mMaxLockedBuffers,
+            prefix, frames,
+            frames ? toMicroseconds(mLockStats.totalLockTime) /
+                    static_cast<double>(frames) : 0.0,
+            toMicroseconds(mLockStats.maxLockTime),
+            frames ? toMicroseconds(mLockStats.totalHoldTime) /
+                    static_cast<double>(frames) : 0.0,
+            toMicroseconds(mLockStats.maxHoldTime));
+
+    ConsumerBase::dumpLocked(result, prefix);
+}
+
 } // namespace android
@@ -0,0 +1,120 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "DisplayEventControlBlock"
+//#define LOG_NDEBUG 0
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include <gui/DisplayEventControlBlock.h>
+
+#include <binder/IMemory.h>
+#include <binder/MemoryHeapBase.h>
+
+#include <cutils/atomic.h>
+
+#include <utils/Log.h>
+
+namespace android {
+
+struct DisplayEventControlBlock::SharedBlock {
+    struct Vsync {
+        // Odd while publishVsync() is updating this entry
+        volatile int32_t sequence;
+        uint32_t count;
+        nsecs_t timestamp;
+        nsecs_t period;
+    };
+    Vsync vsync[NUM_DISPLAYS];
+};
+
+// A reader racing with publishVsync() retries this many times before giving up
+static const int MAX_READ_ATTEMPTS = 4;
+
+sp<DisplayEventControlBlock> DisplayEventControlBlock::create() {
+    sp<MemoryHeapBase> heap = new MemoryHeapBase(sizeof(SharedBlock),
+            MemoryHeapBase::READ_ONLY, "DisplayEventControlBlock");
+    if (heap->getHeapID() < 0 || heap->getBase() == MAP_FAILED) {
+        ALOGE("create: failed to allocate control block");
+        return NULL;
+    }
+    SharedBlock* block = static_cast<SharedBlock*>(heap->getBase());
+    memset(block, 0, sizeof(SharedBlock));
+    return new DisplayEventControlBlock(heap, block);
+}
+
+sp<DisplayEventControlBlock> DisplayEventControlBlock::attach(
+        const sp<IMemoryHeap>& heap) {
+    if (heap == NULL || heap->getHeapID() < 0 ||
+            heap->getBase() == MAP_FAILED ||
+            heap->getSize() < sizeof(SharedBlock)) {
+        ALOGE("attach: invalid control block");
+        return NULL;
+    }
+    return new DisplayEventControlBlock(heap,
+            static_cast<SharedBlock*>(heap->getBase()));
+}
+
+DisplayEventControlBlock::DisplayEventControlBlock(const sp<IMemoryHeap>& heap,
+        SharedBlock* block) :
+    mHeap(heap),
+    mBlock(block) {}
+
+DisplayEventControlBlock::~DisplayEventControlBlock() {}
+
+void DisplayEventControlBlock::publishVsync(int32_t display, nsecs_t timestamp,
+        uint32_t count, nsecs_t period) {
+    if (display < 0 || display >= NUM_DISPLAYS) {
+        return;
+    }
+    SharedBlock::Vsync& vsync(mBlock->vsync[display]);
+    // android_atomic_inc is a full barrier, so the stores can't move ahead
+    // of the first increment or behind the second
+    android_atomic_inc(&vsync.sequence);
+    vsync.count = count;
+    vsync.timestamp = timestamp;
+    vsync.period = period;
+    android_atomic_inc(&vsync.sequence);
+}
+
+bool DisplayEventControlBlock::readVsync(int32_t display,
+        nsecs_t* outTimestamp, uint32_t* outCount, nsecs_t* outPeriod) const {
+    if (display < 0 || display >= NUM_DISPLAYS) {
+        return false;
+    }
+    const SharedBlock::Vsync& vsync(mBlock->vsync[display]);
+    for (int attempt = 0; attempt < MAX_READ_ATTEMPTS; ++attempt) {
+        int32_t sequence = android_atomic_acquire_load(&vsync.sequence);
+        if (sequence & 1) {
+            continue;
+        }
+        nsecs_t timestamp = vsync.timestamp;
+        uint32_t count = vsync.count;
+        nsecs_t period = vsync.period;
+        android_memory_barrier();
+        if (android_atomic_acquire_load(&vsync.sequence) == sequence) {
+            *outTimestamp = timestamp;
+            *outCount = count;
+            *outPeriod = period;
+            return true;
+        }
+    }
+    ALOGV("readVsync: gave up after %d attempts", MAX_READ_ATTEMPTS);
+    return false;
+}
+
+} // namespace android
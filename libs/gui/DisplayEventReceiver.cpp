@@ -18,7 +18,10 @@
 
 #include <utils/Errors.h>
 
+#include <binder/IMemory.h>
+
 #include <gui/BitTube.h>
+#include <gui/DisplayEventControlBlock.h>
 #include <gui/DisplayEventReceiver.h>
 #include <gui/IDisplayEventConnection.h>
 #include <gui/ISurfaceComposer.h>
@@ -37,6 +40,10 @@ DisplayEventReceiver::DisplayEventReceiver() {
         mEventConnection = sf->createDisplayEventConnection();
         if (mEventConnection != NULL) {
             mDataChannel = mEventConnection->getDataChannel();
+            sp<IMemoryHeap> heap(mEventConnection->getControlBlock());
+            if (heap != NULL) {
+                mControlBlock = DisplayEventControlBlock::attach(heap);
+            }
         }
     }
 }
@@ -76,6 +83,32 @@ status_t DisplayEventReceiver::requestNextVsync() {
     return NO_INIT;
 }
 
+status_t DisplayEventReceiver::getLatestVsync(int32_t displayId,
+        nsecs_t* outTimestamp, uint32_t* outCount, nsecs_t* outPeriod) const {
+    if (mControlBlock == NULL)
+        return NO_INIT;
+
+    if (displayId < 0 || displayId >= DisplayEventControlBlock::NUM_DISPLAYS ||
+            outTimestamp == NULL || outCount == NULL || outPeriod == NULL)
+        return BAD_VALUE;
+
+    if (!mControlBlock->readVsync(displayId, outTimestamp, outCount, outPeriod))
+        return WOULD_BLOCK;
+
+    // SurfaceFlinger only publishes when its vsync model gets a new sample,
+    // so carry the last vsync forward to now.
+    const nsecs_t period = *outPeriod;
+    if (period > 0 && *outTimestamp > 0) {
+        const nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - *outTimestamp;
+        if (elapsed >= period) {
+            const nsecs_t periods = elapsed / period;
+            *outTimestamp += periods * period;
+            *outCount += uint32_t(periods);
+        }
+    }
+    return NO_ERROR;
+}
+
 
 ssize_t DisplayEventReceiver::getEvents(DisplayEventReceiver::Event* events,
         size_t count) {
@@ -85,13 +118,15 @@ ssize_t DisplayEventReceiver::getEvents(DisplayEventReceiver::Event* events,
 ssize_t DisplayEventReceiver::getEvents(const sp<BitTube>& dataChannel,
         Event* events, size_t count)
 {
-    return BitTube::recvObjects(dataChannel, events, count);
+    // Every event is sent in a message of its own (see sendEvents), so a
+    // burst of them can be drained with a single system call.
+    return BitTube::recvObjectsBatch(dataChannel, events, count, 1);
 }
 
 ssize_t DisplayEventReceiver::sendEvents(const sp<BitTube>& dataChannel,
         Event const* events, size_t count)
 {
-    return BitTube::sendObjects(dataChannel, events, count);
+    return BitTube::sendObjectsBatch(dataChannel, events, count, 1);
 }
 
 // ---------------------------------------------------------------------------
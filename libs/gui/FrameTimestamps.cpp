@@ -0,0 +1,109 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gui/FrameTimestamps.h>
+
+#include <ui/Fence.h>
+
+namespace android {
+
+// Converts a fence's signal time to a FrameTimestamps time, using fallback
+// if the fence isn't valid
+static nsecs_t resolveFenceTime(const sp<Fence>& fence, nsecs_t fallback) {
+    if (fence == NULL || !fence->isValid()) {
+        return fallback;
+    }
+    nsecs_t signalTime = fence->getSignalTime();
+    if (signalTime == INT64_MAX || signalTime < 0) {
+        return 0;
+    }
+    return signalTime;
+}
+
+FrameEventHistory::FrameEventHistory() {}
+
+FrameEventHistory::Event* FrameEventHistory::getEvent(uint64_t frameNumber) {
+    Event& event(mEvents[frameNumber % MAX_FRAME_HISTORY]);
+    if (frameNumber == 0 || event.timestamps.frameNumber != frameNumber) {
+        return NULL;
+    }
+    return &event;
+}
+
+const FrameEventHistory::Event* FrameEventHistory::getEvent(
+        uint64_t frameNumber) const {
+    const Event& event(mEvents[frameNumber % MAX_FRAME_HISTORY]);
+    if (frameNumber == 0 || event.timestamps.frameNumber != frameNumber) {
+        return NULL;
+    }
+    return &event;
+}
+
+void FrameEventHistory::addQueue(uint64_t frameNumber, nsecs_t dequeueTime,
+        nsecs_t queueTime, nsecs_t requestedPresentTime) {
+    Event& event(mEvents[frameNumber % MAX_FRAME_HISTORY]);
+    event.timestamps = FrameTimestamps();
+    event.timestamps.frameNumber = frameNumber;
+    event.timestamps.requestedPresentTime = requestedPresentTime;
+    event.timestamps.dequeueTime = dequeueTime;
+    event.timestamps.queueTime = queueTime;
+    event.presentFence.clear();
+    event.releaseFence.clear();
+}
+
+void FrameEventHistory::addAcquire(uint64_t frameNumber,
+        nsecs_t acquireTime) {
+    Event* event = getEvent(frameNumber);
+    if (event != NULL) {
+        event->timestamps.acquireTime = acquireTime;
+    }
+}
+
+void FrameEventHistory::addComposition(uint64_t frameNumber,
+        nsecs_t latchTime, const sp<Fence>& presentFence,
+        nsecs_t presentTime) {
+    Event* event = getEvent(frameNumber);
+    if (event != NULL) {
+        event->timestamps.latchTime = latchTime;
+        event->timestamps.presentTime = presentTime;
+        event->presentFence = presentFence;
+    }
+}
+
+void FrameEventHistory::addRelease(uint64_t frameNumber,
+        const sp<Fence>& releaseFence, nsecs_t releaseTime) {
+    Event* event = getEvent(frameNumber);
+    if (event != NULL) {
+        event->timestamps.releaseTime = releaseTime;
+        event->releaseFence = releaseFence;
+    }
+}
+
+bool FrameEventHistory::getFrameTimestamps(uint64_t frameNumber,
+        FrameTimestamps* outTimestamps) const {
+    const Event* event = getEvent(frameNumber);
+    if (event == NULL) {
+        return false;
+    }
+    *outTimestamps = event->timestamps;
+    outTimestamps->presentTime = resolveFenceTime(event->presentFence,
+            event->timestamps.presentTime);
+    outTimestamps->releaseTime = resolveFenceTime(event->releaseFence,
+            event->timestamps.releaseTime);
+    return true;
+}
+
+} // namespace android
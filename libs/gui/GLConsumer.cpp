@@ -144,6 +144,9 @@ GLConsumer::GLConsumer(const sp<IGraphicBufferConsumer>& bq, uint32_t tex,
     mEglDisplay(EGL_NO_DISPLAY),
     mEglContext(EGL_NO_CONTEXT),
     mCurrentTexture(BufferQueue::INVALID_BUFFER_SLOT),
+    mCurrentTextureBound(false),
+    mEglImageCacheSize(0),
+    mHasPendingItem(false),
     mAttached(true)
 {
     GLC_LOGV("GLConsumer");
@@ -171,6 +174,9 @@ GLConsumer::GLConsumer(const sp<IGraphicBufferConsumer>& bq, uint32_t texTarget,
     mEglDisplay(EGL_NO_DISPLAY),
     mEglContext(EGL_NO_CONTEXT),
     mCurrentTexture(BufferQueue::INVALID_BUFFER_SLOT),
+    mCurrentTextureBound(false),
+    mEglImageCacheSize(0),
+    mHasPendingItem(false),
     mAttached(false)
 {
     GLC_LOGV("GLConsumer");
@@ -213,21 +219,41 @@ status_t GLConsumer::updateTexImage() {
 
     BufferItem item;
 
-    // Acquire the next buffer.
-    // In asynchronous mode the list is guaranteed to be one buffer
-    // deep, while in synchronous mode we use the oldest buffer.
-    err = acquireBufferLocked(&item, 0);
-    if (err != NO_ERROR) {
-        if (err == BufferQueue::NO_BUFFER_AVAILABLE) {
-            // We always bind the texture even if we don't update its contents.
-            GLC_LOGV("updateTexImage: no buffers were available");
+    if (mHasPendingItem) {
+        // A buffer was acquired earlier but its fence hadn't signaled yet
+        if (shouldDeferLatchLocked(mPendingItem)) {
+            GLC_LOGV("updateTexImage: pending buffer is not ready yet");
             glBindTexture(mTexTarget, mTexName);
-            err = NO_ERROR;
-        } else {
-            GLC_LOGE("updateTexImage: acquire failed: %s (%d)",
-                strerror(-err), err);
+            return NO_ERROR;
+        }
+        item = mPendingItem;
+        clearPendingItemLocked();
+    } else {
+        // Acquire the next buffer.
+        // In asynchronous mode the list is guaranteed to be one buffer
+        // deep, while in synchronous mode we use the oldest buffer.
+        err = acquireBufferLocked(&item, 0);
+        if (err != NO_ERROR) {
+            if (err == BufferQueue::NO_BUFFER_AVAILABLE) {
+                // We always bind the texture even if we don't update its
+                // contents.
+                GLC_LOGV("updateTexImage: no buffers were available");
+                glBindTexture(mTexTarget, mTexName);
+                err = NO_ERROR;
+            } else {
+                GLC_LOGE("updateTexImage: acquire failed: %s (%d)",
+                    strerror(-err), err);
+            }
+            return err;
+        }
+
+        if (shouldDeferLatchLocked(item)) {
+            // Keep the current contents until the new buffer is ready
+            GLC_LOGV("updateTexImage: deferring latch of slot %d", item.mBuf);
+            deferLatchLocked(item);
+            glBindTexture(mTexTarget, mTexName);
+            return NO_ERROR;
         }
-        return err;
     }
 
     // Release the previous buffer.
@@ -253,6 +279,14 @@ status_t GLConsumer::releaseTexImage() {
         return NO_INIT;
     }
 
+    // A pending buffer was never latched, so it can go straight back
+    if (mHasPendingItem) {
+        int pendingBuf = mPendingItem.mBuf;
+        clearPendingItemLocked();
+        releaseBufferLocked(pendingBuf, mSlots[pendingBuf].mGraphicBuffer,
+                mEglDisplay, EGL_NO_SYNC_KHR);
+    }
+
     // Make sure the EGL state is the same as in previous calls.
     status_t err = NO_ERROR;
 
@@ -296,6 +330,7 @@ status_t GLConsumer::releaseTexImage() {
 
         mCurrentTexture = BufferQueue::INVALID_BUFFER_SLOT;
         mCurrentTextureImage = mReleasedTexImage;
+        mCurrentTextureBound = false;
         mCurrentCrop.makeInvalid();
         mCurrentTransform = 0;
         mCurrentScalingMode = NATIVE_WINDOW_SCALING_MODE_FREEZE;
@@ -353,10 +388,17 @@ status_t GLConsumer::acquireBufferLocked(BufferItem *item,
 
     // If item->mGraphicBuffer is not null, this buffer has not been acquired
     // before, so any prior EglImage created is using a stale buffer. This
-    // replaces any old EglImage with a new one (using the new buffer).
+    // replaces any old EglImage with a new one (using the new buffer), unless
+    // the old one already wraps this very GraphicBuffer. An EglImage for the
+    // buffer may also still be in mEglImageCache if it was freed recently.
     if (item->mGraphicBuffer != NULL) {
         int slot = item->mBuf;
-        mEglSlots[slot].mEglImage = new EglImage(item->mGraphicBuffer);
+        const sp<EglImage>& image(mEglSlots[slot].mEglImage);
+        if (image == NULL || image->graphicBuffer() != item->mGraphicBuffer) {
+            sp<EglImage> cached(takeCachedEglImageLocked(item->mGraphicBuffer));
+            mEglSlots[slot].mEglImage = (cached != NULL) ? cached :
+                    sp<EglImage>(new EglImage(item->mGraphicBuffer));
+        }
     }
 
     return NO_ERROR;
@@ -444,6 +486,7 @@ status_t GLConsumer::updateAndReleaseLocked(const BufferItem& item)
     // Update the GLConsumer state.
     mCurrentTexture = buf;
     mCurrentTextureImage = mEglSlots[buf].mEglImage;
+    mCurrentTextureBound = false;
     mCurrentCrop = item.mCrop;
     mCurrentTransform = item.mTransform;
     mCurrentScalingMode = item.mScalingMode;
@@ -462,6 +505,13 @@ status_t GLConsumer::bindTextureImageLocked() {
         return INVALID_OPERATION;
     }
 
+    // Nothing has changed since this frame was bound and waited for in this
+    // context, so the texture already refers to it
+    if (mCurrentTextureBound && eglGetCurrentContext() == mEglContext) {
+        glBindTexture(mTexTarget, mTexName);
+        return NO_ERROR;
+    }
+
     GLenum error;
     while ((error = glGetError()) != GL_NO_ERROR) {
         GLC_LOGW("bindTextureImage: clearing GL error: %#04x", error);
@@ -505,7 +555,9 @@ status_t GLConsumer::bindTextureImageLocked() {
     }
 
     // Wait for the new buffer to be ready.
-    return doGLFenceWaitLocked();
+    err = doGLFenceWaitLocked();
+    mCurrentTextureBound = (err == NO_ERROR);
+    return err;
 }
 
 status_t GLConsumer::checkAndUpdateEglStateLocked(bool contextCheck) {
@@ -591,6 +643,7 @@ status_t GLConsumer::detachFromContext() {
     mEglDisplay = EGL_NO_DISPLAY;
     mEglContext = EGL_NO_CONTEXT;
     mAttached = false;
+    mCurrentTextureBound = false;
 
     return OK;
 }
@@ -632,6 +685,7 @@ status_t GLConsumer::attachToContext(uint32_t tex) {
     mEglContext = ctx;
     mTexName = tex;
     mAttached = true;
+    mCurrentTextureBound = false;
 
     if (mCurrentTextureImage != NULL) {
         // This may wait for a buffer a second time. This is likely required if
@@ -1008,16 +1062,155 @@ void GLConsumer::freeBufferLocked(int slotIndex) {
     if (slotIndex == mCurrentTexture) {
         mCurrentTexture = BufferQueue::INVALID_BUFFER_SLOT;
     }
+    if (mHasPendingItem && slotIndex == mPendingItem.mBuf) {
+        clearPendingItemLocked();
+    }
+    if (mEglImageCacheSize > 0 && mEglSlots[slotIndex].mEglImage != NULL) {
+        if (mEglImageCache.size() >= mEglImageCacheSize) {
+            mEglImageCache.removeAt(0);
+        }
+        mEglImageCache.push_back(mEglSlots[slotIndex].mEglImage);
+    }
     mEglSlots[slotIndex].mEglImage.clear();
     ConsumerBase::freeBufferLocked(slotIndex);
 }
 
+sp<GLConsumer::EglImage> GLConsumer::takeCachedEglImageLocked(
+        const sp<GraphicBuffer>& graphicBuffer) {
+    // The image has to wrap the same GraphicBuffer object, not just the same
+    // buffer: releasing a slot checks that its buffer handle still matches.
+    for (size_t i = 0; i < mEglImageCache.size(); i++) {
+        if (mEglImageCache[i]->graphicBuffer() == graphicBuffer) {
+            sp<EglImage> image(mEglImageCache[i]);
+            mEglImageCache.removeAt(i);
+            return image;
+        }
+    }
+    return NULL;
+}
+
+void GLConsumer::setEglImageCacheSize(size_t maxImages) {
+    Mutex::Autolock lock(mMutex);
+    mEglImageCacheSize = maxImages;
+    while (mEglImageCache.size() > mEglImageCacheSize) {
+        mEglImageCache.removeAt(0);
+    }
+}
+
 void GLConsumer::abandonLocked() {
     GLC_LOGV("abandonLocked");
     mCurrentTextureImage.clear();
+    mCurrentTextureBound = false;
+    mEglImageCache.clear();
+    clearPendingItemLocked();
     ConsumerBase::abandonLocked();
 }
 
+// ----------------------------------------------------------------------------
+
+class GLConsumer::FenceWaitCallback : public LooperCallback {
+public:
+    // FenceWaitCallback takes ownership of fenceFd, a duplicate of the fence
+    // being polled, so that it stays open for as long as the looper may
+    // still be polling it.
+    FenceWaitCallback(const wp<GLConsumer>& consumer, int fenceFd) :
+        mConsumer(consumer),
+        mFenceFd(fenceFd) {}
+
+    virtual ~FenceWaitCallback();
+
+    int getFd() const { return mFenceFd; }
+
+    virtual int handleEvent(int fd, int events, void* data);
+
+private:
+    wp<GLConsumer> mConsumer;
+    int mFenceFd;
+};
+
+GLConsumer::FenceWaitCallback::~FenceWaitCallback() {
+    close(mFenceFd);
+}
+
+int GLConsumer::FenceWaitCallback::handleEvent(int /*fd*/, int /*events*/,
+        void* /*data*/) {
+    sp<GLConsumer> consumer(mConsumer.promote());
+    if (consumer != NULL) {
+        consumer->onPendingFenceSignaled();
+    }
+    // A fence only signals once
+    return 0;
+}
+
+void GLConsumer::setFenceWaitLooper(const sp<Looper>& looper) {
+    Mutex::Autolock lock(mMutex);
+    if (looper == mFenceWaitLooper) {
+        return;
+    }
+    if (mFenceWaitCallback != NULL) {
+        mFenceWaitLooper->removeFd(mFenceWaitCallback->getFd());
+        if (looper != NULL) {
+            looper->addFd(mFenceWaitCallback->getFd(), 0, Looper::EVENT_INPUT,
+                    mFenceWaitCallback, NULL);
+        }
+    }
+    mFenceWaitLooper = looper;
+}
+
+bool GLConsumer::shouldDeferLatchLocked(const BufferItem& item) const {
+    if (mFenceWaitLooper == NULL || SyncFeatures::getInstance().useWaitSync() ||
+            !item.mFence->isValid()) {
+        return false;
+    }
+    // Any error other than a timeout is left to doGLFenceWaitLocked to report
+    return item.mFence->wait(0) == -ETIME;
+}
+
+void GLConsumer::deferLatchLocked(const BufferItem& item) {
+    mPendingItem = item;
+    mHasPendingItem = true;
+
+    int fenceFd = item.mFence->dup();
+    if (fenceFd == -1) {
+        // Without an fd to poll, updateTexImage will just have to be called
+        // again; the buffer stays pending until then
+        GLC_LOGE("deferLatchLocked: error dup'ing fence fd: %d", errno);
+        return;
+    }
+    mFenceWaitCallback = new FenceWaitCallback(this, fenceFd);
+    mFenceWaitLooper->addFd(fenceFd, 0, Looper::EVENT_INPUT,
+            mFenceWaitCallback, NULL);
+}
+
+void GLConsumer::clearPendingItemLocked() {
+    if (mFenceWaitCallback != NULL) {
+        if (mFenceWaitLooper != NULL) {
+            mFenceWaitLooper->removeFd(mFenceWaitCallback->getFd());
+        }
+        mFenceWaitCallback.clear();
+    }
+    mHasPendingItem = false;
+    mPendingItem = BufferItem();
+}
+
+void GLConsumer::onPendingFenceSignaled() {
+    sp<FrameAvailableListener> listener;
+    BufferItem item;
+    { // Autolock scope
+        Mutex::Autolock lock(mMutex);
+        if (mAbandoned || !mHasPendingItem) {
+            return;
+        }
+        listener = mFrameAvailableListener.promote();
+        item = mPendingItem;
+    }
+
+    GLC_LOGV("onPendingFenceSignaled: slot %d is ready", item.mBuf);
+    if (listener != NULL) {
+        listener->onFrameAvailable(item);
+    }
+}
+
 void GLConsumer::setName(const String8& name) {
     Mutex::Autolock _l(mMutex);
     mName = name;
@@ -15,16 +15,151 @@
  ** limitations under the License.
  */
 
+#include <inttypes.h>
+#include <stdlib.h>
+
+#include <binder/IPCThreadState.h>
+
 #include <cutils/log.h>
+#include <cutils/properties.h>
 
+#include <ui/Fence.h>
 #include <ui/GraphicBuffer.h>
 
+#include <utils/Mutex.h>
+#include <utils/Singleton.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
 #include <gui/GraphicBufferAlloc.h>
 
 // ----------------------------------------------------------------------------
 namespace android {
 // ----------------------------------------------------------------------------
 
+// Buffers that stay in the pool for longer than this are freed
+static const nsecs_t POOL_ENTRY_LIFETIME = s2ns(5);
+
+class GraphicBufferPool : public Singleton<GraphicBufferPool>
+{
+    friend class Singleton<GraphicBufferPool>;
+
+    struct Entry {
+        sp<GraphicBuffer> buffer;
+        sp<Fence> releaseFence;
+        uid_t owner;
+        size_t size;
+        nsecs_t recycleTime;
+    };
+
+    Mutex mLock;
+    size_t mBudget;
+    size_t mSize;
+    // Ordered by recycleTime, oldest first
+    Vector<Entry> mEntries;
+
+    GraphicBufferPool();
+
+    static size_t sizeOf(const sp<GraphicBuffer>& buffer);
+    void trimLocked(nsecs_t now);
+
+public:
+    bool isEnabled() const { return mBudget > 0; }
+    sp<GraphicBuffer> take(uint32_t width, uint32_t height,
+            PixelFormat format, uint32_t usage, uid_t owner);
+    void add(const sp<GraphicBuffer>& buffer, const sp<Fence>& releaseFence,
+            uid_t owner);
+};
+
+ANDROID_SINGLETON_STATIC_INSTANCE(GraphicBufferPool);
+
+GraphicBufferPool::GraphicBufferPool() :
+    Singleton<GraphicBufferPool>(), mBudget(0), mSize(0)
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("ro.sf.buffer_pool_kb", value, "0");
+    mBudget = static_cast<size_t>(atoi(value)) * 1024;
+}
+
+size_t GraphicBufferPool::sizeOf(const sp<GraphicBuffer>& buffer) {
+    uint32_t bpp = bytesPerPixel(buffer->getPixelFormat());
+    if (bpp == 0) {
+        // YUV and other formats without a fixed pixel size; 2 bytes is an
+        // upper bound for the common 4:2:0 layouts
+        bpp = 2;
+    }
+    return static_cast<size_t>(buffer->getStride()) * buffer->getHeight() * bpp;
+}
+
+void GraphicBufferPool::trimLocked(nsecs_t now) {
+    while (!mEntries.isEmpty() &&
+            (mSize > mBudget ||
+             now - mEntries[0].recycleTime > POOL_ENTRY_LIFETIME)) {
+        mSize -= mEntries[0].size;
+        mEntries.removeAt(0);
+    }
+}
+
+sp<GraphicBuffer> GraphicBufferPool::take(uint32_t width, uint32_t height,
+        PixelFormat format, uint32_t usage, uid_t owner) {
+    Mutex::Autolock _l(mLock);
+    trimLocked(systemTime(SYSTEM_TIME_MONOTONIC));
+
+    // Prefer the most recently recycled buffer
+    for (size_t i = mEntries.size(); i > 0; --i) {
+        const Entry& entry(mEntries[i - 1]);
+        const sp<GraphicBuffer>& buffer(entry.buffer);
+        if (entry.owner != owner || buffer->getWidth() != width ||
+                buffer->getHeight() != height ||
+                buffer->getPixelFormat() != format ||
+                buffer->getUsage() != usage) {
+            continue;
+        }
+        // Someone in this process still uses it, e.g. as the current
+        // texture of a layer that is going away
+        if (buffer->getStrongCount() != 1) {
+            continue;
+        }
+        // The GPU or the display may still be reading from it
+        if (entry.releaseFence != NULL &&
+                entry.releaseFence->getSignalTime() == INT64_MAX) {
+            continue;
+        }
+        sp<GraphicBuffer> result(buffer);
+        mSize -= entry.size;
+        mEntries.removeAt(i - 1);
+        return result;
+    }
+    return NULL;
+}
+
+void GraphicBufferPool::add(const sp<GraphicBuffer>& buffer,
+        const sp<Fence>& releaseFence, uid_t owner) {
+    // Protected content must never be handed to another BufferQueue
+    if (buffer == NULL ||
+            (buffer->getUsage() & GraphicBuffer::USAGE_PROTECTED)) {
+        return;
+    }
+    size_t size = sizeOf(buffer);
+    if (size > mBudget) {
+        return;
+    }
+
+    Entry entry;
+    entry.buffer = buffer;
+    entry.releaseFence = releaseFence;
+    entry.owner = owner;
+    entry.size = size;
+    entry.recycleTime = systemTime(SYSTEM_TIME_MONOTONIC);
+
+    Mutex::Autolock _l(mLock);
+    mEntries.push_back(entry);
+    mSize += size;
+    trimLocked(entry.recycleTime);
+}
+
+// ----------------------------------------------------------------------------
+
 GraphicBufferAlloc::GraphicBufferAlloc() {
 }
 
@@ -33,6 +168,18 @@ GraphicBufferAlloc::~GraphicBufferAlloc() {
 
 sp<GraphicBuffer> GraphicBufferAlloc::createGraphicBuffer(uint32_t width,
         uint32_t height, PixelFormat format, uint32_t usage, status_t* error) {
+    GraphicBufferPool& pool(GraphicBufferPool::getInstance());
+    if (pool.isEnabled()) {
+        sp<GraphicBuffer> recycled(pool.take(width, height, format, usage,
+                IPCThreadState::self()->getCallingUid()));
+        if (recycled != NULL) {
+            ALOGV("createGraphicBuffer: reusing buffer %" PRIu64,
+                    recycled->getId());
+            *error = NO_ERROR;
+            return recycled;
+        }
+    }
+
     sp<GraphicBuffer> graphicBuffer(
             new GraphicBuffer(width, height, format, usage));
     status_t err = graphicBuffer->initCheck();
@@ -49,6 +196,14 @@ sp<GraphicBuffer> GraphicBufferAlloc::createGraphicBuffer(uint32_t width,
     return graphicBuffer;
 }
 
+void GraphicBufferAlloc::recycleGraphicBuffer(const sp<GraphicBuffer>& buffer,
+        const sp<Fence>& releaseFence, uid_t owner) {
+    GraphicBufferPool& pool(GraphicBufferPool::getInstance());
+    if (pool.isEnabled()) {
+        pool.add(buffer, releaseFence, owner);
+    }
+}
+
 // ----------------------------------------------------------------------------
 }; // namespace android
 // ----------------------------------------------------------------------------
@@ -21,8 +21,9 @@
 #include <utils/RefBase.h>
 #include <utils/Timers.h>
 
-#include <binder/Parcel.h>
 #include <binder/IInterface.h>
+#include <binder/IMemory.h>
+#include <binder/Parcel.h>
 
 #include <gui/IDisplayEventConnection.h>
 #include <gui/BitTube.h>
@@ -33,7 +34,8 @@ namespace android {
 enum {
     GET_DATA_CHANNEL = IBinder::FIRST_CALL_TRANSACTION,
     SET_VSYNC_RATE,
-    REQUEST_NEXT_VSYNC
+    REQUEST_NEXT_VSYNC,
+    GET_CONTROL_BLOCK
 };
 
 class BpDisplayEventConnection : public BpInterface<IDisplayEventConnection>
@@ -66,6 +68,17 @@ public:
         data.writeInterfaceToken(IDisplayEventConnection::getInterfaceDescriptor());
         remote()->transact(REQUEST_NEXT_VSYNC, data, &reply, IBinder::FLAG_ONEWAY);
     }
+
+    virtual sp<IMemoryHeap> getControlBlock() const
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(IDisplayEventConnection::getInterfaceDescriptor());
+        status_t result = remote()->transact(GET_CONTROL_BLOCK, data, &reply);
+        if (result != NO_ERROR) {
+            return NULL;
+        }
+        return interface_cast<IMemoryHeap>(reply.readStrongBinder());
+    }
 };
 
 // Out-of-line virtual method definition to trigger vtable emission in this
@@ -96,6 +109,12 @@ status_t BnDisplayEventConnection::onTransact(
             requestNextVsync();
             return NO_ERROR;
         }
+        case GET_CONTROL_BLOCK: {
+            CHECK_INTERFACE(IDisplayEventConnection, data, reply);
+            sp<IMemoryHeap> heap(getControlBlock());
+            reply->writeStrongBinder(IInterface::asBinder(heap));
+            return NO_ERROR;
+        }
     }
     return BBinder::onTransact(code, data, reply, flags);
 }
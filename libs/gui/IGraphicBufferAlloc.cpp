@@ -77,6 +77,11 @@ BpGraphicBufferAlloc::~BpGraphicBufferAlloc() {}
 
 IMPLEMENT_META_INTERFACE(GraphicBufferAlloc, "android.ui.IGraphicBufferAlloc");
 
+void IGraphicBufferAlloc::recycleGraphicBuffer(
+        const sp<GraphicBuffer>& /*buffer*/, const sp<Fence>& /*releaseFence*/,
+        uid_t /*owner*/) {
+}
+
 // ----------------------------------------------------------------------
 
 status_t BnGraphicBufferAlloc::onTransact(
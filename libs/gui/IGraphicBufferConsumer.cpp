@@ -53,6 +53,11 @@ enum {
     SET_TRANSFORM_HINT,
     GET_SIDEBAND_STREAM,
     DUMP,
+    SET_BUFFER_PREALLOCATION,
+    SET_FRAME_COMPOSITION_INFO,
+    GET_BUFFER_MEMORY_USAGE,
+    DISCARD_FREE_BUFFERS,
+    SET_FRAME_AVAILABLE_COALESCING,
 };
 
 
@@ -257,6 +262,67 @@ public:
         return reply.readInt32();
     }
 
+    virtual status_t setBufferPreallocation(bool enabled) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferConsumer::getInterfaceDescriptor());
+        data.writeInt32(enabled);
+        status_t result = remote()->transact(SET_BUFFER_PREALLOCATION, data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        return reply.readInt32();
+    }
+
+    virtual status_t setFrameCompositionInfo(uint64_t frameNumber,
+            nsecs_t latchTime, const sp<Fence>& presentFence,
+            nsecs_t presentTime) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferConsumer::getInterfaceDescriptor());
+        data.writeUint64(frameNumber);
+        data.writeInt64(latchTime);
+        data.write(*presentFence);
+        data.writeInt64(presentTime);
+        status_t result = remote()->transact(SET_FRAME_COMPOSITION_INFO, data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        return reply.readInt32();
+    }
+
+    virtual status_t getBufferMemoryUsage(uint32_t* outBufferCount,
+            uint64_t* outBytes) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferConsumer::getInterfaceDescriptor());
+        status_t result = remote()->transact(GET_BUFFER_MEMORY_USAGE, data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        *outBufferCount = reply.readUint32();
+        *outBytes = reply.readUint64();
+        return reply.readInt32();
+    }
+
+    virtual status_t discardFreeBuffers() {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferConsumer::getInterfaceDescriptor());
+        status_t result = remote()->transact(DISCARD_FREE_BUFFERS, data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        return reply.readInt32();
+    }
+
+    virtual status_t setFrameAvailableCoalescing(bool enabled) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferConsumer::getInterfaceDescriptor());
+        data.writeInt32(enabled);
+        status_t result = remote()->transact(SET_FRAME_AVAILABLE_COALESCING, data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        return reply.readInt32();
+    }
+
     virtual sp<NativeHandle> getSidebandStream() const {
         Parcel data, reply;
         status_t err;
@@ -417,6 +483,51 @@ status_t BnGraphicBufferConsumer::onTransact(
             reply->writeInt32(result);
             return NO_ERROR;
         }
+        case SET_BUFFER_PREALLOCATION: {
+            CHECK_INTERFACE(IGraphicBufferConsumer, data, reply);
+            bool enabled = data.readInt32();
+            status_t result = setBufferPreallocation(enabled);
+            reply->writeInt32(result);
+            return NO_ERROR;
+        }
+        case SET_FRAME_COMPOSITION_INFO: {
+            CHECK_INTERFACE(IGraphicBufferConsumer, data, reply);
+            uint64_t frameNumber = data.readUint64();
+            nsecs_t latchTime = data.readInt64();
+            sp<Fence> presentFence = new Fence();
+            status_t result = data.read(*presentFence);
+            if (result != NO_ERROR) {
+                return result;
+            }
+            nsecs_t presentTime = data.readInt64();
+            result = setFrameCompositionInfo(frameNumber, latchTime,
+                    presentFence, presentTime);
+            reply->writeInt32(result);
+            return NO_ERROR;
+        }
+        case GET_BUFFER_MEMORY_USAGE: {
+            CHECK_INTERFACE(IGraphicBufferConsumer, data, reply);
+            uint32_t bufferCount = 0;
+            uint64_t bytes = 0;
+            status_t result = getBufferMemoryUsage(&bufferCount, &bytes);
+            reply->writeUint32(bufferCount);
+            reply->writeUint64(bytes);
+            reply->writeInt32(result);
+            return NO_ERROR;
+        }
+        case DISCARD_FREE_BUFFERS: {
+            CHECK_INTERFACE(IGraphicBufferConsumer, data, reply);
+            status_t result = discardFreeBuffers();
+            reply->writeInt32(result);
+            return NO_ERROR;
+        }
+        case SET_FRAME_AVAILABLE_COALESCING: {
+            CHECK_INTERFACE(IGraphicBufferConsumer, data, reply);
+            bool enabled = data.readInt32();
+            status_t result = setFrameAvailableCoalescing(enabled);
+            reply->writeInt32(result);
+            return NO_ERROR;
+        }
         case GET_SIDEBAND_STREAM: {
             CHECK_INTERFACE(IGraphicBufferConsumer, data, reply);
             sp<NativeHandle> stream = getSidebandStream();
@@ -25,7 +25,9 @@
 
 #include <binder/Parcel.h>
 #include <binder/IInterface.h>
+#include <binder/IMemory.h>
 
+#include <gui/FrameTimestamps.h>
 #include <gui/IGraphicBufferProducer.h>
 #include <gui/IProducerListener.h>
 
@@ -49,6 +51,9 @@ enum {
     ALLOW_ALLOCATION,
     SET_GENERATION_NUMBER,
     GET_CONSUMER_NAME,
+    GET_CONTROL_BLOCK,
+    QUEUE_BUFFER_ASYNC,
+    GET_FRAME_TIMESTAMPS,
 };
 
 class BpGraphicBufferProducer : public BpInterface<IGraphicBufferProducer>
@@ -308,6 +313,51 @@ public:
         }
         return reply.readString8();
     }
+
+    virtual status_t getControlBlock(sp<IMemoryHeap>* outHeap) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferProducer::getInterfaceDescriptor());
+        status_t result = remote()->transact(GET_CONTROL_BLOCK, data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        result = reply.readInt32();
+        if (result == NO_ERROR) {
+            *outHeap = interface_cast<IMemoryHeap>(reply.readStrongBinder());
+        }
+        return result;
+    }
+
+    virtual status_t queueBufferAsync(int buf, const QueueBufferInput& input,
+            int32_t serial) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferProducer::getInterfaceDescriptor());
+        data.writeInt32(buf);
+        data.write(input);
+        data.writeInt32(serial);
+        status_t result = remote()->transact(QUEUE_BUFFER_ASYNC, data, &reply,
+                IBinder::FLAG_ONEWAY);
+        if (result != NO_ERROR) {
+            ALOGE("queueBufferAsync failed to transact: %d", result);
+        }
+        return result;
+    }
+
+    virtual status_t getFrameTimestamps(uint64_t frameNumber,
+            FrameTimestamps* outTimestamps) {
+        Parcel data, reply;
+        data.writeInterfaceToken(IGraphicBufferProducer::getInterfaceDescriptor());
+        data.writeUint64(frameNumber);
+        status_t result = remote()->transact(GET_FRAME_TIMESTAMPS, data, &reply);
+        if (result != NO_ERROR) {
+            return result;
+        }
+        result = reply.readInt32();
+        if (result == NO_ERROR) {
+            result = reply.read(*outTimestamps);
+        }
+        return result;
+    }
 };
 
 // Out-of-line virtual method definition to trigger vtable emission in this
@@ -316,6 +366,21 @@ BpGraphicBufferProducer::~BpGraphicBufferProducer() {}
 
 IMPLEMENT_META_INTERFACE(GraphicBufferProducer, "android.gui.IGraphicBufferProducer");
 
+status_t IGraphicBufferProducer::getControlBlock(sp<IMemoryHeap>* /*outHeap*/) {
+    return INVALID_OPERATION;
+}
+
+status_t IGraphicBufferProducer::getFrameTimestamps(uint64_t /*frameNumber*/,
+        FrameTimestamps* /*outTimestamps*/) {
+    return INVALID_OPERATION;
+}
+
+status_t IGraphicBufferProducer::queueBufferAsync(int slot,
+        const QueueBufferInput& input, int32_t /*serial*/) {
+    QueueBufferOutput output;
+    return queueBuffer(slot, input, &output);
+}
+
 // ----------------------------------------------------------------------
 
 status_t BnGraphicBufferProducer::onTransact(
@@ -486,6 +551,35 @@ status_t BnGraphicBufferProducer::onTransact(
             reply->writeString8(getConsumerName());
             return NO_ERROR;
         }
+        case GET_CONTROL_BLOCK: {
+            CHECK_INTERFACE(IGraphicBufferProducer, data, reply);
+            sp<IMemoryHeap> heap;
+            status_t result = getControlBlock(&heap);
+            reply->writeInt32(result);
+            if (result == NO_ERROR) {
+                reply->writeStrongBinder(IInterface::asBinder(heap));
+            }
+            return NO_ERROR;
+        }
+        case QUEUE_BUFFER_ASYNC: {
+            CHECK_INTERFACE(IGraphicBufferProducer, data, reply);
+            int buf = data.readInt32();
+            QueueBufferInput input(data);
+            int32_t serial = data.readInt32();
+            queueBufferAsync(buf, input, serial);
+            return NO_ERROR;
+        }
+        case GET_FRAME_TIMESTAMPS: {
+            CHECK_INTERFACE(IGraphicBufferProducer, data, reply);
+            uint64_t frameNumber = data.readUint64();
+            FrameTimestamps timestamps;
+            status_t result = getFrameTimestamps(frameNumber, &timestamps);
+            reply->writeInt32(result);
+            if (result == NO_ERROR) {
+                reply->write(timestamps);
+            }
+            return NO_ERROR;
+        }
     }
     return BBinder::onTransact(code, data, reply, flags);
 }
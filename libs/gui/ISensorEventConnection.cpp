@@ -21,8 +21,9 @@
 #include <utils/RefBase.h>
 #include <utils/Timers.h>
 
-#include <binder/Parcel.h>
 #include <binder/IInterface.h>
+#include <binder/IMemory.h>
+#include <binder/Parcel.h>
 
 #include <gui/ISensorEventConnection.h>
 #include <gui/BitTube.h>
@@ -34,7 +35,8 @@ enum {
     GET_SENSOR_CHANNEL = IBinder::FIRST_CALL_TRANSACTION,
     ENABLE_DISABLE,
     SET_EVENT_RATE,
-    FLUSH_SENSOR
+    FLUSH_SENSOR,
+    CREATE_DIRECT_CHANNEL
 };
 
 class BpSensorEventConnection : public BpInterface<ISensorEventConnection>
@@ -85,6 +87,18 @@ public:
         remote()->transact(FLUSH_SENSOR, data, &reply);
         return reply.readInt32();
     }
+
+    virtual sp<IMemoryHeap> createDirectChannel(size_t numEvents)
+    {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISensorEventConnection::getInterfaceDescriptor());
+        data.writeUint32(uint32_t(numEvents));
+        status_t result = remote()->transact(CREATE_DIRECT_CHANNEL, data, &reply);
+        if (result != NO_ERROR) {
+            return NULL;
+        }
+        return interface_cast<IMemoryHeap>(reply.readStrongBinder());
+    }
 };
 
 // Out-of-line virtual method definition to trigger vtable emission in this
@@ -131,6 +145,13 @@ status_t BnSensorEventConnection::onTransact(
             reply->writeInt32(result);
             return NO_ERROR;
         }
+        case CREATE_DIRECT_CHANNEL: {
+            CHECK_INTERFACE(ISensorEventConnection, data, reply);
+            size_t numEvents = data.readUint32();
+            sp<IMemoryHeap> heap(createDirectChannel(numEvents));
+            reply->writeStrongBinder(IInterface::asBinder(heap));
+            return NO_ERROR;
+        }
     }
     return BBinder::onTransact(code, data, reply, flags);
 }
@@ -282,6 +282,16 @@ public:
         reply.read(*outStats);
         return reply.readInt32();
     }
+
+    virtual status_t getAnimationFrameStatsSummary(
+            FrameStatsSummary* outSummary) const {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceComposer::getInterfaceDescriptor());
+        remote()->transact(BnSurfaceComposer::GET_ANIMATION_FRAME_STATS_SUMMARY,
+                data, &reply);
+        reply.read(*outSummary);
+        return reply.readInt32();
+    }
 };
 
 // Out-of-line virtual method definition to trigger vtable emission in this
@@ -460,6 +470,14 @@ status_t BnSurfaceComposer::onTransact(
             reply->writeInt32(result);
             return NO_ERROR;
         }
+        case GET_ANIMATION_FRAME_STATS_SUMMARY: {
+            CHECK_INTERFACE(ISurfaceComposer, data, reply);
+            FrameStatsSummary summary;
+            status_t result = getAnimationFrameStatsSummary(&summary);
+            reply->write(summary);
+            reply->writeInt32(result);
+            return NO_ERROR;
+        }
         case SET_POWER_MODE: {
             CHECK_INTERFACE(ISurfaceComposer, data, reply);
             sp<IBinder> display = data.readStrongBinder();
@@ -41,7 +41,8 @@ enum {
     CREATE_SURFACE = IBinder::FIRST_CALL_TRANSACTION,
     DESTROY_SURFACE,
     CLEAR_LAYER_FRAME_STATS,
-    GET_LAYER_FRAME_STATS
+    GET_LAYER_FRAME_STATS,
+    GET_LAYER_FRAME_STATS_SUMMARY
 };
 
 class BpSurfaceComposerClient : public BpInterface<ISurfaceComposerClient>
@@ -94,6 +95,16 @@ public:
         reply.read(*outStats);
         return reply.readInt32();
     }
+
+    virtual status_t getLayerFrameStatsSummary(const sp<IBinder>& handle,
+            FrameStatsSummary* outSummary) const {
+        Parcel data, reply;
+        data.writeInterfaceToken(ISurfaceComposerClient::getInterfaceDescriptor());
+        data.writeStrongBinder(handle);
+        remote()->transact(GET_LAYER_FRAME_STATS_SUMMARY, data, &reply);
+        reply.read(*outSummary);
+        return reply.readInt32();
+    }
 };
 
 // Out-of-line virtual method definition to trigger vtable emission in this
@@ -145,6 +156,15 @@ status_t BnSurfaceComposerClient::onTransact(
             reply->writeInt32(result);
             return NO_ERROR;
         }
+        case GET_LAYER_FRAME_STATS_SUMMARY: {
+            CHECK_INTERFACE(ISurfaceComposerClient, data, reply);
+            sp<IBinder> handle = data.readStrongBinder();
+            FrameStatsSummary summary;
+            status_t result = getLayerFrameStatsSummary(handle, &summary);
+            reply->write(summary);
+            reply->writeInt32(result);
+            return NO_ERROR;
+        }
         default:
             return BBinder::onTransact(code, data, reply, flags);
     }
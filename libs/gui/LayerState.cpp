@@ -22,23 +22,42 @@
 
 namespace android {
 
+// Only the fields selected by the what mask are written, since SurfaceFlinger
+// ignores the others; a typical animation frame only changes one or two of
+// them. flags and mask are packed into a single word.
 status_t layer_state_t::write(Parcel& output) const
 {
     output.writeStrongBinder(surface);
     output.writeUint32(what);
-    output.writeFloat(x);
-    output.writeFloat(y);
-    output.writeUint32(z);
-    output.writeUint32(w);
-    output.writeUint32(h);
-    output.writeUint32(layerStack);
-    output.writeFloat(alpha);
-    output.writeUint32(flags);
-    output.writeUint32(mask);
-    *reinterpret_cast<layer_state_t::matrix22_t *>(
-            output.writeInplace(sizeof(layer_state_t::matrix22_t))) = matrix;
-    output.write(crop);
-    output.write(transparentRegion);
+    if (what & ePositionChanged) {
+        output.writeFloat(x);
+        output.writeFloat(y);
+    }
+    if (what & eLayerChanged) {
+        output.writeUint32(z);
+    }
+    if (what & eSizeChanged) {
+        output.writeUint32(w);
+        output.writeUint32(h);
+    }
+    if (what & eLayerStackChanged) {
+        output.writeUint32(layerStack);
+    }
+    if (what & eAlphaChanged) {
+        output.writeFloat(alpha);
+    }
+    if (what & eFlagsChanged) {
+        output.writeUint32(uint32_t(flags) | (uint32_t(mask) << 8));
+    }
+    if (what & eMatrixChanged) {
+        output.writeArray(&matrix, 1);
+    }
+    if (what & eCropChanged) {
+        output.write(crop);
+    }
+    if (what & eTransparentRegionChanged) {
+        output.write(transparentRegion);
+    }
     return NO_ERROR;
 }
 
@@ -46,23 +65,39 @@ status_t layer_state_t::read(const Parcel& input)
 {
     surface = input.readStrongBinder();
     what = input.readUint32();
-    x = input.readFloat();
-    y = input.readFloat();
-    z = input.readUint32();
-    w = input.readUint32();
-    h = input.readUint32();
-    layerStack = input.readUint32();
-    alpha = input.readFloat();
-    flags = static_cast<uint8_t>(input.readUint32());
-    mask = static_cast<uint8_t>(input.readUint32());
-    const void* matrix_data = input.readInplace(sizeof(layer_state_t::matrix22_t));
-    if (matrix_data) {
-        matrix = *reinterpret_cast<layer_state_t::matrix22_t const *>(matrix_data);
-    } else {
-        return BAD_VALUE;
-    }
-    input.read(crop);
-    input.read(transparentRegion);
+    if (what & ePositionChanged) {
+        x = input.readFloat();
+        y = input.readFloat();
+    }
+    if (what & eLayerChanged) {
+        z = input.readUint32();
+    }
+    if (what & eSizeChanged) {
+        w = input.readUint32();
+        h = input.readUint32();
+    }
+    if (what & eLayerStackChanged) {
+        layerStack = input.readUint32();
+    }
+    if (what & eAlphaChanged) {
+        alpha = input.readFloat();
+    }
+    if (what & eFlagsChanged) {
+        const uint32_t flagsAndMask = input.readUint32();
+        flags = static_cast<uint8_t>(flagsAndMask & 0xff);
+        mask = static_cast<uint8_t>((flagsAndMask >> 8) & 0xff);
+    }
+    if (what & eMatrixChanged) {
+        if (input.readArray(&matrix, 1) != NO_ERROR) {
+            return BAD_VALUE;
+        }
+    }
+    if (what & eCropChanged) {
+        input.read(crop);
+    }
+    if (what & eTransparentRegionChanged) {
+        input.read(transparentRegion);
+    }
     return NO_ERROR;
 }
 
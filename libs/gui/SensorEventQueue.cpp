@@ -15,6 +15,7 @@
  */
 
 #define LOG_TAG "Sensors"
+#define ATRACE_TAG ATRACE_TAG_HAL
 
 #include <algorithm>
 #include <stdint.h>
@@ -25,10 +26,15 @@
 #include <utils/Errors.h>
 #include <utils/RefBase.h>
 #include <utils/Looper.h>
+#include <utils/SystemClock.h>
+#include <utils/Trace.h>
+
+#include <binder/IMemory.h>
 
 #include <gui/Sensor.h>
 #include <gui/BitTube.h>
 #include <gui/SensorEventQueue.h>
+#include <gui/SensorEventRing.h>
 #include <gui/ISensorEventConnection.h>
 
 #include <android/sensor.h>
@@ -40,8 +46,8 @@ namespace android {
 // ----------------------------------------------------------------------------
 
 SensorEventQueue::SensorEventQueue(const sp<ISensorEventConnection>& connection)
-    : mSensorEventConnection(connection), mRecBuffer(NULL), mAvailable(0), mConsumed(0),
-      mNumAcksToSend(0) {
+    : mSensorEventConnection(connection), mRecBuffer(NULL), mRecBufferMessages(1),
+      mAvailable(0), mConsumed(0), mNumAcksToSend(0), mDirectPosition(0) {
     mRecBuffer = new ASensorEvent[MAX_RECEIVE_BUFFER_EVENT_COUNT];
 }
 
@@ -65,15 +71,31 @@ ssize_t SensorEventQueue::write(const sp<BitTube>& tube,
     return BitTube::sendObjects(tube, events, numEvents);
 }
 
-ssize_t SensorEventQueue::read(ASensorEvent* events, size_t numEvents) {
+ssize_t SensorEventQueue::receiveIfNeeded() {
     if (mAvailable == 0) {
-        ssize_t err = BitTube::recvObjects(mSensorChannel,
-                mRecBuffer, MAX_RECEIVE_BUFFER_EVENT_COUNT);
+        ssize_t err = BitTube::recvObjectsBatch(mSensorChannel, mRecBuffer,
+                MAX_RECEIVE_BUFFER_EVENT_COUNT * mRecBufferMessages,
+                MAX_RECEIVE_BUFFER_EVENT_COUNT);
         if (err < 0) {
             return err;
         }
         mAvailable = static_cast<size_t>(err);
         mConsumed = 0;
+        if (ATRACE_ENABLED() && mAvailable > 0
+                && mRecBuffer[mAvailable - 1].type != SENSOR_TYPE_META_DATA) {
+            // From the timestamp of the newest event to its reception here, the
+            // end of what sensorservice reports in its dump per stage
+            ATRACE_INT("sl:client", int32_t(
+                    (elapsedRealtimeNano() - mRecBuffer[mAvailable - 1].timestamp) / 1000));
+        }
+    }
+    return static_cast<ssize_t>(mAvailable);
+}
+
+ssize_t SensorEventQueue::read(ASensorEvent* events, size_t numEvents) {
+    ssize_t err = receiveIfNeeded();
+    if (err < 0) {
+        return err;
     }
     size_t count = min(numEvents, mAvailable);
     memcpy(events, mRecBuffer + mConsumed, count * sizeof(ASensorEvent));
@@ -82,6 +104,80 @@ ssize_t SensorEventQueue::read(ASensorEvent* events, size_t numEvents) {
     return static_cast<ssize_t>(count);
 }
 
+ssize_t SensorEventQueue::peek(ASensorEvent const** outEvents) {
+    ssize_t err = receiveIfNeeded();
+    if (err < 0) {
+        return err;
+    }
+    *outEvents = mRecBuffer + mConsumed;
+    return static_cast<ssize_t>(mAvailable);
+}
+
+void SensorEventQueue::consume(size_t numEvents) {
+    const size_t count = min(numEvents, mAvailable);
+    for (size_t i = mConsumed; i < mConsumed + count; ++i) {
+        if (mRecBuffer[i].flags & WAKE_UP_SENSOR_EVENT_NEEDS_ACK) {
+            ++mNumAcksToSend;
+        }
+    }
+    mAvailable -= count;
+    mConsumed += count;
+    if (mAvailable == 0) {
+        sendPendingAcks();
+    }
+}
+
+status_t SensorEventQueue::setReadBatchCount(size_t numMessages) {
+    if (numMessages == 0) {
+        return BAD_VALUE;
+    }
+    if (numMessages == mRecBufferMessages) {
+        return NO_ERROR;
+    }
+    if (mAvailable > MAX_RECEIVE_BUFFER_EVENT_COUNT * numMessages) {
+        // Can't shrink below what's still waiting to be read
+        return WOULD_BLOCK;
+    }
+    ASensorEvent* buffer =
+            new ASensorEvent[MAX_RECEIVE_BUFFER_EVENT_COUNT * numMessages];
+    // Keep the events that were received but not read yet
+    memcpy(buffer, mRecBuffer + mConsumed, mAvailable * sizeof(ASensorEvent));
+    delete [] mRecBuffer;
+    mRecBuffer = buffer;
+    mRecBufferMessages = numMessages;
+    mConsumed = 0;
+    return NO_ERROR;
+}
+
+status_t SensorEventQueue::enableDirectChannel(size_t numEvents) {
+    if (numEvents == 0) {
+        return BAD_VALUE;
+    }
+    if (mDirectRing != NULL) {
+        return NO_ERROR;
+    }
+    sp<IMemoryHeap> heap(mSensorEventConnection->createDirectChannel(numEvents));
+    if (heap == NULL) {
+        return NO_MEMORY;
+    }
+    sp<SensorEventRing> ring(SensorEventRing::attach(heap));
+    if (ring == NULL) {
+        return BAD_VALUE;
+    }
+    mDirectPosition = ring->getPosition();
+    mDirectRing = ring;
+    return NO_ERROR;
+}
+
+ssize_t SensorEventQueue::readDirect(ASensorEvent* events, size_t numEvents,
+        uint32_t* outNumLost) {
+    if (mDirectRing == NULL) {
+        return NO_INIT;
+    }
+    return static_cast<ssize_t>(
+            mDirectRing->read(&mDirectPosition, events, numEvents, outNumLost));
+}
+
 sp<Looper> SensorEventQueue::getLooper() const
 {
     Mutex::Autolock _l(mLock);
@@ -173,6 +269,10 @@ void SensorEventQueue::sendAck(const ASensorEvent* events, int count) {
             ++mNumAcksToSend;
         }
     }
+    sendPendingAcks();
+}
+
+void SensorEventQueue::sendPendingAcks() {
     // Send mNumAcksToSend to acknowledge for the wake up sensor events received.
     if (mNumAcksToSend > 0) {
         ssize_t size = ::send(mSensorChannel->getFd(), &mNumAcksToSend, sizeof(mNumAcksToSend),
@@ -0,0 +1,165 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "SensorEventRing"
+//#define LOG_NDEBUG 0
+
+#include <string.h>
+#include <sys/mman.h>
+
+#include <gui/SensorEventRing.h>
+
+#include <android/sensor.h>
+
+#include <binder/IMemory.h>
+#include <binder/MemoryHeapBase.h>
+
+#include <cutils/atomic.h>
+
+#include <utils/Log.h>
+
+namespace android {
+
+struct SensorEventRing::SharedBlock {
+    // Number of events written since the ring was created, modulo 2^32. The
+    // event at position p is in slot p % capacity.
+    volatile int32_t writeCount;
+    // Likewise, counting the events being written, which is ahead of
+    // writeCount while write() is copying them
+    volatile int32_t writeEnd;
+    uint32_t capacity;
+    uint32_t reserved;
+    // Followed by capacity events
+};
+
+sp<SensorEventRing> SensorEventRing::create(size_t numEvents) {
+    if (numEvents == 0 || numEvents > (1U << 16)) {
+        ALOGE("create: invalid capacity %zu", numEvents);
+        return NULL;
+    }
+    sp<MemoryHeapBase> heap = new MemoryHeapBase(
+            sizeof(SharedBlock) + numEvents * sizeof(ASensorEvent),
+            MemoryHeapBase::READ_ONLY, "SensorEventRing");
+    if (heap->getHeapID() < 0 || heap->getBase() == MAP_FAILED) {
+        ALOGE("create: failed to allocate ring");
+        return NULL;
+    }
+    SharedBlock* block = static_cast<SharedBlock*>(heap->getBase());
+    memset(block, 0, sizeof(SharedBlock));
+    block->capacity = uint32_t(numEvents);
+    return new SensorEventRing(heap, block, numEvents);
+}
+
+sp<SensorEventRing> SensorEventRing::attach(const sp<IMemoryHeap>& heap) {
+    if (heap == NULL || heap->getHeapID() < 0 ||
+            heap->getBase() == MAP_FAILED ||
+            heap->getSize() < sizeof(SharedBlock)) {
+        ALOGE("attach: invalid ring");
+        return NULL;
+    }
+    SharedBlock* block = static_cast<SharedBlock*>(heap->getBase());
+    size_t capacity = block->capacity;
+    if (capacity == 0 || capacity >
+            (heap->getSize() - sizeof(SharedBlock)) / sizeof(ASensorEvent)) {
+        ALOGE("attach: invalid capacity %zu", capacity);
+        return NULL;
+    }
+    return new SensorEventRing(heap, block, capacity);
+}
+
+SensorEventRing::SensorEventRing(const sp<IMemoryHeap>& heap,
+        SharedBlock* block, size_t capacity) :
+    mHeap(heap),
+    mBlock(block),
+    mCapacity(capacity) {}
+
+SensorEventRing::~SensorEventRing() {}
+
+ASensorEvent* SensorEventRing::getEvents() const {
+    return reinterpret_cast<ASensorEvent*>(mBlock + 1);
+}
+
+void SensorEventRing::write(const ASensorEvent* events, size_t numEvents) {
+    ASensorEvent* slots = getEvents();
+    uint32_t position = uint32_t(mBlock->writeCount);
+    if (numEvents > mCapacity) {
+        // Only the last ones would be left anyway; the others still count,
+        // so that readers know they lost them
+        position += uint32_t(numEvents - mCapacity);
+        events += numEvents - mCapacity;
+        numEvents = mCapacity;
+    }
+    // Readers check writeEnd after copying, so that they notice if the slots
+    // they were copying were being written; it must be visible before any of
+    // them is
+    mBlock->writeEnd = int32_t(position + numEvents);
+    android_memory_barrier();
+    for (size_t i = 0; i < numEvents; i++) {
+        memcpy(&slots[(position + i) % mCapacity], &events[i],
+                sizeof(ASensorEvent));
+    }
+    android_atomic_release_store(int32_t(position + numEvents),
+            &mBlock->writeCount);
+}
+
+uint32_t SensorEventRing::getPosition() const {
+    return uint32_t(android_atomic_acquire_load(&mBlock->writeCount));
+}
+
+size_t SensorEventRing::read(uint32_t* ioPosition, ASensorEvent* events,
+        size_t numEvents, uint32_t* outNumLost) const {
+    uint32_t position = *ioPosition;
+    uint32_t numLost = 0;
+
+    uint32_t writeCount = getPosition();
+    uint32_t available = writeCount - position;
+    if (available > mCapacity) {
+        numLost = available - mCapacity;
+        position += numLost;
+        available = mCapacity;
+    }
+    size_t count = available < numEvents ? available : numEvents;
+    const ASensorEvent* slots = getEvents();
+    for (size_t i = 0; i < count; i++) {
+        memcpy(&events[i], &slots[(position + i) % mCapacity],
+                sizeof(ASensorEvent));
+    }
+
+    // The writer may have lapped us while we were copying: the event at
+    // position p is overwritten by the one at p + capacity, which is being
+    // written once writeEnd is past it.
+    android_memory_barrier();
+    uint32_t writeEnd = uint32_t(android_atomic_acquire_load(&mBlock->writeEnd));
+    uint32_t numOverwritten = 0;
+    if (writeEnd - position > mCapacity) {
+        numOverwritten = writeEnd - position - uint32_t(mCapacity);
+        if (numOverwritten > count) {
+            numOverwritten = uint32_t(count);
+        }
+        memmove(events, &events[numOverwritten],
+                (count - numOverwritten) * sizeof(ASensorEvent));
+        count -= numOverwritten;
+        numLost += numOverwritten;
+    }
+
+    *ioPosition = position + numOverwritten + uint32_t(count);
+    if (outNumLost) {
+        *outNumLost = numLost;
+    }
+    return count;
+}
+
+} // namespace android
@@ -55,14 +55,16 @@ status_t StreamSplitter::createSplitter(
 }
 
 StreamSplitter::StreamSplitter(const sp<IGraphicBufferConsumer>& inputQueue)
-      : mIsAbandoned(false), mMutex(), mReleaseCondition(),
-        mOutstandingBuffers(0), mInput(inputQueue), mOutputs(), mBuffers() {}
+      : mIsAbandoned(false), mAsyncOutputs(false), mDropSlowOutputs(false),
+        mFrameMutex(), mMutex(), mReleaseCondition(), mOutstandingBuffers(0),
+        mInput(inputQueue), mOutputs(), mBuffers() {}
 
 StreamSplitter::~StreamSplitter() {
     mInput->consumerDisconnect();
-    Vector<sp<IGraphicBufferProducer> >::iterator output = mOutputs.begin();
+    Vector<sp<Output> >::iterator output = mOutputs.begin();
     for (; output != mOutputs.end(); ++output) {
-        (*output)->disconnect(NATIVE_WINDOW_API_CPU);
+        (*output)->stop();
+        (*output)->getProducer()->disconnect(NATIVE_WINDOW_API_CPU);
     }
 
     if (mBuffers.size() > 0) {
@@ -80,7 +82,8 @@ status_t StreamSplitter::addOutput(
     Mutex::Autolock lock(mMutex);
 
     IGraphicBufferProducer::QueueBufferOutput queueBufferOutput;
-    sp<OutputListener> listener(new OutputListener(this, outputQueue));
+    sp<Output> output(new Output(this, outputQueue));
+    sp<OutputListener> listener(new OutputListener(this, output));
     IInterface::asBinder(outputQueue)->linkToDeath(listener);
     status_t status = outputQueue->connect(listener, NATIVE_WINDOW_API_CPU,
             /* producerControlledByApp */ false, &queueBufferOutput);
@@ -89,7 +92,10 @@ status_t StreamSplitter::addOutput(
         return status;
     }
 
-    mOutputs.push_back(outputQueue);
+    if (mAsyncOutputs) {
+        output->run("StreamSplitterOutput", PRIORITY_URGENT_DISPLAY);
+    }
+    mOutputs.push_back(output);
 
     return NO_ERROR;
 }
@@ -99,103 +105,177 @@ void StreamSplitter::setName(const String8 &name) {
     mInput->setConsumerName(name);
 }
 
-void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
-    ATRACE_CALL();
+void StreamSplitter::setAsyncOutputs(bool enabled) {
     Mutex::Autolock lock(mMutex);
+    if (enabled == mAsyncOutputs) {
+        return;
+    }
+    mAsyncOutputs = enabled;
 
-    // The current policy is that if any one consumer is consuming buffers too
-    // slowly, the splitter will stall the rest of the outputs by not acquiring
-    // any more buffers from the input. This will cause back pressure on the
-    // input queue, slowing down its producer.
-
-    // If there are too many outstanding buffers, we block until a buffer is
-    // released back to the input in onBufferReleased
-    while (mOutstandingBuffers >= MAX_OUTSTANDING_BUFFERS) {
-        mReleaseCondition.wait(mMutex);
-
-        // If the splitter is abandoned while we are waiting, the release
-        // condition variable will be broadcast, and we should just return
-        // without attempting to do anything more (since the input queue will
-        // also be abandoned).
-        if (mIsAbandoned) {
-            return;
+    Vector<sp<Output> >::iterator output = mOutputs.begin();
+    for (; output != mOutputs.end(); ++output) {
+        if (enabled) {
+            (*output)->run("StreamSplitterOutput", PRIORITY_URGENT_DISPLAY);
+        } else {
+            (*output)->stop();
         }
     }
-    ++mOutstandingBuffers;
+}
 
-    // Acquire and detach the buffer from the input
-    BufferItem bufferItem;
-    status_t status = mInput->acquireBuffer(&bufferItem, /* presentWhen */ 0);
-    LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
-            "acquiring buffer from input failed (%d)", status);
+void StreamSplitter::setDropSlowOutputs(bool enabled) {
+    Mutex::Autolock lock(mMutex);
+    mDropSlowOutputs = enabled;
+    mReleaseCondition.signal();
+}
 
-    ALOGV("acquired buffer %#" PRIx64 " from input",
-            bufferItem.mGraphicBuffer->getId());
+bool StreamSplitter::canAcquireLocked() const {
+    if (!mDropSlowOutputs) {
+        return mOutstandingBuffers < MAX_OUTSTANDING_BUFFERS;
+    }
 
-    status = mInput->detachBuffer(bufferItem.mBuf);
-    LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
-            "detaching buffer from input failed (%d)", status);
+    // Every outstanding buffer is in flight on at least one output, so this
+    // still bounds the number of buffers to MAX_OUTSTANDING_BUFFERS per output
+    Vector<sp<Output> >::const_iterator output = mOutputs.begin();
+    for (; output != mOutputs.end(); ++output) {
+        if ((*output)->mInFlight < MAX_OUTSTANDING_BUFFERS) {
+            return true;
+        }
+    }
+    return mOutputs.isEmpty();
+}
 
-    // Initialize our reference count for this buffer
-    mBuffers.add(bufferItem.mGraphicBuffer->getId(),
-            new BufferTracker(bufferItem.mGraphicBuffer));
+void StreamSplitter::onFrameAvailable(const BufferItem& /* item */) {
+    ATRACE_CALL();
+    Mutex::Autolock frameLock(mFrameMutex);
 
-    IGraphicBufferProducer::QueueBufferInput queueInput(
-            bufferItem.mTimestamp, bufferItem.mIsAutoTimestamp,
-            bufferItem.mDataSpace, bufferItem.mCrop,
-            static_cast<int32_t>(bufferItem.mScalingMode),
-            bufferItem.mTransform, bufferItem.mIsDroppable,
-            bufferItem.mFence);
+    BufferItem bufferItem;
+    Vector<sp<Output> > targets;
+    bool asyncOutputs;
+    { // Autolock scope
+        Mutex::Autolock lock(mMutex);
+
+        // Unless dropping is enabled, the policy is that if any one consumer
+        // is consuming buffers too slowly, the splitter will stall the rest
+        // of the outputs by not acquiring any more buffers from the input.
+        // This will cause back pressure on the input queue, slowing down its
+        // producer.
+
+        // If there are too many outstanding buffers, we block until a buffer
+        // is released back to the input in onBufferReleased
+        while (!canAcquireLocked()) {
+            mReleaseCondition.wait(mMutex);
+
+            // If the splitter is abandoned while we are waiting, the release
+            // condition variable will be broadcast, and we should just return
+            // without attempting to do anything more (since the input queue
+            // will also be abandoned).
+            if (mIsAbandoned) {
+                return;
+            }
+        }
+        ++mOutstandingBuffers;
+
+        // Acquire and detach the buffer from the input
+        status_t status = mInput->acquireBuffer(&bufferItem,
+                /* presentWhen */ 0);
+        LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
+                "acquiring buffer from input failed (%d)", status);
+
+        ALOGV("acquired buffer %#" PRIx64 " from input",
+                bufferItem.mGraphicBuffer->getId());
+
+        status = mInput->detachBuffer(bufferItem.mBuf);
+        LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
+                "detaching buffer from input failed (%d)", status);
+
+        // Initialize our reference count for this buffer. Outputs that skip
+        // it count as having released it already.
+        sp<BufferTracker> tracker(new BufferTracker(bufferItem.mGraphicBuffer));
+        Vector<sp<Output> >::iterator output = mOutputs.begin();
+        for (; output != mOutputs.end(); ++output) {
+            if (mDropSlowOutputs &&
+                    (*output)->mInFlight >= MAX_OUTSTANDING_BUFFERS) {
+                ALOGV("dropping buffer %#" PRIx64 " for output %p",
+                        bufferItem.mGraphicBuffer->getId(),
+                        (*output)->getProducer().get());
+                tracker->incrementReleaseCountLocked();
+                continue;
+            }
+            ++(*output)->mInFlight;
+            targets.push_back(*output);
+        }
+        mBuffers.add(bufferItem.mGraphicBuffer->getId(), tracker);
+        asyncOutputs = mAsyncOutputs;
+    }
 
     // Attach and queue the buffer to each of the outputs
-    Vector<sp<IGraphicBufferProducer> >::iterator output = mOutputs.begin();
-    for (; output != mOutputs.end(); ++output) {
-        int slot;
-        status = (*output)->attachBuffer(&slot, bufferItem.mGraphicBuffer);
-        if (status == NO_INIT) {
-            // If we just discovered that this output has been abandoned, note
-            // that, increment the release count so that we still release this
-            // buffer eventually, and move on to the next output
-            onAbandonedLocked();
-            mBuffers.editValueFor(bufferItem.mGraphicBuffer->getId())->
-                    incrementReleaseCountLocked();
-            continue;
+    Vector<sp<Output> >::iterator output = targets.begin();
+    for (; output != targets.end(); ++output) {
+        if (asyncOutputs) {
+            (*output)->enqueue(bufferItem);
         } else {
-            LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
-                    "attaching buffer to output failed (%d)", status);
+            queueToOutput(*output, bufferItem);
         }
+    }
+}
+
+void StreamSplitter::queueToOutput(const sp<Output>& output,
+        const BufferItem& item) {
+    ATRACE_CALL();
+    const sp<IGraphicBufferProducer>& producer = output->getProducer();
 
+    IGraphicBufferProducer::QueueBufferInput queueInput(
+            item.mTimestamp, item.mIsAutoTimestamp,
+            item.mDataSpace, item.mCrop,
+            static_cast<int32_t>(item.mScalingMode),
+            item.mTransform, item.mIsDroppable,
+            item.mFence);
+
+    int slot;
+    status_t status = producer->attachBuffer(&slot, item.mGraphicBuffer);
+    if (status == NO_ERROR) {
         IGraphicBufferProducer::QueueBufferOutput queueOutput;
-        status = (*output)->queueBuffer(slot, queueInput, &queueOutput);
-        if (status == NO_INIT) {
-            // If we just discovered that this output has been abandoned, note
-            // that, increment the release count so that we still release this
-            // buffer eventually, and move on to the next output
+        status = producer->queueBuffer(slot, queueInput, &queueOutput);
+        LOG_ALWAYS_FATAL_IF(status != NO_ERROR && status != NO_INIT,
+                "queueing buffer to output failed (%d)", status);
+    } else {
+        LOG_ALWAYS_FATAL_IF(status != NO_INIT,
+                "attaching buffer to output failed (%d)", status);
+    }
+
+    if (status == NO_INIT) {
+        // If we just discovered that this output has been abandoned, note
+        // that, and count this output as having released the buffer so that
+        // we still release it eventually
+        sp<BufferTracker> tracker;
+        { // Autolock scope
+            Mutex::Autolock lock(mMutex);
             onAbandonedLocked();
-            mBuffers.editValueFor(bufferItem.mGraphicBuffer->getId())->
-                    incrementReleaseCountLocked();
-            continue;
-        } else {
-            LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
-                    "queueing buffer to output failed (%d)", status);
+            tracker = releaseFromOutputLocked(output,
+                    item.mGraphicBuffer->getId(), Fence::NO_FENCE);
         }
-
-        ALOGV("queued buffer %#" PRIx64 " to output %p",
-                bufferItem.mGraphicBuffer->getId(), output->get());
+        if (tracker != NULL) {
+            releaseToInput(tracker);
+        }
+        return;
     }
+
+    ALOGV("queued buffer %#" PRIx64 " to output %p",
+            item.mGraphicBuffer->getId(), producer.get());
 }
 
-void StreamSplitter::onBufferReleasedByOutput(
-        const sp<IGraphicBufferProducer>& from) {
+void StreamSplitter::onBufferReleasedByOutput(const sp<Output>& from) {
     ATRACE_CALL();
-    Mutex::Autolock lock(mMutex);
 
+    // Each output only detaches buffers it has released, so this doesn't need
+    // to be serialized against the other outputs
     sp<GraphicBuffer> buffer;
     sp<Fence> fence;
-    status_t status = from->detachNextBuffer(&buffer, &fence);
+    status_t status = from->getProducer()->detachNextBuffer(&buffer, &fence);
     if (status == NO_INIT) {
         // If we just discovered that this output has been abandoned, note that,
         // but we can't do anything else, since buffer is invalid
+        Mutex::Autolock lock(mMutex);
         onAbandonedLocked();
         return;
     } else {
@@ -204,9 +284,33 @@ void StreamSplitter::onBufferReleasedByOutput(
     }
 
     ALOGV("detached buffer %#" PRIx64 " from output %p",
-          buffer->getId(), from.get());
+          buffer->getId(), from->getProducer().get());
+
+    sp<BufferTracker> tracker;
+    { // Autolock scope
+        Mutex::Autolock lock(mMutex);
+        tracker = releaseFromOutputLocked(from, buffer->getId(), fence);
+    }
+    if (tracker != NULL) {
+        releaseToInput(tracker);
+    }
+}
 
-    const sp<BufferTracker>& tracker = mBuffers.editValueFor(buffer->getId());
+sp<StreamSplitter::BufferTracker> StreamSplitter::releaseFromOutputLocked(
+        const sp<Output>& output, uint64_t bufferId, const sp<Fence>& fence) {
+    // An output dropping below its limit may let a blocked onFrameAvailable
+    // call proceed when dropping is enabled
+    --output->mInFlight;
+    if (mDropSlowOutputs) {
+        mReleaseCondition.signal();
+    }
+
+    ssize_t index = mBuffers.indexOfKey(bufferId);
+    if (index < 0) {
+        ALOGE("buffer %#" PRIx64 " is not being tracked", bufferId);
+        return NULL;
+    }
+    sp<BufferTracker> tracker = mBuffers.valueAt(static_cast<size_t>(index));
 
     // Merge the release fence of the incoming buffer so that the fence we send
     // back to the input includes all of the outputs' fences
@@ -214,37 +318,43 @@ void StreamSplitter::onBufferReleasedByOutput(
 
     // Check to see if this is the last outstanding reference to this buffer
     size_t releaseCount = tracker->incrementReleaseCountLocked();
-    ALOGV("buffer %#" PRIx64 " reference count %zu (of %zu)", buffer->getId(),
+    ALOGV("buffer %#" PRIx64 " reference count %zu (of %zu)", bufferId,
             releaseCount, mOutputs.size());
     if (releaseCount < mOutputs.size()) {
-        return;
+        return NULL;
     }
 
-    // If we've been abandoned, we can't return the buffer to the input, so just
-    // stop tracking it and move on
+    // We no longer need to track the buffer once every output is done with
+    // it. If we've been abandoned, we can't return the buffer to the input,
+    // so just stop tracking it and move on.
+    mBuffers.removeItemsAt(static_cast<size_t>(index));
     if (mIsAbandoned) {
-        mBuffers.removeItem(buffer->getId());
-        return;
+        return NULL;
     }
+    return tracker;
+}
 
-    // Attach and release the buffer back to the input
-    int consumerSlot;
-    status = mInput->attachBuffer(&consumerSlot, tracker->getBuffer());
-    LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
-            "attaching buffer to input failed (%d)", status);
-
-    status = mInput->releaseBuffer(consumerSlot, /* frameNumber */ 0,
-            EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, tracker->getMergedFence());
-    LOG_ALWAYS_FATAL_IF(status != NO_ERROR,
-            "releasing buffer to input failed (%d)", status);
+void StreamSplitter::releaseToInput(const sp<BufferTracker>& tracker) {
+    const uint64_t bufferId = tracker->getBuffer()->getId();
 
-    ALOGV("released buffer %#" PRIx64 " to input", buffer->getId());
+    // Attach and release the buffer back to the input. The input may have
+    // been abandoned since the buffer stopped being tracked.
+    int consumerSlot;
+    status_t status = mInput->attachBuffer(&consumerSlot, tracker->getBuffer());
+    if (status == NO_ERROR) {
+        status = mInput->releaseBuffer(consumerSlot, /* frameNumber */ 0,
+                EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, tracker->getMergedFence());
+        LOG_ALWAYS_FATAL_IF(status != NO_ERROR && status != NO_INIT,
+                "releasing buffer to input failed (%d)", status);
+    } else {
+        LOG_ALWAYS_FATAL_IF(status != NO_INIT,
+                "attaching buffer to input failed (%d)", status);
+    }
 
-    // We no longer need to track the buffer once it has been returned to the
-    // input
-    mBuffers.removeItem(buffer->getId());
+    ALOGV("released buffer %#" PRIx64 " to input", bufferId);
 
     // Notify any waiting onFrameAvailable calls
+    Mutex::Autolock lock(mMutex);
     --mOutstandingBuffers;
     mReleaseCondition.signal();
 }
@@ -260,7 +370,7 @@ void StreamSplitter::onAbandonedLocked() {
 
 StreamSplitter::OutputListener::OutputListener(
         const sp<StreamSplitter>& splitter,
-        const sp<IGraphicBufferProducer>& output)
+        const sp<Output>& output)
       : mSplitter(splitter), mOutput(output) {}
 
 StreamSplitter::OutputListener::~OutputListener() {}
@@ -274,12 +384,58 @@ void StreamSplitter::OutputListener::binderDied(const wp<IBinder>& /* who */) {
     mSplitter->onAbandonedLocked();
 }
 
+StreamSplitter::Output::Output(const wp<StreamSplitter>& splitter,
+        const sp<IGraphicBufferProducer>& producer)
+      : Thread(false), mInFlight(0), mSplitter(splitter), mProducer(producer),
+        mMutex(), mCondition(), mPending() {}
+
+StreamSplitter::Output::~Output() {}
+
+void StreamSplitter::Output::enqueue(const BufferItem& item) {
+    Mutex::Autolock lock(mMutex);
+    mPending.push_back(item);
+    mCondition.signal();
+}
+
+void StreamSplitter::Output::stop() {
+    requestExit();
+    Mutex::Autolock lock(mMutex);
+    mCondition.signal();
+}
+
+bool StreamSplitter::Output::threadLoop() {
+    BufferItem item;
+    { // Autolock scope
+        Mutex::Autolock lock(mMutex);
+        // Buffers already handed to us are still queued before exiting,
+        // since the splitter is tracking them
+        while (mPending.isEmpty()) {
+            if (exitPending()) {
+                return false;
+            }
+            mCondition.wait(mMutex);
+        }
+        item = mPending[0];
+        mPending.removeAt(0);
+    }
+
+    sp<StreamSplitter> splitter = mSplitter.promote();
+    if (splitter == NULL) {
+        return false;
+    }
+    splitter->queueToOutput(this, item);
+    return true;
+}
+
 StreamSplitter::BufferTracker::BufferTracker(const sp<GraphicBuffer>& buffer)
       : mBuffer(buffer), mMergedFence(Fence::NO_FENCE), mReleaseCount(0) {}
 
 StreamSplitter::BufferTracker::~BufferTracker() {}
 
 void StreamSplitter::BufferTracker::mergeFence(const sp<Fence>& with) {
+    if (!with->isValid()) {
+        return;
+    }
     mMergedFence = Fence::merge(String8("StreamSplitter"), mMergedFence, with);
 }
 
@@ -20,6 +20,7 @@
 
 #include <android/native_window.h>
 
+#include <binder/IMemory.h>
 #include <binder/Parcel.h>
 
 #include <utils/Log.h>
@@ -29,6 +30,7 @@
 #include <ui/Fence.h>
 #include <ui/Region.h>
 
+#include <gui/BufferQueueControlBlock.h>
 #include <gui/IProducerListener.h>
 #include <gui/ISurfaceComposer.h>
 #include <gui/SurfaceComposerClient.h>
@@ -39,6 +41,10 @@
 
 namespace android {
 
+// How long dequeueBuffer waits for the previous asynchronous queueBuffer
+// before going ahead regardless
+static const nsecs_t ASYNC_QUEUE_TIMEOUT = ms2ns(1000);
+
 Surface::Surface(
         const sp<IGraphicBufferProducer>& bufferProducer,
         bool controlledByApp)
@@ -80,9 +86,16 @@ Surface::Surface(
     mConnectedToCpu = false;
     mProducerControlledByApp = controlledByApp;
     mSwapIntervalZero = false;
+    mAsyncQueueBuffer = false;
+    mQueueSerial = 0;
+    mAsyncQueuePending = false;
+    mLastQueuedFrameNumber = 0;
 }
 
 Surface::~Surface() {
+    if (mDequeueAhead != NULL) {
+        mDequeueAhead->stop();
+    }
     if (mConnectedToCpu) {
         Surface::disconnect(NATIVE_WINDOW_API_CPU);
     }
@@ -115,6 +128,31 @@ String8 Surface::getConsumerName() const {
     return mGraphicBufferProducer->getConsumerName();
 }
 
+void Surface::setAsyncQueueBuffer(bool async) {
+    Mutex::Autolock lock(mMutex);
+    if (!async) {
+        waitForAsyncQueueLocked();
+    }
+    mAsyncQueueBuffer = async;
+}
+
+uint64_t Surface::getLastQueuedFrameNumber() const {
+    Mutex::Autolock lock(mMutex);
+    if (mAsyncQueuePending && mControlBlock != NULL) {
+        BufferQueueControlBlock::State state;
+        if (mControlBlock->read(&state)) {
+            return state.frameCounter;
+        }
+    }
+    return mLastQueuedFrameNumber;
+}
+
+status_t Surface::getFrameTimestamps(uint64_t frameNumber,
+        FrameTimestamps* outTimestamps) const {
+    return mGraphicBufferProducer->getFrameTimestamps(frameNumber,
+            outTimestamps);
+}
+
 int Surface::hook_setSwapInterval(ANativeWindow* window, int interval) {
     Surface* c = getSelf(window);
     return c->setSwapInterval(interval);
@@ -187,6 +225,49 @@ int Surface::hook_perform(ANativeWindow* window, int operation, ...) {
     return c->perform(operation, args);
 }
 
+void Surface::setDequeueAhead(bool enabled) {
+    Mutex::Autolock lock(mMutex);
+    if (enabled == (mDequeueAhead != NULL)) {
+        return;
+    }
+    if (enabled) {
+        mDequeueAhead = new DequeueAheadThread(mGraphicBufferProducer);
+        mDequeueAhead->run("Surface::DequeueAhead");
+    } else {
+        mDequeueAhead->stop();
+        mDequeueAhead.clear();
+    }
+}
+
+Surface::DequeueRequest Surface::getDequeueRequestLocked() const {
+    DequeueRequest request;
+    request.width = mReqWidth ? mReqWidth : mUserWidth;
+    request.height = mReqHeight ? mReqHeight : mUserHeight;
+    request.format = mReqFormat;
+    request.usage = mReqUsage;
+    request.async = mSwapIntervalZero;
+    return request;
+}
+
+void Surface::dropStaleBufferLocked(int slot, status_t result) {
+    // The dequeue may have reallocated buffers we aren't going to ask for
+    if (result & IGraphicBufferProducer::RELEASE_ALL_BUFFERS) {
+        freeAllBuffers();
+    } else if ((result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) &&
+            slot >= 0 && slot < NUM_BUFFER_SLOTS) {
+        mSlots[slot].buffer = 0;
+    }
+}
+
+void Surface::discardDequeueAheadLocked(bool cancel) {
+    int slot = BufferQueue::INVALID_BUFFER_SLOT;
+    status_t result = NO_INIT;
+    mDequeueAhead->discard(cancel, &slot, &result);
+    if (result >= 0) {
+        dropStaleBufferLocked(slot, result);
+    }
+}
+
 int Surface::setSwapInterval(int interval) {
     ATRACE_CALL();
     // EGL specification states:
@@ -208,32 +289,47 @@ int Surface::dequeueBuffer(android_native_buffer_t** buffer, int* fenceFd) {
     ATRACE_CALL();
     ALOGV("Surface::dequeueBuffer");
 
-    uint32_t reqWidth;
-    uint32_t reqHeight;
-    bool swapIntervalZero;
-    PixelFormat reqFormat;
-    uint32_t reqUsage;
+    DequeueRequest request;
+    sp<DequeueAheadThread> dequeueAhead;
 
     {
         Mutex::Autolock lock(mMutex);
 
-        reqWidth = mReqWidth ? mReqWidth : mUserWidth;
-        reqHeight = mReqHeight ? mReqHeight : mUserHeight;
+        // Make sure the server has seen our last buffer before asking it for
+        // another, and report if queuing it failed
+        status_t queueResult = waitForAsyncQueueLocked();
+        if (queueResult != NO_ERROR && queueResult != TIMED_OUT) {
+            return queueResult;
+        }
 
-        swapIntervalZero = mSwapIntervalZero;
-        reqFormat = mReqFormat;
-        reqUsage = mReqUsage;
+        request = getDequeueRequestLocked();
+        dequeueAhead = mDequeueAhead;
     } // Drop the lock so that we can still touch the Surface while blocking in IGBP::dequeueBuffer
 
     int buf = -1;
     sp<Fence> fence;
-    status_t result = mGraphicBufferProducer->dequeueBuffer(&buf, &fence, swapIntervalZero,
-            reqWidth, reqHeight, reqFormat, reqUsage);
+    status_t result = NO_ERROR;
+    bool dequeuedAhead = false;
+    if (dequeueAhead != NULL) {
+        int staleSlot = BufferQueue::INVALID_BUFFER_SLOT;
+        status_t staleResult = NO_INIT;
+        dequeuedAhead = dequeueAhead->take(request, &buf, &fence, &result,
+                &staleSlot, &staleResult);
+        if (!dequeuedAhead && staleResult >= 0) {
+            Mutex::Autolock lock(mMutex);
+            dropStaleBufferLocked(staleSlot, staleResult);
+        }
+    }
+    if (!dequeuedAhead) {
+        result = mGraphicBufferProducer->dequeueBuffer(&buf, &fence,
+                request.async, request.width, request.height,
+                request.format, request.usage);
+    }
 
     if (result < 0) {
         ALOGV("dequeueBuffer: IGraphicBufferProducer::dequeueBuffer(%d, %d, %d, %d, %d)"
-             "failed: %d", swapIntervalZero, reqWidth, reqHeight, reqFormat,
-             reqUsage, result);
+             "failed: %d", request.async, request.width, request.height,
+             request.format, request.usage, result);
         return result;
     }
 
@@ -404,27 +500,82 @@ int Surface::queueBuffer(android_native_buffer_t* buffer, int fenceFd) {
         input.setSurfaceDamage(flippedRegion);
     }
 
-    status_t err = mGraphicBufferProducer->queueBuffer(i, input, &output);
-    if (err != OK)  {
-        ALOGE("queueBuffer: error queuing buffer to SurfaceTexture, %d", err);
-    }
-    uint32_t numPendingBuffers = 0;
-    uint32_t hint = 0;
-    output.deflate(&mDefaultWidth, &mDefaultHeight, &hint,
-            &numPendingBuffers);
-
-    // Disable transform hint if sticky transform is set.
-    if (mStickyTransform == 0) {
-        mTransformHint = hint;
-    }
+    status_t err = NO_ERROR;
+    if (mAsyncQueueBuffer && mControlBlock != NULL) {
+        // The output is picked up from the control block once the queue has
+        // completed, in waitForAsyncQueueLocked
+        mQueueSerial++;
+        err = mGraphicBufferProducer->queueBufferAsync(i, input,
+                static_cast<int32_t>(mQueueSerial));
+        if (err != OK) {
+            // Nothing will complete this serial, so don't wait for it
+            ALOGE("queueBuffer: error queuing buffer asynchronously, %d", err);
+        } else {
+            mAsyncQueuePending = true;
+        }
+    } else {
+        err = mGraphicBufferProducer->queueBuffer(i, input, &output);
+        if (err != OK)  {
+            ALOGE("queueBuffer: error queuing buffer to SurfaceTexture, %d", err);
+        }
+        uint32_t numPendingBuffers = 0;
+        uint32_t hint = 0;
+        output.deflate(&mDefaultWidth, &mDefaultHeight, &hint,
+                &numPendingBuffers);
+        mLastQueuedFrameNumber = output.getFrameNumber();
+
+        // Disable transform hint if sticky transform is set.
+        if (mStickyTransform == 0) {
+            mTransformHint = hint;
+        }
 
-    mConsumerRunningBehind = (numPendingBuffers >= 2);
+        mConsumerRunningBehind = (numPendingBuffers >= 2);
+    }
 
     if (!mConnectedToCpu) {
         // Clear surface damage back to full-buffer
         mDirtyRegion = Region::INVALID_REGION;
     }
 
+    if (err == OK && mDequeueAhead != NULL) {
+        if (mAsyncQueuePending) {
+            mDequeueAhead->request(getDequeueRequestLocked(), mControlBlock,
+                    static_cast<int32_t>(mQueueSerial));
+        } else {
+            mDequeueAhead->request(getDequeueRequestLocked(), NULL, 0);
+        }
+    }
+
+    return err;
+}
+
+status_t Surface::waitForAsyncQueueLocked() {
+    if (!mAsyncQueuePending) {
+        return NO_ERROR;
+    }
+    mAsyncQueuePending = false;
+    if (mControlBlock == NULL) {
+        return NO_ERROR;
+    }
+
+    ATRACE_CALL();
+    status_t err = mControlBlock->waitForQueue(
+            static_cast<int32_t>(mQueueSerial), ASYNC_QUEUE_TIMEOUT);
+    if (err != NO_ERROR) {
+        ALOGE("waitForAsyncQueueLocked: error queuing buffer: %d", err);
+    }
+
+    BufferQueueControlBlock::State state;
+    if (mControlBlock->read(&state)) {
+        mDefaultWidth = state.defaultWidth;
+        mDefaultHeight = state.defaultHeight;
+        // Disable transform hint if sticky transform is set.
+        if (mStickyTransform == 0) {
+            mTransformHint = state.transformHint;
+        }
+        mConsumerRunningBehind = (state.numPendingBuffers >= 2);
+        mLastQueuedFrameNumber = state.frameCounter;
+    }
     return err;
 }
 
@@ -468,6 +619,9 @@ int Surface::query(int what, int* value) const {
                 status_t err = NO_ERROR;
                 if (!mConsumerRunningBehind) {
                     *value = 0;
+                } else if (mControlBlock != NULL &&
+                        mControlBlock->query(what, value)) {
+                    mConsumerRunningBehind = *value;
                 } else {
                     err = mGraphicBufferProducer->query(what, value);
                     if (err == NO_ERROR) {
@@ -477,6 +631,9 @@ int Surface::query(int what, int* value) const {
                 return err;
             }
         }
+        if (mControlBlock != NULL && mControlBlock->query(what, value)) {
+            return NO_ERROR;
+        }
     }
     return mGraphicBufferProducer->query(what, value);
 }
@@ -678,6 +835,16 @@ int Surface::connect(int api, const sp<IProducerListener>& listener) {
         }
 
         mConsumerRunningBehind = (numPendingBuffers >= 2);
+
+        sp<IMemoryHeap> heap;
+        if (mGraphicBufferProducer->getControlBlock(&heap) == NO_ERROR) {
+            mControlBlock = BufferQueueControlBlock::attach(heap);
+        }
+        if (mControlBlock != NULL) {
+            // Earlier connections may have queued asynchronously already
+            mQueueSerial = static_cast<uint32_t>(
+                    mControlBlock->getQueueSerial());
+        }
     }
     if (!err && api == NATIVE_WINDOW_API_CPU) {
         mConnectedToCpu = true;
@@ -696,8 +863,14 @@ int Surface::disconnect(int api) {
     ATRACE_CALL();
     ALOGV("Surface::disconnect");
     Mutex::Autolock lock(mMutex);
+    waitForAsyncQueueLocked();
     freeAllBuffers();
     int err = mGraphicBufferProducer->disconnect(api);
+    if (mDequeueAhead != NULL) {
+        // Disconnecting frees the slots and wakes up a dequeue in flight, so
+        // the buffer only needs cancelling if we're still connected
+        discardDequeueAheadLocked(err != NO_ERROR);
+    }
     if (!err) {
         mReqFormat = 0;
         mReqWidth = 0;
@@ -707,6 +880,7 @@ int Surface::disconnect(int api) {
         mScalingMode = NATIVE_WINDOW_SCALING_MODE_FREEZE;
         mTransform = 0;
         mStickyTransform = 0;
+        mControlBlock.clear();
 
         if (api == NATIVE_WINDOW_API_CPU) {
             mConnectedToCpu = false;
@@ -800,6 +974,11 @@ int Surface::setBufferCount(int bufferCount)
     ALOGV("Surface::setBufferCount");
     Mutex::Autolock lock(mMutex);
 
+    if (mDequeueAhead != NULL) {
+        // The buffer count can't change while a buffer is dequeued
+        discardDequeueAheadLocked(true);
+    }
+
     status_t err = mGraphicBufferProducer->setBufferCount(bufferCount);
     ALOGE_IF(err, "IGraphicBufferProducer::setBufferCount(%d) returned %s",
             bufferCount, strerror(-err));
@@ -932,8 +1111,11 @@ void Surface::setSurfaceDamage(android_native_rect_t* rects, size_t numRects) {
 // ----------------------------------------------------------------------
 // the lock/unlock APIs must be used from the same thread
 
+// Copies reg from src into dst, which the caller has already locked for
+// writing at dst_bits
 static status_t copyBlt(
         const sp<GraphicBuffer>& dst,
+        uint8_t* dst_bits,
         const sp<GraphicBuffer>& src,
         const Region& reg)
 {
@@ -945,11 +1127,6 @@ static status_t copyBlt(
             reinterpret_cast<void**>(&src_bits));
     ALOGE_IF(err, "error locking src buffer %s", strerror(-err));
 
-    uint8_t* dst_bits = NULL;
-    err = dst->lock(GRALLOC_USAGE_SW_WRITE_OFTEN, reg.bounds(),
-            reinterpret_cast<void**>(&dst_bits));
-    ALOGE_IF(err, "error locking dst buffer %s", strerror(-err));
-
     Region::const_iterator head(reg.begin());
     Region::const_iterator tail(reg.end());
     if (head != tail && src_bits && dst_bits) {
@@ -966,8 +1143,10 @@ static status_t copyBlt(
                     static_cast<uint32_t>(r.left + src->stride * r.top) * bpp;
             uint8_t       * d = dst_bits +
                     static_cast<uint32_t>(r.left + dst->stride * r.top) * bpp;
-            if (dbpr==sbpr && size==sbpr) {
-                size *= static_cast<size_t>(h);
+            // Rows that span the whole buffer are copied in one go, along
+            // with the stride padding between them
+            if (dbpr==sbpr && r.width() == src->width) {
+                size += static_cast<size_t>(h - 1) * sbpr;
                 h = 1;
             }
             do {
@@ -981,9 +1160,6 @@ static status_t copyBlt(
     if (src_bits)
         src->unlock();
 
-    if (dst_bits)
-        dst->unlock();
-
     return err;
 }
 
@@ -991,6 +1167,12 @@ static status_t copyBlt(
 
 status_t Surface::lock(
         ANativeWindow_Buffer* outBuffer, ARect* inOutDirtyBounds)
+{
+    return lock(outBuffer, inOutDirtyBounds, 0, NULL);
+}
+
+status_t Surface::lock(ANativeWindow_Buffer* outBuffer,
+        ARect* inOutDirtyBounds, uint32_t flags, int* outBufferAge)
 {
     if (mLockedBuffer != 0) {
         ALOGE("Surface::lock failed, already locked");
@@ -1028,12 +1210,25 @@ status_t Surface::lock(
                 backBuffer->width  == frontBuffer->width &&
                 backBuffer->height == frontBuffer->height &&
                 backBuffer->format == frontBuffer->format);
-
+        // nothing survives from the back buffer when it's redrawn entirely
+        const bool redrawAll = newDirtyRegion.isRect() &&
+                newDirtyRegion.getBounds() == bounds;
+
+        // the area that is invalid and not repainted this round, which is
+        // copied from the front buffer once the back buffer is locked
+        Region copyback;
+        int bufferAge = 0;
         if (canCopyBack) {
-            // copy the area that is invalid and not repainted this round
-            const Region copyback(mDirtyRegion.subtract(newDirtyRegion));
-            if (!copyback.isEmpty())
-                copyBlt(backBuffer, frontBuffer, copyback);
+            if (flags & LOCK_NO_COPY_BACK) {
+                if (query(NATIVE_WINDOW_BUFFER_AGE, &bufferAge) != NO_ERROR) {
+                    bufferAge = 0;
+                }
+            } else {
+                if (!redrawAll) {
+                    copyback = mDirtyRegion.subtract(newDirtyRegion);
+                }
+                bufferAge = 1;
+            }
         } else {
             // if we can't copy-back anything, modify the user's dirty
             // region to make sure they redraw the whole buffer
@@ -1061,10 +1256,19 @@ status_t Surface::lock(
             *inOutDirtyBounds = newDirtyRegion.getBounds();
         }
 
+        if (outBufferAge) {
+            *outBufferAge = bufferAge;
+        }
+
+        // The back buffer is locked once, waiting for its fence, both for
+        // the copy-back and for the caller. Without copy-back, the caller
+        // may draw beyond the dirty bounds to catch up with the buffer's age.
         void* vaddr;
         status_t res = backBuffer->lockAsync(
                 GRALLOC_USAGE_SW_READ_OFTEN | GRALLOC_USAGE_SW_WRITE_OFTEN,
-                newDirtyRegion.bounds(), &vaddr, fenceFd);
+                (flags & LOCK_NO_COPY_BACK) ? bounds :
+                        newDirtyRegion.merge(copyback).bounds(),
+                &vaddr, fenceFd);
 
         ALOGW_IF(res, "failed locking buffer (handle = %p)",
                 backBuffer->handle);
@@ -1072,6 +1276,10 @@ status_t Surface::lock(
         if (res != 0) {
             err = INVALID_OPERATION;
         } else {
+            if (!copyback.isEmpty()) {
+                copyBlt(backBuffer, static_cast<uint8_t*>(vaddr), frontBuffer,
+                        copyback);
+            }
             mLockedBuffer = backBuffer;
             outBuffer->width  = backBuffer->width;
             outBuffer->height = backBuffer->height;
@@ -1103,4 +1311,136 @@ status_t Surface::unlockAndPost()
     return err;
 }
 
+// ----------------------------------------------------------------------------
+
+Surface::DequeueAheadThread::DequeueAheadThread(
+        const sp<IGraphicBufferProducer>& producer)
+      : Thread(false), mProducer(producer), mMutex(), mCondition(),
+        mState(IDLE), mRequest(), mControlBlock(), mQueueSerial(0),
+        mSlot(BufferQueue::INVALID_BUFFER_SLOT), mFence(), mResult(NO_ERROR) {}
+
+Surface::DequeueAheadThread::~DequeueAheadThread() {}
+
+void Surface::DequeueAheadThread::request(const DequeueRequest& request,
+        const sp<BufferQueueControlBlock>& controlBlock, int32_t queueSerial) {
+    Mutex::Autolock lock(mMutex);
+    if (mState != IDLE) {
+        return;
+    }
+    mRequest = request;
+    mControlBlock = controlBlock;
+    mQueueSerial = queueSerial;
+    mState = REQUESTED;
+    mCondition.broadcast();
+}
+
+void Surface::DequeueAheadThread::waitForResultLocked() {
+    while (mState == REQUESTED || mState == DEQUEUEING) {
+        mCondition.wait(mMutex);
+    }
+}
+
+bool Surface::DequeueAheadThread::take(const DequeueRequest& request,
+        int* outSlot, sp<Fence>* outFence, status_t* outResult,
+        int* outStaleSlot, status_t* outStaleResult) {
+    ATRACE_CALL();
+    Mutex::Autolock lock(mMutex);
+    waitForResultLocked();
+    if (mState == IDLE) {
+        return false;
+    }
+    mState = IDLE;
+    if (mResult < 0) {
+        // Let the caller retry, and report the error if it persists
+        return false;
+    }
+    if (!(mRequest == request)) {
+        ALOGV("take: parameters changed, cancelling slot %d", mSlot);
+        mProducer->cancelBuffer(mSlot, mFence);
+        mFence.clear();
+        *outStaleSlot = mSlot;
+        *outStaleResult = mResult;
+        return false;
+    }
+    *outSlot = mSlot;
+    *outFence = mFence;
+    *outResult = mResult;
+    mFence.clear();
+    return true;
+}
+
+void Surface::DequeueAheadThread::discard(bool cancel, int* outSlot,
+        status_t* outResult) {
+    Mutex::Autolock lock(mMutex);
+    waitForResultLocked();
+    if (mState == DONE && mResult >= 0) {
+        if (cancel) {
+            mProducer->cancelBuffer(mSlot, mFence);
+        }
+        *outSlot = mSlot;
+        *outResult = mResult;
+    }
+    mState = IDLE;
+    mFence.clear();
+}
+
+void Surface::DequeueAheadThread::stop() {
+    requestExit();
+    Mutex::Autolock lock(mMutex);
+    if (mState == DONE && mResult >= 0) {
+        mProducer->cancelBuffer(mSlot, mFence);
+    }
+    if (mState != DEQUEUEING) {
+        mState = IDLE;
+    }
+    mFence.clear();
+    mCondition.broadcast();
+}
+
+bool Surface::DequeueAheadThread::threadLoop() {
+    DequeueRequest request;
+    sp<BufferQueueControlBlock> controlBlock;
+    int32_t queueSerial;
+    { // Autolock scope
+        Mutex::Autolock lock(mMutex);
+        while (mState != REQUESTED) {
+            if (exitPending()) {
+                return false;
+            }
+            mCondition.wait(mMutex);
+        }
+        request = mRequest;
+        controlBlock = mControlBlock;
+        queueSerial = mQueueSerial;
+        mControlBlock.clear();
+        mState = DEQUEUEING;
+    }
+
+    ATRACE_NAME("dequeueAhead");
+    if (controlBlock != NULL) {
+        // Errors are reported by the Surface's own wait for this queue
+        controlBlock->waitForQueue(queueSerial, ASYNC_QUEUE_TIMEOUT);
+    }
+    int slot = BufferQueue::INVALID_BUFFER_SLOT;
+    sp<Fence> fence;
+    status_t result = mProducer->dequeueBuffer(&slot, &fence, request.async,
+            request.width, request.height, request.format, request.usage);
+
+    Mutex::Autolock lock(mMutex);
+    if (exitPending()) {
+        if (result >= 0) {
+            mProducer->cancelBuffer(slot, fence);
+        }
+        mState = IDLE;
+        mCondition.broadcast();
+        return false;
+    }
+    mSlot = slot;
+    mFence = fence;
+    mResult = result;
+    mState = DONE;
+    mCondition.broadcast();
+    return true;
+}
+
 }; // namespace android
@@ -239,7 +239,14 @@ void Composer::closeGlobalTransactionImpl(bool synchronous) {
         mAnimation = false;
     }
 
-   sm->setTransactionState(transaction, displayTransaction, flags);
+    // Nothing changed, so there is nothing for SurfaceFlinger to do. A
+    // synchronous transaction is still sent even when empty, since callers
+    // use it to wait for the previous one to be applied.
+    if (transaction.isEmpty() && displayTransaction.isEmpty() && !flags) {
+        return;
+    }
+
+    sm->setTransactionState(transaction, displayTransaction, flags);
 }
 
 void Composer::setAnimationTransactionImpl() {
@@ -538,6 +545,14 @@ status_t SurfaceComposerClient::getLayerFrameStats(const sp<IBinder>& token,
     return mClient->getLayerFrameStats(token, outStats);
 }
 
+status_t SurfaceComposerClient::getLayerFrameStatsSummary(
+        const sp<IBinder>& token, FrameStatsSummary* outSummary) const {
+    if (mStatus != NO_ERROR) {
+        return mStatus;
+    }
+    return mClient->getLayerFrameStatsSummary(token, outSummary);
+}
+
 inline Composer& SurfaceComposerClient::getComposer() {
     return mComposer;
 }
@@ -681,6 +696,12 @@ status_t SurfaceComposerClient::getAnimationFrameStats(FrameStats* outStats) {
     return ComposerService::getComposerService()->getAnimationFrameStats(outStats);
 }
 
+status_t SurfaceComposerClient::getAnimationFrameStatsSummary(
+        FrameStatsSummary* outSummary) {
+    return ComposerService::getComposerService()->getAnimationFrameStatsSummary(
+            outSummary);
+}
+
 // ----------------------------------------------------------------------------
 
 status_t ScreenshotClient::capture(
@@ -42,6 +42,29 @@ LOCAL_SHARED_LIBRARIES := \
 # to integrate with auto-test framework.
 include $(BUILD_NATIVE_TEST)
 
+# Build the BufferQueue benchmark
+include $(CLEAR_VARS)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+
+LOCAL_CLANG := true
+
+LOCAL_MODULE := BufferQueueBenchmark
+
+LOCAL_MODULE_TAGS := tests
+
+LOCAL_SRC_FILES := \
+    BufferQueueBenchmark.cpp \
+
+LOCAL_SHARED_LIBRARIES := \
+	libEGL \
+	libGLESv2 \
+	libbinder \
+	libgui \
+	libui \
+	libutils \
+
+include $(BUILD_NATIVE_TEST)
+
 # Include subdirectory makefiles
 # ============================================================
 
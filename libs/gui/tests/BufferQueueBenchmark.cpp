@@ -0,0 +1,559 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * BufferQueue benchmarks: dequeue/queue/acquire/release latency for
+ * in-process and cross-process queues, in sync and async mode and with
+ * varying buffer counts, plus eglSwapBuffers on a GLES producer. A fuzz
+ * pass then drives an in-process queue with random sequences of producer
+ * and consumer calls, checks every result against what the interface
+ * documents, and reports the latencies seen under that irregular load.
+ *
+ * usage: BufferQueueBenchmark [-i iterations] [-s size] [-r seed]
+ */
+
+#include <errno.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/wait.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <binder/IPCThreadState.h>
+#include <binder/IServiceManager.h>
+#include <binder/ProcessState.h>
+
+#include <gui/BufferItem.h>
+#include <gui/BufferQueue.h>
+#include <gui/IConsumerListener.h>
+#include <gui/IGraphicBufferConsumer.h>
+#include <gui/IGraphicBufferProducer.h>
+#include <gui/Surface.h>
+
+#include <ui/Fence.h>
+#include <ui/GraphicBuffer.h>
+
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include "DummyConsumer.h"
+
+using namespace android;
+
+static const String16 kServiceName("BufferQueueBenchmark.producer");
+
+static const uint32_t USAGE = GRALLOC_USAGE_SW_READ_OFTEN |
+        GRALLOC_USAGE_SW_WRITE_OFTEN;
+
+// ---------------------------------------------------------------------------
+
+struct Results {
+    std::vector<nsecs_t> samples;
+
+    void add(nsecs_t t) { samples.push_back(t); }
+    void clear() { samples.clear(); }
+
+    nsecs_t percentile(size_t p) const {
+        if (samples.empty()) return 0;
+        return samples[std::min(samples.size() - 1, samples.size() * p / 100)];
+    }
+
+    void print(const char* name) {
+        std::sort(samples.begin(), samples.end());
+        nsecs_t total = 0;
+        for (size_t i = 0; i < samples.size(); i++) {
+            total += samples[i];
+        }
+        printf("%-36s n=%-7zu avg=%8.2fus p50=%8.2fus p90=%8.2fus "
+                "p99=%8.2fus max=%8.2fus\n",
+                name, samples.size(),
+                samples.empty() ? 0.0 : total / 1000.0 / samples.size(),
+                percentile(50) / 1000.0, percentile(90) / 1000.0,
+                percentile(99) / 1000.0,
+                samples.empty() ? 0.0 : samples.back() / 1000.0);
+        fflush(stdout);
+    }
+};
+
+struct Config {
+    const char* name;
+    bool async;
+    int bufferCount;
+};
+
+static const Config kConfigs[] = {
+    { "sync 2 buffers",  false, 2 },
+    { "sync 3 buffers",  false, 3 },
+    { "sync 4 buffers",  false, 4 },
+    { "async 3 buffers", true,  3 },
+};
+
+static void printResult(Results& r, const char* mode, const char* config,
+        const char* op) {
+    char name[64];
+    if (config[0] != '\0') {
+        snprintf(name, sizeof(name), "%s %s %s", mode, config, op);
+    } else {
+        snprintf(name, sizeof(name), "%s %s", mode, op);
+    }
+    r.print(name);
+}
+
+// ---------------------------------------------------------------------------
+
+// Acquires and releases every buffer as soon as it's queued, recording the
+// latency of both calls and the time from queueBuffer to acquireBuffer.
+class AcquiringListener : public BnConsumerListener {
+public:
+    AcquiringListener(const char* label) : mLabel(label) {}
+
+    void setConsumer(const sp<IGraphicBufferConsumer>& consumer) {
+        mConsumer = consumer;
+    }
+
+    virtual void onFrameAvailable(const BufferItem& /* item */) {
+        Mutex::Autolock lock(mMutex);
+        BufferItem item;
+        nsecs_t start = systemTime();
+        if (mConsumer->acquireBuffer(&item, 0) != NO_ERROR) {
+            return;
+        }
+        nsecs_t acquired = systemTime();
+        mAcquire.add(acquired - start);
+        if (!item.mIsAutoTimestamp) {
+            mEndToEnd.add(acquired - item.mTimestamp);
+        }
+
+        start = systemTime();
+        mConsumer->releaseBuffer(item.mBuf, item.mFrameNumber,
+                EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE);
+        mRelease.add(systemTime() - start);
+    }
+
+    // Called when the producer disconnects or changes the buffer count; the
+    // results collected so far belong to the configuration that just ended.
+    virtual void onBuffersReleased() {
+        Mutex::Autolock lock(mMutex);
+        if (!mAcquire.samples.empty()) {
+            printResult(mAcquire, mLabel, "", "acquire");
+            printResult(mRelease, mLabel, "", "release");
+            printResult(mEndToEnd, mLabel, "", "queue to acquire");
+        }
+        mAcquire.clear();
+        mRelease.clear();
+        mEndToEnd.clear();
+    }
+
+    virtual void onSidebandStreamChanged() {}
+
+private:
+    const char* mLabel;
+    Mutex mMutex;
+    sp<IGraphicBufferConsumer> mConsumer;
+    Results mAcquire;
+    Results mRelease;
+    Results mEndToEnd;
+};
+
+// Runs iterations dequeue/queue cycles on producer. If consumer is set, each
+// buffer is acquired and released right away on the same thread, otherwise
+// the consumer is expected to do it from its listener.
+static void benchProducer(const sp<IGraphicBufferProducer>& producer,
+        const sp<IGraphicBufferConsumer>& consumer, const char* mode,
+        const Config& config, size_t iterations, uint32_t size)
+{
+    IGraphicBufferProducer::QueueBufferOutput output;
+    if (producer->connect(NULL, NATIVE_WINDOW_API_CPU, false, &output)
+            != NO_ERROR) {
+        printf("%s %s: connect failed\n", mode, config.name);
+        return;
+    }
+    producer->setBufferCount(config.bufferCount);
+
+    Results dequeue, queue, acquire, release;
+    for (size_t i = 0; i < iterations; i++) {
+        int slot;
+        sp<Fence> fence;
+        nsecs_t start = systemTime();
+        status_t result = producer->dequeueBuffer(&slot, &fence,
+                config.async, size, size, PIXEL_FORMAT_RGBA_8888, USAGE);
+        if (result < 0) {
+            printf("%s %s: dequeueBuffer failed (%d)\n", mode, config.name,
+                    result);
+            break;
+        }
+        if (result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+            // Allocation is not what's being measured
+            sp<GraphicBuffer> buffer;
+            producer->requestBuffer(slot, &buffer);
+        } else {
+            dequeue.add(systemTime() - start);
+        }
+
+        IGraphicBufferProducer::QueueBufferInput input(
+                systemTime(SYSTEM_TIME_MONOTONIC), false,
+                HAL_DATASPACE_UNKNOWN, Rect(size, size),
+                NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, config.async,
+                Fence::NO_FENCE);
+        start = systemTime();
+        if (producer->queueBuffer(slot, input, &output) != NO_ERROR) {
+            printf("%s %s: queueBuffer failed\n", mode, config.name);
+            break;
+        }
+        queue.add(systemTime() - start);
+
+        if (consumer != NULL) {
+            BufferItem item;
+            start = systemTime();
+            if (consumer->acquireBuffer(&item, 0) == NO_ERROR) {
+                acquire.add(systemTime() - start);
+                start = systemTime();
+                consumer->releaseBuffer(item.mBuf, item.mFrameNumber,
+                        EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE);
+                release.add(systemTime() - start);
+            }
+        }
+    }
+
+    printResult(dequeue, mode, config.name, "dequeue");
+    printResult(queue, mode, config.name, "queue");
+    if (consumer != NULL) {
+        printResult(acquire, mode, config.name, "acquire");
+        printResult(release, mode, config.name, "release");
+    }
+    producer->disconnect(NATIVE_WINDOW_API_CPU);
+}
+
+static void benchInProcess(size_t iterations, uint32_t size)
+{
+    for (size_t c = 0; c < sizeof(kConfigs) / sizeof(kConfigs[0]); c++) {
+        sp<IGraphicBufferProducer> producer;
+        sp<IGraphicBufferConsumer> consumer;
+        BufferQueue::createBufferQueue(&producer, &consumer);
+        consumer->consumerConnect(new DummyConsumer, false);
+        benchProducer(producer, consumer, "local", kConfigs[c], iterations,
+                size);
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+// One random producer or consumer call per iteration on a non-blocking
+// queue, over a partly dequeued, queued and acquired set of buffers, with
+// the occasional reconnect at a new buffer count. Returns false, after
+// printing what failed, as soon as a call returns something it shouldn't.
+static bool fuzzInProcess(size_t iterations, uint32_t size, unsigned int seed)
+{
+    static const char* const mode = "fuzz";
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+    // Controlled by the app on both sides, so dequeueBuffer never blocks
+    consumer->consumerConnect(new DummyConsumer, true);
+
+    unsigned int state = seed;
+    const Config* config = &kConfigs[rand_r(&state) % (sizeof(kConfigs) / sizeof(kConfigs[0]))];
+    IGraphicBufferProducer::QueueBufferOutput output;
+    if (producer->connect(NULL, NATIVE_WINDOW_API_CPU, true, &output) != NO_ERROR ||
+            producer->setBufferCount(config->bufferCount) != NO_ERROR) {
+        printf("%s: connect failed\n", mode);
+        return false;
+    }
+
+    std::vector<int> dequeued;
+    std::vector<BufferItem> acquired;
+    Results dequeue, queue, cancel, acquire, release;
+    bool ok = true;
+    for (size_t i = 0; ok && i < iterations; i++) {
+        const int op = rand_r(&state) % 6;
+        const char* opName = "";
+        status_t result = NO_ERROR;
+        nsecs_t start = systemTime();
+        if (op == 0) {
+            opName = "dequeueBuffer";
+            int slot;
+            sp<Fence> fence;
+            result = producer->dequeueBuffer(&slot, &fence, config->async,
+                    size, size, PIXEL_FORMAT_RGBA_8888, USAGE);
+            if (result >= 0) {
+                if (result & IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION) {
+                    sp<GraphicBuffer> buffer;
+                    producer->requestBuffer(slot, &buffer);
+                } else {
+                    dequeue.add(systemTime() - start);
+                }
+                dequeued.push_back(slot);
+                result = NO_ERROR;
+            } else if (result == WOULD_BLOCK || result == INVALID_OPERATION) {
+                result = NO_ERROR;
+            }
+        } else if (op == 1 && !dequeued.empty()) {
+            opName = "queueBuffer";
+            size_t index = rand_r(&state) % dequeued.size();
+            IGraphicBufferProducer::QueueBufferInput input(
+                    systemTime(SYSTEM_TIME_MONOTONIC), false,
+                    HAL_DATASPACE_UNKNOWN, Rect(size, size),
+                    NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, config->async,
+                    Fence::NO_FENCE);
+            result = producer->queueBuffer(dequeued[index], input, &output);
+            queue.add(systemTime() - start);
+            dequeued.erase(dequeued.begin() + index);
+        } else if (op == 2 && !dequeued.empty()) {
+            opName = "cancelBuffer";
+            size_t index = rand_r(&state) % dequeued.size();
+            producer->cancelBuffer(dequeued[index], Fence::NO_FENCE);
+            cancel.add(systemTime() - start);
+            dequeued.erase(dequeued.begin() + index);
+        } else if (op == 3 && acquired.empty()) {
+            // Holding more than the one buffer the consumer may acquire
+            // would let dequeueBuffer block
+            opName = "acquireBuffer";
+            BufferItem item;
+            result = consumer->acquireBuffer(&item, 0);
+            if (result == NO_ERROR) {
+                acquire.add(systemTime() - start);
+                acquired.push_back(item);
+            } else if (result == IGraphicBufferConsumer::NO_BUFFER_AVAILABLE) {
+                result = NO_ERROR;
+            }
+        } else if (op == 4 && !acquired.empty()) {
+            opName = "releaseBuffer";
+            result = consumer->releaseBuffer(acquired[0].mBuf, acquired[0].mFrameNumber,
+                    EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE);
+            release.add(systemTime() - start);
+            if (result == IGraphicBufferConsumer::STALE_BUFFER_SLOT) {
+                result = NO_ERROR;
+            }
+            acquired.clear();
+        } else if (op == 5 && dequeued.empty() && rand_r(&state) % 16 == 0) {
+            opName = "reconnect";
+            for (size_t j = 0; j < acquired.size(); j++) {
+                consumer->releaseBuffer(acquired[j].mBuf, acquired[j].mFrameNumber,
+                        EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE);
+            }
+            acquired.clear();
+            config = &kConfigs[rand_r(&state) % (sizeof(kConfigs) / sizeof(kConfigs[0]))];
+            result = producer->disconnect(NATIVE_WINDOW_API_CPU);
+            if (result == NO_ERROR) {
+                result = producer->connect(NULL, NATIVE_WINDOW_API_CPU, true, &output);
+            }
+            if (result == NO_ERROR) {
+                result = producer->setBufferCount(config->bufferCount);
+            }
+        }
+
+        if (result != NO_ERROR) {
+            printf("%s: seed %u iteration %zu: %s failed (%d)\n", mode, seed, i,
+                    opName, result);
+            ok = false;
+        } else if (dequeued.size() > size_t(config->bufferCount)) {
+            printf("%s: seed %u iteration %zu: %zu buffers dequeued with %s\n",
+                    mode, seed, i, dequeued.size(), config->name);
+            ok = false;
+        }
+    }
+
+    printResult(dequeue, mode, "", "dequeue");
+    printResult(queue, mode, "", "queue");
+    printResult(cancel, mode, "", "cancel");
+    printResult(acquire, mode, "", "acquire");
+    printResult(release, mode, "", "release");
+    producer->disconnect(NATIVE_WINDOW_API_CPU);
+    return ok;
+}
+
+// ---------------------------------------------------------------------------
+
+static int runConsumer(int readyFd)
+{
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+    sp<AcquiringListener> listener = new AcquiringListener("remote consumer");
+    listener->setConsumer(consumer);
+    consumer->consumerConnect(listener, false);
+
+    status_t err = defaultServiceManager()->addService(kServiceName,
+            IInterface::asBinder(producer));
+    write(readyFd, &err, sizeof(err));
+    close(readyFd);
+    if (err != NO_ERROR) {
+        return EXIT_FAILURE;
+    }
+    ProcessState::self()->startThreadPool();
+    IPCThreadState::self()->joinThreadPool();
+    return EXIT_SUCCESS;
+}
+
+static void benchCrossProcess(size_t iterations, uint32_t size)
+{
+    // The consumer has to be forked before this process opens the driver.
+    int pipefd[2];
+    if (pipe(pipefd) < 0) {
+        printf("remote: pipe failed, %s\n", strerror(errno));
+        return;
+    }
+    pid_t pid = fork();
+    if (pid < 0) {
+        printf("remote: fork failed, %s\n", strerror(errno));
+        return;
+    }
+    if (pid == 0) {
+        close(pipefd[0]);
+        _exit(runConsumer(pipefd[1]));
+    }
+    close(pipefd[1]);
+    status_t status = NO_INIT;
+    read(pipefd[0], &status, sizeof(status));
+    close(pipefd[0]);
+
+    sp<IGraphicBufferProducer> producer;
+    if (status == NO_ERROR) {
+        producer = interface_cast<IGraphicBufferProducer>(
+                defaultServiceManager()->getService(kServiceName));
+    }
+    if (producer == NULL) {
+        printf("remote: consumer failed to start (%d)\n", status);
+    } else {
+        ProcessState::self()->startThreadPool();
+        for (size_t c = 0; c < sizeof(kConfigs) / sizeof(kConfigs[0]); c++) {
+            // The consumer prints its side when we disconnect
+            benchProducer(producer, NULL, "remote", kConfigs[c], iterations,
+                    size);
+        }
+    }
+    kill(pid, SIGKILL);
+    waitpid(pid, NULL, 0);
+}
+
+// ---------------------------------------------------------------------------
+
+static void benchGl(size_t iterations, uint32_t size, bool async)
+{
+    const char* mode = async ? "gl swap interval 0" : "gl swap interval 1";
+
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+    consumer->setDefaultBufferSize(size, size);
+    sp<AcquiringListener> listener = new AcquiringListener(mode);
+    listener->setConsumer(consumer);
+    consumer->consumerConnect(listener, false);
+    sp<Surface> surface = new Surface(producer);
+
+    EGLDisplay dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (dpy == EGL_NO_DISPLAY || !eglInitialize(dpy, NULL, NULL)) {
+        printf("%s: no EGL display\n", mode);
+        return;
+    }
+    static const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_WINDOW_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_RED_SIZE, 8,
+        EGL_GREEN_SIZE, 8,
+        EGL_BLUE_SIZE, 8,
+        EGL_ALPHA_SIZE, 8,
+        EGL_NONE
+    };
+    static const EGLint contextAttribs[] = {
+        EGL_CONTEXT_CLIENT_VERSION, 2,
+        EGL_NONE
+    };
+    EGLConfig config;
+    EGLint numConfigs = 0;
+    EGLSurface eglSurface = EGL_NO_SURFACE;
+    EGLContext context = EGL_NO_CONTEXT;
+    if (eglChooseConfig(dpy, configAttribs, &config, 1, &numConfigs) &&
+            numConfigs > 0) {
+        eglSurface = eglCreateWindowSurface(dpy, config, surface.get(), NULL);
+        context = eglCreateContext(dpy, config, EGL_NO_CONTEXT,
+                contextAttribs);
+    }
+    if (eglSurface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+            !eglMakeCurrent(dpy, eglSurface, eglSurface, context)) {
+        printf("%s: EGL setup failed (%#x)\n", mode, eglGetError());
+    } else {
+        eglSwapInterval(dpy, async ? 0 : 1);
+        Results swap;
+        for (size_t i = 0; i < iterations; i++) {
+            glClearColor((i & 1) ? 1.0f : 0.0f, 0.0f, 0.0f, 1.0f);
+            glClear(GL_COLOR_BUFFER_BIT);
+            nsecs_t start = systemTime();
+            eglSwapBuffers(dpy, eglSurface);
+            swap.add(systemTime() - start);
+        }
+        printResult(swap, mode, "", "eglSwapBuffers");
+        glFinish();
+    }
+
+    eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    if (context != EGL_NO_CONTEXT) {
+        eglDestroyContext(dpy, context);
+    }
+    if (eglSurface != EGL_NO_SURFACE) {
+        // Disconnects, which makes the listener print the consumer side
+        eglDestroySurface(dpy, eglSurface);
+    }
+    eglTerminate(dpy);
+}
+
+// ---------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    size_t iterations = 1000;
+    uint32_t size = 256;
+    unsigned int seed = 1;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:s:r:")) != -1) {
+        switch (opt) {
+            case 'i':
+                iterations = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                size = static_cast<uint32_t>(strtoul(optarg, NULL, 0));
+                break;
+            case 'r':
+                seed = static_cast<unsigned int>(strtoul(optarg, NULL, 0));
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-i iterations] [-s size] [-r seed]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (size == 0) {
+        size = 1;
+    }
+
+    printf("BufferQueueBenchmark: %zu iterations, %ux%u buffers\n",
+            iterations, size, size);
+    // Must run first, since it forks before opening the binder driver
+    benchCrossProcess(iterations, size);
+    benchInProcess(iterations, size);
+    benchGl(iterations, size, false);
+    benchGl(iterations, size, true);
+    return fuzzInProcess(iterations, size, seed) ? EXIT_SUCCESS : EXIT_FAILURE;
+}
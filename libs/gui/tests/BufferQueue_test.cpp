@@ -21,6 +21,7 @@
 
 #include <gui/BufferItem.h>
 #include <gui/BufferQueue.h>
+#include <gui/FrameTimestamps.h>
 #include <gui/IProducerListener.h>
 
 #include <ui/GraphicBuffer.h>
@@ -440,4 +441,159 @@ TEST_F(BufferQueueTest, TestGenerationNumbers) {
     ASSERT_EQ(OK, mConsumer->attachBuffer(&outSlot, buffer));
 }
 
+TEST_F(BufferQueueTest, TestFrameTimestamps) {
+    createBufferQueue();
+    sp<DummyConsumer> dc(new DummyConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(dc, false));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, mProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &output));
+
+    int slot;
+    sp<Fence> fence;
+    sp<GraphicBuffer> buffer;
+    ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION,
+            mProducer->dequeueBuffer(&slot, &fence, false, 1, 1, 0,
+                GRALLOC_USAGE_SW_READ_OFTEN));
+    ASSERT_EQ(OK, mProducer->requestBuffer(slot, &buffer));
+
+    IGraphicBufferProducer::QueueBufferInput input(42, false,
+            HAL_DATASPACE_UNKNOWN, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false, Fence::NO_FENCE);
+    ASSERT_EQ(OK, mProducer->queueBuffer(slot, input, &output));
+    uint64_t frameNumber = output.getFrameNumber();
+    ASSERT_NE(0U, frameNumber);
+
+    FrameTimestamps timestamps;
+    ASSERT_EQ(OK, mProducer->getFrameTimestamps(frameNumber, &timestamps));
+    ASSERT_EQ(frameNumber, timestamps.frameNumber);
+    ASSERT_EQ(42, timestamps.requestedPresentTime);
+    ASSERT_NE(0, timestamps.dequeueTime);
+    ASSERT_LE(timestamps.dequeueTime, timestamps.queueTime);
+    ASSERT_EQ(0, timestamps.acquireTime);
+
+    BufferItem item;
+    ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+    ASSERT_EQ(OK, mConsumer->setFrameCompositionInfo(frameNumber,
+            systemTime(SYSTEM_TIME_MONOTONIC), Fence::NO_FENCE, 1234));
+    ASSERT_EQ(OK, mConsumer->releaseBuffer(item.mBuf, item.mFrameNumber,
+            EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+
+    ASSERT_EQ(OK, mProducer->getFrameTimestamps(frameNumber, &timestamps));
+    ASSERT_LE(timestamps.queueTime, timestamps.acquireTime);
+    ASSERT_LE(timestamps.acquireTime, timestamps.latchTime);
+    ASSERT_EQ(1234, timestamps.presentTime);
+    ASSERT_LE(timestamps.latchTime, timestamps.releaseTime);
+
+    // Frames that were never queued aren't in the history
+    ASSERT_EQ(BAD_VALUE, mProducer->getFrameTimestamps(frameNumber + 1,
+            &timestamps));
+}
+
+TEST_F(BufferQueueTest, DiscardFreeBuffersKeepsAcquiredBuffer) {
+    createBufferQueue();
+    sp<DummyConsumer> dc(new DummyConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(dc, false));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, mProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &output));
+
+    uint32_t bufferCount;
+    uint64_t bytes;
+    ASSERT_EQ(OK, mConsumer->getBufferMemoryUsage(&bufferCount, &bytes));
+    ASSERT_EQ(0U, bufferCount);
+    ASSERT_EQ(0U, bytes);
+
+    // Dequeue and queue two buffers
+    ASSERT_EQ(OK, mConsumer->setDefaultMaxBufferCount(3));
+    int slots[2];
+    sp<Fence> fence;
+    sp<GraphicBuffer> buffer;
+    IGraphicBufferProducer::QueueBufferInput input(0, false,
+            HAL_DATASPACE_UNKNOWN, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false, Fence::NO_FENCE);
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION,
+                mProducer->dequeueBuffer(&slots[i], &fence, false, 16, 16,
+                    HAL_PIXEL_FORMAT_RGBA_8888, GRALLOC_USAGE_SW_READ_OFTEN));
+        ASSERT_EQ(OK, mProducer->requestBuffer(slots[i], &buffer));
+    }
+    for (int i = 0; i < 2; i++) {
+        ASSERT_EQ(OK, mProducer->queueBuffer(slots[i], input, &output));
+    }
+    ASSERT_EQ(OK, mConsumer->getBufferMemoryUsage(&bufferCount, &bytes));
+    ASSERT_EQ(2U, bufferCount);
+    ASSERT_LE(2U * 16 * 16 * 4, bytes);
+
+    // Acquire and release the first one, then acquire the second one
+    BufferItem item;
+    ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+    ASSERT_EQ(OK, mConsumer->releaseBuffer(item.mBuf, item.mFrameNumber,
+            EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+
+    // Only the released buffer is discarded
+    ASSERT_EQ(OK, mConsumer->discardFreeBuffers());
+    ASSERT_EQ(OK, mConsumer->getBufferMemoryUsage(&bufferCount, &bytes));
+    ASSERT_EQ(1U, bufferCount);
+
+    // The producer gets a new buffer for the slot that was discarded
+    int slot;
+    ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION,
+            mProducer->dequeueBuffer(&slot, &fence, false, 16, 16,
+                HAL_PIXEL_FORMAT_RGBA_8888, GRALLOC_USAGE_SW_READ_OFTEN));
+    ASSERT_NE(item.mBuf, slot);
+}
+
+struct CountingConsumer : public BnConsumerListener {
+    CountingConsumer() : mFrameAvailableCount(0) {}
+    virtual void onFrameAvailable(const BufferItem& /* item */) {
+        mFrameAvailableCount++;
+    }
+    virtual void onBuffersReleased() {}
+    virtual void onSidebandStreamChanged() {}
+    int mFrameAvailableCount;
+};
+
+TEST_F(BufferQueueTest, FrameAvailableCoalescing) {
+    createBufferQueue();
+    sp<CountingConsumer> cc(new CountingConsumer);
+    ASSERT_EQ(OK, mConsumer->consumerConnect(cc, false));
+    IGraphicBufferProducer::QueueBufferOutput output;
+    ASSERT_EQ(OK, mProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &output));
+    ASSERT_EQ(OK, mConsumer->setDefaultMaxBufferCount(4));
+    ASSERT_EQ(OK, mConsumer->setFrameAvailableCoalescing(true));
+
+    int slots[3];
+    sp<Fence> fence;
+    sp<GraphicBuffer> buffer;
+    IGraphicBufferProducer::QueueBufferInput input(0, false,
+            HAL_DATASPACE_UNKNOWN, Rect(0, 0, 1, 1),
+            NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false, Fence::NO_FENCE);
+    for (int i = 0; i < 3; i++) {
+        ASSERT_EQ(IGraphicBufferProducer::BUFFER_NEEDS_REALLOCATION,
+                mProducer->dequeueBuffer(&slots[i], &fence, false, 1, 1,
+                    HAL_PIXEL_FORMAT_RGBA_8888, GRALLOC_USAGE_SW_READ_OFTEN));
+        ASSERT_EQ(OK, mProducer->requestBuffer(slots[i], &buffer));
+    }
+
+    // Only the first of the buffers queued before acquiring is reported
+    ASSERT_EQ(OK, mProducer->queueBuffer(slots[0], input, &output));
+    ASSERT_EQ(OK, mProducer->queueBuffer(slots[1], input, &output));
+    ASSERT_EQ(1, cc->mFrameAvailableCount);
+
+    BufferItem item;
+    ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+    ASSERT_EQ(1U, item.mCoalescedFrames);
+
+    // Acquiring re-arms the callback
+    ASSERT_EQ(OK, mProducer->queueBuffer(slots[2], input, &output));
+    ASSERT_EQ(2, cc->mFrameAvailableCount);
+    ASSERT_EQ(OK, mConsumer->releaseBuffer(item.mBuf, item.mFrameNumber,
+            EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+    ASSERT_EQ(OK, mConsumer->acquireBuffer(&item, 0));
+    ASSERT_EQ(1U, item.mCoalescedFrames);
+}
+
 } // namespace android
@@ -694,6 +694,67 @@ TEST_P(CpuConsumerTest, FromCpuLockMax) {
 
 }
 
+TEST_P(CpuConsumerTest, FromCpuLockBatch) {
+    status_t err;
+    CpuConsumerTestParams params = GetParam();
+
+    // Set up
+
+    ASSERT_NO_FATAL_FAILURE(configureANW(mANW, params, params.maxLockedBuffers + 1));
+
+    // Produce
+
+    const int numFrames = params.maxLockedBuffers + 1;
+    uint32_t stride;
+
+    for (int i = 0; i < numFrames; i++) {
+        ALOGV("Producing frame %d", i);
+        ASSERT_NO_FATAL_FAILURE(produceOneFrame(mANW, params, int64_t(i + 1),
+                        &stride));
+    }
+
+    // Consume
+
+    const size_t batchSize = size_t(numFrames);
+    CpuConsumer::LockedBuffer *b = new CpuConsumer::LockedBuffer[batchSize];
+    size_t count = 0;
+    err = mCC->lockNextBuffers(b, batchSize, &count);
+    ASSERT_NO_ERROR(err, "lockNextBuffers error: ");
+    // Only maxLockedBuffers can be locked at once
+    ASSERT_EQ(size_t(params.maxLockedBuffers), count);
+
+    for (size_t i = 0; i < count; i++) {
+        ASSERT_TRUE(b[i].data != NULL);
+        EXPECT_EQ(params.width,  b[i].width);
+        EXPECT_EQ(params.height, b[i].height);
+        EXPECT_EQ(stride, b[i].stride);
+        EXPECT_EQ(int64_t(i + 1), b[i].timestamp);
+
+        checkAnyBuffer(b[i], GetParam().format);
+    }
+
+    size_t extraCount = 0;
+    err = mCC->lockNextBuffers(&b[count], 1, &extraCount);
+    ASSERT_TRUE(err == NOT_ENOUGH_DATA) << "Allowing too many locks";
+
+    CpuConsumer::LockStats stats;
+    mCC->getLockStats(&stats);
+    EXPECT_EQ(uint64_t(count), stats.lockedFrames);
+
+    for (size_t i = 0; i < count; i++) {
+        err = mCC->unlockBuffer(b[i]);
+        ASSERT_NO_ERROR(err, "Could not unlock buffer: ");
+    }
+
+    err = mCC->lockNextBuffers(b, batchSize, &count);
+    ASSERT_NO_ERROR(err, "lockNextBuffers error: ");
+    ASSERT_EQ(size_t(1), count);
+    EXPECT_EQ(int64_t(numFrames), b[0].timestamp);
+    mCC->unlockBuffer(b[0]);
+
+    delete[] b;
+}
+
 CpuConsumerTestParams y8TestSets[] = {
     { 512,   512, 1, HAL_PIXEL_FORMAT_Y8},
     { 512,   512, 3, HAL_PIXEL_FORMAT_Y8},
@@ -208,6 +208,71 @@ TEST_F(StreamSplitterTest, OneInputMultipleOutputs) {
     ASSERT_EQ(1, allocator->getAllocCount());
 }
 
+TEST_F(StreamSplitterTest, DropSlowOutput) {
+    const int NUM_FRAMES = 3;
+    sp<IGraphicBufferProducer> inputProducer;
+    sp<IGraphicBufferConsumer> inputConsumer;
+    BufferQueue::createBufferQueue(&inputProducer, &inputConsumer);
+
+    sp<IGraphicBufferProducer> fastProducer;
+    sp<IGraphicBufferConsumer> fastConsumer;
+    BufferQueue::createBufferQueue(&fastProducer, &fastConsumer);
+    ASSERT_EQ(OK, fastConsumer->consumerConnect(new DummyListener, false));
+
+    sp<IGraphicBufferProducer> slowProducer;
+    sp<IGraphicBufferConsumer> slowConsumer;
+    BufferQueue::createBufferQueue(&slowProducer, &slowConsumer);
+    ASSERT_EQ(OK, slowConsumer->consumerConnect(new DummyListener, false));
+
+    sp<StreamSplitter> splitter;
+    status_t status = StreamSplitter::createSplitter(inputConsumer, &splitter);
+    ASSERT_EQ(OK, status);
+    ASSERT_EQ(OK, splitter->addOutput(fastProducer));
+    ASSERT_EQ(OK, splitter->addOutput(slowProducer));
+    splitter->setDropSlowOutputs(true);
+
+    IGraphicBufferProducer::QueueBufferOutput qbOutput;
+    ASSERT_EQ(OK, inputProducer->connect(new DummyProducerListener,
+            NATIVE_WINDOW_API_CPU, false, &qbOutput));
+
+    // The slow output never releases anything, so once it holds
+    // MAX_OUTSTANDING_BUFFERS buffers the fast output alone gets the rest
+    for (int frame = 0; frame < NUM_FRAMES; ++frame) {
+        int slot;
+        sp<Fence> fence;
+        sp<GraphicBuffer> buffer;
+        ASSERT_LE(0, inputProducer->dequeueBuffer(&slot, &fence, false, 0, 0,
+                0, GRALLOC_USAGE_SW_WRITE_OFTEN));
+        ASSERT_EQ(OK, inputProducer->requestBuffer(slot, &buffer));
+
+        IGraphicBufferProducer::QueueBufferInput qbInput(frame + 1, false,
+                HAL_DATASPACE_UNKNOWN,
+                Rect(0, 0, 1, 1), NATIVE_WINDOW_SCALING_MODE_FREEZE, 0, false,
+                Fence::NO_FENCE);
+        ASSERT_EQ(OK, inputProducer->queueBuffer(slot, qbInput, &qbOutput));
+
+        BufferItem item;
+        ASSERT_EQ(OK, fastConsumer->acquireBuffer(&item, 0));
+        ASSERT_EQ(frame + 1, item.mTimestamp);
+        ASSERT_EQ(OK, fastConsumer->releaseBuffer(item.mBuf,
+                item.mFrameNumber, EGL_NO_DISPLAY, EGL_NO_SYNC_KHR,
+                Fence::NO_FENCE));
+    }
+
+    for (int frame = 0; frame < NUM_FRAMES - 1; ++frame) {
+        BufferItem item;
+        ASSERT_EQ(OK, slowConsumer->acquireBuffer(&item, 0));
+        ASSERT_EQ(frame + 1, item.mTimestamp);
+        ASSERT_EQ(OK, slowConsumer->releaseBuffer(item.mBuf,
+                item.mFrameNumber, EGL_NO_DISPLAY, EGL_NO_SYNC_KHR,
+                Fence::NO_FENCE));
+    }
+
+    BufferItem item;
+    ASSERT_EQ(IGraphicBufferConsumer::NO_BUFFER_AVAILABLE,
+            slowConsumer->acquireBuffer(&item, 0));
+}
+
 TEST_F(StreamSplitterTest, OutputAbandonment) {
     sp<IGraphicBufferProducer> inputProducer;
     sp<IGraphicBufferConsumer> inputConsumer;
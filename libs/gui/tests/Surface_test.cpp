@@ -228,4 +228,82 @@ TEST_F(SurfaceTest, GetConsumerName) {
     EXPECT_STREQ("TestConsumer", surface->getConsumerName().string());
 }
 
+TEST_F(SurfaceTest, DequeueAheadHonorsBufferDimensions) {
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+
+    sp<DummyConsumer> dummyConsumer(new DummyConsumer);
+    consumer->consumerConnect(dummyConsumer, false);
+
+    sp<Surface> surface = new Surface(producer);
+    sp<ANativeWindow> window(surface);
+    ASSERT_EQ(NO_ERROR, native_window_api_connect(window.get(),
+            NATIVE_WINDOW_API_CPU));
+    ASSERT_EQ(NO_ERROR, native_window_set_buffer_count(window.get(), 4));
+    surface->setDequeueAhead(true);
+
+    ANativeWindowBuffer* buffer;
+    int fenceFd;
+    ASSERT_EQ(NO_ERROR, window->dequeueBuffer(window.get(), &buffer, &fenceFd));
+    ASSERT_EQ(NO_ERROR, window->queueBuffer(window.get(), buffer, fenceFd));
+
+    // The buffer dequeued ahead has the old dimensions, so it must not be
+    // handed out after they change
+    ASSERT_EQ(NO_ERROR, native_window_set_buffers_dimensions(window.get(),
+            16, 8));
+    ASSERT_EQ(NO_ERROR, window->dequeueBuffer(window.get(), &buffer, &fenceFd));
+    EXPECT_EQ(16, buffer->width);
+    EXPECT_EQ(8, buffer->height);
+    ASSERT_EQ(NO_ERROR, window->queueBuffer(window.get(), buffer, fenceFd));
+
+    ASSERT_EQ(NO_ERROR, window->dequeueBuffer(window.get(), &buffer, &fenceFd));
+    EXPECT_EQ(16, buffer->width);
+    EXPECT_EQ(8, buffer->height);
+    ASSERT_EQ(NO_ERROR, window->cancelBuffer(window.get(), buffer, fenceFd));
+
+    surface->setDequeueAhead(false);
+    ASSERT_EQ(NO_ERROR, native_window_api_disconnect(window.get(),
+            NATIVE_WINDOW_API_CPU));
+}
+
+TEST_F(SurfaceTest, LockReportsBufferAge) {
+    sp<IGraphicBufferProducer> producer;
+    sp<IGraphicBufferConsumer> consumer;
+    BufferQueue::createBufferQueue(&producer, &consumer);
+
+    sp<DummyConsumer> dummyConsumer(new DummyConsumer);
+    consumer->consumerConnect(dummyConsumer, false);
+    consumer->setDefaultBufferSize(16, 16);
+
+    sp<Surface> surface = new Surface(producer);
+    ANativeWindow_Buffer buffer;
+    BufferItem item;
+    int age = -1;
+
+    // Nothing to copy back from for the first frame
+    ASSERT_EQ(NO_ERROR, surface->lock(&buffer, NULL,
+            Surface::LOCK_NO_COPY_BACK, &age));
+    EXPECT_EQ(0, age);
+    ASSERT_EQ(NO_ERROR, surface->unlockAndPost());
+    ASSERT_EQ(NO_ERROR, consumer->acquireBuffer(&item, 0));
+    const int firstSlot = item.mBuf;
+    const uint64_t firstFrame = item.mFrameNumber;
+
+    // The copy-back brings the new buffer up to date with the previous frame
+    ARect dirty = { 0, 0, 4, 4 };
+    ASSERT_EQ(NO_ERROR, surface->lock(&buffer, &dirty, 0, &age));
+    EXPECT_EQ(1, age);
+    ASSERT_EQ(NO_ERROR, surface->unlockAndPost());
+    ASSERT_EQ(NO_ERROR, consumer->acquireBuffer(&item, 0));
+    ASSERT_EQ(NO_ERROR, consumer->releaseBuffer(firstSlot, firstFrame,
+            EGL_NO_DISPLAY, EGL_NO_SYNC_KHR, Fence::NO_FENCE));
+
+    // Without it, the first buffer is two frames old
+    ASSERT_EQ(NO_ERROR, surface->lock(&buffer, &dirty,
+            Surface::LOCK_NO_COPY_BACK, &age));
+    EXPECT_EQ(2, age);
+    ASSERT_EQ(NO_ERROR, surface->unlockAndPost());
+}
+
 }
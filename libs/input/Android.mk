@@ -29,6 +29,7 @@ deviceSources := \
     $(commonSources) \
     IInputFlinger.cpp \
     InputTransport.cpp \
+    TouchPredictor.cpp \
     VelocityControl.cpp \
     VelocityTracker.cpp
 
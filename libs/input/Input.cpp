@@ -153,20 +153,13 @@ status_t PointerCoords::readFromParcel(Parcel* parcel) {
         return BAD_VALUE;
     }
 
-    for (uint32_t i = 0; i < count; i++) {
-        values[i] = parcel->readFloat();
-    }
-    return OK;
+    return parcel->readArray(values, count);
 }
 
 status_t PointerCoords::writeToParcel(Parcel* parcel) const {
     parcel->writeInt64(bits);
 
-    uint32_t count = BitSet64::count(bits);
-    for (uint32_t i = 0; i < count; i++) {
-        parcel->writeFloat(values[i]);
-    }
-    return OK;
+    return parcel->writeArray(values, BitSet64::count(bits));
 }
 #endif
 
@@ -450,18 +443,18 @@ status_t MotionEvent::readFromParcel(Parcel* parcel) {
     mSamplePointerCoords.clear();
     mSamplePointerCoords.setCapacity(sampleCount * pointerCount);
 
-    for (size_t i = 0; i < pointerCount; i++) {
-        mPointerProperties.push();
-        PointerProperties& properties = mPointerProperties.editTop();
-        properties.id = parcel->readInt32();
-        properties.toolType = parcel->readInt32();
+    // PointerProperties is its id and tool type, in that order.
+    mPointerProperties.resize(pointerCount);
+    status_t status = parcel->readArray(mPointerProperties.editArray(), pointerCount);
+    if (status) {
+        return status;
     }
 
     while (sampleCount-- > 0) {
         mSampleEventTimes.push(parcel->readInt64());
         for (size_t i = 0; i < pointerCount; i++) {
             mSamplePointerCoords.push();
-            status_t status = mSamplePointerCoords.editTop().readFromParcel(parcel);
+            status = mSamplePointerCoords.editTop().readFromParcel(parcel);
             if (status) {
                 return status;
             }
@@ -491,17 +484,17 @@ status_t MotionEvent::writeToParcel(Parcel* parcel) const {
     parcel->writeFloat(mYPrecision);
     parcel->writeInt64(mDownTime);
 
-    for (size_t i = 0; i < pointerCount; i++) {
-        const PointerProperties& properties = mPointerProperties.itemAt(i);
-        parcel->writeInt32(properties.id);
-        parcel->writeInt32(properties.toolType);
+    // PointerProperties is its id and tool type, in that order.
+    status_t status = parcel->writeArray(mPointerProperties.array(), pointerCount);
+    if (status) {
+        return status;
     }
 
     const PointerCoords* pc = mSamplePointerCoords.array();
     for (size_t h = 0; h < sampleCount; h++) {
         parcel->writeInt64(mSampleEventTimes.itemAt(h));
         for (size_t i = 0; i < pointerCount; i++) {
-            status_t status = (pc++)->writeToParcel(parcel);
+            status = (pc++)->writeToParcel(parcel);
             if (status) {
                 return status;
             }
@@ -79,7 +79,10 @@ bool InputMessage::isValid(size_t actualSize) const {
             return true;
         case TYPE_MOTION:
             return body.motion.pointerCount > 0
-                    && body.motion.pointerCount <= MAX_POINTERS;
+                    && body.motion.pointerCount <= MAX_POINTERS
+                    && body.motion.sampleCount > 0
+                    && body.motion.sampleCount
+                            <= Body::Motion::getMaxSampleCount(body.motion.pointerCount);
         case TYPE_FINISHED:
             return true;
         }
@@ -103,7 +106,7 @@ size_t InputMessage::size() const {
 // --- InputChannel ---
 
 InputChannel::InputChannel(const String8& name, int fd) :
-        mName(name), mFd(fd) {
+        mName(name), mFd(fd), mDeferredReceiveError(OK) {
 #if DEBUG_CHANNEL_LIFECYCLE
     ALOGD("Input channel constructed: name='%s', fd=%d",
             mName.string(), fd);
@@ -234,6 +237,84 @@ status_t InputChannel::receiveMessage(InputMessage* msg) {
     return OK;
 }
 
+status_t InputChannel::receiveMessages(InputMessage* msgs, size_t maxCount,
+        size_t* outCount) {
+    if (mDeferredReceiveError != OK) {
+        status_t error = mDeferredReceiveError;
+        mDeferredReceiveError = OK;
+        return error;
+    }
+
+    struct iovec iovs[MAX_RECEIVE_MESSAGES];
+    struct mmsghdr mmsgs[MAX_RECEIVE_MESSAGES];
+    if (maxCount > MAX_RECEIVE_MESSAGES) {
+        maxCount = MAX_RECEIVE_MESSAGES;
+    }
+    memset(mmsgs, 0, sizeof(mmsgs));
+    for (size_t i = 0; i < maxCount; i++) {
+        iovs[i].iov_base = &msgs[i];
+        iovs[i].iov_len = sizeof(InputMessage);
+        mmsgs[i].msg_hdr.msg_iov = &iovs[i];
+        mmsgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    int nMsgs;
+    do {
+        nMsgs = ::recvmmsg(mFd, mmsgs, static_cast<unsigned int>(maxCount),
+                MSG_DONTWAIT, NULL);
+    } while (nMsgs == -1 && errno == EINTR);
+
+    if (nMsgs < 0) {
+        int error = errno;
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ receive messages failed, errno=%d", mName.string(), errno);
+#endif
+        if (error == EAGAIN || error == EWOULDBLOCK) {
+            return WOULD_BLOCK;
+        }
+        if (error == EPIPE || error == ENOTCONN || error == ECONNREFUSED) {
+            return DEAD_OBJECT;
+        }
+        return -error;
+    }
+
+    // Stop at the end of file, which reads as an empty message; it's reported by the
+    // next call if messages came before it.
+    size_t count = 0;
+    while (count < size_t(nMsgs) && mmsgs[count].msg_len != 0) {
+        count++;
+    }
+    if (count == 0) {
+#if DEBUG_CHANNEL_MESSAGES
+        ALOGD("channel '%s' ~ receive messages failed because peer was closed",
+                mName.string());
+#endif
+        return DEAD_OBJECT;
+    }
+
+    // Hand out the valid messages that came before an invalid one. The invalid one has
+    // left the socket already, so its error is kept for the next call.
+    for (size_t i = 0; i < count; i++) {
+        if (!msgs[i].isValid(mmsgs[i].msg_len)) {
+#if DEBUG_CHANNEL_MESSAGES
+            ALOGD("channel '%s' ~ received invalid message", mName.string());
+#endif
+            if (i == 0) {
+                return BAD_VALUE;
+            }
+            mDeferredReceiveError = BAD_VALUE;
+            count = i;
+            break;
+        }
+    }
+
+#if DEBUG_CHANNEL_MESSAGES
+    ALOGD("channel '%s' ~ received %zu messages", mName.string(), count);
+#endif
+    *outCount = count;
+    return OK;
+}
+
 sp<InputChannel> InputChannel::dup() const {
     int fd = ::dup(getFd());
     return fd >= 0 ? new InputChannel(getName(), fd) : NULL;
@@ -325,25 +406,46 @@ status_t InputPublisher::publishKeyEvent(
             downTime, eventTime);
 #endif
 
+    InputMessage msg;
+    status_t result = buildKeyMessage(&msg, seq, deviceId, source, action, flags,
+            keyCode, scanCode, metaState, repeatCount, downTime, eventTime);
+    if (result) {
+        return result;
+    }
+    return mChannel->sendMessage(&msg);
+}
+
+status_t InputPublisher::buildKeyMessage(
+        InputMessage* msg,
+        uint32_t seq,
+        int32_t deviceId,
+        int32_t source,
+        int32_t action,
+        int32_t flags,
+        int32_t keyCode,
+        int32_t scanCode,
+        int32_t metaState,
+        int32_t repeatCount,
+        nsecs_t downTime,
+        nsecs_t eventTime) {
     if (!seq) {
         ALOGE("Attempted to publish a key event with sequence number 0.");
         return BAD_VALUE;
     }
 
-    InputMessage msg;
-    msg.header.type = InputMessage::TYPE_KEY;
-    msg.body.key.seq = seq;
-    msg.body.key.deviceId = deviceId;
-    msg.body.key.source = source;
-    msg.body.key.action = action;
-    msg.body.key.flags = flags;
-    msg.body.key.keyCode = keyCode;
-    msg.body.key.scanCode = scanCode;
-    msg.body.key.metaState = metaState;
-    msg.body.key.repeatCount = repeatCount;
-    msg.body.key.downTime = downTime;
-    msg.body.key.eventTime = eventTime;
-    return mChannel->sendMessage(&msg);
+    msg->header.type = InputMessage::TYPE_KEY;
+    msg->body.key.seq = seq;
+    msg->body.key.deviceId = deviceId;
+    msg->body.key.source = source;
+    msg->body.key.action = action;
+    msg->body.key.flags = flags;
+    msg->body.key.keyCode = keyCode;
+    msg->body.key.scanCode = scanCode;
+    msg->body.key.metaState = metaState;
+    msg->body.key.repeatCount = repeatCount;
+    msg->body.key.downTime = downTime;
+    msg->body.key.eventTime = eventTime;
+    return OK;
 }
 
 status_t InputPublisher::publishMotionEvent(
@@ -365,51 +467,141 @@ status_t InputPublisher::publishMotionEvent(
         uint32_t pointerCount,
         const PointerProperties* pointerProperties,
         const PointerCoords* pointerCoords) {
+    return publishMotionSamples(1, &seq, &eventTime,
+            deviceId, source, action, actionButton, flags, edgeFlags, metaState, buttonState,
+            xOffset, yOffset, xPrecision, yPrecision, downTime,
+            pointerCount, pointerProperties, pointerCoords);
+}
+
+status_t InputPublisher::publishMotionSamples(
+        size_t sampleCount,
+        const uint32_t* seqs,
+        const nsecs_t* eventTimes,
+        int32_t deviceId,
+        int32_t source,
+        int32_t action,
+        int32_t actionButton,
+        int32_t flags,
+        int32_t edgeFlags,
+        int32_t metaState,
+        int32_t buttonState,
+        float xOffset,
+        float yOffset,
+        float xPrecision,
+        float yPrecision,
+        nsecs_t downTime,
+        uint32_t pointerCount,
+        const PointerProperties* pointerProperties,
+        const PointerCoords* pointerCoords) {
 #if DEBUG_TRANSPORT_ACTIONS
-    ALOGD("channel '%s' publisher ~ publishMotionEvent: seq=%u, deviceId=%d, source=0x%x, "
+    ALOGD("channel '%s' publisher ~ publishMotionSamples: sampleCount=%zu, seq=%u, "
+            "deviceId=%d, source=0x%x, "
             "action=0x%x, actionButton=0x%08x, flags=0x%x, edgeFlags=0x%x, "
             "metaState=0x%x, buttonState=0x%x, xOffset=%f, yOffset=%f, "
             "xPrecision=%f, yPrecision=%f, downTime=%lld, eventTime=%lld, "
             "pointerCount=%" PRIu32,
-            mChannel->getName().string(), seq,
+            mChannel->getName().string(), sampleCount, sampleCount ? seqs[0] : 0,
             deviceId, source, action, actionButton, flags, edgeFlags, metaState, buttonState,
-            xOffset, yOffset, xPrecision, yPrecision, downTime, eventTime, pointerCount);
+            xOffset, yOffset, xPrecision, yPrecision, downTime,
+            sampleCount ? eventTimes[0] : 0, pointerCount);
 #endif
 
-    if (!seq) {
-        ALOGE("Attempted to publish a motion event with sequence number 0.");
-        return BAD_VALUE;
+    InputMessage msg;
+    status_t result = buildMotionMessage(&msg, sampleCount, seqs, eventTimes,
+            deviceId, source, action, actionButton, flags, edgeFlags, metaState, buttonState,
+            xOffset, yOffset, xPrecision, yPrecision, downTime,
+            pointerCount, pointerProperties, pointerCoords);
+    if (result) {
+        return result;
+    }
+    return mChannel->sendMessage(&msg);
+}
+
+status_t InputPublisher::buildMotionMessage(
+        InputMessage* msg,
+        size_t sampleCount,
+        const uint32_t* seqs,
+        const nsecs_t* eventTimes,
+        int32_t deviceId,
+        int32_t source,
+        int32_t action,
+        int32_t actionButton,
+        int32_t flags,
+        int32_t edgeFlags,
+        int32_t metaState,
+        int32_t buttonState,
+        float xOffset,
+        float yOffset,
+        float xPrecision,
+        float yPrecision,
+        nsecs_t downTime,
+        uint32_t pointerCount,
+        const PointerProperties* pointerProperties,
+        const PointerCoords* pointerCoords) {
+    for (size_t i = 0; i < sampleCount; i++) {
+        if (!seqs[i]) {
+            ALOGE("Attempted to publish a motion event with sequence number 0.");
+            return BAD_VALUE;
+        }
     }
 
     if (pointerCount > MAX_POINTERS || pointerCount < 1) {
-        ALOGE("channel '%s' publisher ~ Invalid number of pointers provided: %" PRIu32 ".",
-                mChannel->getName().string(), pointerCount);
+        ALOGE("Invalid number of pointers provided: %" PRIu32 ".", pointerCount);
         return BAD_VALUE;
     }
 
-    InputMessage msg;
-    msg.header.type = InputMessage::TYPE_MOTION;
-    msg.body.motion.seq = seq;
-    msg.body.motion.deviceId = deviceId;
-    msg.body.motion.source = source;
-    msg.body.motion.action = action;
-    msg.body.motion.actionButton = actionButton;
-    msg.body.motion.flags = flags;
-    msg.body.motion.edgeFlags = edgeFlags;
-    msg.body.motion.metaState = metaState;
-    msg.body.motion.buttonState = buttonState;
-    msg.body.motion.xOffset = xOffset;
-    msg.body.motion.yOffset = yOffset;
-    msg.body.motion.xPrecision = xPrecision;
-    msg.body.motion.yPrecision = yPrecision;
-    msg.body.motion.downTime = downTime;
-    msg.body.motion.eventTime = eventTime;
-    msg.body.motion.pointerCount = pointerCount;
-    for (uint32_t i = 0; i < pointerCount; i++) {
-        msg.body.motion.pointers[i].properties.copyFrom(pointerProperties[i]);
-        msg.body.motion.pointers[i].coords.copyFrom(pointerCoords[i]);
+    if (sampleCount > getMaxSampleCount(pointerCount) || sampleCount < 1) {
+        ALOGE("Invalid number of samples provided: %zu.", sampleCount);
+        return BAD_VALUE;
     }
-    return mChannel->sendMessage(&msg);
+
+    msg->header.type = InputMessage::TYPE_MOTION;
+    msg->body.motion.seq = seqs[0];
+    msg->body.motion.deviceId = deviceId;
+    msg->body.motion.source = source;
+    msg->body.motion.action = action;
+    msg->body.motion.actionButton = actionButton;
+    msg->body.motion.flags = flags;
+    msg->body.motion.edgeFlags = edgeFlags;
+    msg->body.motion.metaState = metaState;
+    msg->body.motion.buttonState = buttonState;
+    msg->body.motion.xOffset = xOffset;
+    msg->body.motion.yOffset = yOffset;
+    msg->body.motion.xPrecision = xPrecision;
+    msg->body.motion.yPrecision = yPrecision;
+    msg->body.motion.downTime = downTime;
+    msg->body.motion.eventTime = eventTimes[0];
+    msg->body.motion.pointerCount = pointerCount;
+    msg->body.motion.sampleCount = uint32_t(sampleCount);
+    for (size_t i = 0; i < sampleCount * pointerCount; i++) {
+        msg->body.motion.pointers[i].properties.copyFrom(pointerProperties[i % pointerCount]);
+        msg->body.motion.pointers[i].coords.copyFrom(pointerCoords[i]);
+    }
+    InputMessage::Body::Motion::Sample* samples = msg->body.motion.getSamples();
+    for (size_t i = 1; i < sampleCount; i++) {
+        samples[i - 1].seq = seqs[i];
+        samples[i - 1].eventTime = eventTimes[i];
+    }
+    return OK;
+}
+
+status_t InputPublisher::publishMessage(const InputMessage* msg) {
+#if DEBUG_TRANSPORT_ACTIONS
+    ALOGD("channel '%s' publisher ~ publishMessage: type=%d",
+            mChannel->getName().string(), msg->header.type);
+#endif
+
+    if (msg->header.type != InputMessage::TYPE_KEY
+            && msg->header.type != InputMessage::TYPE_MOTION) {
+        ALOGE("channel '%s' publisher ~ Attempted to publish a message of type %d.",
+                mChannel->getName().string(), msg->header.type);
+        return BAD_VALUE;
+    }
+    return mChannel->sendMessage(msg);
+}
+
+size_t InputPublisher::getMaxSampleCount(uint32_t pointerCount) {
+    return InputMessage::Body::Motion::getMaxSampleCount(pointerCount);
 }
 
 status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandled) {
@@ -439,7 +631,8 @@ status_t InputPublisher::receiveFinishedSignal(uint32_t* outSeq, bool* outHandle
 
 InputConsumer::InputConsumer(const sp<InputChannel>& channel) :
         mResampleTouch(isTouchResamplingEnabled()),
-        mChannel(channel), mMsgDeferred(false) {
+        mChannel(channel), mMsgDeferred(false),
+        mNumReceivedMsgs(0), mNextReceivedMsg(0), mNextReceivedSample(0) {
 }
 
 InputConsumer::~InputConsumer() {
@@ -479,7 +672,7 @@ status_t InputConsumer::consume(InputEventFactoryInterface* factory,
             mMsgDeferred = false;
         } else {
             // Receive a fresh message.
-            status_t result = mChannel->receiveMessage(&mMsg);
+            status_t result = receiveMessage(&mMsg);
             if (result) {
                 // Consume the next batched event unless batches are being held for later.
                 if (consumeBatches || result != WOULD_BLOCK) {
@@ -921,8 +1114,52 @@ status_t InputConsumer::sendUnchainedFinishedSignal(uint32_t seq, bool handled)
     return mChannel->sendMessage(&msg);
 }
 
+status_t InputConsumer::receiveMessage(InputMessage* msg) {
+    if (mNextReceivedMsg == mNumReceivedMsgs) {
+        size_t count;
+        status_t result = mChannel->receiveMessages(mReceivedMsgs, RECEIVE_BUFFER_SIZE,
+                &count);
+        if (result) {
+            return result;
+        }
+        mNumReceivedMsgs = count;
+        mNextReceivedMsg = 0;
+        mNextReceivedSample = 0;
+    }
+
+    const InputMessage& received = mReceivedMsgs[mNextReceivedMsg];
+    if (received.header.type != InputMessage::TYPE_MOTION
+            || received.body.motion.sampleCount == 1) {
+        memcpy(msg, &received, received.size());
+        mNextReceivedMsg++;
+        return OK;
+    }
+
+    // Take the samples of a batched move one at a time, as if they had been sent
+    // separately.
+    const InputMessage::Body::Motion& motion = received.body.motion;
+    const uint32_t sample = mNextReceivedSample;
+    msg->header = received.header;
+    msg->body.motion = motion;
+    msg->body.motion.sampleCount = 1;
+    if (sample > 0) {
+        const InputMessage::Body::Motion::Sample& info = motion.getSamples()[sample - 1];
+        msg->body.motion.seq = info.seq;
+        msg->body.motion.eventTime = info.eventTime;
+        for (uint32_t i = 0; i < motion.pointerCount; i++) {
+            msg->body.motion.pointers[i].coords.copyFrom(
+                    motion.pointers[sample * motion.pointerCount + i].coords);
+        }
+    }
+    if (++mNextReceivedSample == motion.sampleCount) {
+        mNextReceivedMsg++;
+        mNextReceivedSample = 0;
+    }
+    return OK;
+}
+
 bool InputConsumer::hasDeferredEvent() const {
-    return mMsgDeferred;
+    return mMsgDeferred || mNextReceivedMsg < mNumReceivedMsgs;
 }
 
 bool InputConsumer::hasPendingBatch() const {
@@ -18,6 +18,7 @@
 
 #include <stdlib.h>
 #include <string.h>
+#include <sys/stat.h>
 
 #if HAVE_ANDROID_OS
 #include <binder/Parcel.h>
@@ -30,6 +31,7 @@
 
 #include <utils/Log.h>
 #include <utils/Errors.h>
+#include <utils/Mutex.h>
 #include <utils/Tokenizer.h>
 #include <utils/Timers.h>
 
@@ -83,6 +85,33 @@ static String8 toString(const char16_t* chars, size_t numChars) {
 #endif
 
 
+// Key character maps already loaded, by file name, so that devices which use the same
+// map share it instead of each parsing the file again. An entry is only used while the
+// file it was loaded from is unchanged.
+struct CachedKeyCharacterMap {
+    KeyCharacterMap::Format format;
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    sp<KeyCharacterMap> map;
+};
+
+static Mutex gCacheLock;
+static KeyedVector<String8, CachedKeyCharacterMap> gCache;
+
+// Likewise for the maps loaded from contents, such as the keyboard layout overlays,
+// which are matched by their contents. Only the most recently used ones are kept, the
+// oldest first, since there can be many layouts but a user switches between a few.
+struct CachedKeyCharacterMapContents {
+    String8 filename;
+    String8 contents;
+    KeyCharacterMap::Format format;
+    sp<KeyCharacterMap> map;
+};
+
+static const size_t MAX_CACHED_CONTENTS = 4;
+static Vector<CachedKeyCharacterMapContents> gContentsCache;
+
 // --- KeyCharacterMap ---
 
 sp<KeyCharacterMap> KeyCharacterMap::sEmpty = new KeyCharacterMap();
@@ -93,7 +122,7 @@ KeyCharacterMap::KeyCharacterMap() :
 
 KeyCharacterMap::KeyCharacterMap(const KeyCharacterMap& other) :
     RefBase(), mType(other.mType), mKeysByScanCode(other.mKeysByScanCode),
-    mKeysByUsageCode(other.mKeysByUsageCode) {
+    mKeysByUsageCode(other.mKeysByUsageCode), mKeysByCharacter(other.mKeysByCharacter) {
     for (size_t i = 0; i < other.mKeys.size(); i++) {
         mKeys.add(other.mKeys.keyAt(i), new Key(*other.mKeys.valueAt(i)));
     }
@@ -110,6 +139,21 @@ status_t KeyCharacterMap::load(const String8& filename,
         Format format, sp<KeyCharacterMap>* outMap) {
     outMap->clear();
 
+    struct stat st;
+    bool haveStat = !stat(filename.string(), &st);
+    if (haveStat) {
+        AutoMutex _l(gCacheLock);
+        ssize_t index = gCache.indexOfKey(filename);
+        if (index >= 0) {
+            const CachedKeyCharacterMap& cached = gCache.valueAt(index);
+            if (cached.format == format && cached.ino == st.st_ino
+                    && cached.size == st.st_size && cached.mtime == st.st_mtime) {
+                *outMap = cached.map;
+                return OK;
+            }
+        }
+    }
+
     Tokenizer* tokenizer;
     status_t status = Tokenizer::open(filename, &tokenizer);
     if (status) {
@@ -118,6 +162,17 @@ status_t KeyCharacterMap::load(const String8& filename,
         status = load(tokenizer, format, outMap);
         delete tokenizer;
     }
+
+    if (!status && haveStat) {
+        CachedKeyCharacterMap cached;
+        cached.format = format;
+        cached.ino = st.st_ino;
+        cached.size = st.st_size;
+        cached.mtime = st.st_mtime;
+        cached.map = *outMap;
+        AutoMutex _l(gCacheLock);
+        gCache.add(filename, cached);
+    }
     return status;
 }
 
@@ -125,6 +180,21 @@ status_t KeyCharacterMap::loadContents(const String8& filename, const char* cont
         Format format, sp<KeyCharacterMap>* outMap) {
     outMap->clear();
 
+    { // acquire lock
+        AutoMutex _l(gCacheLock);
+        for (size_t i = 0; i < gContentsCache.size(); i++) {
+            const CachedKeyCharacterMapContents& cached = gContentsCache[i];
+            if (cached.format == format && cached.filename == filename
+                    && cached.contents == contents) {
+                *outMap = cached.map;
+                CachedKeyCharacterMapContents used(cached);
+                gContentsCache.removeAt(i);
+                gContentsCache.push(used);
+                return OK;
+            }
+        }
+    } // release lock
+
     Tokenizer* tokenizer;
     status_t status = Tokenizer::fromContents(filename, contents, &tokenizer);
     if (status) {
@@ -133,6 +203,19 @@ status_t KeyCharacterMap::loadContents(const String8& filename, const char* cont
         status = load(tokenizer, format, outMap);
         delete tokenizer;
     }
+
+    if (!status) {
+        CachedKeyCharacterMapContents cached;
+        cached.filename = filename;
+        cached.contents = contents;
+        cached.format = format;
+        cached.map = *outMap;
+        AutoMutex _l(gCacheLock);
+        if (gContentsCache.size() >= MAX_CACHED_CONTENTS) {
+            gContentsCache.removeAt(0);
+        }
+        gContentsCache.push(cached);
+    }
     return status;
 }
 
@@ -156,6 +239,7 @@ status_t KeyCharacterMap::load(Tokenizer* tokenizer,
                 elapsedTime / 1000000.0);
 #endif
         if (!status) {
+            map->updateKeysByCharacter();
             *outMap = map;
         }
     }
@@ -193,6 +277,7 @@ sp<KeyCharacterMap> KeyCharacterMap::combine(const sp<KeyCharacterMap>& base,
         map->mKeysByUsageCode.replaceValueFor(overlay->mKeysByUsageCode.keyAt(i),
                 overlay->mKeysByUsageCode.valueAt(i));
     }
+    map->updateKeysByCharacter();
     return map;
 }
 
@@ -421,24 +506,34 @@ bool KeyCharacterMap::findKey(char16_t ch, int32_t* outKeyCode, int32_t* outMeta
         return false;
     }
 
-    for (size_t i = 0; i < mKeys.size(); i++) {
-        const Key* key = mKeys.valueAt(i);
+    ssize_t index = mKeysByCharacter.indexOfKey(ch);
+    if (index < 0) {
+        return false;
+    }
+    const CharacterKey& characterKey = mKeysByCharacter.valueAt(index);
+    *outKeyCode = characterKey.keyCode;
+    *outMetaState = characterKey.metaState;
+    return true;
+}
 
-        // Try to find the most general behavior that maps to this character.
-        // For example, the base key behavior will usually be last in the list.
-        const Behavior* found = NULL;
+void KeyCharacterMap::updateKeysByCharacter() {
+    mKeysByCharacter.clear();
+
+    // A character maps to the first key that generates it, and to the most general
+    // behavior of that key that does, which is usually the base one, last in the list.
+    // So the keys are gone through backwards, and their behaviors forwards, each
+    // replacing any earlier mapping of its character.
+    for (size_t i = mKeys.size(); i-- > 0; ) {
+        const Key* key = mKeys.valueAt(i);
         for (const Behavior* behavior = key->firstBehavior; behavior; behavior = behavior->next) {
-            if (behavior->character == ch) {
-                found = behavior;
+            if (behavior->character) {
+                CharacterKey characterKey;
+                characterKey.keyCode = mKeys.keyAt(i);
+                characterKey.metaState = behavior->metaState;
+                mKeysByCharacter.replaceValueFor(behavior->character, characterKey);
             }
         }
-        if (found) {
-            *outKeyCode = mKeys.keyAt(i);
-            *outMetaState = found->metaState;
-            return true;
-        }
     }
-    return false;
 }
 
 void KeyCharacterMap::addKey(Vector<KeyEvent>& outEvents,
@@ -604,28 +699,39 @@ sp<KeyCharacterMap> KeyCharacterMap::readFromParcel(Parcel* parcel) {
             return NULL;
         }
     }
+    map->updateKeysByCharacter();
     return map;
 }
 
 void KeyCharacterMap::writeToParcel(Parcel* parcel) const {
-    parcel->writeInt32(mType);
+    AutoMutex _l(mParcelDataLock);
+
+    if (mParcelData.isEmpty()) {
+        flattenLocked(&mParcelData);
+    }
+    // Same layout as a writeInt32 per word.
+    parcel->write(mParcelData.array(), mParcelData.size() * sizeof(int32_t));
+}
+
+void KeyCharacterMap::flattenLocked(Vector<int32_t>* outData) const {
+    outData->push(mType);
 
     size_t numKeys = mKeys.size();
-    parcel->writeInt32(numKeys);
+    outData->push(numKeys);
     for (size_t i = 0; i < numKeys; i++) {
         int32_t keyCode = mKeys.keyAt(i);
         const Key* key = mKeys.valueAt(i);
-        parcel->writeInt32(keyCode);
-        parcel->writeInt32(key->label);
-        parcel->writeInt32(key->number);
+        outData->push(keyCode);
+        outData->push(key->label);
+        outData->push(key->number);
         for (const Behavior* behavior = key->firstBehavior; behavior != NULL;
                 behavior = behavior->next) {
-            parcel->writeInt32(1);
-            parcel->writeInt32(behavior->metaState);
-            parcel->writeInt32(behavior->character);
-            parcel->writeInt32(behavior->fallbackKeyCode);
+            outData->push(1);
+            outData->push(behavior->metaState);
+            outData->push(behavior->character);
+            outData->push(behavior->fallbackKeyCode);
         }
-        parcel->writeInt32(0);
+        outData->push(0);
     }
 }
 #endif
@@ -17,6 +17,7 @@
 #define LOG_TAG "KeyLayoutMap"
 
 #include <stdlib.h>
+#include <sys/stat.h>
 
 #include <android/keycodes.h>
 #include <input/InputEventLabels.h>
@@ -24,6 +25,7 @@
 #include <input/KeyLayoutMap.h>
 #include <utils/Log.h>
 #include <utils/Errors.h>
+#include <utils/Mutex.h>
 #include <utils/Tokenizer.h>
 #include <utils/Timers.h>
 
@@ -41,6 +43,19 @@ namespace android {
 
 static const char* WHITESPACE = " \t\r";
 
+// Key layout maps already loaded, by file name, so that devices which use the same
+// layout share it instead of each parsing the file again. An entry is only used while
+// the file it was loaded from is unchanged.
+struct CachedKeyLayoutMap {
+    ino_t ino;
+    off_t size;
+    time_t mtime;
+    sp<KeyLayoutMap> map;
+};
+
+static Mutex gCacheLock;
+static KeyedVector<String8, CachedKeyLayoutMap> gCache;
+
 // --- KeyLayoutMap ---
 
 KeyLayoutMap::KeyLayoutMap() {
@@ -52,6 +67,21 @@ KeyLayoutMap::~KeyLayoutMap() {
 status_t KeyLayoutMap::load(const String8& filename, sp<KeyLayoutMap>* outMap) {
     outMap->clear();
 
+    struct stat st;
+    bool haveStat = !stat(filename.string(), &st);
+    if (haveStat) {
+        AutoMutex _l(gCacheLock);
+        ssize_t index = gCache.indexOfKey(filename);
+        if (index >= 0) {
+            const CachedKeyLayoutMap& cached = gCache.valueAt(index);
+            if (cached.ino == st.st_ino && cached.size == st.st_size
+                    && cached.mtime == st.st_mtime) {
+                *outMap = cached.map;
+                return OK;
+            }
+        }
+    }
+
     Tokenizer* tokenizer;
     status_t status = Tokenizer::open(filename, &tokenizer);
     if (status) {
@@ -75,6 +105,15 @@ status_t KeyLayoutMap::load(const String8& filename, sp<KeyLayoutMap>* outMap) {
 #endif
             if (!status) {
                 *outMap = map;
+                if (haveStat) {
+                    CachedKeyLayoutMap cached;
+                    cached.ino = st.st_ino;
+                    cached.size = st.st_size;
+                    cached.mtime = st.st_mtime;
+                    cached.map = map;
+                    AutoMutex _l(gCacheLock);
+                    gCache.add(filename, cached);
+                }
             }
         }
         delete tokenizer;
@@ -0,0 +1,105 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "TouchPredictor"
+//#define LOG_NDEBUG 0
+
+// Log debug messages about predictions.
+#define DEBUG_PREDICTION 0
+
+#include <cutils/log.h>
+#include <input/TouchPredictor.h>
+
+namespace android {
+
+const nsecs_t TouchPredictor::MAX_PREDICTION;
+
+// Evaluates the polynomial coefficients at t, by Horner's method.
+static float evaluate(const float* coeffs, uint32_t degree, float t) {
+    float value = coeffs[degree];
+    for (uint32_t i = degree; i > 0; i--) {
+        value = value * t + coeffs[i - 1];
+    }
+    return value;
+}
+
+TouchPredictor::TouchPredictor(const char* strategy) :
+        mVelocityTracker(strategy) {
+}
+
+void TouchPredictor::clear() {
+    mVelocityTracker.clear();
+    mDownIdBits.clear();
+}
+
+void TouchPredictor::addMovement(const MotionEvent* event) {
+    switch (event->getActionMasked()) {
+    case AMOTION_EVENT_ACTION_DOWN:
+    case AMOTION_EVENT_ACTION_HOVER_ENTER:
+        mDownIdBits.clear();
+        // fall through
+    case AMOTION_EVENT_ACTION_POINTER_DOWN:
+    case AMOTION_EVENT_ACTION_MOVE:
+    case AMOTION_EVENT_ACTION_HOVER_MOVE:
+        mVelocityTracker.addMovement(event);
+        for (size_t i = 0; i < event->getPointerCount(); i++) {
+            mDownIdBits.markBit(event->getPointerId(i));
+        }
+        break;
+    case AMOTION_EVENT_ACTION_POINTER_UP:
+        mDownIdBits.clearBit(event->getPointerId(event->getActionIndex()));
+        break;
+    case AMOTION_EVENT_ACTION_UP:
+    case AMOTION_EVENT_ACTION_CANCEL:
+    case AMOTION_EVENT_ACTION_HOVER_EXIT:
+        mDownIdBits.clear();
+        break;
+    default:
+        break;
+    }
+}
+
+bool TouchPredictor::predict(uint32_t id, nsecs_t predictionTime,
+        float* outX, float* outY) const {
+    VelocityTracker::Estimator estimator;
+    if (id > MAX_POINTER_ID || !mDownIdBits.hasBit(id)
+            || !mVelocityTracker.getEstimator(id, &estimator)) {
+        return false;
+    }
+
+    // Estimators have their time base at the most recent sample, in seconds.
+    nsecs_t delta = predictionTime - estimator.time;
+    if (delta < 0) {
+        delta = 0;
+    } else if (delta > MAX_PREDICTION) {
+        delta = MAX_PREDICTION;
+    }
+    const float t = delta * 0.000000001f;
+    *outX = evaluate(estimator.xCoeff, estimator.degree, t);
+    *outY = evaluate(estimator.yCoeff, estimator.degree, t);
+#if DEBUG_PREDICTION
+    ALOGD("[%u] predicted (%0.3f, %0.3f) %0.3fms ahead, degree %u, confidence %0.3f",
+            id, *outX, *outY, delta * 0.000001f, estimator.degree, estimator.confidence);
+#endif
+    return true;
+}
+
+nsecs_t TouchPredictor::getPresentTime(nsecs_t frameTime, nsecs_t vsyncPeriod,
+        uint32_t framesOfLatency) {
+    return frameTime + vsyncPeriod * framesOfLatency;
+}
+
+} // namespace android
@@ -392,7 +392,10 @@ void LeastSquaresVelocityTrackerStrategy::addMovement(nsecs_t eventTime, BitSet3
  * Solves a linear least squares problem to obtain a N degree polynomial that fits
  * the specified input data as nearly as possible.
  *
- * Returns true if a solution is found, false otherwise.
+ * This is done in two steps: decomposeLeastSquares() calculates the QR decomposition
+ * described below, which only depends on X and W, and returns true if a solution can be
+ * found, false otherwise.  solveLeastSquares() then finds the solution for a vector Y, so
+ * that several vectors fitted over the same X and W share the decomposition.
  *
  * The input consists of two vectors of data points X and Y with indices 0..m-1
  * along with a weight vector W of the same size.
@@ -437,12 +440,11 @@ void LeastSquaresVelocityTrackerStrategy::addMovement(nsecs_t eventTime, BitSet3
  * http://en.wikipedia.org/wiki/Numerical_methods_for_linear_least_squares
  * http://en.wikipedia.org/wiki/Gram-Schmidt
  */
-static bool solveLeastSquares(const float* x, const float* y,
-        const float* w, uint32_t m, uint32_t n, float* outB, float* outDet) {
+static bool decomposeLeastSquares(const float* x, const float* w, uint32_t m, uint32_t n,
+        float* outQ, float* outR) {
 #if DEBUG_STRATEGY
-    ALOGD("solveLeastSquares: m=%d, n=%d, x=%s, y=%s, w=%s", int(m), int(n),
-            vectorToString(x, m).string(), vectorToString(y, m).string(),
-            vectorToString(w, m).string());
+    ALOGD("decomposeLeastSquares: m=%d, n=%d, x=%s, w=%s", int(m), int(n),
+            vectorToString(x, m).string(), vectorToString(w, m).string());
 #endif
 
     // Expand the X vector to a matrix A, pre-multiplied by the weights.
@@ -458,20 +460,24 @@ static bool solveLeastSquares(const float* x, const float* y,
 #endif
 
     // Apply the Gram-Schmidt process to A to obtain its QR decomposition.
-    float q[n][m]; // orthonormal basis, column-major order
-    float r[n][n]; // upper triangular matrix, row-major order
+    // Q is the orthonormal basis, column-major order, so that column j starts at q + j * m.
+    // R is the upper triangular matrix, row-major order, so that row j starts at r + j * n.
+    float* q = outQ;
+    float* r = outR;
     for (uint32_t j = 0; j < n; j++) {
+        float* qj = q + j * m;
         for (uint32_t h = 0; h < m; h++) {
-            q[j][h] = a[j][h];
+            qj[h] = a[j][h];
         }
         for (uint32_t i = 0; i < j; i++) {
-            float dot = vectorDot(&q[j][0], &q[i][0], m);
+            const float* qi = q + i * m;
+            float dot = vectorDot(qj, qi, m);
             for (uint32_t h = 0; h < m; h++) {
-                q[j][h] -= dot * q[i][h];
+                qj[h] -= dot * qi[h];
             }
         }
 
-        float norm = vectorNorm(&q[j][0], m);
+        float norm = vectorNorm(qj, m);
         if (norm < 0.000001f) {
             // vectors are linearly dependent or zero so no solution
 #if DEBUG_STRATEGY
@@ -482,15 +488,15 @@ static bool solveLeastSquares(const float* x, const float* y,
 
         float invNorm = 1.0f / norm;
         for (uint32_t h = 0; h < m; h++) {
-            q[j][h] *= invNorm;
+            qj[h] *= invNorm;
         }
         for (uint32_t i = 0; i < n; i++) {
-            r[j][i] = i < j ? 0 : vectorDot(&q[j][0], &a[i][0], m);
+            r[j * n + i] = i < j ? 0 : vectorDot(qj, &a[i][0], m);
         }
     }
 #if DEBUG_STRATEGY
-    ALOGD("  - q=%s", matrixToString(&q[0][0], m, n, false /*rowMajor*/).string());
-    ALOGD("  - r=%s", matrixToString(&r[0][0], n, n, true /*rowMajor*/).string());
+    ALOGD("  - q=%s", matrixToString(q, m, n, false /*rowMajor*/).string());
+    ALOGD("  - r=%s", matrixToString(r, n, n, true /*rowMajor*/).string());
 
     // calculate QR, if we factored A correctly then QR should equal A
     float qr[n][m];
@@ -498,12 +504,20 @@ static bool solveLeastSquares(const float* x, const float* y,
         for (uint32_t i = 0; i < n; i++) {
             qr[i][h] = 0;
             for (uint32_t j = 0; j < n; j++) {
-                qr[i][h] += q[j][h] * r[j][i];
+                qr[i][h] += q[j * m + h] * r[j * n + i];
             }
         }
     }
     ALOGD("  - qr=%s", matrixToString(&qr[0][0], m, n, false /*rowMajor*/).string());
 #endif
+    return true;
+}
+
+static void solveLeastSquares(const float* q, const float* r, const float* x,
+        const float* y, const float* w, uint32_t m, uint32_t n, float* outB, float* outDet) {
+#if DEBUG_STRATEGY
+    ALOGD("solveLeastSquares: m=%d, n=%d, y=%s", int(m), int(n), vectorToString(y, m).string());
+#endif
 
     // Solve R B = Qt W Y to find B.  This is easy because R is upper triangular.
     // We just work from bottom-right to top-left calculating B's coefficients.
@@ -512,11 +526,11 @@ static bool solveLeastSquares(const float* x, const float* y,
         wy[h] = y[h] * w[h];
     }
     for (uint32_t i = n; i-- != 0; ) {
-        outB[i] = vectorDot(&q[i][0], wy, m);
+        outB[i] = vectorDot(q + i * m, wy, m);
         for (uint32_t j = n - 1; j > i; j--) {
-            outB[i] -= r[i][j] * outB[j];
+            outB[i] -= r[i * n + j] * outB[j];
         }
-        outB[i] /= r[i][i];
+        outB[i] /= r[i * n + i];
     }
 #if DEBUG_STRATEGY
     ALOGD("  - b=%s", vectorToString(outB, n).string());
@@ -551,7 +565,6 @@ static bool solveLeastSquares(const float* x, const float* y,
     ALOGD("  - sstot=%f", sstot);
     ALOGD("  - det=%f", *outDet);
 #endif
-    return true;
 }
 
 bool LeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
@@ -595,10 +608,16 @@ bool LeastSquaresVelocityTrackerStrategy::getEstimator(uint32_t id,
         degree = m - 1;
     }
     if (degree >= 1) {
+        // The x and y fits are over the same times and weights, so they share the
+        // decomposition.
+        float q[(VelocityTracker::Estimator::MAX_DEGREE + 1) * HISTORY_SIZE];
+        float r[(VelocityTracker::Estimator::MAX_DEGREE + 1)
+                * (VelocityTracker::Estimator::MAX_DEGREE + 1)];
         float xdet, ydet;
         uint32_t n = degree + 1;
-        if (solveLeastSquares(time, x, w, m, n, outEstimator->xCoeff, &xdet)
-                && solveLeastSquares(time, y, w, m, n, outEstimator->yCoeff, &ydet)) {
+        if (decomposeLeastSquares(time, w, m, n, q, r)) {
+            solveLeastSquares(q, r, time, x, w, m, n, outEstimator->xCoeff, &xdet);
+            solveLeastSquares(q, r, time, y, w, m, n, outEstimator->yCoeff, &ydet);
             outEstimator->time = newestMovement.eventTime;
             outEstimator->degree = degree;
             outEstimator->confidence = xdet * ydet;
@@ -5,7 +5,8 @@ LOCAL_PATH:= $(call my-dir)
 test_src_files := \
     InputChannel_test.cpp \
     InputEvent_test.cpp \
-    InputPublisherAndConsumer_test.cpp
+    InputPublisherAndConsumer_test.cpp \
+    TouchPredictor_test.cpp
 
 shared_libraries := \
     libinput \
@@ -36,5 +37,13 @@ LOCAL_MULTILIB := both
 include $(BUILD_STATIC_LIBRARY)
 
 
+include $(CLEAR_VARS)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+LOCAL_SHARED_LIBRARIES := libinput libutils
+LOCAL_SRC_FILES := VelocityTrackerBenchmark.cpp
+LOCAL_MODULE := VelocityTrackerBenchmark
+include $(BUILD_NATIVE_TEST)
+
+
 # Build the manual test programs.
 include $(call all-makefiles-under, $(LOCAL_PATH))
@@ -17,6 +17,7 @@
 #include "TestHelpers.h"
 
 #include <unistd.h>
+#include <sys/socket.h>
 #include <time.h>
 #include <errno.h>
 
@@ -108,6 +109,82 @@ TEST_F(InputChannelTest, OpenInputChannelPair_ReturnsAPairOfConnectedChannels) {
             << "server channel should receive the correct message from client channel";
 }
 
+TEST_F(InputChannelTest, ReceiveMessages_ReceivesPendingMessagesInOrder) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    for (uint32_t i = 1; i <= 3; i++) {
+        InputMessage msg;
+        memset(&msg, 0, sizeof(InputMessage));
+        msg.header.type = InputMessage::TYPE_FINISHED;
+        msg.body.finished.seq = i;
+        ASSERT_EQ(OK, serverChannel->sendMessage(&msg))
+                << "server channel should be able to send message to client channel";
+    }
+
+    InputMessage msgs[2];
+    size_t count = 0;
+    ASSERT_EQ(OK, clientChannel->receiveMessages(msgs, 2, &count))
+            << "client channel should be able to receive messages from server channel";
+    ASSERT_EQ(2U, count)
+            << "receiveMessages should have received as many messages as requested";
+    EXPECT_EQ(1U, msgs[0].body.finished.seq);
+    EXPECT_EQ(2U, msgs[1].body.finished.seq);
+
+    ASSERT_EQ(OK, clientChannel->receiveMessages(msgs, 2, &count))
+            << "client channel should be able to receive messages from server channel";
+    ASSERT_EQ(1U, count)
+            << "receiveMessages should have received the remaining message";
+    EXPECT_EQ(3U, msgs[0].body.finished.seq);
+
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessages(msgs, 2, &count))
+            << "receiveMessages should have returned WOULD_BLOCK";
+
+    serverChannel.clear(); // close server channel
+
+    EXPECT_EQ(DEAD_OBJECT, clientChannel->receiveMessages(msgs, 2, &count))
+            << "receiveMessages should have returned DEAD_OBJECT";
+}
+
+TEST_F(InputChannelTest, ReceiveMessages_WhenInvalidMessageFollowsValidOnes_ReturnsThemFirst) {
+    sp<InputChannel> serverChannel, clientChannel;
+
+    status_t result = InputChannel::openInputChannelPair(String8("channel name"),
+            serverChannel, clientChannel);
+
+    ASSERT_EQ(OK, result)
+            << "should have successfully opened a channel pair";
+
+    InputMessage msg;
+    memset(&msg, 0, sizeof(InputMessage));
+    msg.header.type = InputMessage::TYPE_FINISHED;
+    msg.body.finished.seq = 1;
+    ASSERT_EQ(OK, serverChannel->sendMessage(&msg))
+            << "server channel should be able to send message to client channel";
+    // Too short to be any message
+    ASSERT_EQ(1, ::send(serverChannel->getFd(), &msg, 1, MSG_DONTWAIT | MSG_NOSIGNAL))
+            << "server should be able to write to the socket";
+
+    InputMessage msgs[3];
+    size_t count = 0;
+    ASSERT_EQ(OK, clientChannel->receiveMessages(msgs, 3, &count))
+            << "receiveMessages should have returned the valid message";
+    ASSERT_EQ(1U, count)
+            << "receiveMessages should have stopped at the invalid message";
+    EXPECT_EQ(1U, msgs[0].body.finished.seq);
+
+    EXPECT_EQ(BAD_VALUE, clientChannel->receiveMessages(msgs, 3, &count))
+            << "receiveMessages should have reported the invalid message";
+
+    EXPECT_EQ(WOULD_BLOCK, clientChannel->receiveMessages(msgs, 3, &count))
+            << "receiveMessages should have reported the invalid message only once";
+}
+
 TEST_F(InputChannelTest, ReceiveSignal_WhenNoSignalPresent_ReturnsAnError) {
     sp<InputChannel> serverChannel, clientChannel;
 
@@ -278,6 +278,143 @@ TEST_F(InputPublisherAndConsumerTest, PublishMotionEvent_WhenPointerCountGreater
             << "publisher publishMotionEvent should return BAD_VALUE";
 }
 
+TEST_F(InputPublisherAndConsumerTest, PublishMotionSamples_EndToEnd) {
+    status_t status;
+    const size_t sampleCount = 3;
+    const uint32_t seqs[sampleCount] = { 21, 22, 23 };
+    const nsecs_t eventTimes[sampleCount] = { 10, 20, 30 };
+    const size_t pointerCount = 1;
+    PointerProperties pointerProperties[pointerCount];
+    pointerProperties[0].clear();
+    pointerProperties[0].id = 0;
+    pointerProperties[0].toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+    PointerCoords pointerCoords[sampleCount * pointerCount];
+    for (size_t i = 0; i < sampleCount; i++) {
+        pointerCoords[i].clear();
+        pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_X, 100 + i);
+        pointerCoords[i].setAxisValue(AMOTION_EVENT_AXIS_Y, 200 + i);
+    }
+
+    status = mPublisher->publishMotionSamples(sampleCount, seqs, eventTimes,
+            1, AINPUT_SOURCE_TOUCHSCREEN, AMOTION_EVENT_ACTION_MOVE, 0, 0, 0, 0, 0,
+            0, 0, 1, 1, 5, pointerCount, pointerProperties, pointerCoords);
+    ASSERT_EQ(OK, status)
+            << "publisher publishMotionSamples should return OK";
+
+    uint32_t consumeSeq;
+    InputEvent* event;
+    status = mConsumer->consume(&mEventFactory, true /*consumeBatches*/, -1, &consumeSeq, &event);
+    ASSERT_EQ(OK, status)
+            << "consumer consume should return OK";
+    ASSERT_TRUE(event != NULL)
+            << "consumer should have returned non-NULL event";
+    ASSERT_EQ(AINPUT_EVENT_TYPE_MOTION, event->getType())
+            << "consumer should have returned a motion event";
+
+    // The samples are batched again, as if they had been sent one by one.
+    MotionEvent* motionEvent = static_cast<MotionEvent*>(event);
+    EXPECT_EQ(seqs[sampleCount - 1], consumeSeq);
+    EXPECT_EQ(sampleCount - 1, motionEvent->getHistorySize());
+    for (size_t i = 0; i < sampleCount - 1; i++) {
+        SCOPED_TRACE(i);
+        EXPECT_EQ(eventTimes[i], motionEvent->getHistoricalEventTime(i));
+        EXPECT_EQ(100.0f + i, motionEvent->getHistoricalRawX(0, i));
+        EXPECT_EQ(200.0f + i, motionEvent->getHistoricalRawY(0, i));
+    }
+    EXPECT_EQ(eventTimes[sampleCount - 1], motionEvent->getEventTime());
+    EXPECT_EQ(100.0f + sampleCount - 1, motionEvent->getRawX(0));
+    EXPECT_EQ(200.0f + sampleCount - 1, motionEvent->getRawY(0));
+
+    status = mConsumer->sendFinishedSignal(consumeSeq, true);
+    ASSERT_EQ(OK, status)
+            << "consumer sendFinishedSignal should return OK";
+
+    // Each sample is finished.
+    bool finished[sampleCount] = { false, false, false };
+    for (size_t i = 0; i < sampleCount; i++) {
+        uint32_t finishedSeq = 0;
+        bool handled = false;
+        status = mPublisher->receiveFinishedSignal(&finishedSeq, &handled);
+        ASSERT_EQ(OK, status)
+                << "publisher receiveFinishedSignal should return OK";
+        ASSERT_TRUE(finishedSeq >= seqs[0] && finishedSeq <= seqs[sampleCount - 1])
+                << "publisher receiveFinishedSignal should have returned a sample's seq";
+        finished[finishedSeq - seqs[0]] = true;
+        EXPECT_TRUE(handled);
+    }
+    for (size_t i = 0; i < sampleCount; i++) {
+        EXPECT_TRUE(finished[i]);
+    }
+}
+
+TEST_F(InputPublisherAndConsumerTest, PublishMotionSamples_WhenTooManySamples_ReturnsError) {
+    status_t status;
+    const size_t pointerCount = MAX_POINTERS;
+    const size_t sampleCount = 2;
+    const uint32_t seqs[sampleCount] = { 1, 2 };
+    const nsecs_t eventTimes[sampleCount] = { 1, 2 };
+    PointerProperties pointerProperties[pointerCount];
+    PointerCoords pointerCoords[sampleCount * pointerCount];
+    for (size_t i = 0; i < pointerCount; i++) {
+        pointerProperties[i].clear();
+        pointerProperties[i].id = i;
+    }
+    for (size_t i = 0; i < sampleCount * pointerCount; i++) {
+        pointerCoords[i].clear();
+    }
+
+    ASSERT_EQ(1U, InputPublisher::getMaxSampleCount(pointerCount));
+    status = mPublisher->publishMotionSamples(sampleCount, seqs, eventTimes,
+            0, 0, AMOTION_EVENT_ACTION_MOVE, 0, 0, 0, 0, 0, 0, 0, 0, 0, 0,
+            pointerCount, pointerProperties, pointerCoords);
+    ASSERT_EQ(BAD_VALUE, status)
+            << "publisher publishMotionSamples should return BAD_VALUE";
+}
+
+TEST_F(InputPublisherAndConsumerTest, PublishMessage_ToSeveralChannels_EndToEnd) {
+    status_t status;
+    sp<InputChannel> otherServerChannel, otherClientChannel;
+    status = InputChannel::openInputChannelPair(String8("other channel name"),
+            otherServerChannel, otherClientChannel);
+    ASSERT_EQ(OK, status);
+    InputPublisher otherPublisher(otherServerChannel);
+    InputConsumer otherConsumer(otherClientChannel);
+
+    const uint32_t seq = 15;
+    InputMessage msg;
+    status = InputPublisher::buildKeyMessage(&msg, seq, 1, AINPUT_SOURCE_KEYBOARD,
+            AKEY_EVENT_ACTION_DOWN, 0, AKEYCODE_ENTER, 13, 0, 0, 3, 4);
+    ASSERT_EQ(OK, status)
+            << "publisher buildKeyMessage should return OK";
+
+    InputPublisher* publishers[] = { mPublisher, &otherPublisher };
+    InputConsumer* consumers[] = { mConsumer, &otherConsumer };
+    for (size_t i = 0; i < 2; i++) {
+        status = publishers[i]->publishMessage(&msg);
+        ASSERT_EQ(OK, status)
+                << "publisher publishMessage should return OK";
+
+        uint32_t consumeSeq;
+        InputEvent* event;
+        status = consumers[i]->consume(&mEventFactory, true /*consumeBatches*/, -1,
+                &consumeSeq, &event);
+        ASSERT_EQ(OK, status)
+                << "consumer consume should return OK";
+        ASSERT_EQ(AINPUT_EVENT_TYPE_KEY, event->getType())
+                << "consumer should have returned a key event";
+        EXPECT_EQ(seq, consumeSeq);
+        EXPECT_EQ(AKEYCODE_ENTER, static_cast<KeyEvent*>(event)->getKeyCode());
+    }
+}
+
+TEST_F(InputPublisherAndConsumerTest, BuildKeyMessage_WhenSequenceNumberIsZero_ReturnsError) {
+    InputMessage msg;
+    status_t status = InputPublisher::buildKeyMessage(&msg, 0, 1, AINPUT_SOURCE_KEYBOARD,
+            AKEY_EVENT_ACTION_DOWN, 0, AKEYCODE_ENTER, 13, 0, 0, 3, 4);
+    ASSERT_EQ(BAD_VALUE, status)
+            << "publisher buildKeyMessage should return BAD_VALUE";
+}
+
 TEST_F(InputPublisherAndConsumerTest, PublishMultipleEvents_EndToEnd) {
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeMotionEvent());
     ASSERT_NO_FATAL_FAILURE(PublishAndConsumeKeyEvent());
@@ -62,6 +62,7 @@ void TestInputMessageAlignment() {
   CHECK_OFFSET(InputMessage::Body::Motion, xPrecision, 64);
   CHECK_OFFSET(InputMessage::Body::Motion, yPrecision, 68);
   CHECK_OFFSET(InputMessage::Body::Motion, pointerCount, 72);
+  CHECK_OFFSET(InputMessage::Body::Motion, sampleCount, 76);
   CHECK_OFFSET(InputMessage::Body::Motion, pointers, 80);
 }
 
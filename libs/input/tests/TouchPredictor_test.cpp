@@ -0,0 +1,88 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <gtest/gtest.h>
+#include <input/Input.h>
+#include <input/TouchPredictor.h>
+
+namespace android {
+
+// Nanoseconds per milliseconds.
+static const nsecs_t NANOS_PER_MS = 1000000;
+
+class TouchPredictorTest : public testing::Test {
+protected:
+    // A finger moving at 1 pixel per ms to the right, and 2 down.
+    static float xAt(nsecs_t time) { return 100 + float(time) / NANOS_PER_MS; }
+    static float yAt(nsecs_t time) { return 200 + 2 * float(time) / NANOS_PER_MS; }
+
+    void addMotion(TouchPredictor& predictor, int32_t action, nsecs_t eventTime) {
+        PointerProperties properties;
+        properties.clear();
+        properties.id = 0;
+        properties.toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+        PointerCoords coords;
+        coords.clear();
+        coords.setAxisValue(AMOTION_EVENT_AXIS_X, xAt(eventTime));
+        coords.setAxisValue(AMOTION_EVENT_AXIS_Y, yAt(eventTime));
+
+        MotionEvent event;
+        event.initialize(0, AINPUT_SOURCE_TOUCHSCREEN, action, 0, 0, 0, 0, 0,
+                0, 0, 1, 1, 0, eventTime, 1, &properties, &coords);
+        predictor.addMovement(&event);
+    }
+};
+
+TEST_F(TouchPredictorTest, Predict_WhenMovingSteadily_ExtrapolatesMovement) {
+    TouchPredictor predictor("lsq2");
+    addMotion(predictor, AMOTION_EVENT_ACTION_DOWN, 0);
+    for (nsecs_t time = 8 * NANOS_PER_MS; time <= 64 * NANOS_PER_MS; time += 8 * NANOS_PER_MS) {
+        addMotion(predictor, AMOTION_EVENT_ACTION_MOVE, time);
+    }
+
+    float x, y;
+    const nsecs_t predictionTime = 74 * NANOS_PER_MS;
+    ASSERT_TRUE(predictor.predict(0, predictionTime, &x, &y));
+    EXPECT_NEAR(xAt(predictionTime), x, 0.1);
+    EXPECT_NEAR(yAt(predictionTime), y, 0.1);
+
+    // Predictions don't go further than MAX_PREDICTION past the last sample.
+    const nsecs_t maxPredictionTime = 64 * NANOS_PER_MS + TouchPredictor::MAX_PREDICTION;
+    ASSERT_TRUE(predictor.predict(0, maxPredictionTime + 50 * NANOS_PER_MS, &x, &y));
+    EXPECT_NEAR(xAt(maxPredictionTime), x, 0.1);
+    EXPECT_NEAR(yAt(maxPredictionTime), y, 0.1);
+}
+
+TEST_F(TouchPredictorTest, Predict_WhenPointerUp_ReturnsFalse) {
+    TouchPredictor predictor;
+    float x, y;
+    EXPECT_FALSE(predictor.predict(0, 0, &x, &y));
+
+    addMotion(predictor, AMOTION_EVENT_ACTION_DOWN, 0);
+    ASSERT_TRUE(predictor.predict(0, 10 * NANOS_PER_MS, &x, &y));
+    EXPECT_NEAR(xAt(0), x, 0.1);
+    EXPECT_NEAR(yAt(0), y, 0.1);
+
+    addMotion(predictor, AMOTION_EVENT_ACTION_MOVE, 8 * NANOS_PER_MS);
+    addMotion(predictor, AMOTION_EVENT_ACTION_UP, 16 * NANOS_PER_MS);
+    EXPECT_FALSE(predictor.predict(0, 20 * NANOS_PER_MS, &x, &y));
+}
+
+TEST_F(TouchPredictorTest, GetPresentTime) {
+    EXPECT_EQ(1000 + 2 * 16, TouchPredictor::getPresentTime(1000, 16, 2));
+}
+
+} // namespace android
@@ -0,0 +1,242 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * VelocityTracker benchmarks: the cost and accuracy of each strategy on
+ * touch traces. Each trace is a gesture of a single pointer, fed to the
+ * tracker one sample at a time, with the estimator queried after each of
+ * them as an app would on every move.
+ *
+ * The accuracy is measured as the error of the position the estimator
+ * predicts for the next sample, and for the synthetic flings, which have a
+ * known velocity, as the error of the velocity at the end of the gesture.
+ *
+ * With -f, the traces are read from a file instead of being synthesized:
+ * one "eventTimeNs x y" sample per line, and an empty line between
+ * gestures.
+ *
+ * usage: VelocityTrackerBenchmark [-i iterations] [-f traces]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <input/VelocityTracker.h>
+
+#include <utils/BitSet.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+static const char* const STRATEGIES[] = {
+    "lsq1", "lsq2", "lsq3", "wlsq2-delta", "wlsq2-central", "wlsq2-recent",
+    "int1", "int2", "legacy",
+};
+
+// ---------------------------------------------------------------------------
+
+struct Sample {
+    nsecs_t eventTime;
+    float x;
+    float y;
+};
+
+struct Trace {
+    std::vector<Sample> samples;
+    // Velocity at the end of the gesture, if known
+    bool hasVelocity;
+    float vx;
+    float vy;
+
+    Trace() : hasVelocity(false), vx(0), vy(0) {}
+};
+
+// Flings which decelerate, sampled at the given rate, with some noise on
+// the positions as a touch panel would report them
+static void synthesizeTraces(std::vector<Trace>* traces) {
+    static const float SPEEDS[] = { 200.0f, 1000.0f, 4000.0f };
+    static const nsecs_t PERIODS[] = { 16666667, 8333333 };
+    static const float DECELERATION = 0.5f; // of the speed, per 100ms
+    static const nsecs_t DURATION = 150000000;
+
+    srand48(0);
+    for (size_t s = 0; s < sizeof(SPEEDS) / sizeof(SPEEDS[0]); s++) {
+        for (size_t p = 0; p < sizeof(PERIODS) / sizeof(PERIODS[0]); p++) {
+            const float speed = SPEEDS[s];
+            const float k = DECELERATION * 10.0f; // per second
+            Trace trace;
+            for (nsecs_t t = 0; t <= DURATION; t += PERIODS[p]) {
+                const float seconds = t * 0.000000001f;
+                // v(t) = speed * (1 - k * t / 2), the deceleration is linear
+                const float distance = speed * (seconds - k * seconds * seconds / 4);
+                Sample sample;
+                sample.eventTime = t;
+                sample.x = 100.0f + 0.8f * distance + (drand48() - 0.5f);
+                sample.y = 500.0f - 0.6f * distance + (drand48() - 0.5f);
+                trace.samples.push_back(sample);
+            }
+            const float seconds = DURATION * 0.000000001f;
+            const float v = speed * (1 - k * seconds / 2);
+            trace.hasVelocity = true;
+            trace.vx = 0.8f * v;
+            trace.vy = -0.6f * v;
+            traces->push_back(trace);
+        }
+    }
+}
+
+static bool readTraces(const char* path, std::vector<Trace>* traces) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "could not open %s\n", path);
+        return false;
+    }
+    Trace trace;
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        long long eventTime;
+        Sample sample;
+        if (sscanf(line, "%lld %f %f", &eventTime, &sample.x, &sample.y) == 3) {
+            sample.eventTime = eventTime;
+            trace.samples.push_back(sample);
+        } else if (!trace.samples.empty()) {
+            traces->push_back(trace);
+            trace = Trace();
+        }
+    }
+    if (!trace.samples.empty()) {
+        traces->push_back(trace);
+    }
+    fclose(file);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+
+static float evaluate(const float* coeff, uint32_t degree, float t) {
+    float value = 0;
+    for (uint32_t i = degree + 1; i-- != 0; ) {
+        value = value * t + coeff[i];
+    }
+    return value;
+}
+
+static void bench(size_t iterations, const char* strategy,
+        const std::vector<Trace>& traces) {
+    static const uint32_t ID = 0;
+    BitSet32 idBits;
+    idBits.markBit(ID);
+
+    // Accuracy, in a first pass
+    double positionError = 0;
+    size_t numPositions = 0;
+    double velocityError = 0;
+    size_t numVelocities = 0;
+    for (size_t i = 0; i < traces.size(); i++) {
+        const std::vector<Sample>& samples = traces[i].samples;
+        VelocityTracker tracker(strategy);
+        for (size_t j = 0; j < samples.size(); j++) {
+            VelocityTracker::Position position;
+            position.x = samples[j].x;
+            position.y = samples[j].y;
+            tracker.addMovement(samples[j].eventTime, idBits, &position);
+            VelocityTracker::Estimator estimator;
+            if (j + 1 < samples.size() && tracker.getEstimator(ID, &estimator)) {
+                const float dt = (samples[j + 1].eventTime - estimator.time) * 0.000000001f;
+                const float dx = evaluate(estimator.xCoeff, estimator.degree, dt)
+                        - samples[j + 1].x;
+                const float dy = evaluate(estimator.yCoeff, estimator.degree, dt)
+                        - samples[j + 1].y;
+                positionError += sqrtf(dx * dx + dy * dy);
+                numPositions++;
+            }
+        }
+        float vx, vy;
+        if (traces[i].hasVelocity && tracker.getVelocity(ID, &vx, &vy)) {
+            const float dx = vx - traces[i].vx;
+            const float dy = vy - traces[i].vy;
+            velocityError += sqrtf(dx * dx + dy * dy);
+            numVelocities++;
+        }
+    }
+
+    // Cost of adding a sample and getting the estimator
+    size_t numSamples = 0;
+    const nsecs_t start = systemTime();
+    for (size_t n = 0; n < iterations; n++) {
+        for (size_t i = 0; i < traces.size(); i++) {
+            const std::vector<Sample>& samples = traces[i].samples;
+            VelocityTracker tracker(strategy);
+            for (size_t j = 0; j < samples.size(); j++) {
+                VelocityTracker::Position position;
+                position.x = samples[j].x;
+                position.y = samples[j].y;
+                tracker.addMovement(samples[j].eventTime, idBits, &position);
+                VelocityTracker::Estimator estimator;
+                tracker.getEstimator(ID, &estimator);
+            }
+            numSamples += samples.size();
+        }
+    }
+    const nsecs_t elapsed = systemTime() - start;
+
+    printf("%-16s %8.1fns/sample  position error %8.3f  velocity error %9.3f\n",
+            strategy, numSamples ? elapsed / static_cast<double>(numSamples) : 0.0,
+            numPositions ? positionError / numPositions : 0.0,
+            numVelocities ? velocityError / numVelocities : 0.0);
+    fflush(stdout);
+}
+
+int main(int argc, char** argv)
+{
+    size_t iterations = 100;
+    const char* path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:f:")) != -1) {
+        switch (opt) {
+            case 'i':
+                iterations = strtoul(optarg, NULL, 0);
+                break;
+            case 'f':
+                path = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-i iterations] [-f traces]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<Trace> traces;
+    if (path) {
+        if (!readTraces(path, &traces)) {
+            return EXIT_FAILURE;
+        }
+    } else {
+        synthesizeTraces(&traces);
+    }
+
+    printf("VelocityTrackerBenchmark: %zu traces, %zu iterations\n",
+            traces.size(), iterations);
+    for (size_t i = 0; i < sizeof(STRATEGIES) / sizeof(STRATEGIES[0]); i++) {
+        bench(iterations, STRATEGIES[i], traces);
+    }
+    return EXIT_SUCCESS;
+}
@@ -35,11 +35,13 @@ namespace android {
 const sp<Fence> Fence::NO_FENCE = sp<Fence>(new Fence);
 
 Fence::Fence() :
-    mFenceFd(-1) {
+    mFenceFd(-1),
+    mSignalTime(INT64_MAX) {
 }
 
 Fence::Fence(int fenceFd) :
-    mFenceFd(fenceFd) {
+    mFenceFd(fenceFd),
+    mSignalTime(INT64_MAX) {
 }
 
 Fence::~Fence() {
@@ -98,6 +100,44 @@ sp<Fence> Fence::merge(const String8& name, const sp<Fence>& f1,
     return sp<Fence>(new Fence(result));
 }
 
+sp<Fence> Fence::mergeMany(const String8& name,
+        const Vector< sp<Fence> >& fences) {
+    ATRACE_CALL();
+    Vector< sp<Fence> > pending;
+    pending.setCapacity(fences.size());
+    for (size_t i = 0; i < fences.size(); i++) {
+        const sp<Fence>& fence(fences[i]);
+        if (fence == NULL || !fence->isValid()) {
+            continue;
+        }
+        // -1 is an error, in which case the fence is kept, to be safe
+        const nsecs_t signalTime = fence->getSignalTime();
+        if (signalTime != INT64_MAX && signalTime != -1) {
+            continue;
+        }
+        bool duplicate = false;
+        for (size_t j = 0; j < pending.size() && !duplicate; j++) {
+            duplicate = pending[j] == fence;
+        }
+        if (!duplicate) {
+            pending.add(fence);
+        }
+    }
+
+    if (pending.isEmpty()) {
+        return NO_FENCE;
+    }
+    sp<Fence> result(pending[0]);
+    for (size_t i = 1; i < pending.size(); i++) {
+        result = merge(name, result, pending[i]);
+        if (result == NO_FENCE) {
+            // merge logged the error
+            return NULL;
+        }
+    }
+    return result;
+}
+
 int Fence::dup() const {
     return ::dup(mFenceFd);
 }
@@ -107,6 +147,11 @@ nsecs_t Fence::getSignalTime() const {
         return -1;
     }
 
+    const nsecs_t signalTime = mSignalTime.load(std::memory_order_relaxed);
+    if (signalTime != INT64_MAX) {
+        return signalTime;
+    }
+
     struct sync_fence_info_data* finfo = sync_fence_info(mFenceFd);
     if (finfo == NULL) {
         ALOGE("sync_fence_info returned NULL for fd %d", mFenceFd);
@@ -126,6 +171,7 @@ nsecs_t Fence::getSignalTime() const {
     }
     sync_fence_info_free(finfo);
 
+    mSignalTime.store(nsecs_t(timestamp), std::memory_order_relaxed);
     return nsecs_t(timestamp);
 }
 
@@ -14,10 +14,97 @@
  * limitations under the License.
  */
 
+#include <stdint.h>
+#include <string.h>
+
+#include <algorithm>
+#include <vector>
+
 #include <ui/FrameStats.h>
 
 namespace android {
 
+// The percentiles given by FrameStatsSummary
+static const size_t PERCENTILES[FrameStatsSummary::NUM_PERCENTILES] =
+        { 50, 90, 95, 99 };
+
+FrameStatsSummary::FrameStatsSummary() :
+    refreshPeriodNano(0),
+    frameCount(0),
+    jankyFrameCount(0),
+    missedRefreshCount(0) {
+    memset(frameIntervalHistogram, 0, sizeof(frameIntervalHistogram));
+    memset(frameIntervalPercentilesNano, 0,
+            sizeof(frameIntervalPercentilesNano));
+    memset(presentLatencyPercentilesNano, 0,
+            sizeof(presentLatencyPercentilesNano));
+}
+
+static void computePercentiles(std::vector<nsecs_t>& values,
+        nsecs_t* outPercentiles) {
+    if (values.empty()) {
+        return;
+    }
+    std::sort(values.begin(), values.end());
+    const size_t count = values.size();
+    for (size_t i = 0; i < FrameStatsSummary::NUM_PERCENTILES; i++) {
+        outPercentiles[i] = values[std::min(count - 1,
+                count * PERCENTILES[i] / 100)];
+    }
+}
+
+static bool isPresentTimeValid(nsecs_t time) {
+    // Frames that weren't presented yet have INT64_MAX, empty records 0
+    return time > 0 && time != INT64_MAX;
+}
+
+void FrameStats::summarize(FrameStatsSummary* outSummary) const {
+    *outSummary = FrameStatsSummary();
+    outSummary->refreshPeriodNano = refreshPeriodNano;
+
+    const size_t frameCount = std::min(desiredPresentTimesNano.size(),
+            actualPresentTimesNano.size());
+    std::vector<nsecs_t> intervals;
+    std::vector<nsecs_t> latencies;
+    intervals.reserve(frameCount);
+    latencies.reserve(frameCount);
+
+    nsecs_t previousPresentTime = 0;
+    for (size_t i = 0; i < frameCount; i++) {
+        const nsecs_t presentTime = actualPresentTimesNano[i];
+        if (!isPresentTimeValid(presentTime)) {
+            previousPresentTime = 0;
+            continue;
+        }
+        outSummary->frameCount++;
+
+        const nsecs_t desiredPresentTime = desiredPresentTimesNano[i];
+        if (isPresentTimeValid(desiredPresentTime)) {
+            latencies.push_back(presentTime - desiredPresentTime);
+        }
+
+        if (previousPresentTime != 0 && presentTime > previousPresentTime) {
+            const nsecs_t interval = presentTime - previousPresentTime;
+            intervals.push_back(interval);
+            if (refreshPeriodNano > 0) {
+                const uint64_t refreshes = static_cast<uint64_t>(
+                        (interval + refreshPeriodNano / 2) / refreshPeriodNano);
+                outSummary->frameIntervalHistogram[std::min(refreshes,
+                        static_cast<uint64_t>(
+                        FrameStatsSummary::NUM_BUCKETS - 1))]++;
+                if (refreshes > 1) {
+                    outSummary->jankyFrameCount++;
+                    outSummary->missedRefreshCount += refreshes - 1;
+                }
+            }
+        }
+        previousPresentTime = presentTime;
+    }
+
+    computePercentiles(intervals, outSummary->frameIntervalPercentilesNano);
+    computePercentiles(latencies, outSummary->presentLatencyPercentilesNano);
+}
+
 bool FrameStats::isFixedSize() const {
     return false;
 }
@@ -16,20 +16,160 @@
 
 #define LOG_TAG "GraphicBuffer"
 
+#include <inttypes.h>
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
+#include <sys/syscall.h>
 #include <sys/types.h>
+#include <unistd.h>
+
+#include <cutils/properties.h>
 
 #include <utils/Errors.h>
+#include <utils/KeyedVector.h>
 #include <utils/Log.h>
+#include <utils/Mutex.h>
+#include <utils/Singleton.h>
 
 #include <ui/GraphicBuffer.h>
 #include <ui/GraphicBufferAllocator.h>
 #include <ui/GraphicBufferMapper.h>
 #include <ui/PixelFormat.h>
 
+#ifndef KCMP_FILE
+#define KCMP_FILE 0
+#endif
+
 namespace android {
 
+// ===========================================================================
+// Cache of the handles imported by unflatten
+// ===========================================================================
+
+// A buffer that crosses binder again while this process still has a
+// GraphicBuffer for it, e.g. when a producer requests the buffer of a slot
+// again or a buffer is attached back, reuses the handle that was registered
+// with gralloc the first time instead of registering, and mapping, it once
+// more. Buffers are looked up by id, and the fds received with a buffer must
+// refer to the same open files as the ones kept in the cached handle for it
+// to be reused. Binder installs the sender's file itself, so only somebody
+// who already has the buffer can pass that check.
+class ImportedHandleCache : public Singleton<ImportedHandleCache>
+{
+    friend class Singleton<ImportedHandleCache>;
+
+    struct Entry {
+        native_handle_t* handle;
+        // the flattened width, height, stride, format and usage
+        int header[5];
+        uint32_t refs;
+    };
+
+    Mutex mLock;
+    bool mEnabled;
+    KeyedVector<uint64_t, Entry> mEntries;
+
+    ImportedHandleCache();
+
+    static bool isSameFile(int lhs, int rhs);
+
+public:
+    bool isEnabled() const { return mEnabled; }
+
+    // acquire returns the handle cached for the buffer id, flattened in buf
+    // with fds, and takes a reference to it. It returns NULL if no handle is
+    // cached for id, or if it isn't for the same buffer.
+    native_handle_t* acquire(uint64_t id, int const* buf, int const* fds);
+
+    // add caches h, registered for the buffer id flattened in buf, with one
+    // reference. It returns false if a handle is already cached for id, in
+    // which case h isn't cached.
+    bool add(uint64_t id, native_handle_t* h, int const* buf);
+
+    // release drops a reference to the handle cached for id. It returns true
+    // if it was the last one, in which case the caller must unregister, close
+    // and delete the handle.
+    bool release(uint64_t id);
+};
+
+ANDROID_SINGLETON_STATIC_INSTANCE(ImportedHandleCache);
+
+ImportedHandleCache::ImportedHandleCache()
+    : Singleton<ImportedHandleCache>(), mEnabled(false)
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("ro.ui.buffer_import_cache", value, "1");
+    mEnabled = atoi(value) != 0;
+}
+
+// Compares the struct file the fds refer to. The inode isn't good enough:
+// ion and dma-buf fds can all share one anonymous inode. Without kcmp no
+// handle is ever reused.
+bool ImportedHandleCache::isSameFile(int lhs, int rhs) {
+#ifdef __NR_kcmp
+    const pid_t pid = getpid();
+    return syscall(__NR_kcmp, pid, pid, KCMP_FILE, lhs, rhs) == 0;
+#else
+    (void)lhs;
+    (void)rhs;
+    return false;
+#endif
+}
+
+native_handle_t* ImportedHandleCache::acquire(uint64_t id, int const* buf,
+        int const* fds) {
+    Mutex::Autolock _l(mLock);
+    ssize_t index = mEntries.indexOfKey(id);
+    if (index < 0) {
+        return NULL;
+    }
+    Entry& entry(mEntries.editValueAt(static_cast<size_t>(index)));
+    native_handle_t* h = entry.handle;
+    if (memcmp(entry.header, &buf[1], sizeof(entry.header)) != 0 ||
+            h->numFds != buf[9] || h->numInts != buf[10]) {
+        return NULL;
+    }
+    // The ints may have been updated by registerBuffer, e.g. with the
+    // address the buffer is mapped at, so only the fds can tell
+    for (int i = 0; i < h->numFds; i++) {
+        if (!isSameFile(h->data[i], fds[i])) {
+            return NULL;
+        }
+    }
+    entry.refs++;
+    return h;
+}
+
+bool ImportedHandleCache::add(uint64_t id, native_handle_t* h,
+        int const* buf) {
+    Mutex::Autolock _l(mLock);
+    if (mEntries.indexOfKey(id) >= 0) {
+        return false;
+    }
+    Entry entry;
+    entry.handle = h;
+    memcpy(entry.header, &buf[1], sizeof(entry.header));
+    entry.refs = 1;
+    mEntries.add(id, entry);
+    return true;
+}
+
+bool ImportedHandleCache::release(uint64_t id) {
+    Mutex::Autolock _l(mLock);
+    ssize_t index = mEntries.indexOfKey(id);
+    if (index < 0) {
+        ALOGE("release: no imported handle for buffer %#" PRIx64, id);
+        return false;
+    }
+    Entry& entry(mEntries.editValueAt(static_cast<size_t>(index)));
+    if (--entry.refs > 0) {
+        return false;
+    }
+    mEntries.removeItemsAt(static_cast<size_t>(index));
+    return true;
+}
+
 // ===========================================================================
 // Buffer and implementation of ANativeWindowBuffer
 // ===========================================================================
@@ -104,7 +244,13 @@ GraphicBuffer::~GraphicBuffer()
 
 void GraphicBuffer::free_handle()
 {
-    if (mOwner == ownHandle) {
+    if (mOwner == ownImported) {
+        if (ImportedHandleCache::getInstance().release(mId)) {
+            mBufferMapper.unregisterBuffer(handle);
+            native_handle_close(handle);
+            native_handle_delete(const_cast<native_handle*>(handle));
+        }
+    } else if (mOwner == ownHandle) {
         mBufferMapper.unregisterBuffer(handle);
         native_handle_close(handle);
         native_handle_delete(const_cast<native_handle*>(handle));
@@ -358,36 +504,51 @@ status_t GraphicBuffer::unflatten(
         free_handle();
     }
 
+    mId = static_cast<uint64_t>(buf[6]) << 32;
+    mId |= static_cast<uint32_t>(buf[7]);
+
+    mGenerationNumber = static_cast<uint32_t>(buf[8]);
+
+    mOwner = ownHandle;
+
+    ImportedHandleCache& cache(ImportedHandleCache::getInstance());
+    bool imported = false;
     if (numFds || numInts) {
         width  = buf[1];
         height = buf[2];
         stride = buf[3];
         format = buf[4];
         usage  = buf[5];
-        native_handle* h = native_handle_create(
-                static_cast<int>(numFds), static_cast<int>(numInts));
-        if (!h) {
-            width = height = stride = format = usage = 0;
-            handle = NULL;
-            ALOGE("unflatten: native_handle_create failed");
-            return NO_MEMORY;
+        native_handle* h = NULL;
+        if (numFds && cache.isEnabled()) {
+            h = cache.acquire(mId, buf, fds);
+        }
+        if (h) {
+            // The fds received are duplicates of the cached handle's
+            for (size_t i = 0; i < numFds; i++) {
+                close(fds[i]);
+            }
+            imported = true;
+            mOwner = ownImported;
+        } else {
+            h = native_handle_create(
+                    static_cast<int>(numFds), static_cast<int>(numInts));
+            if (!h) {
+                width = height = stride = format = usage = 0;
+                handle = NULL;
+                ALOGE("unflatten: native_handle_create failed");
+                return NO_MEMORY;
+            }
+            memcpy(h->data, fds, numFds * sizeof(int));
+            memcpy(h->data + numFds, &buf[11], numInts * sizeof(int));
         }
-        memcpy(h->data, fds, numFds * sizeof(int));
-        memcpy(h->data + numFds, &buf[11], numInts * sizeof(int));
         handle = h;
     } else {
         width = height = stride = format = usage = 0;
         handle = NULL;
     }
 
-    mId = static_cast<uint64_t>(buf[6]) << 32;
-    mId |= static_cast<uint32_t>(buf[7]);
-
-    mGenerationNumber = static_cast<uint32_t>(buf[8]);
-
-    mOwner = ownHandle;
-
-    if (handle != 0) {
+    if (handle != 0 && !imported) {
         status_t err = mBufferMapper.registerBuffer(handle);
         if (err != NO_ERROR) {
             width = height = stride = format = usage = 0;
@@ -396,6 +557,10 @@ status_t GraphicBuffer::unflatten(
                     strerror(-err), err);
             return err;
         }
+        if (numFds && cache.isEnabled() &&
+                cache.add(mId, const_cast<native_handle*>(handle), buf)) {
+            mOwner = ownImported;
+        }
     }
 
     buffer = static_cast<void const*>(static_cast<uint8_t const*>(buffer) + sizeNeeded);
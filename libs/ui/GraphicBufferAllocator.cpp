@@ -18,6 +18,9 @@
 #define LOG_TAG "GraphicBufferAllocator"
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 
+#include <inttypes.h>
+#include <string.h>
+
 #include <cutils/log.h>
 
 #include <utils/Singleton.h>
@@ -34,6 +37,15 @@ ANDROID_SINGLETON_STATIC_INSTANCE( GraphicBufferAllocator )
 Mutex GraphicBufferAllocator::sLock;
 KeyedVector<buffer_handle_t,
     GraphicBufferAllocator::alloc_rec_t> GraphicBufferAllocator::sAllocList;
+GraphicBufferAllocator::stats_t GraphicBufferAllocator::sStats;
+KeyedVector<PixelFormat,
+    GraphicBufferAllocator::totals_t> GraphicBufferAllocator::sFormatTotals;
+KeyedVector<uint32_t,
+    GraphicBufferAllocator::totals_t> GraphicBufferAllocator::sUsageTotals;
+
+const nsecs_t GraphicBufferAllocator::LATENCY_BUCKETS_US[
+        GraphicBufferAllocator::NUM_LATENCY_BUCKETS - 1] =
+        { 100, 500, 1000, 2000, 5000, 10000 };
 
 GraphicBufferAllocator::GraphicBufferAllocator()
     : mAllocDev(0)
@@ -51,6 +63,66 @@ GraphicBufferAllocator::~GraphicBufferAllocator()
     gralloc_close(mAllocDev);
 }
 
+void GraphicBufferAllocator::addTotals(totals_t& totals, size_t size)
+{
+    totals.count++;
+    totals.size += size;
+    if (totals.count > totals.peakCount) {
+        totals.peakCount = totals.count;
+    }
+    if (totals.size > totals.peakSize) {
+        totals.peakSize = totals.size;
+    }
+}
+
+void GraphicBufferAllocator::removeTotals(totals_t& totals, size_t size)
+{
+    totals.count--;
+    totals.size -= size;
+}
+
+void GraphicBufferAllocator::addAllocLocked(buffer_handle_t handle,
+        const alloc_rec_t& rec)
+{
+    sAllocList.add(handle, rec);
+    sStats.allocs++;
+    addTotals(sStats.totals, rec.size);
+
+    ssize_t index = sFormatTotals.indexOfKey(rec.format);
+    if (index < 0) {
+        totals_t totals;
+        memset(&totals, 0, sizeof(totals));
+        index = sFormatTotals.add(rec.format, totals);
+    }
+    addTotals(sFormatTotals.editValueAt(static_cast<size_t>(index)), rec.size);
+
+    index = sUsageTotals.indexOfKey(rec.usage);
+    if (index < 0) {
+        totals_t totals;
+        memset(&totals, 0, sizeof(totals));
+        index = sUsageTotals.add(rec.usage, totals);
+    }
+    addTotals(sUsageTotals.editValueAt(static_cast<size_t>(index)), rec.size);
+}
+
+void GraphicBufferAllocator::removeAllocLocked(size_t index)
+{
+    const alloc_rec_t& rec(sAllocList.valueAt(index));
+    sStats.frees++;
+    removeTotals(sStats.totals, rec.size);
+    removeTotals(sFormatTotals.editValueFor(rec.format), rec.size);
+    removeTotals(sUsageTotals.editValueFor(rec.usage), rec.size);
+    sAllocList.removeItemsAt(index);
+}
+
+static void dumpTotals(String8& result, const char* name, size_t count,
+        size_t size, size_t peakCount, size_t peakSize)
+{
+    result.appendFormat("  %-24s %5zu buffers %9.2f KiB (peak %5zu buffers "
+            "%9.2f KiB)\n", name, count, size / 1024.0, peakCount,
+            peakSize / 1024.0);
+}
+
 void GraphicBufferAllocator::dump(String8& result) const
 {
     Mutex::Autolock _l(sLock);
@@ -77,6 +149,33 @@ void GraphicBufferAllocator::dump(String8& result) const
     }
     snprintf(buffer, SIZE, "Total allocated (estimate): %.2f KB\n", total/1024.0f);
     result.append(buffer);
+
+    result.appendFormat("Allocation stats: %" PRIu64 " allocs, %" PRIu64
+            " frees, %" PRIu64 " failures\n",
+            sStats.allocs, sStats.frees, sStats.failures);
+    const totals_t& totals(sStats.totals);
+    dumpTotals(result, "total", totals.count, totals.size, totals.peakCount,
+            totals.peakSize);
+    for (size_t i = 0; i < sFormatTotals.size(); i++) {
+        const totals_t& t(sFormatTotals.valueAt(i));
+        snprintf(buffer, SIZE, "format %#x", sFormatTotals.keyAt(i));
+        dumpTotals(result, buffer, t.count, t.size, t.peakCount, t.peakSize);
+    }
+    for (size_t i = 0; i < sUsageTotals.size(); i++) {
+        const totals_t& t(sUsageTotals.valueAt(i));
+        snprintf(buffer, SIZE, "usage 0x%08x", sUsageTotals.keyAt(i));
+        dumpTotals(result, buffer, t.count, t.size, t.peakCount, t.peakSize);
+    }
+    result.append("  alloc latency:");
+    for (size_t i = 0; i < NUM_LATENCY_BUCKETS - 1; i++) {
+        result.appendFormat(" <%" PRId64 "us:%" PRIu64, LATENCY_BUCKETS_US[i],
+                sStats.latencyHistogram[i]);
+    }
+    result.appendFormat(" >=%" PRId64 "us:%" PRIu64 " max=%.3fms\n",
+            LATENCY_BUCKETS_US[NUM_LATENCY_BUCKETS - 2],
+            sStats.latencyHistogram[NUM_LATENCY_BUCKETS - 1],
+            sStats.maxLatency / 1e6);
+
     if (mAllocDev->common.version >= 1 && mAllocDev->dump) {
         mAllocDev->dump(mAllocDev, buffer, SIZE);
         result.append(buffer);
@@ -107,27 +206,41 @@ status_t GraphicBufferAllocator::alloc(uint32_t width, uint32_t height,
     // Filter out any usage bits that should not be passed to the gralloc module
     usage &= GRALLOC_USAGE_ALLOC_MASK;
 
+    alloc_rec_t rec;
+    rec.width = width;
+    rec.height = height;
+    rec.format = format;
+    rec.usage = usage;
+
     int outStride = 0;
+    const nsecs_t start = systemTime();
     err = mAllocDev->alloc(mAllocDev, static_cast<int>(width),
             static_cast<int>(height), format, static_cast<int>(usage), handle,
             &outStride);
+    const nsecs_t latency = systemTime() - start;
     *stride = static_cast<uint32_t>(outStride);
 
     ALOGW_IF(err, "alloc(%u, %u, %d, %08x, ...) failed %d (%s)",
             width, height, format, usage, err, strerror(-err));
 
+    Mutex::Autolock _l(sLock);
+    size_t bucket = 0;
+    while (bucket < NUM_LATENCY_BUCKETS - 1 &&
+            latency >= us2ns(LATENCY_BUCKETS_US[bucket])) {
+        bucket++;
+    }
+    sStats.latencyHistogram[bucket]++;
+    if (latency > sStats.maxLatency) {
+        sStats.maxLatency = latency;
+    }
+
     if (err == NO_ERROR) {
-        Mutex::Autolock _l(sLock);
-        KeyedVector<buffer_handle_t, alloc_rec_t>& list(sAllocList);
         uint32_t bpp = bytesPerPixel(format);
-        alloc_rec_t rec;
-        rec.width = width;
-        rec.height = height;
         rec.stride = *stride;
-        rec.format = format;
-        rec.usage = usage;
         rec.size = static_cast<size_t>(height * (*stride) * bpp);
-        list.add(*handle, rec);
+        addAllocLocked(*handle, rec);
+    } else {
+        sStats.failures++;
     }
 
     return err;
@@ -143,8 +256,10 @@ status_t GraphicBufferAllocator::free(buffer_handle_t handle)
     ALOGW_IF(err, "free(...) failed %d (%s)", err, strerror(-err));
     if (err == NO_ERROR) {
         Mutex::Autolock _l(sLock);
-        KeyedVector<buffer_handle_t, alloc_rec_t>& list(sAllocList);
-        list.removeItem(handle);
+        const ssize_t index = sAllocList.indexOfKey(handle);
+        if (index >= 0) {
+            removeAllocLocked(static_cast<size_t>(index));
+        }
     }
 
     return err;
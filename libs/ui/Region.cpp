@@ -18,6 +18,9 @@
 
 #include <inttypes.h>
 #include <limits.h>
+#include <string.h>
+
+#include <algorithm>
 
 #include <utils/Log.h>
 #include <utils/String8.h>
@@ -57,8 +60,52 @@ const Region Region::INVALID_REGION(Rect::INVALID_RECT);
 
 // ----------------------------------------------------------------------------
 
-Region::Region() {
-    mStorage.add(Rect(0,0));
+// Empty regions are by far the most common ones, so they all start out with
+// the same storage, which saves an allocation for each of them
+static Vector<Rect> createEmptyStorage() {
+    Vector<Rect> storage;
+    storage.add(Rect(0,0));
+    return storage;
+}
+
+static const Vector<Rect>& getEmptyStorage() {
+    static const Vector<Rect> sEmptyStorage(createEmptyStorage());
+    return sEmptyStorage;
+}
+
+// Makes storage hold just rect, in place when it already holds a single rect
+// and isn't shared
+static void setSingleRect(Vector<Rect>& storage, const Rect& rect) {
+    if (storage.size() == 1) {
+        storage.editItemAt(0) = rect;
+    } else {
+        storage.clear();
+        storage.add(rect);
+    }
+}
+
+// Returns the first rect of the first span whose bottom is below y
+static Rect const* findSpanBelow(Rect const* begin, Rect const* end, int y) {
+    return std::upper_bound(begin, end, y,
+            [](int value, const Rect& rect) { return value < rect.bottom; });
+}
+
+// Returns the end of the span starting at rect
+static Rect const* findSpanEnd(Rect const* span, Rect const* end) {
+    return std::upper_bound(span, end, span->top,
+            [](int value, const Rect& rect) { return value < rect.top; });
+}
+
+// Returns the first rect of the span whose right is right of x
+static Rect const* findRectRightOf(Rect const* span, Rect const* spanEnd,
+        int x) {
+    return std::upper_bound(span, spanEnd, x,
+            [](int value, const Rect& rect) { return value < rect.right; });
+}
+
+Region::Region()
+    : mStorage(getEmptyStorage())
+{
 }
 
 Region::Region(const Region& rhs)
@@ -220,9 +267,7 @@ Region& Region::operator = (const Region& rhs)
 Region& Region::makeBoundsSelf()
 {
     if (mStorage.size() >= 2) {
-        const Rect bounds(getBounds());
-        mStorage.clear();
-        mStorage.add(bounds);
+        setSingleRect(mStorage, getBounds());
     }
     return *this;
 }
@@ -232,39 +277,65 @@ bool Region::contains(const Point& point) const {
 }
 
 bool Region::contains(int x, int y) const {
-    const_iterator cur = begin();
+    const Rect bounds(getBounds());
+    if (y < bounds.top || y >= bounds.bottom ||
+            x < bounds.left || x >= bounds.right) {
+        return false;
+    }
+    if (isRect()) {
+        return true;
+    }
+
     const_iterator const tail = end();
-    while (cur != tail) {
-        if (y >= cur->top && y < cur->bottom && x >= cur->left && x < cur->right) {
+    const_iterator const span = findSpanBelow(begin(), tail, y);
+    if (span == tail || y < span->top) {
+        return false;
+    }
+    const_iterator const spanEnd = findSpanEnd(span, tail);
+    const_iterator const cur = findRectRightOf(span, spanEnd, x);
+    return cur != spanEnd && x >= cur->left;
+}
+
+bool Region::intersects(const Rect& rect) const {
+    Rect overlap;
+    if (rect.isEmpty() || !getBounds().intersect(rect, &overlap)) {
+        return false;
+    }
+    if (isRect()) {
+        return true;
+    }
+
+    const_iterator const tail = end();
+    const_iterator span = findSpanBelow(begin(), tail, rect.top);
+    while (span != tail && span->top < rect.bottom) {
+        const_iterator const spanEnd = findSpanEnd(span, tail);
+        const_iterator const cur = findRectRightOf(span, spanEnd, rect.left);
+        if (cur != spanEnd && cur->left < rect.right) {
             return true;
         }
-        cur++;
+        span = spanEnd;
     }
     return false;
 }
 
 void Region::clear()
 {
-    mStorage.clear();
-    mStorage.add(Rect(0,0));
+    mStorage = getEmptyStorage();
 }
 
 void Region::set(const Rect& r)
 {
-    mStorage.clear();
-    mStorage.add(r);
+    setSingleRect(mStorage, r);
 }
 
 void Region::set(int32_t w, int32_t h)
 {
-    mStorage.clear();
-    mStorage.add(Rect(w, h));
+    setSingleRect(mStorage, Rect(w, h));
 }
 
 void Region::set(uint32_t w, uint32_t h)
 {
-    mStorage.clear();
-    mStorage.add(Rect(w, h));
+    setSingleRect(mStorage, Rect(w, h));
 }
 
 bool Region::isTriviallyEqual(const Region& region) const {
@@ -592,6 +663,26 @@ void Region::boolean_operation(int op, Region& dst,
     validate(dst, "boolean_operation (before): dst");
 #endif
 
+#if !VALIDATE_WITH_CORECG && !VALIDATE_REGIONS
+    if (rhs.isRect()) {
+        boolean_operation(op, dst, lhs, rhs.getBounds(), dx, dy);
+        return;
+    }
+    if (op == op_and || op == op_nand) {
+        Rect rhsBounds(rhs.getBounds());
+        rhsBounds.offsetBy(dx, dy);
+        Rect overlap;
+        if (!lhs.getBounds().intersect(rhsBounds, &overlap)) {
+            if (op == op_nand && !lhs.isEmpty()) {
+                dst = lhs;
+            } else {
+                dst.clear();
+            }
+            return;
+        }
+    }
+#endif
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
@@ -707,6 +798,12 @@ void Region::boolean_operation(int op, Region& dst,
 #if VALIDATE_WITH_CORECG || VALIDATE_REGIONS
     boolean_operation(op, dst, lhs, Region(rhs), dx, dy);
 #else
+    Rect offsetRhs(rhs);
+    offsetRhs.offsetBy(dx, dy);
+    if (trivial_operation(op, dst, lhs, offsetRhs)) {
+        return;
+    }
+
     size_t lhs_count;
     Rect const * const lhs_rects = lhs.getArray(&lhs_count);
 
@@ -721,6 +818,64 @@ void Region::boolean_operation(int op, Region& dst,
 #endif
 }
 
+/**
+ * Handles the operations with a rect whose result follows from the bounds of
+ * lhs alone, without rasterizing: when either operand is empty, when they
+ * don't overlap, when rhs covers all of lhs, and intersections and unions with
+ * a region that is a single rect, if the result is one too.
+ *
+ * Returns false if the operation must be rasterized.
+ */
+bool Region::trivial_operation(int op, Region& dst,
+        const Region& lhs, const Rect& rhs)
+{
+    if (lhs.isEmpty()) {
+        if ((op == op_or || op == op_xor) && !rhs.isEmpty()) {
+            dst.set(rhs);
+        } else {
+            dst.clear();
+        }
+        return true;
+    }
+
+    const Rect bounds(lhs.getBounds());
+    Rect overlap;
+    if (rhs.isEmpty() || !bounds.intersect(rhs, &overlap)) {
+        if (op == op_and) {
+            dst.clear();
+            return true;
+        }
+        if (op == op_nand || rhs.isEmpty()) {
+            dst = lhs;
+            return true;
+        }
+        return false;
+    }
+
+    if (overlap == bounds) {
+        // rhs covers all of lhs
+        switch (op) {
+            case op_and: dst = lhs; return true;
+            case op_or: dst.set(rhs); return true;
+            case op_nand: dst.clear(); return true;
+            default: return false;
+        }
+    }
+
+    if (lhs.isRect()) {
+        if (op == op_and) {
+            dst.set(overlap);
+            return true;
+        }
+        if (op == op_or && overlap == rhs) {
+            // lhs covers all of rhs
+            dst = lhs;
+            return true;
+        }
+    }
+    return false;
+}
+
 void Region::boolean_operation(int op, Region& dst,
         const Region& lhs, const Region& rhs)
 {
@@ -758,6 +913,64 @@ void Region::translate(Region& dst, const Region& reg, int dx, int dy)
     translate(dst, dx, dy);
 }
 
+Rect Region::flip(const Rect& r, bool flipH, bool flipV, int dx, int dy)
+{
+    return Rect(flipH ? dx - r.right : r.left + dx,
+            flipV ? dy - r.bottom : r.top + dy,
+            flipH ? dx - r.left : r.right + dx,
+            flipV ? dy - r.top : r.bottom + dy);
+}
+
+const Region Region::flip(bool flipH, bool flipV, int dx, int dy) const
+{
+    if (!flipH && !flipV) {
+        return translate(dx, dy);
+    }
+    Region result;
+    if (isEmpty()) {
+        return result;
+    }
+
+    // Mirroring keeps the spans, so the result is made by copying them in
+    // reverse order if flipped vertically, with the rects of each of them
+    // in reverse order if flipped horizontally
+    const Rect* const rects = mStorage.array();
+    const size_t count = isRect() ? 1 : mStorage.size() - 1;
+    Vector<Rect>& storage(result.mStorage);
+    storage.clear();
+    storage.setCapacity(mStorage.size());
+    size_t next = flipV ? count : 0;
+    while (flipV ? next > 0 : next < count) {
+        size_t begin, end;
+        if (flipV) {
+            end = next;
+            begin = end - 1;
+            while (begin > 0 && rects[begin - 1].top == rects[end - 1].top) {
+                begin--;
+            }
+            next = begin;
+        } else {
+            begin = next;
+            end = begin + 1;
+            while (end < count && rects[end].top == rects[begin].top) {
+                end++;
+            }
+            next = end;
+        }
+        for (size_t i = 0; i < end - begin; i++) {
+            storage.add(flip(rects[flipH ? end - 1 - i : begin + i],
+                    flipH, flipV, dx, dy));
+        }
+    }
+    if (!isRect()) {
+        storage.add(flip(getBounds(), flipH, flipV, dx, dy));
+    }
+#if VALIDATE_REGIONS
+    validate(result, "flip");
+#endif
+    return result;
+}
+
 // ----------------------------------------------------------------------------
 
 size_t Region::getFlattenedSize() const {
@@ -774,13 +987,10 @@ status_t Region::flatten(void* buffer, size_t size) const {
     // Cast to uint32_t since the size of a size_t can vary between 32- and
     // 64-bit processes
     FlattenableUtils::write(buffer, size, static_cast<uint32_t>(mStorage.size()));
-    for (auto rect : mStorage) {
-        status_t result = rect.flatten(buffer, size);
-        if (result != NO_ERROR) {
-            return result;
-        }
-        FlattenableUtils::advance(buffer, size, sizeof(rect));
-    }
+    // Rects are PODs, so the whole storage is written at once
+    const size_t rectsSize = mStorage.size() * sizeof(Rect);
+    memcpy(buffer, mStorage.array(), rectsSize);
+    FlattenableUtils::advance(buffer, size, rectsSize);
     return NO_ERROR;
 }
 
@@ -791,21 +1001,20 @@ status_t Region::unflatten(void const* buffer, size_t size) {
 
     uint32_t numRects = 0;
     FlattenableUtils::read(buffer, size, numRects);
-    if (size < numRects * sizeof(Rect)) {
+    if (numRects == 0) {
+        ALOGE("Region::unflatten() failed, no rects");
+        return BAD_VALUE;
+    }
+    if (numRects > size / sizeof(Rect)) {
         return NO_MEMORY;
     }
 
+    // The rects are read straight from the buffer (which Parcel passes in
+    // place), into storage allocated once for all of them
     Region result;
     result.mStorage.clear();
-    for (size_t r = 0; r < numRects; ++r) {
-        Rect rect;
-        status_t status = rect.unflatten(buffer, size);
-        if (status != NO_ERROR) {
-            return status;
-        }
-        FlattenableUtils::advance(buffer, size, sizeof(rect));
-        result.mStorage.push_back(rect);
-    }
+    result.mStorage.setCapacity(numRects);
+    result.mStorage.appendArray(static_cast<Rect const*>(buffer), numRects);
 
 #if VALIDATE_REGIONS
     validate(result, "Region::unflatten");
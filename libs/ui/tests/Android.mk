@@ -34,3 +34,17 @@ LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
 LOCAL_SRC_FILES := mat_test.cpp
 LOCAL_MODULE := mat_test
 include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+LOCAL_SHARED_LIBRARIES := libui libutils
+LOCAL_SRC_FILES := RegionBenchmark.cpp
+LOCAL_MODULE := RegionBenchmark
+include $(BUILD_NATIVE_TEST)
+
+include $(CLEAR_VARS)
+LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
+LOCAL_SHARED_LIBRARIES := libutils
+LOCAL_SRC_FILES := MatBenchmark.cpp
+LOCAL_MODULE := MatBenchmark
+include $(BUILD_NATIVE_TEST)
@@ -0,0 +1,137 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * mat4 benchmarks: the operations SurfaceFlinger, the Daltonizer and the
+ * sensor fusion run on 4x4 float matrices. Each sample times a batch of
+ * BATCH_SIZE operations, since a single one is too short for the clock.
+ *
+ * usage: MatBenchmark [-i iterations]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <ui/mat4.h>
+
+#include <utils/Timers.h>
+
+using namespace android;
+
+static const size_t BATCH_SIZE = 1000;
+
+// ---------------------------------------------------------------------------
+
+struct Results {
+    std::vector<nsecs_t> samples;
+
+    void add(nsecs_t t) { samples.push_back(t); }
+
+    double percentile(size_t p) const {
+        if (samples.empty()) return 0;
+        return samples[std::min(samples.size() - 1, samples.size() * p / 100)]
+                / static_cast<double>(BATCH_SIZE);
+    }
+
+    void print(const char* name) {
+        std::sort(samples.begin(), samples.end());
+        nsecs_t total = 0;
+        for (size_t i = 0; i < samples.size(); i++) {
+            total += samples[i];
+        }
+        printf("%-36s n=%-7zu avg=%8.2fns p50=%8.2fns p90=%8.2fns "
+                "p99=%8.2fns\n",
+                name, samples.size(),
+                samples.empty() ? 0.0 :
+                        total / static_cast<double>(BATCH_SIZE) / samples.size(),
+                percentile(50), percentile(90), percentile(99));
+        fflush(stdout);
+    }
+};
+
+// A well conditioned matrix, different for each i
+static mat4 makeMatrix(size_t i) {
+    const float f = static_cast<float>(i % 64) / 64.0f;
+    return mat4(vec4(2.0f + f, 0.5f, 0.0f, 0.1f),
+                vec4(0.25f, 1.5f, f, 0.0f),
+                vec4(0.0f, 0.3f, 1.0f + f, 0.2f),
+                vec4(10.0f * f, 20.0f, 0.0f, 1.0f));
+}
+
+// Keeps the results alive
+static volatile float sSink;
+
+// ---------------------------------------------------------------------------
+
+// Each operation takes the result of the previous one, so that none of them
+// can be hoisted out of the loop; they're all chosen so that the values
+// stay bounded.
+template <typename OP>
+static void bench(size_t iterations, const char* name, OP op) {
+    Results results;
+    for (size_t i = 0; i < iterations; i++) {
+        mat4 m(makeMatrix(i));
+        const nsecs_t start = systemTime();
+        for (size_t j = 0; j < BATCH_SIZE; j++) {
+            op(m);
+        }
+        results.add(systemTime() - start);
+        sSink = m[0][0];
+    }
+    results.print(name);
+}
+
+int main(int argc, char** argv)
+{
+    size_t iterations = 1000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:")) != -1) {
+        switch (opt) {
+            case 'i':
+                iterations = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-i iterations]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    printf("MatBenchmark: %zu iterations of %zu operations\n",
+            iterations, BATCH_SIZE);
+    const mat4 rotation(mat4::rotate(0.1f, vec3(0, 0, 1)));
+    bench(iterations, "mat4 * mat4", [&](mat4& m) {
+        m = m * rotation;
+    });
+    bench(iterations, "mat4 * vec4", [&](mat4& m) {
+        m[0] = rotation * m[0];
+    });
+    bench(iterations, "transpose", [](mat4& m) {
+        m = transpose(m);
+    });
+    bench(iterations, "inverse", [](mat4& m) {
+        m = inverse(m);
+    });
+    bench(iterations, "inverse (Gauss-Jordan)", [](mat4& m) {
+        m = matrix::gaussJordanInverse(m);
+    });
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,402 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Region benchmarks: the boolean operations SurfaceFlinger runs on every
+ * frame, on layer stacks shaped like common screens, plus the hit tests the
+ * input dispatcher runs on touchable regions.
+ *
+ * With -f, replays instead a recording of SurfaceFlinger's
+ * computeVisibleRegions, as fetched from a device with:
+ *   adb shell dumpsys SurfaceFlinger --regions -start
+ *   adb shell dumpsys SurfaceFlinger --regions -binary > regions.bin
+ *
+ * usage: RegionBenchmark [-i iterations] [-f recording]
+ */
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <ui/Rect.h>
+#include <ui/Region.h>
+
+#include <utils/Errors.h>
+#include <utils/Timers.h>
+
+using namespace android;
+
+static const int WIDTH = 1080;
+static const int HEIGHT = 1920;
+
+// ---------------------------------------------------------------------------
+
+struct Results {
+    std::vector<nsecs_t> samples;
+
+    void add(nsecs_t t) { samples.push_back(t); }
+
+    nsecs_t percentile(size_t p) const {
+        if (samples.empty()) return 0;
+        return samples[std::min(samples.size() - 1, samples.size() * p / 100)];
+    }
+
+    void print(const char* name) {
+        std::sort(samples.begin(), samples.end());
+        nsecs_t total = 0;
+        for (size_t i = 0; i < samples.size(); i++) {
+            total += samples[i];
+        }
+        printf("%-36s n=%-7zu avg=%8.2fus p50=%8.2fus p90=%8.2fus "
+                "p99=%8.2fus\n",
+                name, samples.size(),
+                samples.empty() ? 0.0 : total / 1000.0 / samples.size(),
+                percentile(50) / 1000.0, percentile(90) / 1000.0,
+                percentile(99) / 1000.0);
+        fflush(stdout);
+    }
+};
+
+struct TestLayer {
+    Rect bounds;
+    bool opaque;
+};
+
+// An app with the status and navigation bars over a wallpaper
+static const TestLayer APP_LAYERS[] = {
+    { Rect(0, 0, WIDTH, HEIGHT), true },            // wallpaper
+    { Rect(0, 0, WIDTH, HEIGHT), true },            // app
+    { Rect(0, 0, WIDTH, 72), false },               // status bar
+    { Rect(0, HEIGHT - 144, WIDTH, HEIGHT), false },// navigation bar
+};
+
+// The launcher over the wallpaper, with a dialog and a toast on top
+static const TestLayer DIALOG_LAYERS[] = {
+    { Rect(0, 0, WIDTH, HEIGHT), true },            // wallpaper
+    { Rect(0, 72, WIDTH, HEIGHT - 144), false },    // launcher
+    { Rect(0, 0, WIDTH, HEIGHT), false },           // dim layer
+    { Rect(90, 600, WIDTH - 90, 1300), true },      // dialog
+    { Rect(340, 1500, WIDTH - 340, 1620), false },  // toast
+    { Rect(0, 0, WIDTH, 72), false },               // status bar
+    { Rect(0, HEIGHT - 144, WIDTH, HEIGHT), false },// navigation bar
+};
+
+// Mirrors what SurfaceFlinger::computeVisibleRegions does with each layer,
+// from the top of the stack down
+static void computeVisibleRegions(const TestLayer* layers, size_t count,
+        Region& outDirty) {
+    Region aboveOpaqueLayers;
+    Region aboveCoveredLayers;
+    outDirty.clear();
+    for (size_t i = count; i-- > 0; ) {
+        const Region bounds(layers[i].bounds);
+        const Region visibleRegion(bounds.subtract(aboveOpaqueLayers));
+        const Region coveredRegion(aboveCoveredLayers.intersect(bounds));
+        aboveCoveredLayers.orSelf(bounds);
+        if (layers[i].opaque) {
+            aboveOpaqueLayers.orSelf(bounds);
+        }
+        outDirty.orSelf(visibleRegion.merge(coveredRegion));
+    }
+}
+
+static void benchVisibleRegions(size_t iterations, const char* name,
+        const TestLayer* layers, size_t count) {
+    Results results;
+    Region dirty;
+    for (size_t i = 0; i < iterations; i++) {
+        const nsecs_t start = systemTime();
+        computeVisibleRegions(layers, count, dirty);
+        results.add(systemTime() - start);
+    }
+    results.print(name);
+}
+
+// A screen's worth of small dirty rects, like those of a list scrolling
+// under a blinking cursor
+static void benchDirtyRegion(size_t iterations) {
+    Results results;
+    srandom(12345);
+    for (size_t i = 0; i < iterations; i++) {
+        Region dirty;
+        const nsecs_t start = systemTime();
+        for (int j = 0; j < 32; j++) {
+            const int left = static_cast<int>(random() % (WIDTH - 64));
+            const int top = static_cast<int>(random() % (HEIGHT - 64));
+            dirty.orSelf(Rect(left, top, left + 64, top + 64));
+        }
+        dirty.andSelf(Rect(0, 72, WIDTH, HEIGHT - 144));
+        results.add(systemTime() - start);
+    }
+    results.print("dirty region (32 rects)");
+}
+
+// Hit tests on a touchable region with a hole, like a window with a
+// transparent cutout
+static void benchHitTest(size_t iterations) {
+    Region touchable(Rect(0, 0, WIDTH, HEIGHT));
+    for (int y = 200; y < HEIGHT - 200; y += 200) {
+        touchable.subtractSelf(Rect(100, y, WIDTH - 100, y + 100));
+    }
+
+    Results contains;
+    Results intersects;
+    srandom(12345);
+    for (size_t i = 0; i < iterations; i++) {
+        const int x = static_cast<int>(random() % WIDTH);
+        const int y = static_cast<int>(random() % HEIGHT);
+        nsecs_t start = systemTime();
+        for (int j = 0; j < 100; j++) {
+            touchable.contains(x, y + j);
+        }
+        contains.add(systemTime() - start);
+        start = systemTime();
+        for (int j = 0; j < 100; j++) {
+            touchable.intersects(Rect(x, y + j, x + 8, y + j + 8));
+        }
+        intersects.add(systemTime() - start);
+    }
+    contains.print("contains (x100)");
+    intersects.print("intersects (x100)");
+}
+
+// ---------------------------------------------------------------------------
+
+// A layer of a recorded computeVisibleRegions call, in the format described
+// in services/surfaceflinger/RegionRecorder.cpp
+struct RecordedLayer {
+    enum {
+        RECORD_CACHED = 0x1,
+        RECORD_OPAQUE = 0x2,
+        RECORD_CONTENT_DIRTY = 0x4,
+    };
+
+    uint32_t flags;
+    Rect bounds;
+    // set from the cache, if RECORD_CACHED is set
+    Region aboveOpaqueLayers;
+    Region aboveCoveredLayers;
+    Region transparentRegion;
+    Region oldVisibleRegion;
+    Region oldCoveredRegion;
+};
+
+typedef std::vector<RecordedLayer> RecordedCall;
+
+class RecordingReader {
+public:
+    RecordingReader(const std::vector<char>& data) :
+        mData(data), mOffset(0) {}
+
+    bool isDone() const { return mOffset == mData.size(); }
+
+    template <typename T>
+    bool read(T* value) {
+        if (mData.size() - mOffset < sizeof(T)) {
+            return false;
+        }
+        memcpy(value, mData.data() + mOffset, sizeof(T));
+        mOffset += sizeof(T);
+        return true;
+    }
+
+    bool read(Region* region) {
+        uint32_t size = 0;
+        if (!read(&size) || mData.size() - mOffset < size ||
+                region->unflatten(mData.data() + mOffset, size) != NO_ERROR) {
+            return false;
+        }
+        mOffset += size;
+        return true;
+    }
+
+    bool read(RecordedLayer* layer) {
+        if (!read(&layer->flags)) {
+            return false;
+        }
+        if (layer->flags & RecordedLayer::RECORD_CACHED) {
+            return read(&layer->aboveOpaqueLayers) &&
+                    read(&layer->aboveCoveredLayers);
+        }
+        int32_t left, top, right, bottom;
+        if (!read(&left) || !read(&top) || !read(&right) || !read(&bottom)) {
+            return false;
+        }
+        layer->bounds = Rect(left, top, right, bottom);
+        return read(&layer->transparentRegion) &&
+                read(&layer->oldVisibleRegion) &&
+                read(&layer->oldCoveredRegion);
+    }
+
+private:
+    const std::vector<char>& mData;
+    size_t mOffset;
+};
+
+static bool readRecording(const char* path,
+        std::vector<RecordedCall>* outCalls) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        fprintf(stderr, "can't open %s: %s\n", path, strerror(errno));
+        return false;
+    }
+    std::vector<char> data;
+    char buffer[4096];
+    size_t count;
+    while ((count = fread(buffer, 1, sizeof(buffer), file)) > 0) {
+        data.insert(data.end(), buffer, buffer + count);
+    }
+    fclose(file);
+
+    RecordingReader reader(data);
+    uint32_t magic = 0;
+    uint32_t version = 0;
+    if (!reader.read(&magic) || magic != 'rgns' ||
+            !reader.read(&version) || version != 1) {
+        fprintf(stderr, "%s isn't a region recording\n", path);
+        return false;
+    }
+    while (!reader.isDone()) {
+        uint32_t layerStack = 0;
+        uint32_t numLayers = 0;
+        if (!reader.read(&layerStack) || !reader.read(&numLayers)) {
+            fprintf(stderr, "%s is truncated\n", path);
+            return false;
+        }
+        RecordedCall call(numLayers);
+        for (size_t i = 0; i < call.size(); i++) {
+            if (!reader.read(&call[i])) {
+                fprintf(stderr, "%s is truncated\n", path);
+                return false;
+            }
+        }
+        outCalls->push_back(call);
+    }
+    return true;
+}
+
+// Runs the same Region operations as the recorded computeVisibleRegions call
+static void replayCall(const RecordedCall& call, Region& outDirty) {
+    Region aboveOpaqueLayers;
+    Region aboveCoveredLayers;
+    Region dirty;
+    outDirty.clear();
+    for (size_t i = 0; i < call.size(); i++) {
+        const RecordedLayer& layer(call[i]);
+        if (layer.flags & RecordedLayer::RECORD_CACHED) {
+            aboveOpaqueLayers = layer.aboveOpaqueLayers;
+            aboveCoveredLayers = layer.aboveCoveredLayers;
+            continue;
+        }
+
+        Region visibleRegion(layer.bounds);
+        Region opaqueRegion;
+        if (layer.flags & RecordedLayer::RECORD_OPAQUE) {
+            opaqueRegion = visibleRegion;
+        }
+        const Region coveredRegion(aboveCoveredLayers.intersect(visibleRegion));
+        aboveCoveredLayers.orSelf(visibleRegion);
+        visibleRegion.subtractSelf(aboveOpaqueLayers);
+        if (layer.flags & RecordedLayer::RECORD_CONTENT_DIRTY) {
+            dirty = visibleRegion;
+            dirty.orSelf(layer.oldVisibleRegion);
+        } else {
+            const Region newExposed = visibleRegion - coveredRegion;
+            const Region oldExposed =
+                    layer.oldVisibleRegion - layer.oldCoveredRegion;
+            dirty = (visibleRegion & layer.oldCoveredRegion) |
+                    (newExposed - oldExposed);
+        }
+        dirty.subtractSelf(aboveOpaqueLayers);
+        outDirty.orSelf(dirty);
+        aboveOpaqueLayers.orSelf(opaqueRegion);
+        visibleRegion.subtract(layer.transparentRegion);
+    }
+}
+
+static bool benchReplay(size_t iterations, const char* path) {
+    std::vector<RecordedCall> calls;
+    if (!readRecording(path, &calls)) {
+        return false;
+    }
+    if (calls.empty()) {
+        fprintf(stderr, "%s has no calls\n", path);
+        return false;
+    }
+
+    size_t numLayers = 0;
+    for (size_t i = 0; i < calls.size(); i++) {
+        numLayers += calls[i].size();
+    }
+    printf("RegionBenchmark: %zu iterations of %zu recorded calls "
+            "(%zu layers)\n", iterations, calls.size(), numLayers);
+
+    Results results;
+    Region dirty;
+    for (size_t i = 0; i < iterations; i++) {
+        const nsecs_t start = systemTime();
+        for (size_t j = 0; j < calls.size(); j++) {
+            replayCall(calls[j], dirty);
+        }
+        results.add(systemTime() - start);
+    }
+    results.print("replay (all calls)");
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+
+int main(int argc, char** argv)
+{
+    size_t iterations = 10000;
+    const char* recording = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:f:")) != -1) {
+        switch (opt) {
+            case 'i':
+                iterations = strtoul(optarg, NULL, 0);
+                break;
+            case 'f':
+                recording = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-i iterations] [-f recording]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    if (recording != NULL) {
+        return benchReplay(iterations, recording) ?
+                EXIT_SUCCESS : EXIT_FAILURE;
+    }
+
+    printf("RegionBenchmark: %zu iterations, %dx%d screen\n",
+            iterations, WIDTH, HEIGHT);
+    benchVisibleRegions(iterations, "visible regions (app)", APP_LAYERS,
+            sizeof(APP_LAYERS) / sizeof(APP_LAYERS[0]));
+    benchVisibleRegions(iterations, "visible regions (dialog)",
+            DIALOG_LAYERS, sizeof(DIALOG_LAYERS) / sizeof(DIALOG_LAYERS[0]));
+    benchDirtyRegion(iterations);
+    benchHitTest(iterations);
+    return EXIT_SUCCESS;
+}
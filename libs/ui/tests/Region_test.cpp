@@ -152,5 +152,110 @@ TEST_F(RegionTest, Random_TJunction) {
     }
 }
 
+TEST_F(RegionTest, Random_ContainsAndIntersects) {
+    Region r;
+    srandom(12345);
+
+    for (int iter = 0; iter < ITER_MAX; iter++) {
+        bool grid[Y_MAX][X_MAX];
+        r.clear();
+        for (int i = 0; i < X_MAX; i++) {
+            for (int j = 0; j < Y_MAX; j++) {
+                grid[j][i] = random() % 2;
+                if (grid[j][i]) {
+                    r.orSelf(Rect(i, j, i + 1, j + 1));
+                }
+            }
+        }
+
+        for (int x = -1; x <= X_MAX; x++) {
+            for (int y = -1; y <= Y_MAX; y++) {
+                const bool inside = x >= 0 && x < X_MAX && y >= 0 &&
+                        y < Y_MAX && grid[y][x];
+                EXPECT_EQ(inside, r.contains(x, y));
+            }
+        }
+
+        const Rect rect(random() % X_MAX, random() % Y_MAX,
+                X_MAX + 1 - random() % 4, Y_MAX + 1 - random() % 4);
+        EXPECT_EQ(!r.intersect(rect).isEmpty(), r.intersects(rect));
+    }
+}
+
+TEST_F(RegionTest, TrivialOperations) {
+    const Rect a(0, 0, 10, 10);
+    const Rect b(20, 20, 30, 30);
+    const Rect inner(2, 2, 8, 8);
+
+    EXPECT_TRUE(Region(a).intersect(b).isEmpty());
+    EXPECT_TRUE((Region(a).subtract(b) ^ Region(a)).isEmpty());
+    EXPECT_TRUE(Region(a).subtract(Rect(-1, -1, 11, 11)).isEmpty());
+    EXPECT_TRUE((Region(a).merge(inner) ^ Region(a)).isEmpty());
+    EXPECT_TRUE(Region(a).intersect(Rect(5, 5, 15, 15)).isRect());
+    EXPECT_EQ(Rect(5, 5, 10, 10),
+            Region(a).intersect(Rect(5, 5, 15, 15)).getBounds());
+    EXPECT_EQ(b, Region().merge(b).getBounds());
+
+    // The same operations on regions that aren't a single rect
+    Region r(a);
+    r.orSelf(b);
+    EXPECT_TRUE((r.intersect(Rect(-5, -5, 40, 40)) ^ r).isEmpty());
+    EXPECT_TRUE((r.subtract(Rect(40, 40, 50, 50)) ^ r).isEmpty());
+    EXPECT_TRUE(r.subtract(Rect(-5, -5, 40, 40)).isEmpty());
+    EXPECT_TRUE((r.intersect(Region(inner)) ^ Region(inner)).isEmpty());
+    EXPECT_FALSE(r.subtract(inner).contains(5, 5));
+    EXPECT_TRUE(r.subtract(inner).contains(1, 1));
+    EXPECT_TRUE(r.subtract(inner).contains(25, 25));
+}
+
+TEST_F(RegionTest, FlattenRoundTrip) {
+    Region r;
+    r.orSelf(Rect(0, 0, 10, 10));
+    r.orSelf(Rect(5, 5, 20, 20));
+    r.subtractSelf(Rect(2, 2, 4, 4));
+
+    const size_t size = r.getFlattenedSize();
+    uint8_t* buffer = new uint8_t[size];
+    ASSERT_EQ(NO_ERROR, r.flatten(buffer, size));
+
+    Region result;
+    ASSERT_EQ(NO_ERROR, result.unflatten(buffer, size));
+    EXPECT_TRUE((r ^ result).isEmpty());
+    EXPECT_EQ(r.end() - r.begin(), result.end() - result.begin());
+
+    // Too short for the rects it claims to have
+    EXPECT_EQ(NO_MEMORY, result.unflatten(buffer, size - 1));
+
+    // No rects at all, which isn't a valid region
+    const uint32_t numRects = 0;
+    EXPECT_EQ(BAD_VALUE, result.unflatten(&numRects, sizeof(numRects)));
+    delete[] buffer;
+}
+
+TEST_F(RegionTest, Flip) {
+    Region r;
+    r.orSelf(Rect(0, 0, 10, 10));
+    r.orSelf(Rect(5, 5, 20, 20));
+    r.subtractSelf(Rect(2, 2, 4, 4));
+
+    // Build the expected results rect by rect
+    for (int flips = 0; flips < 4; flips++) {
+        const bool flipH = flips & 1;
+        const bool flipV = flips & 2;
+        Region expected;
+        for (Region::const_iterator it = r.begin(); it != r.end(); ++it) {
+            expected.orSelf(Rect(flipH ? 100 - it->right : it->left + 100,
+                    flipV ? 50 - it->bottom : it->top + 50,
+                    flipH ? 100 - it->left : it->right + 100,
+                    flipV ? 50 - it->top : it->bottom + 50));
+        }
+        const Region result(r.flip(flipH, flipV, 100, 50));
+        EXPECT_TRUE((expected ^ result).isEmpty());
+        EXPECT_EQ(expected.bounds(), result.bounds());
+        EXPECT_EQ(expected.end() - expected.begin(),
+                result.end() - result.begin());
+    }
+}
+
 }; // namespace android
 
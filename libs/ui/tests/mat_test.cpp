@@ -136,4 +136,28 @@ TEST_F(MatTest, MiscOps) {
     EXPECT_EQ(m1, m1*identity);
 }
 
+TEST_F(MatTest, Inverse) {
+    // the closed form 4x4 inverse must agree with Gauss-Jordan elimination
+    srand(42);
+    for (size_t n=0 ; n<1000 ; n++) {
+        mat4 m;
+        for (size_t i=0 ; i<4 ; i++) {
+            for (size_t j=0 ; j<4 ; j++) {
+                m[i][j] = (rand() % 2001 - 1000) / 100.0f;
+            }
+            // keeps m diagonally dominant, hence well conditioned
+            m[i][i] += m[i][i] < 0 ? -40.0f : 40.0f;
+        }
+        const mat4 mi(inverse(m));
+        const mat4 expected(matrix::gaussJordanInverse(m));
+        const mat4 product(m * mi);
+        for (size_t i=0 ; i<4 ; i++) {
+            for (size_t j=0 ; j<4 ; j++) {
+                EXPECT_NEAR(expected[i][j], mi[i][j], 1e-5f);
+                EXPECT_NEAR(i == j ? 1.0f : 0.0f, product[i][j], 1e-5f);
+            }
+        }
+    }
+}
+
 }; // namespace android
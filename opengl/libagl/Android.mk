@@ -19,7 +19,9 @@ LOCAL_SRC_FILES:= \
 	light.cpp.arm		        \
 	matrix.cpp.arm		        \
 	mipmap.cpp.arm		        \
+	perf.cpp		        \
 	primitives.cpp.arm	        \
+	tiler.cpp.arm		        \
 	vertex.cpp.arm
 
 LOCAL_CFLAGS += -DLOG_TAG=\"libagl\"
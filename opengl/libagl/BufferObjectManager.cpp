@@ -16,6 +16,8 @@
 
 #include <stdint.h>
 #include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
 #include <sys/types.h>
 
 #include <utils/Atomic.h>
@@ -37,6 +39,7 @@ using namespace gl;
 EGLBufferObjectManager::EGLBufferObjectManager() 
 : TokenManager(), mCount(0)
 {
+    memset((void*)mTable, 0, sizeof(mTable));
 }
 
 EGLBufferObjectManager::~EGLBufferObjectManager()
@@ -48,21 +51,63 @@ EGLBufferObjectManager::~EGLBufferObjectManager()
         free(bo->data);
         delete bo;
     }
+    for (GLsizei i=0 ; i<TABLE_PAGE_COUNT ; i++) {
+        free((void*)mTable[i]);
+    }
+}
+
+buffer_t* EGLBufferObjectManager::lookup(GLuint buffer) const
+{
+    const GLuint page = buffer >> TABLE_PAGE_BITS;
+    if (page >= GLuint(TABLE_PAGE_COUNT))
+        return 0;
+    // the page and the buffer are published after they're initialized,
+    // and loading through the pointers is ordered after loading them.
+    table_page_t* p = mTable[page];
+    if (!p)
+        return 0;
+    return (*p)[buffer & (TABLE_PAGE_SIZE-1)];
+}
+
+void EGLBufferObjectManager::publish(GLuint buffer, buffer_t* bo)
+{
+    const GLuint page = buffer >> TABLE_PAGE_BITS;
+    if (page >= GLuint(TABLE_PAGE_COUNT))
+        return;
+    table_page_t* p = mTable[page];
+    if (!p) {
+        if (!bo)
+            return;
+        p = (table_page_t*)calloc(1, sizeof(table_page_t));
+        if (!p)
+            return; // bind() will take the slow path for this name
+        android_memory_barrier();
+        mTable[page] = p;
+    }
+    android_memory_barrier();
+    (*p)[buffer & (TABLE_PAGE_SIZE-1)] = bo;
 }
 
 buffer_t const* EGLBufferObjectManager::bind(GLuint buffer)
 {
+    buffer_t* bo = lookup(buffer);
+    if (bo) {
+        return bo;
+    }
+
     Mutex::Autolock _l(mLock);
     int32_t i = mBuffers.indexOfKey(buffer);
     if (i >= 0) {
         return mBuffers.valueAt(i);
     }
-    buffer_t* bo = new buffer_t;
+    bo = new buffer_t;
     bo->data = 0;
     bo->usage = GL_STATIC_DRAW;
     bo->size = 0;
     bo->name = buffer;
+    bo->minIndexCount = 0;
     mBuffers.add(buffer, bo);
+    publish(buffer, bo);
     return bo;
 }
 
@@ -79,9 +124,43 @@ int EGLBufferObjectManager::allocateStore(buffer_t* bo,
         bo->size = size;
     }
     bo->usage = usage;
+    bo->minIndexCount = 0;
     return 0;
 }
 
+uint32_t EGLBufferObjectManager::getMinIndex(buffer_t* bo, GLintptr offset,
+        GLsizei count, GLenum type)
+{
+    if (bo->minIndexCount == count && bo->minIndexOffset == offset &&
+            bo->minIndexType == type) {
+        return bo->minIndex;
+    }
+    const size_t size = (type == GL_UNSIGNED_BYTE) ? 1 : 2;
+    if (offset < 0 || count <= 0 || !bo->data ||
+            size_t(offset) + size_t(count) * size > size_t(bo->size)) {
+        return 0;
+    }
+    uint32_t minIndex = 0xFFFF;
+    if (type == GL_UNSIGNED_BYTE) {
+        const uint8_t* indices = bo->data + offset;
+        for (GLsizei i=0 ; i<count ; i++) {
+            if (indices[i] < minIndex)
+                minIndex = indices[i];
+        }
+    } else {
+        const GLushort* indices = (const GLushort*)(bo->data + offset);
+        for (GLsizei i=0 ; i<count ; i++) {
+            if (indices[i] < minIndex)
+                minIndex = indices[i];
+        }
+    }
+    bo->minIndexOffset = offset;
+    bo->minIndexCount = count;
+    bo->minIndexType = type;
+    bo->minIndex = minIndex;
+    return minIndex;
+}
+
 void EGLBufferObjectManager::deleteBuffers(GLsizei n, const GLuint* buffers)
 {
     Mutex::Autolock _l(mLock);
@@ -91,6 +170,7 @@ void EGLBufferObjectManager::deleteBuffers(GLsizei n, const GLuint* buffers)
             int32_t index = mBuffers.indexOfKey(t);
             if (index >= 0) {
                 buffer_t* bo = mBuffers.valueAt(index);
+                publish(t, 0);
                 free(bo->data);
                 mBuffers.removeItemsAt(index);
                 delete bo;
@@ -44,6 +44,12 @@ struct buffer_t {
     GLenum          usage;
     uint8_t*        data;
     uint32_t        name;
+    // the smallest index of the indices last drawn from the buffer, which
+    // stays valid until its data change
+    GLintptr        minIndexOffset;
+    GLsizei         minIndexCount;
+    GLenum          minIndexType;
+    uint32_t        minIndex;
 };
 
 };
@@ -63,10 +69,31 @@ public:
     int                 allocateStore(gl::buffer_t* bo, GLsizeiptr size, GLenum usage);
     void                deleteBuffers(GLsizei n, const GLuint* buffers);
 
+    // getMinIndex returns the smallest of the count indices of the given
+    // type at offset in the buffer, which is computed once for all the
+    // draw calls of the same indices.
+    uint32_t            getMinIndex(gl::buffer_t* bo, GLintptr offset,
+                                    GLsizei count, GLenum type);
+
 private:
+    // The names handed out by the Tokenizer are small and dense, they
+    // index a table of pages of buffers which bind() reads without
+    // taking mLock. The table is only written with mLock held, and its
+    // pages never move, larger names are only found in mBuffers.
+    enum {
+        TABLE_PAGE_BITS  = 8,
+        TABLE_PAGE_SIZE  = 1 << TABLE_PAGE_BITS,
+        TABLE_PAGE_COUNT = 256
+    };
+    typedef gl::buffer_t* volatile table_page_t[TABLE_PAGE_SIZE];
+
+            gl::buffer_t*   lookup(GLuint buffer) const;
+            void            publish(GLuint buffer, gl::buffer_t* bo);
+
     mutable volatile int32_t            mCount;
     mutable Mutex                       mLock;
     KeyedVector<GLuint, gl::buffer_t*>  mBuffers;
+    table_page_t* volatile              mTable[TABLE_PAGE_COUNT];
 };
 
 void EGLBufferObjectManager::incStrong(const void* /*id*/) const {
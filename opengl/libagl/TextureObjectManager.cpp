@@ -30,6 +30,7 @@ EGLTextureObject::EGLTextureObject()
 
 EGLTextureObject::~EGLTextureObject()
 {
+    unlockImage();
     if (!direct) {
         if (mSize && surface.data)
             free(surface.data);
@@ -45,6 +46,7 @@ void EGLTextureObject::init()
     mMipmaps = 0;
     mNumExtraLod = 0;
     mIsComplete = false;
+    mImageModule = 0;
     wraps = GL_REPEAT;
     wrapt = GL_REPEAT;
     min_filter = GL_LINEAR;
@@ -119,6 +121,7 @@ GGLSurface& EGLTextureObject::editMip(int lod)
 status_t EGLTextureObject::setSurface(GGLSurface const* s)
 {
     // XXX: glFlush() on 's'
+    unlockImage();
     if (mSize && surface.data) {
         free(surface.data);
     }
@@ -157,6 +160,46 @@ status_t EGLTextureObject::setImage(ANativeWindowBuffer* native_buffer)
     return NO_ERROR;
 }
 
+status_t EGLTextureObject::lockImage()
+{
+    if (!buffer)
+        return BAD_VALUE;
+    if (mImageModule)
+        return NO_ERROR;
+
+    hw_module_t const* pModule;
+    if (hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &pModule))
+        return NO_INIT;
+
+    gralloc_module_t const* module =
+        reinterpret_cast<gralloc_module_t const*>(pModule);
+
+    void* vaddr;
+    int err = module->lock(module, buffer->handle,
+            GRALLOC_USAGE_SW_READ_OFTEN,
+            0, 0, buffer->width, buffer->height,
+            &vaddr);
+    if (err != NO_ERROR)
+        return err;
+
+    // keep the buffer alive while it's locked, the EGLImage it came
+    // from may be destroyed before this texture is.
+    buffer->common.incRef(&buffer->common);
+    mImageModule = module;
+    setImageBits(vaddr);
+    return NO_ERROR;
+}
+
+void EGLTextureObject::unlockImage()
+{
+    if (mImageModule) {
+        mImageModule->unlock(mImageModule, buffer->handle);
+        buffer->common.decRef(&buffer->common);
+        mImageModule = 0;
+        setImageBits(NULL);
+    }
+}
+
 status_t EGLTextureObject::reallocate(
         GLint level, int w, int h, int s,
         int format, int compressedFormat, int bpr)
@@ -164,6 +207,10 @@ status_t EGLTextureObject::reallocate(
     const size_t size = h * bpr;
     if (level == 0)
     {
+        if (buffer) {
+            unlockImage();
+            buffer = 0;
+        }
         if (size!=mSize || !surface.data) {
             if (mSize && surface.data) {
                 free(surface.data);
@@ -51,6 +51,12 @@ public:
     status_t    setImage(ANativeWindowBuffer* buffer);
     void        setImageBits(void* vaddr) { surface.data = (GGLubyte*)vaddr; }
 
+    // the EGLImage buffer stays locked from the first draw that uses it
+    // until the texture is given another image or is destroyed.
+    status_t    lockImage();
+    void        unlockImage();
+    bool        isImageLocked() const { return mImageModule != 0; }
+
     status_t            reallocate(GLint level,
                             int w, int h, int s,
                             int format, int compressedFormat, int bpr);
@@ -69,6 +75,7 @@ private:
     GGLSurface          *mMipmaps;
     int                 mNumExtraLod;
     bool                mIsComplete;
+    gralloc_module_t const* mImageModule;
 
 public:
     GGLSurface          surface;
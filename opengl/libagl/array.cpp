@@ -16,6 +16,10 @@
 
 #include <stdlib.h>
 #include <stdio.h>
+#include <string.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
 
 #include "context.h"
 #include "fp.h"
@@ -25,6 +29,8 @@
 #include "light.h"
 #include "primitives.h"
 #include "texture.h"
+#include "tiler.h"
+#include "perf.h"
 #include "BufferObjectManager.h"
 
 // ----------------------------------------------------------------------------
@@ -49,6 +55,10 @@ static void compileElements__generic(ogles_context_t*,
         vertex_t*, GLint, GLsizei);
 static void compileElement__generic(ogles_context_t*,
         vertex_t*, GLint);
+#if OGLES_VECTOR_TRANSFORM
+static void compileElements__vector(ogles_context_t*,
+        vertex_t*, GLint, GLsizei);
+#endif
 
 static void drawPrimitivesPoints(ogles_context_t*, GLint, GLsizei);
 static void drawPrimitivesLineStrip(ogles_context_t*, GLint, GLsizei);
@@ -350,8 +360,27 @@ void vertex_cache_t::init()
     // make sure the size of vertex_t allows cache-line alignment
     CTA<(sizeof(vertex_t) & 0x1F) == 0> assertAlignedSize;
 
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.libagl.vertex_cache", value, "0");
+    uint32_t entries = uint32_t(atoi(value));
+    if (entries < VERTEX_CACHE_SIZE) {
+        entries = VERTEX_CACHE_DEFAULT_SIZE;
+    } else if (entries > VERTEX_CACHE_MAX_SIZE) {
+        entries = VERTEX_CACHE_MAX_SIZE;
+    }
+    // round down to a power of two
+    while (entries & (entries - 1))
+        entries &= entries - 1;
+
+    property_get("debug.libagl.vertex_cache_stats", value, "0");
+    logStats = atoi(value) != 0;
+    lookupCount = 0;
+    missCount = 0;
+    drawCount = 0;
+    first = 0;
+
     const int align = 32;
-    const size_t s = VERTEX_BUFFER_SIZE + VERTEX_CACHE_SIZE;
+    const size_t s = VERTEX_BUFFER_SIZE + entries;
     const size_t size = s*sizeof(vertex_t) + align;
     base = malloc(size);
     if (base) {
@@ -359,11 +388,14 @@ void vertex_cache_t::init()
         vBuffer = (vertex_t*)((size_t(base) + align - 1) & ~(align-1));
         vCache = vBuffer + VERTEX_BUFFER_SIZE;
         sequence = 0;
+        mask = entries - 1;
     }
 }
 
 void vertex_cache_t::uninit()
 {
+    if (logStats)
+        log_stats();
     free(base);
     base = vBuffer = vCache = 0;
 }
@@ -376,9 +408,11 @@ void vertex_cache_t::clear()
     misses = 0;
 #endif
 
+    first = 0;
+
 #if VC_CACHE_TYPE == VC_CACHE_TYPE_LRU
     vertex_t* v = vBuffer;
-    size_t count = VERTEX_BUFFER_SIZE + VERTEX_CACHE_SIZE;
+    size_t count = VERTEX_BUFFER_SIZE + mask + 1;
     do {
         v->mru = 0;
         v++;
@@ -389,7 +423,7 @@ void vertex_cache_t::clear()
     if (sequence >= 0x80000000LU) {
         sequence = INDEX_SEQ;
         vertex_t* v = vBuffer;
-        size_t count = VERTEX_BUFFER_SIZE + VERTEX_CACHE_SIZE;
+        size_t count = VERTEX_BUFFER_SIZE + mask + 1;
         do {
             v->index = 0;
             v++;
@@ -397,6 +431,15 @@ void vertex_cache_t::clear()
     }
 }
 
+void vertex_cache_t::log_stats()
+{
+    const uint64_t hits = lookupCount - missCount;
+    ALOGD("vertex cache: %u entries, %llu lookups, %llu misses, hitrate=%u%%",
+            mask + 1, (unsigned long long)lookupCount,
+            (unsigned long long)missCount,
+            lookupCount ? unsigned(hits * 100 / lookupCount) : 0);
+}
+
 #if VC_CACHE_STATISTICS
 void vertex_cache_t::dump_stats(GLenum mode)
 {
@@ -459,6 +502,7 @@ vertex_t* cache_vertex(ogles_context_t* c, vertex_t* v, uint32_t index)
     #if VC_CACHE_STATISTICS
         c->vc.misses++;
     #endif
+    c->vc.missCount++;
     if (ggl_unlikely(v->locked)) {
         // we're just looking for an entry in the cache that is not locked.
         // and we know that there cannot be more than 2 locked entries
@@ -480,12 +524,16 @@ vertex_t* cache_vertex(ogles_context_t* c, vertex_t* v, uint32_t index)
 static __attribute__((noinline))
 vertex_t* fetch_vertex(ogles_context_t* c, size_t index)
 {
+    // the entries are mapped from the first index of the draw call, so
+    // that the vertices of meshes of up to the size of the cache each get
+    // their own
+    const size_t entry = index - c->vc.first;
     index |= c->vc.sequence;
+    c->vc.lookupCount++;
 
 #if VC_CACHE_TYPE == VC_CACHE_TYPE_INDEXED
 
-    vertex_t* const v = c->vc.vCache +
-            (index & (vertex_cache_t::VERTEX_CACHE_SIZE-1));
+    vertex_t* const v = c->vc.vCache + (entry & c->vc.mask);
 
     if (ggl_likely(v->index == index)) {
         v->locked = 1;
@@ -495,8 +543,7 @@ vertex_t* fetch_vertex(ogles_context_t* c, size_t index)
 
 #elif VC_CACHE_TYPE == VC_CACHE_TYPE_LRU
 
-    vertex_t* v = c->vc.vCache +
-            (index & ((vertex_cache_t::VERTEX_CACHE_SIZE-1)>>1))*2;
+    vertex_t* v = c->vc.vCache + (entry & (c->vc.mask>>1))*2;
 
     // always record LRU in v[0]
     if (ggl_likely(v[0].index == index)) {
@@ -982,6 +1029,36 @@ void compileElements__generic(ogles_context_t* c,
     } while (--count);
 }
 
+#if OGLES_VECTOR_TRANSFORM
+void compileElements__vector(ogles_context_t* c,
+        vertex_t* v, GLint first, GLsizei count)
+{
+    const GLubyte* vp = c->arrays.vertex.element(
+            first & vertex_cache_t::INDEX_MASK);
+    const size_t stride = c->arrays.vertex.stride;
+    vertex_t* const vertices = v;
+    GLsizei n = count;
+    do {
+        v->flags = 0;
+        v->index = first++;
+        v->obj.z = 0;
+        v->obj.w = 0x10000;
+        c->arrays.vertex.fetch(c, v->obj.v, vp);
+        vp += stride;
+        v++;
+    } while (--n);
+
+    ogles_transform_vertices(&c->transforms.mvp, c->arrays.vertex.size,
+            vertices, count);
+
+    v = vertices;
+    do {
+        c->arrays.perspective(c, v);
+        v++;
+    } while (--count);
+}
+#endif
+
 /*
 void compileElements__3x_full(ogles_context_t* c,
         vertex_t* v, GLint first, GLsizei count)
@@ -1081,8 +1158,86 @@ static void clipEye(ogles_context_t* c, vertex_t* nv,
 #pragma mark -
 #endif
 
+static inline uint32_t array_key(const array_t& a)
+{
+    return a.enable | (a.size << 1) | ((a.type & 0xF) << 4) |
+            ((a.bo || a.pointer) ? 0x100 : 0);
+}
+
+// everything validate_arrays() picks its functions from, which are then
+// left alone until it changes.
+static void validate_key(ogles_context_t* c, GLenum mode, uint32_t* key)
+{
+    const array_machine_t& am = c->arrays;
+    uint32_t state = 0x80000000 | mode;
+    state |= c->perspective ? 0x8 : 0;
+    state |= c->lighting.enable ? 0x10 : 0;
+    state |= (c->lighting.shadeModel == GL_SMOOTH) ? 0x20 : 0;
+    state |= c->point.smooth ? 0x40 : 0;
+    state |= c->line.smooth ? 0x80 : 0;
+    state |= (c->clipPlanes.enable & 0xFF) << 8;
+    for (int i=0 ; i<GGL_TEXTURE_UNIT_COUNT ; i++) {
+        if (c->rasterizer.state.texture[i].enable)
+            state |= 0x10000 << i;
+    }
+    key[0] = c->rasterizer.state.enables;
+    key[1] = state;
+    key[2] = array_key(am.vertex);
+    key[3] = array_key(am.normal);
+    key[4] = array_key(am.color);
+    for (int i=0 ; i<GGL_TEXTURE_UNIT_COUNT ; i++) {
+        key[5+i] = array_key(am.texture[i]);
+    }
+}
+
+// When the state is the one the functions were last picked for, only the
+// transforms, the textures and the array pointers need to be revalidated,
+// the first two have their own dirty flags.
+static bool validate_arrays_unchanged(ogles_context_t* c, GLenum mode)
+{
+    array_machine_t& am = c->arrays;
+    uint32_t key[array_machine_t::VALIDATE_KEY_SIZE];
+    validate_key(c, mode, key);
+    if (memcmp(key, am.validateKey, sizeof(key)))
+        return false;
+
+    ogles_validate_transform(c, am.validateWant);
+    if (c->rasterizer.state.enables & GGL_ENABLE_TMUS) {
+        ogles_validate_texture(c);
+        // an incomplete texture disables its unit
+        validate_key(c, mode, key);
+        if (memcmp(key, am.validateKey, sizeof(key)))
+            return false;
+    }
+
+    am.mvp_transform =
+        c->transforms.mvp.pointv[am.vertex.size - 2];
+    am.mv_transform =
+        c->transforms.modelview.transform.pointv[am.vertex.size - 2];
+
+    if (am.vertex.enable)
+        am.vertex.resolve();
+    if (am.normal.enable)
+        am.normal.resolve();
+    if (am.color.enable)
+        am.color.resolve();
+    for (int i=0 ; i<GGL_TEXTURE_UNIT_COUNT ; i++) {
+        if (c->rasterizer.state.texture[i].enable) {
+            if (am.texture[i].enable)
+                am.texture[i].resolve();
+            const int index = am.texture[i].size - 2;
+            am.tex_transform[i] =
+                c->transforms.texture[i].transform.pointv[index];
+        }
+    }
+    return true;
+}
+
 void validate_arrays(ogles_context_t* c, GLenum mode)
 {
+    if (validate_arrays_unchanged(c, mode))
+        return;
+
     uint32_t enables = c->rasterizer.state.enables;
 
     // Perspective correction is not need if Ortho transform, but
@@ -1128,6 +1283,7 @@ void validate_arrays(ogles_context_t* c, GLenum mode)
         want |= transform_state_t::MODELVIEW; // needs eye coords
     }
     ogles_validate_transform(c, want);
+    c->arrays.validateWant = want;
 
     // textures...
     if (enables & GGL_ENABLE_TMUS)
@@ -1136,6 +1292,9 @@ void validate_arrays(ogles_context_t* c, GLenum mode)
     // vertex compilers
     c->arrays.compileElement = compileElement__generic;
     c->arrays.compileElements = compileElements__generic;
+#if OGLES_VECTOR_TRANSFORM
+    c->arrays.compileElements = compileElements__vector;
+#endif
 
     // vertex transform
     c->arrays.mvp_transform =
@@ -1223,6 +1382,8 @@ void validate_arrays(ogles_context_t* c, GLenum mode)
 
     // pick the primitive rasterizer
     ogles_validate_primitives(c);
+
+    validate_key(c, mode, c->arrays.validateKey);
 }
 
 // ----------------------------------------------------------------------------
@@ -1369,16 +1530,18 @@ void glDrawArrays(GLenum mode, GLint first, GLsizei count)
         return; // all triangles are culled
 
 
+    const nsecs_t start = perf_begin(c);
     validate_arrays(c, mode);
 
     const uint32_t enables = c->rasterizer.state.enables;
     if (enables & GGL_ENABLE_TMUS)
         ogles_lock_textures(c);
 
+    ogles_begin_tiling(c, mode);
     drawArraysPrims[mode](c, first, count);
+    ogles_end_tiling(c);
 
-    if (enables & GGL_ENABLE_TMUS)
-        ogles_unlock_textures(c);
+    perf_draw(c, start, count, 0);
 
 #if VC_CACHE_STATISTICS
     c->vc.total = count;
@@ -1421,6 +1584,10 @@ void glDrawElements(
     if ((c->cull.enable) && (c->cull.cullFace == GL_FRONT_AND_BACK))
         return; // all triangles are culled
 
+    const nsecs_t start = perf_begin(c);
+    const uint64_t lookups = c->vc.lookupCount;
+    const uint64_t misses = c->vc.missCount;
+
     // clear the vertex-cache
     c->vc.clear();
     validate_arrays(c, mode);
@@ -1428,17 +1595,26 @@ void glDrawElements(
     // if indices are in a buffer object, the pointer is treated as an
     // offset in that buffer.
     if (c->arrays.element_array_buffer) {
-        indices = c->arrays.element_array_buffer->data + uintptr_t(indices);
+        buffer_t* bo = const_cast<buffer_t*>(c->arrays.element_array_buffer);
+        if (bo->usage == GL_STATIC_DRAW) {
+            c->vc.first = c->bufferObjectManager->getMinIndex(bo,
+                    uintptr_t(indices), count, type);
+        }
+        indices = bo->data + uintptr_t(indices);
     }
 
     const uint32_t enables = c->rasterizer.state.enables;
     if (enables & GGL_ENABLE_TMUS)
         ogles_lock_textures(c);
 
+    ogles_begin_tiling(c, mode);
     drawElementsPrims[mode](c, count, indices);
-    
-    if (enables & GGL_ENABLE_TMUS)
-        ogles_unlock_textures(c);
+    ogles_end_tiling(c);
+
+    perf_draw(c, start, c->vc.missCount - misses, c->vc.lookupCount - lookups);
+
+    if (ggl_unlikely(c->vc.logStats) && (++c->vc.drawCount & 0xFF) == 0)
+        c->vc.log_stats();
 
     
 #if VC_CACHE_STATISTICS
@@ -1529,6 +1705,7 @@ void glBufferSubData(GLenum target, GLintptr offset, GLsizeiptr size, const GLvo
         return;
     }
     memcpy(bo->data + offset, data, size);
+    const_cast<buffer_t*>(bo)->minIndexCount = 0;
 }
 
 void glDeleteBuffers(GLsizei n, const GLuint* buffers)
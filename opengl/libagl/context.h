@@ -43,6 +43,7 @@ const unsigned int OGLES_NUM_COMPRESSED_TEXTURE_FORMATS = 10
 class EGLTextureObject;
 class EGLSurfaceManager;
 class EGLBufferObjectManager;
+struct tiler_t;
 
 namespace gl {
 
@@ -210,6 +211,12 @@ struct array_machine_t {
     buffer_t const* array_buffer;
     buffer_t const* element_array_buffer;
 
+    // the state validate_arrays() last picked the fetchers, clipper and
+    // primitives for, and the transforms it needed
+    enum { VALIDATE_KEY_SIZE = 5 + GGL_TEXTURE_UNIT_COUNT };
+    uint32_t        validateKey[VALIDATE_KEY_SIZE];
+    uint32_t        validateWant;
+
     void (*compileElements)(ogles_context_t*, vertex_t*, GLint, GLsizei);
     void (*compileElement)(ogles_context_t*, vertex_t*, GLint);
 
@@ -230,7 +237,13 @@ struct vertex_cache_t {
         // or 2 + 2 for indexed triangles w/ cache contention
         VERTEX_BUFFER_SIZE  = 8,
         // must be a power of two and at least 3
+        // this is the smallest size of the cache, which is also used
+        // to compile runs of vertices of non-indexed primitives
         VERTEX_CACHE_SIZE   = 64,   // 8 KB
+        // the size of the cache unless debug.libagl.vertex_cache says
+        // otherwise, and the largest it can be
+        VERTEX_CACHE_DEFAULT_SIZE = 256,    // 32 KB
+        VERTEX_CACHE_MAX_SIZE = 4096,
 
         INDEX_BITS      = 16,
         INDEX_MASK      = ((1LU<<INDEX_BITS)-1),
@@ -239,14 +252,26 @@ struct vertex_cache_t {
     vertex_t*       vBuffer;
     vertex_t*       vCache;
     uint32_t        sequence;
+    // entries in the cache, less one
+    uint32_t        mask;
+    // the index the entries of the cache start at, which is the smallest
+    // index of the draw call when it is known
+    uint32_t        first;
     void*           base;
     uint32_t        total;
     uint32_t        misses;
     int64_t         startTime;
+    // the lookups and misses since the context was created, which are
+    // logged every 256 indexed draw calls with debug.libagl.vertex_cache_stats
+    uint64_t        lookupCount;
+    uint64_t        missCount;
+    uint32_t        drawCount;
+    bool            logStats;
     void init();
     void uninit();
     void clear();
     void dump_stats(GLenum mode);
+    void log_stats();
 };
 
 // ----------------------------------------------------------------------------
@@ -530,6 +555,7 @@ struct viewport_t {
         GLint       y;
         GLsizei     w;
         GLsizei     h;
+        GLboolean   enable;
     } scissor;
 };
 
@@ -575,6 +601,38 @@ private:
 
 };
 
+// ----------------------------------------------------------------------------
+// performance counters
+// ----------------------------------------------------------------------------
+
+struct perf_counters_t {
+    enum {
+        // triangles are counted per rasterizer path, which is made of
+        // the PATH_* features they're drawn with
+        PATH_TEXTURE    = 0x1,
+        PATH_SMOOTH     = 0x2,
+        PATH_BLEND      = 0x4,
+        PATH_DEPTH      = 0x8,
+        PATH_COUNT      = 16
+    };
+    // the counters are logged and reset every 'period' frames, they're
+    // disabled when it's 0 (debug.libagl.perf_frames)
+    uint32_t        period;
+    uint32_t        frames;
+    uint64_t        draws;
+    uint64_t        vertices;
+    uint64_t        lookups;
+    uint64_t        misses;
+    uint64_t        culled;
+    uint64_t        clipped;
+    uint64_t        triangles[PATH_COUNT];
+    uint64_t        pixels[PATH_COUNT];
+    uint64_t        textureBytes;
+    int64_t         drawTime;
+    int64_t         textureTime;
+    int64_t         swapTime;
+};
+
 // ----------------------------------------------------------------------------
 // state
 // ----------------------------------------------------------------------------
@@ -624,10 +682,13 @@ struct ogles_context_t {
     line_width_t            line;
     polygon_offset_t        polygonOffset;
     fog_t                   fog;
+    perf_counters_t         perf;
     uint32_t                perspective : 1;
     uint32_t                transformTextures : 1;
+    uint32_t                tiling : 1;
     EGLSurfaceManager*      surfaceManager;
     EGLBufferObjectManager* bufferObjectManager;
+    tiler_t*                tiler;
 
     GLenum                  error;
 
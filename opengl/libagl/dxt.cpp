@@ -248,38 +248,35 @@ decodeDXT1(const GLvoid *data, int width, int height,
                     c[1] = color1;
                 }
                 
+                // The whole table is computed, even if this block
+                // doesn't use codes 2 and 3, because the next blocks
+                // with the same base colors reuse it and may use them.
                 int r2, g2, b2, r3, g3, b3, a3;
                 
-                int bbits = bits >> 1;
-                bool has2 = ((bbits & ~bits) & 0x55555555) != 0;
-                bool has3 = ((bbits &  bits) & 0x55555555) != 0;
-                
-                if (has2 || has3) {
-                    if (color0 > color1) {
-                        r2 = avg23(r0, r1);
-                        g2 = avg23(g0, g1);
-                        b2 = avg23(b0, b1);
-                        
-                        r3 = avg23(r1, r0);
-                        g3 = avg23(g1, g0);
-                        b3 = avg23(b1, b0);
-                        a3 = 1;
-                    } else {
-                        r2 = (r0 + r1) >> 1;
-                        g2 = (g0 + g1) >> 1;
-                        b2 = (b0 + b1) >> 1;
-                        
-                        r3 = g3 = b3 = a3 = 0;
-                    }
-                    if (hasAlpha) {
-                        c[2] = (r2 << 11) | ((g2 >> 1) << 6) |
-                            (b2 << 1) | 0x1;
-                        c[3] = (r3 << 11) | ((g3 >> 1) << 6) |
-                            (b3 << 1) | a3;
-                    } else {
-                        c[2] = (r2 << 11) | (g2 << 5) | b2;
-                        c[3] = (r3 << 11) | (g3 << 5) | b3;
-                    }
+                if (color0 > color1) {
+                    r2 = avg23(r0, r1);
+                    g2 = avg23(g0, g1);
+                    b2 = avg23(b0, b1);
+                    
+                    r3 = avg23(r1, r0);
+                    g3 = avg23(g1, g0);
+                    b3 = avg23(b1, b0);
+                    a3 = 1;
+                } else {
+                    r2 = (r0 + r1) >> 1;
+                    g2 = (g0 + g1) >> 1;
+                    b2 = (b0 + b1) >> 1;
+                    
+                    r3 = g3 = b3 = a3 = 0;
+                }
+                if (hasAlpha) {
+                    c[2] = (r2 << 11) | ((g2 >> 1) << 6) |
+                        (b2 << 1) | 0x1;
+                    c[3] = (r3 << 11) | ((g3 >> 1) << 6) |
+                        (b3 << 1) | a3;
+                } else {
+                    c[2] = (r2 << 11) | (g2 << 5) | b2;
+                    c[3] = (r3 << 11) | (g3 << 5) | b3;
                 }
             }
             
@@ -357,36 +354,27 @@ decodeDXT3(const GLvoid *data, int width, int height,
                 prev_color0 = color0;
                 prev_color1 = color1;
                 
-                int bbits = bits >> 1;
-                bool has2 = ((bbits & ~bits) & 0x55555555) != 0;
-                bool has3 = ((bbits &  bits) & 0x55555555) != 0;
+                // The whole table is computed, see decodeDXT1()
+                int r0 =   red(color0);
+                int g0 = green(color0);
+                int b0 =  blue(color0);
                 
-                if (has2 || has3) {
-                    int r0 =   red(color0);
-                    int g0 = green(color0);
-                    int b0 =  blue(color0);
-                    
-                    int r1 =   red(color1);
-                    int g1 = green(color1);
-                    int b1 =  blue(color1);
-                    
-                    int r2 = avg23(r0, r1);
-                    int g2 = avg23(g0, g1);
-                    int b2 = avg23(b0, b1);
-                    
-                    int r3 = avg23(r1, r0);
-                    int g3 = avg23(g1, g0);
-                    int b3 = avg23(b1, b0);
-
-                    c[0] = rgb565SepTo888(r0, g0, b0);
-                    c[1] = rgb565SepTo888(r1, g1, b1);
-                    c[2] = rgb565SepTo888(r2, g2, b2);
-                    c[3] = rgb565SepTo888(r3, g3, b3);
-                } else {
-                    // Convert to 8 bits
-                    c[0] = rgb565To888(color0);
-                    c[1] = rgb565To888(color1);
-                }
+                int r1 =   red(color1);
+                int g1 = green(color1);
+                int b1 =  blue(color1);
+                
+                int r2 = avg23(r0, r1);
+                int g2 = avg23(g0, g1);
+                int b2 = avg23(b0, b1);
+                
+                int r3 = avg23(r1, r0);
+                int g3 = avg23(g1, g0);
+                int b3 = avg23(b1, b0);
+
+                c[0] = rgb565SepTo888(r0, g0, b0);
+                c[1] = rgb565SepTo888(r1, g1, b1);
+                c[2] = rgb565SepTo888(r2, g2, b2);
+                c[3] = rgb565SepTo888(r3, g3, b3);
             }
 
             uint32_t* blockRowPtr = blockPtr;
@@ -462,7 +450,7 @@ decodeDXT5(const GLvoid *data, int width, int height,
             uint32_t colors = *d32++;
             uint32_t bits = *d32++;
             
-#if __BYTE_ORDER == __BIG_ENDIANx
+#if __BYTE_ORDER == __BIG_ENDIAN
             colors = swap(colors);
             bits = swap(bits);
 #endif
@@ -514,36 +502,27 @@ decodeDXT5(const GLvoid *data, int width, int height,
                 prev_color0 = color0;
                 prev_color1 = color1;
                 
-                int bbits = bits >> 1;
-                bool has2 = ((bbits & ~bits) & 0x55555555) != 0;
-                bool has3 = ((bbits &  bits) & 0x55555555) != 0;
+                // The whole table is computed, see decodeDXT1()
+                int r0 =   red(color0);
+                int g0 = green(color0);
+                int b0 =  blue(color0);
+                
+                int r1 =   red(color1);
+                int g1 = green(color1);
+                int b1 =  blue(color1);
                 
-                if (has2 || has3) {
-                    int r0 =   red(color0);
-                    int g0 = green(color0);
-                    int b0 =  blue(color0);
-                    
-                    int r1 =   red(color1);
-                    int g1 = green(color1);
-                    int b1 =  blue(color1);
+                int r2 = avg23(r0, r1);
+                int g2 = avg23(g0, g1);
+                int b2 = avg23(b0, b1);
                 
-                    int r2 = avg23(r0, r1);
-                    int g2 = avg23(g0, g1);
-                    int b2 = avg23(b0, b1);
-                    
-                    int r3 = avg23(r1, r0);
-                    int g3 = avg23(g1, g0);
-                    int b3 = avg23(b1, b0);
-
-                    c[0] = rgb565SepTo888(r0, g0, b0);
-                    c[1] = rgb565SepTo888(r1, g1, b1);
-                    c[2] = rgb565SepTo888(r2, g2, b2);
-                    c[3] = rgb565SepTo888(r3, g3, b3);
-                } else {
-                    // Convert to 8 bits
-                    c[0] = rgb565To888(color0);
-                    c[1] = rgb565To888(color1);
-                }                
+                int r3 = avg23(r1, r0);
+                int g3 = avg23(g1, g0);
+                int b3 = avg23(b1, b0);
+
+                c[0] = rgb565SepTo888(r0, g0, b0);
+                c[1] = rgb565SepTo888(r1, g1, b1);
+                c[2] = rgb565SepTo888(r2, g2, b2);
+                c[3] = rgb565SepTo888(r3, g3, b3);
             }
 
             uint32_t* blockRowPtr = blockPtr;
@@ -45,6 +45,7 @@
 #include "state.h"
 #include "texture.h"
 #include "matrix.h"
+#include "perf.h"
 
 #undef NELEM
 #define NELEM(x) (sizeof(x)/sizeof(*(x)))
@@ -165,6 +166,7 @@ struct egl_surface_t
     virtual     EGLint      getVerticalResolution() const;
     virtual     EGLint      getRefreshRate() const;
     virtual     EGLint      getSwapBehavior() const;
+    virtual     EGLint      getBufferAge();
     virtual     EGLBoolean  swapBuffers();
     virtual     EGLBoolean  setSwapRectangle(EGLint l, EGLint t, EGLint w, EGLint h);
 protected:
@@ -205,6 +207,9 @@ EGLint egl_surface_t::getRefreshRate() const {
 EGLint egl_surface_t::getSwapBehavior() const {
     return EGL_BUFFER_PRESERVED;
 }
+EGLint egl_surface_t::getBufferAge() {
+    return 0;
+}
 EGLBoolean egl_surface_t::setSwapRectangle(
         EGLint /*l*/, EGLint /*t*/, EGLint /*w*/, EGLint /*h*/)
 {
@@ -234,11 +239,15 @@ struct egl_window_surface_v2_t : public egl_surface_t
     virtual     EGLint      getVerticalResolution() const;
     virtual     EGLint      getRefreshRate() const;
     virtual     EGLint      getSwapBehavior() const;
+    virtual     EGLint      getBufferAge();
     virtual     EGLBoolean  setSwapRectangle(EGLint l, EGLint t, EGLint w, EGLint h);
     
 private:
     status_t lock(ANativeWindowBuffer* buf, int usage, void** vaddr);
     status_t unlock(ANativeWindowBuffer* buf);
+    void updateBufferAge();
+    void queuedBuffer(ANativeWindowBuffer* buf);
+    void clearBufferAges();
     ANativeWindow*   nativeWindow;
     ANativeWindowBuffer*   buffer;
     ANativeWindowBuffer*   previousBuffer;
@@ -335,6 +344,19 @@ private:
 
     Rect dirtyRegion;
     Rect oldDirtyRegion;
+
+    // the last few buffers we queued, along with the frame they were
+    // queued in, which gives the age of their content when they're
+    // dequeued again (EGL_EXT_buffer_age).
+    enum { MAX_AGED_BUFFERS = 4 };
+    struct aged_buffer_t {
+        ANativeWindowBuffer* buffer;
+        uint32_t frame;
+    };
+    aged_buffer_t agedBuffers[MAX_AGED_BUFFERS];
+    uint32_t frameCount;
+    EGLint bufferAge;
+    bool bufferAgeQueried;
 };
 
 egl_window_surface_v2_t::egl_window_surface_v2_t(EGLDisplay dpy,
@@ -343,8 +365,10 @@ egl_window_surface_v2_t::egl_window_surface_v2_t(EGLDisplay dpy,
         ANativeWindow* window)
     : egl_surface_t(dpy, config, depthFormat), 
     nativeWindow(window), buffer(0), previousBuffer(0), module(0),
-    bits(NULL)
+    bits(NULL), frameCount(0), bufferAge(0), bufferAgeQueried(false)
 {
+    memset(agedBuffers, 0, sizeof(agedBuffers));
+
     hw_module_t const* pModule;
     hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &pModule);
     module = reinterpret_cast<gralloc_module_t const*>(pModule);
@@ -364,6 +388,7 @@ egl_window_surface_v2_t::~egl_window_surface_v2_t() {
     if (previousBuffer) {
         previousBuffer->common.decRef(&previousBuffer->common); 
     }
+    clearBufferAges();
     nativeWindow->common.decRef(&nativeWindow->common);
 }
 
@@ -390,6 +415,7 @@ EGLBoolean egl_window_surface_v2_t::connect()
     // allocate a corresponding depth-buffer
     width = buffer->width;
     height = buffer->height;
+    updateBufferAge();
     if (depth.format) {
         depth.width   = width;
         depth.height  = height;
@@ -435,6 +461,8 @@ void egl_window_surface_v2_t::disconnect()
         previousBuffer->common.decRef(&previousBuffer->common); 
         previousBuffer = 0;
     }
+    clearBufferAges();
+    bufferAge = 0;
 }
 
 status_t egl_window_surface_v2_t::lock(
@@ -458,6 +486,52 @@ status_t egl_window_surface_v2_t::unlock(ANativeWindowBuffer* buf)
     return err;
 }
 
+void egl_window_surface_v2_t::updateBufferAge()
+{
+    bufferAge = 0;
+    for (int i=0 ; i<MAX_AGED_BUFFERS ; i++) {
+        if (agedBuffers[i].buffer == buffer) {
+            bufferAge = frameCount - agedBuffers[i].frame + 1;
+            break;
+        }
+    }
+}
+
+void egl_window_surface_v2_t::queuedBuffer(ANativeWindowBuffer* buf)
+{
+    // replace this buffer's entry, or the oldest one
+    int slot = 0;
+    for (int i=0 ; i<MAX_AGED_BUFFERS ; i++) {
+        if (agedBuffers[i].buffer == buf) {
+            slot = i;
+            break;
+        }
+        if (agedBuffers[i].frame < agedBuffers[slot].frame)
+            slot = i;
+    }
+    aged_buffer_t& aged(agedBuffers[slot]);
+    if (aged.buffer != buf) {
+        // we keep a reference, so the buffer can't be freed and another
+        // one allocated at the same address while we track its age
+        if (aged.buffer)
+            aged.buffer->common.decRef(&aged.buffer->common);
+        buf->common.incRef(&buf->common);
+        aged.buffer = buf;
+    }
+    aged.frame = ++frameCount;
+}
+
+void egl_window_surface_v2_t::clearBufferAges()
+{
+    for (int i=0 ; i<MAX_AGED_BUFFERS ; i++) {
+        aged_buffer_t& aged(agedBuffers[i]);
+        if (aged.buffer)
+            aged.buffer->common.decRef(&aged.buffer->common);
+        aged.buffer = 0;
+        aged.frame = 0;
+    }
+}
+
 void egl_window_surface_v2_t::copyBlt(
         ANativeWindowBuffer* dst, void* dst_vaddr,
         ANativeWindowBuffer* src, void const* src_vaddr,
@@ -507,7 +581,9 @@ EGLBoolean egl_window_surface_v2_t::swapBuffers()
      */
     if (!dirtyRegion.isEmpty()) {
         dirtyRegion.andSelf(Rect(buffer->width, buffer->height));
-        if (previousBuffer) {
+        // clients that asked for the buffer age repair the back buffer
+        // themselves, there is nothing to copy back for them.
+        if (previousBuffer && !bufferAgeQueried) {
             // This was const Region copyBack, but that causes an
             // internal compile error on simulator builds
             /*const*/ Region copyBack(Region::subtract(oldDirtyRegion, dirtyRegion));
@@ -532,7 +608,9 @@ EGLBoolean egl_window_surface_v2_t::swapBuffers()
     unlock(buffer);
     previousBuffer = buffer;
     nativeWindow->queueBuffer(nativeWindow, buffer, -1);
+    queuedBuffer(buffer);
     buffer = 0;
+    bufferAgeQueried = false;
 
     // dequeue a new buffer
     int fenceFd = -1;
@@ -549,6 +627,7 @@ EGLBoolean egl_window_surface_v2_t::swapBuffers()
             // if the window size has changed
             width = buffer->width;
             height = buffer->height;
+            clearBufferAges();
             if (depth.data) {
                 free(depth.data);
                 depth.width   = width;
@@ -569,6 +648,8 @@ EGLBoolean egl_window_surface_v2_t::swapBuffers()
             }
         }
 
+        updateBufferAge();
+
         // keep a reference on the buffer
         buffer->common.incRef(&buffer->common);
 
@@ -648,6 +729,11 @@ EGLint egl_window_surface_v2_t::getSwapBehavior() const
 
     return EGL_BUFFER_DESTROYED;
 }
+EGLint egl_window_surface_v2_t::getBufferAge()
+{
+    bufferAgeQueried = true;
+    return buffer ? bufferAge : 0;
+}
 
 // ----------------------------------------------------------------------------
 
@@ -838,6 +924,7 @@ static char const * const gExtensionsString =
         // "KHR_image_pixmap "
         "EGL_ANDROID_image_native_buffer "
         "EGL_ANDROID_swap_rectangle "
+        "EGL_EXT_buffer_age "
         ;
 
 // ----------------------------------------------------------------------------
@@ -1675,6 +1762,9 @@ EGLBoolean eglQuerySurface( EGLDisplay dpy, EGLSurface eglSurface,
         case EGL_SWAP_BEHAVIOR:
             *value = surface->getSwapBehavior();
             break;
+        case EGL_BUFFER_AGE_EXT:
+            *value = surface->getBufferAge();
+            break;
         default:
             ret = setError(EGL_BAD_ATTRIBUTE, EGL_FALSE);
     }
@@ -1897,10 +1987,15 @@ EGLBoolean eglSwapBuffers(EGLDisplay dpy, EGLSurface draw)
         return setError(EGL_BAD_DISPLAY, EGL_FALSE);
 
     // post the surface
+    const nsecs_t start = (d->ctx != EGL_NO_CONTEXT) ?
+            perf_begin((ogles_context_t*)d->ctx) : 0;
     d->swapBuffers();
 
     // if it's bound to a context, update the buffer
     if (d->ctx != EGL_NO_CONTEXT) {
+        ogles_context_t* gl = (ogles_context_t*)d->ctx;
+        if (ggl_unlikely(gl->perf.period))
+            ogles_perf_frame(gl, systemTime(SYSTEM_TIME_MONOTONIC) - start);
         d->bindDrawSurface((ogles_context_t*)d->ctx);
         // if this surface is also the read surface of the context
         // it is bound to, make sure to update the read buffer as well.
@@ -18,6 +18,12 @@
 #include <stdlib.h>
 #include <stdio.h>
 
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__SSE4_1__)
+#include <smmintrin.h>
+#endif
+
 #include "context.h"
 #include "fp.h"
 #include "state.h"
@@ -806,6 +812,119 @@ void point4__nop(transform_t const*, vec4_t* lhs, vec4_t const* rhs) {
         *lhs = *rhs;
 }
 
+// ----------------------------------------------------------------------------
+#if 0
+#pragma mark -
+#pragma mark matrix * vertices
+#endif
+
+#if OGLES_VECTOR_TRANSFORM
+
+// The 4 coordinates are computed together, with 64-bits products as mla2a,
+// mla3a and mla4 do: the last column is added after the shift, except for
+// 4 components vertices, which are rounded as mla4 does.
+
+#if defined(__aarch64__)
+
+template <int SIZE>
+static void transform_vertices(transform_t const* mx,
+        vertex_t* v, GLsizei count)
+{
+    const GLfixed* const m = mx->matrix.m;
+    const int32x4_t m0 = vld1q_s32(m +  0);
+    const int32x4_t m1 = vld1q_s32(m +  4);
+    const int32x4_t m2 = vld1q_s32(m +  8);
+    const int32x4_t m3 = vld1q_s32(m + 12);
+    const int64x2_t round = vdupq_n_s64(SIZE == 4 ? 0x8000 : 0);
+    const int32x4_t add = SIZE == 4 ? vdupq_n_s32(0) : m3;
+    do {
+        const GLfixed* const o = v->obj.v;
+        int64x2_t lo = vmlal_n_s32(round, vget_low_s32(m0), o[0]);
+        int64x2_t hi = vmlal_n_s32(round, vget_high_s32(m0), o[0]);
+        lo = vmlal_n_s32(lo, vget_low_s32(m1), o[1]);
+        hi = vmlal_n_s32(hi, vget_high_s32(m1), o[1]);
+        if (SIZE >= 3) {
+            lo = vmlal_n_s32(lo, vget_low_s32(m2), o[2]);
+            hi = vmlal_n_s32(hi, vget_high_s32(m2), o[2]);
+        }
+        if (SIZE == 4) {
+            lo = vmlal_n_s32(lo, vget_low_s32(m3), o[3]);
+            hi = vmlal_n_s32(hi, vget_high_s32(m3), o[3]);
+        }
+        const int32x4_t r = vcombine_s32(vshrn_n_s64(lo, 16),
+                vshrn_n_s64(hi, 16));
+        vst1q_s32(v->clip.v, vaddq_s32(r, add));
+        v++;
+    } while (--count);
+}
+
+#else
+
+// _mm_mul_epi32 multiplies the even lanes only: the odd lanes of the
+// coordinates are computed from the columns shifted down by a lane.
+template <int SIZE>
+static void transform_vertices(transform_t const* mx,
+        vertex_t* v, GLsizei count)
+{
+    const GLfixed* const m = mx->matrix.m;
+    const __m128i m0 = _mm_loadu_si128((const __m128i*)(m +  0));
+    const __m128i m1 = _mm_loadu_si128((const __m128i*)(m +  4));
+    const __m128i m2 = _mm_loadu_si128((const __m128i*)(m +  8));
+    const __m128i m3 = _mm_loadu_si128((const __m128i*)(m + 12));
+    const __m128i m0odd = _mm_srli_epi64(m0, 32);
+    const __m128i m1odd = _mm_srli_epi64(m1, 32);
+    const __m128i m2odd = _mm_srli_epi64(m2, 32);
+    const __m128i m3odd = _mm_srli_epi64(m3, 32);
+    const __m128i round = _mm_set1_epi64x(SIZE == 4 ? 0x8000 : 0);
+    const __m128i add = SIZE == 4 ? _mm_setzero_si128() : m3;
+    do {
+        const GLfixed* const o = v->obj.v;
+        __m128i s = _mm_set1_epi32(o[0]);
+        __m128i even = _mm_add_epi64(round, _mm_mul_epi32(m0, s));
+        __m128i odd = _mm_add_epi64(round, _mm_mul_epi32(m0odd, s));
+        s = _mm_set1_epi32(o[1]);
+        even = _mm_add_epi64(even, _mm_mul_epi32(m1, s));
+        odd = _mm_add_epi64(odd, _mm_mul_epi32(m1odd, s));
+        if (SIZE >= 3) {
+            s = _mm_set1_epi32(o[2]);
+            even = _mm_add_epi64(even, _mm_mul_epi32(m2, s));
+            odd = _mm_add_epi64(odd, _mm_mul_epi32(m2odd, s));
+        }
+        if (SIZE == 4) {
+            s = _mm_set1_epi32(o[3]);
+            even = _mm_add_epi64(even, _mm_mul_epi32(m3, s));
+            odd = _mm_add_epi64(odd, _mm_mul_epi32(m3odd, s));
+        }
+        // bits 16 to 47 of the sums, the odd ones moved up to their lanes
+        const __m128i r = _mm_blend_epi16(_mm_srli_epi64(even, 16),
+                _mm_slli_epi64(odd, 16), 0xCC);
+        _mm_storeu_si128((__m128i*)v->clip.v, _mm_add_epi32(r, add));
+        v++;
+    } while (--count);
+}
+
+#endif
+
+void ogles_transform_vertices(transform_t const* mx, int size,
+        vertex_t* v, GLsizei count)
+{
+    if (mx->ops == OP_IDENTITY) {
+        const int i = size - 2;
+        do {
+            mx->pointv[i](mx, &v->clip, &v->obj);
+            v++;
+        } while (--count);
+        return;
+    }
+    switch (size) {
+    case 2: transform_vertices<2>(mx, v, count); break;
+    case 3: transform_vertices<3>(mx, v, count); break;
+    case 4: transform_vertices<4>(mx, v, count); break;
+    }
+}
+
+#endif // OGLES_VECTOR_TRANSFORM
+
 
 static void frustumf(
             GLfloat left, GLfloat right, 
@@ -27,6 +27,14 @@
 
 #include <GLES/gl.h>
 
+// The vertices of the arrays are transformed with NEON on ARMv8, and with
+// SSE4.1, which Android requires of x86_64 devices.
+#if defined(__aarch64__) || (defined(__x86_64__) && defined(__SSE4_1__))
+#define OGLES_VECTOR_TRANSFORM 1
+#else
+#define OGLES_VECTOR_TRANSFORM 0
+#endif
+
 namespace android {
 
 const int OGLES_MODELVIEW_STACK_DEPTH   = 16;
@@ -46,6 +54,14 @@ void ogles_scissor(ogles_context_t* c,
 void ogles_viewport(ogles_context_t* c,
         GLint x, GLint y, GLsizei w, GLsizei h);
 
+#if OGLES_VECTOR_TRANSFORM
+// Transforms the object coordinates of count vertices, of the given size,
+// into their clip coordinates, with the same results as the transform's
+// point2, point3 or point4.
+void ogles_transform_vertices(transform_t const* mx, int size,
+        vertex_t* v, GLsizei count);
+#endif
+
 inline void ogles_validate_transform(
         ogles_context_t* c, uint32_t want)
 {
@@ -15,8 +15,18 @@
 ** limitations under the License.
 */
 
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <unistd.h>
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#define MIPMAP_USE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define MIPMAP_USE_SSE2 1
+#endif
 
 #include "context.h"
 #include "state.h"
@@ -27,10 +37,365 @@ namespace android {
 
 // ----------------------------------------------------------------------------
 
+// Levels with at least this many texels are built by several threads,
+// which each take a band of their rows.
+static const int kMinThreadedTexels = 256 * 256;
+static const int kMaxThreads = 4;
+
+// downsample565 and downsample8888 build the first texels of a row of a
+// level from the two rows of the level above, with the same results as the
+// loops of downsampleRows, and return how many they built.
+
+#if defined(MIPMAP_USE_NEON)
+
+static int downsample565(uint16_t* dst,
+        const uint16_t* row0, const uint16_t* row1, int w)
+{
+    const uint16x8_t gmask = vdupq_n_u16(0x3F);
+    const uint16x8_t bmask = vdupq_n_u16(0x1F);
+    int x = 0;
+    for ( ; x+8 <= w ; x += 8) {
+        // the even and odd texels of the 16 of each row
+        const uint16x8x2_t p0 = vld2q_u16(row0 + x*2);
+        const uint16x8x2_t p1 = vld2q_u16(row1 + x*2);
+        const uint16x8_t r = vshrq_n_u16(vaddq_u16(
+                vaddq_u16(vshrq_n_u16(p0.val[0], 11), vshrq_n_u16(p0.val[1], 11)),
+                vaddq_u16(vshrq_n_u16(p1.val[0], 11), vshrq_n_u16(p1.val[1], 11))), 2);
+        const uint16x8_t g = vshrq_n_u16(vaddq_u16(
+                vaddq_u16(vandq_u16(vshrq_n_u16(p0.val[0], 5), gmask),
+                          vandq_u16(vshrq_n_u16(p0.val[1], 5), gmask)),
+                vaddq_u16(vandq_u16(vshrq_n_u16(p1.val[0], 5), gmask),
+                          vandq_u16(vshrq_n_u16(p1.val[1], 5), gmask))), 2);
+        const uint16x8_t b = vshrq_n_u16(vaddq_u16(
+                vaddq_u16(vandq_u16(p0.val[0], bmask), vandq_u16(p0.val[1], bmask)),
+                vaddq_u16(vandq_u16(p1.val[0], bmask), vandq_u16(p1.val[1], bmask))), 2);
+        vst1q_u16(dst + x, vorrq_u16(vorrq_u16(vshlq_n_u16(r, 11),
+                vshlq_n_u16(g, 5)), b));
+    }
+    return x;
+}
+
+static int downsample8888(uint32_t* dst,
+        const uint32_t* row0, const uint32_t* row1, int w)
+{
+    int x = 0;
+    for ( ; x+4 <= w ; x += 4) {
+        // the even and odd texels of the 8 of each row
+        const uint32x4x2_t p0 = vld2q_u32(row0 + x*2);
+        const uint32x4x2_t p1 = vld2q_u32(row1 + x*2);
+        const uint8x16_t e0 = vreinterpretq_u8_u32(p0.val[0]);
+        const uint8x16_t o0 = vreinterpretq_u8_u32(p0.val[1]);
+        const uint8x16_t e1 = vreinterpretq_u8_u32(p1.val[0]);
+        const uint8x16_t o1 = vreinterpretq_u8_u32(p1.val[1]);
+        const uint16x8_t lo = vaddq_u16(
+                vaddl_u8(vget_low_u8(e0), vget_low_u8(o0)),
+                vaddl_u8(vget_low_u8(e1), vget_low_u8(o1)));
+        const uint16x8_t hi = vaddq_u16(
+                vaddl_u8(vget_high_u8(e0), vget_high_u8(o0)),
+                vaddl_u8(vget_high_u8(e1), vget_high_u8(o1)));
+        const uint8x16_t rgba = vcombine_u8(vshrn_n_u16(lo, 2), vshrn_n_u16(hi, 2));
+        vst1q_u32(dst + x, vreinterpretq_u32_u8(rgba));
+    }
+    return x;
+}
+
+#elif defined(MIPMAP_USE_SSE2)
+
+// the sums of the pairs of 16-bits lanes of a and b, in 8 lanes
+static inline __m128i sumPairs(__m128i a, __m128i b)
+{
+    const __m128i one = _mm_set1_epi16(1);
+    return _mm_packs_epi32(_mm_madd_epi16(a, one), _mm_madd_epi16(b, one));
+}
+
+static int downsample565(uint16_t* dst,
+        const uint16_t* row0, const uint16_t* row1, int w)
+{
+    const __m128i gmask = _mm_set1_epi16(0x3F);
+    const __m128i bmask = _mm_set1_epi16(0x1F);
+    int x = 0;
+    for ( ; x+8 <= w ; x += 8) {
+        const __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x*2));
+        const __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x*2 + 8));
+        const __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x*2));
+        const __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x*2 + 8));
+        const __m128i r = _mm_srli_epi16(sumPairs(
+                _mm_add_epi16(_mm_srli_epi16(a0, 11), _mm_srli_epi16(b0, 11)),
+                _mm_add_epi16(_mm_srli_epi16(a1, 11), _mm_srli_epi16(b1, 11))), 2);
+        const __m128i g = _mm_srli_epi16(sumPairs(
+                _mm_add_epi16(_mm_and_si128(_mm_srli_epi16(a0, 5), gmask),
+                              _mm_and_si128(_mm_srli_epi16(b0, 5), gmask)),
+                _mm_add_epi16(_mm_and_si128(_mm_srli_epi16(a1, 5), gmask),
+                              _mm_and_si128(_mm_srli_epi16(b1, 5), gmask))), 2);
+        const __m128i b = _mm_srli_epi16(sumPairs(
+                _mm_add_epi16(_mm_and_si128(a0, bmask), _mm_and_si128(b0, bmask)),
+                _mm_add_epi16(_mm_and_si128(a1, bmask), _mm_and_si128(b1, bmask))), 2);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_or_si128(_mm_or_si128(
+                _mm_slli_epi16(r, 11), _mm_slli_epi16(g, 5)), b));
+    }
+    return x;
+}
+
+static int downsample8888(uint32_t* dst,
+        const uint32_t* row0, const uint32_t* row1, int w)
+{
+    const __m128i zero = _mm_setzero_si128();
+    int x = 0;
+    for ( ; x+4 <= w ; x += 4) {
+        const __m128i a0 = _mm_loadu_si128((const __m128i*)(row0 + x*2));
+        const __m128i a1 = _mm_loadu_si128((const __m128i*)(row0 + x*2 + 4));
+        const __m128i b0 = _mm_loadu_si128((const __m128i*)(row1 + x*2));
+        const __m128i b1 = _mm_loadu_si128((const __m128i*)(row1 + x*2 + 4));
+        // the components of 2 texels of each row, summed over the 2 rows
+        const __m128i s0 = _mm_add_epi16(_mm_unpacklo_epi8(a0, zero),
+                _mm_unpacklo_epi8(b0, zero));
+        const __m128i s1 = _mm_add_epi16(_mm_unpackhi_epi8(a0, zero),
+                _mm_unpackhi_epi8(b0, zero));
+        const __m128i s2 = _mm_add_epi16(_mm_unpacklo_epi8(a1, zero),
+                _mm_unpacklo_epi8(b1, zero));
+        const __m128i s3 = _mm_add_epi16(_mm_unpackhi_epi8(a1, zero),
+                _mm_unpackhi_epi8(b1, zero));
+        // then over the 2 texels
+        const __m128i t0 = _mm_add_epi16(s0, _mm_srli_si128(s0, 8));
+        const __m128i t1 = _mm_add_epi16(s1, _mm_srli_si128(s1, 8));
+        const __m128i t2 = _mm_add_epi16(s2, _mm_srli_si128(s2, 8));
+        const __m128i t3 = _mm_add_epi16(s3, _mm_srli_si128(s3, 8));
+        const __m128i lo = _mm_srli_epi16(_mm_unpacklo_epi64(t0, t1), 2);
+        const __m128i hi = _mm_srli_epi16(_mm_unpacklo_epi64(t2, t3), 2);
+        _mm_storeu_si128((__m128i*)(dst + x), _mm_packus_epi16(lo, hi));
+    }
+    return x;
+}
+
+#else
+
+static int downsample565(uint16_t*, const uint16_t*, const uint16_t*, int)
+{
+    return 0;
+}
+
+static int downsample8888(uint32_t*, const uint32_t*, const uint32_t*, int)
+{
+    return 0;
+}
+
+#endif
+
+// ----------------------------------------------------------------------------
+
+static bool isMipmapFormat(int format)
+{
+    switch (format) {
+    case GGL_PIXEL_FORMAT_RGB_565:
+    case GGL_PIXEL_FORMAT_RGBA_5551:
+    case GGL_PIXEL_FORMAT_RGBA_8888:
+    case GGL_PIXEL_FORMAT_RGB_888:
+    case GGL_PIXEL_FORMAT_LA_88:
+    case GGL_PIXEL_FORMAT_A_8:
+    case GGL_PIXEL_FORMAT_L_8:
+    case GGL_PIXEL_FORMAT_RGBA_4444:
+        return true;
+    }
+    return false;
+}
+
+// downsampleRows builds the rows [y0, y1) of the level cur from the level
+// base above it.
+static void downsampleRows(const GGLSurface* base, GGLSurface* cur,
+        int y0, int y1)
+{
+    const int w = cur->width;
+    int stride = cur->stride;
+    int bs = base->stride;
+    // the vector loops read both texels of the pairs they filter, which
+    // the last levels of a side don't have
+    const bool vector = base->width > 1 && base->height > 1;
+
+    if (base->format == GGL_PIXEL_FORMAT_RGB_565)
+    {
+        uint16_t const * src = (uint16_t const *)base->data;
+        uint16_t* dst = (uint16_t*)cur->data;
+        const uint32_t mask = 0x07E0F81F;
+        for (int y=y0 ; y<y1 ; y++) {
+            int x = vector ? downsample565(dst + y*stride,
+                    src + (y*2) * bs, src + (y*2+1) * bs, w) : 0;
+            size_t offset = (y*2) * bs + x*2;
+            for ( ; x<w ; x++) {
+                uint32_t p00 = src[offset];
+                uint32_t p10 = src[offset+1];
+                uint32_t p01 = src[offset+bs];
+                uint32_t p11 = src[offset+bs+1];
+                p00 = (p00 | (p00 << 16)) & mask;
+                p01 = (p01 | (p01 << 16)) & mask;
+                p10 = (p10 | (p10 << 16)) & mask;
+                p11 = (p11 | (p11 << 16)) & mask;
+                uint32_t grb = ((p00 + p10 + p01 + p11) >> 2) & mask;
+                uint32_t rgb = (grb & 0xFFFF) | (grb >> 16);
+                dst[x + y*stride] = rgb;
+                offset += 2;
+            }
+        }
+    }
+    else if (base->format == GGL_PIXEL_FORMAT_RGBA_5551)
+    {
+        uint16_t const * src = (uint16_t const *)base->data;
+        uint16_t* dst = (uint16_t*)cur->data;
+        for (int y=y0 ; y<y1 ; y++) {
+            size_t offset = (y*2) * bs;
+            for (int x=0 ; x<w ; x++) {
+                uint32_t p00 = src[offset];
+                uint32_t p10 = src[offset+1];
+                uint32_t p01 = src[offset+bs];
+                uint32_t p11 = src[offset+bs+1];
+                uint32_t r = ((p00>>11)+(p10>>11)+(p01>>11)+(p11>>11)+2)>>2;
+                uint32_t g = (((p00>>6)+(p10>>6)+(p01>>6)+(p11>>6)+2)>>2)&0x3F;
+                uint32_t b = ((p00&0x3E)+(p10&0x3E)+(p01&0x3E)+(p11&0x3E)+4)>>3;
+                uint32_t a = ((p00&1)+(p10&1)+(p01&1)+(p11&1)+2)>>2;
+                dst[x + y*stride] = (r<<11)|(g<<6)|(b<<1)|a;
+                offset += 2;
+            }
+        }
+    }
+    else if (base->format == GGL_PIXEL_FORMAT_RGBA_8888)
+    {
+        uint32_t const * src = (uint32_t const *)base->data;
+        uint32_t* dst = (uint32_t*)cur->data;
+        for (int y=y0 ; y<y1 ; y++) {
+            int x = vector ? downsample8888(dst + y*stride,
+                    src + (y*2) * bs, src + (y*2+1) * bs, w) : 0;
+            size_t offset = (y*2) * bs + x*2;
+            for ( ; x<w ; x++) {
+                uint32_t p00 = src[offset];
+                uint32_t p10 = src[offset+1];
+                uint32_t p01 = src[offset+bs];
+                uint32_t p11 = src[offset+bs+1];
+                uint32_t rb00 = p00 & 0x00FF00FF;
+                uint32_t rb01 = p01 & 0x00FF00FF;
+                uint32_t rb10 = p10 & 0x00FF00FF;
+                uint32_t rb11 = p11 & 0x00FF00FF;
+                uint32_t ga00 = (p00 >> 8) & 0x00FF00FF;
+                uint32_t ga01 = (p01 >> 8) & 0x00FF00FF;
+                uint32_t ga10 = (p10 >> 8) & 0x00FF00FF;
+                uint32_t ga11 = (p11 >> 8) & 0x00FF00FF;
+                uint32_t rb = (rb00 + rb01 + rb10 + rb11)>>2;
+                uint32_t ga = (ga00 + ga01 + ga10 + ga11)>>2;
+                uint32_t rgba = (rb & 0x00FF00FF) | ((ga & 0x00FF00FF)<<8);
+                dst[x + y*stride] = rgba;
+                offset += 2;
+            }
+        }
+    }
+    else if ((base->format == GGL_PIXEL_FORMAT_RGB_888) ||
+             (base->format == GGL_PIXEL_FORMAT_LA_88) ||
+             (base->format == GGL_PIXEL_FORMAT_A_8) ||
+             (base->format == GGL_PIXEL_FORMAT_L_8))
+    {
+        int skip;
+        switch (base->format) {
+        case GGL_PIXEL_FORMAT_RGB_888:  skip = 3;   break;
+        case GGL_PIXEL_FORMAT_LA_88:    skip = 2;   break;
+        default:                        skip = 1;   break;
+        }
+        uint8_t const * src = (uint8_t const *)base->data;
+        uint8_t* dst = (uint8_t*)cur->data;
+        bs *= skip;
+        stride *= skip;
+        for (int y=y0 ; y<y1 ; y++) {
+            size_t offset = (y*2) * bs;
+            for (int x=0 ; x<w ; x++) {
+                for (int c=0 ; c<skip ; c++) {
+                    uint32_t p00 = src[c+offset];
+                    uint32_t p10 = src[c+offset+skip];
+                    uint32_t p01 = src[c+offset+bs];
+                    uint32_t p11 = src[c+offset+bs+skip];
+                    dst[x + y*stride + c] = (p00 + p10 + p01 + p11) >> 2;
+                }
+                offset += 2*skip;
+            }
+        }
+    }
+    else if (base->format == GGL_PIXEL_FORMAT_RGBA_4444)
+    {
+        uint16_t const * src = (uint16_t const *)base->data;
+        uint16_t* dst = (uint16_t*)cur->data;
+        for (int y=y0 ; y<y1 ; y++) {
+            size_t offset = (y*2) * bs;
+            for (int x=0 ; x<w ; x++) {
+                uint32_t p00 = src[offset];
+                uint32_t p10 = src[offset+1];
+                uint32_t p01 = src[offset+bs];
+                uint32_t p11 = src[offset+bs+1];
+                p00 = ((p00 << 12) & 0x0F0F0000) | (p00 & 0x0F0F);
+                p10 = ((p10 << 12) & 0x0F0F0000) | (p10 & 0x0F0F);
+                p01 = ((p01 << 12) & 0x0F0F0000) | (p01 & 0x0F0F);
+                p11 = ((p11 << 12) & 0x0F0F0000) | (p11 & 0x0F0F);
+                uint32_t rbga = (p00 + p10 + p01 + p11) >> 2;
+                uint32_t rgba = (rbga & 0x0F0F) | ((rbga>>12) & 0xF0F0);
+                dst[x + y*stride] = rgba;
+                offset += 2;
+            }
+        }
+    }
+}
+
+struct mipmap_band_t {
+    const GGLSurface*   base;
+    GGLSurface*         cur;
+    int                 y0;
+    int                 y1;
+};
+
+static void* downsampleBand(void* arg)
+{
+    const mipmap_band_t* band = (const mipmap_band_t*)arg;
+    downsampleRows(band->base, band->cur, band->y0, band->y1);
+    return 0;
+}
+
+// downsample builds the level cur from base, splitting its rows among
+// threads when it is large.
+static void downsample(const GGLSurface* base, GGLSurface* cur)
+{
+    const int h = cur->height;
+    int numThreads = 1;
+    if (int(cur->width) * h >= kMinThreadedTexels) {
+        const long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+        numThreads = numCpus < kMaxThreads ? int(numCpus) : kMaxThreads;
+    }
+    if (numThreads <= 1) {
+        downsampleRows(base, cur, 0, h);
+        return;
+    }
+
+    mipmap_band_t bands[kMaxThreads];
+    pthread_t threads[kMaxThreads];
+    bool started[kMaxThreads];
+    for (int i=0 ; i<numThreads ; i++) {
+        bands[i].base = base;
+        bands[i].cur = cur;
+        bands[i].y0 = (h * i) / numThreads;
+        bands[i].y1 = (h * (i+1)) / numThreads;
+    }
+    // the calling thread builds the first band, and those of the threads
+    // that couldn't be started
+    for (int i=1 ; i<numThreads ; i++) {
+        started[i] = pthread_create(&threads[i], 0,
+                downsampleBand, &bands[i]) == 0;
+    }
+    downsampleBand(&bands[0]);
+    for (int i=1 ; i<numThreads ; i++) {
+        if (started[i]) {
+            pthread_join(threads[i], 0);
+        } else {
+            downsampleBand(&bands[i]);
+        }
+    }
+}
+
 status_t buildAPyramid(ogles_context_t* c, EGLTextureObject* tex)
 {
     int level = 0;
-    const GGLSurface* base = &tex->surface;    
+    const GGLSurface* base = &tex->surface;
     const GGLFormat& pixelFormat(c->rasterizer.formats[base->format]);
 
     int w = base->width;
@@ -38,6 +403,11 @@ status_t buildAPyramid(ogles_context_t* c, EGLTextureObject* tex)
     if ((w&h) == 1)
         return NO_ERROR;
 
+    if (!isMipmapFormat(base->format)) {
+        ALOGE("Unsupported format (%d)", base->format);
+        return BAD_TYPE;
+    }
+
     w = (w>>1) ? : 1;
     h = (h>>1) ? : 1;
 
@@ -48,135 +418,9 @@ status_t buildAPyramid(ogles_context_t* c, EGLTextureObject* tex)
                 base->format, base->compressedFormat, bpr) != NO_ERROR) {
             return NO_MEMORY;
         }
-    
-        int stride = w;
-        int bs = base->stride;
-        GGLSurface& cur = tex->editMip(level);
 
-        if (base->format == GGL_PIXEL_FORMAT_RGB_565)
-        {
-            uint16_t const * src = (uint16_t const *)base->data;
-            uint16_t* dst = (uint16_t*)cur.data;
-            const uint32_t mask = 0x07E0F81F;
-            for (int y=0 ; y<h ; y++) {
-                size_t offset = (y*2) * bs;
-                for (int x=0 ; x<w ; x++) {
-                    uint32_t p00 = src[offset];
-                    uint32_t p10 = src[offset+1];
-                    uint32_t p01 = src[offset+bs];
-                    uint32_t p11 = src[offset+bs+1];
-                    p00 = (p00 | (p00 << 16)) & mask;
-                    p01 = (p01 | (p01 << 16)) & mask;
-                    p10 = (p10 | (p10 << 16)) & mask;
-                    p11 = (p11 | (p11 << 16)) & mask;
-                    uint32_t grb = ((p00 + p10 + p01 + p11) >> 2) & mask;
-                    uint32_t rgb = (grb & 0xFFFF) | (grb >> 16);
-                    dst[x + y*stride] = rgb;
-                    offset += 2;
-                }
-            }
-        }
-        else if (base->format == GGL_PIXEL_FORMAT_RGBA_5551)
-        {
-            uint16_t const * src = (uint16_t const *)base->data;
-            uint16_t* dst = (uint16_t*)cur.data;
-            for (int y=0 ; y<h ; y++) {
-                size_t offset = (y*2) * bs;
-                for (int x=0 ; x<w ; x++) {
-                    uint32_t p00 = src[offset];
-                    uint32_t p10 = src[offset+1];
-                    uint32_t p01 = src[offset+bs];
-                    uint32_t p11 = src[offset+bs+1];
-                    uint32_t r = ((p00>>11)+(p10>>11)+(p01>>11)+(p11>>11)+2)>>2;
-                    uint32_t g = (((p00>>6)+(p10>>6)+(p01>>6)+(p11>>6)+2)>>2)&0x3F;
-                    uint32_t b = ((p00&0x3E)+(p10&0x3E)+(p01&0x3E)+(p11&0x3E)+4)>>3;
-                    uint32_t a = ((p00&1)+(p10&1)+(p01&1)+(p11&1)+2)>>2;
-                    dst[x + y*stride] = (r<<11)|(g<<6)|(b<<1)|a;
-                    offset += 2;
-                }
-            }
-        }
-        else if (base->format == GGL_PIXEL_FORMAT_RGBA_8888)
-        {
-            uint32_t const * src = (uint32_t const *)base->data;
-            uint32_t* dst = (uint32_t*)cur.data;
-            for (int y=0 ; y<h ; y++) {
-                size_t offset = (y*2) * bs;
-                for (int x=0 ; x<w ; x++) {
-                    uint32_t p00 = src[offset];
-                    uint32_t p10 = src[offset+1];
-                    uint32_t p01 = src[offset+bs];
-                    uint32_t p11 = src[offset+bs+1];
-                    uint32_t rb00 = p00 & 0x00FF00FF;
-                    uint32_t rb01 = p01 & 0x00FF00FF;
-                    uint32_t rb10 = p10 & 0x00FF00FF;
-                    uint32_t rb11 = p11 & 0x00FF00FF;
-                    uint32_t ga00 = (p00 >> 8) & 0x00FF00FF;
-                    uint32_t ga01 = (p01 >> 8) & 0x00FF00FF;
-                    uint32_t ga10 = (p10 >> 8) & 0x00FF00FF;
-                    uint32_t ga11 = (p11 >> 8) & 0x00FF00FF;
-                    uint32_t rb = (rb00 + rb01 + rb10 + rb11)>>2;
-                    uint32_t ga = (ga00 + ga01 + ga10 + ga11)>>2;
-                    uint32_t rgba = (rb & 0x00FF00FF) | ((ga & 0x00FF00FF)<<8);
-                    dst[x + y*stride] = rgba;
-                    offset += 2;
-                }
-            }
-        }
-        else if ((base->format == GGL_PIXEL_FORMAT_RGB_888) ||
-                 (base->format == GGL_PIXEL_FORMAT_LA_88) ||
-                 (base->format == GGL_PIXEL_FORMAT_A_8) ||
-                 (base->format == GGL_PIXEL_FORMAT_L_8))
-        {
-            int skip;
-            switch (base->format) {
-            case GGL_PIXEL_FORMAT_RGB_888:  skip = 3;   break;
-            case GGL_PIXEL_FORMAT_LA_88:    skip = 2;   break;
-            default:                        skip = 1;   break;
-            }
-            uint8_t const * src = (uint8_t const *)base->data;
-            uint8_t* dst = (uint8_t*)cur.data;            
-            bs *= skip;
-            stride *= skip;
-            for (int y=0 ; y<h ; y++) {
-                size_t offset = (y*2) * bs;
-                for (int x=0 ; x<w ; x++) {
-                    for (int c=0 ; c<skip ; c++) {
-                        uint32_t p00 = src[c+offset];
-                        uint32_t p10 = src[c+offset+skip];
-                        uint32_t p01 = src[c+offset+bs];
-                        uint32_t p11 = src[c+offset+bs+skip];
-                        dst[x + y*stride + c] = (p00 + p10 + p01 + p11) >> 2;
-                    }
-                    offset += 2*skip;
-                }
-            }
-        }
-        else if (base->format == GGL_PIXEL_FORMAT_RGBA_4444)
-        {
-            uint16_t const * src = (uint16_t const *)base->data;
-            uint16_t* dst = (uint16_t*)cur.data;
-            for (int y=0 ; y<h ; y++) {
-                size_t offset = (y*2) * bs;
-                for (int x=0 ; x<w ; x++) {
-                    uint32_t p00 = src[offset];
-                    uint32_t p10 = src[offset+1];
-                    uint32_t p01 = src[offset+bs];
-                    uint32_t p11 = src[offset+bs+1];
-                    p00 = ((p00 << 12) & 0x0F0F0000) | (p00 & 0x0F0F);
-                    p10 = ((p10 << 12) & 0x0F0F0000) | (p10 & 0x0F0F);
-                    p01 = ((p01 << 12) & 0x0F0F0000) | (p01 & 0x0F0F);
-                    p11 = ((p11 << 12) & 0x0F0F0000) | (p11 & 0x0F0F);
-                    uint32_t rbga = (p00 + p10 + p01 + p11) >> 2;
-                    uint32_t rgba = (rbga & 0x0F0F) | ((rbga>>12) & 0xF0F0);
-                    dst[x + y*stride] = rgba;
-                    offset += 2;
-                }
-            }
-        } else {
-            ALOGE("Unsupported format (%d)", base->format);
-            return BAD_TYPE;
-        }
+        GGLSurface& cur = tex->editMip(level);
+        downsample(base, &cur);
 
         // exit condition: we just processed the 1x1 LODs
         if ((w&h) == 1)
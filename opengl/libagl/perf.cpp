@@ -0,0 +1,100 @@
+/* libs/opengles/perf.cpp
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include <stdlib.h>
+#include <string.h>
+
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "context.h"
+#include "perf.h"
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+void ogles_init_perf(ogles_context_t* c)
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.libagl.perf_frames", value, "0");
+    const int period = atoi(value);
+    c->perf.period = period > 0 ? period : 0;
+}
+
+void ogles_perf_triangle(ogles_context_t* c)
+{
+    const uint32_t enables = c->rasterizer.state.enables;
+    int path = 0;
+    if (enables & GGL_ENABLE_TMUS)          path |= perf_counters_t::PATH_TEXTURE;
+    if (enables & GGL_ENABLE_SMOOTH)        path |= perf_counters_t::PATH_SMOOTH;
+    if (enables & GGL_ENABLE_BLENDING)      path |= perf_counters_t::PATH_BLEND;
+    if (enables & GGL_ENABLE_DEPTH_TEST)    path |= perf_counters_t::PATH_DEPTH;
+
+    // the area is twice the triangle's, in subpixels squared
+    int64_t area = c->lerp.area();
+    if (area < 0)
+        area = -area;
+    c->perf.triangles[path]++;
+    c->perf.pixels[path] += area >> (2*TRI_FRACTION_BITS + 1);
+}
+
+static inline unsigned long long us(int64_t ns) {
+    return (unsigned long long)(ns / 1000);
+}
+
+void ogles_perf_frame(ogles_context_t* c, nsecs_t swapTime)
+{
+    perf_counters_t& p(c->perf);
+    if (!p.period)
+        return;
+
+    p.swapTime += swapTime;
+    if (++p.frames < p.period)
+        return;
+
+    ALOGD("perf: %u frames, %llu draws (%llu us), swap %llu us",
+            p.frames, (unsigned long long)p.draws, us(p.drawTime),
+            us(p.swapTime));
+    ALOGD("perf: %llu vertices transformed, %llu/%llu indexed cache hits, "
+            "%llu triangles culled, %llu clipped",
+            (unsigned long long)p.vertices,
+            (unsigned long long)(p.lookups - p.misses),
+            (unsigned long long)p.lookups,
+            (unsigned long long)p.culled,
+            (unsigned long long)p.clipped);
+    for (int i=0 ; i<perf_counters_t::PATH_COUNT ; i++) {
+        if (!p.triangles[i])
+            continue;
+        ALOGD("perf: path%s%s%s%s: %llu triangles, %llu pixels",
+                (i & perf_counters_t::PATH_TEXTURE) ? " texture" : "",
+                (i & perf_counters_t::PATH_SMOOTH)  ? " smooth"  : " flat",
+                (i & perf_counters_t::PATH_BLEND)   ? " blend"   : "",
+                (i & perf_counters_t::PATH_DEPTH)   ? " depth"   : "",
+                (unsigned long long)p.triangles[i],
+                (unsigned long long)p.pixels[i]);
+    }
+    ALOGD("perf: %llu texture bytes uploaded (%llu us)",
+            (unsigned long long)p.textureBytes, us(p.textureTime));
+
+    const uint32_t period = p.period;
+    memset(&p, 0, sizeof(p));
+    p.period = period;
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
@@ -0,0 +1,88 @@
+/* libs/opengles/perf.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef ANDROID_OPENGLES_PERF_H
+#define ANDROID_OPENGLES_PERF_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include <utils/Timers.h>
+
+#include "context.h"
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+// Performance counters
+//
+// When debug.libagl.perf_frames is set to a number of frames, each context
+// counts the work done by its draw calls and texture uploads, and logs it
+// every that many eglSwapBuffers. The counters cost a test per call or per
+// triangle when they're disabled.
+// ----------------------------------------------------------------------------
+
+void ogles_init_perf(ogles_context_t* c);
+void ogles_perf_triangle(ogles_context_t* c);
+void ogles_perf_frame(ogles_context_t* c, nsecs_t swapTime);
+
+inline nsecs_t perf_begin(ogles_context_t* c) {
+    return ggl_unlikely(c->perf.period) ? systemTime(SYSTEM_TIME_MONOTONIC) : 0;
+}
+
+// the vertices transformed by a draw call, and the cache lookups for
+// indexed draw calls, the misses being the vertices.
+inline void perf_draw(ogles_context_t* c, nsecs_t start,
+        uint32_t vertices, uint32_t lookups) {
+    if (ggl_unlikely(c->perf.period)) {
+        perf_counters_t& p(c->perf);
+        p.draws++;
+        p.vertices += vertices;
+        if (lookups) {
+            p.lookups += lookups;
+            p.misses += vertices;
+        }
+        p.drawTime += systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    }
+}
+
+inline void perf_texture(ogles_context_t* c, nsecs_t start, size_t bytes) {
+    if (ggl_unlikely(c->perf.period)) {
+        c->perf.textureBytes += bytes;
+        c->perf.textureTime += systemTime(SYSTEM_TIME_MONOTONIC) - start;
+    }
+}
+
+inline void perf_triangle(ogles_context_t* c) {
+    if (ggl_unlikely(c->perf.period))
+        ogles_perf_triangle(c);
+}
+
+inline void perf_culled(ogles_context_t* c) {
+    if (ggl_unlikely(c->perf.period))
+        c->perf.culled++;
+}
+
+inline void perf_clipped(ogles_context_t* c) {
+    if (ggl_unlikely(c->perf.period))
+        c->perf.clipped++;
+}
+
+}; // namespace android
+
+#endif // ANDROID_OPENGLES_PERF_H
@@ -26,6 +26,8 @@
 #include "vertex.h"
 #include "fp.h"
 #include "TextureObjectManager.h"
+#include "perf.h"
+#include "tiler.h"
 
 extern "C" void iterators0032(const void* that,
         int32_t* it, int32_t c0, int32_t c1, int32_t c2);
@@ -103,7 +105,7 @@ static void lightTriangleDarkFlat(ogles_context_t* c,
         c->arrays.color.fetch(c, v2->color.v, cp);
     }
     // configure the rasterizer here, before we clip
-    c->rasterizer.procs.color4xv(c, v2->color.v);
+    tiler_color4xv(c, v2->color.v);
 }
 
 static void lightTriangleSmooth(ogles_context_t* c,
@@ -123,7 +125,7 @@ static void lightTriangleFlat(ogles_context_t* c,
     if (!(v2->flags & vertex_t::LIT))
         c->lighting.lightVertex(c, v2);
     // configure the rasterizer here, before we clip
-    c->rasterizer.procs.color4xv(c, v2->color.v);
+    tiler_color4xv(c, v2->color.v);
 }
 
 // The fog versions...
@@ -171,7 +173,7 @@ static void lightTriangleDarkFlatFog(ogles_context_t* c,
     lightVertexDarkFlatFog(c, v1);
     lightVertexDarkSmoothFog(c, v2);
     // configure the rasterizer here, before we clip
-    c->rasterizer.procs.color4xv(c, v2->color.v);
+    tiler_color4xv(c, v2->color.v);
 }
 
 static void lightTriangleSmoothFog(ogles_context_t* c,
@@ -189,7 +191,7 @@ static void lightTriangleFlatFog(ogles_context_t* c,
     lightVertexDarkFlatFog(c, v1);
     lightVertexSmoothFog(c, v2);
     // configure the rasterizer here, before we clip
-    c->rasterizer.procs.color4xv(c, v2->color.v);
+    tiler_color4xv(c, v2->color.v);
 }
 
 
@@ -600,6 +602,8 @@ void primitive_clip_triangle(ogles_context_t* c,
     // being culled out. So it's okay to light the vertices here, even though
     // in a few cases we won't render the triangle (if culled).
 
+    perf_clipped(c);
+
     // Fetch texture coordinates...
     fetch_texcoord(c, v0, v1, v2);
 
@@ -625,7 +629,8 @@ void triangle(ogles_context_t* c,
     if (ggl_likely(enables & mask))
         lerp_triangle(c, v0, v1, v2);
 
-    c->rasterizer.procs.trianglex(c, v0->window.v, v1->window.v, v2->window.v);
+    perf_triangle(c);
+    tiler_trianglex(c, v0->window.v, v1->window.v, v2->window.v);
 }
 
 void lerp_triangle(ogles_context_t* c,
@@ -653,7 +658,7 @@ void lerp_triangle(ogles_context_t* c,
             const GGLcolor c2 = v2->color.v[i] * 255;
             lerp.iterators1616(&itc[i*3], c0, c1, c2);
         }
-        c->rasterizer.procs.colorGrad12xv(c, itc);
+        tiler_colorGrad12xv(c, itc);
     }
 
     if (enables & GGL_ENABLE_DEPTH_TEST) {
@@ -679,13 +684,13 @@ void lerp_triangle(ogles_context_t* c,
         } else {
             lerp.iterators0032(itz, v0z, v1z, v2z);
         }
-        c->rasterizer.procs.zGrad3xv(c, itz);
+        tiler_zGrad3xv(c, itz);
     }    
 
     if (ggl_unlikely(enables & GGL_ENABLE_FOG)) {
         GLfixed itf[3];
         lerp.iterators1616(itf, v0->fog, v1->fog, v2->fog);
-        c->rasterizer.procs.fogGrad3xv(c, itf);
+        tiler_fogGrad3xv(c, itf);
     }
 }
 
@@ -733,7 +738,7 @@ void lerp_texcoords(ogles_context_t* c,
         const GLenum min_filter = c->textures.tmu[i].texture->min_filter;
         if (ggl_unlikely(min_filter >= GL_NEAREST_MIPMAP_NEAREST)) {
             int lod = compute_lod(c, i, s0, t0, s1, t1, s2, t2);
-            c->rasterizer.procs.bindTextureLod(c, i,
+            tiler_bindTextureLod(c, i,
                     &c->textures.tmu[i].texture->mip(lod));
         }
 
@@ -752,7 +757,7 @@ void lerp_texcoords(ogles_context_t* c,
         }
         itt[6] = -lerp.iteratorsScale(itt+0, s0, s1, s2);
         itt[7] = -lerp.iteratorsScale(itt+3, t0, t1, t2);
-        c->rasterizer.procs.texCoordGradScale8xv(c, i, itt);
+        tiler_texCoordGradScale8xv(c, i, itt);
     }
 }
 
@@ -772,7 +777,7 @@ void lerp_texcoords_w(ogles_context_t* c,
     // compute the jacobian using block floating-point    
     int sc = lerp.iteratorsScale(itw, w0, w1, w2);
     sc +=  wscale - 16;
-    c->rasterizer.procs.wGrad3xv(c, itw);
+    tiler_wGrad3xv(c, itw);
 
     for (int i=0 ; i<GGL_TEXTURE_UNIT_COUNT ; i++) {
         const texture_t& tmu = c->rasterizer.state.texture[i];
@@ -790,7 +795,7 @@ void lerp_texcoords_w(ogles_context_t* c,
         const GLenum min_filter = c->textures.tmu[i].texture->min_filter;
         if (ggl_unlikely(min_filter >= GL_NEAREST_MIPMAP_NEAREST)) {
             int lod = compute_lod(c, i, s0, t0, s1, t1, s2, t2);
-            c->rasterizer.procs.bindTextureLod(c, i,
+            tiler_bindTextureLod(c, i,
                     &c->textures.tmu[i].texture->mip(lod));
         }
 
@@ -817,7 +822,7 @@ void lerp_texcoords_w(ogles_context_t* c,
 
         itt[6] = sc - lerp.iteratorsScale(itt+0, s0, s1, s2);
         itt[7] = sc - lerp.iteratorsScale(itt+3, t0, t1, t2);
-        c->rasterizer.procs.texCoordGradScale8xv(c, i, itt);
+        tiler_texCoordGradScale8xv(c, i, itt);
     }
 }
 
@@ -828,8 +833,10 @@ bool cull_triangle(ogles_context_t* c, vertex_t* /*v0*/, vertex_t* /*v1*/, verte
     if (ggl_likely(c->cull.enable)) {
         const GLenum winding = (c->lerp.area() > 0) ? GL_CW : GL_CCW;
         const GLenum face = (winding == c->cull.frontFace) ? GL_FRONT : GL_BACK;
-        if (face == c->cull.cullFace)
+        if (face == c->cull.cullFace) {
+            perf_culled(c);
             return true; // culled!
+        }
     }
     return false;
 }
@@ -20,6 +20,8 @@
 #include "context.h"
 #include "fp.h"
 #include "state.h"
+#include "tiler.h"
+#include "perf.h"
 #include "array.h"
 #include "matrix.h"
 #include "vertex.h"
@@ -87,6 +89,8 @@ ogles_context_t *ogles_init(size_t extra)
     ogles_init_vertex(c);
     ogles_init_light(c);
     ogles_init_texture(c);
+    ogles_init_tiler(c);
+    ogles_init_perf(c);
 
     c->rasterizer.base = base;
     c->point.size = TRI_ONE;
@@ -108,6 +112,7 @@ void ogles_uninit(ogles_context_t* c)
     ogles_uninit_vertex(c);
     ogles_uninit_light(c);
     ogles_uninit_texture(c);
+    ogles_uninit_tiler(c);
     c->surfaceManager->decStrong(c);
     c->bufferObjectManager->decStrong(c);
     ggl_uninit_context(&(c->rasterizer));
@@ -181,9 +186,13 @@ static void enable_disable(ogles_context_t* c, GLenum cap, int enabled)
     case GL_FOG:
     case GL_DEPTH_TEST:
         ogles_invalidate_perspective(c);
-        // fall-through...
-    case GL_BLEND:
+        c->rasterizer.procs.enableDisable(c, cap, enabled);
+        break;
     case GL_SCISSOR_TEST:
+        c->viewport.scissor.enable = enabled;
+        c->rasterizer.procs.enableDisable(c, cap, enabled);
+        break;
+    case GL_BLEND:
     case GL_ALPHA_TEST:
     case GL_COLOR_LOGIC_OP:
     case GL_DITHER:
@@ -17,8 +17,11 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <cutils/log.h>
+
 #include "context.h"
 #include "fp.h"
+#include "perf.h"
 #include "state.h"
 #include "texture.h"
 #include "TextureObjectManager.h"
@@ -114,62 +117,31 @@ void invalidate_texture(ogles_context_t* c, int tmu, uint8_t flags = 0xFF) {
 
 /*
  * If the active textures are EGLImage, they need to be locked before
- * they can be used.
- *
- * FIXME: code below is far from being optimal
- *
+ * they can be used. They stay locked after that, until they're given
+ * another image, so this is a no-op for the draws that follow.
  */
 
 void ogles_lock_textures(ogles_context_t* c)
 {
+    bool changed = false;
     for (int i=0 ; i<GGL_TEXTURE_UNIT_COUNT ; i++) {
         if (c->rasterizer.state.texture[i].enable) {
             texture_unit_t& u(c->textures.tmu[i]);
-            ANativeWindowBuffer* native_buffer = u.texture->buffer;
-            if (native_buffer) {
-                c->rasterizer.procs.activeTexture(c, i);
-                hw_module_t const* pModule;
-                if (hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &pModule))
+            if (u.texture->buffer && !u.texture->isImageLocked()) {
+                status_t err = u.texture->lockImage();
+                if (err != NO_ERROR) {
+                    ALOGE("couldn't lock EGLImage buffer %p (%d)",
+                            u.texture->buffer, err);
                     continue;
-
-                gralloc_module_t const* module =
-                    reinterpret_cast<gralloc_module_t const*>(pModule);
-
-                void* vaddr;
-                int err = module->lock(module, native_buffer->handle,
-                        GRALLOC_USAGE_SW_READ_OFTEN,
-                        0, 0, native_buffer->width, native_buffer->height,
-                        &vaddr);
-
-                u.texture->setImageBits(vaddr);
-                c->rasterizer.procs.bindTexture(c, &(u.texture->surface));
-            }
-        }
-    }
-}
-
-void ogles_unlock_textures(ogles_context_t* c)
-{
-    for (int i=0 ; i<GGL_TEXTURE_UNIT_COUNT ; i++) {
-        if (c->rasterizer.state.texture[i].enable) {
-            texture_unit_t& u(c->textures.tmu[i]);
-            ANativeWindowBuffer* native_buffer = u.texture->buffer;
-            if (native_buffer) {
+                }
                 c->rasterizer.procs.activeTexture(c, i);
-                hw_module_t const* pModule;
-                if (hw_get_module(GRALLOC_HARDWARE_MODULE_ID, &pModule))
-                    continue;
-
-                gralloc_module_t const* module =
-                    reinterpret_cast<gralloc_module_t const*>(pModule);
-
-                module->unlock(module, native_buffer->handle);
-                u.texture->setImageBits(NULL);
                 c->rasterizer.procs.bindTexture(c, &(u.texture->surface));
+                changed = true;
             }
         }
     }
-    c->rasterizer.procs.activeTexture(c, c->textures.active);
+    if (changed)
+        c->rasterizer.procs.activeTexture(c, c->textures.active);
 }
 
 // ----------------------------------------------------------------------------
@@ -266,7 +238,7 @@ GGLContext* getRasterizer(ogles_context_t* c)
 }
 
 static __attribute__((noinline))
-int copyPixels(
+int convertPixels(
         ogles_context_t* c,
         const GGLSurface& dst,
         GLint xoffset, GLint yoffset,
@@ -288,6 +260,29 @@ int copyPixels(
         return 0;
     }
 
+    if ((dst.format == src.format) &&
+        (dst.stride > 0) && (src.stride > 0) &&
+        ((x|y|xoffset|yoffset) >= 0) &&
+        (xoffset + w <= GLint(dst.width)) &&
+        (yoffset + h <= GLint(dst.height)) &&
+        (x + w <= GLint(src.width)) &&
+        (y + h <= GLint(src.height)))
+    {
+        // sub-images of the same format don't need any conversion,
+        // copy them a row at a time
+        const GGLFormat& pixelFormat(c->rasterizer.formats[src.format]);
+        const size_t bpp = pixelFormat.size;
+        const size_t bpr = w * bpp;
+        uint8_t* d = (uint8_t*)dst.data + (yoffset * dst.stride + xoffset) * bpp;
+        const uint8_t* s = (const uint8_t*)src.data + (y * src.stride + x) * bpp;
+        for (GLsizei j=0 ; j<h ; j++) {
+            memcpy(d, s, bpr);
+            d += dst.stride * bpp;
+            s += src.stride * bpp;
+        }
+        return 0;
+    }
+
     // use pixel-flinger to handle all the conversions
     GGLContext* ggl = getRasterizer(c);
     if (!ggl) {
@@ -302,6 +297,20 @@ int copyPixels(
     return 0;
 }
 
+static inline
+int copyPixels(
+        ogles_context_t* c,
+        const GGLSurface& dst,
+        GLint xoffset, GLint yoffset,
+        const GGLSurface& src,
+        GLint x, GLint y, GLsizei w, GLsizei h)
+{
+    const nsecs_t start = perf_begin(c);
+    int err = convertPixels(c, dst, xoffset, yoffset, src, x, y, w, h);
+    perf_texture(c, start, w * h * c->rasterizer.formats[dst.format].size);
+    return err;
+}
+
 // ----------------------------------------------------------------------------
 
 static __attribute__((noinline))
@@ -751,8 +760,6 @@ static void drawTexxOESImp(GLfixed x, GLfixed y, GLfixed z, GLfixed w, GLfixed h
             gglFixedToIntRound(y),
             gglFixedToIntRound(x)+w,
             gglFixedToIntRound(y)+h);
-
-    ogles_unlock_textures(c);
 }
 
 static void drawTexxOES(GLfixed x, GLfixed y, GLfixed z, GLfixed w, GLfixed h,
@@ -825,9 +832,6 @@ static void drawTexiOES(GLint x, GLint y, GLint z, GLint w, GLint h, ogles_conte
             c->rasterizer.procs.disable(c, GGL_AA);
             c->rasterizer.procs.shadeModel(c, GL_FLAT);
             c->rasterizer.procs.recti(c, x, y, x+w, y+h);
-
-            ogles_unlock_textures(c);
-
             return;
         }
     }
@@ -1116,6 +1120,7 @@ void glCompressedTexImage2D(
 
     int32_t size;
     GGLSurface* surface;
+    const nsecs_t start = perf_begin(c);
 
 #ifdef GL_OES_compressed_ETC1_RGB8_texture
     if (internalformat == GL_ETC1_RGB8_OES) {
@@ -1136,6 +1141,7 @@ void glCompressedTexImage2D(
                 width, height, 3, surface->stride*3) != 0) {
             ogles_error(c, GL_INVALID_OPERATION);
         }
+        perf_texture(c, start, size);
         return;
     }
 #endif
@@ -1148,6 +1154,7 @@ void glCompressedTexImage2D(
         return;
     }
 
+    size_t bytes = 0;
     for (int i=0 ; i<numLevels ; i++) {
         int lod_w = (width  >> i) ? : 1;
         int lod_h = (height >> i) ? : 1;
@@ -1159,7 +1166,9 @@ void glCompressedTexImage2D(
         }
         decodePalette4(data, i, width, height,
                 surface->data, surface->stride, internalformat);
+        bytes += size;
     }
+    perf_texture(c, start, bytes);
 }
 
 
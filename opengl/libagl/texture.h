@@ -34,7 +34,6 @@ void ogles_init_texture(ogles_context_t* c);
 void ogles_uninit_texture(ogles_context_t* c);
 void ogles_validate_texture(ogles_context_t* c);
 void ogles_lock_textures(ogles_context_t* c);
-void ogles_unlock_textures(ogles_context_t* c);
 
 }; // namespace android
 
@@ -0,0 +1,406 @@
+/* libs/opengles/tiler.cpp
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#include <limits.h>
+#include <malloc.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <cutils/atomic.h>
+#include <cutils/log.h>
+#include <cutils/properties.h>
+
+#include "context.h"
+#include "tiler.h"
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+
+// The height of the bands the threads take in turn.
+static const int32_t kBandHeight = 32;
+
+// Draws covering fewer rows, summed over their triangles, are replayed on
+// the calling thread, as waking up the threads would cost more than it saves.
+static const int32_t kMinTiledRows = 256;
+
+static const int kMaxThreads = 8;
+
+struct tiler_cmd_t {
+    int32_t             v[12] __attribute__((aligned(16)));
+    const GGLSurface*   surface;
+    int32_t             top;
+    int32_t             bottom;
+    uint8_t             op;
+    uint8_t             tmu;
+};
+
+struct tiler_t {
+    tiler_cmd_t*    cmds;
+    size_t          count;
+    size_t          capacity;
+    int32_t         rows;
+};
+
+// A draw call being rasterized: the bands of [top, bottom) are taken in turn
+// by the threads, and clipped to [left, right).
+struct tiler_job_t {
+    const tiler_t*  tiler;
+    const state_t*  state;
+    int32_t         left;
+    int32_t         top;
+    int32_t         right;
+    int32_t         bottom;
+    volatile int32_t nextBand;
+};
+
+struct tiler_thread_t {
+    context_t*      gl;
+    // the generation of the pool when the thread was started
+    uint32_t        generation;
+};
+
+struct tiler_pool_t {
+    pthread_mutex_t lock;
+    pthread_cond_t  start;
+    pthread_cond_t  done;
+    // serializes the draw calls of all contexts
+    pthread_mutex_t drawLock;
+    // the number of threads, including the ones drawing for them
+    int             numThreads;
+    int             numStarted;
+    tiler_thread_t  threads[kMaxThreads];
+    uint32_t        generation;
+    int             pending;
+    tiler_job_t*    job;
+};
+
+static pthread_once_t sPoolOnce = PTHREAD_ONCE_INIT;
+static tiler_pool_t sPool = {
+    PTHREAD_MUTEX_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+    PTHREAD_COND_INITIALIZER,
+    PTHREAD_MUTEX_INITIALIZER,
+    0, 0, { { 0, 0 } }, 0, 0, 0
+};
+
+static void init_pool()
+{
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.libagl.raster_threads", value, "0");
+    int n = atoi(value);
+    const long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (n > numCpus)
+        n = int(numCpus);
+    if (n > kMaxThreads)
+        n = kMaxThreads;
+    if (n < 2)
+        return;
+
+    for (int i=0 ; i<n ; i++) {
+        context_t* gl = (context_t*)memalign(32, sizeof(context_t));
+        if (!gl)
+            break;
+        memset(gl, 0, sizeof(context_t));
+        ggl_init_context(gl);
+        sPool.threads[i].gl = gl;
+        sPool.numThreads = i + 1;
+    }
+    if (sPool.numThreads < 2) {
+        sPool.numThreads = 0;
+        return;
+    }
+    ALOGD("rasterizing with %d threads", sPool.numThreads);
+}
+
+// ----------------------------------------------------------------------------
+
+static void replay(context_t* gl, const tiler_t* t,
+        int32_t top, int32_t bottom)
+{
+    const tiler_cmd_t* cmd = t->cmds;
+    const tiler_cmd_t* const end = cmd + t->count;
+    for ( ; cmd < end ; cmd++) {
+        switch (cmd->op) {
+        case TILER_COLOR:
+            gl->procs.color4xv(gl, cmd->v);
+            break;
+        case TILER_COLOR_GRAD:
+            gl->procs.colorGrad12xv(gl, cmd->v);
+            break;
+        case TILER_Z_GRAD:
+            gl->procs.zGrad3xv(gl, cmd->v);
+            break;
+        case TILER_FOG_GRAD:
+            gl->procs.fogGrad3xv(gl, cmd->v);
+            break;
+        case TILER_W_GRAD:
+            gl->procs.wGrad3xv(gl, cmd->v);
+            break;
+        case TILER_TEXCOORD_GRAD:
+            gl->procs.texCoordGradScale8xv(gl, cmd->tmu, cmd->v);
+            break;
+        case TILER_BIND_TEXTURE_LOD:
+            gl->procs.bindTextureLod(gl, cmd->tmu, cmd->surface);
+            break;
+        case TILER_TRIANGLE:
+            if (cmd->top < bottom && cmd->bottom > top)
+                gl->procs.trianglex(gl, cmd->v, cmd->v + 4, cmd->v + 8);
+            break;
+        }
+    }
+}
+
+static void draw_bands(context_t* gl, tiler_job_t* job)
+{
+    bool prepared = false;
+    for (;;) {
+        const int32_t band = android_atomic_inc(&job->nextBand);
+        const int32_t top = job->top + band * kBandHeight;
+        if (top >= job->bottom)
+            break;
+        const int32_t bottom = min(top + kBandHeight, job->bottom);
+        if (!prepared) {
+            // Take the context's state, and have the rasterizer picked
+            // anew for it, which toggling the scissor test does.
+            gl->state = *job->state;
+            gl->procs.disable(gl, GL_SCISSOR_TEST);
+            prepared = true;
+        }
+        gl->procs.scissor(gl, job->left, top,
+                job->right - job->left, bottom - top);
+        gl->procs.enable(gl, GL_SCISSOR_TEST);
+        replay(gl, job->tiler, top, bottom);
+    }
+}
+
+static void* tiler_thread(void* arg)
+{
+    context_t* const gl = ((tiler_thread_t*)arg)->gl;
+    uint32_t generation = ((tiler_thread_t*)arg)->generation;
+    pthread_mutex_lock(&sPool.lock);
+    for (;;) {
+        while (sPool.generation == generation)
+            pthread_cond_wait(&sPool.start, &sPool.lock);
+        generation = sPool.generation;
+        tiler_job_t* const job = sPool.job;
+        pthread_mutex_unlock(&sPool.lock);
+
+        draw_bands(gl, job);
+
+        pthread_mutex_lock(&sPool.lock);
+        if (--sPool.pending == 0)
+            pthread_cond_signal(&sPool.done);
+    }
+    return 0;
+}
+
+// Starts the threads, the first time they're needed, which must be with
+// drawLock held. The caller draws with the first context.
+static void start_threads()
+{
+    while (sPool.numStarted < sPool.numThreads - 1) {
+        const int i = sPool.numStarted + 1;
+        sPool.threads[i].generation = sPool.generation;
+        pthread_t thread;
+        pthread_attr_t attr;
+        pthread_attr_init(&attr);
+        pthread_attr_setdetachstate(&attr, PTHREAD_CREATE_DETACHED);
+        const int err = pthread_create(&thread, &attr,
+                tiler_thread, &sPool.threads[i]);
+        pthread_attr_destroy(&attr);
+        if (err) {
+            ALOGE("could not start a rasterizer thread (%s)", strerror(err));
+            break;
+        }
+        sPool.numStarted++;
+    }
+}
+
+static void flush(ogles_context_t* c)
+{
+    tiler_t* const t = c->tiler;
+    if (!t->count)
+        return;
+
+    if (t->rows < kMinTiledRows) {
+        // the rasterizer already has the last state, replaying it again
+        // from the start gives the triangles theirs
+        replay(&c->rasterizer, t, INT_MIN, INT_MAX);
+        t->count = 0;
+        t->rows = 0;
+        return;
+    }
+
+    // The bands are clipped to the scissor box, in the rasterizer's
+    // coordinates, as ogles_scissor sets it
+    const int32_t width = c->rasterizer.state.buffers.color.width;
+    const int32_t height = c->rasterizer.state.buffers.color.height;
+    tiler_job_t job;
+    job.tiler = t;
+    job.state = &c->rasterizer.state;
+    job.left = 0;
+    job.top = 0;
+    job.right = width;
+    job.bottom = height;
+    job.nextBand = 0;
+    if (c->viewport.scissor.enable) {
+        const int32_t x = c->viewport.scissor.x + c->viewport.surfaceport.x;
+        const int32_t y = height - (c->viewport.scissor.y +
+                c->viewport.surfaceport.y + c->viewport.scissor.h);
+        job.left = max(job.left, x);
+        job.top = max(job.top, y);
+        job.right = min(job.right, x + c->viewport.scissor.w);
+        job.bottom = min(job.bottom, y + c->viewport.scissor.h);
+    }
+
+    if (job.left < job.right && job.top < job.bottom) {
+        pthread_mutex_lock(&sPool.drawLock);
+        start_threads();
+        pthread_mutex_lock(&sPool.lock);
+        sPool.job = &job;
+        sPool.pending = sPool.numStarted;
+        sPool.generation++;
+        pthread_cond_broadcast(&sPool.start);
+        pthread_mutex_unlock(&sPool.lock);
+
+        draw_bands(sPool.threads[0].gl, &job);
+
+        pthread_mutex_lock(&sPool.lock);
+        while (sPool.pending)
+            pthread_cond_wait(&sPool.done, &sPool.lock);
+        pthread_mutex_unlock(&sPool.lock);
+        pthread_mutex_unlock(&sPool.drawLock);
+    }
+    t->count = 0;
+    t->rows = 0;
+}
+
+// Returns a command to record, or null if the recording can't grow, in which
+// case what is recorded is drawn and tiling stops for the rest of the draw
+// call: the rasterizer has the state for the calls that follow.
+static tiler_cmd_t* add_cmd(ogles_context_t* c)
+{
+    tiler_t* const t = c->tiler;
+    if (ggl_unlikely(t->count == t->capacity)) {
+        // the command arrays are aligned like the ones the iterators are
+        // computed in
+        const size_t capacity = t->capacity ? t->capacity * 2 : 256;
+        tiler_cmd_t* const cmds = (tiler_cmd_t*)memalign(16,
+                capacity * sizeof(tiler_cmd_t));
+        if (!cmds) {
+            flush(c);
+            c->tiling = 0;
+            return 0;
+        }
+        if (t->count)
+            memcpy(cmds, t->cmds, t->count * sizeof(tiler_cmd_t));
+        free(t->cmds);
+        t->cmds = cmds;
+        t->capacity = capacity;
+    }
+    return &t->cmds[t->count++];
+}
+
+static void set_cmd(tiler_cmd_t* cmd, int op, int tmu,
+        const GGLSurface* surface, const int32_t* v, int count)
+{
+    cmd->op = op;
+    cmd->tmu = tmu;
+    cmd->surface = surface;
+    if (count)
+        memcpy(cmd->v, v, count * sizeof(int32_t));
+}
+
+// ----------------------------------------------------------------------------
+
+void ogles_init_tiler(ogles_context_t* c)
+{
+    pthread_once(&sPoolOnce, init_pool);
+    if (sPool.numThreads) {
+        c->tiler = (tiler_t*)calloc(1, sizeof(tiler_t));
+    }
+}
+
+void ogles_uninit_tiler(ogles_context_t* c)
+{
+    if (c->tiler) {
+        free(c->tiler->cmds);
+        free(c->tiler);
+        c->tiler = 0;
+    }
+}
+
+void ogles_begin_tiling(ogles_context_t* c, GLenum mode)
+{
+    // points and lines aren't worth it
+    if (c->tiler && mode >= GL_TRIANGLES)
+        c->tiling = 1;
+}
+
+void ogles_end_tiling(ogles_context_t* c)
+{
+    if (c->tiling) {
+        flush(c);
+        c->tiling = 0;
+    }
+}
+
+void ogles_tiler_record(ogles_context_t* c, int op, int tmu,
+        const GGLSurface* surface, const int32_t* v, int count)
+{
+    tiler_cmd_t* const cmd = add_cmd(c);
+    if (!cmd) {
+        // this call was made before what is recorded was drawn, which may
+        // have changed the rasterizer's state, so it is made again
+        tiler_cmd_t again;
+        set_cmd(&again, op, tmu, surface, v, count);
+        const tiler_t t = { &again, 1, 1, 0 };
+        replay(&c->rasterizer, &t, INT_MIN, INT_MAX);
+        return;
+    }
+    set_cmd(cmd, op, tmu, surface, v, count);
+}
+
+void ogles_tiler_record_triangle(ogles_context_t* c,
+        const GLfixed* v0, const GLfixed* v1, const GLfixed* v2)
+{
+    tiler_cmd_t* const cmd = add_cmd(c);
+    if (!cmd) {
+        c->rasterizer.procs.trianglex(c, v0, v1, v2);
+        return;
+    }
+    cmd->op = TILER_TRIANGLE;
+    cmd->tmu = 0;
+    cmd->surface = 0;
+    memcpy(cmd->v + 0, v0, 4 * sizeof(int32_t));
+    memcpy(cmd->v + 4, v1, 4 * sizeof(int32_t));
+    memcpy(cmd->v + 8, v2, 4 * sizeof(int32_t));
+
+    // the rows the triangle may cover, its vertices being in 28.4
+    const int32_t ymin = min(v0[1], v1[1], v2[1]);
+    const int32_t ymax = max(v0[1], v1[1], v2[1]);
+    cmd->top = ymin >> TRI_FRACTION_BITS;
+    cmd->bottom = ((ymax + TRI_ONE - 1) >> TRI_FRACTION_BITS) + 1;
+    if (c->tiler->rows < kMinTiledRows)
+        c->tiler->rows += cmd->bottom - cmd->top;
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
@@ -0,0 +1,127 @@
+/* libs/opengles/tiler.h
+**
+** Copyright 2016, The Android Open Source Project
+**
+** Licensed under the Apache License, Version 2.0 (the "License");
+** you may not use this file except in compliance with the License.
+** You may obtain a copy of the License at
+**
+**     http://www.apache.org/licenses/LICENSE-2.0
+**
+** Unless required by applicable law or agreed to in writing, software
+** distributed under the License is distributed on an "AS IS" BASIS,
+** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+** See the License for the specific language governing permissions and
+** limitations under the License.
+*/
+
+#ifndef ANDROID_OPENGLES_TILER_H
+#define ANDROID_OPENGLES_TILER_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <sys/types.h>
+
+#include "context.h"
+
+namespace android {
+
+// ----------------------------------------------------------------------------
+// Tiled rasterization
+//
+// When debug.libagl.raster_threads is set to a number of threads, the
+// triangles of a glDrawArrays or glDrawElements call are recorded, along with
+// the per-triangle rasterizer state they are set up with, instead of being
+// rasterized as they come. At the end of the call, the framebuffer is split
+// in bands of rows which a pool of threads rasterize, each with its own
+// pixelflinger context, by replaying the recording clipped to the band.
+// The triangles of a band are drawn in order, so the result is the same as
+// drawing them on the calling thread.
+//
+// The state set up per triangle is still applied to the context's
+// rasterizer, which the rest of libagl reads back.
+// ----------------------------------------------------------------------------
+
+enum {
+    TILER_COLOR,
+    TILER_COLOR_GRAD,
+    TILER_Z_GRAD,
+    TILER_FOG_GRAD,
+    TILER_W_GRAD,
+    TILER_TEXCOORD_GRAD,
+    TILER_BIND_TEXTURE_LOD,
+    TILER_TRIANGLE
+};
+
+void ogles_init_tiler(ogles_context_t* c);
+void ogles_uninit_tiler(ogles_context_t* c);
+
+// ogles_begin_tiling starts recording the triangles of a draw call of the
+// given mode, if tiling is enabled; ogles_end_tiling rasterizes them.
+void ogles_begin_tiling(ogles_context_t* c, GLenum mode);
+void ogles_end_tiling(ogles_context_t* c);
+
+void ogles_tiler_record(ogles_context_t* c, int op, int tmu,
+        const GGLSurface* surface, const int32_t* v, int count);
+void ogles_tiler_record_triangle(ogles_context_t* c,
+        const GLfixed* v0, const GLfixed* v1, const GLfixed* v2);
+
+// These are the rasterizer calls made per triangle, which are recorded
+// while tiling.
+
+inline void tiler_color4xv(ogles_context_t* c, const GLfixed* v) {
+    c->rasterizer.procs.color4xv(c, v);
+    if (ggl_unlikely(c->tiling))
+        ogles_tiler_record(c, TILER_COLOR, 0, 0, v, 4);
+}
+
+inline void tiler_colorGrad12xv(ogles_context_t* c, const GLfixed* v) {
+    c->rasterizer.procs.colorGrad12xv(c, v);
+    if (ggl_unlikely(c->tiling))
+        ogles_tiler_record(c, TILER_COLOR_GRAD, 0, 0, v, 12);
+}
+
+inline void tiler_zGrad3xv(ogles_context_t* c, const int32_t* v) {
+    c->rasterizer.procs.zGrad3xv(c, v);
+    if (ggl_unlikely(c->tiling))
+        ogles_tiler_record(c, TILER_Z_GRAD, 0, 0, v, 3);
+}
+
+inline void tiler_fogGrad3xv(ogles_context_t* c, const GLfixed* v) {
+    c->rasterizer.procs.fogGrad3xv(c, v);
+    if (ggl_unlikely(c->tiling))
+        ogles_tiler_record(c, TILER_FOG_GRAD, 0, 0, v, 3);
+}
+
+inline void tiler_wGrad3xv(ogles_context_t* c, const int32_t* v) {
+    c->rasterizer.procs.wGrad3xv(c, v);
+    if (ggl_unlikely(c->tiling))
+        ogles_tiler_record(c, TILER_W_GRAD, 0, 0, v, 3);
+}
+
+inline void tiler_texCoordGradScale8xv(ogles_context_t* c, int tmu,
+        const int32_t* v) {
+    c->rasterizer.procs.texCoordGradScale8xv(c, tmu, v);
+    if (ggl_unlikely(c->tiling))
+        ogles_tiler_record(c, TILER_TEXCOORD_GRAD, tmu, 0, v, 8);
+}
+
+inline void tiler_bindTextureLod(ogles_context_t* c, int tmu,
+        const GGLSurface* surface) {
+    c->rasterizer.procs.bindTextureLod(c, tmu, surface);
+    if (ggl_unlikely(c->tiling))
+        ogles_tiler_record(c, TILER_BIND_TEXTURE_LOD, tmu, surface, 0, 0);
+}
+
+inline void tiler_trianglex(ogles_context_t* c,
+        const GLfixed* v0, const GLfixed* v1, const GLfixed* v2) {
+    if (ggl_unlikely(c->tiling)) {
+        ogles_tiler_record_triangle(c, v0, v1, v2);
+    } else {
+        c->rasterizer.procs.trianglex(c, v0, v1, v2);
+    }
+}
+
+}; // namespace android
+
+#endif // ANDROID_OPENGLES_TILER_H
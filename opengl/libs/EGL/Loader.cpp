@@ -420,7 +420,14 @@ void *Loader::load_driver(const char* kind,
             getProcAddress);
     }
 
-    if (mask & GLESv2) {
+    if ((mask & GLESv2) && (mask & GLESv1_CM)) {
+        // Both APIs come from the same library, and have the same entry
+        // points: resolving them again would only resolve the same names
+        // to the same functions.
+        memcpy(&cnx->hooks[egl_connection_t::GLESv2_INDEX]->gl,
+                &cnx->hooks[egl_connection_t::GLESv1_INDEX]->gl,
+                sizeof(gl_hooks_t::gl_t));
+    } else if (mask & GLESv2) {
       init_api(dso, gl_names,
             (__eglMustCastToProperFunctionPointerType*)
                 &cnx->hooks[egl_connection_t::GLESv2_INDEX]->gl,
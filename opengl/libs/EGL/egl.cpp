@@ -31,6 +31,8 @@
 #include <utils/CallStack.h>
 #include <utils/String8.h>
 
+#include <private/EGL/preload.h>
+
 #include "../egl_impl.h"
 #include "../glestrace.h"
 
@@ -61,7 +63,7 @@ EGLAPI pthread_key_t gGLTraceKey = -1;
 // ----------------------------------------------------------------------------
 
 /**
- * There are three different tracing methods:
+ * There are five different tracing methods:
  * 1. libs/EGL/trace.cpp: Traces all functions to systrace.
  *    To enable:
  *      - set system property "debug.egl.trace" to "systrace" to trace all apps.
@@ -72,7 +74,13 @@ EGLAPI pthread_key_t gGLTraceKey = -1;
  *    To enable:
  *      - set system property "debug.egl.trace" to 1 to trace all apps.
  *      - or call setGLTraceLevel(1) from an app to enable tracing for that app.
- * 4. libs/GLES_trace: Traces all functions via protobuf to host.
+ * 4. libs/EGL/trace.cpp: Counts the calls, state changes, draw calls and uploads
+ *    of each frame of each context, as systrace counters.
+ *    To enable:
+ *      - set system property "debug.egl.trace" to "counters" to count for all apps.
+ *      - the totals of the contexts are logged when they are destroyed, and
+ *        dumped by dumpGLCounters().
+ * 5. libs/GLES_trace: Traces all functions via protobuf to host.
  *    To enable:
  *        - set system property "debug.egl.debug_proc" to the application name.
  *      - or call setGLDebugLevel(1) from the app.
@@ -82,12 +90,17 @@ static int sEGLApplicationTraceLevel;
 
 static bool sEGLSystraceEnabled;
 static bool sEGLGetErrorEnabled;
+static bool sEGLCountersEnabled;
 
 static volatile int sEGLDebugLevel;
 
 extern gl_hooks_t gHooksTrace;
 extern gl_hooks_t gHooksSystrace;
 extern gl_hooks_t gHooksErrorTrace;
+extern gl_hooks_t gHooksCounters;
+
+extern void initGLCallCounters();
+extern void dumpGLCallCounters(int fd);
 
 int getEGLDebugLevel() {
     return sEGLDebugLevel;
@@ -122,6 +135,13 @@ void initEglTraceLevel() {
         return;
     }
 
+    sEGLCountersEnabled = !strcasecmp(value, "counters");
+    if (sEGLCountersEnabled) {
+        initGLCallCounters();
+        sEGLTraceLevel = 0;
+        return;
+    }
+
     int propertyLevel = atoi(value);
     int applicationLevel = sEGLApplicationTraceLevel;
     sEGLTraceLevel = propertyLevel > applicationLevel ? propertyLevel : applicationLevel;
@@ -168,6 +188,9 @@ void setGLHooksThreadSpecific(gl_hooks_t const *value) {
     } else if (sEGLSystraceEnabled) {
         setGlTraceThreadSpecific(value);
         setGlThreadSpecific(&gHooksSystrace);
+    } else if (sEGLCountersEnabled) {
+        setGlTraceThreadSpecific(value);
+        setGlThreadSpecific(&gHooksCounters);
     } else if (sEGLTraceLevel > 0) {
         setGlTraceThreadSpecific(value);
         setGlThreadSpecific(&gHooksTrace);
@@ -201,6 +224,15 @@ void EGLAPI setGLDebugLevel(int level) {
     setEGLDebugLevel(level);
 }
 
+/*
+ * Global entry point to dump the GL call counters of the contexts of this process to a
+ * file descriptor, when debug.egl.trace is set to "counters".
+ */
+extern "C"
+void EGLAPI dumpGLCounters(int fd) {
+    dumpGLCallCounters(fd);
+}
+
 #else
 
 void setGLHooksThreadSpecific(gl_hooks_t const *value) {
@@ -368,6 +400,19 @@ EGLBoolean egl_init_drivers() {
     return res;
 }
 
+/*
+ * Global entry point for the zygote to load the drivers before it forks the
+ * applications, so that they share the relocated libraries and the hook
+ * tables copy-on-write instead of each loading them on their first EGL call.
+ * Loading does run driver code, the libraries' constructors and the driver's
+ * eglGetProcAddress, but no display is set up: that is still done in each
+ * application, by eglGetDisplay and eglInitialize.
+ */
+extern "C"
+EGLBoolean EGLAPI preloadEGLDrivers() {
+    return egl_init_drivers();
+}
+
 static pthread_mutex_t sLogPrintMutex = PTHREAD_MUTEX_INITIALIZER;
 static nsecs_t sLogPrintTime = 0;
 #define NSECS_DURATION 1000000000
@@ -234,6 +234,9 @@ extern const __eglMustCastToProperFunctionPointerType gExtensionForwarders[MAX_N
 extern int getEGLDebugLevel();
 extern void setEGLDebugLevel(int level);
 extern gl_hooks_t gHooksTrace;
+extern gl_hooks_t gHooksCounters;
+extern void flushGLCallCounters(bool endOfFrame);
+extern void removeGLCallCounters(EGLContext ctx);
 
 } // namespace android;
 
@@ -708,16 +711,47 @@ EGLBoolean eglDestroyContext(EGLDisplay dpy, EGLContext ctx)
     egl_context_t * const c = get_context(ctx);
     EGLBoolean result = c->cnx->egl.eglDestroyContext(dp->disp.dpy, c->context);
     if (result == EGL_TRUE) {
+#if EGL_TRACE
+        removeGLCallCounters(ctx);
+#endif
         _c.terminate();
     }
     return result;
 }
 
+// Toolkits make their context current before each frame whether or not it
+// already is.  Tells whether this call would change nothing, without the
+// object lookups, which take the display lock, or a call into the driver.
+// Anything unusual is left to the full path, which reports the errors.
+static bool isCurrentAlready(EGLDisplay dpy, EGLSurface draw,
+        EGLSurface read, EGLContext ctx)
+{
+    if (ctx == EGL_NO_CONTEXT || ctx != egl_tls_t::getContext()) {
+        return false;
+    }
+    // The current context and its surfaces hold a reference on behalf of this
+    // thread, so they are still there even if they have been destroyed.
+    egl_context_t const * const c = get_context(ctx);
+    if (c->dpy != dpy || c->draw != draw || c->read != read || !c->isAlive()) {
+        return false;
+    }
+    if ((draw != EGL_NO_SURFACE && !get_surface(draw)->isAlive())
+            || (read != EGL_NO_SURFACE && !get_surface(read)->isAlive())) {
+        return false;
+    }
+    egl_display_t const * const dp = egl_display_t::get(dpy);
+    return dp && dp->isReady();
+}
+
 EGLBoolean eglMakeCurrent(  EGLDisplay dpy, EGLSurface draw,
                             EGLSurface read, EGLContext ctx)
 {
     clearError();
 
+    if (isCurrentAlready(dpy, draw, read, ctx)) {
+        return EGL_TRUE;
+    }
+
     egl_display_ptr dp = validate_display(dpy);
     if (!dp) return setError(EGL_BAD_DISPLAY, EGL_FALSE);
 
@@ -784,6 +818,11 @@ EGLBoolean eglMakeCurrent(  EGLDisplay dpy, EGLSurface draw,
     }
 
 
+#if EGL_TRACE
+    // the calls made so far were made to the current context
+    flushGLCallCounters(false);
+#endif
+
     EGLBoolean result = dp->makeCurrent(c, cur_c,
             draw, read, ctx,
             impl_draw, impl_read, impl_ctx);
@@ -996,6 +1035,7 @@ __eglMustCastToProperFunctionPointerType eglGetProcAddress(const char *procname)
 #if EGL_TRACE
                 debugHooks->ext.extensions[slot] =
                 gHooksTrace.ext.extensions[slot] =
+                gHooksCounters.ext.extensions[slot] =
 #endif
                         cnx->egl.eglGetProcAddress(procname);
                 if (addr) found = true;
@@ -1114,6 +1154,7 @@ EGLBoolean eglSwapBuffersWithDamageKHR(EGLDisplay dpy, EGLSurface draw,
         if (c) setGLHooksThreadSpecific(c->cnx->hooks[c->version]);
         GLTrace_stop();
     }
+    flushGLCallCounters(true);
 #endif
 
     egl_surface_t const * const s = get_surface(draw);
@@ -1139,22 +1180,28 @@ EGLBoolean eglSwapBuffersWithDamageKHR(EGLDisplay dpy, EGLSurface draw,
         return s->cnx->egl.eglSwapBuffers(dp->disp.dpy, s->surface);
     }
 
-    Vector<android_native_rect_t> androidRects;
+    // Partial updates rarely have more than a few rects; don't allocate for them.
+    android_native_rect_t stackRects[8];
+    Vector<android_native_rect_t> heapRects;
+    android_native_rect_t* androidRects = stackRects;
+    size_t numRects = n_rects > 0 ? size_t(n_rects) : 0;
+    if (numRects > NELEM(stackRects)) {
+        heapRects.resize(numRects);
+        androidRects = heapRects.editArray();
+    }
     for (int r = 0; r < n_rects; ++r) {
         int offset = r * 4;
         int x = rects[offset];
         int y = rects[offset + 1];
         int width = rects[offset + 2];
         int height = rects[offset + 3];
-        android_native_rect_t androidRect;
+        android_native_rect_t& androidRect = androidRects[r];
         androidRect.left = x;
         androidRect.top = y + height;
         androidRect.right = x + width;
         androidRect.bottom = y;
-        androidRects.push_back(androidRect);
     }
-    native_window_set_surface_damage(s->win.get(), androidRects.array(),
-            androidRects.size());
+    native_window_set_surface_damage(s->win.get(), androidRects, numRects);
 
     if (s->cnx->egl.eglSwapBuffersWithDamageKHR) {
         return s->cnx->egl.eglSwapBuffersWithDamageKHR(dp->disp.dpy, s->surface,
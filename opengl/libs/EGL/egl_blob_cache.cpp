@@ -0,0 +1,532 @@
+/*
+ ** Copyright 2016, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#include "egl_blob_cache.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/uio.h>
+#include <unistd.h>
+
+#include <utils/JenkinsHash.h>
+#include <utils/Log.h>
+#include <utils/Vector.h>
+
+// ----------------------------------------------------------------------------
+namespace android {
+// ----------------------------------------------------------------------------
+
+// The cache file starts with a Header, followed by the records of the
+// entries in the order they were written: a RecordHeader, the key and the
+// value, padded to a multiple of 4 bytes.
+struct Header {
+    uint32_t magic;
+    uint32_t version;
+};
+
+struct RecordHeader {
+    uint32_t keySize;
+    uint32_t valueSize;
+    // The CRC of the key and value.
+    uint32_t crc;
+};
+
+static const uint32_t cacheFileMagic = 0x24424745; // "EGB$"
+static const uint32_t cacheFileVersion = 1;
+
+static size_t getRecordSize(size_t keySize, size_t valueSize) {
+    return sizeof(RecordHeader) + ((keySize + valueSize + 3) & ~3);
+}
+
+static uint32_t hashKey(const void* key, size_t keySize) {
+    return JenkinsHashWhiten(JenkinsHashMixBytes(0,
+            reinterpret_cast<const uint8_t*>(key), keySize));
+}
+
+class Crc32cTable {
+public:
+    Crc32cTable() {
+        const uint32_t polyBits = 0x82F63B78;
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t r = i;
+            for (int j = 0; j < 8; j++) {
+                if (r & 1) {
+                    r = (r >> 1) ^ polyBits;
+                } else {
+                    r >>= 1;
+                }
+            }
+            mTable[i] = r;
+        }
+    }
+
+    uint32_t crc(const uint8_t* buf, size_t len) const {
+        uint32_t r = 0;
+        for (size_t i = 0; i < len; i++) {
+            r = (r >> 8) ^ mTable[(r ^ buf[i]) & 0xFF];
+        }
+        return r;
+    }
+
+private:
+    uint32_t mTable[256];
+};
+
+static const Crc32cTable crc32c;
+
+//
+// egl_blob_cache_t definition
+//
+egl_blob_cache_t::egl_blob_cache_t(size_t maxKeySize, size_t maxValueSize,
+        size_t maxTotalSize) :
+        mMaxKeySize(maxKeySize),
+        mMaxValueSize(maxValueSize),
+        mMaxTotalSize(maxTotalSize),
+        mTotalSize(0),
+        mClock(0),
+        mFd(-1),
+        mReadOnly(false),
+        mMap(NULL),
+        mMapSize(0),
+        mFileSize(0) {
+}
+
+egl_blob_cache_t::~egl_blob_cache_t() {
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        delete [] mEntries.valueAt(i).data;
+    }
+    if (mMap != NULL) {
+        munmap(mMap, mMapSize);
+    }
+    if (mFd != -1) {
+        close(mFd);
+    }
+}
+
+const uint8_t* egl_blob_cache_t::getEntryData(const Entry& entry) const {
+    return entry.data != NULL ? entry.data : mMap + entry.offset;
+}
+
+void egl_blob_cache_t::addEntry(uint32_t hash, const Entry& entry) {
+    ssize_t index = mEntries.indexOfKey(hash);
+    if (index >= 0) {
+        removeEntryAt(index);
+    }
+    mEntries.add(hash, entry);
+    mTotalSize += entry.keySize + entry.valueSize;
+}
+
+void egl_blob_cache_t::removeEntryAt(size_t index) {
+    const Entry& entry(mEntries.valueAt(index));
+    mTotalSize -= entry.keySize + entry.valueSize;
+    delete [] entry.data;
+    mEntries.removeItemsAt(index);
+}
+
+void egl_blob_cache_t::evict() {
+    while (mTotalSize > mMaxTotalSize && !mEntries.isEmpty()) {
+        size_t oldest = 0;
+        for (size_t i = 1; i < mEntries.size(); i++) {
+            if (mEntries.valueAt(i).lastUse < mEntries.valueAt(oldest).lastUse) {
+                oldest = i;
+            }
+        }
+        removeEntryAt(oldest);
+    }
+}
+
+void egl_blob_cache_t::set(const void* key, size_t keySize,
+        const void* value, size_t valueSize) {
+    if (keySize == 0 || valueSize == 0) {
+        ALOGW("set: not caching because the key or value is empty");
+        return;
+    }
+    if (keySize > mMaxKeySize || valueSize > mMaxValueSize ||
+            keySize + valueSize > mMaxTotalSize) {
+        ALOGV("set: not caching because the key or value is too large "
+                "(%zu, %zu)", keySize, valueSize);
+        return;
+    }
+
+    const uint32_t hash = hashKey(key, keySize);
+    ssize_t index = mEntries.indexOfKey(hash);
+    if (index >= 0) {
+        // The driver may set an entry it just retrieved again, which
+        // would only grow the file.
+        Entry& entry(mEntries.editValueAt(index));
+        const uint8_t* data = getEntryData(entry);
+        if (entry.keySize == keySize && entry.valueSize == valueSize &&
+                !memcmp(data, key, keySize) &&
+                !memcmp(data + keySize, value, valueSize)) {
+            entry.lastUse = ++mClock;
+            return;
+        }
+    }
+
+    Entry entry;
+    entry.keySize = keySize;
+    entry.valueSize = valueSize;
+    entry.lastUse = ++mClock;
+    entry.offset = 0;
+    entry.data = new uint8_t[keySize + valueSize];
+    memcpy(entry.data, key, keySize);
+    memcpy(entry.data + keySize, value, valueSize);
+    addEntry(hash, entry);
+    evict();
+}
+
+size_t egl_blob_cache_t::get(const void* key, size_t keySize, void* value,
+        size_t valueSize) {
+    if (keySize == 0) {
+        return 0;
+    }
+    ssize_t index = mEntries.indexOfKey(hashKey(key, keySize));
+    if (index < 0) {
+        return 0;
+    }
+    Entry& entry(mEntries.editValueAt(index));
+    const uint8_t* data = getEntryData(entry);
+    if (entry.keySize != keySize || memcmp(data, key, keySize)) {
+        return 0;
+    }
+    entry.lastUse = ++mClock;
+    if (entry.valueSize <= valueSize) {
+        memcpy(value, data + keySize, entry.valueSize);
+    }
+    return entry.valueSize;
+}
+
+void egl_blob_cache_t::open(const char* filename) {
+    if (mFd != -1) {
+        closeFile();
+    }
+
+    int fd = ::open(filename, O_RDWR | O_CREAT | O_CLOEXEC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        ALOGE("error opening cache file %s: %s (%d)", filename,
+                strerror(errno), errno);
+        return;
+    }
+    // Processes sharing the cache directory can't both append to the file.
+    if (flock(fd, LOCK_EX | LOCK_NB) == -1) {
+        ALOGW("cache file %s is in use, not saving the cache: %s (%d)",
+                filename, strerror(errno), errno);
+        close(fd);
+        return;
+    }
+    mFd = fd;
+    mFilename = filename;
+    mReadOnly = false;
+
+    if (!loadFile() && mFd != -1) {
+        resetFile();
+    }
+}
+
+void egl_blob_cache_t::openReadOnly(const char* filename) {
+    if (mFd != -1) {
+        closeFile();
+    }
+
+    int fd = ::open(filename, O_RDONLY | O_CLOEXEC);
+    if (fd == -1) {
+        if (errno != ENOENT) {
+            ALOGE("error opening cache file %s: %s (%d)", filename,
+                    strerror(errno), errno);
+        }
+        return;
+    }
+    mFd = fd;
+    mFilename = filename;
+    mReadOnly = true;
+
+    if (!loadFile() && mFd != -1) {
+        closeFile();
+    }
+}
+
+bool egl_blob_cache_t::loadFile() {
+    struct stat statBuf;
+    if (fstat(mFd, &statBuf) == -1) {
+        ALOGE("error stat'ing cache file: %s (%d)", strerror(errno), errno);
+        return false;
+    }
+
+    // Sanity check the size before trying to mmap it; the file isn't
+    // supposed to grow past twice mMaxTotalSize before being compacted.
+    size_t fileSize = statBuf.st_size;
+    if (fileSize < sizeof(Header) || fileSize > mMaxTotalSize * 4) {
+        if (fileSize != 0) {
+            ALOGE("cache file has a bad size: %#llx",
+                    (long long)statBuf.st_size);
+        }
+        return false;
+    }
+
+    mFileSize = fileSize;
+    remap();
+    if (mMap == NULL) {
+        return false;
+    }
+
+    const Header* header = reinterpret_cast<const Header*>(mMap);
+    if (header->magic != cacheFileMagic || header->version != cacheFileVersion) {
+        ALOGE("cache file has bad mojo");
+        return false;
+    }
+
+    // Later records replace the earlier ones of the same key, and are more
+    // recent.
+    size_t pos = sizeof(Header);
+    while (pos + sizeof(RecordHeader) <= fileSize) {
+        const RecordHeader* record =
+                reinterpret_cast<const RecordHeader*>(mMap + pos);
+        if (record->keySize == 0 || record->keySize > mMaxKeySize ||
+                record->valueSize == 0 || record->valueSize > mMaxValueSize) {
+            break;
+        }
+        const size_t recordSize = getRecordSize(record->keySize,
+                record->valueSize);
+        if (recordSize > fileSize - pos) {
+            break;
+        }
+        const uint8_t* data = mMap + pos + sizeof(RecordHeader);
+        if (crc32c.crc(data, record->keySize + record->valueSize) !=
+                record->crc) {
+            break;
+        }
+
+        Entry entry;
+        entry.keySize = record->keySize;
+        entry.valueSize = record->valueSize;
+        entry.lastUse = ++mClock;
+        entry.offset = pos + sizeof(RecordHeader);
+        entry.data = NULL;
+        addEntry(hashKey(data, entry.keySize), entry);
+        pos += recordSize;
+    }
+
+    // The tail of the file is what a crash interrupted the writing of.
+    if (pos != fileSize) {
+        ALOGW("cache file has a bad record at %#zx, ignoring the rest", pos);
+        if (!mReadOnly && ftruncate(mFd, pos) == -1) {
+            ALOGE("error truncating cache file: %s (%d)", strerror(errno),
+                    errno);
+            closeFile();
+            return true;
+        }
+        mFileSize = pos;
+    }
+
+    evict();
+    return true;
+}
+
+bool egl_blob_cache_t::resetFile() {
+    const Header header = { cacheFileMagic, cacheFileVersion };
+    if (ftruncate(mFd, 0) == -1 ||
+            pwrite(mFd, &header, sizeof(header), 0) != sizeof(header)) {
+        ALOGE("error resetting cache file %s: %s (%d)", mFilename.string(),
+                strerror(errno), errno);
+        closeFile();
+        return false;
+    }
+    mFileSize = sizeof(header);
+    remap();
+    return mMap != NULL;
+}
+
+size_t egl_blob_cache_t::appendEntry(int fd, size_t* fileSize,
+        const Entry& entry) {
+    const uint8_t* data = getEntryData(entry);
+    const size_t dataSize = entry.keySize + entry.valueSize;
+    const size_t recordSize = getRecordSize(entry.keySize, entry.valueSize);
+
+    RecordHeader record;
+    record.keySize = entry.keySize;
+    record.valueSize = entry.valueSize;
+    record.crc = crc32c.crc(data, dataSize);
+    static const uint8_t padding[4] = { 0, 0, 0, 0 };
+
+    struct iovec iov[3];
+    iov[0].iov_base = &record;
+    iov[0].iov_len = sizeof(record);
+    iov[1].iov_base = const_cast<uint8_t*>(data);
+    iov[1].iov_len = dataSize;
+    iov[2].iov_base = const_cast<uint8_t*>(padding);
+    iov[2].iov_len = recordSize - sizeof(record) - dataSize;
+
+    if (lseek(fd, *fileSize, SEEK_SET) == -1 ||
+            writev(fd, iov, 3) != ssize_t(recordSize)) {
+        ALOGE("error writing cache file: %s (%d)", strerror(errno), errno);
+        // Don't leave a partial record behind.
+        ftruncate(fd, *fileSize);
+        return 0;
+    }
+    const size_t offset = *fileSize + sizeof(record);
+    *fileSize += recordSize;
+    return offset;
+}
+
+void egl_blob_cache_t::flush() {
+    if (mFd == -1 || mReadOnly) {
+        return;
+    }
+
+    size_t pendingSize = 0;
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        const Entry& entry(mEntries.valueAt(i));
+        if (entry.data != NULL) {
+            pendingSize += getRecordSize(entry.keySize, entry.valueSize);
+        }
+    }
+    if (pendingSize == 0) {
+        return;
+    }
+
+    // Once the records of the evicted and replaced entries take more space
+    // than the live ones, rewriting the file is the cheaper option.
+    if (mFileSize + pendingSize > sizeof(Header) + mMaxTotalSize * 2) {
+        compactFile();
+        return;
+    }
+
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        Entry& entry(mEntries.editValueAt(i));
+        if (entry.data != NULL) {
+            entry.offset = appendEntry(mFd, &mFileSize, entry);
+            if (entry.offset == 0) {
+                break;
+            }
+        }
+    }
+    remap();
+}
+
+void egl_blob_cache_t::compactFile() {
+    String8 tmpFilename(mFilename);
+    tmpFilename.append(".tmp");
+    const char* fname = tmpFilename.string();
+
+    int fd = ::open(fname, O_CREAT | O_TRUNC | O_RDWR | O_CLOEXEC,
+            S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+        ALOGE("error creating cache file %s: %s (%d)", fname,
+                strerror(errno), errno);
+        return;
+    }
+    flock(fd, LOCK_EX | LOCK_NB);
+
+    const Header header = { cacheFileMagic, cacheFileVersion };
+    size_t fileSize = sizeof(header);
+    bool ok = write(fd, &header, sizeof(header)) == sizeof(header);
+
+    // The least recently used entries go first, so that they are the first
+    // to be evicted once the file is loaded again.
+    KeyedVector<uint32_t, size_t> byLastUse;
+    byLastUse.setCapacity(mEntries.size());
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        byLastUse.add(mEntries.valueAt(i).lastUse, i);
+    }
+    Vector<size_t> offsets;
+    offsets.insertAt(0, 0, mEntries.size());
+    for (size_t i = 0; ok && i < byLastUse.size(); i++) {
+        const size_t index = byLastUse.valueAt(i);
+        offsets.editItemAt(index) = appendEntry(fd, &fileSize,
+                mEntries.valueAt(index));
+        ok = offsets[index] != 0;
+    }
+
+    if (!ok || rename(fname, mFilename.string()) == -1) {
+        ALOGE("error compacting cache file %s: %s (%d)", mFilename.string(),
+                strerror(errno), errno);
+        close(fd);
+        unlink(fname);
+        return;
+    }
+
+    if (mMap != NULL) {
+        munmap(mMap, mMapSize);
+        mMap = NULL;
+        mMapSize = 0;
+    }
+    close(mFd);
+    mFd = fd;
+    mFileSize = fileSize;
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        mEntries.editValueAt(i).offset = offsets[i];
+    }
+    remap();
+}
+
+void egl_blob_cache_t::remap() {
+    if (mMap != NULL) {
+        munmap(mMap, mMapSize);
+        mMap = NULL;
+        mMapSize = 0;
+    }
+
+    void* map = mmap(NULL, mFileSize, PROT_READ, MAP_SHARED, mFd, 0);
+    if (map == MAP_FAILED) {
+        ALOGE("error mmaping cache file: %s (%d)", strerror(errno), errno);
+        closeFile();
+        return;
+    }
+    mMap = reinterpret_cast<uint8_t*>(map);
+    mMapSize = mFileSize;
+
+    // The entries that were written are now read from the file.
+    for (size_t i = 0; i < mEntries.size(); i++) {
+        Entry& entry(mEntries.editValueAt(i));
+        if (entry.data != NULL && entry.offset != 0) {
+            delete [] entry.data;
+            entry.data = NULL;
+        }
+    }
+}
+
+void egl_blob_cache_t::closeFile() {
+    for (size_t i = mEntries.size(); i-- > 0; ) {
+        Entry& entry(mEntries.editValueAt(i));
+        if (entry.data == NULL) {
+            removeEntryAt(i);
+        } else {
+            entry.offset = 0;
+        }
+    }
+    if (mMap != NULL) {
+        munmap(mMap, mMapSize);
+        mMap = NULL;
+        mMapSize = 0;
+    }
+    if (mFd != -1) {
+        close(mFd);
+        mFd = -1;
+    }
+    mFilename = "";
+    mReadOnly = false;
+    mFileSize = 0;
+}
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+// ----------------------------------------------------------------------------
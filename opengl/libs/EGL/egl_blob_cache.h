@@ -0,0 +1,178 @@
+/*
+ ** Copyright 2016, The Android Open Source Project
+ **
+ ** Licensed under the Apache License, Version 2.0 (the "License");
+ ** you may not use this file except in compliance with the License.
+ ** You may obtain a copy of the License at
+ **
+ **     http://www.apache.org/licenses/LICENSE-2.0
+ **
+ ** Unless required by applicable law or agreed to in writing, software
+ ** distributed under the License is distributed on an "AS IS" BASIS,
+ ** WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ ** See the License for the specific language governing permissions and
+ ** limitations under the License.
+ */
+
+#ifndef ANDROID_EGL_BLOB_CACHE_H
+#define ANDROID_EGL_BLOB_CACHE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+
+// ----------------------------------------------------------------------------
+namespace android {
+// ----------------------------------------------------------------------------
+
+// egl_blob_cache_t is a key/value blob cache backed by a log file: the
+// entries are appended to the file as they are inserted, and read back from a
+// read-only mapping of it, so that neither loading nor saving the cache needs
+// to go through the whole of it, and only the entries inserted since the last
+// save are held in memory.
+//
+// When the cache is full, the least recently used entries are evicted.  The
+// file then holds records of entries that were evicted or replaced; when they
+// take more space than the live entries, the file is compacted by rewriting
+// the live entries, least recently used first, so that their order gives
+// their recency when the file is loaded again.
+//
+// Evictions aren't recorded in the file, so that an entry evicted before it
+// was saved may come back with the value it replaced once the file is
+// loaded again, as it may after a crash while it was being saved.
+class egl_blob_cache_t : public RefBase {
+public:
+
+    // Create an empty cache.  Keys at most maxKeySize bytes long and values
+    // at most maxValueSize bytes long are accepted, and the keys and values
+    // of the entries won't take more than maxTotalSize bytes.
+    egl_blob_cache_t(size_t maxKeySize, size_t maxValueSize,
+            size_t maxTotalSize);
+
+    // open loads the entries of the cache file, creating it if it doesn't
+    // exist or isn't a valid cache file, and keeps it open for the entries
+    // inserted afterwards to be appended to it by flush.  If the file can't
+    // be opened, or is in use by another process, the cache is only held in
+    // memory.
+    void open(const char* filename);
+
+    // openReadOnly loads the entries of a cache file that this process
+    // can't write, such as one shared by all processes.  The entries can
+    // still be set, but flush won't save them.
+    void openReadOnly(const char* filename);
+
+    // set inserts a new key/value blob pair into the cache, replacing the
+    // value of the key if it was already in the cache, and evicting the least
+    // recently used entries if needed.  Keys or values that are too large
+    // are ignored.
+    void set(const void* key, size_t keySize, const void* value,
+            size_t valueSize);
+
+    // get copies the value associated with the key into value if valueSize
+    // is large enough, and returns its size, or 0 if the key isn't in the
+    // cache.
+    size_t get(const void* key, size_t keySize, void* value, size_t valueSize);
+
+    // flush appends the entries inserted since the last flush to the cache
+    // file, compacting it first if needed.
+    void flush();
+
+protected:
+    virtual ~egl_blob_cache_t();
+
+private:
+    // Copying is disallowed.
+    egl_blob_cache_t(const egl_blob_cache_t&); // not implemented
+    void operator=(const egl_blob_cache_t&); // not implemented
+
+    struct Entry {
+        uint32_t keySize;
+        uint32_t valueSize;
+        // mClock at the last time the entry was set or retrieved.
+        uint32_t lastUse;
+        // The offset of the key in the cache file, which the value follows,
+        // once the entry was written to it.  Until then, data holds the key
+        // followed by the value.
+        size_t offset;
+        uint8_t* data;
+    };
+
+    // getEntryData returns the key of the entry, which its value follows.
+    const uint8_t* getEntryData(const Entry& entry) const;
+
+    // addEntry inserts an entry for the key hash, replacing the entry
+    // it had, if any.
+    void addEntry(uint32_t hash, const Entry& entry);
+
+    // removeEntryAt removes the entry at index in mEntries and frees its
+    // data.
+    void removeEntryAt(size_t index);
+
+    // evict removes the least recently used entries until the keys and
+    // values of those left fit in mMaxTotalSize.
+    void evict();
+
+    // loadFile builds the index of the entries of the open cache file, and
+    // truncates it after the last valid one.  Returns false if it isn't a
+    // cache file.
+    bool loadFile();
+
+    // resetFile truncates the open cache file to an empty one.
+    bool resetFile();
+
+    // compactFile rewrites the cache file with the live entries only.
+    void compactFile();
+
+    // appendEntry appends the record of the entry to the file fd at
+    // fileSize, which it advances, and returns the offset of its key, or 0
+    // on error.
+    size_t appendEntry(int fd, size_t* fileSize, const Entry& entry);
+
+    // remap maps mFileSize bytes of the cache file, after which the data of
+    // the entries that were written to it is freed.  On error, the file is
+    // closed.
+    void remap();
+
+    // closeFile unmaps and closes the cache file; the entries written to it
+    // are dropped.
+    void closeFile();
+
+    // The size limits of the keys and values.
+    const size_t mMaxKeySize;
+    const size_t mMaxValueSize;
+    const size_t mMaxTotalSize;
+
+    // mTotalSize is the total size of the keys and values of the entries.
+    size_t mTotalSize;
+
+    // mClock is incremented each time an entry is used, to give the order
+    // of the entries' lastUse.
+    uint32_t mClock;
+
+    // mEntries is the cache index, by key hash.  Keys whose hash collide
+    // replace each other, which is harmless in a cache.
+    KeyedVector<uint32_t, Entry> mEntries;
+
+    // mFilename and mFd are the name and descriptor of the cache file, or an
+    // empty string and -1 if the cache is not backed by a file.  mReadOnly
+    // is whether the file was opened with openReadOnly.
+    String8 mFilename;
+    int mFd;
+    bool mReadOnly;
+
+    // mMap maps the first mMapSize bytes of the cache file, of which the
+    // first mFileSize hold the header and the records of the entries written
+    // to it.
+    uint8_t* mMap;
+    size_t mMapSize;
+    size_t mFileSize;
+};
+
+// ----------------------------------------------------------------------------
+}; // namespace android
+// ----------------------------------------------------------------------------
+
+#endif // ANDROID_EGL_BLOB_CACHE_H
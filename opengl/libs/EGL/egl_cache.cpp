@@ -20,32 +20,28 @@
 #include "egl_display.h"
 #include "egldefs.h"
 
-#include <fcntl.h>
-#include <sys/mman.h>
-#include <sys/stat.h>
-#include <sys/types.h>
-#include <unistd.h>
+#include <stdlib.h>
+
+#include <cutils/properties.h>
+#include <utils/JenkinsHash.h>
 
 #ifndef MAX_EGL_CACHE_ENTRY_SIZE
-#define MAX_EGL_CACHE_ENTRY_SIZE (16 * 1024);
+#define MAX_EGL_CACHE_ENTRY_SIZE (64 * 1024)
 #endif
 
 #ifndef MAX_EGL_CACHE_KEY_SIZE
-#define MAX_EGL_CACHE_KEY_SIZE (1024);
+#define MAX_EGL_CACHE_KEY_SIZE (1024)
 #endif
 
 #ifndef MAX_EGL_CACHE_SIZE
-#define MAX_EGL_CACHE_SIZE (64 * 1024);
+#define MAX_EGL_CACHE_SIZE (2 * 1024 * 1024)
 #endif
 
-// Cache size limits.
+// Cache size limits.  The total size can be changed with the
+// ro.egl.blob_cache_size property, in bytes.
 static const size_t maxKeySize = MAX_EGL_CACHE_KEY_SIZE;
 static const size_t maxValueSize = MAX_EGL_CACHE_ENTRY_SIZE;
-static const size_t maxTotalSize = MAX_EGL_CACHE_SIZE;
-
-// Cache file header
-static const char* cacheFileMagic = "EGL$";
-static const size_t cacheFileHeaderSize = 8;
+static const size_t defaultMaxTotalSize = MAX_EGL_CACHE_SIZE;
 
 // The time in seconds to wait before saving newly inserted cache entries.
 static const unsigned int deferredSaveDelay = 4;
@@ -100,6 +96,8 @@ void egl_cache_t::initialize(egl_display_t *display) {
                 !strcmp(" " BC_EXT_STR, exts + extsLen - (bcExtLen+1));
         bool inMiddle = strstr(exts, " " BC_EXT_STR " ");
         if (equal || atStart || atEnd || inMiddle) {
+            setSystemCacheFilenameLocked(display);
+
             PFNEGLSETBLOBCACHEFUNCSANDROIDPROC eglSetBlobCacheFuncsANDROID;
             eglSetBlobCacheFuncsANDROID =
                     reinterpret_cast<PFNEGLSETBLOBCACHEFUNCSANDROIDPROC>(
@@ -128,6 +126,7 @@ void egl_cache_t::terminate() {
     Mutex::Autolock lock(mMutex);
     saveBlobCacheLocked();
     mBlobCache = NULL;
+    mSystemBlobCache = NULL;
 }
 
 void egl_cache_t::setBlob(const void* key, EGLsizeiANDROID keySize,
@@ -140,7 +139,7 @@ void egl_cache_t::setBlob(const void* key, EGLsizeiANDROID keySize,
     }
 
     if (mInitialized) {
-        sp<BlobCache> bc = getBlobCacheLocked();
+        sp<egl_blob_cache_t> bc = getBlobCacheLocked();
         bc->set(key, keySize, value, valueSize);
 
         if (!mSavePending) {
@@ -179,7 +178,14 @@ EGLsizeiANDROID egl_cache_t::getBlob(const void* key, EGLsizeiANDROID keySize,
     }
 
     if (mInitialized) {
-        sp<BlobCache> bc = getBlobCacheLocked();
+        sp<egl_blob_cache_t> sbc = getSystemBlobCacheLocked();
+        if (sbc != NULL) {
+            size_t size = sbc->get(key, keySize, value, valueSize);
+            if (size > 0) {
+                return size;
+            }
+        }
+        sp<egl_blob_cache_t> bc = getBlobCacheLocked();
         return bc->get(key, keySize, value, valueSize);
     }
     return 0;
@@ -190,161 +196,65 @@ void egl_cache_t::setCacheFilename(const char* filename) {
     mFilename = filename;
 }
 
-sp<BlobCache> egl_cache_t::getBlobCacheLocked() {
+static size_t getMaxTotalSize() {
+    char value[PROPERTY_VALUE_MAX];
+    property_get("ro.egl.blob_cache_size", value, "");
+    size_t size = strtoul(value, NULL, 0);
+    return size > 0 ? size : defaultMaxTotalSize;
+}
+
+sp<egl_blob_cache_t> egl_cache_t::getBlobCacheLocked() {
     if (mBlobCache == NULL) {
-        mBlobCache = new BlobCache(maxKeySize, maxValueSize, maxTotalSize);
+        mBlobCache = new egl_blob_cache_t(maxKeySize, maxValueSize,
+                getMaxTotalSize());
         loadBlobCacheLocked();
     }
     return mBlobCache;
 }
 
-static uint32_t crc32c(const uint8_t* buf, size_t len) {
-    const uint32_t polyBits = 0x82F63B78;
-    uint32_t r = 0;
-    for (size_t i = 0; i < len; i++) {
-        r ^= buf[i];
-        for (int j = 0; j < 8; j++) {
-            if (r & 1) {
-                r = (r >> 1) ^ polyBits;
-            } else {
-                r >>= 1;
-            }
-        }
+void egl_cache_t::setSystemCacheFilenameLocked(egl_display_t* display) {
+    char dir[PROPERTY_VALUE_MAX];
+    property_get("ro.egl.system_blob_cache_dir", dir, "");
+    if (dir[0] == '\0') {
+        mSystemCacheFilename = "";
+        return;
+    }
+
+    // The blobs are only valid for the driver that made them, which its EGL
+    // vendor and version strings identify.
+    const char* vendor = display->disp.queryString.vendor;
+    const char* version = display->disp.queryString.version;
+    uint32_t hash = 0;
+    if (vendor != NULL) {
+        hash = JenkinsHashMixBytes(hash,
+                reinterpret_cast<const uint8_t*>(vendor), strlen(vendor) + 1);
+    }
+    if (version != NULL) {
+        hash = JenkinsHashMixBytes(hash,
+                reinterpret_cast<const uint8_t*>(version), strlen(version) + 1);
+    }
+    mSystemCacheFilename = String8::format("%s/blob_cache-%08x", dir,
+            JenkinsHashWhiten(hash));
+}
+
+sp<egl_blob_cache_t> egl_cache_t::getSystemBlobCacheLocked() {
+    if (mSystemBlobCache == NULL && mSystemCacheFilename.length() > 0) {
+        mSystemBlobCache = new egl_blob_cache_t(maxKeySize, maxValueSize,
+                getMaxTotalSize());
+        mSystemBlobCache->openReadOnly(mSystemCacheFilename.string());
     }
-    return r;
+    return mSystemBlobCache;
 }
 
 void egl_cache_t::saveBlobCacheLocked() {
     if (mFilename.length() > 0 && mBlobCache != NULL) {
-        size_t cacheSize = mBlobCache->getFlattenedSize();
-        size_t headerSize = cacheFileHeaderSize;
-        const char* fname = mFilename.string();
-
-        // Try to create the file with no permissions so we can write it
-        // without anyone trying to read it.
-        int fd = open(fname, O_CREAT | O_EXCL | O_RDWR, 0);
-        if (fd == -1) {
-            if (errno == EEXIST) {
-                // The file exists, delete it and try again.
-                if (unlink(fname) == -1) {
-                    // No point in retrying if the unlink failed.
-                    ALOGE("error unlinking cache file %s: %s (%d)", fname,
-                            strerror(errno), errno);
-                    return;
-                }
-                // Retry now that we've unlinked the file.
-                fd = open(fname, O_CREAT | O_EXCL | O_RDWR, 0);
-            }
-            if (fd == -1) {
-                ALOGE("error creating cache file %s: %s (%d)", fname,
-                        strerror(errno), errno);
-                return;
-            }
-        }
-
-        size_t fileSize = headerSize + cacheSize;
-
-        uint8_t* buf = new uint8_t [fileSize];
-        if (!buf) {
-            ALOGE("error allocating buffer for cache contents: %s (%d)",
-                    strerror(errno), errno);
-            close(fd);
-            unlink(fname);
-            return;
-        }
-
-        status_t err = mBlobCache->flatten(buf + headerSize, cacheSize);
-        if (err != OK) {
-            ALOGE("error writing cache contents: %s (%d)", strerror(-err),
-                    -err);
-            delete [] buf;
-            close(fd);
-            unlink(fname);
-            return;
-        }
-
-        // Write the file magic and CRC
-        memcpy(buf, cacheFileMagic, 4);
-        uint32_t* crc = reinterpret_cast<uint32_t*>(buf + 4);
-        *crc = crc32c(buf + headerSize, cacheSize);
-
-        if (write(fd, buf, fileSize) == -1) {
-            ALOGE("error writing cache file: %s (%d)", strerror(errno),
-                    errno);
-            delete [] buf;
-            close(fd);
-            unlink(fname);
-            return;
-        }
-
-        delete [] buf;
-        fchmod(fd, S_IRUSR);
-        close(fd);
+        mBlobCache->flush();
     }
 }
 
 void egl_cache_t::loadBlobCacheLocked() {
     if (mFilename.length() > 0) {
-        size_t headerSize = cacheFileHeaderSize;
-
-        int fd = open(mFilename.string(), O_RDONLY, 0);
-        if (fd == -1) {
-            if (errno != ENOENT) {
-                ALOGE("error opening cache file %s: %s (%d)", mFilename.string(),
-                        strerror(errno), errno);
-            }
-            return;
-        }
-
-        struct stat statBuf;
-        if (fstat(fd, &statBuf) == -1) {
-            ALOGE("error stat'ing cache file: %s (%d)", strerror(errno), errno);
-            close(fd);
-            return;
-        }
-
-        // Sanity check the size before trying to mmap it.
-        size_t fileSize = statBuf.st_size;
-        if (fileSize > maxTotalSize * 2) {
-            ALOGE("cache file is too large: %#llx", statBuf.st_size);
-            close(fd);
-            return;
-        }
-
-        uint8_t* buf = reinterpret_cast<uint8_t*>(mmap(NULL, fileSize,
-                PROT_READ, MAP_PRIVATE, fd, 0));
-        if (buf == MAP_FAILED) {
-            ALOGE("error mmaping cache file: %s (%d)", strerror(errno),
-                    errno);
-            close(fd);
-            return;
-        }
-
-        // Check the file magic and CRC
-        size_t cacheSize = fileSize - headerSize;
-        if (memcmp(buf, cacheFileMagic, 4) != 0) {
-            ALOGE("cache file has bad mojo");
-            close(fd);
-            return;
-        }
-        uint32_t* crc = reinterpret_cast<uint32_t*>(buf + 4);
-        if (crc32c(buf + headerSize, cacheSize) != *crc) {
-            ALOGE("cache file failed CRC check");
-            close(fd);
-            return;
-        }
-
-        status_t err = mBlobCache->unflatten(buf + headerSize, cacheSize);
-        if (err != OK) {
-            ALOGE("error reading cache contents: %s (%d)", strerror(-err),
-                    -err);
-            munmap(buf, fileSize);
-            close(fd);
-            return;
-        }
-
-        munmap(buf, fileSize);
-        close(fd);
+        mBlobCache->open(mFilename.string());
     }
 }
 
@@ -20,10 +20,12 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 
-#include <utils/BlobCache.h>
+#include <utils/Mutex.h>
 #include <utils/String8.h>
 #include <utils/StrongPointer.h>
 
+#include "egl_blob_cache.h"
+
 // ----------------------------------------------------------------------------
 namespace android {
 // ----------------------------------------------------------------------------
@@ -74,18 +76,27 @@ private:
     egl_cache_t(const egl_cache_t&); // not implemented
     void operator=(const egl_cache_t&); // not implemented
 
-    // getBlobCacheLocked returns the BlobCache object being used to store the
-    // key/value blob pairs.  If the BlobCache object has not yet been created,
-    // this will do so, loading the serialized cache contents from disk if
-    // possible.
-    sp<BlobCache> getBlobCacheLocked();
+    // getBlobCacheLocked returns the egl_blob_cache_t object being used to
+    // store the key/value blob pairs.  If the egl_blob_cache_t object has not
+    // yet been created, this will do so, loading the cache contents from disk
+    // if possible.
+    sp<egl_blob_cache_t> getBlobCacheLocked();
+
+    // setSystemCacheFilenameLocked sets the name of the system-wide cache
+    // file for the driver of the display, if the device has one.
+    void setSystemCacheFilenameLocked(egl_display_t* display);
 
-    // saveBlobCache attempts to save the current contents of mBlobCache to
-    // disk.
+    // getSystemBlobCacheLocked returns the egl_blob_cache_t object of the
+    // system-wide cache, loading it the first time, or NULL if the device
+    // doesn't have one.
+    sp<egl_blob_cache_t> getSystemBlobCacheLocked();
+
+    // saveBlobCache attempts to append the entries inserted in mBlobCache
+    // since the last save to disk.
     void saveBlobCacheLocked();
 
     // loadBlobCache attempts to load the saved cache contents from disk into
-    // mBlobCache.
+    // mBlobCache, and keeps the cache file open for the following saves.
     void loadBlobCacheLocked();
 
     // mInitialized indicates whether the egl_cache_t is in the initialized
@@ -99,7 +110,7 @@ private:
     // mBlobCache is the cache in which the key/value blob pairs are stored.  It
     // is initially NULL, and will be initialized by getBlobCacheLocked the
     // first time it's needed.
-    sp<BlobCache> mBlobCache;
+    sp<egl_blob_cache_t> mBlobCache;
 
     // mFilename is the name of the file for storing cache contents in between
     // program invocations.  It is initialized to an empty string at
@@ -108,6 +119,17 @@ private:
     // from disk.
     String8 mFilename;
 
+    // mSystemBlobCache is a read-only cache shared by all processes, holding
+    // the programs used by most of them, such as the ones of the UI toolkit,
+    // so that they don't each have to compile them.  It is looked up before
+    // mBlobCache, and is loaded by getSystemBlobCacheLocked from
+    // mSystemCacheFilename, which is set in initialize from the
+    // ro.egl.system_blob_cache_dir property and the identity of the driver.
+    // The file has the format of the per-process cache files, so that one of
+    // them can be used for it.
+    sp<egl_blob_cache_t> mSystemBlobCache;
+    String8 mSystemCacheFilename;
+
     // mSavePending indicates whether or not a deferred save operation is
     // pending.  Each time a key/value pair is inserted into the cache via
     // setBlob, a deferred save is initiated if one is not already pending.
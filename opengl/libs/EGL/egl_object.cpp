@@ -33,7 +33,7 @@ namespace android {
 // ----------------------------------------------------------------------------
 
 egl_object_t::egl_object_t(egl_display_t* disp) :
-    display(disp), count(1) {
+    display(disp), count(1), terminated(0) {
     // NOTE: this does an implicit incRef
     display->addObject(this);
 }
@@ -43,6 +43,7 @@ egl_object_t::~egl_object_t() {
 
 void egl_object_t::terminate() {
     // this marks the object as "terminated"
+    android_atomic_release_store(1, &terminated);
     display->removeObject(this);
     if (decRef() == 1) {
         // shouldn't happen because this is called from LocalRef
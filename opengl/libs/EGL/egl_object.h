@@ -42,6 +42,7 @@ struct egl_display_t;
 class egl_object_t {
     egl_display_t *display;
     mutable volatile int32_t count;
+    volatile int32_t terminated;
 
 protected:
     virtual ~egl_object_t();
@@ -54,6 +55,13 @@ public:
     inline int32_t decRef() { return android_atomic_dec(&count); }
     inline egl_display_t* getDisplay() const { return display; }
 
+    // True until the object is destroyed by the application.  This doesn't need
+    // the display lock, but it's only meaningful on an object the caller holds a
+    // reference to, such as the current context and surfaces.
+    inline bool isAlive() const {
+        return !android_atomic_acquire_load(&terminated);
+    }
+
 private:
     void terminate();
     static bool get(egl_display_t const* display, egl_object_t* object);
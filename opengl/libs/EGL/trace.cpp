@@ -16,18 +16,25 @@
 
 #if EGL_TRACE
 
+#include <inttypes.h>
 #include <stdarg.h>
+#include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 
+#include <cutils/compiler.h>
 #include <cutils/log.h>
 
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 #include <utils/Trace.h>
 
 #include <utils/CallStack.h>
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
+#include <utils/String8.h>
 
 #include "egl_tls.h"
 #include "hooks.h"
@@ -453,6 +460,380 @@ EGLAPI gl_hooks_t gHooksErrorTrace = {
 #undef GL_ENTRY
 #undef CHECK_ERROR
 
+///////////////////////////////////////////////////////////////////////////
+// Counters
+///////////////////////////////////////////////////////////////////////////
+
+#undef TRACE_GL_VOID
+#undef TRACE_GL
+
+// The counts of the GL calls a thread made since it last swapped buffers or
+// made a context current, after which they are added to the totals of the
+// context that was current.
+struct GLCallCounters {
+    uint64_t calls;
+    uint64_t stateChanges;
+    uint64_t drawCalls;
+    uint64_t textureUploads;
+    uint64_t textureBytes;
+    uint64_t bufferBytes;
+};
+
+struct GLContextCounters {
+    uint32_t frames;
+    GLCallCounters total;
+};
+
+enum GLCallKind {
+    GL_CALL_OTHER,
+    GL_CALL_STATE,
+    GL_CALL_DRAW,
+};
+
+static bool sCountersEnabled;
+static pthread_key_t sCountersKey;
+static Mutex sContextCountersLock;
+static KeyedVector<EGLContext, GLContextCounters> sContextCounters;
+
+static GLCallKind getGLCallKind(const char* name) {
+    static const char* const drawCalls[] = {
+        "glDraw", "glDispatchCompute",
+    };
+    static const char* const stateChanges[] = {
+        "glActiveTexture", "glBind", "glBlend", "glClearColor",
+        "glClearDepth", "glClearStencil", "glColorMask", "glCullFace",
+        "glDepthFunc", "glDepthMask", "glDepthRange", "glDisable",
+        "glEnable", "glFrontFace", "glLineWidth", "glPixelStore",
+        "glPolygonOffset", "glProgramUniform", "glSampleCoverage",
+        "glSamplerParameter", "glScissor", "glStencil", "glTexParameter",
+        "glUniform", "glUseProgram", "glVertexAttrib", "glViewport",
+    };
+    for (size_t i = 0; i < NELEM(drawCalls); i++) {
+        if (!strncmp(name, drawCalls[i], strlen(drawCalls[i]))) {
+            return GL_CALL_DRAW;
+        }
+    }
+    for (size_t i = 0; i < NELEM(stateChanges); i++) {
+        if (!strncmp(name, stateChanges[i], strlen(stateChanges[i]))) {
+            return GL_CALL_STATE;
+        }
+    }
+    return GL_CALL_OTHER;
+}
+
+static void freeGLCallCounters(void* counters) {
+    delete static_cast<GLCallCounters*>(counters);
+}
+
+static GLCallCounters* getGLCallCounters() {
+    GLCallCounters* counters =
+            static_cast<GLCallCounters*>(pthread_getspecific(sCountersKey));
+    if (CC_UNLIKELY(counters == NULL)) {
+        counters = new GLCallCounters();
+        pthread_setspecific(sCountersKey, counters);
+    }
+    return counters;
+}
+
+static inline GLCallCounters* countGLCall(GLCallKind kind) {
+    GLCallCounters* const counters = getGLCallCounters();
+    counters->calls++;
+    if (kind == GL_CALL_STATE) {
+        counters->stateChanges++;
+    } else if (kind == GL_CALL_DRAW) {
+        counters->drawCalls++;
+    }
+    return counters;
+}
+
+// The kind of each call is looked up by name the first time it is made.
+#define TRACE_GL_VOID(_api, _args, _argList, ...)                         \
+static void Counters_ ## _api _args {                                     \
+    static const GLCallKind _kind = getGLCallKind(#_api);                 \
+    countGLCall(_kind);                                                   \
+    gl_hooks_t::gl_t const * const _c = &getGLTraceThreadSpecific()->gl;  \
+    _c->_api _argList;                                                    \
+}
+
+#define TRACE_GL(_type, _api, _args, _argList, ...)                       \
+static _type Counters_ ## _api _args {                                    \
+    static const GLCallKind _kind = getGLCallKind(#_api);                 \
+    countGLCall(_kind);                                                   \
+    gl_hooks_t::gl_t const * const _c = &getGLTraceThreadSpecific()->gl;  \
+    return _c->_api _argList;                                             \
+}
+
+extern "C" {
+#include "../trace.in"
+}
+
+#undef TRACE_GL_VOID
+#undef TRACE_GL
+
+#define GL_ENTRY(_r, _api, ...) Counters_ ## _api,
+EGLAPI gl_hooks_t gHooksCounters = {
+    {
+        #include "entries.in"
+    },
+    {
+        {0}
+    }
+};
+#undef GL_ENTRY
+
+// The size of the pixels of an upload, ignoring the unpack alignment.
+static uint64_t getPixelsSize(GLsizei width, GLsizei height, GLsizei depth,
+        GLenum format, GLenum type) {
+    uint64_t components;
+    switch (format) {
+        case GL_RGBA:
+        case GL_RGBA_INTEGER:
+        case GL_BGRA_EXT:
+            components = 4;
+            break;
+        case GL_RGB:
+        case GL_RGB_INTEGER:
+            components = 3;
+            break;
+        case GL_LUMINANCE_ALPHA:
+        case GL_RG:
+        case GL_RG_INTEGER:
+            components = 2;
+            break;
+        default:
+            components = 1;
+            break;
+    }
+    uint64_t pixelSize;
+    switch (type) {
+        case GL_UNSIGNED_BYTE:
+        case GL_BYTE:
+            pixelSize = components;
+            break;
+        case GL_UNSIGNED_SHORT:
+        case GL_SHORT:
+        case GL_HALF_FLOAT:
+        case GL_HALF_FLOAT_OES:
+            pixelSize = components * 2;
+            break;
+        case GL_UNSIGNED_INT:
+        case GL_INT:
+        case GL_FLOAT:
+            pixelSize = components * 4;
+            break;
+        case GL_UNSIGNED_SHORT_5_6_5:
+        case GL_UNSIGNED_SHORT_4_4_4_4:
+        case GL_UNSIGNED_SHORT_5_5_5_1:
+            pixelSize = 2;
+            break;
+        case GL_FLOAT_32_UNSIGNED_INT_24_8_REV:
+            pixelSize = 8;
+            break;
+        default:
+            // the packed 32 bit types
+            pixelSize = 4;
+            break;
+    }
+    if (width <= 0 || height <= 0 || depth <= 0) {
+        return 0;
+    }
+    return uint64_t(width) * uint64_t(height) * uint64_t(depth) * pixelSize;
+}
+
+static inline void countTextureUpload(uint64_t size) {
+    GLCallCounters* const counters = countGLCall(GL_CALL_OTHER);
+    counters->textureUploads++;
+    counters->textureBytes += size;
+}
+
+static inline void countBufferUpload(GLsizeiptr size) {
+    GLCallCounters* const counters = countGLCall(GL_CALL_OTHER);
+    counters->bufferBytes += size > 0 ? uint64_t(size) : 0;
+}
+
+// The uploads are counted by these instead of the generated hooks, which
+// don't know their sizes.
+static void CountersUpload_glTexImage2D(GLenum target, GLint level,
+        GLint internalformat, GLsizei width, GLsizei height, GLint border,
+        GLenum format, GLenum type, const void * pixels) {
+    countTextureUpload(getPixelsSize(width, height, 1, format, type));
+    getGLTraceThreadSpecific()->gl.glTexImage2D(target, level,
+            internalformat, width, height, border, format, type, pixels);
+}
+
+static void CountersUpload_glTexSubImage2D(GLenum target, GLint level,
+        GLint xoffset, GLint yoffset, GLsizei width, GLsizei height,
+        GLenum format, GLenum type, const void * pixels) {
+    countTextureUpload(getPixelsSize(width, height, 1, format, type));
+    getGLTraceThreadSpecific()->gl.glTexSubImage2D(target, level,
+            xoffset, yoffset, width, height, format, type, pixels);
+}
+
+static void CountersUpload_glTexImage3D(GLenum target, GLint level,
+        GLint internalformat, GLsizei width, GLsizei height, GLsizei depth,
+        GLint border, GLenum format, GLenum type, const void * pixels) {
+    countTextureUpload(getPixelsSize(width, height, depth, format, type));
+    getGLTraceThreadSpecific()->gl.glTexImage3D(target, level,
+            internalformat, width, height, depth, border, format, type, pixels);
+}
+
+static void CountersUpload_glTexSubImage3D(GLenum target, GLint level,
+        GLint xoffset, GLint yoffset, GLint zoffset, GLsizei width,
+        GLsizei height, GLsizei depth, GLenum format, GLenum type,
+        const void * pixels) {
+    countTextureUpload(getPixelsSize(width, height, depth, format, type));
+    getGLTraceThreadSpecific()->gl.glTexSubImage3D(target, level,
+            xoffset, yoffset, zoffset, width, height, depth, format, type,
+            pixels);
+}
+
+static void CountersUpload_glCompressedTexImage2D(GLenum target,
+        GLint level, GLenum internalformat, GLsizei width, GLsizei height,
+        GLint border, GLsizei imageSize, const void * data) {
+    countTextureUpload(imageSize > 0 ? uint64_t(imageSize) : 0);
+    getGLTraceThreadSpecific()->gl.glCompressedTexImage2D(target, level,
+            internalformat, width, height, border, imageSize, data);
+}
+
+static void CountersUpload_glCompressedTexSubImage2D(GLenum target,
+        GLint level, GLint xoffset, GLint yoffset, GLsizei width,
+        GLsizei height, GLenum format, GLsizei imageSize, const void * data) {
+    countTextureUpload(imageSize > 0 ? uint64_t(imageSize) : 0);
+    getGLTraceThreadSpecific()->gl.glCompressedTexSubImage2D(target, level,
+            xoffset, yoffset, width, height, format, imageSize, data);
+}
+
+static void CountersUpload_glCompressedTexImage3D(GLenum target,
+        GLint level, GLenum internalformat, GLsizei width, GLsizei height,
+        GLsizei depth, GLint border, GLsizei imageSize, const void * data) {
+    countTextureUpload(imageSize > 0 ? uint64_t(imageSize) : 0);
+    getGLTraceThreadSpecific()->gl.glCompressedTexImage3D(target, level,
+            internalformat, width, height, depth, border, imageSize, data);
+}
+
+static void CountersUpload_glCompressedTexSubImage3D(GLenum target,
+        GLint level, GLint xoffset, GLint yoffset, GLint zoffset,
+        GLsizei width, GLsizei height, GLsizei depth, GLenum format,
+        GLsizei imageSize, const void * data) {
+    countTextureUpload(imageSize > 0 ? uint64_t(imageSize) : 0);
+    getGLTraceThreadSpecific()->gl.glCompressedTexSubImage3D(target, level,
+            xoffset, yoffset, zoffset, width, height, depth, format,
+            imageSize, data);
+}
+
+static void CountersUpload_glBufferData(GLenum target, GLsizeiptr size,
+        const void * data, GLenum usage) {
+    countBufferUpload(size);
+    getGLTraceThreadSpecific()->gl.glBufferData(target, size, data, usage);
+}
+
+static void CountersUpload_glBufferSubData(GLenum target, GLintptr offset,
+        GLsizeiptr size, const void * data) {
+    countBufferUpload(size);
+    getGLTraceThreadSpecific()->gl.glBufferSubData(target, offset, size,
+            data);
+}
+
+void initGLCallCounters() {
+    if (sCountersEnabled) {
+        return;
+    }
+    pthread_key_create(&sCountersKey, freeGLCallCounters);
+    gl_hooks_t::gl_t* const gl = &gHooksCounters.gl;
+    gl->glTexImage2D = CountersUpload_glTexImage2D;
+    gl->glTexSubImage2D = CountersUpload_glTexSubImage2D;
+    gl->glTexImage3D = CountersUpload_glTexImage3D;
+    gl->glTexSubImage3D = CountersUpload_glTexSubImage3D;
+    gl->glCompressedTexImage2D = CountersUpload_glCompressedTexImage2D;
+    gl->glCompressedTexSubImage2D = CountersUpload_glCompressedTexSubImage2D;
+    gl->glCompressedTexImage3D = CountersUpload_glCompressedTexImage3D;
+    gl->glCompressedTexSubImage3D = CountersUpload_glCompressedTexSubImage3D;
+    gl->glBufferData = CountersUpload_glBufferData;
+    gl->glBufferSubData = CountersUpload_glBufferSubData;
+    sCountersEnabled = true;
+}
+
+static void traceGLCallCounter(const char* name, EGLContext ctx,
+        uint64_t value) {
+    const String8 counter(String8::format("%s %p", name, ctx));
+    ATRACE_INT(counter.string(), int32_t(value < INT32_MAX ? value : INT32_MAX));
+}
+
+void flushGLCallCounters(bool endOfFrame) {
+    if (!sCountersEnabled) {
+        return;
+    }
+    GLCallCounters* const counters = getGLCallCounters();
+    const EGLContext ctx = egl_tls_t::getContext();
+    if (ctx != EGL_NO_CONTEXT) {
+        Mutex::Autolock _l(sContextCountersLock);
+        ssize_t index = sContextCounters.indexOfKey(ctx);
+        if (index < 0) {
+            index = sContextCounters.add(ctx, GLContextCounters());
+        }
+        GLContextCounters& context(sContextCounters.editValueAt(index));
+        context.total.calls += counters->calls;
+        context.total.stateChanges += counters->stateChanges;
+        context.total.drawCalls += counters->drawCalls;
+        context.total.textureUploads += counters->textureUploads;
+        context.total.textureBytes += counters->textureBytes;
+        context.total.bufferBytes += counters->bufferBytes;
+        if (endOfFrame) {
+            context.frames++;
+        }
+    }
+    // The counts of a frame are those since the last swap, or since the
+    // context was made current if it was in between
+    if (endOfFrame && ctx != EGL_NO_CONTEXT && ATRACE_ENABLED()) {
+        traceGLCallCounter("GL calls", ctx, counters->calls);
+        traceGLCallCounter("GL state changes", ctx, counters->stateChanges);
+        traceGLCallCounter("GL draw calls", ctx, counters->drawCalls);
+        traceGLCallCounter("GL texture uploads", ctx, counters->textureUploads);
+        traceGLCallCounter("GL texture bytes", ctx, counters->textureBytes);
+        traceGLCallCounter("GL buffer bytes", ctx, counters->bufferBytes);
+    }
+    *counters = GLCallCounters();
+}
+
+static String8 formatGLContextCounters(EGLContext ctx,
+        const GLContextCounters& context) {
+    const GLCallCounters& total(context.total);
+    const uint64_t frames = context.frames ? context.frames : 1;
+    return String8::format("context %p: %u frames, per frame: %" PRIu64
+            " calls, %" PRIu64 " state changes, %" PRIu64 " draw calls, %"
+            PRIu64 " texture uploads, %" PRIu64 " texture bytes, %" PRIu64
+            " buffer bytes", ctx, context.frames, total.calls / frames,
+            total.stateChanges / frames, total.drawCalls / frames,
+            total.textureUploads / frames, total.textureBytes / frames,
+            total.bufferBytes / frames);
+}
+
+void removeGLCallCounters(EGLContext ctx) {
+    if (!sCountersEnabled) {
+        return;
+    }
+    Mutex::Autolock _l(sContextCountersLock);
+    const ssize_t index = sContextCounters.indexOfKey(ctx);
+    if (index >= 0) {
+        ALOGD("%s", formatGLContextCounters(ctx,
+                sContextCounters.valueAt(index)).string());
+        sContextCounters.removeItemsAt(index);
+    }
+}
+
+void dumpGLCallCounters(int fd) {
+    if (!sCountersEnabled) {
+        dprintf(fd, "GL call counters are disabled, set debug.egl.trace "
+                "to \"counters\" to enable them\n");
+        return;
+    }
+    Mutex::Autolock _l(sContextCountersLock);
+    for (size_t i = 0; i < sContextCounters.size(); i++) {
+        dprintf(fd, "%s\n", formatGLContextCounters(sContextCounters.keyAt(i),
+                sContextCounters.valueAt(i)).string());
+    }
+}
+
 #undef TRACE_GL_VOID
 #undef TRACE_GL
 
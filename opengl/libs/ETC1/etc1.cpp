@@ -16,6 +16,20 @@
 
 #include <string.h>
 
+#if defined(__ANDROID__)
+#include <pthread.h>
+#include <unistd.h>
+#define ETC1_USE_THREADS 1
+#endif
+
+#if defined(__ARM_NEON__) || defined(__aarch64__)
+#include <arm_neon.h>
+#define ETC1_USE_NEON 1
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#define ETC1_USE_SSE2 1
+#endif
+
 /* From http://www.khronos.org/registry/gles/extensions/OES/OES_compressed_ETC1_RGB8_texture.txt
 
  The number of bits that represent a 4x4 texel block is 64 bits if
@@ -163,41 +177,31 @@ inline int convertDiff(int base, int diff) {
     return convert5To8((0x1f & base) + kLookup[0x7 & diff]);
 }
 
-static
-void decode_subblock(etc1_byte* pOut, int r, int g, int b, const int* table,
-        etc1_uint32 low, bool second, bool flipped) {
-    int baseX = 0;
-    int baseY = 0;
-    if (second) {
-        if (flipped) {
-            baseY = 2;
-        } else {
-            baseX = 2;
-        }
-    }
-    for (int i = 0; i < 8; i++) {
-        int x, y;
-        if (flipped) {
-            x = baseX + (i >> 1);
-            y = baseY + (i & 1);
-        } else {
-            x = baseX + (i >> 2);
-            y = baseY + (i & 3);
-        }
-        int k = y + (x * 4);
-        int offset = ((low >> k) & 1) | ((low >> (k + 15)) & 2);
-        int delta = table[offset];
-        etc1_byte* q = pOut + 3 * (x + 4 * y);
-        *q++ = clamp(r + delta);
-        *q++ = clamp(g + delta);
-        *q++ = clamp(b + delta);
-    }
-}
-
-// Input is an ETC1 compressed version of the data.
-// Output is a 4 x 4 square of 3-byte pixels in form R, G, B
+// The modifiers of each table, each repeated for the R, G and B components.
+#define ETC1_RGB_MODIFIERS(a, b, c, d) a, a, a, b, b, b, c, c, c, d, d, d
+static const short kModifierTableRGB[8][12] = {
+    { ETC1_RGB_MODIFIERS(2, 8, -2, -8) },
+    { ETC1_RGB_MODIFIERS(5, 17, -5, -17) },
+    { ETC1_RGB_MODIFIERS(9, 29, -9, -29) },
+    { ETC1_RGB_MODIFIERS(13, 42, -13, -42) },
+    { ETC1_RGB_MODIFIERS(18, 60, -18, -60) },
+    { ETC1_RGB_MODIFIERS(24, 80, -24, -80) },
+    { ETC1_RGB_MODIFIERS(33, 106, -33, -106) },
+    { ETC1_RGB_MODIFIERS(47, 183, -47, -183) } };
+#undef ETC1_RGB_MODIFIERS
+
+// A decoded block: the R, G, B colors of the first sub-block with each of the
+// modifiers of its table, then those of the second sub-block, which its pixels
+// pick from. Bit (y + x * 4) of second is set if pixel (x, y) is in the
+// second sub-block.
+typedef struct {
+    etc1_byte colors[24];
+    etc1_uint32 low;
+    etc1_uint32 second;
+} etc_decoded_block;
 
-void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
+static
+void etc_decode_palette(const etc1_byte* pIn, etc_decoded_block* pBlock) {
     etc1_uint32 high = (pIn[0] << 24) | (pIn[1] << 16) | (pIn[2] << 8) | pIn[3];
     etc1_uint32 low = (pIn[4] << 24) | (pIn[5] << 16) | (pIn[6] << 8) | pIn[7];
     int r1, r2, g1, g2, b1, b2;
@@ -223,11 +227,65 @@ void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
     }
     int tableIndexA = 7 & (high >> 5);
     int tableIndexB = 7 & (high >> 2);
-    const int* tableA = kModifierTable + tableIndexA * 4;
-    const int* tableB = kModifierTable + tableIndexB * 4;
-    bool flipped = (high & 1) != 0;
-    decode_subblock(pOut, r1, g1, b1, tableA, low, false, flipped);
-    decode_subblock(pOut, r2, g2, b2, tableB, low, true, flipped);
+    pBlock->low = low;
+    pBlock->second = (high & 1) ? 0xcccc : 0xff00;
+
+    short base[24];
+    short delta[24];
+    for (int i = 0; i < 12; i += 3) {
+        base[i] = r1;
+        base[i + 1] = g1;
+        base[i + 2] = b1;
+        base[i + 12] = r2;
+        base[i + 13] = g2;
+        base[i + 14] = b2;
+    }
+    memcpy(delta, kModifierTableRGB[tableIndexA], sizeof(kModifierTableRGB[0]));
+    memcpy(delta + 12, kModifierTableRGB[tableIndexB], sizeof(kModifierTableRGB[0]));
+#if defined(ETC1_USE_NEON)
+    for (int i = 0; i < 24; i += 8) {
+        int16x8_t color = vaddq_s16(vld1q_s16(base + i), vld1q_s16(delta + i));
+        vst1_u8(pBlock->colors + i, vqmovun_s16(color));
+    }
+#elif defined(ETC1_USE_SSE2)
+    __m128i c0 = _mm_add_epi16(_mm_loadu_si128((const __m128i*) base),
+            _mm_loadu_si128((const __m128i*) delta));
+    __m128i c1 = _mm_add_epi16(_mm_loadu_si128((const __m128i*) (base + 8)),
+            _mm_loadu_si128((const __m128i*) (delta + 8)));
+    __m128i c2 = _mm_add_epi16(_mm_loadu_si128((const __m128i*) (base + 16)),
+            _mm_loadu_si128((const __m128i*) (delta + 16)));
+    _mm_storeu_si128((__m128i*) pBlock->colors, _mm_packus_epi16(c0, c1));
+    _mm_storel_epi64((__m128i*) (pBlock->colors + 16), _mm_packus_epi16(c2, c2));
+#else
+    for (int i = 0; i < 24; i++) {
+        pBlock->colors[i] = clamp(base[i] + delta[i]);
+    }
+#endif
+}
+
+// Returns the index in the colors of a decoded block of the color of pixel
+// (x, y).
+static
+inline int etc_decoded_color_index(const etc_decoded_block* pBlock, int x, int y) {
+    int k = y + (x * 4);
+    return ((pBlock->second >> k) & 1) << 2 | ((pBlock->low >> (k + 15)) & 2)
+            | ((pBlock->low >> k) & 1);
+}
+
+// Input is an ETC1 compressed version of the data.
+// Output is a 4 x 4 square of 3-byte pixels in form R, G, B
+
+void etc1_decode_block(const etc1_byte* pIn, etc1_byte* pOut) {
+    etc_decoded_block block;
+    etc_decode_palette(pIn, &block);
+    for (int y = 0; y < 4; y++) {
+        for (int x = 0; x < 4; x++) {
+            const etc1_byte* color = block.colors + 3 * etc_decoded_color_index(&block, x, y);
+            *pOut++ = color[0];
+            *pOut++ = color[1];
+            *pOut++ = color[2];
+        }
+    }
 }
 
 typedef struct {
@@ -295,36 +353,91 @@ inline int square(int x) {
     return x * x;
 }
 
-static etc1_uint32 chooseModifier(const etc1_byte* pBaseColors,
-        const etc1_byte* pIn, etc1_uint32 *pLow, int bitIndex,
-        const int* pModifierTable) {
+// The colors that a base color decodes to with each of the 4 modifiers of a
+// table: the green and red components interleaved, then the blue ones
+// interleaved with 0, which is the layout the vector kernels load them in.
+typedef struct {
+    short gr[8];
+    short b0[8];
+} etc_decoded_colors;
+
+static
+void etc_decode_colors(const etc1_byte* pBaseColors, const int* pModifierTable,
+        etc_decoded_colors* pDecoded) {
+    for (int i = 0; i < 4; i++) {
+        int modifier = pModifierTable[i];
+        pDecoded->gr[2 * i] = clamp(pBaseColors[1] + modifier);
+        pDecoded->gr[2 * i + 1] = clamp(pBaseColors[0] + modifier);
+        pDecoded->b0[2 * i] = clamp(pBaseColors[2] + modifier);
+        pDecoded->b0[2 * i + 1] = 0;
+    }
+}
+
+// Returns the index of the modifier whose decoded color is the closest to the
+// pixel, the first one if several are, and sets *pScore to its error.
+static
+inline int etc_choose_modifier_index(const etc_decoded_colors* pDecoded,
+        const etc1_byte* pIn, etc1_uint32* pScore) {
+#if defined(ETC1_USE_NEON) || defined(ETC1_USE_SSE2)
+    int scores[4];
+#if defined(ETC1_USE_NEON)
+    int16x4x2_t gr = vld2_s16(pDecoded->gr);
+    int16x4x2_t b0 = vld2_s16(pDecoded->b0);
+    int16x4_t dg = vsub_s16(gr.val[0], vdup_n_s16(pIn[1]));
+    int16x4_t dr = vsub_s16(gr.val[1], vdup_n_s16(pIn[0]));
+    int16x4_t db = vsub_s16(b0.val[0], vdup_n_s16(pIn[2]));
+    int32x4_t score = vmull_s16(dg, vmul_n_s16(dg, 6));
+    score = vmlal_s16(score, dr, vmul_n_s16(dr, 3));
+    score = vmlal_s16(score, db, db);
+    vst1q_s32(scores, score);
+#else
+    const __m128i gr = _mm_loadu_si128((const __m128i*) pDecoded->gr);
+    const __m128i b0 = _mm_loadu_si128((const __m128i*) pDecoded->b0);
+    const __m128i dgr = _mm_sub_epi16(gr, _mm_set1_epi32((pIn[0] << 16) | pIn[1]));
+    const __m128i db0 = _mm_sub_epi16(b0, _mm_set1_epi32(pIn[2]));
+    const __m128i weights = _mm_set1_epi32((3 << 16) | 6);
+    __m128i score = _mm_madd_epi16(dgr, _mm_mullo_epi16(dgr, weights));
+    score = _mm_add_epi32(score, _mm_madd_epi16(db0, db0));
+    _mm_storeu_si128((__m128i*) scores, score);
+#endif
+    int bestIndex = 0;
+    for (int i = 1; i < 4; i++) {
+        if (scores[i] < scores[bestIndex]) {
+            bestIndex = i;
+        }
+    }
+    *pScore = (etc1_uint32) scores[bestIndex];
+    return bestIndex;
+#else
     etc1_uint32 bestScore = ~0;
     int bestIndex = 0;
     int pixelR = pIn[0];
     int pixelG = pIn[1];
     int pixelB = pIn[2];
-    int r = pBaseColors[0];
-    int g = pBaseColors[1];
-    int b = pBaseColors[2];
     for (int i = 0; i < 4; i++) {
-        int modifier = pModifierTable[i];
-        int decodedG = clamp(g + modifier);
-        etc1_uint32 score = (etc1_uint32) (6 * square(decodedG - pixelG));
+        etc1_uint32 score = (etc1_uint32) (6 * square(pDecoded->gr[2 * i] - pixelG));
         if (score >= bestScore) {
             continue;
         }
-        int decodedR = clamp(r + modifier);
-        score += (etc1_uint32) (3 * square(decodedR - pixelR));
+        score += (etc1_uint32) (3 * square(pDecoded->gr[2 * i + 1] - pixelR));
         if (score >= bestScore) {
             continue;
         }
-        int decodedB = clamp(b + modifier);
-        score += (etc1_uint32) square(decodedB - pixelB);
+        score += (etc1_uint32) square(pDecoded->b0[2 * i] - pixelB);
         if (score < bestScore) {
             bestScore = score;
             bestIndex = i;
         }
     }
+    *pScore = bestScore;
+    return bestIndex;
+#endif
+}
+
+static etc1_uint32 chooseModifier(const etc_decoded_colors* pDecoded,
+        const etc1_byte* pIn, etc1_uint32 *pLow, int bitIndex) {
+    etc1_uint32 bestScore;
+    int bestIndex = etc_choose_modifier_index(pDecoded, pIn, &bestScore);
     etc1_uint32 lowMask = (((bestIndex >> 1) << 16) | (bestIndex & 1))
             << bitIndex;
     *pLow |= lowMask;
@@ -336,6 +449,9 @@ void etc_encode_subblock_helper(const etc1_byte* pIn, etc1_uint32 inMask,
         etc_compressed* pCompressed, bool flipped, bool second,
         const etc1_byte* pBaseColors, const int* pModifierTable) {
     int score = pCompressed->score;
+    // The colors the pixels can decode to are the same for all of them
+    etc_decoded_colors decoded;
+    etc_decode_colors(pBaseColors, pModifierTable, &decoded);
     if (flipped) {
         int by = 0;
         if (second) {
@@ -346,8 +462,8 @@ void etc_encode_subblock_helper(const etc1_byte* pIn, etc1_uint32 inMask,
             for (int x = 0; x < 4; x++) {
                 int i = x + 4 * yy;
                 if (inMask & (1 << i)) {
-                    score += chooseModifier(pBaseColors, pIn + i * 3,
-                            &pCompressed->low, yy + x * 4, pModifierTable);
+                    score += chooseModifier(&decoded, pIn + i * 3,
+                            &pCompressed->low, yy + x * 4);
                 }
             }
         }
@@ -361,8 +477,8 @@ void etc_encode_subblock_helper(const etc1_byte* pIn, etc1_uint32 inMask,
                 int xx = bx + x;
                 int i = xx + 4 * y;
                 if (inMask & (1 << i)) {
-                    score += chooseModifier(pBaseColors, pIn + i * 3,
-                            &pCompressed->low, y + xx * 4, pModifierTable);
+                    score += chooseModifier(&decoded, pIn + i * 3,
+                            &pCompressed->low, y + xx * 4);
                 }
             }
         }
@@ -504,16 +620,12 @@ etc1_uint32 etc1_get_encoded_data_size(etc1_uint32 width, etc1_uint32 height) {
     return (((width + 3) & ~3) * ((height + 3) & ~3)) >> 1;
 }
 
-// Encode an entire image.
-// pIn - pointer to the image data. Formatted such that the Red component of
-//       pixel (x,y) is at pIn + pixelSize * x + stride * y + redOffset;
-// pOut - pointer to encoded data. Must be large enough to store entire encoded image.
+// Encode the rows of blocks [rowBegin, rowEnd) of an image, to pOut, which
+// points to the first of them.
 
-int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
-        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut) {
-    if (pixelSize < 2 || pixelSize > 3) {
-        return -1;
-    }
+static void etc1_encode_rows(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut,
+        etc1_uint32 rowBegin, etc1_uint32 rowEnd) {
     static const unsigned short kYMask[] = { 0x0, 0xf, 0xff, 0xfff, 0xffff };
     static const unsigned short kXMask[] = { 0x0, 0x1111, 0x3333, 0x7777,
             0xffff };
@@ -521,9 +633,8 @@ int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 heigh
     etc1_byte encoded[ETC1_ENCODED_BLOCK_SIZE];
 
     etc1_uint32 encodedWidth = (width + 3) & ~3;
-    etc1_uint32 encodedHeight = (height + 3) & ~3;
 
-    for (etc1_uint32 y = 0; y < encodedHeight; y += 4) {
+    for (etc1_uint32 y = rowBegin * 4; y < rowEnd * 4; y += 4) {
         etc1_uint32 yEnd = height - y;
         if (yEnd > 4) {
             yEnd = 4;
@@ -555,6 +666,92 @@ int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 heigh
             pOut += sizeof(encoded);
         }
     }
+}
+
+#if defined(ETC1_USE_THREADS)
+
+// Images are split in bands of at least that many rows of blocks, one per
+// thread, so that small ones aren't slowed down by starting threads.
+static const etc1_uint32 kMinRowsPerThread = 16;
+static const etc1_uint32 kMaxThreads = 8;
+
+typedef struct {
+    const etc1_byte* pIn;
+    etc1_uint32 width;
+    etc1_uint32 height;
+    etc1_uint32 pixelSize;
+    etc1_uint32 stride;
+    etc1_byte* pOut;
+    etc1_uint32 rowBegin;
+    etc1_uint32 rowEnd;
+} etc_encode_band;
+
+static void* etc1_encode_band_thread(void* arg) {
+    const etc_encode_band* band = (const etc_encode_band*) arg;
+    etc1_encode_rows(band->pIn, band->width, band->height, band->pixelSize,
+            band->stride, band->pOut, band->rowBegin, band->rowEnd);
+    return NULL;
+}
+
+#endif
+
+// Encode an entire image.
+// pIn - pointer to the image data. Formatted such that the Red component of
+//       pixel (x,y) is at pIn + pixelSize * x + stride * y + redOffset;
+// pOut - pointer to encoded data. Must be large enough to store entire encoded image.
+// Large images are encoded in bands of rows, on as many threads as there are
+// online CPUs.
+
+int etc1_encode_image(const etc1_byte* pIn, etc1_uint32 width, etc1_uint32 height,
+        etc1_uint32 pixelSize, etc1_uint32 stride, etc1_byte* pOut) {
+    if (pixelSize < 2 || pixelSize > 3) {
+        return -1;
+    }
+    etc1_uint32 rows = ((height + 3) & ~3) / 4;
+
+#if defined(ETC1_USE_THREADS)
+    etc1_uint32 numThreads = rows / kMinRowsPerThread;
+    long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+    if (numCpus > 0 && numThreads > (etc1_uint32) numCpus) {
+        numThreads = numCpus;
+    }
+    if (numThreads > kMaxThreads) {
+        numThreads = kMaxThreads;
+    }
+    if (numThreads > 1) {
+        etc1_uint32 rowSize = etc1_get_encoded_data_size(width, 4);
+        etc_encode_band bands[kMaxThreads];
+        pthread_t threads[kMaxThreads];
+        bool started[kMaxThreads];
+        for (etc1_uint32 i = 0; i < numThreads; i++) {
+            etc_encode_band* band = &bands[i];
+            band->pIn = pIn;
+            band->width = width;
+            band->height = height;
+            band->pixelSize = pixelSize;
+            band->stride = stride;
+            band->rowBegin = rows * i / numThreads;
+            band->rowEnd = rows * (i + 1) / numThreads;
+            band->pOut = pOut + rowSize * band->rowBegin;
+            // The calling thread encodes the first band
+            started[i] = i > 0 && pthread_create(&threads[i], NULL,
+                    etc1_encode_band_thread, band) == 0;
+        }
+        for (etc1_uint32 i = 0; i < numThreads; i++) {
+            if (!started[i]) {
+                etc1_encode_band_thread(&bands[i]);
+            }
+        }
+        for (etc1_uint32 i = 1; i < numThreads; i++) {
+            if (started[i]) {
+                pthread_join(threads[i], NULL);
+            }
+        }
+        return 0;
+    }
+#endif
+
+    etc1_encode_rows(pIn, width, height, pixelSize, stride, pOut, 0, rows);
     return 0;
 }
 
@@ -571,11 +768,11 @@ int etc1_decode_image(const etc1_byte* pIn, etc1_byte* pOut,
     if (pixelSize < 2 || pixelSize > 3) {
         return -1;
     }
-    etc1_byte block[ETC1_DECODED_BLOCK_SIZE];
-
     etc1_uint32 encodedWidth = (width + 3) & ~3;
     etc1_uint32 encodedHeight = (height + 3) & ~3;
 
+    // The pixels are written straight from the colors of their block,
+    // converted to 565 once per block when pixelSize is 2
     for (etc1_uint32 y = 0; y < encodedHeight; y += 4) {
         etc1_uint32 yEnd = height - y;
         if (yEnd > 4) {
@@ -586,19 +783,31 @@ int etc1_decode_image(const etc1_byte* pIn, etc1_byte* pOut,
             if (xEnd > 4) {
                 xEnd = 4;
             }
-            etc1_decode_block(pIn, block);
+            etc_decoded_block block;
+            etc_decode_palette(pIn, &block);
             pIn += ETC1_ENCODED_BLOCK_SIZE;
-            for (etc1_uint32 cy = 0; cy < yEnd; cy++) {
-                const etc1_byte* q = block + (cy * 4) * 3;
-                etc1_byte* p = pOut + pixelSize * x + stride * (y + cy);
-                if (pixelSize == 3) {
-                    memcpy(p, q, xEnd * 3);
-                } else {
+            if (pixelSize == 3) {
+                for (etc1_uint32 cy = 0; cy < yEnd; cy++) {
+                    etc1_byte* p = pOut + 3 * x + stride * (y + cy);
+                    for (etc1_uint32 cx = 0; cx < xEnd; cx++) {
+                        const etc1_byte* q = block.colors
+                                + 3 * etc_decoded_color_index(&block, cx, cy);
+                        *p++ = q[0];
+                        *p++ = q[1];
+                        *p++ = q[2];
+                    }
+                }
+            } else {
+                etc1_uint32 colors565[8];
+                for (int i = 0; i < 8; i++) {
+                    const etc1_byte* q = block.colors + 3 * i;
+                    colors565[i] = ((q[0] >> 3) << 11) | ((q[1] >> 2) << 5) | (q[2] >> 3);
+                }
+                for (etc1_uint32 cy = 0; cy < yEnd; cy++) {
+                    etc1_byte* p = pOut + 2 * x + stride * (y + cy);
                     for (etc1_uint32 cx = 0; cx < xEnd; cx++) {
-                        etc1_byte r = *q++;
-                        etc1_byte g = *q++;
-                        etc1_byte b = *q++;
-                        etc1_uint32 pixel = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+                        etc1_uint32 pixel = colors565[
+                                etc_decoded_color_index(&block, cx, cy)];
                         *p++ = (etc1_byte) pixel;
                         *p++ = (etc1_byte) (pixel >> 8);
                     }
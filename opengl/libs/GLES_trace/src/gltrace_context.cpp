@@ -15,7 +15,9 @@
  */
 
 #include <pthread.h>
+#include <stdlib.h>
 #include <cutils/log.h>
+#include <cutils/properties.h>
 
 extern "C" {
 #include "liblzf/lzf.h"
@@ -64,6 +66,13 @@ GLTraceState::GLTraceState(TCPStream *stream) {
     mCollectFbOnGlDraw = false;
     mCollectTextureDataOnGlTexImage = false;
     pthread_rwlock_init(&mTraceOptionsRwLock, NULL);
+
+    char value[PROPERTY_VALUE_MAX];
+    property_get("debug.egl.debug_fbscale", value, "1");
+    mFbScale = atoi(value);
+    if (mFbScale < 1) {
+        mFbScale = 1;
+    }
 }
 
 GLTraceState::~GLTraceState() {
@@ -114,6 +123,10 @@ bool GLTraceState::shouldCollectTextureDataOnGlTexImage() {
     return safeGetValue(&mCollectTextureDataOnGlTexImage, &mTraceOptionsRwLock);
 }
 
+int GLTraceState::getFbScale() {
+    return mFbScale;
+}
+
 GLTraceContext *GLTraceState::createTraceContext(int version, EGLContext eglContext) {
     int id = __sync_fetch_and_add(&mTraceContextIds, 1);
 
@@ -142,6 +155,8 @@ GLTraceContext::GLTraceContext(int id, int version, GLTraceState *state,
 {
     fbcontents = fbcompressed = NULL;
     fbcontentsSize = 0;
+    fbScaledFramebuffer = fbScaledRenderbuffer = 0;
+    fbScaledWidth = fbScaledHeight = 0;
 }
 
 int GLTraceContext::getId() {
@@ -202,6 +217,68 @@ void GLTraceContext::resizeFBMemory(unsigned minSize) {
     fbcontentsSize = minSize;
 }
 
+bool GLTraceContext::readScaledFB(const int viewport[4], int scale,
+                            GLsizei *width, GLsizei *height) {
+    // A multisampled framebuffer can't be resolved and scaled in a single blit
+    GLint samples = 0;
+    hooks->gl.glGetIntegerv(GL_SAMPLES, &samples);
+    if (samples > 0) {
+        return false;
+    }
+
+    GLsizei w = viewport[2] / scale > 0 ? viewport[2] / scale : 1;
+    GLsizei h = viewport[3] / scale > 0 ? viewport[3] / scale : 1;
+
+    GLint readFb = 0, drawFb = 0, renderbuffer = 0, packBuffer = 0;
+    hooks->gl.glGetIntegerv(GL_READ_FRAMEBUFFER_BINDING, &readFb);
+    hooks->gl.glGetIntegerv(GL_DRAW_FRAMEBUFFER_BINDING, &drawFb);
+    hooks->gl.glGetIntegerv(GL_RENDERBUFFER_BINDING, &renderbuffer);
+    hooks->gl.glGetIntegerv(GL_PIXEL_PACK_BUFFER_BINDING, &packBuffer);
+    GLboolean scissorTest = hooks->gl.glIsEnabled(GL_SCISSOR_TEST);
+
+    if (fbScaledFramebuffer == 0) {
+        hooks->gl.glGenFramebuffers(1, &fbScaledFramebuffer);
+        hooks->gl.glGenRenderbuffers(1, &fbScaledRenderbuffer);
+    }
+    hooks->gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, fbScaledFramebuffer);
+    if (fbScaledWidth != w || fbScaledHeight != h) {
+        hooks->gl.glBindRenderbuffer(GL_RENDERBUFFER, fbScaledRenderbuffer);
+        hooks->gl.glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, w, h);
+        hooks->gl.glFramebufferRenderbuffer(GL_DRAW_FRAMEBUFFER, GL_COLOR_ATTACHMENT0,
+                                            GL_RENDERBUFFER, fbScaledRenderbuffer);
+        hooks->gl.glBindRenderbuffer(GL_RENDERBUFFER, renderbuffer);
+        fbScaledWidth = w;
+        fbScaledHeight = h;
+    }
+
+    // the blit is subject to the scissor test
+    if (scissorTest) {
+        hooks->gl.glDisable(GL_SCISSOR_TEST);
+    }
+    hooks->gl.glBlitFramebuffer(viewport[0], viewport[1],
+                                viewport[0] + viewport[2], viewport[1] + viewport[3],
+                                0, 0, w, h, GL_COLOR_BUFFER_BIT, GL_LINEAR);
+    if (scissorTest) {
+        hooks->gl.glEnable(GL_SCISSOR_TEST);
+    }
+
+    hooks->gl.glBindFramebuffer(GL_READ_FRAMEBUFFER, fbScaledFramebuffer);
+    if (packBuffer != 0) {
+        hooks->gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, 0);
+    }
+    hooks->gl.glReadPixels(0, 0, w, h, GL_RGBA, GL_UNSIGNED_BYTE, fbcontents);
+    if (packBuffer != 0) {
+        hooks->gl.glBindBuffer(GL_PIXEL_PACK_BUFFER, packBuffer);
+    }
+
+    hooks->gl.glBindFramebuffer(GL_READ_FRAMEBUFFER, readFb);
+    hooks->gl.glBindFramebuffer(GL_DRAW_FRAMEBUFFER, drawFb);
+
+    *width = w;
+    *height = h;
+    return true;
+}
+
 /** obtain a pointer to the compressed framebuffer image */
 void GLTraceContext::getCompressedFB(void **fb, unsigned *fbsize, unsigned *fbwidth, 
                             unsigned *fbheight, FBBinding fbToRead) {
@@ -223,8 +300,17 @@ void GLTraceContext::getCompressedFB(void **fb, unsigned *fbsize, unsigned *fbwi
         }
     }
 
-    hooks->gl.glReadPixels(viewport[0], viewport[1], viewport[2], viewport[3],
-                                        GL_RGBA, GL_UNSIGNED_BYTE, fbcontents);
+    // Downscaling needs glBlitFramebuffer, from GLES 3.0
+    GLsizei width = viewport[2];
+    GLsizei height = viewport[3];
+    const int scale = mState->getFbScale();
+    if (scale > 1 && getVersionMajor() >= 3
+            && readScaledFB(viewport, scale, &width, &height)) {
+        fbContentsSize = width * height * 4;
+    } else {
+        hooks->gl.glReadPixels(viewport[0], viewport[1], viewport[2], viewport[3],
+                                            GL_RGBA, GL_UNSIGNED_BYTE, fbcontents);
+    }
 
     // switch back to previously bound buffer if necessary
     if (fbSwitched) {
@@ -233,8 +319,8 @@ void GLTraceContext::getCompressedFB(void **fb, unsigned *fbsize, unsigned *fbwi
 
     *fbsize = lzf_compress(fbcontents, fbContentsSize, fbcompressed, fbContentsSize);
     *fb = fbcompressed;
-    *fbwidth = viewport[2];
-    *fbheight = viewport[3];
+    *fbwidth = width;
+    *fbheight = height;
 }
 
 void GLTraceContext::traceGLMessage(GLMessage *msg) {
@@ -60,6 +60,11 @@ class GLTraceContext {
     void *fbcompressed;         /* destination for lzf compressed framebuffer */
     unsigned fbcontentsSize;    /* size of fbcontents & fbcompressed buffers */
 
+    GLuint fbScaledFramebuffer; /* framebuffer the framebuffer is downscaled into */
+    GLuint fbScaledRenderbuffer;/* its color attachment */
+    GLsizei fbScaledWidth;      /* size of fbScaledRenderbuffer */
+    GLsizei fbScaledHeight;
+
     BufferedOutputStream *mBufferedOutputStream; /* stream where trace info is sent */
 
     /* list of element array buffers in use. */
@@ -69,6 +74,9 @@ class GLTraceContext {
        minor versions of the GLES API. The context must be current before calling. */
     void parseGlesVersion();
     void resizeFBMemory(unsigned minSize);
+    /* Reads the viewport of the framebuffer bound to GL_READ_FRAMEBUFFER into fbcontents,
+       downscaled by scale on the GPU. Returns false if it can't be downscaled. */
+    bool readScaledFB(const int viewport[4], int scale, GLsizei *width, GLsizei *height);
 public:
     gl_hooks_t *hooks;
 
@@ -104,6 +112,9 @@ class GLTraceState {
     bool mCollectTextureDataOnGlTexImage;
     pthread_rwlock_t mTraceOptionsRwLock;
 
+    /* Factor the framebuffer contents are downscaled by, from debug.egl.debug_fbscale. */
+    int mFbScale;
+
     /* helper methods to get/set values using provided lock for mutual exclusion. */
     void safeSetValue(bool *ptr, bool value, pthread_rwlock_t *lock);
     bool safeGetValue(bool *ptr, pthread_rwlock_t *lock);
@@ -125,6 +136,8 @@ public:
     bool shouldCollectFbOnEglSwap();
     bool shouldCollectFbOnGlDraw();
     bool shouldCollectTextureDataOnGlTexImage();
+
+    int getFbScale();
 };
 
 void setupTraceContextThreadSpecific(GLTraceContext *context);
@@ -111,11 +111,15 @@ static void *commandReceiveTask(void *arg) {
 /**
  * Starts Trace Server and waits for connection from the host.
  * Returns -1 in case of connection error, 0 otherwise.
+ *
+ * If the debug.egl.debug_tracefile property is set, the trace is written to
+ * that file instead, with no host to send trace options.
  */
 int GLTrace_start() {
     int status = 0;
     int clientSocket = -1;
     TCPStream *stream = NULL;
+    bool traceToFile = false;
 
     pthread_mutex_lock(&sGlTraceStateLock);
 
@@ -123,9 +127,16 @@ int GLTrace_start() {
         goto done;
     }
 
-    char udsName[PROPERTY_VALUE_MAX];
-    property_get("debug.egl.debug_portname", udsName, "gltrace");
-    clientSocket = gltrace::acceptClientConnection(udsName);
+    char traceFile[PROPERTY_VALUE_MAX];
+    property_get("debug.egl.debug_tracefile", traceFile, "");
+    if (traceFile[0] != '\0') {
+        clientSocket = gltrace::openTraceFile(traceFile);
+        traceToFile = true;
+    } else {
+        char udsName[PROPERTY_VALUE_MAX];
+        property_get("debug.egl.debug_portname", udsName, "gltrace");
+        clientSocket = gltrace::acceptClientConnection(udsName);
+    }
     if (clientSocket < 0) {
         ALOGE("Error creating GLTrace server socket. Tracing disabled.");
         status = -1;
@@ -140,7 +151,9 @@ int GLTrace_start() {
     // initialize tracing state
     sGLTraceState = new GLTraceState(stream);
 
-    pthread_create(&sReceiveThreadId, NULL, commandReceiveTask, sGLTraceState);
+    if (!traceToFile) {
+        pthread_create(&sReceiveThreadId, NULL, commandReceiveTask, sGLTraceState);
+    }
 
 done:
     pthread_mutex_unlock(&sGlTraceStateLock);
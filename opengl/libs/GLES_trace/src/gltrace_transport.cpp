@@ -15,6 +15,7 @@
  */
 
 #include <errno.h>
+#include <fcntl.h>
 #include <stdlib.h>
 #include <unistd.h>
 
@@ -91,34 +92,143 @@ int acceptClientConnection(char *sockname) {
     return clientSocket;
 }
 
+int openTraceFile(const char *path) {
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (fd < 0) {
+        ALOGE("Error (%d) while creating trace file %s", errno, path);
+        return -1;
+    }
+
+    ALOGD("gltrace::openTraceFile: writing trace to %s", path);
+    return fd;
+}
+
 TCPStream::TCPStream(int socket) {
     mSocket = socket;
     pthread_mutex_init(&mSocketWriteMutex, NULL);
+
+    pthread_mutex_init(&mQueueMutex, NULL);
+    pthread_cond_init(&mQueueCond, NULL);
+    mQueuedSize = 0;
+    mWriterExit = false;
+    mWriterError = false;
+    pthread_create(&mWriterThread, NULL, writerTask, this);
 }
 
 TCPStream::~TCPStream() {
+    closeStream();
+    pthread_cond_destroy(&mQueueCond);
+    pthread_mutex_destroy(&mQueueMutex);
     pthread_mutex_destroy(&mSocketWriteMutex);
 }
 
 void TCPStream::closeStream() {
+    pthread_mutex_lock(&mQueueMutex);
+    bool wasRunning = !mWriterExit;
+    mWriterExit = true;
+    pthread_cond_broadcast(&mQueueCond);
+    pthread_mutex_unlock(&mQueueMutex);
+
+    if (wasRunning) {
+        pthread_join(mWriterThread, NULL);
+    }
+
     if (mSocket > 0) {
         close(mSocket);
         mSocket = 0;
     }
 }
 
+int TCPStream::writeFully(const void *buf, size_t len) {
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = write(mSocket, (const uint8_t*)buf + written, len - written);
+        if (n < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            ALOGE("Error sending data to stream: %d", errno);
+            return -1;
+        }
+        written += n;
+    }
+    return 0;
+}
+
 int TCPStream::send(void *buf, size_t len) {
     if (mSocket <= 0) {
         return -1;
     }
 
     pthread_mutex_lock(&mSocketWriteMutex);
-    int n = write(mSocket, buf, len);
+    int n = writeFully(buf, len);
     pthread_mutex_unlock(&mSocketWriteMutex);
 
     return n;
 }
 
+int TCPStream::sendAsync(std::string *buffer) {
+    pthread_mutex_lock(&mQueueMutex);
+    // Throttle the GL threads if the host can't keep up, rather than
+    // dropping messages.
+    while (mQueuedSize > MAX_QUEUED_SIZE && !mWriterExit && !mWriterError) {
+        pthread_cond_wait(&mQueueCond, &mQueueMutex);
+    }
+    if (mWriterExit || mWriterError) {
+        pthread_mutex_unlock(&mQueueMutex);
+        buffer->clear();
+        return -1;
+    }
+
+    mQueuedSize += buffer->size();
+    mQueue.push_back(std::string());
+    mQueue.back().swap(*buffer);
+    if (!mFreeBuffers.empty()) {
+        buffer->swap(mFreeBuffers.back());
+        mFreeBuffers.pop_back();
+    }
+    pthread_cond_broadcast(&mQueueCond);
+    pthread_mutex_unlock(&mQueueMutex);
+    return 0;
+}
+
+void *TCPStream::writerTask(void *arg) {
+    TCPStream *stream = (TCPStream *)arg;
+    std::string buffer;
+
+    pthread_mutex_lock(&stream->mQueueMutex);
+    while (true) {
+        while (stream->mQueue.empty() && !stream->mWriterExit) {
+            pthread_cond_wait(&stream->mQueueCond, &stream->mQueueMutex);
+        }
+        if (stream->mQueue.empty()) {
+            // only exit once everything queued was written
+            break;
+        }
+
+        buffer.swap(stream->mQueue.front());
+        stream->mQueue.pop_front();
+        pthread_mutex_unlock(&stream->mQueueMutex);
+
+        int err = stream->send((void *)buffer.data(), buffer.size());
+
+        pthread_mutex_lock(&stream->mQueueMutex);
+        stream->mQueuedSize -= buffer.size();
+        buffer.clear();
+        if (stream->mFreeBuffers.size() < MAX_FREE_BUFFERS) {
+            stream->mFreeBuffers.push_back(std::string());
+            stream->mFreeBuffers.back().swap(buffer);
+        }
+        pthread_cond_broadcast(&stream->mQueueCond);
+        if (err < 0) {
+            stream->mWriterError = true;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&stream->mQueueMutex);
+    return NULL;
+}
+
 int TCPStream::receive(void *data, size_t len) {
     if (mSocket <= 0) {
         return -1;
@@ -151,8 +261,10 @@ int BufferedOutputStream::flush() {
         return 0;
     }
 
-    int n = mStream->send((void *)mStringBuffer.data(), mStringBuffer.size());
-    mStringBuffer.clear();
+    int n = mStream->sendAsync(&mStringBuffer);
+    if (mStringBuffer.capacity() < mBufferSize) {
+        mStringBuffer.reserve(mBufferSize);
+    }
     return n;
 }
 
@@ -19,6 +19,10 @@
 
 #include <pthread.h>
 
+#include <deque>
+#include <string>
+#include <vector>
+
 #include "frameworks/native/opengl/libs/GLES_trace/proto/gltrace.pb.h"
 
 namespace android {
@@ -27,21 +31,48 @@ namespace gltrace {
 /**
  * TCPStream provides a TCP based communication channel from the device to
  * the host for transferring GLMessages.
+ *
+ * The data queued with sendAsync is written by a writer thread, so that the
+ * GL threads don't wait for the host to read it, unless more than
+ * MAX_QUEUED_SIZE bytes are waiting to be written.
  */
 class TCPStream {
+    enum { MAX_QUEUED_SIZE = 16 * 1024 * 1024 };
+    enum { MAX_FREE_BUFFERS = 8 };
+
     int mSocket;
     pthread_mutex_t mSocketWriteMutex;
+
+    /* Buffers waiting to be written, and emptied ones to be reused. */
+    pthread_mutex_t mQueueMutex;
+    pthread_cond_t mQueueCond;
+    std::deque<std::string> mQueue;
+    std::vector<std::string> mFreeBuffers;
+    size_t mQueuedSize;
+    bool mWriterExit;
+    bool mWriterError;
+    pthread_t mWriterThread;
+
+    static void *writerTask(void *arg);
+    /** Write all of @data, returns -1 on error, 0 on success. */
+    int writeFully(const void *data, size_t len);
 public:
     /** Create a TCP based communication channel over @socket */
     TCPStream(int socket);
     ~TCPStream();
 
-    /** Close the channel. */
+    /** Close the channel, once the queued data is written. */
     void closeStream();
 
     /** Send @data of size @len to host. . Returns -1 on error, 0 on success. */
     int send(void *data, size_t len);
 
+    /**
+     * Queue the contents of @buffer to be sent to the host, and leave
+     * @buffer empty. Returns -1 on error, 0 on success.
+     */
+    int sendAsync(std::string *buffer);
+
     /**
      * Receive @len bytes of data into @buf from the remote end. This is a blocking call.
      * Returns -1 on failure, 0 on success.
@@ -51,7 +82,8 @@ public:
 
 /**
  * BufferedOutputStream provides buffering of data sent to the underlying
- * unbuffered channel.
+ * unbuffered channel. The buffered data is handed over to the channel's
+ * writer thread when flushed.
  */
 class BufferedOutputStream {
     TCPStream *mStream;
@@ -85,6 +117,13 @@ public:
  */
 int acceptClientConnection(char *sockName);
 
+/**
+ * Utility method: create the file @path, to which the trace is written
+ * instead of being sent to a host, in the format the host saves it in.
+ * Returns the file descriptor on success, or -1 on failure.
+ */
+int openTraceFile(const char *path);
+
 };
 };
 
@@ -2,11 +2,13 @@ dirs := \
 	angeles \
 	configdump \
 	EGLTest \
+	etc1_codec \
 	fillrate \
 	filter \
 	finish \
 	gl2_basic \
 	gl2_copyTexImage \
+	gl2_dispatch \
 	gl2_yuvtex \
 	gl_basic \
 	gl_perf \
@@ -107,4 +107,24 @@ TEST_F(EGLCacheSerializationTest, ReinitializedCacheContainsValues) {
     ASSERT_EQ('h', buf[3]);
 }
 
+TEST_F(EGLCacheSerializationTest, ReinitializedCacheContainsAppendedValues) {
+    uint8_t buf[32 * 1024];
+    uint8_t value[32 * 1024];
+    memset(value, 'v', sizeof(value));
+    mCache->setCacheFilename(mFilename);
+    mCache->initialize(egl_display_t::get(EGL_DEFAULT_DISPLAY));
+    mCache->setBlob("abcd", 4, "efgh", 4);
+    mCache->terminate();
+    mCache->initialize(egl_display_t::get(EGL_DEFAULT_DISPLAY));
+    mCache->setBlob("ijkl", 4, value, sizeof(value));
+    mCache->terminate();
+    mCache->initialize(egl_display_t::get(EGL_DEFAULT_DISPLAY));
+    ASSERT_EQ(4, mCache->getBlob("abcd", 4, buf, 4));
+    ASSERT_EQ('e', buf[0]);
+    ASSERT_EQ('h', buf[3]);
+    ASSERT_EQ(EGLsizeiANDROID(sizeof(value)),
+            mCache->getBlob("ijkl", 4, buf, sizeof(buf)));
+    ASSERT_EQ(0, memcmp(value, buf, sizeof(value)));
+}
+
 }
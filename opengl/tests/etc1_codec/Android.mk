@@ -0,0 +1,15 @@
+LOCAL_PATH:= $(call my-dir)
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	etc1_codec.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libETC1 \
+	libutils
+
+LOCAL_MODULE:= test-opengl-etc1_codec
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,141 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The throughput of libETC1's etc1_encode_image and etc1_decode_image, on a
+ * synthetic image of gradients and noise, for both the 565 and RGB pixel
+ * formats, and the error of the decoded image.
+ *
+ * usage: test-opengl-etc1_codec [-s size] [-i iterations]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <ETC1/etc1.h>
+
+#include <utils/Timers.h>
+
+using namespace android;
+
+static void fillImage(std::vector<etc1_byte>* image, etc1_uint32 size,
+        etc1_uint32 pixelSize) {
+    image->resize(size * size * pixelSize);
+    srand(1);
+    etc1_byte* p = &(*image)[0];
+    for (etc1_uint32 y = 0; y < size; y++) {
+        for (etc1_uint32 x = 0; x < size; x++) {
+            int noise = rand() % 32;
+            int r = (x * 255 / size + noise) & 0xff;
+            int g = (y * 255 / size + noise) & 0xff;
+            int b = ((x + y) * 255 / (2 * size) + noise) & 0xff;
+            if (pixelSize == 3) {
+                *p++ = r;
+                *p++ = g;
+                *p++ = b;
+            } else {
+                int pixel = ((r >> 3) << 11) | ((g >> 2) << 5) | (b >> 3);
+                *p++ = pixel;
+                *p++ = pixel >> 8;
+            }
+        }
+    }
+}
+
+static void getComponents(const etc1_byte* p, etc1_uint32 pixelSize, int* rgb) {
+    if (pixelSize == 3) {
+        rgb[0] = p[0];
+        rgb[1] = p[1];
+        rgb[2] = p[2];
+    } else {
+        int pixel = (p[1] << 8) | p[0];
+        rgb[0] = (pixel >> 11) << 3;
+        rgb[1] = ((pixel >> 5) & 0x3f) << 2;
+        rgb[2] = (pixel & 0x1f) << 3;
+    }
+}
+
+static double getPsnr(const std::vector<etc1_byte>& a,
+        const std::vector<etc1_byte>& b, etc1_uint32 pixelSize) {
+    double error = 0;
+    for (size_t i = 0; i < a.size(); i += pixelSize) {
+        int rgbA[3], rgbB[3];
+        getComponents(&a[i], pixelSize, rgbA);
+        getComponents(&b[i], pixelSize, rgbB);
+        for (int c = 0; c < 3; c++) {
+            double d = rgbA[c] - rgbB[c];
+            error += d * d;
+        }
+    }
+    error /= a.size() / pixelSize * 3;
+    return error > 0 ? 10 * log10(255.0 * 255.0 / error) : INFINITY;
+}
+
+int main(int argc, char** argv) {
+    etc1_uint32 size = 1024;
+    int iterations = 10;
+    int opt;
+    while ((opt = getopt(argc, argv, "s:i:")) != -1) {
+        switch (opt) {
+            case 's':
+                size = atoi(optarg);
+                break;
+            case 'i':
+                iterations = atoi(optarg);
+                break;
+            default:
+                break;
+        }
+    }
+    if (size == 0 || iterations <= 0) {
+        fprintf(stderr, "usage: %s [-s size] [-i iterations]\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const double pixels = double(size) * size;
+    for (etc1_uint32 pixelSize = 2; pixelSize <= 3; pixelSize++) {
+        std::vector<etc1_byte> image;
+        fillImage(&image, size, pixelSize);
+        std::vector<etc1_byte> encoded(etc1_get_encoded_data_size(size, size));
+        std::vector<etc1_byte> decoded(image.size());
+
+        nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < iterations; i++) {
+            etc1_encode_image(&image[0], size, size, pixelSize, size * pixelSize,
+                    &encoded[0]);
+        }
+        const nsecs_t encodeTime = (systemTime(SYSTEM_TIME_MONOTONIC) - start) / iterations;
+
+        start = systemTime(SYSTEM_TIME_MONOTONIC);
+        for (int i = 0; i < iterations; i++) {
+            etc1_decode_image(&encoded[0], &decoded[0], size, size, pixelSize,
+                    size * pixelSize);
+        }
+        const nsecs_t decodeTime = (systemTime(SYSTEM_TIME_MONOTONIC) - start) / iterations;
+
+        printf("%ux%u %s: encode %8.3fms (%7.2f Mpixels/s), "
+                "decode %8.3fms (%7.2f Mpixels/s), PSNR %.2fdB\n",
+                size, size, pixelSize == 2 ? "565" : "RGB",
+                encodeTime / 1e6, pixels * 1e3 / encodeTime,
+                decodeTime / 1e6, pixels * 1e3 / decodeTime,
+                getPsnr(image, decoded, pixelSize));
+    }
+    return EXIT_SUCCESS;
+}
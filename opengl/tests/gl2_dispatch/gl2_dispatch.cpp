@@ -0,0 +1,148 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * The cost of calling through libGLESv2's entry points, which load the
+ * current context's hooks from the TLS slot and jump to the driver, on
+ * calls the driver handles without doing much: state queries, and uniform
+ * updates with no program in use, which the driver rejects with
+ * GL_INVALID_OPERATION before looking at the location.
+ *
+ * The cost of an indirect call to an empty function is the floor the GL
+ * calls are compared to; the difference covers the wrapper and the
+ * driver's own dispatch to its context.
+ *
+ * usage: test-opengl-gl2_dispatch [-i iterations]
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2.h>
+
+#include <utils/Timers.h>
+
+using namespace android;
+
+#if defined(__arm__)
+static const char* const ABI = "arm";
+#elif defined(__aarch64__)
+static const char* const ABI = "arm64";
+#elif defined(__i386__)
+static const char* const ABI = "x86";
+#elif defined(__x86_64__)
+static const char* const ABI = "x86_64";
+#elif defined(__mips64)
+static const char* const ABI = "mips64";
+#elif defined(__mips__)
+static const char* const ABI = "mips";
+#else
+static const char* const ABI = "unknown";
+#endif
+
+// Called through a pointer the compiler can't see through
+static __attribute__((noinline)) void emptyFunction() {
+}
+static void (* volatile sEmptyFunction)() = emptyFunction;
+
+static volatile GLenum sSink;
+
+static void printResult(const char* name, nsecs_t elapsed, size_t iterations) {
+    printf("%-24s %8.2fns/call\n", name, elapsed / double(iterations));
+    fflush(stdout);
+}
+
+#define BENCH(_name, _call)                                         \
+    do {                                                            \
+        const nsecs_t start = systemTime();                         \
+        for (size_t i = 0; i < iterations; i++) {                   \
+            _call;                                                  \
+        }                                                           \
+        printResult(_name, systemTime() - start, iterations);       \
+    } while (0)
+
+int main(int argc, char** argv)
+{
+    size_t iterations = 10000000;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:")) != -1) {
+        switch (opt) {
+            case 'i':
+                iterations = strtoul(optarg, NULL, 0);
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-i iterations]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    const EGLint configAttribs[] = {
+        EGL_SURFACE_TYPE, EGL_PBUFFER_BIT,
+        EGL_RENDERABLE_TYPE, EGL_OPENGL_ES2_BIT,
+        EGL_NONE
+    };
+    const EGLint surfaceAttribs[] = {
+        EGL_WIDTH, 16,
+        EGL_HEIGHT, 16,
+        EGL_NONE
+    };
+    const EGLint contextAttribs[] = {
+        EGL_CONTEXT_CLIENT_VERSION, 2,
+        EGL_NONE
+    };
+
+    EGLDisplay dpy = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    EGLint numConfigs;
+    EGLConfig config;
+    if (!eglInitialize(dpy, NULL, NULL) ||
+            !eglChooseConfig(dpy, configAttribs, &config, 1, &numConfigs) ||
+            numConfigs < 1) {
+        fprintf(stderr, "couldn't find a pbuffer EGLConfig\n");
+        return EXIT_FAILURE;
+    }
+    EGLSurface surface = eglCreatePbufferSurface(dpy, config, surfaceAttribs);
+    EGLContext context = eglCreateContext(dpy, config, EGL_NO_CONTEXT,
+            contextAttribs);
+    if (surface == EGL_NO_SURFACE || context == EGL_NO_CONTEXT ||
+            !eglMakeCurrent(dpy, surface, surface, context)) {
+        fprintf(stderr, "couldn't make a GLES 2 context current\n");
+        return EXIT_FAILURE;
+    }
+
+    printf("gl2_dispatch: %s, %s, %zu iterations\n", ABI,
+            glGetString(GL_RENDERER), iterations);
+    BENCH("indirect call", sEmptyFunction());
+    BENCH("glGetError", sSink = glGetError());
+    BENCH("glIsEnabled", sSink = glIsEnabled(GL_BLEND));
+    BENCH("glUniform1f", glUniform1f(-1, 0.0f));
+    BENCH("glUniform4f", glUniform4f(-1, 0.0f, 0.0f, 0.0f, 0.0f));
+    // Otherwise the uniform numbers didn't measure the error path
+    GLenum error = glGetError();
+    if (error != GL_INVALID_OPERATION) {
+        fprintf(stderr, "glUniform with no program: expected GL_INVALID_OPERATION, got %#x\n",
+                error);
+        return EXIT_FAILURE;
+    }
+
+    eglMakeCurrent(dpy, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+    eglDestroyContext(dpy, context);
+    eglDestroySurface(dpy, surface);
+    eglTerminate(dpy);
+    return EXIT_SUCCESS;
+}
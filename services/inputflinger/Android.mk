@@ -16,13 +16,16 @@ LOCAL_PATH:= $(call my-dir)
 include $(CLEAR_VARS)
 
 LOCAL_SRC_FILES:= \
+    EntryPool.cpp \
     EventHub.cpp \
     InputApplication.cpp \
     InputDispatcher.cpp \
+    InputLatencyTracker.cpp \
     InputListener.cpp \
     InputManager.cpp \
     InputReader.cpp \
-    InputWindow.cpp
+    InputWindow.cpp \
+    InputWindowIndex.cpp
 
 LOCAL_SHARED_LIBRARIES := \
     libbinder \
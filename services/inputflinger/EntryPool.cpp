@@ -0,0 +1,79 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "EntryPool"
+
+#include "EntryPool.h"
+
+#include <new>
+
+namespace android {
+
+EntryPool::EntryPool(const char* name, size_t entrySize, size_t maxFree) :
+        mName(name), mEntrySize(entrySize), mMaxFree(maxFree),
+        mFreeList(NULL), mNumFree(0), mNumInUse(0), mPeakInUse(0),
+        mNumAllocations(0), mNumHeapAllocations(0) {
+}
+
+void* EntryPool::allocate(size_t size) {
+    if (size == mEntrySize) {
+        AutoMutex _l(mLock);
+        mNumAllocations += 1;
+        mNumInUse += 1;
+        if (mNumInUse > mPeakInUse) {
+            mPeakInUse = mNumInUse;
+        }
+        if (mFreeList) {
+            FreeBlock* block = mFreeList;
+            mFreeList = block->next;
+            mNumFree -= 1;
+            return block;
+        }
+        mNumHeapAllocations += 1;
+    }
+    // the block is big enough for a FreeBlock, since entries have a vtable
+    // or links
+    return ::operator new(size);
+}
+
+void EntryPool::free(void* block, size_t size) {
+    if (block == NULL) {
+        return;
+    }
+    if (size == mEntrySize) {
+        AutoMutex _l(mLock);
+        mNumInUse -= 1;
+        if (mNumFree < mMaxFree) {
+            FreeBlock* freeBlock = static_cast<FreeBlock*>(block);
+            freeBlock->next = mFreeList;
+            mFreeList = freeBlock;
+            mNumFree += 1;
+            return;
+        }
+    }
+    ::operator delete(block);
+}
+
+void EntryPool::dump(String8& dump) const {
+    AutoMutex _l(mLock);
+    dump.appendFormat("%s: entrySize=%zu, inUse=%zu, peakInUse=%zu, free=%zu/%zu, "
+            "allocations=%llu, heapAllocations=%llu\n",
+            mName, mEntrySize, mNumInUse, mPeakInUse, mNumFree, mMaxFree,
+            (unsigned long long) mNumAllocations,
+            (unsigned long long) mNumHeapAllocations);
+}
+
+} // namespace android
@@ -0,0 +1,73 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UI_INPUT_ENTRY_POOL_H
+#define _UI_INPUT_ENTRY_POOL_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/String8.h>
+#include <utils/threads.h>
+
+namespace android {
+
+/*
+ * A pool of fixed size blocks for the dispatcher's queue entries, which are
+ * allocated and released for every event on the dispatch path.
+ *
+ * Released blocks are kept on a free list, up to maxFree of them, and handed
+ * out again by the next allocations, so that in the steady state dispatching
+ * an event doesn't go through the heap. Entry types use it by defining their
+ * operator new and delete in terms of allocate() and free().
+ *
+ * Entries are allocated both with and without the dispatcher lock held, so
+ * the pool has a lock of its own.
+ */
+class EntryPool {
+public:
+    EntryPool(const char* name, size_t entrySize, size_t maxFree);
+
+    // Returns a block of size bytes; sizes other than the entry size, which
+    // subclasses of the entry type may ask for, come from the heap
+    void* allocate(size_t size);
+    void free(void* block, size_t size);
+
+    // Appends a line of pool statistics
+    void dump(String8& dump) const;
+
+private:
+    struct FreeBlock {
+        FreeBlock* next;
+    };
+
+    mutable Mutex mLock;
+
+    const char* const mName;
+    const size_t mEntrySize;
+    const size_t mMaxFree;
+
+    FreeBlock* mFreeList;
+    size_t mNumFree;
+    size_t mNumInUse;
+    size_t mPeakInUse;
+    uint64_t mNumAllocations;
+    uint64_t mNumHeapAllocations;
+};
+
+} // namespace android
+
+#endif // _UI_INPUT_ENTRY_POOL_H
@@ -814,18 +814,24 @@ size_t EventHub::getEvents(int timeoutMillis, RawEvent* buffer, size_t bufferSiz
 
             Device* device = mDevices.valueAt(deviceIndex);
             if (eventItem.events & EPOLLIN) {
+                // Devices are only opened and closed on this thread, so the device stays
+                // valid while the lock is released for the read, which lets the other
+                // threads query devices meanwhile.
+                mLock.unlock();
                 int32_t readSize = read(device->fd, readBuffer,
                         sizeof(struct input_event) * capacity);
-                if (readSize == 0 || (readSize < 0 && errno == ENODEV)) {
+                int readErrno = errno;
+                mLock.lock();
+                if (readSize == 0 || (readSize < 0 && readErrno == ENODEV)) {
                     // Device was removed before INotify noticed.
                     ALOGW("could not get event, removed? (fd: %d size: %" PRId32
                             " bufferSize: %zu capacity: %zu errno: %d)\n",
-                            device->fd, readSize, bufferSize, capacity, errno);
+                            device->fd, readSize, bufferSize, capacity, readErrno);
                     deviceChanged = true;
                     closeDeviceLocked(device);
                 } else if (readSize < 0) {
-                    if (errno != EAGAIN && errno != EINTR) {
-                        ALOGW("could not get event (errno=%d)", errno);
+                    if (readErrno != EAGAIN && readErrno != EINTR) {
+                        ALOGW("could not get event (errno=%d)", readErrno);
                     }
                 } else if ((readSize % sizeof(struct input_event)) != 0) {
                     ALOGE("could not get event (wrong size: %d)", readSize);
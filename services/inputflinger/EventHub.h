@@ -447,8 +447,9 @@ private:
     // Epoll FD list size hint.
     static const int EPOLL_SIZE_HINT = 8;
 
-    // Maximum number of signalled FDs to handle at a time.
-    static const int EPOLL_MAX_EVENTS = 16;
+    // Maximum number of signalled FDs to handle at a time.  Enough for every device of
+    // devices with many evdev nodes to be handled after a single epoll_wait().
+    static const int EPOLL_MAX_EVENTS = 64;
 
     // The array of pending epoll events and the index of the next event to be handled.
     struct epoll_event mPendingEventItems[EPOLL_MAX_EVENTS];
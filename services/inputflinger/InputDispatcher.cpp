@@ -208,7 +208,7 @@ static void dumpRegion(String8& dump, const Region& region) {
 
 InputDispatcher::InputDispatcher(const sp<InputDispatcherPolicyInterface>& policy) :
     mPolicy(policy),
-    mPendingEvent(NULL), mLastDropReason(DROP_REASON_NOT_DROPPED),
+    mPendingEvent(NULL), mInboundQueueIdle(true), mLastDropReason(DROP_REASON_NOT_DROPPED),
     mAppSwitchSawKeyDown(false), mAppSwitchDueTime(LONG_LONG_MAX),
     mNextUnblockedEvent(NULL),
     mDispatchEnabled(false), mDispatchFrozen(false), mInputFilterEnabled(false),
@@ -254,6 +254,8 @@ void InputDispatcher::dispatchOnce() {
         AutoMutex _l(mLock);
         mDispatcherIsAliveCondition.broadcast();
 
+        takeHandoffEventsLocked();
+
         // Run a dispatch loop if there are no pending commands.
         // The dispatch loop might enqueue commands to run afterwards.
         if (!haveCommandsLocked()) {
@@ -265,6 +267,16 @@ void InputDispatcher::dispatchOnce() {
         if (runCommandsLockedInterruptible()) {
             nextWakeupTime = LONG_LONG_MIN;
         }
+
+        // Tell the reader whether its next events should wake us up, and don't wait
+        // if some came in while we were busy.
+        { // acquire handoff lock
+            AutoMutex _h(mHandoffLock);
+            mInboundQueueIdle = mInboundQueue.isEmpty();
+            if (mInboundQueueIdle && !mHandoffQueue.isEmpty()) {
+                nextWakeupTime = LONG_LONG_MIN;
+            }
+        } // release handoff lock
     } // release lock
 
     // Wait for callback or timeout or wake.  (make sure we round up, not down)
@@ -329,7 +341,15 @@ void InputDispatcher::dispatchOnceInnerLocked(nsecs_t* nextWakeupTime) {
             // Inbound queue has at least one entry.
             mPendingEvent = mInboundQueue.dequeueAtHead();
             traceInboundQueueLengthLocked();
+
+            if (!mPendingEvent->isInjected()) {
+                traceEventLatencyLocked(mPendingEvent, InputLatencyTracker::STAGE_READ,
+                        mPendingEvent->enqueueTime - mPendingEvent->eventTime);
+            }
+            traceEventLatencyLocked(mPendingEvent, InputLatencyTracker::STAGE_INBOUND,
+                    currentTime - mPendingEvent->enqueueTime);
         }
+        mPendingEvent->dispatchTime = currentTime;
 
         // Poke user activity for this event.
         if (mPendingEvent->policyFlags & POLICY_FLAG_PASS_TO_USER) {
@@ -427,7 +447,16 @@ void InputDispatcher::dispatchOnceInnerLocked(nsecs_t* nextWakeupTime) {
 }
 
 bool InputDispatcher::enqueueInboundEventLocked(EventEntry* entry) {
+    if (entry->type == EventEntry::TYPE_MOTION && mConfig.coalesceHoverMoves
+            && coalesceInboundMotionLocked(static_cast<MotionEntry*>(entry))) {
+        return false; // the queue wasn't empty
+    }
+
     bool needWake = mInboundQueue.isEmpty();
+    if (!entry->enqueueTime) {
+        // Events from the reader were timestamped when they were handed off
+        entry->enqueueTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    }
     mInboundQueue.enqueueAtTail(entry);
     traceInboundQueueLengthLocked();
 
@@ -486,6 +515,90 @@ bool InputDispatcher::enqueueInboundEventLocked(EventEntry* entry) {
     return needWake;
 }
 
+bool InputDispatcher::coalesceInboundMotionLocked(MotionEntry* entry) {
+    if (entry->action != AMOTION_EVENT_ACTION_HOVER_MOVE
+            && !(entry->action == AMOTION_EVENT_ACTION_MOVE
+                    && entry->source == AINPUT_SOURCE_MOUSE)) {
+        return false;
+    }
+
+    EventEntry* lastEventEntry = mInboundQueue.tail;
+    if (!lastEventEntry || lastEventEntry->type != EventEntry::TYPE_MOTION
+            || lastEventEntry->injectionState || entry->injectionState
+            || lastEventEntry->policyFlags != entry->policyFlags) {
+        return false;
+    }
+    MotionEntry* lastEntry = static_cast<MotionEntry*>(lastEventEntry);
+    if (lastEntry->deviceId != entry->deviceId
+            || lastEntry->source != entry->source
+            || lastEntry->displayId != entry->displayId
+            || lastEntry->action != entry->action
+            || lastEntry->flags != entry->flags
+            || lastEntry->metaState != entry->metaState
+            || lastEntry->buttonState != entry->buttonState
+            || lastEntry->pointerCount != entry->pointerCount) {
+        return false;
+    }
+    for (uint32_t i = 0; i < entry->pointerCount; i++) {
+        if (lastEntry->pointerProperties[i] != entry->pointerProperties[i]) {
+            return false;
+        }
+    }
+
+    // The coordinates of moves are absolute, so the last ones are all that's left
+    // of the previous move.  It keeps its place, and its enqueue time.
+    lastEventEntry->eventTime = entry->eventTime;
+    lastEntry->eventTime = entry->eventTime;
+    for (uint32_t i = 0; i < entry->pointerCount; i++) {
+        lastEntry->pointerCoords[i].copyFrom(entry->pointerCoords[i]);
+    }
+    entry->release();
+    return true;
+}
+
+bool InputDispatcher::enqueueHandoffEventLocked(EventEntry* entry) {
+    bool needWake = (mHandoffQueue.isEmpty() && mInboundQueueIdle)
+            || canPreemptInboundEventsLocked(entry);
+    entry->enqueueTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    mHandoffQueue.enqueueAtTail(entry);
+    return needWake;
+}
+
+bool InputDispatcher::canPreemptInboundEventsLocked(EventEntry* entry) {
+    // The events for which enqueueInboundEventLocked may ask for a wake even though
+    // the inbound queue isn't empty: the release of an app switch key, and a touch
+    // which may be meant for another application than the one we are waiting for.
+    switch (entry->type) {
+    case EventEntry::TYPE_KEY: {
+        KeyEntry* keyEntry = static_cast<KeyEntry*>(entry);
+        return keyEntry->action == AKEY_EVENT_ACTION_UP
+                && isAppSwitchKeyEventLocked(keyEntry);
+    }
+    case EventEntry::TYPE_MOTION: {
+        MotionEntry* motionEntry = static_cast<MotionEntry*>(entry);
+        return motionEntry->action == AMOTION_EVENT_ACTION_DOWN
+                && (motionEntry->source & AINPUT_SOURCE_CLASS_POINTER);
+    }
+    default:
+        return false;
+    }
+}
+
+void InputDispatcher::takeHandoffEventsLocked() {
+    EventEntry* entry;
+    { // acquire handoff lock
+        AutoMutex _h(mHandoffLock);
+        entry = mHandoffQueue.detachAll();
+    } // release handoff lock
+
+    // The dispatcher is about to look at the inbound queue, so there's no one to wake
+    while (entry) {
+        EventEntry* nextEntry = entry->next;
+        enqueueInboundEventLocked(entry);
+        entry = nextEntry;
+    }
+}
+
 void InputDispatcher::addRecentEventLocked(EventEntry* entry) {
     entry->refCount += 1;
     mRecentQueue.enqueueAtTail(entry);
@@ -496,27 +609,12 @@ void InputDispatcher::addRecentEventLocked(EventEntry* entry) {
 
 sp<InputWindowHandle> InputDispatcher::findTouchedWindowAtLocked(int32_t displayId,
         int32_t x, int32_t y) {
-    // Traverse windows from front to back to find touched window.
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
-        const InputWindowInfo* windowInfo = windowHandle->getInfo();
-        if (windowInfo->displayId == displayId) {
-            int32_t flags = windowInfo->layoutParamsFlags;
-
-            if (windowInfo->visible) {
-                if (!(flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)) {
-                    bool isTouchModal = (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
-                            | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
-                    if (isTouchModal || windowInfo->touchableRegionContainsPoint(x, y)) {
-                        // Found window.
-                        return windowHandle;
-                    }
-                }
-            }
-        }
+    // Find the front most window that takes the touch.
+    ssize_t index = mWindowIndex.findTouchedWindowAt(displayId, x, y);
+    if (index < 0) {
+        return NULL;
     }
-    return NULL;
+    return mWindowHandles.itemAt(size_t(index));
 }
 
 void InputDispatcher::dropInboundEventLocked(EventEntry* entry, DropReason dropReason) {
@@ -634,6 +732,7 @@ InputDispatcher::CommandEntry* InputDispatcher::postCommandLocked(Command comman
 }
 
 void InputDispatcher::drainInboundQueueLocked() {
+    takeHandoffEventsLocked();
     while (! mInboundQueue.isEmpty()) {
         EventEntry* entry = mInboundQueue.dequeueAtHead();
         releaseInboundEventLocked(entry);
@@ -949,23 +1048,171 @@ void InputDispatcher::dispatchEventLocked(nsecs_t currentTime,
 
     pokeUserActivityLocked(eventEntry);
 
+    // Publish to the foreground targets first, so that the windows the user interacts
+    // with don't wait for the outside, wallpaper and monitor targets to be published.
+    // Each connection still gets its events in order since they have their own queues.
+    for (size_t i = 0; i < inputTargets.size(); i++) {
+        const InputTarget& inputTarget = inputTargets.itemAt(i);
+        if (inputTarget.flags & InputTarget::FLAG_FOREGROUND) {
+            dispatchEventToTargetLocked(currentTime, eventEntry, inputTarget);
+        }
+    }
+    bool hasMonitors = false;
+    for (size_t i = 0; i < inputTargets.size(); i++) {
+        const InputTarget& inputTarget = inputTargets.itemAt(i);
+        if (inputTarget.flags & InputTarget::FLAG_MONITOR) {
+            hasMonitors = true;
+        } else if (!(inputTarget.flags & InputTarget::FLAG_FOREGROUND)) {
+            dispatchEventToTargetLocked(currentTime, eventEntry, inputTarget);
+        }
+    }
+    if (hasMonitors) {
+        broadcastEventToMonitorsLocked(currentTime, eventEntry, inputTargets);
+    }
+
+    // Targets with the same pointers, such as the windows a touch slips out of and
+    // into, shared their split; the dispatch entries hold their own references to it.
+    releaseSplitMotionEntriesLocked();
+}
+
+void InputDispatcher::broadcastEventToMonitorsLocked(nsecs_t currentTime,
+        EventEntry* eventEntry, const Vector<InputTarget>& inputTargets) {
+    // Monitors get the event as is, so the message is the same for all of them and can
+    // be built once.  Each monitor is finished with the same sequence number, which is
+    // fine since they are only looked up per connection.  A monitor that is behind gets
+    // a dispatch entry as usual, to keep its events in order.
+    InputMessage msg;
+    status_t status = buildBroadcastMessage(eventEntry, &msg);
+
     for (size_t i = 0; i < inputTargets.size(); i++) {
         const InputTarget& inputTarget = inputTargets.itemAt(i);
+        if (!(inputTarget.flags & InputTarget::FLAG_MONITOR)) {
+            continue;
+        }
 
         ssize_t connectionIndex = getConnectionIndexLocked(inputTarget.inputChannel);
-        if (connectionIndex >= 0) {
-            sp<Connection> connection = mConnectionsByFd.valueAt(connectionIndex);
+        if (connectionIndex < 0 || status) {
+            dispatchEventToTargetLocked(currentTime, eventEntry, inputTarget);
+            continue;
+        }
+        sp<Connection> connection = mConnectionsByFd.valueAt(connectionIndex);
+        if (!canBroadcastToConnection(connection, eventEntry)) {
             prepareDispatchCycleLocked(currentTime, connection, eventEntry, &inputTarget);
+            continue;
+        }
+
+        // Update the connection's input state, as enqueueDispatchEntryLocked would.
+        int32_t action, flags;
+        bool consistent;
+        if (eventEntry->type == EventEntry::TYPE_KEY) {
+            KeyEntry* keyEntry = static_cast<KeyEntry*>(eventEntry);
+            action = keyEntry->action;
+            flags = keyEntry->flags;
+            consistent = connection->inputState.trackKey(keyEntry, action, flags);
         } else {
-#if DEBUG_FOCUS
-            ALOGD("Dropping event delivery to target with channel '%s' because it "
-                    "is no longer registered with the input dispatcher.",
-                    inputTarget.inputChannel->getName().string());
+            MotionEntry* motionEntry = static_cast<MotionEntry*>(eventEntry);
+            action = motionEntry->action;
+            flags = motionEntry->flags;
+            consistent = connection->inputState.trackMotion(motionEntry, action, flags);
+        }
+        if (!consistent) {
+#if DEBUG_DISPATCH_CYCLE
+            ALOGD("channel '%s' ~ broadcastEventToMonitorsLocked: skipping inconsistent event",
+                    connection->getInputChannelName());
 #endif
+            continue;
+        }
+
+        status_t publishStatus = connection->inputPublisher.publishMessage(&msg);
+        if (!publishStatus) {
+            connection->broadcastsInFlight += 1;
+        } else if (publishStatus == WOULD_BLOCK) {
+            // Queue the event and let the dispatch cycle work out whether the
+            // application is just slow or the channel is broken.
+            DispatchEntry* dispatchEntry = new DispatchEntry(eventEntry, // increments ref
+                    inputTarget.flags, inputTarget.xOffset, inputTarget.yOffset,
+                    inputTarget.scaleFactor);
+            dispatchEntry->resolvedAction = action;
+            dispatchEntry->resolvedFlags = flags;
+            connection->outboundQueue.enqueueAtTail(dispatchEntry);
+            traceOutboundQueueLengthLocked(connection);
+            startDispatchCycleLocked(currentTime, connection);
+        } else {
+            ALOGE("channel '%s' ~ Could not publish event due to an unexpected error, "
+                    "status=%d", connection->getInputChannelName(), publishStatus);
+            abortBrokenDispatchCycleLocked(currentTime, connection, true /*notify*/);
         }
     }
 }
 
+bool InputDispatcher::canBroadcastToConnection(const sp<Connection>& connection,
+        const EventEntry* eventEntry) {
+    if (connection->status != Connection::STATUS_NORMAL
+            || connection->inputPublisherBlocked
+            || !connection->outboundQueue.isEmpty()) {
+        return false;
+    }
+
+    // A hover move the monitor has no hover enter for is sent as one, with a message
+    // of its own.
+    if (eventEntry->type == EventEntry::TYPE_MOTION) {
+        const MotionEntry* motionEntry = static_cast<const MotionEntry*>(eventEntry);
+        if (motionEntry->action == AMOTION_EVENT_ACTION_HOVER_MOVE
+                && !connection->inputState.isHovering(
+                        motionEntry->deviceId, motionEntry->source, motionEntry->displayId)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+status_t InputDispatcher::buildBroadcastMessage(const EventEntry* eventEntry,
+        InputMessage* msg) {
+    uint32_t seq = DispatchEntry::nextSeq();
+    switch (eventEntry->type) {
+    case EventEntry::TYPE_KEY: {
+        const KeyEntry* keyEntry = static_cast<const KeyEntry*>(eventEntry);
+        return InputPublisher::buildKeyMessage(msg, seq,
+                keyEntry->deviceId, keyEntry->source,
+                keyEntry->action, keyEntry->flags,
+                keyEntry->keyCode, keyEntry->scanCode,
+                keyEntry->metaState, keyEntry->repeatCount, keyEntry->downTime,
+                keyEntry->eventTime);
+    }
+
+    case EventEntry::TYPE_MOTION: {
+        // Monitors have no offset and no scaling.
+        const MotionEntry* motionEntry = static_cast<const MotionEntry*>(eventEntry);
+        return InputPublisher::buildMotionMessage(msg, 1, &seq, &motionEntry->eventTime,
+                motionEntry->deviceId, motionEntry->source,
+                motionEntry->action, motionEntry->actionButton,
+                motionEntry->flags, motionEntry->edgeFlags,
+                motionEntry->metaState, motionEntry->buttonState,
+                0.0f, 0.0f, motionEntry->xPrecision, motionEntry->yPrecision,
+                motionEntry->downTime, motionEntry->pointerCount,
+                motionEntry->pointerProperties, motionEntry->pointerCoords);
+    }
+
+    default:
+        return BAD_VALUE;
+    }
+}
+
+void InputDispatcher::dispatchEventToTargetLocked(nsecs_t currentTime,
+        EventEntry* eventEntry, const InputTarget& inputTarget) {
+    ssize_t connectionIndex = getConnectionIndexLocked(inputTarget.inputChannel);
+    if (connectionIndex >= 0) {
+        sp<Connection> connection = mConnectionsByFd.valueAt(connectionIndex);
+        prepareDispatchCycleLocked(currentTime, connection, eventEntry, &inputTarget);
+    } else {
+#if DEBUG_FOCUS
+        ALOGD("Dropping event delivery to target with channel '%s' because it "
+                "is no longer registered with the input dispatcher.",
+                inputTarget.inputChannel->getName().string());
+#endif
+    }
+}
+
 int32_t InputDispatcher::handleTargetsNotReadyLocked(nsecs_t currentTime,
         const EventEntry* entry,
         const sp<InputApplicationHandle>& applicationHandle,
@@ -1219,40 +1466,27 @@ int32_t InputDispatcher::findTouchedWindowTargetsLocked(nsecs_t currentTime,
         int32_t y = int32_t(entry->pointerCoords[pointerIndex].
                 getAxisValue(AMOTION_EVENT_AXIS_Y));
         sp<InputWindowHandle> newTouchedWindowHandle;
-        bool isTouchModal = false;
-
-        // Traverse windows from front to back to find touched window and outside targets.
-        size_t numWindows = mWindowHandles.size();
-        for (size_t i = 0; i < numWindows; i++) {
-            sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(i);
-            const InputWindowInfo* windowInfo = windowHandle->getInfo();
-            if (windowInfo->displayId != displayId) {
-                continue; // wrong display
-            }
 
-            int32_t flags = windowInfo->layoutParamsFlags;
-            if (windowInfo->visible) {
-                if (! (flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)) {
-                    isTouchModal = (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
-                            | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
-                    if (isTouchModal || windowInfo->touchableRegionContainsPoint(x, y)) {
-                        newTouchedWindowHandle = windowHandle;
-                        break; // found touched window, exit window loop
-                    }
+        // Find the touched window, and the outside targets in front of it.
+        ssize_t touchedIndex = mWindowIndex.findTouchedWindowAt(displayId, x, y);
+        size_t numWindowsInFront = mWindowHandles.size();
+        if (touchedIndex >= 0) {
+            newTouchedWindowHandle = mWindowHandles.itemAt(size_t(touchedIndex));
+            numWindowsInFront = size_t(touchedIndex);
+        }
+        if (maskedAction == AMOTION_EVENT_ACTION_DOWN) {
+            const Vector<size_t>& watchers(mWindowIndex.getOutsideTouchWatchers(displayId));
+            for (size_t i = 0; i < watchers.size() && watchers[i] < numWindowsInFront; i++) {
+                sp<InputWindowHandle> windowHandle = mWindowHandles.itemAt(watchers[i]);
+                int32_t outsideTargetFlags = InputTarget::FLAG_DISPATCH_AS_OUTSIDE;
+                if (isWindowObscuredAtPointLocked(windowHandle, x, y)) {
+                    outsideTargetFlags |= InputTarget::FLAG_WINDOW_IS_OBSCURED;
+                } else if (isWindowObscuredLocked(windowHandle)) {
+                    outsideTargetFlags |= InputTarget::FLAG_WINDOW_IS_PARTIALLY_OBSCURED;
                 }
 
-                if (maskedAction == AMOTION_EVENT_ACTION_DOWN
-                        && (flags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH)) {
-                    int32_t outsideTargetFlags = InputTarget::FLAG_DISPATCH_AS_OUTSIDE;
-                    if (isWindowObscuredAtPointLocked(windowHandle, x, y)) {
-                        outsideTargetFlags |= InputTarget::FLAG_WINDOW_IS_OBSCURED;
-                    } else if (isWindowObscuredLocked(windowHandle)) {
-                        outsideTargetFlags |= InputTarget::FLAG_WINDOW_IS_PARTIALLY_OBSCURED;
-                    }
-
-                    mTempTouchState.addOrUpdateWindow(
-                            windowHandle, outsideTargetFlags, BitSet32(0));
-                }
+                mTempTouchState.addOrUpdateWindow(
+                        windowHandle, outsideTargetFlags, BitSet32(0));
             }
         }
 
@@ -1608,7 +1842,7 @@ void InputDispatcher::addMonitoringTargetsLocked(Vector<InputTarget>& inputTarge
 
         InputTarget& target = inputTargets.editTop();
         target.inputChannel = mMonitoringChannels[i];
-        target.flags = InputTarget::FLAG_DISPATCH_AS_IS;
+        target.flags = InputTarget::FLAG_DISPATCH_AS_IS | InputTarget::FLAG_MONITOR;
         target.xOffset = 0;
         target.yOffset = 0;
         target.pointerIds.clear();
@@ -1639,43 +1873,20 @@ bool InputDispatcher::checkInjectionPermission(const sp<InputWindowHandle>& wind
 
 bool InputDispatcher::isWindowObscuredAtPointLocked(
         const sp<InputWindowHandle>& windowHandle, int32_t x, int32_t y) const {
-    int32_t displayId = windowHandle->getInfo()->displayId;
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> otherHandle = mWindowHandles.itemAt(i);
-        if (otherHandle == windowHandle) {
-            break;
-        }
-
-        const InputWindowInfo* otherInfo = otherHandle->getInfo();
-        if (otherInfo->displayId == displayId
-                && otherInfo->visible && !otherInfo->isTrustedOverlay()
-                && otherInfo->frameContainsPoint(x, y)) {
-            return true;
-        }
-    }
-    return false;
+    // Windows that aren't in the list are behind all the others
+    ssize_t index = mWindowIndex.indexOf(windowHandle);
+    size_t numWindowsInFront = index >= 0 ? size_t(index) : mWindowHandles.size();
+    return mWindowIndex.isObscuredAtPoint(windowHandle->getInfo()->displayId,
+            numWindowsInFront, x, y);
 }
 
 
 bool InputDispatcher::isWindowObscuredLocked(const sp<InputWindowHandle>& windowHandle) const {
-    int32_t displayId = windowHandle->getInfo()->displayId;
     const InputWindowInfo* windowInfo = windowHandle->getInfo();
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        sp<InputWindowHandle> otherHandle = mWindowHandles.itemAt(i);
-        if (otherHandle == windowHandle) {
-            break;
-        }
-
-        const InputWindowInfo* otherInfo = otherHandle->getInfo();
-        if (otherInfo->displayId == displayId
-                && otherInfo->visible && !otherInfo->isTrustedOverlay()
-                && otherInfo->overlaps(windowInfo)) {
-            return true;
-        }
-    }
-    return false;
+    ssize_t index = mWindowIndex.indexOf(windowHandle);
+    size_t numWindowsInFront = index >= 0 ? size_t(index) : mWindowHandles.size();
+    return mWindowIndex.isObscured(windowInfo->displayId, numWindowsInFront,
+            windowInfo);
 }
 
 String8 InputDispatcher::checkWindowReadyForMoreInputLocked(nsecs_t currentTime,
@@ -1844,7 +2055,7 @@ void InputDispatcher::prepareDispatchCycleLocked(nsecs_t currentTime,
 
         MotionEntry* originalMotionEntry = static_cast<MotionEntry*>(eventEntry);
         if (inputTarget->pointerIds.count() != originalMotionEntry->pointerCount) {
-            MotionEntry* splitMotionEntry = splitMotionEvent(
+            MotionEntry* splitMotionEntry = getSplitMotionEntryLocked(
                     originalMotionEntry, inputTarget->pointerIds);
             if (!splitMotionEntry) {
                 return; // split event was dropped
@@ -1856,7 +2067,6 @@ void InputDispatcher::prepareDispatchCycleLocked(nsecs_t currentTime,
 #endif
             enqueueDispatchEntriesLocked(currentTime, connection,
                     splitMotionEntry, inputTarget);
-            splitMotionEntry->release();
             return;
         }
     }
@@ -1989,7 +2199,7 @@ void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
     while (connection->status == Connection::STATUS_NORMAL
             && !connection->outboundQueue.isEmpty()) {
         DispatchEntry* dispatchEntry = connection->outboundQueue.head;
-        dispatchEntry->deliveryTime = currentTime;
+        DispatchEntry* lastDispatchEntry = dispatchEntry;
 
         // Publish the event.
         status_t status;
@@ -2040,6 +2250,15 @@ void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
                     usingCoords = scaledCoords;
                 }
             }
+
+            // Moves queued behind this one, when the connection fell behind, are sent
+            // along with it in a single message.
+            if (canBatchMotionSamples(dispatchEntry, dispatchEntry->next)) {
+                status = publishMotionSamplesLocked(connection, dispatchEntry,
+                        xOffset, yOffset, scaleFactor, &lastDispatchEntry);
+                break;
+            }
+
             // Publish the motion event.
             status = connection->inputPublisher.publishMotionEvent(dispatchEntry->seq,
                     motionEntry->deviceId, motionEntry->source,
@@ -2061,7 +2280,7 @@ void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
         // Check the result.
         if (status) {
             if (status == WOULD_BLOCK) {
-                if (connection->waitQueue.isEmpty()) {
+                if (connection->waitQueue.isEmpty() && !connection->broadcastsInFlight) {
                     ALOGE("channel '%s' ~ Could not publish event because the pipe is full. "
                             "This is unexpected because the wait queue is empty, so the pipe "
                             "should be empty and we shouldn't have any problems writing an "
@@ -2085,14 +2304,107 @@ void InputDispatcher::startDispatchCycleLocked(nsecs_t currentTime,
             return;
         }
 
-        // Re-enqueue the event on the wait queue.
-        connection->outboundQueue.dequeue(dispatchEntry);
+        // Re-enqueue the events on the wait queue.
+        for (;;) {
+            DispatchEntry* publishedEntry = connection->outboundQueue.dequeueAtHead();
+            publishedEntry->deliveryTime = currentTime;
+            connection->waitQueue.enqueueAtTail(publishedEntry);
+            if (publishedEntry == lastDispatchEntry) {
+                break;
+            }
+        }
         traceOutboundQueueLengthLocked(connection);
-        connection->waitQueue.enqueueAtTail(dispatchEntry);
         traceWaitQueueLengthLocked(connection);
     }
 }
 
+bool InputDispatcher::canBatchMotionSamples(const DispatchEntry* first,
+        const DispatchEntry* next) {
+    if (!next || next->eventEntry->type != EventEntry::TYPE_MOTION
+            || (first->resolvedAction != AMOTION_EVENT_ACTION_MOVE
+                    && first->resolvedAction != AMOTION_EVENT_ACTION_HOVER_MOVE)
+            || next->resolvedAction != first->resolvedAction
+            || next->resolvedFlags != first->resolvedFlags
+            || next->targetFlags != first->targetFlags
+            || next->xOffset != first->xOffset
+            || next->yOffset != first->yOffset
+            || next->scaleFactor != first->scaleFactor) {
+        return false;
+    }
+
+    const MotionEntry* firstEntry = static_cast<const MotionEntry*>(first->eventEntry);
+    const MotionEntry* nextEntry = static_cast<const MotionEntry*>(next->eventEntry);
+    if (nextEntry->deviceId != firstEntry->deviceId
+            || nextEntry->source != firstEntry->source
+            || nextEntry->actionButton != firstEntry->actionButton
+            || nextEntry->edgeFlags != firstEntry->edgeFlags
+            || nextEntry->metaState != firstEntry->metaState
+            || nextEntry->buttonState != firstEntry->buttonState
+            || nextEntry->xPrecision != firstEntry->xPrecision
+            || nextEntry->yPrecision != firstEntry->yPrecision
+            || nextEntry->downTime != firstEntry->downTime
+            || nextEntry->pointerCount != firstEntry->pointerCount) {
+        return false;
+    }
+    for (uint32_t i = 0; i < firstEntry->pointerCount; i++) {
+        if (nextEntry->pointerProperties[i] != firstEntry->pointerProperties[i]) {
+            return false;
+        }
+    }
+    return true;
+}
+
+status_t InputDispatcher::publishMotionSamplesLocked(const sp<Connection>& connection,
+        DispatchEntry* firstDispatchEntry, float xOffset, float yOffset, float scaleFactor,
+        DispatchEntry** outLastDispatchEntry) {
+    const MotionEntry* motionEntry = static_cast<const MotionEntry*>(
+            firstDispatchEntry->eventEntry);
+    const uint32_t pointerCount = motionEntry->pointerCount;
+    const size_t maxSampleCount = InputPublisher::getMaxSampleCount(pointerCount);
+    // We don't want the dispatch target to know.
+    const bool zeroCoords = firstDispatchEntry->targetFlags & InputTarget::FLAG_ZERO_COORDS;
+
+    // A message has room for at most MAX_POINTERS pointers.
+    uint32_t seqs[MAX_POINTERS];
+    nsecs_t eventTimes[MAX_POINTERS];
+    PointerCoords coords[MAX_POINTERS];
+    size_t sampleCount = 0;
+    DispatchEntry* dispatchEntry = firstDispatchEntry;
+    for (;;) {
+        const MotionEntry* sampleEntry = static_cast<const MotionEntry*>(
+                dispatchEntry->eventEntry);
+        seqs[sampleCount] = dispatchEntry->seq;
+        eventTimes[sampleCount] = sampleEntry->eventTime;
+        for (uint32_t i = 0; i < pointerCount; i++) {
+            PointerCoords& sampleCoords = coords[sampleCount * pointerCount + i];
+            if (zeroCoords) {
+                sampleCoords.clear();
+            } else {
+                sampleCoords.copyFrom(sampleEntry->pointerCoords[i]);
+                if (scaleFactor != 1.0f) {
+                    sampleCoords.scale(scaleFactor);
+                }
+            }
+        }
+        sampleCount += 1;
+
+        if (sampleCount == maxSampleCount
+                || !canBatchMotionSamples(firstDispatchEntry, dispatchEntry->next)) {
+            break;
+        }
+        dispatchEntry = dispatchEntry->next;
+    }
+
+    *outLastDispatchEntry = dispatchEntry;
+    return connection->inputPublisher.publishMotionSamples(sampleCount, seqs, eventTimes,
+            motionEntry->deviceId, motionEntry->source,
+            firstDispatchEntry->resolvedAction, motionEntry->actionButton,
+            firstDispatchEntry->resolvedFlags, motionEntry->edgeFlags,
+            motionEntry->metaState, motionEntry->buttonState,
+            xOffset, yOffset, motionEntry->xPrecision, motionEntry->yPrecision,
+            motionEntry->downTime, pointerCount, motionEntry->pointerProperties, coords);
+}
+
 void InputDispatcher::finishDispatchCycleLocked(nsecs_t currentTime,
         const sp<Connection>& connection, uint32_t seq, bool handled) {
 #if DEBUG_DISPATCH_CYCLE
@@ -2123,6 +2435,7 @@ void InputDispatcher::abortBrokenDispatchCycleLocked(nsecs_t currentTime,
     traceOutboundQueueLengthLocked(connection);
     drainDispatchQueueLocked(&connection->waitQueue);
     traceWaitQueueLengthLocked(connection);
+    connection->broadcastsInFlight = 0;
 
     // The connection appears to be unrecoverably broken.
     // Ignore already broken or zombie connections.
@@ -2300,22 +2613,16 @@ InputDispatcher::splitMotionEvent(const MotionEntry* originalMotionEntry, BitSet
     ALOG_ASSERT(pointerIds.value != 0);
 
     uint32_t splitPointerIndexMap[MAX_POINTERS];
-    PointerProperties splitPointerProperties[MAX_POINTERS];
-    PointerCoords splitPointerCoords[MAX_POINTERS];
 
     uint32_t originalPointerCount = originalMotionEntry->pointerCount;
     uint32_t splitPointerCount = 0;
 
     for (uint32_t originalPointerIndex = 0; originalPointerIndex < originalPointerCount;
             originalPointerIndex++) {
-        const PointerProperties& pointerProperties =
-                originalMotionEntry->pointerProperties[originalPointerIndex];
-        uint32_t pointerId = uint32_t(pointerProperties.id);
+        uint32_t pointerId = uint32_t(
+                originalMotionEntry->pointerProperties[originalPointerIndex].id);
         if (pointerIds.hasBit(pointerId)) {
             splitPointerIndexMap[splitPointerCount] = originalPointerIndex;
-            splitPointerProperties[splitPointerCount].copyFrom(pointerProperties);
-            splitPointerCoords[splitPointerCount].copyFrom(
-                    originalMotionEntry->pointerCoords[originalPointerIndex]);
             splitPointerCount += 1;
         }
     }
@@ -2349,7 +2656,7 @@ InputDispatcher::splitMotionEvent(const MotionEntry* originalMotionEntry, BitSet
             } else {
                 // A secondary pointer went down/up.
                 uint32_t splitPointerIndex = 0;
-                while (pointerId != uint32_t(splitPointerProperties[splitPointerIndex].id)) {
+                while (splitPointerIndexMap[splitPointerIndex] != uint32_t(originalPointerIndex)) {
                     splitPointerIndex += 1;
                 }
                 action = maskedAction | (splitPointerIndex
@@ -2361,6 +2668,8 @@ InputDispatcher::splitMotionEvent(const MotionEntry* originalMotionEntry, BitSet
         }
     }
 
+    // The pointers are copied straight from the original entry into the split one,
+    // rather than through temporary arrays.
     MotionEntry* splitMotionEntry = new MotionEntry(
             originalMotionEntry->eventTime,
             originalMotionEntry->deviceId,
@@ -2376,28 +2685,58 @@ InputDispatcher::splitMotionEvent(const MotionEntry* originalMotionEntry, BitSet
             originalMotionEntry->yPrecision,
             originalMotionEntry->downTime,
             originalMotionEntry->displayId,
-            splitPointerCount, splitPointerProperties, splitPointerCoords, 0, 0);
+            0, NULL, NULL, 0, 0);
+    for (uint32_t i = 0; i < splitPointerCount; i++) {
+        uint32_t originalPointerIndex = splitPointerIndexMap[i];
+        splitMotionEntry->pointerProperties[i].copyFrom(
+                originalMotionEntry->pointerProperties[originalPointerIndex]);
+        splitMotionEntry->pointerCoords[i].copyFrom(
+                originalMotionEntry->pointerCoords[originalPointerIndex]);
+    }
+    splitMotionEntry->pointerCount = splitPointerCount;
 
     if (originalMotionEntry->injectionState) {
         splitMotionEntry->injectionState = originalMotionEntry->injectionState;
         splitMotionEntry->injectionState->refCount += 1;
     }
+    splitMotionEntry->enqueueTime = originalMotionEntry->enqueueTime;
+    splitMotionEntry->dispatchTime = originalMotionEntry->dispatchTime;
 
     return splitMotionEntry;
 }
 
+InputDispatcher::MotionEntry* InputDispatcher::getSplitMotionEntryLocked(
+        const MotionEntry* originalMotionEntry, BitSet32 pointerIds) {
+    ssize_t index = mSplitMotionEntries.indexOfKey(pointerIds.value);
+    if (index >= 0) {
+        return mSplitMotionEntries.valueAt(index);
+    }
+    MotionEntry* splitMotionEntry = splitMotionEvent(originalMotionEntry, pointerIds);
+    if (splitMotionEntry) {
+        mSplitMotionEntries.add(pointerIds.value, splitMotionEntry);
+    }
+    return splitMotionEntry;
+}
+
+void InputDispatcher::releaseSplitMotionEntriesLocked() {
+    for (size_t i = 0; i < mSplitMotionEntries.size(); i++) {
+        mSplitMotionEntries.valueAt(i)->release();
+    }
+    mSplitMotionEntries.clear();
+}
+
 void InputDispatcher::notifyConfigurationChanged(const NotifyConfigurationChangedArgs* args) {
 #if DEBUG_INBOUND_EVENT_DETAILS
     ALOGD("notifyConfigurationChanged - eventTime=%lld", args->eventTime);
 #endif
 
     bool needWake;
-    { // acquire lock
-        AutoMutex _l(mLock);
+    { // acquire handoff lock
+        AutoMutex _h(mHandoffLock);
 
         ConfigurationChangedEntry* newEntry = new ConfigurationChangedEntry(args->eventTime);
-        needWake = enqueueInboundEventLocked(newEntry);
-    } // release lock
+        needWake = enqueueHandoffEventLocked(newEntry);
+    } // release handoff lock
 
     if (needWake) {
         mLooper->wake();
@@ -2466,18 +2805,18 @@ void InputDispatcher::notifyKey(const NotifyKeyArgs* args) {
     mPolicy->interceptKeyBeforeQueueing(&event, /*byref*/ policyFlags);
 
     bool needWake;
-    { // acquire lock
-        mLock.lock();
+    { // acquire handoff lock
+        mHandoffLock.lock();
 
         if (shouldSendKeyToInputFilterLocked(args)) {
-            mLock.unlock();
+            mHandoffLock.unlock();
 
             policyFlags |= POLICY_FLAG_FILTERED;
             if (!mPolicy->filterInputEvent(&event, policyFlags)) {
                 return; // event was consumed by the filter
             }
 
-            mLock.lock();
+            mHandoffLock.lock();
         }
 
         int32_t repeatCount = 0;
@@ -2486,9 +2825,9 @@ void InputDispatcher::notifyKey(const NotifyKeyArgs* args) {
                 args->action, flags, keyCode, args->scanCode,
                 metaState, repeatCount, args->downTime);
 
-        needWake = enqueueInboundEventLocked(newEntry);
-        mLock.unlock();
-    } // release lock
+        needWake = enqueueHandoffEventLocked(newEntry);
+        mHandoffLock.unlock();
+    } // release handoff lock
 
     if (needWake) {
         mLooper->wake();
@@ -2535,11 +2874,11 @@ void InputDispatcher::notifyMotion(const NotifyMotionArgs* args) {
     mPolicy->interceptMotionBeforeQueueing(args->eventTime, /*byref*/ policyFlags);
 
     bool needWake;
-    { // acquire lock
-        mLock.lock();
+    { // acquire handoff lock
+        mHandoffLock.lock();
 
         if (shouldSendMotionToInputFilterLocked(args)) {
-            mLock.unlock();
+            mHandoffLock.unlock();
 
             MotionEvent event;
             event.initialize(args->deviceId, args->source, args->action, args->actionButton,
@@ -2553,7 +2892,7 @@ void InputDispatcher::notifyMotion(const NotifyMotionArgs* args) {
                 return; // event was consumed by the filter
             }
 
-            mLock.lock();
+            mHandoffLock.lock();
         }
 
         // Just enqueue a new motion event.
@@ -2565,9 +2904,9 @@ void InputDispatcher::notifyMotion(const NotifyMotionArgs* args) {
                 args->displayId,
                 args->pointerCount, args->pointerProperties, args->pointerCoords, 0, 0);
 
-        needWake = enqueueInboundEventLocked(newEntry);
-        mLock.unlock();
-    } // release lock
+        needWake = enqueueHandoffEventLocked(newEntry);
+        mHandoffLock.unlock();
+    } // release handoff lock
 
     if (needWake) {
         mLooper->wake();
@@ -2599,12 +2938,12 @@ void InputDispatcher::notifyDeviceReset(const NotifyDeviceResetArgs* args) {
 #endif
 
     bool needWake;
-    { // acquire lock
-        AutoMutex _l(mLock);
+    { // acquire handoff lock
+        AutoMutex _h(mHandoffLock);
 
         DeviceResetEntry* newEntry = new DeviceResetEntry(args->eventTime, args->deviceId);
-        needWake = enqueueInboundEventLocked(newEntry);
-    } // release lock
+        needWake = enqueueHandoffEventLocked(newEntry);
+    } // release handoff lock
 
     if (needWake) {
         mLooper->wake();
@@ -2715,6 +3054,8 @@ int32_t InputDispatcher::injectInputEvent(const InputEvent* event, int32_t displ
     injectionState->refCount += 1;
     lastInjectedEntry->injectionState = injectionState;
 
+    // Keep the injected events behind those the reader already handed off
+    takeHandoffEventsLocked();
     bool needWake = false;
     for (EventEntry* entry = firstInjectedEntry; entry != NULL; ) {
         EventEntry* nextEntry = entry->next;
@@ -2856,15 +3197,22 @@ sp<InputWindowHandle> InputDispatcher::getWindowHandleLocked(
     return NULL;
 }
 
-bool InputDispatcher::hasWindowHandleLocked(
-        const sp<InputWindowHandle>& windowHandle) const {
-    size_t numWindows = mWindowHandles.size();
-    for (size_t i = 0; i < numWindows; i++) {
-        if (mWindowHandles.itemAt(i) == windowHandle) {
-            return true;
+bool InputDispatcher::isSameWindowHandles(const Vector<sp<InputWindowHandle> >& a,
+        const Vector<sp<InputWindowHandle> >& b) {
+    if (a.size() != b.size()) {
+        return false;
+    }
+    for (size_t i = 0; i < a.size(); i++) {
+        if (a[i] != b[i]) {
+            return false;
         }
     }
-    return false;
+    return true;
+}
+
+bool InputDispatcher::hasWindowHandleLocked(
+        const sp<InputWindowHandle>& windowHandle) const {
+    return mWindowIndex.indexOf(windowHandle) >= 0;
 }
 
 void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inputWindowHandles) {
@@ -2893,6 +3241,12 @@ void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inpu
             }
         }
 
+        // Windows are only removed when the list of handles changed, and the index only needs
+        // rebuilding when it did or the windows moved, so the frequent updates during which
+        // nothing changed are cheap.
+        bool windowHandlesChanged = !isSameWindowHandles(oldWindowHandles, mWindowHandles);
+        mWindowIndex.update(mWindowHandles);
+
         if (!foundHoveredWindow) {
             mLastHoverWindowHandle = NULL;
         }
@@ -2920,7 +3274,7 @@ void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inpu
             mFocusedWindowHandle = newFocusedWindowHandle;
         }
 
-        for (size_t d = 0; d < mTouchStatesByDisplay.size(); d++) {
+        for (size_t d = 0; windowHandlesChanged && d < mTouchStatesByDisplay.size(); d++) {
             TouchState& state = mTouchStatesByDisplay.editValueAt(d);
             for (size_t i = 0; i < state.windows.size(); i++) {
                 TouchedWindow& touchedWindow = state.windows.editItemAt(i);
@@ -2946,7 +3300,7 @@ void InputDispatcher::setInputWindows(const Vector<sp<InputWindowHandle> >& inpu
         // This ensures that unused input channels are released promptly.
         // Otherwise, they might stick around until the window handle is destroyed
         // which might not happen until the next GC.
-        for (size_t i = 0; i < oldWindowHandles.size(); i++) {
+        for (size_t i = 0; windowHandlesChanged && i < oldWindowHandles.size(); i++) {
             const sp<InputWindowHandle>& oldWindowHandle = oldWindowHandles.itemAt(i);
             if (!hasWindowHandleLocked(oldWindowHandle)) {
 #if DEBUG_FOCUS
@@ -3040,7 +3394,10 @@ void InputDispatcher::setInputFilterEnabled(bool enabled) {
             return;
         }
 
-        mInputFilterEnabled = enabled;
+        { // acquire handoff lock
+            AutoMutex _h(mHandoffLock);
+            mInputFilterEnabled = enabled;
+        } // release handoff lock
         resetAndDropEverythingLocked("input filter is being enabled or disabled");
     } // release lock
 
@@ -3284,6 +3641,11 @@ void InputDispatcher::dumpDispatchStateLocked(String8& dump) {
         dump.append(INDENT "InboundQueue: <empty>\n");
     }
 
+    { // acquire handoff lock
+        AutoMutex _h(mHandoffLock);
+        dump.appendFormat(INDENT "HandoffQueue: length=%u\n", mHandoffQueue.count());
+    } // release handoff lock
+
     if (!mReplacedKeys.isEmpty()) {
         dump.append(INDENT "ReplacedKeys:\n");
         for (size_t i = 0; i < mReplacedKeys.size(); i++) {
@@ -3305,6 +3667,10 @@ void InputDispatcher::dumpDispatchStateLocked(String8& dump) {
                     i, connection->getInputChannelName(), connection->getWindowName(),
                     connection->getStatusLabel(), toString(connection->monitor),
                     toString(connection->inputPublisherBlocked));
+            if (connection->broadcastsInFlight) {
+                dump.appendFormat(INDENT3 "BroadcastsInFlight: %u\n",
+                        connection->broadcastsInFlight);
+            }
 
             if (!connection->outboundQueue.isEmpty()) {
                 dump.appendFormat(INDENT3 "OutboundQueue: length=%u\n",
@@ -3603,6 +3969,13 @@ void InputDispatcher::doDispatchCycleFinishedLockedInterruptible(
             dispatchEntry->eventEntry->appendDescription(msg);
             ALOGI("%s", msg.string());
         }
+        if (dispatchEntry->eventEntry->dispatchTime) {
+            traceEventLatencyLocked(dispatchEntry->eventEntry,
+                    InputLatencyTracker::STAGE_OUTBOUND,
+                    dispatchEntry->deliveryTime - dispatchEntry->eventEntry->dispatchTime);
+        }
+        traceEventLatencyLocked(dispatchEntry->eventEntry, InputLatencyTracker::STAGE_APP,
+                eventDuration);
 
         bool restartEvent;
         if (dispatchEntry->eventEntry->type == EventEntry::TYPE_KEY) {
@@ -3634,6 +4007,11 @@ void InputDispatcher::doDispatchCycleFinishedLockedInterruptible(
 
         // Start the next dispatch cycle for this connection.
         startDispatchCycleLocked(now(), connection);
+    } else if (connection->broadcastsInFlight) {
+        // A message broadcast to a monitor; there's nothing to dequeue, but the
+        // monitor may have fallen behind and have events queued in the meantime.
+        connection->broadcastsInFlight -= 1;
+        startDispatchCycleLocked(now(), connection);
     }
 }
 
@@ -3833,6 +4211,22 @@ void InputDispatcher::updateDispatchStatisticsLocked(nsecs_t currentTime, const
     // TODO Write some statistics about how long we spend waiting.
 }
 
+void InputDispatcher::traceEventLatencyLocked(const EventEntry* entry,
+        InputLatencyTracker::Stage stage, nsecs_t latency) {
+    int32_t deviceId;
+    switch (entry->type) {
+    case EventEntry::TYPE_KEY:
+        deviceId = static_cast<const KeyEntry*>(entry)->deviceId;
+        break;
+    case EventEntry::TYPE_MOTION:
+        deviceId = static_cast<const MotionEntry*>(entry)->deviceId;
+        break;
+    default:
+        return;
+    }
+    mLatencyTracker.addLatency(deviceId, stage, latency);
+}
+
 void InputDispatcher::traceInboundQueueLengthLocked() {
     if (ATRACE_ENABLED()) {
         ATRACE_INT("iq", mInboundQueue.count());
@@ -3875,6 +4269,18 @@ void InputDispatcher::dump(String8& dump) {
     dump.append("Input Dispatcher State:\n");
     dumpDispatchStateLocked(dump);
 
+    dump.append(INDENT "EntryPools:\n");
+    dump.append(INDENT2);
+    KeyEntry::sPool.dump(dump);
+    dump.append(INDENT2);
+    MotionEntry::sPool.dump(dump);
+    dump.append(INDENT2);
+    DispatchEntry::sPool.dump(dump);
+    dump.append(INDENT2);
+    CommandEntry::sPool.dump(dump);
+
+    mLatencyTracker.dump(dump);
+
     if (!mLastANRState.isEmpty()) {
         dump.append("\nInput Dispatcher State at time of last ANR:\n");
         dump.append(mLastANRState);
@@ -3916,7 +4322,7 @@ void InputDispatcher::InjectionState::release() {
 
 InputDispatcher::EventEntry::EventEntry(int32_t type, nsecs_t eventTime, uint32_t policyFlags) :
         refCount(1), type(type), eventTime(eventTime), policyFlags(policyFlags),
-        injectionState(NULL), dispatchInProgress(false) {
+        injectionState(NULL), dispatchInProgress(false), enqueueTime(0), dispatchTime(0) {
 }
 
 InputDispatcher::EventEntry::~EventEntry() {
@@ -3973,6 +4379,9 @@ void InputDispatcher::DeviceResetEntry::appendDescription(String8& msg) const {
 
 // --- InputDispatcher::KeyEntry ---
 
+// Keys come a few at a time, even with repeats.
+EntryPool InputDispatcher::KeyEntry::sPool("KeyEntry", sizeof(KeyEntry), 16);
+
 InputDispatcher::KeyEntry::KeyEntry(nsecs_t eventTime,
         int32_t deviceId, uint32_t source, uint32_t policyFlags, int32_t action,
         int32_t flags, int32_t keyCode, int32_t scanCode, int32_t metaState,
@@ -4008,6 +4417,9 @@ void InputDispatcher::KeyEntry::recycle() {
 
 // --- InputDispatcher::MotionEntry ---
 
+// Enough for a few frames of touch samples, and their split copies.
+EntryPool InputDispatcher::MotionEntry::sPool("MotionEntry", sizeof(MotionEntry), 64);
+
 InputDispatcher::MotionEntry::MotionEntry(nsecs_t eventTime, int32_t deviceId,
         uint32_t source, uint32_t policyFlags, int32_t action, int32_t actionButton,
         int32_t flags, int32_t metaState, int32_t buttonState, int32_t edgeFlags,
@@ -4052,6 +4464,9 @@ void InputDispatcher::MotionEntry::appendDescription(String8& msg) const {
 
 // --- InputDispatcher::DispatchEntry ---
 
+// One per event and target, kept until the target finishes the event.
+EntryPool InputDispatcher::DispatchEntry::sPool("DispatchEntry", sizeof(DispatchEntry), 64);
+
 volatile int32_t InputDispatcher::DispatchEntry::sNextSeqAtomic;
 
 InputDispatcher::DispatchEntry::DispatchEntry(EventEntry* eventEntry,
@@ -4437,7 +4852,8 @@ InputDispatcher::Connection::Connection(const sp<InputChannel>& inputChannel,
         const sp<InputWindowHandle>& inputWindowHandle, bool monitor) :
         status(STATUS_NORMAL), inputChannel(inputChannel), inputWindowHandle(inputWindowHandle),
         monitor(monitor),
-        inputPublisher(inputChannel), inputPublisherBlocked(false) {
+        inputPublisher(inputChannel), inputPublisherBlocked(false),
+        broadcastsInFlight(0) {
 }
 
 InputDispatcher::Connection::~Connection() {
@@ -4481,6 +4897,8 @@ InputDispatcher::DispatchEntry* InputDispatcher::Connection::findWaitQueueEntry(
 
 // --- InputDispatcher::CommandEntry ---
 
+EntryPool InputDispatcher::CommandEntry::sPool("CommandEntry", sizeof(CommandEntry), 16);
+
 InputDispatcher::CommandEntry::CommandEntry(Command command) :
     command(command), eventTime(0), keyEntry(NULL), userActivityEventType(0),
     seq(0), handled(false) {
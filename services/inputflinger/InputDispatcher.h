@@ -33,8 +33,11 @@
 #include <unistd.h>
 #include <limits.h>
 
+#include "EntryPool.h"
 #include "InputWindow.h"
+#include "InputWindowIndex.h"
 #include "InputApplication.h"
+#include "InputLatencyTracker.h"
 #include "InputListener.h"
 
 
@@ -145,6 +148,10 @@ struct InputTarget {
          * delivered with flag AMOTION_EVENT_FLAG_WINDOW_IS_PARTIALLY_OBSCURED. */
         FLAG_WINDOW_IS_PARTIALLY_OBSCURED = 1 << 14,
 
+        /* This flag indicates that the target is a global monitor.  Monitors receive the
+         * event as is, so a single message is built and published to all of them. */
+        FLAG_MONITOR = 1 << 15,
+
     };
 
     // The input channel to be targeted.
@@ -181,9 +188,15 @@ struct InputDispatcherConfiguration {
     // The key repeat inter-key delay.
     nsecs_t keyRepeatDelay;
 
+    // Whether a hover move, or a mouse move, replaces the previous one of the same
+    // device if it is still waiting in the inbound queue, rather than being queued
+    // after it.  The intermediate samples are then lost to the apps' history.
+    bool coalesceHoverMoves;
+
     InputDispatcherConfiguration() :
             keyRepeatTimeout(500 * 1000000LL),
-            keyRepeatDelay(50 * 1000000LL) { }
+            keyRepeatDelay(50 * 1000000LL),
+            coalesceHoverMoves(false) { }
 };
 
 
@@ -442,6 +455,11 @@ private:
 
         bool dispatchInProgress; // initially false, set to true while dispatching
 
+        // Set when the event is added to the inbound queue and when it is taken from it
+        // to be dispatched, for latency tracking; 0 if it didn't come that way.
+        nsecs_t enqueueTime;
+        nsecs_t dispatchTime;
+
         inline bool isInjected() const { return injectionState != NULL; }
 
         void release();
@@ -501,6 +519,11 @@ private:
         virtual void appendDescription(String8& msg) const;
         void recycle();
 
+        // Allocated from sPool
+        static void* operator new(size_t size) { return sPool.allocate(size); }
+        static void operator delete(void* block, size_t size) { sPool.free(block, size); }
+        static EntryPool sPool;
+
     protected:
         virtual ~KeyEntry();
     };
@@ -533,6 +556,11 @@ private:
                 float xOffset, float yOffset);
         virtual void appendDescription(String8& msg) const;
 
+        // Allocated from sPool
+        static void* operator new(size_t size) { return sPool.allocate(size); }
+        static void operator delete(void* block, size_t size) { sPool.free(block, size); }
+        static EntryPool sPool;
+
     protected:
         virtual ~MotionEntry();
     };
@@ -556,6 +584,11 @@ private:
                 int32_t targetFlags, float xOffset, float yOffset, float scaleFactor);
         ~DispatchEntry();
 
+        // Allocated from sPool
+        static void* operator new(size_t size) { return sPool.allocate(size); }
+        static void operator delete(void* block, size_t size) { sPool.free(block, size); }
+        static EntryPool sPool;
+
         inline bool hasForegroundTarget() const {
             return targetFlags & InputTarget::FLAG_FOREGROUND;
         }
@@ -564,10 +597,11 @@ private:
             return targetFlags & InputTarget::FLAG_SPLIT;
         }
 
+        // Also used for the messages broadcast to monitors, which have no dispatch entry.
+        static uint32_t nextSeq();
+
     private:
         static volatile int32_t sNextSeqAtomic;
-
-        static uint32_t nextSeq();
     };
 
     // A command entry captures state and behavior for an action to be performed in the
@@ -594,6 +628,11 @@ private:
         CommandEntry(Command command);
         ~CommandEntry();
 
+        // Allocated from sPool
+        static void* operator new(size_t size) { return sPool.allocate(size); }
+        static void operator delete(void* block, size_t size) { sPool.free(block, size); }
+        static EntryPool sPool;
+
         Command command;
 
         // parameters for the command (usage varies by command)
@@ -672,6 +711,16 @@ private:
             return entry;
         }
 
+        // Empties the queue, and returns its former head, still linked to
+        // the entries that followed it
+        inline T* detachAll() {
+            T* entry = head;
+            head = NULL;
+            tail = NULL;
+            entryCount = 0;
+            return entry;
+        }
+
         uint32_t count() const {
             return entryCount;
         }
@@ -829,6 +878,10 @@ private:
         // yet received a "finished" response from the application.
         Queue<DispatchEntry> waitQueue;
 
+        // Number of events broadcast to this monitor, outside of the queues, that have
+        // not yet received a "finished" response.
+        uint32_t broadcastsInFlight;
+
         explicit Connection(const sp<InputChannel>& inputChannel,
                 const sp<InputWindowHandle>& inputWindowHandle, bool monitor);
 
@@ -854,12 +907,23 @@ private:
 
     Mutex mLock;
 
+    // Guards mHandoffQueue, through which the reader thread hands its events
+    // over to the dispatcher thread, so that it only has to wait for the
+    // dispatcher to move them to mInboundQueue, rather than for whatever the
+    // dispatcher does while holding mLock.  It is always acquired after mLock.
+    Mutex mHandoffLock;
+
     Condition mDispatcherIsAliveCondition;
 
     sp<Looper> mLooper;
 
     EventEntry* mPendingEvent;
     Queue<EventEntry> mInboundQueue;
+    Queue<EventEntry> mHandoffQueue;
+    // Whether mInboundQueue was empty as of the last dispatch cycle, guarded by
+    // mHandoffLock.  Until it is, more events can't be dispatched any sooner, so
+    // there's no point in waking the dispatcher for them.
+    bool mInboundQueueIdle;
     Queue<EventEntry> mRecentQueue;
     Queue<CommandEntry> mCommandQueue;
 
@@ -870,6 +934,20 @@ private:
     // Enqueues an inbound event.  Returns true if mLooper->wake() should be called.
     bool enqueueInboundEventLocked(EventEntry* entry);
 
+    // Merges a hover or mouse move into the last inbound event, if it is the previous
+    // move of the same pointers, and then releases it.  Returns whether it did.
+    bool coalesceInboundMotionLocked(MotionEntry* entry);
+
+    // Enqueues an event from the reader to the handoff queue, with mHandoffLock held.
+    // Returns true if mLooper->wake() should be called, which is only the case for
+    // the first event since the dispatcher last took them, if it is idle, and for the
+    // events that may make it drop the ones it's busy with.
+    bool enqueueHandoffEventLocked(EventEntry* entry);
+    bool canPreemptInboundEventsLocked(EventEntry* entry);
+
+    // Moves the events of the handoff queue to the inbound queue.
+    void takeHandoffEventsLocked();
+
     // Cleans up input state when dropping an inbound event.
     void dropInboundEventLocked(EventEntry* entry, DropReason dropReason);
 
@@ -939,7 +1017,7 @@ private:
     bool runCommandsLockedInterruptible();
     CommandEntry* postCommandLocked(Command command);
 
-    // Input filter processing.
+    // Input filter processing, with either mLock or mHandoffLock held.
     bool shouldSendKeyToInputFilterLocked(const NotifyKeyArgs* args);
     bool shouldSendMotionToInputFilterLocked(const NotifyMotionArgs* args);
 
@@ -951,12 +1029,17 @@ private:
     // Dispatch state.
     bool mDispatchEnabled;
     bool mDispatchFrozen;
+    // Written with both mLock and mHandoffLock held, so it can be read with either
     bool mInputFilterEnabled;
 
     Vector<sp<InputWindowHandle> > mWindowHandles;
+    // Spatial index of mWindowHandles, rebuilt along with it
+    InputWindowIndex mWindowIndex;
 
     sp<InputWindowHandle> getWindowHandleLocked(const sp<InputChannel>& inputChannel) const;
     bool hasWindowHandleLocked(const sp<InputWindowHandle>& windowHandle) const;
+    static bool isSameWindowHandles(const Vector<sp<InputWindowHandle> >& a,
+            const Vector<sp<InputWindowHandle> >& b);
 
     // Focus tracking for keys, trackball, etc.
     sp<InputWindowHandle> mFocusedWindowHandle;
@@ -996,6 +1079,11 @@ private:
     // Dispatcher state at time of last ANR.
     String8 mLastANRState;
 
+    // Time spent by events in each stage, per device.
+    InputLatencyTracker mLatencyTracker;
+    void traceEventLatencyLocked(const EventEntry* entry, InputLatencyTracker::Stage stage,
+            nsecs_t latency);
+
     // Dispatch inbound events.
     bool dispatchConfigurationChangedLocked(
             nsecs_t currentTime, ConfigurationChangedEntry* entry);
@@ -1009,6 +1097,13 @@ private:
             DropReason* dropReason, nsecs_t* nextWakeupTime);
     void dispatchEventLocked(nsecs_t currentTime, EventEntry* entry,
             const Vector<InputTarget>& inputTargets);
+    void dispatchEventToTargetLocked(nsecs_t currentTime, EventEntry* entry,
+            const InputTarget& inputTarget);
+    void broadcastEventToMonitorsLocked(nsecs_t currentTime, EventEntry* entry,
+            const Vector<InputTarget>& inputTargets);
+    static bool canBroadcastToConnection(const sp<Connection>& connection,
+            const EventEntry* entry);
+    static status_t buildBroadcastMessage(const EventEntry* entry, InputMessage* msg);
 
     void logOutboundKeyDetailsLocked(const char* prefix, const KeyEntry* entry);
     void logOutboundMotionDetailsLocked(const char* prefix, const MotionEntry* entry);
@@ -1073,6 +1168,10 @@ private:
     void enqueueDispatchEntryLocked(const sp<Connection>& connection,
             EventEntry* eventEntry, const InputTarget* inputTarget, int32_t dispatchMode);
     void startDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection);
+    static bool canBatchMotionSamples(const DispatchEntry* first, const DispatchEntry* next);
+    status_t publishMotionSamplesLocked(const sp<Connection>& connection,
+            DispatchEntry* firstDispatchEntry, float xOffset, float yOffset, float scaleFactor,
+            DispatchEntry** outLastDispatchEntry);
     void finishDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection,
             uint32_t seq, bool handled);
     void abortBrokenDispatchCycleLocked(nsecs_t currentTime, const sp<Connection>& connection,
@@ -1092,6 +1191,14 @@ private:
     // Splitting motion events across windows.
     MotionEntry* splitMotionEvent(const MotionEntry* originalMotionEntry, BitSet32 pointerIds);
 
+    // The splits of the event being dispatched, by pointer ids, so that targets with
+    // the same pointers share one.  Splits the event if it hasn't been split for them
+    // yet; the entry is owned by the cache until releaseSplitMotionEntriesLocked.
+    KeyedVector<uint32_t, MotionEntry*> mSplitMotionEntries;
+    MotionEntry* getSplitMotionEntryLocked(const MotionEntry* originalMotionEntry,
+            BitSet32 pointerIds);
+    void releaseSplitMotionEntriesLocked();
+
     // Reset and drop everything the dispatcher is doing.
     void resetAndDropEverythingLocked(const char* reason);
 
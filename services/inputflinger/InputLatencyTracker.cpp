@@ -0,0 +1,110 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputLatencyTracker"
+#define ATRACE_TAG ATRACE_TAG_INPUT
+
+#include "InputLatencyTracker.h"
+
+#include <utils/Trace.h>
+
+#define INDENT "  "
+#define INDENT2 "    "
+#define INDENT3 "      "
+
+namespace android {
+
+static const char* const STAGE_NAMES[] = {
+    "read", "inbound", "outbound", "app",
+};
+
+// The atrace counters of the stages, in microseconds.
+static const char* const STAGE_COUNTERS[] = {
+    "il:read", "il:inbound", "il:outbound", "il:app",
+};
+
+// --- InputLatencyTracker::Histogram ---
+
+InputLatencyTracker::Histogram::Histogram() :
+        count(0), total(0), max(0) {
+    for (size_t i = 0; i < NUM_BUCKETS; i++) {
+        buckets[i] = 0;
+    }
+}
+
+void InputLatencyTracker::Histogram::add(nsecs_t latency) {
+    size_t bucket = 0;
+    nsecs_t bound = 1000000; // 1ms
+    while (bucket < NUM_BUCKETS - 1 && latency >= bound) {
+        bucket++;
+        bound *= 2;
+    }
+    buckets[bucket]++;
+    count++;
+    total += latency;
+    if (latency > max) {
+        max = latency;
+    }
+}
+
+// --- InputLatencyTracker ---
+
+InputLatencyTracker::InputLatencyTracker() {
+}
+
+void InputLatencyTracker::addLatency(int32_t deviceId, Stage stage, nsecs_t latency) {
+    if (latency < 0) {
+        // the clocks don't agree, e.g. for events timestamped by a driver
+        return;
+    }
+    ssize_t index = mDevices.indexOfKey(deviceId);
+    if (index < 0) {
+        index = mDevices.add(deviceId, DeviceLatency());
+    }
+    mDevices.editValueAt(index).stages[stage].add(latency);
+
+    if (ATRACE_ENABLED()) {
+        ATRACE_INT(STAGE_COUNTERS[stage], int32_t(latency / 1000));
+    }
+}
+
+void InputLatencyTracker::dump(String8& dump) const {
+    dump.append(INDENT "Latency (bucket counts for <1ms, <2ms, ... <128ms, >=128ms):\n");
+    if (mDevices.isEmpty()) {
+        dump.append(INDENT2 "<none>\n");
+        return;
+    }
+    for (size_t i = 0; i < mDevices.size(); i++) {
+        dump.appendFormat(INDENT2 "Device %d:\n", mDevices.keyAt(i));
+        const DeviceLatency& device = mDevices.valueAt(i);
+        for (size_t stage = 0; stage < NUM_STAGES; stage++) {
+            const Histogram& histogram = device.stages[stage];
+            if (!histogram.count) {
+                continue;
+            }
+            dump.appendFormat(INDENT3 "%s: count=%u, avg=%0.3fms, max=%0.3fms, buckets=[",
+                    STAGE_NAMES[stage], histogram.count,
+                    histogram.total / histogram.count * 0.000001f,
+                    histogram.max * 0.000001f);
+            for (size_t bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+                dump.appendFormat(bucket ? ", %u" : "%u", histogram.buckets[bucket]);
+            }
+            dump.append("]\n");
+        }
+    }
+}
+
+} // namespace android
@@ -0,0 +1,85 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UI_INPUT_LATENCY_TRACKER_H
+#define _UI_INPUT_LATENCY_TRACKER_H
+
+#include <stdint.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+/*
+ * Keeps histograms, per input device, of how long events spend in each stage of the
+ * input pipeline, from the kernel timestamp of the event to the app finishing it.
+ *
+ * EventHub and InputReader are a single stage: the reader processes the events it
+ * reads right away, on the same thread, so the time from the kernel timestamp to the
+ * dispatcher's inbound queue is theirs.
+ *
+ * Not thread safe; the dispatcher uses it with its lock held.
+ */
+class InputLatencyTracker {
+public:
+    enum Stage {
+        // From the kernel timestamp to the inbound queue
+        STAGE_READ,
+        // In the inbound queue, until the dispatcher takes the event
+        STAGE_INBOUND,
+        // From the dispatcher taking the event, until it's published to a connection,
+        // which includes finding the targets and the connection's outbound queue
+        STAGE_OUTBOUND,
+        // From being published to being finished by the app
+        STAGE_APP,
+
+        NUM_STAGES
+    };
+
+    InputLatencyTracker();
+
+    // Adds the time an event of the device spent in the stage.
+    void addLatency(int32_t deviceId, Stage stage, nsecs_t latency);
+
+    void dump(String8& dump) const;
+
+private:
+    // Buckets for latencies under 1, 2, 4, ... 128ms, and the longer ones.
+    enum { NUM_BUCKETS = 9 };
+
+    struct Histogram {
+        Histogram();
+
+        uint32_t buckets[NUM_BUCKETS];
+        uint32_t count;
+        nsecs_t total;
+        nsecs_t max;
+
+        void add(nsecs_t latency);
+    };
+
+    struct DeviceLatency {
+        Histogram stages[NUM_STAGES];
+    };
+
+    KeyedVector<int32_t, DeviceLatency> mDevices;
+};
+
+} // namespace android
+
+#endif // _UI_INPUT_LATENCY_TRACKER_H
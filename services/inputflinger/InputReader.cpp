@@ -88,6 +88,11 @@ static const nsecs_t TOUCH_DATA_TIMEOUT = ms2ns(20);
 // data.
 static const nsecs_t STYLUS_DATA_LATENCY = ms2ns(10);
 
+// Default maximum rate at which joystick axis changes are reported, in Hz.  Gamepads can
+// report at up to 1kHz, but applications only look at them once per frame; this is above
+// the display refresh rate, so every frame still gets fresh values.
+static const float JOYSTICK_DEFAULT_MAX_REPORT_RATE = 120.0f;
+
 // --- Static Functions ---
 
 template<typename T>
@@ -3010,11 +3015,20 @@ void CursorInputMapper::fadePointer() {
 
 // --- TouchInputMapper ---
 
+static bool isSameRawPointer(const RawPointerData::Pointer& a, const RawPointerData::Pointer& b) {
+    return a.id == b.id && a.x == b.x && a.y == b.y && a.pressure == b.pressure
+            && a.touchMajor == b.touchMajor && a.touchMinor == b.touchMinor
+            && a.toolMajor == b.toolMajor && a.toolMinor == b.toolMinor
+            && a.orientation == b.orientation && a.distance == b.distance
+            && a.tiltX == b.tiltX && a.tiltY == b.tiltY
+            && a.toolType == b.toolType && a.isHovering == b.isHovering;
+}
+
 TouchInputMapper::TouchInputMapper(InputDevice* device) :
         InputMapper(device),
         mSource(0), mDeviceMode(DEVICE_MODE_DISABLED),
         mSurfaceWidth(-1), mSurfaceHeight(-1), mSurfaceLeft(0), mSurfaceTop(0),
-        mSurfaceOrientation(DISPLAY_ORIENTATION_0) {
+        mSurfaceOrientation(DISPLAY_ORIENTATION_0), mCookedPointerCacheTouchingCount(0) {
 }
 
 TouchInputMapper::~TouchInputMapper() {
@@ -3219,6 +3233,9 @@ void TouchInputMapper::configure(nsecs_t when,
         configureSurface(when, &resetNeeded);
     }
 
+    // The calibration and the surface may have changed.
+    updateRawToSurfaceTransformation();
+
     if (changes && resetNeeded) {
         // Send reset, unless this is the first time the device has been configured,
         // in which case the reader will call reset itself after all mappers are ready.
@@ -4132,6 +4149,57 @@ void TouchInputMapper::updateAffineTransformation() {
             mSurfaceOrientation);
 }
 
+void TouchInputMapper::updateRawToSurfaceTransformation() {
+    // The surface orientation maps each of the calibrated coordinates to one of the surface
+    // coordinates, scaled and translated: surface x = xScale * (x or y) + xOffset, and
+    // likewise for surface y.
+    bool swapXY;
+    float xScale, xOffset, yScale, yOffset;
+    switch (mSurfaceOrientation) {
+    case DISPLAY_ORIENTATION_90:
+        swapXY = true;
+        xScale = mYScale;
+        xOffset = mYTranslate - mRawPointerAxes.y.minValue * mYScale;
+        yScale = -mXScale;
+        yOffset = mXTranslate + mRawPointerAxes.x.maxValue * mXScale;
+        break;
+    case DISPLAY_ORIENTATION_180:
+        swapXY = false;
+        xScale = -mXScale;
+        xOffset = mXTranslate + mRawPointerAxes.x.maxValue * mXScale;
+        yScale = -mYScale;
+        yOffset = mYTranslate + mRawPointerAxes.y.maxValue * mYScale;
+        break;
+    case DISPLAY_ORIENTATION_270:
+        swapXY = true;
+        xScale = -mYScale;
+        xOffset = mYTranslate + mRawPointerAxes.y.maxValue * mYScale;
+        yScale = mXScale;
+        yOffset = mXTranslate - mRawPointerAxes.x.minValue * mXScale;
+        break;
+    default:
+        swapXY = false;
+        xScale = mXScale;
+        xOffset = mXTranslate - mRawPointerAxes.x.minValue * mXScale;
+        yScale = mYScale;
+        yOffset = mYTranslate - mRawPointerAxes.y.minValue * mYScale;
+        break;
+    }
+
+    // Compose it with the calibration, which comes first.
+    const TouchAffineTransformation& t = mAffineTransform;
+    const float xRow[3] = { t.x_scale, t.x_ymix, t.x_offset };
+    const float yRow[3] = { t.y_xmix, t.y_scale, t.y_offset };
+    const float* surfaceXRow = swapXY ? yRow : xRow;
+    const float* surfaceYRow = swapXY ? xRow : yRow;
+    mRawToSurfaceTransform = TouchAffineTransformation(
+            xScale * surfaceXRow[0], xScale * surfaceXRow[1], xScale * surfaceXRow[2] + xOffset,
+            yScale * surfaceYRow[0], yScale * surfaceYRow[1], yScale * surfaceYRow[2] + yOffset);
+
+    // The pointers need to be cooked again.
+    mCookedPointerCacheIdBits.clear();
+}
+
 void TouchInputMapper::reset(nsecs_t when) {
     mCursorButtonAccumulator.reset(getDevice());
     mCursorScrollAccumulator.reset(getDevice());
@@ -4146,6 +4214,7 @@ void TouchInputMapper::reset(nsecs_t when) {
     mCurrentCookedState.clear();
     mLastRawState.clear();
     mLastCookedState.clear();
+    mCookedPointerCacheIdBits.clear();
     mPointerUsage = POINTER_USAGE_NONE;
     mSentHoverEnter = false;
     mHavePointerIds = false;
@@ -4820,249 +4889,262 @@ void TouchInputMapper::cookPointerData() {
         mCurrentCookedState.buttonState = mCurrentRawState.buttonState;
     }
 
+    // The pointers are cooked again only if their raw data changed since they were last
+    // cooked. Their size depends on the number of touching pointers when it's summed.
+    uint32_t touchingCount = mCurrentRawState.rawPointerData.touchingIdBits.count();
+    if (touchingCount != mCookedPointerCacheTouchingCount
+            && mCalibration.haveSizeIsSummed && mCalibration.sizeIsSummed) {
+        mCookedPointerCacheIdBits.clear();
+    }
+    mCookedPointerCacheTouchingCount = touchingCount;
+
     // Walk through the the active pointers and map device coordinates onto
     // surface coordinates and adjust for display orientation.
     for (uint32_t i = 0; i < currentPointerCount; i++) {
         const RawPointerData::Pointer& in = mCurrentRawState.rawPointerData.pointers[i];
+        uint32_t id = in.id;
 
-        // Size
-        float touchMajor, touchMinor, toolMajor, toolMinor, size;
-        switch (mCalibration.sizeCalibration) {
-        case Calibration::SIZE_CALIBRATION_GEOMETRIC:
-        case Calibration::SIZE_CALIBRATION_DIAMETER:
-        case Calibration::SIZE_CALIBRATION_BOX:
-        case Calibration::SIZE_CALIBRATION_AREA:
-            if (mRawPointerAxes.touchMajor.valid && mRawPointerAxes.toolMajor.valid) {
-                touchMajor = in.touchMajor;
-                touchMinor = mRawPointerAxes.touchMinor.valid ? in.touchMinor : in.touchMajor;
-                toolMajor = in.toolMajor;
-                toolMinor = mRawPointerAxes.toolMinor.valid ? in.toolMinor : in.toolMajor;
-                size = mRawPointerAxes.touchMinor.valid
-                        ? avg(in.touchMajor, in.touchMinor) : in.touchMajor;
-            } else if (mRawPointerAxes.touchMajor.valid) {
-                toolMajor = touchMajor = in.touchMajor;
-                toolMinor = touchMinor = mRawPointerAxes.touchMinor.valid
-                        ? in.touchMinor : in.touchMajor;
-                size = mRawPointerAxes.touchMinor.valid
-                        ? avg(in.touchMajor, in.touchMinor) : in.touchMajor;
-            } else if (mRawPointerAxes.toolMajor.valid) {
-                touchMajor = toolMajor = in.toolMajor;
-                touchMinor = toolMinor = mRawPointerAxes.toolMinor.valid
-                        ? in.toolMinor : in.toolMajor;
-                size = mRawPointerAxes.toolMinor.valid
-                        ? avg(in.toolMajor, in.toolMinor) : in.toolMajor;
-            } else {
-                ALOG_ASSERT(false, "No touch or tool axes.  "
-                        "Size calibration should have been resolved to NONE.");
-                touchMajor = 0;
-                touchMinor = 0;
-                toolMajor = 0;
-                toolMinor = 0;
-                size = 0;
-            }
+        // Write output coords, as cooked last time if the raw pointer is the same.
+        PointerCoords& out = mCurrentCookedState.cookedPointerData.pointerCoords[i];
+        CookedPointer& cached = mCookedPointerCache[id];
+        if (mCookedPointerCacheIdBits.hasBit(id) && isSameRawPointer(cached.raw, in)) {
+            out.copyFrom(cached.coords);
+        } else {
+            cookPointer(in, out);
+            cached.raw = in;
+            cached.coords.copyFrom(out);
+            mCookedPointerCacheIdBits.markBit(id);
+        }
 
-            if (mCalibration.haveSizeIsSummed && mCalibration.sizeIsSummed) {
-                uint32_t touchingCount =
-                        mCurrentRawState.rawPointerData.touchingIdBits.count();
-                if (touchingCount > 1) {
-                    touchMajor /= touchingCount;
-                    touchMinor /= touchingCount;
-                    toolMajor /= touchingCount;
-                    toolMinor /= touchingCount;
-                    size /= touchingCount;
-                }
-            }
+        // Write output properties.
+        PointerProperties& properties =
+                mCurrentCookedState.cookedPointerData.pointerProperties[i];
+        properties.clear();
+        properties.id = id;
+        properties.toolType = in.toolType;
 
-            if (mCalibration.sizeCalibration == Calibration::SIZE_CALIBRATION_GEOMETRIC) {
-                touchMajor *= mGeometricScale;
-                touchMinor *= mGeometricScale;
-                toolMajor *= mGeometricScale;
-                toolMinor *= mGeometricScale;
-            } else if (mCalibration.sizeCalibration == Calibration::SIZE_CALIBRATION_AREA) {
-                touchMajor = touchMajor > 0 ? sqrtf(touchMajor) : 0;
-                touchMinor = touchMajor;
-                toolMajor = toolMajor > 0 ? sqrtf(toolMajor) : 0;
-                toolMinor = toolMajor;
-            } else if (mCalibration.sizeCalibration == Calibration::SIZE_CALIBRATION_DIAMETER) {
-                touchMinor = touchMajor;
-                toolMinor = toolMajor;
-            }
+        // Write id index.
+        mCurrentCookedState.cookedPointerData.idToIndex[id] = i;
+    }
+}
 
-            mCalibration.applySizeScaleAndBias(&touchMajor);
-            mCalibration.applySizeScaleAndBias(&touchMinor);
-            mCalibration.applySizeScaleAndBias(&toolMajor);
-            mCalibration.applySizeScaleAndBias(&toolMinor);
-            size *= mSizeScale;
-            break;
-        default:
+void TouchInputMapper::cookPointer(const RawPointerData::Pointer& in, PointerCoords& out) {
+    // Size
+    float touchMajor, touchMinor, toolMajor, toolMinor, size;
+    switch (mCalibration.sizeCalibration) {
+    case Calibration::SIZE_CALIBRATION_GEOMETRIC:
+    case Calibration::SIZE_CALIBRATION_DIAMETER:
+    case Calibration::SIZE_CALIBRATION_BOX:
+    case Calibration::SIZE_CALIBRATION_AREA:
+        if (mRawPointerAxes.touchMajor.valid && mRawPointerAxes.toolMajor.valid) {
+            touchMajor = in.touchMajor;
+            touchMinor = mRawPointerAxes.touchMinor.valid ? in.touchMinor : in.touchMajor;
+            toolMajor = in.toolMajor;
+            toolMinor = mRawPointerAxes.toolMinor.valid ? in.toolMinor : in.toolMajor;
+            size = mRawPointerAxes.touchMinor.valid
+                    ? avg(in.touchMajor, in.touchMinor) : in.touchMajor;
+        } else if (mRawPointerAxes.touchMajor.valid) {
+            toolMajor = touchMajor = in.touchMajor;
+            toolMinor = touchMinor = mRawPointerAxes.touchMinor.valid
+                    ? in.touchMinor : in.touchMajor;
+            size = mRawPointerAxes.touchMinor.valid
+                    ? avg(in.touchMajor, in.touchMinor) : in.touchMajor;
+        } else if (mRawPointerAxes.toolMajor.valid) {
+            touchMajor = toolMajor = in.toolMajor;
+            touchMinor = toolMinor = mRawPointerAxes.toolMinor.valid
+                    ? in.toolMinor : in.toolMajor;
+            size = mRawPointerAxes.toolMinor.valid
+                    ? avg(in.toolMajor, in.toolMinor) : in.toolMajor;
+        } else {
+            ALOG_ASSERT(false, "No touch or tool axes.  "
+                    "Size calibration should have been resolved to NONE.");
             touchMajor = 0;
             touchMinor = 0;
             toolMajor = 0;
             toolMinor = 0;
             size = 0;
-            break;
         }
 
-        // Pressure
-        float pressure;
-        switch (mCalibration.pressureCalibration) {
-        case Calibration::PRESSURE_CALIBRATION_PHYSICAL:
-        case Calibration::PRESSURE_CALIBRATION_AMPLITUDE:
-            pressure = in.pressure * mPressureScale;
-            break;
-        default:
-            pressure = in.isHovering ? 0 : 1;
-            break;
+        if (mCalibration.haveSizeIsSummed && mCalibration.sizeIsSummed) {
+            uint32_t touchingCount =
+                    mCurrentRawState.rawPointerData.touchingIdBits.count();
+            if (touchingCount > 1) {
+                touchMajor /= touchingCount;
+                touchMinor /= touchingCount;
+                toolMajor /= touchingCount;
+                toolMinor /= touchingCount;
+                size /= touchingCount;
+            }
         }
 
-        // Tilt and Orientation
-        float tilt;
-        float orientation;
-        if (mHaveTilt) {
-            float tiltXAngle = (in.tiltX - mTiltXCenter) * mTiltXScale;
-            float tiltYAngle = (in.tiltY - mTiltYCenter) * mTiltYScale;
-            orientation = atan2f(-sinf(tiltXAngle), sinf(tiltYAngle));
-            tilt = acosf(cosf(tiltXAngle) * cosf(tiltYAngle));
-        } else {
-            tilt = 0;
+        if (mCalibration.sizeCalibration == Calibration::SIZE_CALIBRATION_GEOMETRIC) {
+            touchMajor *= mGeometricScale;
+            touchMinor *= mGeometricScale;
+            toolMajor *= mGeometricScale;
+            toolMinor *= mGeometricScale;
+        } else if (mCalibration.sizeCalibration == Calibration::SIZE_CALIBRATION_AREA) {
+            touchMajor = touchMajor > 0 ? sqrtf(touchMajor) : 0;
+            touchMinor = touchMajor;
+            toolMajor = toolMajor > 0 ? sqrtf(toolMajor) : 0;
+            toolMinor = toolMajor;
+        } else if (mCalibration.sizeCalibration == Calibration::SIZE_CALIBRATION_DIAMETER) {
+            touchMinor = touchMajor;
+            toolMinor = toolMajor;
+        }
+
+        mCalibration.applySizeScaleAndBias(&touchMajor);
+        mCalibration.applySizeScaleAndBias(&touchMinor);
+        mCalibration.applySizeScaleAndBias(&toolMajor);
+        mCalibration.applySizeScaleAndBias(&toolMinor);
+        size *= mSizeScale;
+        break;
+    default:
+        touchMajor = 0;
+        touchMinor = 0;
+        toolMajor = 0;
+        toolMinor = 0;
+        size = 0;
+        break;
+    }
 
-            switch (mCalibration.orientationCalibration) {
-            case Calibration::ORIENTATION_CALIBRATION_INTERPOLATED:
-                orientation = in.orientation * mOrientationScale;
-                break;
-            case Calibration::ORIENTATION_CALIBRATION_VECTOR: {
-                int32_t c1 = signExtendNybble((in.orientation & 0xf0) >> 4);
-                int32_t c2 = signExtendNybble(in.orientation & 0x0f);
-                if (c1 != 0 || c2 != 0) {
-                    orientation = atan2f(c1, c2) * 0.5f;
-                    float confidence = hypotf(c1, c2);
-                    float scale = 1.0f + confidence / 16.0f;
-                    touchMajor *= scale;
-                    touchMinor /= scale;
-                    toolMajor *= scale;
-                    toolMinor /= scale;
-                } else {
-                    orientation = 0;
-                }
-                break;
-            }
-            default:
+    // Pressure
+    float pressure;
+    switch (mCalibration.pressureCalibration) {
+    case Calibration::PRESSURE_CALIBRATION_PHYSICAL:
+    case Calibration::PRESSURE_CALIBRATION_AMPLITUDE:
+        pressure = in.pressure * mPressureScale;
+        break;
+    default:
+        pressure = in.isHovering ? 0 : 1;
+        break;
+    }
+
+    // Tilt and Orientation
+    float tilt;
+    float orientation;
+    if (mHaveTilt) {
+        float tiltXAngle = (in.tiltX - mTiltXCenter) * mTiltXScale;
+        float tiltYAngle = (in.tiltY - mTiltYCenter) * mTiltYScale;
+        orientation = atan2f(-sinf(tiltXAngle), sinf(tiltYAngle));
+        tilt = acosf(cosf(tiltXAngle) * cosf(tiltYAngle));
+    } else {
+        tilt = 0;
+
+        switch (mCalibration.orientationCalibration) {
+        case Calibration::ORIENTATION_CALIBRATION_INTERPOLATED:
+            orientation = in.orientation * mOrientationScale;
+            break;
+        case Calibration::ORIENTATION_CALIBRATION_VECTOR: {
+            int32_t c1 = signExtendNybble((in.orientation & 0xf0) >> 4);
+            int32_t c2 = signExtendNybble(in.orientation & 0x0f);
+            if (c1 != 0 || c2 != 0) {
+                orientation = atan2f(c1, c2) * 0.5f;
+                float confidence = hypotf(c1, c2);
+                float scale = 1.0f + confidence / 16.0f;
+                touchMajor *= scale;
+                touchMinor /= scale;
+                toolMajor *= scale;
+                toolMinor /= scale;
+            } else {
                 orientation = 0;
             }
-        }
-
-        // Distance
-        float distance;
-        switch (mCalibration.distanceCalibration) {
-        case Calibration::DISTANCE_CALIBRATION_SCALED:
-            distance = in.distance * mDistanceScale;
             break;
-        default:
-            distance = 0;
         }
-
-        // Coverage
-        int32_t rawLeft, rawTop, rawRight, rawBottom;
-        switch (mCalibration.coverageCalibration) {
-        case Calibration::COVERAGE_CALIBRATION_BOX:
-            rawLeft = (in.toolMinor & 0xffff0000) >> 16;
-            rawRight = in.toolMinor & 0x0000ffff;
-            rawBottom = in.toolMajor & 0x0000ffff;
-            rawTop = (in.toolMajor & 0xffff0000) >> 16;
-            break;
         default:
-            rawLeft = rawTop = rawRight = rawBottom = 0;
-            break;
+            orientation = 0;
         }
+    }
 
-        // Adjust X,Y coords for device calibration
-        // TODO: Adjust coverage coords?
-        float xTransformed = in.x, yTransformed = in.y;
-        mAffineTransform.applyTo(xTransformed, yTransformed);
+    // Distance
+    float distance;
+    switch (mCalibration.distanceCalibration) {
+    case Calibration::DISTANCE_CALIBRATION_SCALED:
+        distance = in.distance * mDistanceScale;
+        break;
+    default:
+        distance = 0;
+    }
 
-        // Adjust X, Y, and coverage coords for surface orientation.
-        float x, y;
-        float left, top, right, bottom;
+    // Coverage
+    int32_t rawLeft, rawTop, rawRight, rawBottom;
+    switch (mCalibration.coverageCalibration) {
+    case Calibration::COVERAGE_CALIBRATION_BOX:
+        rawLeft = (in.toolMinor & 0xffff0000) >> 16;
+        rawRight = in.toolMinor & 0x0000ffff;
+        rawBottom = in.toolMajor & 0x0000ffff;
+        rawTop = (in.toolMajor & 0xffff0000) >> 16;
+        break;
+    default:
+        rawLeft = rawTop = rawRight = rawBottom = 0;
+        break;
+    }
 
-        switch (mSurfaceOrientation) {
-        case DISPLAY_ORIENTATION_90:
-            x = float(yTransformed - mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
-            y = float(mRawPointerAxes.x.maxValue - xTransformed) * mXScale + mXTranslate;
-            left = float(rawTop - mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
-            right = float(rawBottom- mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
-            bottom = float(mRawPointerAxes.x.maxValue - rawLeft) * mXScale + mXTranslate;
-            top = float(mRawPointerAxes.x.maxValue - rawRight) * mXScale + mXTranslate;
-            orientation -= M_PI_2;
-            if (orientation < mOrientedRanges.orientation.min) {
-                orientation += (mOrientedRanges.orientation.max - mOrientedRanges.orientation.min);
-            }
-            break;
-        case DISPLAY_ORIENTATION_180:
-            x = float(mRawPointerAxes.x.maxValue - xTransformed) * mXScale + mXTranslate;
-            y = float(mRawPointerAxes.y.maxValue - yTransformed) * mYScale + mYTranslate;
-            left = float(mRawPointerAxes.x.maxValue - rawRight) * mXScale + mXTranslate;
-            right = float(mRawPointerAxes.x.maxValue - rawLeft) * mXScale + mXTranslate;
-            bottom = float(mRawPointerAxes.y.maxValue - rawTop) * mYScale + mYTranslate;
-            top = float(mRawPointerAxes.y.maxValue - rawBottom) * mYScale + mYTranslate;
-            orientation -= M_PI;
-            if (orientation < mOrientedRanges.orientation.min) {
-                orientation += (mOrientedRanges.orientation.max - mOrientedRanges.orientation.min);
-            }
-            break;
-        case DISPLAY_ORIENTATION_270:
-            x = float(mRawPointerAxes.y.maxValue - yTransformed) * mYScale + mYTranslate;
-            y = float(xTransformed - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
-            left = float(mRawPointerAxes.y.maxValue - rawBottom) * mYScale + mYTranslate;
-            right = float(mRawPointerAxes.y.maxValue - rawTop) * mYScale + mYTranslate;
-            bottom = float(rawRight - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
-            top = float(rawLeft - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
-            orientation += M_PI_2;
-            if (orientation > mOrientedRanges.orientation.max) {
-                orientation -= (mOrientedRanges.orientation.max - mOrientedRanges.orientation.min);
-            }
-            break;
-        default:
-            x = float(xTransformed - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
-            y = float(yTransformed - mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
-            left = float(rawLeft - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
-            right = float(rawRight - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
-            bottom = float(rawBottom - mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
-            top = float(rawTop - mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
-            break;
-        }
+    // Adjust X,Y coords for device calibration and surface orientation.
+    // TODO: Adjust coverage coords for device calibration?
+    float x = in.x, y = in.y;
+    mRawToSurfaceTransform.applyTo(x, y);
 
-        // Write output coords.
-        PointerCoords& out = mCurrentCookedState.cookedPointerData.pointerCoords[i];
-        out.clear();
-        out.setAxisValue(AMOTION_EVENT_AXIS_X, x);
-        out.setAxisValue(AMOTION_EVENT_AXIS_Y, y);
-        out.setAxisValue(AMOTION_EVENT_AXIS_PRESSURE, pressure);
-        out.setAxisValue(AMOTION_EVENT_AXIS_SIZE, size);
-        out.setAxisValue(AMOTION_EVENT_AXIS_TOUCH_MAJOR, touchMajor);
-        out.setAxisValue(AMOTION_EVENT_AXIS_TOUCH_MINOR, touchMinor);
-        out.setAxisValue(AMOTION_EVENT_AXIS_ORIENTATION, orientation);
-        out.setAxisValue(AMOTION_EVENT_AXIS_TILT, tilt);
-        out.setAxisValue(AMOTION_EVENT_AXIS_DISTANCE, distance);
-        if (mCalibration.coverageCalibration == Calibration::COVERAGE_CALIBRATION_BOX) {
-            out.setAxisValue(AMOTION_EVENT_AXIS_GENERIC_1, left);
-            out.setAxisValue(AMOTION_EVENT_AXIS_GENERIC_2, top);
-            out.setAxisValue(AMOTION_EVENT_AXIS_GENERIC_3, right);
-            out.setAxisValue(AMOTION_EVENT_AXIS_GENERIC_4, bottom);
-        } else {
-            out.setAxisValue(AMOTION_EVENT_AXIS_TOOL_MAJOR, toolMajor);
-            out.setAxisValue(AMOTION_EVENT_AXIS_TOOL_MINOR, toolMinor);
-        }
+    // Adjust coverage coords for surface orientation.
+    float left, top, right, bottom;
 
-        // Write output properties.
-        PointerProperties& properties =
-                mCurrentCookedState.cookedPointerData.pointerProperties[i];
-        uint32_t id = in.id;
-        properties.clear();
-        properties.id = id;
-        properties.toolType = in.toolType;
+    switch (mSurfaceOrientation) {
+    case DISPLAY_ORIENTATION_90:
+        left = float(rawTop - mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
+        right = float(rawBottom- mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
+        bottom = float(mRawPointerAxes.x.maxValue - rawLeft) * mXScale + mXTranslate;
+        top = float(mRawPointerAxes.x.maxValue - rawRight) * mXScale + mXTranslate;
+        orientation -= M_PI_2;
+        if (orientation < mOrientedRanges.orientation.min) {
+            orientation += (mOrientedRanges.orientation.max - mOrientedRanges.orientation.min);
+        }
+        break;
+    case DISPLAY_ORIENTATION_180:
+        left = float(mRawPointerAxes.x.maxValue - rawRight) * mXScale + mXTranslate;
+        right = float(mRawPointerAxes.x.maxValue - rawLeft) * mXScale + mXTranslate;
+        bottom = float(mRawPointerAxes.y.maxValue - rawTop) * mYScale + mYTranslate;
+        top = float(mRawPointerAxes.y.maxValue - rawBottom) * mYScale + mYTranslate;
+        orientation -= M_PI;
+        if (orientation < mOrientedRanges.orientation.min) {
+            orientation += (mOrientedRanges.orientation.max - mOrientedRanges.orientation.min);
+        }
+        break;
+    case DISPLAY_ORIENTATION_270:
+        left = float(mRawPointerAxes.y.maxValue - rawBottom) * mYScale + mYTranslate;
+        right = float(mRawPointerAxes.y.maxValue - rawTop) * mYScale + mYTranslate;
+        bottom = float(rawRight - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
+        top = float(rawLeft - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
+        orientation += M_PI_2;
+        if (orientation > mOrientedRanges.orientation.max) {
+            orientation -= (mOrientedRanges.orientation.max - mOrientedRanges.orientation.min);
+        }
+        break;
+    default:
+        left = float(rawLeft - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
+        right = float(rawRight - mRawPointerAxes.x.minValue) * mXScale + mXTranslate;
+        bottom = float(rawBottom - mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
+        top = float(rawTop - mRawPointerAxes.y.minValue) * mYScale + mYTranslate;
+        break;
+    }
 
-        // Write id index.
-        mCurrentCookedState.cookedPointerData.idToIndex[id] = i;
+    // Write output coords.
+    out.clear();
+    out.setAxisValue(AMOTION_EVENT_AXIS_X, x);
+    out.setAxisValue(AMOTION_EVENT_AXIS_Y, y);
+    out.setAxisValue(AMOTION_EVENT_AXIS_PRESSURE, pressure);
+    out.setAxisValue(AMOTION_EVENT_AXIS_SIZE, size);
+    out.setAxisValue(AMOTION_EVENT_AXIS_TOUCH_MAJOR, touchMajor);
+    out.setAxisValue(AMOTION_EVENT_AXIS_TOUCH_MINOR, touchMinor);
+    out.setAxisValue(AMOTION_EVENT_AXIS_ORIENTATION, orientation);
+    out.setAxisValue(AMOTION_EVENT_AXIS_TILT, tilt);
+    out.setAxisValue(AMOTION_EVENT_AXIS_DISTANCE, distance);
+    if (mCalibration.coverageCalibration == Calibration::COVERAGE_CALIBRATION_BOX) {
+        out.setAxisValue(AMOTION_EVENT_AXIS_GENERIC_1, left);
+        out.setAxisValue(AMOTION_EVENT_AXIS_GENERIC_2, top);
+        out.setAxisValue(AMOTION_EVENT_AXIS_GENERIC_3, right);
+        out.setAxisValue(AMOTION_EVENT_AXIS_GENERIC_4, bottom);
+    } else {
+        out.setAxisValue(AMOTION_EVENT_AXIS_TOOL_MAJOR, toolMajor);
+        out.setAxisValue(AMOTION_EVENT_AXIS_TOOL_MINOR, toolMinor);
     }
 }
 
@@ -6964,7 +7046,8 @@ void ExternalStylusInputMapper::sync(nsecs_t when) {
 // --- JoystickInputMapper ---
 
 JoystickInputMapper::JoystickInputMapper(InputDevice* device) :
-        InputMapper(device) {
+        InputMapper(device), mMinReportInterval(0), mNextReportTime(LLONG_MIN),
+        mReportPending(false), mPendingReportTime(0) {
 }
 
 JoystickInputMapper::~JoystickInputMapper() {
@@ -7040,8 +7123,9 @@ void JoystickInputMapper::dump(String8& dump) {
             dump.append(" (invert)");
         }
 
-        dump.appendFormat(": min=%0.5f, max=%0.5f, flat=%0.5f, fuzz=%0.5f, resolution=%0.5f\n",
-                axis.min, axis.max, axis.flat, axis.fuzz, axis.resolution);
+        dump.appendFormat(": min=%0.5f, max=%0.5f, flat=%0.5f, fuzz=%0.5f, resolution=%0.5f, "
+                "filter=%0.5f\n",
+                axis.min, axis.max, axis.flat, axis.fuzz, axis.resolution, axis.filter);
         dump.appendFormat(INDENT4 "  scale=%0.5f, offset=%0.5f, "
                 "highScale=%0.5f, highOffset=%0.5f\n",
                 axis.scale, axis.offset, axis.highScale, axis.highOffset);
@@ -7050,6 +7134,8 @@ void JoystickInputMapper::dump(String8& dump) {
                 mAxes.keyAt(i), axis.rawAxisInfo.minValue, axis.rawAxisInfo.maxValue,
                 axis.rawAxisInfo.flat, axis.rawAxisInfo.fuzz, axis.rawAxisInfo.resolution);
     }
+    dump.appendFormat(INDENT3 "MinReportInterval: %0.1fms\n", mMinReportInterval * 0.000001f);
+    dump.appendFormat(INDENT3 "ReportPending: %s\n", toString(mReportPending));
 }
 
 void JoystickInputMapper::configure(nsecs_t when,
@@ -7057,6 +7143,18 @@ void JoystickInputMapper::configure(nsecs_t when,
     InputMapper::configure(when, config, changes);
 
     if (!changes) { // first time only
+        // Limit the report rate.  A rate of 0 means no limit.
+        float maxReportRate = JOYSTICK_DEFAULT_MAX_REPORT_RATE;
+        getDevice()->getConfiguration().tryGetProperty(String8("joystick.maxReportRate"),
+                maxReportRate);
+        mMinReportInterval = maxReportRate > 0 ? nsecs_t(1000000000.0f / maxReportRate) : 0;
+
+        // An optional floor for the per axis filters below, for devices whose
+        // fuzz doesn't account for all of their noise.
+        float minAxisChange = 0.0f;
+        getDevice()->getConfiguration().tryGetProperty(String8("joystick.minAxisChange"),
+                minAxisChange);
+
         // Collect all axes.
         for (int32_t abs = 0; abs <= ABS_MAX; abs++) {
             if (!(getAbsAxisUsage(abs, getDevice()->getClasses())
@@ -7107,6 +7205,9 @@ void JoystickInputMapper::configure(nsecs_t when,
                 // To eliminate noise while the joystick is at rest, filter out small variations
                 // in axis values up front.
                 axis.filter = axis.fuzz ? axis.fuzz : axis.flat * 0.25f;
+                if (axis.filter < minAxisChange) {
+                    axis.filter = minAxisChange;
+                }
 
                 mAxes.add(abs, axis);
             }
@@ -7198,6 +7299,8 @@ void JoystickInputMapper::reset(nsecs_t when) {
         Axis& axis = mAxes.editValueAt(i);
         axis.resetValue();
     }
+    mNextReportTime = LLONG_MIN;
+    mReportPending = false;
 
     InputMapper::reset(when);
 }
@@ -7250,10 +7353,39 @@ void JoystickInputMapper::process(const RawEvent* rawEvent) {
     }
 }
 
+void JoystickInputMapper::timeoutExpired(nsecs_t when) {
+    if (mReportPending) {
+        if (when >= mNextReportTime) {
+            reportAxes(mPendingReportTime, false /*force*/);
+        } else {
+            getContext()->requestTimeoutAtTime(mNextReportTime);
+        }
+    }
+}
+
 void JoystickInputMapper::sync(nsecs_t when, bool force) {
+    // Hold back reports that come too soon after the previous one.  The axes keep their
+    // new values, so the report sent when the timeout expires has the latest of them.
+    if (!force && when < mNextReportTime) {
+        if (!mReportPending) {
+            if (!haveNewAxisValues()) {
+                return;
+            }
+            mReportPending = true;
+            getContext()->requestTimeoutAtTime(mNextReportTime);
+        }
+        mPendingReportTime = when;
+        return;
+    }
+    reportAxes(when, force);
+}
+
+void JoystickInputMapper::reportAxes(nsecs_t when, bool force) {
+    mReportPending = false;
     if (!filterAxes(force)) {
         return;
     }
+    mNextReportTime = when + mMinReportInterval;
 
     int32_t metaState = mContext->getGlobalMetaState();
     int32_t buttonState = 0;
@@ -7301,6 +7433,18 @@ void JoystickInputMapper::setPointerCoordsAxisValue(PointerCoords* pointerCoords
     }
 }
 
+bool JoystickInputMapper::haveNewAxisValues() const {
+    size_t numAxes = mAxes.size();
+    for (size_t i = 0; i < numAxes; i++) {
+        const Axis& axis = mAxes.valueAt(i);
+        if (axis.newValue != axis.currentValue
+                || axis.highNewValue != axis.highCurrentValue) {
+            return true;
+        }
+    }
+    return false;
+}
+
 bool JoystickInputMapper::filterAxes(bool force) {
     bool atLeastOneSignificantChange = force;
     size_t numAxes = mAxes.size();
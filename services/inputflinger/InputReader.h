@@ -1430,6 +1430,10 @@ protected:
     // Affine location transformation/calibration
     struct TouchAffineTransformation mAffineTransform;
 
+    // The calibration followed by the scaling and orientation of the surface, which maps
+    // raw coordinates to surface coordinates in one step.
+    struct TouchAffineTransformation mRawToSurfaceTransform;
+
     RawPointerAxes mRawPointerAxes;
 
     struct RawState {
@@ -1495,6 +1499,16 @@ protected:
     RawState mLastRawState;
     CookedState mLastCookedState;
 
+    // The pointers as they were last cooked, by id, so that those whose raw data didn't
+    // change needn't be cooked again.  Cleared when the cooking parameters change.
+    struct CookedPointer {
+        RawPointerData::Pointer raw;
+        PointerCoords coords;
+    };
+    BitSet32 mCookedPointerCacheIdBits;
+    uint32_t mCookedPointerCacheTouchingCount;
+    CookedPointer mCookedPointerCache[MAX_POINTER_ID + 1];
+
     // State provided by an external stylus
     StylusState mExternalStylusState;
     int64_t mExternalStylusId;
@@ -1843,6 +1857,8 @@ private:
     void dispatchButtonPress(nsecs_t when, uint32_t policyFlags);
     const BitSet32& findActiveIdBits(const CookedPointerData& cookedPointerData);
     void cookPointerData();
+    void cookPointer(const RawPointerData::Pointer& in, PointerCoords& out);
+    void updateRawToSurfaceTransformation();
     void abortTouches(nsecs_t when, uint32_t policyFlags);
 
     void dispatchPointerUsage(nsecs_t when, uint32_t policyFlags, PointerUsage pointerUsage);
@@ -1965,6 +1981,7 @@ public:
     virtual void configure(nsecs_t when, const InputReaderConfiguration* config, uint32_t changes);
     virtual void reset(nsecs_t when);
     virtual void process(const RawEvent* rawEvent);
+    virtual void timeoutExpired(nsecs_t when);
 
 private:
     struct Axis {
@@ -2021,7 +2038,17 @@ private:
     // Axes indexed by raw ABS_* axis index.
     KeyedVector<int32_t, Axis> mAxes;
 
+    // The shortest time between two reports, or 0 if reports are not limited.
+    nsecs_t mMinReportInterval;
+    // The earliest time at which the next report can be sent.
+    nsecs_t mNextReportTime;
+    // True if a report was held back until mNextReportTime, and the time it was made.
+    bool mReportPending;
+    nsecs_t mPendingReportTime;
+
     void sync(nsecs_t when, bool force);
+    void reportAxes(nsecs_t when, bool force);
+    bool haveNewAxisValues() const;
 
     bool haveAxis(int32_t axisId);
     void pruneAxes(bool ignoreExplicitlyMappedAxes);
@@ -0,0 +1,312 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define LOG_TAG "InputWindowIndex"
+
+#include "InputWindowIndex.h"
+
+#include <algorithm>
+
+#include <ui/Region.h>
+
+namespace android {
+
+static void addToBounds(Rect* bounds, const Rect& rect) {
+    if (rect.isEmpty()) {
+        return;
+    }
+    if (bounds->isEmpty()) {
+        *bounds = rect;
+        return;
+    }
+    bounds->left = std::min(bounds->left, rect.left);
+    bounds->top = std::min(bounds->top, rect.top);
+    bounds->right = std::max(bounds->right, rect.right);
+    bounds->bottom = std::max(bounds->bottom, rect.bottom);
+}
+
+// --- InputWindowIndex::Grid ---
+
+InputWindowIndex::Grid::Grid() {
+}
+
+void InputWindowIndex::Grid::getCells(const Rect& rect, int32_t* outLeft,
+        int32_t* outTop, int32_t* outRight, int32_t* outBottom) const {
+    // Cells are [left, right) x [top, bottom); the right and bottom edges of
+    // rect are exclusive, so the last cell is the one of right - 1
+    const int64_t width = bounds.getWidth();
+    const int64_t height = bounds.getHeight();
+    *outLeft = int32_t((int64_t(rect.left) - bounds.left) * GRID_SIZE / width);
+    *outTop = int32_t((int64_t(rect.top) - bounds.top) * GRID_SIZE / height);
+    *outRight = int32_t((int64_t(rect.right) - 1 - bounds.left) * GRID_SIZE
+            / width) + 1;
+    *outBottom = int32_t((int64_t(rect.bottom) - 1 - bounds.top) * GRID_SIZE
+            / height) + 1;
+    *outLeft = std::max(*outLeft, 0);
+    *outTop = std::max(*outTop, 0);
+    *outRight = std::min(*outRight, int32_t(GRID_SIZE));
+    *outBottom = std::min(*outBottom, int32_t(GRID_SIZE));
+}
+
+ssize_t InputWindowIndex::Grid::getCell(int32_t x, int32_t y) const {
+    if (x < bounds.left || x >= bounds.right
+            || y < bounds.top || y >= bounds.bottom) {
+        return -1;
+    }
+    const int32_t column = int32_t((int64_t(x) - bounds.left) * GRID_SIZE
+            / bounds.getWidth());
+    const int32_t row = int32_t((int64_t(y) - bounds.top) * GRID_SIZE
+            / bounds.getHeight());
+    return row * GRID_SIZE + column;
+}
+
+void InputWindowIndex::Grid::add(Vector<size_t>* cells, const Rect& rect,
+        size_t index) {
+    if (rect.isEmpty()) {
+        return;
+    }
+    int32_t left, top, right, bottom;
+    getCells(rect, &left, &top, &right, &bottom);
+    for (int32_t row = top; row < bottom; row++) {
+        for (int32_t column = left; column < right; column++) {
+            cells[row * GRID_SIZE + column].add(index);
+        }
+    }
+}
+
+// --- InputWindowIndex ---
+
+InputWindowIndex::InputWindowIndex() {
+}
+
+Rect InputWindowIndex::getFrame(const InputWindowInfo* info) {
+    return Rect(info->frameLeft, info->frameTop, info->frameRight,
+            info->frameBottom);
+}
+
+uint8_t InputWindowIndex::getState(const InputWindowInfo* info) {
+    return (info->visible ? STATE_VISIBLE : 0)
+            | (info->isTrustedOverlay() ? STATE_TRUSTED_OVERLAY : 0)
+            | (info->touchableRegion.isRect() ? STATE_TOUCHABLE_RECT : 0);
+}
+
+// Same as InputWindowInfo::overlaps
+bool InputWindowIndex::overlaps(const Rect& a, const Rect& b) {
+    return a.left < b.right && a.right > b.left
+            && a.top < b.bottom && a.bottom > b.top;
+}
+
+bool InputWindowIndex::matches(size_t i, const InputWindowInfo* info) const {
+    return mStates[i] == getState(info) && mDisplayIds[i] == info->displayId
+            && mLayoutParamsFlags[i] == info->layoutParamsFlags
+            && mFrames[i] == getFrame(info)
+            && mTouchableBounds[i] == info->touchableRegion.getBounds();
+}
+
+bool InputWindowIndex::touchableRegionContainsPoint(size_t i,
+        int32_t x, int32_t y) const {
+    if (mStates[i] & STATE_TOUCHABLE_RECT) {
+        const Rect& bounds(mTouchableBounds[i]);
+        return x >= bounds.left && x < bounds.right
+                && y >= bounds.top && y < bounds.bottom;
+    }
+    return mWindowHandles[i]->getInfo()->touchableRegionContainsPoint(x, y);
+}
+
+void InputWindowIndex::rebuild(
+        const Vector<sp<InputWindowHandle> >& windowHandles) {
+    mWindowHandles = windowHandles;
+    mIndexOfHandle.clear();
+    mGrids.clear();
+
+    const size_t numWindows = mWindowHandles.size();
+    mIndexOfHandle.setCapacity(numWindows);
+    mFrames.clear();
+    mFrames.setCapacity(numWindows);
+    mTouchableBounds.clear();
+    mTouchableBounds.setCapacity(numWindows);
+    mLayoutParamsFlags.clear();
+    mLayoutParamsFlags.setCapacity(numWindows);
+    mDisplayIds.clear();
+    mDisplayIds.setCapacity(numWindows);
+    mStates.clear();
+    mStates.setCapacity(numWindows);
+    for (size_t i = 0; i < numWindows; i++) {
+        const InputWindowInfo* info = mWindowHandles[i]->getInfo();
+        mIndexOfHandle.add(mWindowHandles[i].get(), i);
+        mFrames.add(getFrame(info));
+        mTouchableBounds.add(info->touchableRegion.getBounds());
+        mLayoutParamsFlags.add(info->layoutParamsFlags);
+        mDisplayIds.add(info->displayId);
+        mStates.add(getState(info));
+    }
+
+    // The grids cover the bounds of the visible windows of their display
+    for (size_t i = 0; i < numWindows; i++) {
+        if (!(mStates[i] & STATE_VISIBLE)) {
+            continue;
+        }
+        ssize_t gridIndex = mGrids.indexOfKey(mDisplayIds[i]);
+        if (gridIndex < 0) {
+            gridIndex = mGrids.add(mDisplayIds[i], Grid());
+        }
+        Rect& bounds(mGrids.editValueAt(size_t(gridIndex)).bounds);
+        addToBounds(&bounds, mFrames[i]);
+        addToBounds(&bounds, mTouchableBounds[i]);
+    }
+
+    for (size_t i = 0; i < numWindows; i++) {
+        if (!(mStates[i] & STATE_VISIBLE)) {
+            continue;
+        }
+        Grid& grid(mGrids.editValueFor(mDisplayIds[i]));
+        const int32_t flags = mLayoutParamsFlags[i];
+        if (!(flags & InputWindowInfo::FLAG_NOT_TOUCHABLE)) {
+            const bool isTouchModal = (flags & (InputWindowInfo::FLAG_NOT_FOCUSABLE
+                    | InputWindowInfo::FLAG_NOT_TOUCH_MODAL)) == 0;
+            if (isTouchModal) {
+                grid.touchModalWindows.add(i);
+            } else {
+                grid.add(grid.touchableCells, mTouchableBounds[i], i);
+            }
+        }
+        if (!(mStates[i] & STATE_TRUSTED_OVERLAY)) {
+            const Rect& frame(mFrames[i]);
+            if (frame.isEmpty()) {
+                // these can't contain a point, but may still overlap
+                grid.emptyObscuringWindows.add(i);
+            } else {
+                grid.add(grid.obscuringCells, frame, i);
+            }
+        }
+        if (flags & InputWindowInfo::FLAG_WATCH_OUTSIDE_TOUCH) {
+            grid.outsideTouchWatchers.add(i);
+        }
+    }
+}
+
+bool InputWindowIndex::update(const Vector<sp<InputWindowHandle> >& windowHandles) {
+    bool changed = windowHandles.size() != mWindowHandles.size();
+    for (size_t i = 0; !changed && i < windowHandles.size(); i++) {
+        changed = windowHandles[i] != mWindowHandles[i]
+                || !matches(i, windowHandles[i]->getInfo());
+    }
+    if (changed) {
+        rebuild(windowHandles);
+    }
+    return changed;
+}
+
+ssize_t InputWindowIndex::indexOf(const sp<InputWindowHandle>& windowHandle) const {
+    const ssize_t index = mIndexOfHandle.indexOfKey(windowHandle.get());
+    return index < 0 ? -1 : ssize_t(mIndexOfHandle.valueAt(size_t(index)));
+}
+
+ssize_t InputWindowIndex::findTouchedWindowAt(int32_t displayId,
+        int32_t x, int32_t y) const {
+    const ssize_t gridIndex = mGrids.indexOfKey(displayId);
+    if (gridIndex < 0) {
+        return -1;
+    }
+    const Grid& grid(mGrids.valueAt(size_t(gridIndex)));
+
+    // The front most touch modal window takes the touch, unless a window in
+    // front of it contains the point
+    size_t found = grid.touchModalWindows.isEmpty() ?
+            mWindowHandles.size() : grid.touchModalWindows[0];
+    const ssize_t cell = grid.getCell(x, y);
+    if (cell >= 0) {
+        const Vector<size_t>& windows(grid.touchableCells[cell]);
+        for (size_t i = 0; i < windows.size() && windows[i] < found; i++) {
+            if (touchableRegionContainsPoint(windows[i], x, y)) {
+                found = windows[i];
+                break;
+            }
+        }
+    }
+    return found < mWindowHandles.size() ? ssize_t(found) : -1;
+}
+
+bool InputWindowIndex::isObscuredAtPoint(int32_t displayId, size_t before,
+        int32_t x, int32_t y) const {
+    const ssize_t gridIndex = mGrids.indexOfKey(displayId);
+    if (gridIndex < 0) {
+        return false;
+    }
+    const Grid& grid(mGrids.valueAt(size_t(gridIndex)));
+    const ssize_t cell = grid.getCell(x, y);
+    if (cell < 0) {
+        return false;
+    }
+    const Vector<size_t>& windows(grid.obscuringCells[cell]);
+    for (size_t i = 0; i < windows.size() && windows[i] < before; i++) {
+        const Rect& frame(mFrames[windows[i]]);
+        if (x >= frame.left && x < frame.right && y >= frame.top && y < frame.bottom) {
+            return true;
+        }
+    }
+    return false;
+}
+
+bool InputWindowIndex::isObscured(int32_t displayId, size_t before,
+        const InputWindowInfo* windowInfo) const {
+    const ssize_t gridIndex = mGrids.indexOfKey(displayId);
+    if (gridIndex < 0) {
+        return false;
+    }
+    const Grid& grid(mGrids.valueAt(size_t(gridIndex)));
+    const Rect frame(getFrame(windowInfo));
+    for (size_t i = 0; i < grid.emptyObscuringWindows.size()
+            && grid.emptyObscuringWindows[i] < before; i++) {
+        if (overlaps(mFrames[grid.emptyObscuringWindows[i]], frame)) {
+            return true;
+        }
+    }
+
+    if (grid.bounds.isEmpty()) {
+        return false;
+    }
+    Rect area;
+    if (frame.isEmpty()) {
+        // An empty frame may still overlap others, as far as
+        // InputWindowInfo::overlaps goes, so it's checked against all of them
+        area = grid.bounds;
+    } else if (!grid.bounds.intersect(frame, &area)) {
+        return false;
+    }
+
+    int32_t left, top, right, bottom;
+    grid.getCells(area, &left, &top, &right, &bottom);
+    for (int32_t row = top; row < bottom; row++) {
+        for (int32_t column = left; column < right; column++) {
+            const Vector<size_t>& windows(grid.obscuringCells[row * GRID_SIZE + column]);
+            for (size_t i = 0; i < windows.size() && windows[i] < before; i++) {
+                if (overlaps(mFrames[windows[i]], frame)) {
+                    return true;
+                }
+            }
+        }
+    }
+    return false;
+}
+
+const Vector<size_t>& InputWindowIndex::getOutsideTouchWatchers(
+        int32_t displayId) const {
+    const ssize_t gridIndex = mGrids.indexOfKey(displayId);
+    return gridIndex < 0 ? mEmpty : mGrids.valueAt(size_t(gridIndex)).outsideTouchWatchers;
+}
+
+} // namespace android
@@ -0,0 +1,146 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef _UI_INPUT_WINDOW_INDEX_H
+#define _UI_INPUT_WINDOW_INDEX_H
+
+#include <ui/Rect.h>
+#include <utils/KeyedVector.h>
+#include <utils/RefBase.h>
+#include <utils/Vector.h>
+
+#include "InputWindow.h"
+
+namespace android {
+
+/*
+ * A spatial index of the input windows, so that the dispatcher can find the
+ * window touched at a point, and the windows obscuring it, without scanning
+ * every window.
+ *
+ * Windows are referred to by their position in the list the index was built
+ * from, which is front to back, so that a lower position means closer to the
+ * front. Each display is split in a grid of GRID_SIZE x GRID_SIZE cells over
+ * the bounds of its windows, and each cell lists, front to back, the windows
+ * whose touchable region and frame cover it. A query then only looks at the
+ * windows of the cell its point falls in.
+ *
+ * The index is a snapshot of the window infos: it must be rebuilt whenever
+ * they are updated, which the dispatcher does in setInputWindows. It keeps
+ * its own copy of the geometry, flags and state of the windows, one array per
+ * field, which queries read rather than going through each window handle to
+ * its info, so that walking a cell touches few cache lines.
+ */
+class InputWindowIndex {
+public:
+    InputWindowIndex();
+
+    // Rebuilds the index from the windows handles, front to back, whose info
+    // must be up to date
+    void rebuild(const Vector<sp<InputWindowHandle> >& windowHandles);
+
+    // Likewise, but only if the windows or the parts of their infos that the
+    // index depends on changed since it was built, which during animations is
+    // seldom the case. Returns whether it was rebuilt.
+    bool update(const Vector<sp<InputWindowHandle> >& windowHandles);
+
+    // Returns the position of the window handle, or -1 if it wasn't indexed
+    ssize_t indexOf(const sp<InputWindowHandle>& windowHandle) const;
+
+    // Returns the position of the front most window of the display that
+    // takes a touch at (x, y): a visible touchable window which is either
+    // touch modal or whose touchable region contains the point. Returns -1
+    // if there is none.
+    ssize_t findTouchedWindowAt(int32_t displayId, int32_t x, int32_t y) const;
+
+    // Returns whether a visible window of the display, in front of the one
+    // at position "before" and that isn't a trusted overlay, has a frame
+    // that contains (x, y)
+    bool isObscuredAtPoint(int32_t displayId, size_t before,
+            int32_t x, int32_t y) const;
+
+    // Likewise, whether such a window's frame overlaps the one of windowInfo
+    bool isObscured(int32_t displayId, size_t before,
+            const InputWindowInfo* windowInfo) const;
+
+    // Returns the positions of the visible windows of the display that
+    // watch touches outside of them, front to back
+    const Vector<size_t>& getOutsideTouchWatchers(int32_t displayId) const;
+
+private:
+    enum { GRID_SIZE = 8 };
+
+    struct Grid {
+        Grid();
+
+        // Bounds of the frames and touchable regions of the display's
+        // windows, which are the bounds of the grid
+        Rect bounds;
+
+        // Visible touchable windows that take touches anywhere
+        Vector<size_t> touchModalWindows;
+        // Visible touchable windows that aren't touch modal, by the bounds
+        // of their touchable region
+        Vector<size_t> touchableCells[GRID_SIZE * GRID_SIZE];
+        // Visible windows that aren't trusted overlays, by frame, and those
+        // of them whose frame is empty
+        Vector<size_t> obscuringCells[GRID_SIZE * GRID_SIZE];
+        Vector<size_t> emptyObscuringWindows;
+
+        Vector<size_t> outsideTouchWatchers;
+
+        // Sets the range of cells that rect covers, clamped to the grid
+        void getCells(const Rect& rect, int32_t* outLeft, int32_t* outTop,
+                int32_t* outRight, int32_t* outBottom) const;
+        // Returns the cell containing (x, y), or -1 if it's outside the grid
+        ssize_t getCell(int32_t x, int32_t y) const;
+        void add(Vector<size_t>* cells, const Rect& rect, size_t index);
+    };
+
+    // Bits of mStates
+    enum {
+        STATE_VISIBLE = 1 << 0,
+        STATE_TRUSTED_OVERLAY = 1 << 1,
+        // The touchable region is the rectangle of its bounds, so it needn't
+        // be looked at to tell whether it contains a point
+        STATE_TOUCHABLE_RECT = 1 << 2,
+    };
+
+    static Rect getFrame(const InputWindowInfo* info);
+    static uint8_t getState(const InputWindowInfo* info);
+    static bool overlaps(const Rect& a, const Rect& b);
+
+    // Whether the snapshot of the window at position i is still the info's
+    bool matches(size_t i, const InputWindowInfo* info) const;
+    bool touchableRegionContainsPoint(size_t i, int32_t x, int32_t y) const;
+
+    Vector<sp<InputWindowHandle> > mWindowHandles;
+
+    // Snapshot of the window infos, by position
+    Vector<Rect> mFrames;
+    Vector<Rect> mTouchableBounds;
+    Vector<int32_t> mLayoutParamsFlags;
+    Vector<int32_t> mDisplayIds;
+    Vector<uint8_t> mStates;
+
+    KeyedVector<const InputWindowHandle*, size_t> mIndexOfHandle;
+    KeyedVector<int32_t, Grid> mGrids;
+    const Vector<size_t> mEmpty;
+};
+
+} // namespace android
+
+#endif // _UI_INPUT_WINDOW_INDEX_H
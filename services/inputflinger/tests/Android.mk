@@ -36,5 +36,21 @@ $(foreach file,$(test_src_files), \
     $(eval include $(BUILD_NATIVE_TEST)) \
 )
 
+# Build the display pipeline benchmark.
+include $(CLEAR_VARS)
+LOCAL_SRC_FILES := DisplayPipelineBenchmark.cpp
+LOCAL_SHARED_LIBRARIES := \
+    libbinder \
+    libcutils \
+    liblog \
+    libutils \
+    libui \
+    libgui \
+    libinput \
+    libinputflinger
+LOCAL_MODULE := DisplayPipelineBenchmark
+LOCAL_MODULE_TAGS := $(module_tags)
+include $(BUILD_NATIVE_TEST)
+
 # Build the manual test programs.
 include $(call all-makefiles-under, $(LOCAL_PATH))
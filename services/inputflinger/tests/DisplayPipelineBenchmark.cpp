@@ -0,0 +1,577 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Display pipeline benchmark: a touch drag is injected through an
+ * InputDispatcher, one move per vsync, into the input channel of a window
+ * backed by a SurfaceFlinger surface. Each batch of moves received is drawn
+ * into the surface with the newest event time as the buffer timestamp, and
+ * the layer's frame stats tell when each of these frames was presented.
+ *
+ * Reports the time from a move to its dispatch, to its frame being posted
+ * and to its frame being presented, the intervals between presents, and
+ * last, the input-to-present p90 that release gating compares.
+ *
+ * The dispatcher runs in this process, so the window manager and the rest
+ * of the system's input pipeline, other than the dispatcher itself, aren't
+ * part of what's measured.
+ *
+ * usage: DisplayPipelineBenchmark [-n frames] [-s size]
+ */
+
+// This is needed for stdint.h to define INT64_MAX in C++
+#define __STDC_LIMIT_MACROS
+
+#include <errno.h>
+#include <math.h>
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <binder/ProcessState.h>
+
+#include <gui/DisplayEventReceiver.h>
+#include <gui/ISurfaceComposer.h>
+#include <gui/Surface.h>
+#include <gui/SurfaceComposerClient.h>
+#include <gui/SurfaceControl.h>
+
+#include <input/InputTransport.h>
+
+#include <ui/DisplayInfo.h>
+#include <ui/FrameStats.h>
+#include <ui/PixelFormat.h>
+
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include "../InputDispatcher.h"
+
+using namespace android;
+
+// Frames per round; the layer's frame stats only keep the last 127 frames
+static const size_t ROUND_FRAMES = 100;
+
+// Moves injected and drawn before measuring, while buffers get allocated
+static const size_t WARMUP_FRAMES = 30;
+
+// How long presents are waited for at the end of a round
+static const nsecs_t PRESENT_WAIT = ms2ns(200);
+
+static const int POLL_TIMEOUT_MS = 1000;
+
+// ---------------------------------------------------------------------------
+
+struct Results {
+    std::vector<nsecs_t> samples;
+
+    void add(nsecs_t t) { samples.push_back(t); }
+
+    nsecs_t percentile(size_t p) const {
+        if (samples.empty()) return 0;
+        return samples[std::min(samples.size() - 1, samples.size() * p / 100)];
+    }
+
+    void print(const char* name) {
+        std::sort(samples.begin(), samples.end());
+        nsecs_t total = 0;
+        for (size_t i = 0; i < samples.size(); i++) {
+            total += samples[i];
+        }
+        printf("%-24s n=%-6zu avg=%7.2fms p50=%7.2fms p90=%7.2fms "
+                "p99=%7.2fms max=%7.2fms\n",
+                name, samples.size(),
+                samples.empty() ? 0.0 : total / 1e6 / samples.size(),
+                percentile(50) / 1e6, percentile(90) / 1e6,
+                percentile(99) / 1e6,
+                samples.empty() ? 0.0 : samples.back() / 1e6);
+        fflush(stdout);
+    }
+};
+
+// ---------------------------------------------------------------------------
+
+// Lets every injected event through to the benchmark's window
+class BenchDispatcherPolicy : public InputDispatcherPolicyInterface {
+    InputDispatcherConfiguration mConfig;
+
+protected:
+    virtual ~BenchDispatcherPolicy() {}
+
+private:
+    virtual void notifyConfigurationChanged(nsecs_t) {}
+
+    virtual nsecs_t notifyANR(const sp<InputApplicationHandle>&,
+            const sp<InputWindowHandle>&, const String8& reason) {
+        printf("dispatcher reported an ANR: %s\n", reason.string());
+        return 0;
+    }
+
+    virtual void notifyInputChannelBroken(const sp<InputWindowHandle>&) {}
+
+    virtual void getDispatcherConfiguration(
+            InputDispatcherConfiguration* outConfig) {
+        *outConfig = mConfig;
+    }
+
+    virtual bool filterInputEvent(const InputEvent*, uint32_t) {
+        return true;
+    }
+
+    virtual void interceptKeyBeforeQueueing(const KeyEvent*, uint32_t&) {}
+
+    virtual void interceptMotionBeforeQueueing(nsecs_t, uint32_t&) {}
+
+    virtual nsecs_t interceptKeyBeforeDispatching(
+            const sp<InputWindowHandle>&, const KeyEvent*, uint32_t) {
+        return 0;
+    }
+
+    virtual bool dispatchUnhandledKey(const sp<InputWindowHandle>&,
+            const KeyEvent*, uint32_t, KeyEvent*) {
+        return false;
+    }
+
+    virtual void notifySwitch(nsecs_t, uint32_t, uint32_t, uint32_t) {}
+
+    virtual void pokeUserActivity(nsecs_t, int32_t) {}
+
+    virtual bool checkInjectEventsPermissionNonReentrant(int32_t, int32_t) {
+        return true;
+    }
+};
+
+class BenchApplicationHandle : public InputApplicationHandle {
+public:
+    virtual bool updateInfo() {
+        if (mInfo == NULL) {
+            mInfo = new InputApplicationInfo();
+        }
+        mInfo->name = String8("DisplayPipelineBenchmark");
+        mInfo->dispatchingTimeout = s2ns(5);
+        return true;
+    }
+};
+
+// A focused, touchable window over the benchmark's surface
+class BenchWindowHandle : public InputWindowHandle {
+public:
+    BenchWindowHandle(const sp<InputApplicationHandle>& application,
+            const sp<InputChannel>& channel, uint32_t size) :
+            InputWindowHandle(application), mChannel(channel), mSize(size) {}
+
+    virtual bool updateInfo() {
+        if (mInfo == NULL) {
+            mInfo = new InputWindowInfo();
+        }
+        mInfo->inputChannel = mChannel;
+        mInfo->name = String8("DisplayPipelineBenchmark");
+        mInfo->layoutParamsFlags = 0;
+        mInfo->layoutParamsType = InputWindowInfo::TYPE_APPLICATION;
+        mInfo->dispatchingTimeout = s2ns(5);
+        mInfo->frameLeft = 0;
+        mInfo->frameTop = 0;
+        mInfo->frameRight = mSize;
+        mInfo->frameBottom = mSize;
+        mInfo->scaleFactor = 1.0f;
+        mInfo->touchableRegion.clear();
+        mInfo->addTouchableRegion(Rect(mSize, mSize));
+        mInfo->visible = true;
+        mInfo->canReceiveKeys = true;
+        mInfo->hasFocus = true;
+        mInfo->hasWallpaper = false;
+        mInfo->paused = false;
+        mInfo->layer = 1;
+        mInfo->ownerPid = getpid();
+        mInfo->ownerUid = getuid();
+        mInfo->inputFeatures = 0;
+        mInfo->displayId = ISurfaceComposer::eDisplayIdMain;
+        return true;
+    }
+
+private:
+    const sp<InputChannel> mChannel;
+    const uint32_t mSize;
+};
+
+// ---------------------------------------------------------------------------
+
+// What's known of a frame before SurfaceFlinger presents it
+struct FrameSample {
+    // The newest move it draws, which is also its buffer timestamp
+    nsecs_t eventTime;
+    nsecs_t receiveTime;
+    nsecs_t postTime;
+};
+
+static bool operator<(const FrameSample& sample, nsecs_t eventTime) {
+    return sample.eventTime < eventTime;
+}
+
+class Pipeline {
+public:
+    Pipeline(uint32_t size) :
+            mSize(size), mConsumer(NULL), mDownTime(0), mShade(0) {}
+
+    bool init();
+    void finish();
+
+    // Injects count moves, one per vsync, and draws what the window
+    // receives; the frames drawn go in samples when it's set
+    bool run(size_t count, std::vector<FrameSample>* samples);
+
+    const sp<SurfaceControl>& getSurfaceControl() const { return mControl; }
+
+private:
+    bool injectMotion(int32_t action, nsecs_t eventTime);
+    bool waitForVsync();
+    bool receiveAndDraw(std::vector<FrameSample>* samples);
+
+    const uint32_t mSize;
+    sp<SurfaceComposerClient> mComposer;
+    sp<SurfaceControl> mControl;
+    sp<Surface> mSurface;
+    sp<InputDispatcher> mDispatcher;
+    sp<InputDispatcherThread> mDispatcherThread;
+    sp<InputChannel> mServerChannel;
+    sp<InputChannel> mClientChannel;
+    InputConsumer* mConsumer;
+    PreallocatedInputEventFactory mEventFactory;
+    DisplayEventReceiver mVsyncReceiver;
+    nsecs_t mDownTime;
+    uint8_t mShade;
+};
+
+bool Pipeline::init() {
+    mComposer = new SurfaceComposerClient();
+    if (mComposer->initCheck() != NO_ERROR) {
+        printf("couldn't connect to SurfaceFlinger\n");
+        return false;
+    }
+    mControl = mComposer->createSurface(String8("DisplayPipelineBenchmark"),
+            mSize, mSize, PIXEL_FORMAT_RGBX_8888);
+    if (mControl == NULL || !mControl->isValid()) {
+        printf("couldn't create a %ux%u surface\n", mSize, mSize);
+        return false;
+    }
+    SurfaceComposerClient::openGlobalTransaction();
+    mControl->setLayer(0x7fffffff);
+    mControl->setPosition(0, 0);
+    mControl->show();
+    SurfaceComposerClient::closeGlobalTransaction(true);
+    mSurface = mControl->getSurface();
+
+    if (mVsyncReceiver.initCheck() != NO_ERROR) {
+        printf("couldn't receive vsync events\n");
+        return false;
+    }
+    mVsyncReceiver.setVsyncRate(1);
+
+    status_t err = InputChannel::openInputChannelPair(
+            String8("DisplayPipelineBenchmark"), mServerChannel,
+            mClientChannel);
+    if (err != NO_ERROR) {
+        printf("couldn't open an input channel pair (%d)\n", err);
+        return false;
+    }
+    mConsumer = new InputConsumer(mClientChannel);
+
+    sp<InputApplicationHandle> application = new BenchApplicationHandle();
+    sp<InputWindowHandle> window = new BenchWindowHandle(application,
+            mServerChannel, mSize);
+    Vector<sp<InputWindowHandle> > windows;
+    windows.add(window);
+
+    mDispatcher = new InputDispatcher(new BenchDispatcherPolicy());
+    mDispatcher->registerInputChannel(mServerChannel, window, false);
+    mDispatcher->setInputWindows(windows);
+    mDispatcher->setFocusedApplication(application);
+    mDispatcher->setInputDispatchMode(true, false);
+    mDispatcherThread = new InputDispatcherThread(mDispatcher);
+    mDispatcherThread->run("InputDispatcher", PRIORITY_URGENT_DISPLAY);
+
+    mDownTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    return injectMotion(AMOTION_EVENT_ACTION_DOWN, mDownTime);
+}
+
+void Pipeline::finish() {
+    if (mDispatcherThread != NULL) {
+        // The up event wakes the dispatcher thread up, so that it exits
+        mDispatcherThread->requestExit();
+        injectMotion(AMOTION_EVENT_ACTION_UP, systemTime(SYSTEM_TIME_MONOTONIC));
+        mDispatcherThread->requestExitAndWait();
+        mDispatcher->unregisterInputChannel(mServerChannel);
+    }
+    delete mConsumer;
+    mConsumer = NULL;
+    mSurface.clear();
+    mControl.clear();
+    mComposer->dispose();
+}
+
+bool Pipeline::injectMotion(int32_t action, nsecs_t eventTime) {
+    // a slow diagonal drag across the window
+    const float position = (eventTime - mDownTime) / 1e6f * 0.05f;
+    PointerProperties properties;
+    properties.clear();
+    properties.id = 0;
+    properties.toolType = AMOTION_EVENT_TOOL_TYPE_FINGER;
+    PointerCoords coords;
+    coords.clear();
+    coords.setAxisValue(AMOTION_EVENT_AXIS_X, fmodf(position, mSize));
+    coords.setAxisValue(AMOTION_EVENT_AXIS_Y, fmodf(position, mSize));
+
+    MotionEvent event;
+    event.initialize(0, AINPUT_SOURCE_TOUCHSCREEN, action, 0, 0, 0,
+            AMETA_NONE, 0, 0, 0, 1.0f, 1.0f, mDownTime, eventTime, 1,
+            &properties, &coords);
+    // the policy has nothing to add, so it's skipped
+    int32_t result = mDispatcher->injectInputEvent(&event,
+            ISurfaceComposer::eDisplayIdMain, getpid(), getuid(),
+            INPUT_EVENT_INJECTION_SYNC_NONE, POLL_TIMEOUT_MS,
+            POLICY_FLAG_FILTERED | POLICY_FLAG_PASS_TO_USER);
+    if (result != INPUT_EVENT_INJECTION_SUCCEEDED) {
+        printf("couldn't inject a motion event (%d)\n", result);
+        return false;
+    }
+    return true;
+}
+
+bool Pipeline::waitForVsync() {
+    DisplayEventReceiver::Event buffer[8];
+    ssize_t n;
+    bool vsync = false;
+    while ((n = mVsyncReceiver.getEvents(buffer, 8)) > 0) {
+        for (ssize_t i = 0; i < n; i++) {
+            if (buffer[i].header.type ==
+                    DisplayEventReceiver::DISPLAY_EVENT_VSYNC) {
+                vsync = true;
+            }
+        }
+    }
+    return vsync;
+}
+
+bool Pipeline::receiveAndDraw(std::vector<FrameSample>* samples) {
+    const nsecs_t receiveTime = systemTime(SYSTEM_TIME_MONOTONIC);
+    nsecs_t eventTime = -1;
+    for (;;) {
+        uint32_t seq;
+        InputEvent* event;
+        status_t err = mConsumer->consume(&mEventFactory, true, -1, &seq,
+                &event);
+        if (err == WOULD_BLOCK) {
+            break;
+        }
+        if (err != OK) {
+            printf("couldn't consume an input event (%d)\n", err);
+            return false;
+        }
+        if (event->getType() == AINPUT_EVENT_TYPE_MOTION &&
+                static_cast<MotionEvent*>(event)->getAction() ==
+                AMOTION_EVENT_ACTION_MOVE) {
+            eventTime = static_cast<MotionEvent*>(event)->getEventTime();
+        }
+        mConsumer->sendFinishedSignal(seq, true);
+    }
+    if (eventTime < 0) {
+        return true;
+    }
+
+    // what an app would do: draw the newest position and post the frame
+    ANativeWindow_Buffer buffer;
+    if (mSurface->lock(&buffer, NULL) != NO_ERROR) {
+        printf("couldn't lock the surface\n");
+        return false;
+    }
+    memset(buffer.bits, mShade++, buffer.stride * buffer.height *
+            bytesPerPixel(buffer.format));
+    native_window_set_buffers_timestamp(mSurface.get(), eventTime);
+    mSurface->unlockAndPost();
+    if (samples != NULL) {
+        FrameSample sample;
+        sample.eventTime = eventTime;
+        sample.receiveTime = receiveTime;
+        sample.postTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        samples->push_back(sample);
+    }
+    return true;
+}
+
+bool Pipeline::run(size_t count, std::vector<FrameSample>* samples) {
+    struct pollfd fds[2];
+    fds[0].fd = mVsyncReceiver.getFd();
+    fds[0].events = POLLIN;
+    fds[1].fd = mClientChannel->getFd();
+    fds[1].events = POLLIN;
+
+    size_t injected = 0;
+    while (injected < count) {
+        int n = poll(fds, 2, POLL_TIMEOUT_MS);
+        if (n < 0 && errno == EINTR) {
+            continue;
+        } else if (n < 0) {
+            printf("poll failed, %s\n", strerror(errno));
+            return false;
+        } else if (n == 0) {
+            printf("timed out waiting for vsync or input\n");
+            return false;
+        }
+        if ((fds[0].revents & POLLIN) && waitForVsync()) {
+            if (!injectMotion(AMOTION_EVENT_ACTION_MOVE,
+                    systemTime(SYSTEM_TIME_MONOTONIC))) {
+                return false;
+            }
+            injected++;
+        }
+        if ((fds[1].revents & POLLIN) && !receiveAndDraw(samples)) {
+            return false;
+        }
+    }
+
+    // draw the last moves, then leave the frames time to be presented
+    const nsecs_t endTime = systemTime(SYSTEM_TIME_MONOTONIC) + PRESENT_WAIT;
+    for (;;) {
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (now >= endTime) {
+            break;
+        }
+        int n = poll(&fds[1], 1, int(ns2ms(endTime - now)) + 1);
+        if (n > 0 && !receiveAndDraw(samples)) {
+            return false;
+        }
+    }
+    waitForVsync();
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+
+struct PipelineResults {
+    Results dispatch;
+    Results post;
+    Results present;
+    Results presentInterval;
+    size_t frames;
+    size_t presented;
+    size_t janky;
+
+    PipelineResults() : frames(0), presented(0), janky(0) {}
+
+    // Matches the frames drawn in a round to the layer's frame stats
+    void addRound(const std::vector<FrameSample>& samples,
+            const FrameStats& stats) {
+        frames += samples.size();
+        nsecs_t lastPresent = -1;
+        for (size_t i = 0; i < stats.desiredPresentTimesNano.size(); i++) {
+            const nsecs_t desired = stats.desiredPresentTimesNano[i];
+            const nsecs_t actual = stats.actualPresentTimesNano[i];
+            std::vector<FrameSample>::const_iterator sample = std::lower_bound(
+                    samples.begin(), samples.end(), desired);
+            if (sample == samples.end() || sample->eventTime != desired ||
+                    actual <= 0 || actual == INT64_MAX) {
+                continue;
+            }
+            presented++;
+            dispatch.add(sample->receiveTime - sample->eventTime);
+            post.add(sample->postTime - sample->eventTime);
+            present.add(actual - sample->eventTime);
+            if (lastPresent > 0) {
+                presentInterval.add(actual - lastPresent);
+                if (actual - lastPresent > stats.refreshPeriodNano * 3 / 2) {
+                    janky++;
+                }
+            }
+            lastPresent = actual;
+        }
+    }
+
+    void print() {
+        dispatch.print("input to dispatch");
+        post.print("input to post");
+        present.print("input to present");
+        presentInterval.print("present interval");
+        printf("%zu frames drawn, %zu presented, %zu presented more than "
+                "1.5 refresh periods after the previous one\n",
+                frames, presented, janky);
+        printf("input-to-present p90: %.2f ms\n",
+                present.percentile(90) / 1e6);
+        fflush(stdout);
+    }
+};
+
+int main(int argc, char** argv)
+{
+    size_t frames = 600;
+    uint32_t size = 256;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "n:s:")) != -1) {
+        switch (opt) {
+            case 'n':
+                frames = strtoul(optarg, NULL, 0);
+                break;
+            case 's':
+                size = static_cast<uint32_t>(strtoul(optarg, NULL, 0));
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-n frames] [-s size]\n",
+                        argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+    if (size == 0) {
+        size = 1;
+    }
+
+    ProcessState::self()->startThreadPool();
+
+    DisplayInfo info;
+    sp<IBinder> display = SurfaceComposerClient::getBuiltInDisplay(
+            ISurfaceComposer::eDisplayIdMain);
+    if (SurfaceComposerClient::getDisplayInfo(display, &info) == NO_ERROR) {
+        size = std::min(size, std::min(info.w, info.h));
+        printf("DisplayPipelineBenchmark: %zu frames, %ux%u surface, "
+                "%.2f Hz display\n", frames, size, size, info.fps);
+    }
+
+    Pipeline pipeline(size);
+    PipelineResults results;
+    bool ok = pipeline.init() && pipeline.run(WARMUP_FRAMES, NULL);
+    for (size_t done = 0; ok && done < frames; done += ROUND_FRAMES) {
+        std::vector<FrameSample> samples;
+        pipeline.getSurfaceControl()->clearLayerFrameStats();
+        ok = pipeline.run(std::min(ROUND_FRAMES, frames - done), &samples);
+        FrameStats stats;
+        if (ok && pipeline.getSurfaceControl()->getLayerFrameStats(&stats)
+                != NO_ERROR) {
+            printf("couldn't get the layer's frame stats\n");
+            ok = false;
+        }
+        if (ok) {
+            results.addRound(samples, stats);
+        }
+    }
+    pipeline.finish();
+
+    results.print();
+    return ok && results.presented > 0 ? EXIT_SUCCESS : EXIT_FAILURE;
+}
@@ -19,6 +19,8 @@
 #include <utils/List.h>
 #include <gtest/gtest.h>
 #include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
 
 namespace android {
 
@@ -275,6 +277,14 @@ public:
                 << "Expected notifyMotion() to not have been called.";
     }
 
+    void clear() {
+        mNotifyConfigurationChangedArgsQueue.clear();
+        mNotifyDeviceResetArgsQueue.clear();
+        mNotifyKeyArgsQueue.clear();
+        mNotifyMotionArgsQueue.clear();
+        mNotifySwitchArgsQueue.clear();
+    }
+
     void assertNotifySwitchWasCalled(NotifySwitchArgs* outEventArgs = NULL) {
         ASSERT_FALSE(mNotifySwitchArgsQueue.empty())
                 << "Expected notifySwitch() to have been called.";
@@ -5159,4 +5169,258 @@ TEST_F(MultiTouchInputMapperTest, Process_WhenAbsMTPressureIsPresent_HoversIfIts
 }
 
 
+// --- InputMapper benchmarks ---
+
+// These replay streams of raw events through a mapper and print what it costs per event and
+// per frame, a frame being the events up to a SYN_REPORT. They are disabled by default; run
+// them with --gtest_also_run_disabled_tests --gtest_filter=*Benchmark*.
+//
+// Each benchmark synthesizes its stream, which can be replaced by one recorded with
+// "getevent -t" of a device of the same kind, given by an environment variable, such as
+// INPUT_REPLAY_MULTI_TOUCH=/data/local/tmp/touch.txt.
+
+static const size_t BENCHMARK_ITERATIONS = 200;
+
+static void addRawEvent(Vector<RawEvent>& events, nsecs_t when, int32_t type, int32_t code,
+        int32_t value) {
+    RawEvent event;
+    event.when = when;
+    event.deviceId = 0; // set to the mapper's as it's replayed
+    event.type = type;
+    event.code = code;
+    event.value = value;
+    events.push(event);
+}
+
+// Reads the getevent -t output of the file the variable names, if it's set, whose lines are
+// like "[    4518.386354] /dev/input/event1: 0003 0035 000001ab".
+static bool loadRecordedEvents(const char* variable, Vector<RawEvent>* outEvents) {
+    const char* path = getenv(variable);
+    if (!path) {
+        return false;
+    }
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        ADD_FAILURE() << "Could not open " << path;
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        unsigned long seconds, micros;
+        unsigned int type, code, value;
+        if (sscanf(line, "[ %lu.%lu] %*[^:]: %x %x %x",
+                &seconds, &micros, &type, &code, &value) == 5) {
+            addRawEvent(*outEvents, seconds * 1000000000LL + micros * 1000LL,
+                    int32_t(type), int32_t(code), int32_t(value));
+        }
+    }
+    fclose(file);
+    printf("Replaying %zu events from %s\n", outEvents->size(), path);
+    return !outEvents->isEmpty();
+}
+
+static void benchmarkMapper(const char* name, InputMapper* mapper,
+        const sp<FakeInputListener>& listener, const Vector<RawEvent>& events) {
+    ASSERT_FALSE(events.isEmpty());
+
+    // Each iteration replays the stream after the previous one, so that time goes forward
+    const nsecs_t duration = events[events.size() - 1].when - events[0].when + 1000000;
+    size_t numFrames = 0;
+    nsecs_t elapsed = 0;
+    for (size_t i = 0; i < BENCHMARK_ITERATIONS; i++) {
+        const nsecs_t offset = nsecs_t(i) * duration;
+        const nsecs_t start = systemTime(SYSTEM_TIME_THREAD);
+        for (size_t j = 0; j < events.size(); j++) {
+            RawEvent event = events[j];
+            event.when += offset;
+            event.deviceId = mapper->getDeviceId();
+            mapper->process(&event);
+            if (event.type == EV_SYN && event.code == SYN_REPORT) {
+                numFrames++;
+            }
+        }
+        elapsed += systemTime(SYSTEM_TIME_THREAD) - start;
+        listener->clear();
+    }
+
+    const size_t numEvents = events.size() * BENCHMARK_ITERATIONS;
+    printf("%s: %zu events, %zu frames, %.0fns per event, %.0fns per frame\n", name,
+            numEvents, numFrames, double(elapsed) / numEvents,
+            numFrames ? double(elapsed) / numFrames : 0.0);
+}
+
+TEST_F(MultiTouchInputMapperTest, DISABLED_Benchmark_TenFingers) {
+    MultiTouchInputMapper* mapper = new MultiTouchInputMapper(mDevice);
+    addConfigurationProperty("touch.deviceType", "touchScreen");
+    prepareDisplay(DISPLAY_ORIENTATION_0);
+    prepareAxes(POSITION | TOUCH | PRESSURE | ID | SLOT);
+    addMapperAndConfigure(mapper);
+
+    // Ten fingers moving together for a second, at 120Hz
+    Vector<RawEvent> events;
+    if (!loadRecordedEvents("INPUT_REPLAY_MULTI_TOUCH", &events)) {
+        static const size_t NUM_FRAMES = 120;
+        static const nsecs_t PERIOD = 8333333;
+        for (size_t frame = 0; frame <= NUM_FRAMES; frame++) {
+            const nsecs_t when = ARBITRARY_TIME + frame * PERIOD;
+            for (int32_t slot = RAW_SLOT_MIN; slot <= RAW_SLOT_MAX; slot++) {
+                addRawEvent(events, when, EV_ABS, ABS_MT_SLOT, slot);
+                if (frame == NUM_FRAMES) {
+                    addRawEvent(events, when, EV_ABS, ABS_MT_TRACKING_ID, -1);
+                    continue;
+                }
+                if (frame == 0) {
+                    addRawEvent(events, when, EV_ABS, ABS_MT_TRACKING_ID, slot);
+                }
+                addRawEvent(events, when, EV_ABS, ABS_MT_POSITION_X,
+                        RAW_X_MIN + 90 * slot + frame % 80);
+                addRawEvent(events, when, EV_ABS, ABS_MT_POSITION_Y,
+                        RAW_Y_MIN + 100 + 6 * frame);
+                addRawEvent(events, when, EV_ABS, ABS_MT_TOUCH_MAJOR, RAW_TOUCH_MAX / 2);
+                addRawEvent(events, when, EV_ABS, ABS_MT_PRESSURE, RAW_PRESSURE_MAX / 2);
+            }
+            addRawEvent(events, when, EV_SYN, SYN_REPORT, 0);
+        }
+    }
+
+    benchmarkMapper("multi-touch", mapper, mFakeListener, events);
+}
+
+TEST_F(SingleTouchInputMapperTest, DISABLED_Benchmark_Stylus) {
+    SingleTouchInputMapper* mapper = new SingleTouchInputMapper(mDevice);
+    addConfigurationProperty("touch.deviceType", "touchScreen");
+    prepareDisplay(DISPLAY_ORIENTATION_0);
+    prepareButtons();
+    prepareAxes(POSITION | PRESSURE | DISTANCE | TILT);
+    mFakeEventHub->addKey(DEVICE_ID, BTN_TOOL_PEN, 0, AKEYCODE_UNKNOWN, 0);
+    addMapperAndConfigure(mapper);
+
+    // A pen hovering in, then drawing a stroke, at 240Hz
+    Vector<RawEvent> events;
+    if (!loadRecordedEvents("INPUT_REPLAY_STYLUS", &events)) {
+        static const size_t NUM_FRAMES = 240;
+        static const nsecs_t PERIOD = 4166667;
+        nsecs_t when = ARBITRARY_TIME;
+        addRawEvent(events, when, EV_KEY, BTN_TOOL_PEN, 1);
+        for (size_t frame = 0; frame < NUM_FRAMES; frame++, when += PERIOD) {
+            const bool touching = frame >= 20 && frame < NUM_FRAMES - 20;
+            if (frame == 20 || frame == NUM_FRAMES - 20) {
+                addRawEvent(events, when, EV_KEY, BTN_TOUCH, touching);
+            }
+            addRawEvent(events, when, EV_ABS, ABS_X, RAW_X_MIN + 3 * frame);
+            addRawEvent(events, when, EV_ABS, ABS_Y, RAW_Y_MIN + 2 * frame);
+            addRawEvent(events, when, EV_ABS, ABS_PRESSURE,
+                    touching ? RAW_PRESSURE_MAX / 2 + frame % 8 : 0);
+            addRawEvent(events, when, EV_ABS, ABS_DISTANCE, touching ? 0 : RAW_DISTANCE_MAX);
+            addRawEvent(events, when, EV_ABS, ABS_TILT_X, RAW_TILT_MIN + frame % 60);
+            addRawEvent(events, when, EV_ABS, ABS_TILT_Y, RAW_TILT_MAX - frame % 60);
+            addRawEvent(events, when, EV_SYN, SYN_REPORT, 0);
+        }
+        addRawEvent(events, when, EV_KEY, BTN_TOOL_PEN, 0);
+        addRawEvent(events, when, EV_SYN, SYN_REPORT, 0);
+    }
+
+    benchmarkMapper("stylus", mapper, mFakeListener, events);
+}
+
+TEST_F(CursorInputMapperTest, DISABLED_Benchmark_Mouse) {
+    CursorInputMapper* mapper = new CursorInputMapper(mDevice);
+    addConfigurationProperty("cursor.mode", "pointer");
+    addMapperAndConfigure(mapper);
+
+    // A mouse moving at 125Hz, with a click now and then
+    Vector<RawEvent> events;
+    if (!loadRecordedEvents("INPUT_REPLAY_MOUSE", &events)) {
+        static const size_t NUM_FRAMES = 250;
+        static const nsecs_t PERIOD = 8000000;
+        for (size_t frame = 0; frame < NUM_FRAMES; frame++) {
+            const nsecs_t when = ARBITRARY_TIME + frame * PERIOD;
+            addRawEvent(events, when, EV_REL, REL_X, int32_t(frame % 7) - 3);
+            addRawEvent(events, when, EV_REL, REL_Y, int32_t(frame % 5) - 2);
+            if (frame % 50 == 10 || frame % 50 == 20) {
+                addRawEvent(events, when, EV_KEY, BTN_LEFT, frame % 50 == 10);
+            }
+            addRawEvent(events, when, EV_SYN, SYN_REPORT, 0);
+        }
+    }
+
+    benchmarkMapper("mouse", mapper, mFakeListener, events);
+}
+
+TEST_F(InputMapperTest, Joystick_LimitsReportRate) {
+    // The joystick mapper only takes the axes of joystick devices
+    InputDeviceIdentifier identifier;
+    identifier.name = DEVICE_NAME;
+    InputDevice device(mFakeContext, DEVICE_ID, DEVICE_GENERATION, DEVICE_CONTROLLER_NUMBER,
+            identifier, INPUT_DEVICE_CLASS_JOYSTICK | INPUT_DEVICE_CLASS_GAMEPAD);
+    JoystickInputMapper* mapper = new JoystickInputMapper(&device);
+    mFakeEventHub->addAbsoluteAxis(DEVICE_ID, ABS_X, 0, 255, 0, 0);
+    addConfigurationProperty("joystick.maxReportRate", "100");
+    device.addMapper(mapper);
+    device.configure(ARBITRARY_TIME, mFakePolicy->getReaderConfiguration(), 0);
+    device.reset(ARBITRARY_TIME);
+
+    // The first change is reported right away.
+    NotifyMotionArgs args;
+    process(mapper, ARBITRARY_TIME, DEVICE_ID, EV_ABS, ABS_X, 255);
+    process(mapper, ARBITRARY_TIME, DEVICE_ID, EV_SYN, SYN_REPORT, 0);
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasCalled(&args));
+    ASSERT_NEAR(1.0f, args.pointerCoords[0].getAxisValue(AMOTION_EVENT_AXIS_GENERIC_1),
+            EPSILON);
+
+    // The next ones, within 10ms, are held back.
+    process(mapper, ARBITRARY_TIME + 2000000, DEVICE_ID, EV_ABS, ABS_X, 128);
+    process(mapper, ARBITRARY_TIME + 2000000, DEVICE_ID, EV_SYN, SYN_REPORT, 0);
+    process(mapper, ARBITRARY_TIME + 4000000, DEVICE_ID, EV_ABS, ABS_X, 0);
+    process(mapper, ARBITRARY_TIME + 4000000, DEVICE_ID, EV_SYN, SYN_REPORT, 0);
+    mapper->timeoutExpired(ARBITRARY_TIME + 6000000);
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasNotCalled());
+
+    // Until the timeout, which reports the latest values only.
+    mapper->timeoutExpired(ARBITRARY_TIME + 10000000);
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasCalled(&args));
+    ASSERT_EQ(ARBITRARY_TIME + 4000000, args.eventTime);
+    ASSERT_NEAR(0.0f, args.pointerCoords[0].getAxisValue(AMOTION_EVENT_AXIS_GENERIC_1),
+            EPSILON);
+    mapper->timeoutExpired(ARBITRARY_TIME + 20000000);
+    ASSERT_NO_FATAL_FAILURE(mFakeListener->assertNotifyMotionWasNotCalled());
+}
+
+TEST_F(InputMapperTest, DISABLED_Benchmark_Gamepad) {
+    // The joystick mapper only takes the axes of joystick devices
+    InputDeviceIdentifier identifier;
+    identifier.name = DEVICE_NAME;
+    InputDevice device(mFakeContext, DEVICE_ID, DEVICE_GENERATION, DEVICE_CONTROLLER_NUMBER,
+            identifier, INPUT_DEVICE_CLASS_JOYSTICK | INPUT_DEVICE_CLASS_GAMEPAD);
+    JoystickInputMapper* mapper = new JoystickInputMapper(&device);
+    static const int32_t AXES[] = { ABS_X, ABS_Y, ABS_Z, ABS_RZ, ABS_GAS, ABS_BRAKE };
+    for (size_t i = 0; i < sizeof(AXES) / sizeof(AXES[0]); i++) {
+        mFakeEventHub->addAbsoluteAxis(DEVICE_ID, AXES[i], 0, 255, 15, 0);
+    }
+    mFakeEventHub->addAbsoluteAxis(DEVICE_ID, ABS_HAT0X, -1, 1, 0, 0);
+    mFakeEventHub->addAbsoluteAxis(DEVICE_ID, ABS_HAT0Y, -1, 1, 0, 0);
+    device.addMapper(mapper);
+    device.configure(ARBITRARY_TIME, mFakePolicy->getReaderConfiguration(), 0);
+    device.reset(ARBITRARY_TIME);
+
+    // Both sticks and triggers moving, at 250Hz
+    Vector<RawEvent> events;
+    if (!loadRecordedEvents("INPUT_REPLAY_GAMEPAD", &events)) {
+        static const size_t NUM_FRAMES = 250;
+        static const nsecs_t PERIOD = 4000000;
+        for (size_t frame = 0; frame < NUM_FRAMES; frame++) {
+            const nsecs_t when = ARBITRARY_TIME + frame * PERIOD;
+            for (size_t i = 0; i < sizeof(AXES) / sizeof(AXES[0]); i++) {
+                addRawEvent(events, when, EV_ABS, AXES[i], int32_t((frame * (i + 1)) % 256));
+            }
+            if (frame % 25 == 0) {
+                addRawEvent(events, when, EV_ABS, ABS_HAT0X, int32_t(frame / 25 % 3) - 1);
+            }
+            addRawEvent(events, when, EV_SYN, SYN_REPORT, 0);
+        }
+    }
+
+    benchmarkMapper("gamepad", mapper, mFakeListener, events);
+}
+
 } // namespace android
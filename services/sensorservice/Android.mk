@@ -10,8 +10,10 @@ LOCAL_SRC_FILES:= \
     OrientationSensor.cpp \
     RotationVectorSensor.cpp \
     SensorDevice.cpp \
+    SensorEventRecorder.cpp \
     SensorFusion.cpp \
     SensorInterface.cpp \
+    SensorLatencyTracker.cpp \
     SensorService.cpp
 
 LOCAL_CFLAGS:= -DLOG_TAG=\"SensorService\"
@@ -111,6 +111,32 @@ static mat<TYPE, R, R> scaleCovariance(
     return APAt;
 }
 
+/*
+ * P = Phi*P*transpose(Phi) + GQGt, in place, for the state transition
+ * matrix of the fusion, whose lower blocks are 0 and I33:
+ *
+ *  Phi = | Phi00 Phi10 |
+ *        |   0     1   |
+ *
+ * The generic product of 6x6 block matrices takes 16 3x3 products and as
+ * many temporaries, most of which are by these 0 and I33 blocks; this
+ * takes 6, and gives the same result.
+ */
+template <typename TYPE>
+static void propagateCovariance(mat<mat<TYPE, 3, 3>, 2, 2>& P,
+        const mat<TYPE, 3, 3>& Phi00, const mat<TYPE, 3, 3>& Phi10,
+        const mat<mat<TYPE, 3, 3>, 2, 2>& GQGt) {
+    // rows of Phi*P; its second row is the one of P
+    const mat<TYPE, 3, 3> A0(Phi00*P[0][0] + Phi10*P[0][1]);
+    const mat<TYPE, 3, 3> A1(Phi00*P[1][0] + Phi10*P[1][1]);
+    const mat<TYPE, 3, 3> Phi00t(transpose(Phi00));
+    const mat<TYPE, 3, 3> Phi10t(transpose(Phi10));
+    P[0][0] = A0*Phi00t + A1*Phi10t + GQGt[0][0];
+    P[0][1] = P[0][1]*Phi00t + P[1][1]*Phi10t + GQGt[0][1];
+    P[1][0] = A1 + GQGt[1][0];
+    P[1][1] += GQGt[1][1];
+}
+
 template <typename TYPE, typename OTHER_TYPE>
 static mat<TYPE, 3, 3> crossMatrix(const vec<TYPE, 3>& p, OTHER_TYPE diag) {
     mat<TYPE, 3, 3> r;
@@ -425,7 +451,7 @@ void Fusion::predict(const vec3_t& w, float dT) {
     if (x0.w < 0)
         x0 = -x0;
 
-    P = Phi*P*transpose(Phi) + GQGt;
+    propagateCovariance(P, Phi[0][0], Phi[1][0], GQGt);
 
     checkState();
 }
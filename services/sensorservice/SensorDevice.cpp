@@ -130,84 +130,171 @@ void SensorDevice::autoDisable(void *ident, int handle) {
     Info& info( mActivationCount.editValueFor(handle) );
     Mutex::Autolock _l(mLock);
     info.removeBatchParamsForIdent(ident);
+    if (info.numActiveClients() == 0) {
+        // One-shot sensors de-activate themselves in h/w.
+        info.activated = false;
+    }
 }
 
 status_t SensorDevice::activate(void* ident, int handle, int enabled)
 {
+    Transaction transaction;
+    transaction.activate(ident, handle, enabled);
+    return apply(transaction);
+}
+
+status_t SensorDevice::batch(void* ident, int handle, int flags, int64_t samplingPeriodNs,
+                             int64_t maxBatchReportLatencyNs) {
+    Transaction transaction;
+    transaction.batch(ident, handle, flags, samplingPeriodNs, maxBatchReportLatencyNs);
+    return apply(transaction);
+}
+
+status_t SensorDevice::apply(const Transaction& transaction) {
     if (!mSensorDevice) return NO_INIT;
     status_t err(NO_ERROR);
-    bool actuateHardware = false;
 
     Mutex::Autolock _l(mLock);
-    Info& info( mActivationCount.editValueFor(handle) );
-
-    ALOGD_IF(DEBUG_CONNECTIONS,
-             "SensorDevice::activate: ident=%p, handle=0x%08x, enabled=%d, count=%zu",
-             ident, handle, enabled, info.batchParams.size());
-
-    if (enabled) {
-        ALOGD_IF(DEBUG_CONNECTIONS, "enable index=%zd", info.batchParams.indexOfKey(ident));
-
-        if (isClientDisabledLocked(ident)) {
-            return INVALID_OPERATION;
+    SortedVector<int> handles;
+    for (size_t i = 0; i < transaction.mRequests.size(); i++) {
+        const int handle = transaction.mRequests[i].handle;
+        if (handles.indexOf(handle) >= 0) continue;
+        handles.add(handle);
+        status_t result = applyLocked(transaction, handle);
+        if (err == NO_ERROR) {
+            err = result;
         }
+    }
+    return err;
+}
 
-        if (info.batchParams.indexOfKey(ident) >= 0) {
-          if (info.numActiveClients() == 1) {
-              // This is the first connection, we need to activate the underlying h/w sensor.
-              actuateHardware = true;
-          }
-        } else {
-            // Log error. Every activate call should be preceded by a batch() call.
-            ALOGE("\t >>>ERROR: activate called without batch");
-        }
-    } else {
-        ALOGD_IF(DEBUG_CONNECTIONS, "disable index=%zd", info.batchParams.indexOfKey(ident));
+status_t SensorDevice::applyLocked(const Transaction& transaction, int handle) {
+    const int halVersion = getHalDeviceVersion();
+    status_t err(NO_ERROR);
+    Info& info( mActivationCount.editValueFor(handle) );
+    BatchParams prevBestBatchParams = info.bestBatchParams;
 
-        if (info.removeBatchParamsForIdent(ident) >= 0) {
-            if (info.numActiveClients() == 0) {
-                // This is the last connection, we need to de-activate the underlying h/w sensor.
-                actuateHardware = true;
+    // First update the batch parameters with all the requests for this sensor. Keep track of the
+    // clients that were batched or enabled, to undo that if the h/w calls below fail.
+    SortedVector<void*> batched;
+    SortedVector<void*> enabled;
+    for (size_t i = 0; i < transaction.mRequests.size(); i++) {
+        const Transaction::Request& request(transaction.mRequests[i]);
+        if (request.handle != handle) continue;
+        void* ident = request.ident;
+
+        if (request.type == Transaction::Request::BATCH) {
+            const BatchParams& params(request.params);
+            ALOGD_IF(DEBUG_CONNECTIONS,
+                     "SensorDevice::batch: ident=%p, handle=0x%08x, flags=%d, period_ns=%" PRId64 " timeout=%" PRId64,
+                     ident, handle, params.flags, params.batchDelay, params.batchTimeout);
+            if (halVersion < SENSORS_DEVICE_API_VERSION_1_1 && params.batchTimeout != 0) {
+                // Batch is not supported on older devices return invalid operation.
+                err = INVALID_OPERATION;
+                continue;
+            }
+            if (info.batchParams.indexOfKey(ident) < 0) {
+                info.batchParams.add(ident, params);
             } else {
-                const int halVersion = getHalDeviceVersion();
-                if (halVersion >= SENSORS_DEVICE_API_VERSION_1_1) {
-                    // Call batch for this sensor with the previously calculated best effort
-                    // batch_rate and timeout. One of the apps has unregistered for sensor
-                    // events, and the best effort batch parameters might have changed.
-                    ALOGD_IF(DEBUG_CONNECTIONS,
-                             "\t>>> actuating h/w batch %d %d %" PRId64 " %" PRId64, handle,
-                             info.bestBatchParams.flags, info.bestBatchParams.batchDelay,
-                             info.bestBatchParams.batchTimeout);
-                    mSensorDevice->batch(mSensorDevice, handle,info.bestBatchParams.flags,
-                                         info.bestBatchParams.batchDelay,
-                                         info.bestBatchParams.batchTimeout);
-                }
+                // A batch has already been called with this ident. Update the batch parameters.
+                info.setBatchParamsForIdent(ident, params.flags, params.batchDelay,
+                                            params.batchTimeout);
             }
+            batched.add(ident);
+        } else if (request.enabled) {
+            ALOGD_IF(DEBUG_CONNECTIONS,
+                     "SensorDevice::activate: ident=%p, handle=0x%08x, enabled=1, index=%zd",
+                     ident, handle, info.batchParams.indexOfKey(ident));
+            if (isClientDisabledLocked(ident)) {
+                err = INVALID_OPERATION;
+                continue;
+            }
+            if (info.batchParams.indexOfKey(ident) < 0) {
+                // Log error. Every activate call should be preceded by a batch() call.
+                ALOGE("\t >>>ERROR: activate called without batch");
+                continue;
+            }
+            enabled.add(ident);
         } else {
-            // sensor wasn't enabled for this ident
+            ALOGD_IF(DEBUG_CONNECTIONS,
+                     "SensorDevice::activate: ident=%p, handle=0x%08x, enabled=0, index=%zd",
+                     ident, handle, info.batchParams.indexOfKey(ident));
+            // If the sensor wasn't enabled for this ident, there's nothing to do.
+            info.batchParams.removeItem(ident);
+            batched.remove(ident);
+            enabled.remove(ident);
         }
+    }
+
+    // Find the minimum of all timeouts and batch_rates for this sensor.
+    info.selectBatchParams();
 
-        if (isClientDisabledLocked(ident)) {
-            return NO_ERROR;
+    // The h/w sensor is turned on by the first client to enable it, and stays on as long as one
+    // of them is left.
+    bool activate = info.numActiveClients() > 0 && (info.activated || !enabled.isEmpty());
+
+    ALOGD_IF(DEBUG_CONNECTIONS,
+             "\t>>> curr_period=%" PRId64 " min_period=%" PRId64
+             " curr_timeout=%" PRId64 " min_timeout=%" PRId64 " activate=%d",
+             prevBestBatchParams.batchDelay, info.bestBatchParams.batchDelay,
+             prevBestBatchParams.batchTimeout, info.bestBatchParams.batchTimeout, activate);
+
+    // If the min period or min timeout has changed, call batch; unless the sensor is about to be
+    // de-activated anyway. For older devices which do not support batch, call setDelay() after
+    // activate(), as some of them may not support calling setDelay before activate().
+    if ((activate || !info.activated) && info.numActiveClients() > 0 &&
+            prevBestBatchParams != info.bestBatchParams &&
+            halVersion >= SENSORS_DEVICE_API_VERSION_1_1) {
+        ALOGD_IF(DEBUG_CONNECTIONS, "\t>>> actuating h/w BATCH %d %d %" PRId64 " %" PRId64, handle,
+                 info.bestBatchParams.flags, info.bestBatchParams.batchDelay,
+                 info.bestBatchParams.batchTimeout);
+        status_t result = mSensorDevice->batch(mSensorDevice, handle, info.bestBatchParams.flags,
+                                               info.bestBatchParams.batchDelay,
+                                               info.bestBatchParams.batchTimeout);
+        if (result != NO_ERROR) {
+            ALOGE("sensor batch failed %p %d %d %" PRId64 " %" PRId64 " err=%s",
+                  mSensorDevice, handle,
+                  info.bestBatchParams.flags, info.bestBatchParams.batchDelay,
+                  info.bestBatchParams.batchTimeout, strerror(-result));
+            for (size_t i = 0; i < batched.size(); i++) {
+                info.batchParams.removeItem(batched[i]);
+                enabled.remove(batched[i]);
+            }
+            info.selectBatchParams();
+            activate = info.numActiveClients() > 0 && (info.activated || !enabled.isEmpty());
+            if (err == NO_ERROR) {
+                err = result;
+            }
         }
     }
 
-    if (actuateHardware) {
+    bool actuated = false;
+    if (activate != info.activated) {
         ALOGD_IF(DEBUG_CONNECTIONS, "\t>>> actuating h/w activate handle=%d enabled=%d", handle,
-                 enabled);
-        err = mSensorDevice->activate(
-                reinterpret_cast<struct sensors_poll_device_t *> (mSensorDevice), handle, enabled);
-        ALOGE_IF(err, "Error %s sensor %d (%s)", enabled ? "activating" : "disabling", handle,
-                 strerror(-err));
-
-        if (err != NO_ERROR && enabled) {
+                 activate);
+        status_t result = mSensorDevice->activate(
+                reinterpret_cast<struct sensors_poll_device_t *> (mSensorDevice), handle,
+                activate);
+        ALOGE_IF(result, "Error %s sensor %d (%s)", activate ? "activating" : "disabling", handle,
+                 strerror(-result));
+
+        if (result != NO_ERROR && activate) {
             // Failure when enabling the sensor. Clean up on failure.
-            info.removeBatchParamsForIdent(ident);
+            for (size_t i = 0; i < enabled.size(); i++) {
+                info.removeBatchParamsForIdent(enabled[i]);
+            }
+        } else {
+            info.activated = activate;
+            actuated = activate;
+        }
+        if (err == NO_ERROR) {
+            err = result;
         }
     }
 
     // On older devices which do not support batch, call setDelay().
-    if (getHalDeviceVersion() < SENSORS_DEVICE_API_VERSION_1_1 && info.numActiveClients() > 0) {
+    if (halVersion < SENSORS_DEVICE_API_VERSION_1_1 && info.activated &&
+            (actuated || prevBestBatchParams != info.bestBatchParams)) {
         ALOGD_IF(DEBUG_CONNECTIONS, "\t>>> actuating h/w setDelay %d %" PRId64, handle,
                  info.bestBatchParams.batchDelay);
         mSensorDevice->setDelay(
@@ -217,71 +304,6 @@ status_t SensorDevice::activate(void* ident, int handle, int enabled)
     return err;
 }
 
-status_t SensorDevice::batch(void* ident, int handle, int flags, int64_t samplingPeriodNs,
-                             int64_t maxBatchReportLatencyNs) {
-    if (!mSensorDevice) return NO_INIT;
-
-    if (samplingPeriodNs < MINIMUM_EVENTS_PERIOD) {
-        samplingPeriodNs = MINIMUM_EVENTS_PERIOD;
-    }
-
-    const int halVersion = getHalDeviceVersion();
-    if (halVersion < SENSORS_DEVICE_API_VERSION_1_1 && maxBatchReportLatencyNs != 0) {
-        // Batch is not supported on older devices return invalid operation.
-        return INVALID_OPERATION;
-    }
-
-    ALOGD_IF(DEBUG_CONNECTIONS,
-             "SensorDevice::batch: ident=%p, handle=0x%08x, flags=%d, period_ns=%" PRId64 " timeout=%" PRId64,
-             ident, handle, flags, samplingPeriodNs, maxBatchReportLatencyNs);
-
-    Mutex::Autolock _l(mLock);
-    Info& info(mActivationCount.editValueFor(handle));
-
-    if (info.batchParams.indexOfKey(ident) < 0) {
-        BatchParams params(flags, samplingPeriodNs, maxBatchReportLatencyNs);
-        info.batchParams.add(ident, params);
-    } else {
-        // A batch has already been called with this ident. Update the batch parameters.
-        info.setBatchParamsForIdent(ident, flags, samplingPeriodNs, maxBatchReportLatencyNs);
-    }
-
-    BatchParams prevBestBatchParams = info.bestBatchParams;
-    // Find the minimum of all timeouts and batch_rates for this sensor.
-    info.selectBatchParams();
-
-    ALOGD_IF(DEBUG_CONNECTIONS,
-             "\t>>> curr_period=%" PRId64 " min_period=%" PRId64
-             " curr_timeout=%" PRId64 " min_timeout=%" PRId64,
-             prevBestBatchParams.batchDelay, info.bestBatchParams.batchDelay,
-             prevBestBatchParams.batchTimeout, info.bestBatchParams.batchTimeout);
-
-    status_t err(NO_ERROR);
-    // If the min period or min timeout has changed since the last batch call, call batch.
-    if (prevBestBatchParams != info.bestBatchParams) {
-        if (halVersion >= SENSORS_DEVICE_API_VERSION_1_1) {
-            ALOGD_IF(DEBUG_CONNECTIONS, "\t>>> actuating h/w BATCH %d %d %" PRId64 " %" PRId64, handle,
-                     info.bestBatchParams.flags, info.bestBatchParams.batchDelay,
-                     info.bestBatchParams.batchTimeout);
-            err = mSensorDevice->batch(mSensorDevice, handle, info.bestBatchParams.flags,
-                                       info.bestBatchParams.batchDelay,
-                                       info.bestBatchParams.batchTimeout);
-        } else {
-            // For older devices which do not support batch, call setDelay() after activate() is
-            // called. Some older devices may not support calling setDelay before activate(), so
-            // call setDelay in SensorDevice::activate() method.
-        }
-        if (err != NO_ERROR) {
-            ALOGE("sensor batch failed %p %d %d %" PRId64 " %" PRId64 " err=%s",
-                  mSensorDevice, handle,
-                  info.bestBatchParams.flags, info.bestBatchParams.batchDelay,
-                  info.bestBatchParams.batchTimeout, strerror(-err));
-            info.removeBatchParamsForIdent(ident);
-        }
-    }
-    return err;
-}
-
 status_t SensorDevice::setDelay(void* ident, int handle, int64_t samplingPeriodNs)
 {
     if (!mSensorDevice) return NO_INIT;
@@ -354,6 +376,7 @@ void SensorDevice::enableAllSensors() {
                     reinterpret_cast<struct sensors_poll_device_t *>(mSensorDevice),
                     sensor_handle, 1);
             ALOGE_IF(err, "Error activating sensor %d (%s)", sensor_handle, strerror(-err));
+            info.activated = (err == NO_ERROR);
         }
 
         if (halVersion <= SENSORS_DEVICE_API_VERSION_1_0) {
@@ -368,7 +391,7 @@ void SensorDevice::enableAllSensors() {
 void SensorDevice::disableAllSensors() {
     Mutex::Autolock _l(mLock);
    for (size_t i = 0; i< mActivationCount.size(); ++i) {
-        const Info& info = mActivationCount.valueAt(i);
+        Info& info = mActivationCount.editValueAt(i);
         // Check if this sensor has been activated previously and disable it.
         if (info.batchParams.size() > 0) {
            const int sensor_handle = mActivationCount.keyAt(i);
@@ -377,6 +400,7 @@ void SensorDevice::disableAllSensors() {
            mSensorDevice->activate(
                    reinterpret_cast<struct sensors_poll_device_t *> (mSensorDevice),
                    sensor_handle, 0);
+           info.activated = false;
            // Add all the connections that were registered for this sensor to the disabled
            // clients list.
            for (size_t j = 0; j < info.batchParams.size(); ++j) {
@@ -409,6 +433,32 @@ status_t SensorDevice::setMode(uint32_t mode) {
 
 // ---------------------------------------------------------------------------
 
+void SensorDevice::Transaction::activate(void* ident, int handle, int enabled) {
+    Request request;
+    request.type = Request::ACTIVATE;
+    request.ident = ident;
+    request.handle = handle;
+    request.enabled = enabled;
+    mRequests.add(request);
+}
+
+void SensorDevice::Transaction::batch(void* ident, int handle, int flags,
+                                      int64_t samplingPeriodNs,
+                                      int64_t maxBatchReportLatencyNs) {
+    if (samplingPeriodNs < MINIMUM_EVENTS_PERIOD) {
+        samplingPeriodNs = MINIMUM_EVENTS_PERIOD;
+    }
+    Request request;
+    request.type = Request::BATCH;
+    request.ident = ident;
+    request.handle = handle;
+    request.enabled = 0;
+    request.params = BatchParams(flags, samplingPeriodNs, maxBatchReportLatencyNs);
+    mRequests.add(request);
+}
+
+// ---------------------------------------------------------------------------
+
 int SensorDevice::Info::numActiveClients() {
     SensorDevice& device(SensorDevice::getInstance());
     int num = 0;
@@ -22,7 +22,9 @@
 
 #include <utils/KeyedVector.h>
 #include <utils/Singleton.h>
+#include <utils/SortedVector.h>
 #include <utils/String8.h>
+#include <utils/Vector.h>
 
 #include <gui/Sensor.h>
 
@@ -65,8 +67,10 @@ class SensorDevice : public Singleton<SensorDevice> {
         // Key is the unique identifier(ident) for each client, value is the batch parameters
         // requested by the client.
         KeyedVector<void*, BatchParams> batchParams;
+        // Whether the h/w sensor was last activated or de-activated.
+        bool activated;
 
-        Info() : bestBatchParams(0, -1, -1) {}
+        Info() : bestBatchParams(0, -1, -1), activated(false) {}
         // Sets batch parameters for this ident. Returns error if this ident is not already present
         // in the KeyedVector above.
         status_t setBatchParamsForIdent(void* ident, int flags, int64_t samplingPeriodNs,
@@ -88,6 +92,27 @@ class SensorDevice : public Singleton<SensorDevice> {
     bool isClientDisabled(void* ident);
     bool isClientDisabledLocked(void* ident);
 public:
+    // A Transaction collects activate() and batch() requests for any number of clients and
+    // sensors. apply() updates the batch parameters of all of them first, and then makes at most
+    // one h/w batch and one h/w activate call per sensor, instead of one per request.
+    class Transaction {
+    public:
+        void activate(void* ident, int handle, int enabled);
+        void batch(void* ident, int handle, int flags, int64_t samplingPeriodNs,
+                   int64_t maxBatchReportLatencyNs);
+        bool isEmpty() const { return mRequests.isEmpty(); }
+    private:
+        friend class SensorDevice;
+        struct Request {
+            enum { ACTIVATE, BATCH } type;
+            void* ident;
+            int handle;
+            int enabled;
+            BatchParams params;
+        };
+        Vector<Request> mRequests;
+    };
+
     ssize_t getSensorList(sensor_t const** list);
     status_t initCheck() const;
     int getHalDeviceVersion() const;
@@ -95,6 +120,9 @@ public:
     status_t activate(void* ident, int handle, int enabled);
     status_t batch(void* ident, int handle, int flags, int64_t samplingPeriodNs,
                    int64_t maxBatchReportLatencyNs);
+    // Applies all the requests of the transaction. Returns the first error, requests that failed
+    // are undone as activate() and batch() would.
+    status_t apply(const Transaction& transaction);
     // Call batch with timeout zero instead of calling setDelay() for newer devices.
     status_t setDelay(void* ident, int handle, int64_t ns);
     status_t flush(void* ident, int handle);
@@ -104,6 +132,10 @@ public:
     void autoDisable(void *ident, int handle);
     status_t injectSensorData(const sensors_event_t *event);
     void dump(String8& result);
+
+private:
+    // Applies the requests of the transaction for this sensor, with mLock held.
+    status_t applyLocked(const Transaction& transaction, int handle);
 };
 
 // ---------------------------------------------------------------------------
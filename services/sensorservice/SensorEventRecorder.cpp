@@ -0,0 +1,123 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <errno.h>
+#include <fcntl.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+#include <utils/Log.h>
+
+#include "SensorEventRecorder.h"
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+const char* const SensorEventRecorder::RECORDING_DIR = "/data/system/sensorservice";
+
+SensorEventRecorder::SensorEventRecorder()
+    : mFile(NULL), mNumBatches(0), mNumEvents(0)
+{
+}
+
+SensorEventRecorder::~SensorEventRecorder() {
+    stop();
+}
+
+status_t SensorEventRecorder::start(const char* name) {
+    stop();
+    if (name[0] == '\0' || name[0] == '.' || strchr(name, '/') != NULL) {
+        ALOGE("invalid sensor recording name '%s'", name);
+        return BAD_VALUE;
+    }
+    if (mkdir(RECORDING_DIR, 0700) < 0 && errno != EEXIST) {
+        const int err = errno;
+        ALOGE("could not create %s (%s)", RECORDING_DIR, strerror(err));
+        return -err;
+    }
+    const String8 path(String8::format("%s/%s", RECORDING_DIR, name));
+    const int fd = open(path.string(),
+            O_WRONLY | O_CREAT | O_EXCL | O_NOFOLLOW | O_CLOEXEC, 0600);
+    FILE* file = fd < 0 ? NULL : fdopen(fd, "w");
+    if (file == NULL) {
+        const int err = errno;
+        ALOGE("could not record sensor events to %s (%s)", path.string(),
+                strerror(err));
+        if (fd >= 0) {
+            close(fd);
+        }
+        return -err;
+    }
+    Header header;
+    memset(&header, 0, sizeof(header));
+    header.magic = MAGIC;
+    header.version = VERSION;
+    header.eventSize = sizeof(sensors_event_t);
+    if (fwrite(&header, sizeof(header), 1, file) != 1) {
+        ALOGE("could not record sensor events to %s (%s)", path.string(),
+                strerror(errno));
+        fclose(file);
+        unlink(path.string());
+        return UNKNOWN_ERROR;
+    }
+    mFile = file;
+    mPath = path;
+    mNumBatches = 0;
+    mNumEvents = 0;
+    ALOGI("recording sensor events to %s", path.string());
+    return NO_ERROR;
+}
+
+void SensorEventRecorder::stop() {
+    if (mFile != NULL) {
+        fclose(mFile);
+        mFile = NULL;
+        ALOGI("recorded %zu sensor events in %zu batches to %s",
+                mNumEvents, mNumBatches, mPath.string());
+    }
+}
+
+void SensorEventRecorder::record(nsecs_t pollTime, const sensors_event_t* events,
+        size_t count) {
+    if (mFile == NULL || count == 0) {
+        return;
+    }
+    // The file is buffered by stdio, so most batches don't cost a write
+    BatchHeader batch;
+    memset(&batch, 0, sizeof(batch));
+    batch.pollTime = pollTime;
+    batch.count = count;
+    if (fwrite(&batch, sizeof(batch), 1, mFile) != 1
+            || fwrite(events, sizeof(sensors_event_t), count, mFile) != count) {
+        ALOGE("error recording sensor events to %s (%s), stopping",
+                mPath.string(), strerror(errno));
+        stop();
+        return;
+    }
+    mNumBatches++;
+    mNumEvents += count;
+}
+
+void SensorEventRecorder::dump(String8& result) const {
+    if (mFile != NULL) {
+        result.appendFormat("Recording to %s: %zu events in %zu batches\n",
+                mPath.string(), mNumEvents, mNumBatches);
+    }
+}
+
+// ---------------------------------------------------------------------------
+}; // namespace android
@@ -0,0 +1,103 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_EVENT_RECORDER_H
+#define ANDROID_SENSOR_EVENT_RECORDER_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <sys/types.h>
+
+#include <hardware/sensors.h>
+
+#include <utils/Errors.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+// ---------------------------------------------------------------------------
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+/*
+ * Records the events SensorService polls from the HAL to a file, batch by
+ * batch, so that a load can be replayed later through data injection, at
+ * its original timing (see tests/SensorReplayBenchmark.cpp).
+ *
+ * Recordings are only ever created in RECORDING_DIR, under a plain file
+ * name that mustn't exist yet: the name comes from whoever calls dump, and
+ * SensorService runs in system_server.
+ *
+ * The file is a Header followed by the batches, each of them a BatchHeader
+ * followed by its sensors_event_ts, as they are in memory: it's meant to be
+ * replayed on the device it was recorded on.
+ */
+class SensorEventRecorder {
+public:
+    enum {
+        // "srec"
+        MAGIC = 0x73726563,
+        VERSION = 1,
+    };
+
+    static const char* const RECORDING_DIR;
+
+    struct Header {
+        uint32_t magic;
+        uint32_t version;
+        // sizeof(sensors_event_t) where the file was recorded
+        uint32_t eventSize;
+        uint32_t reserved;
+    };
+
+    struct BatchHeader {
+        // When the poll returned, in the SYSTEM_TIME_MONOTONIC time base
+        int64_t pollTime;
+        uint32_t count;
+        uint32_t reserved;
+    };
+
+    SensorEventRecorder();
+    ~SensorEventRecorder();
+
+    // Starts recording to a new file called name in RECORDING_DIR, stopping
+    // the recording in progress if there is one. Fails with BAD_VALUE if
+    // name isn't a plain file name, and with -EEXIST if the file exists.
+    status_t start(const char* name);
+    void stop();
+
+    bool isRecording() const { return mFile != NULL; }
+
+    // Appends a batch of events polled at pollTime. A write error stops the
+    // recording.
+    void record(nsecs_t pollTime, const sensors_event_t* events, size_t count);
+
+    void dump(String8& result) const;
+
+private:
+    FILE* mFile;
+    String8 mPath;
+    size_t mNumBatches;
+    size_t mNumEvents;
+
+    SensorEventRecorder(const SensorEventRecorder&);
+    SensorEventRecorder& operator=(const SensorEventRecorder&);
+};
+
+// ---------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_SENSOR_EVENT_RECORDER_H
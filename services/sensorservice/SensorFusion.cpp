@@ -25,7 +25,7 @@ ANDROID_SINGLETON_STATIC_INSTANCE(SensorFusion)
 
 SensorFusion::SensorFusion()
     : mSensorDevice(SensorDevice::getInstance()),
-      mEnabled(false), mGyroTime(0)
+      mEnabled(false), mGyroTime(0), mRotationMatrixValid(false)
 {
     sensor_t const* list;
     Sensor uncalibratedGyro;
@@ -60,6 +60,7 @@ SensorFusion::SensorFusion()
 }
 
 void SensorFusion::process(const sensors_event_t& event) {
+    mRotationMatrixValid = false;
     if (event.type == mGyro.getType()) {
         if (mGyroTime != 0) {
             const float dT = (event.timestamp - mGyroTime) / 1000000000.0f;
@@ -82,6 +83,14 @@ void SensorFusion::process(const sensors_event_t& event) {
     }
 }
 
+mat33_t SensorFusion::getRotationMatrix() const {
+    if (!mRotationMatrixValid) {
+        mRotationMatrix = mFusion.getRotationMatrix();
+        mRotationMatrixValid = true;
+    }
+    return mRotationMatrix;
+}
+
 template <typename T> inline T min(T a, T b) { return a<b ? a : b; }
 template <typename T> inline T max(T a, T b) { return a>b ? a : b; }
 
@@ -102,9 +111,11 @@ status_t SensorFusion::activate(void* ident, bool enabled) {
         }
     }
 
-    mSensorDevice.activate(ident, mAcc.getHandle(), enabled);
-    mSensorDevice.activate(ident, mMag.getHandle(), enabled);
-    mSensorDevice.activate(ident, mGyro.getHandle(), enabled);
+    SensorDevice::Transaction transaction;
+    transaction.activate(ident, mAcc.getHandle(), enabled);
+    transaction.activate(ident, mMag.getHandle(), enabled);
+    transaction.activate(ident, mGyro.getHandle(), enabled);
+    mSensorDevice.apply(transaction);
 
     const bool newState = mClients.size() != 0;
     if (newState != mEnabled) {
@@ -112,6 +123,7 @@ status_t SensorFusion::activate(void* ident, bool enabled) {
         if (newState) {
             mFusion.init();
             mGyroTime = 0;
+            mRotationMatrixValid = false;
         }
     }
     return NO_ERROR;
@@ -119,9 +131,11 @@ status_t SensorFusion::activate(void* ident, bool enabled) {
 
 status_t SensorFusion::setDelay(void* ident, int64_t ns) {
     // Call batch with timeout zero instead of setDelay().
-    mSensorDevice.batch(ident, mAcc.getHandle(), 0, ns, 0);
-    mSensorDevice.batch(ident, mMag.getHandle(), 0, ms2ns(20), 0);
-    mSensorDevice.batch(ident, mGyro.getHandle(), 0, mTargetDelayNs, 0);
+    SensorDevice::Transaction transaction;
+    transaction.batch(ident, mAcc.getHandle(), 0, ns, 0);
+    transaction.batch(ident, mMag.getHandle(), 0, ms2ns(20), 0);
+    transaction.batch(ident, mGyro.getHandle(), 0, mTargetDelayNs, 0);
+    mSensorDevice.apply(transaction);
     return NO_ERROR;
 }
 
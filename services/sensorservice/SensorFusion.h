@@ -48,6 +48,10 @@ class SensorFusion : public Singleton<SensorFusion> {
     nsecs_t mTargetDelayNs;
     nsecs_t mGyroTime;
     vec4_t mAttitude;
+    // The rotation matrix of the current estimate, computed once for all the
+    // virtual sensors that read it until the next event is processed
+    mutable mat33_t mRotationMatrix;
+    mutable bool mRotationMatrixValid;
     SortedVector<void*> mClients;
 
     SensorFusion();
@@ -57,7 +61,7 @@ public:
 
     bool isEnabled() const { return mEnabled; }
     bool hasEstimate() const { return mFusion.hasEstimate(); }
-    mat33_t getRotationMatrix() const { return mFusion.getRotationMatrix(); }
+    mat33_t getRotationMatrix() const;
     vec4_t getAttitude() const { return mAttitude; }
     vec3_t getGyroBias() const { return mFusion.getBias(); }
     float getEstimatedRate() const { return mEstimatedGyroRate; }
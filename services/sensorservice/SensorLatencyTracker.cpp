@@ -0,0 +1,107 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_HAL
+
+#include <utils/Trace.h>
+
+#include "SensorLatencyTracker.h"
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+static const char* const STAGE_NAMES[] = {
+    "hal", "service",
+};
+
+// The atrace counters of the stages, in microseconds.
+static const char* const STAGE_COUNTERS[] = {
+    "sl:hal", "sl:service",
+};
+
+// ---------------------------------------------------------------------------
+
+SensorLatencyTracker::Histogram::Histogram()
+    : count(0), total(0), max(0) {
+    for (size_t i = 0; i < NUM_BUCKETS; i++) {
+        buckets[i] = 0;
+    }
+}
+
+void SensorLatencyTracker::Histogram::add(nsecs_t latency) {
+    size_t bucket = 0;
+    nsecs_t bound = 1000000; // 1ms
+    while (bucket < NUM_BUCKETS - 1 && latency >= bound) {
+        bucket++;
+        bound *= 2;
+    }
+    buckets[bucket]++;
+    count++;
+    total += latency;
+    if (latency > max) {
+        max = latency;
+    }
+}
+
+// ---------------------------------------------------------------------------
+
+SensorLatencyTracker::SensorLatencyTracker() {
+}
+
+void SensorLatencyTracker::addLatency(int32_t handle, Stage stage, nsecs_t latency) {
+    if (latency < 0) {
+        // the HAL doesn't timestamp in the elapsedRealtimeNano() time base
+        return;
+    }
+    ssize_t index = mSensors.indexOfKey(handle);
+    if (index < 0) {
+        index = mSensors.add(handle, SensorLatency());
+    }
+    mSensors.editValueAt(index).stages[stage].add(latency);
+
+    if (ATRACE_ENABLED()) {
+        ATRACE_INT(STAGE_COUNTERS[stage], int32_t(latency / 1000));
+    }
+}
+
+void SensorLatencyTracker::dump(String8& result) const {
+    result.append("Latency (bucket counts for <1ms, <2ms, ... <1024ms, >=1024ms):\n");
+    if (mSensors.isEmpty()) {
+        result.append("\t<none>\n");
+        return;
+    }
+    for (size_t i = 0; i < mSensors.size(); i++) {
+        result.appendFormat("\tSensor 0x%08x:\n", mSensors.keyAt(i));
+        const SensorLatency& sensor = mSensors.valueAt(i);
+        for (size_t stage = 0; stage < NUM_STAGES; stage++) {
+            const Histogram& histogram = sensor.stages[stage];
+            if (!histogram.count) {
+                continue;
+            }
+            result.appendFormat("\t\t%s: count=%u, avg=%0.3fms, max=%0.3fms, buckets=[",
+                    STAGE_NAMES[stage], histogram.count,
+                    histogram.total / histogram.count * 0.000001f,
+                    histogram.max * 0.000001f);
+            for (size_t bucket = 0; bucket < NUM_BUCKETS; bucket++) {
+                result.appendFormat(bucket ? ", %u" : "%u", histogram.buckets[bucket]);
+            }
+            result.append("]\n");
+        }
+    }
+}
+
+// ---------------------------------------------------------------------------
+}; // namespace android
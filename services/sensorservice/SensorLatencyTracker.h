@@ -0,0 +1,90 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_SENSOR_LATENCY_TRACKER_H
+#define ANDROID_SENSOR_LATENCY_TRACKER_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+// ---------------------------------------------------------------------------
+
+namespace android {
+// ---------------------------------------------------------------------------
+
+/*
+ * Keeps histograms, per sensor, of how long events spend in each stage from
+ * their timestamp to their delivery to the clients' sockets, so that
+ * batching periods can be tuned against latency. Latencies are measured
+ * against elapsedRealtimeNano(), the clock of the sensor timestamps.
+ *
+ * The last stage, from the socket to the app reading the event, is in the
+ * app's process: SensorEventQueue::read reports the whole latency, from the
+ * timestamp to the read, as the "sl:client" atrace counter.
+ *
+ * Not thread safe; SensorService uses it with mLock held.
+ */
+class SensorLatencyTracker {
+public:
+    enum Stage {
+        // From the event timestamp to the poll returning it, which includes
+        // the time spent in the HAL's FIFO
+        STAGE_HAL,
+        // From the poll returning, until the batch was written to all the
+        // connections registered for its sensors, counted once per batch
+        STAGE_SERVICE,
+
+        NUM_STAGES
+    };
+
+    SensorLatencyTracker();
+
+    // Adds the time an event of the sensor spent in the stage.
+    void addLatency(int32_t handle, Stage stage, nsecs_t latency);
+
+    void dump(String8& result) const;
+
+private:
+    // Buckets for latencies under 1, 2, 4, ... 1024ms, and the longer ones,
+    // batching taking up to seconds.
+    enum { NUM_BUCKETS = 12 };
+
+    struct Histogram {
+        Histogram();
+
+        uint32_t buckets[NUM_BUCKETS];
+        uint32_t count;
+        nsecs_t total;
+        nsecs_t max;
+
+        void add(nsecs_t latency);
+    };
+
+    struct SensorLatency {
+        Histogram stages[NUM_STAGES];
+    };
+
+    KeyedVector<int32_t, SensorLatency> mSensors;
+};
+
+// ---------------------------------------------------------------------------
+}; // namespace android
+
+#endif // ANDROID_SENSOR_LATENCY_TRACKER_H
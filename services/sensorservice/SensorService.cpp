@@ -14,6 +14,7 @@
  * limitations under the License.
  */
 
+#include <errno.h>
 #include <inttypes.h>
 #include <math.h>
 #include <stdint.h>
@@ -30,9 +31,12 @@
 #include <utils/RefBase.h>
 #include <utils/Singleton.h>
 #include <utils/String16.h>
+#include <utils/SystemClock.h>
+#include <utils/Timers.h>
 
 #include <binder/AppOpsManager.h>
 #include <binder/BinderService.h>
+#include <binder/IMemory.h>
 #include <binder/IServiceManager.h>
 #include <binder/PermissionCache.h>
 
@@ -70,7 +74,7 @@ static const String16 sDump("android.permission.DUMP");
 
 SensorService::SensorService()
     : mInitCheck(NO_INIT), mSocketBufferSize(SOCKET_BUFFER_SIZE_NON_BATCHED),
-      mWakeLockAcquired(false)
+      mWakeLockAcquired(false), mWakeLockHeld(false), mWakeLockReleaseTime(0)
 {
 }
 
@@ -193,6 +197,8 @@ void SensorService::onFirstRef()
             }
 
             mWakeLockAcquired = false;
+            mWakeLockHeld = false;
+            mWakeLockReleaseTime = 0;
             mLooper = new Looper(false);
             const size_t minBufferSize = SensorEventQueue::MAX_RECEIVE_BUFFER_EVENT_COUNT;
             mSensorEventBuffer = new sensors_event_t[minBufferSize];
@@ -305,6 +311,13 @@ status_t SensorService::dump(int fd, const Vector<String16>& args)
                 // Transition to data injection mode supported only from NORMAL mode.
                 return INVALID_OPERATION;
             }
+        } else if (args.size() == 2 && args[0] == String16("record")) {
+            // Record the events polled from the HAL to a new file in
+            // SensorEventRecorder::RECORDING_DIR, which can be replayed through data injection.
+            return mRecorder.start(String8(args[1]).string());
+        } else if (args.size() == 1 && args[0] == String16("record_stop")) {
+            mRecorder.stop();
+            return NO_ERROR;
         } else if (mSensorList.size() == 0) {
             result.append("No Sensors on the device\n");
         } else {
@@ -384,7 +397,9 @@ status_t SensorService::dump(int fd, const Vector<String16>& args)
             result.appendFormat("Socket Buffer size = %d events\n",
                                 mSocketBufferSize/sizeof(sensors_event_t));
             result.appendFormat("WakeLock Status: %s \n", mWakeLockAcquired ? "acquired" :
-                    "not held");
+                    (mWakeLockHeld ? "releasing" : "not held"));
+            mRecorder.dump(result);
+            mLatencyTracker.dump(result);
             result.appendFormat("Mode :");
             switch(mCurrentOperatingMode) {
                case NORMAL:
@@ -464,11 +479,17 @@ bool SensorService::threadLoop()
 {
     ALOGD("nuSensorService thread starting...");
 
-    // each virtual sensor could generate an event per "real" event, that's why we need
-    // to size numEventMax much smaller than MAX_RECEIVE_BUFFER_EVENT_COUNT.
-    // in practice, this is too aggressive, but guaranteed to be enough.
+    // each active virtual sensor could generate an event per "real" event, that's why we
+    // need to size numEventMax smaller than MAX_RECEIVE_BUFFER_EVENT_COUNT when some are
+    // active. in practice, this is too aggressive, but guaranteed to be enough. It's only
+    // sized by the virtual sensors which are active, so that when none are, which is the
+    // common case, a poll can return as many events as the buffer holds.
     const size_t minBufferSize = SensorEventQueue::MAX_RECEIVE_BUFFER_EVENT_COUNT;
-    const size_t numEventMax = minBufferSize / (1 + mVirtualSensorList.size());
+    size_t numEventMax;
+    {
+        Mutex::Autolock _l(mLock);
+        numEventMax = minBufferSize / (1 + mActiveVirtualSensors.size());
+    }
 
     SensorDevice& device(SensorDevice::getInstance());
     const size_t vcount = mVirtualSensorList.size();
@@ -480,6 +501,9 @@ bool SensorService::threadLoop()
             ALOGE("sensor poll failed (%s)", strerror(-count));
             break;
         }
+        const nsecs_t pollTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        // The sensor timestamps are in the elapsedRealtimeNano() time base
+        const nsecs_t pollRealtime = elapsedRealtimeNano();
 
         // Reset sensors_event_t.flags to zero for all events in the buffer.
         for (int i = 0; i < count; i++) {
@@ -512,6 +536,14 @@ bool SensorService::threadLoop()
             setWakeLockAcquiredLocked(true);
         }
         recordLastValueLocked(mSensorEventBuffer, count);
+        mRecorder.record(pollTime, mSensorEventBuffer, count);
+        for (int i = 0; i < count; i++) {
+            if (mSensorEventBuffer[i].type != SENSOR_TYPE_META_DATA) {
+                mLatencyTracker.addLatency(mSensorEventBuffer[i].sensor,
+                        SensorLatencyTracker::STAGE_HAL,
+                        pollRealtime - mSensorEventBuffer[i].timestamp);
+            }
+        }
 
         // handle virtual sensors
         if (count && vcount) {
@@ -578,12 +610,25 @@ bool SensorService::threadLoop()
             }
         }
 
+        // Collect the sensors the events are from. There are usually few of them, and few
+        // connections registered for each, so most connections don't need to filter the buffer.
+        mSensorHandlesInBuffer.clear();
+        for (int i = 0; i < count; ++i) {
+            mSensorHandlesInBuffer.add(mSensorEventBuffer[i].type == SENSOR_TYPE_META_DATA ?
+                    mSensorEventBuffer[i].meta_data.sensor : mSensorEventBuffer[i].sensor);
+        }
+
         // Send our events to clients. Check the state of wake lock for each client and release the
         // lock if none of the clients need it.
         bool needsWakeLock = false;
         size_t numConnections = activeConnections.size();
         for (size_t i=0 ; i < numConnections; ++i) {
             if (activeConnections[i] != 0) {
+                if (!activeConnections[i]->hasAnyOfSensors(mSensorHandlesInBuffer)) {
+                    activeConnections[i]->sendPendingFlushEvents();
+                    needsWakeLock |= activeConnections[i]->needsWakeLock();
+                    continue;
+                }
                 activeConnections[i]->sendEvents(mSensorEventBuffer, count, mSensorEventScratch,
                         mMapFlushEventsToConnections);
                 needsWakeLock |= activeConnections[i]->needsWakeLock();
@@ -599,6 +644,18 @@ bool SensorService::threadLoop()
         if (mWakeLockAcquired && !needsWakeLock) {
             setWakeLockAcquiredLocked(false);
         }
+
+        if (count > 0) {
+            const nsecs_t sentLatency = elapsedRealtimeNano() - pollRealtime;
+            for (size_t i = 0; i < mSensorHandlesInBuffer.size(); ++i) {
+                mLatencyTracker.addLatency(mSensorHandlesInBuffer[i],
+                        SensorLatencyTracker::STAGE_SERVICE, sentLatency);
+            }
+        }
+
+        // A virtual sensor activated before the next poll returns is still bounded by the
+        // check on minBufferSize above, it may only drop some synthesized events of that batch.
+        numEventMax = minBufferSize / (1 + mActiveVirtualSensors.size());
     } while (!Thread::exitPending());
 
     ALOGW("Exiting SensorService::threadLoop => aborting...");
@@ -626,15 +683,20 @@ void SensorService::resetAllWakeLockRefCounts() {
 
 void SensorService::setWakeLockAcquiredLocked(bool acquire) {
     if (acquire) {
-        if (!mWakeLockAcquired) {
+        if (!mWakeLockHeld) {
             acquire_wake_lock(PARTIAL_WAKE_LOCK, WAKE_LOCK_NAME);
-            mWakeLockAcquired = true;
+            mWakeLockHeld = true;
         }
+        mWakeLockAcquired = true;
+        mWakeLockReleaseTime = 0;
         mLooper->wake();
     } else {
         if (mWakeLockAcquired) {
-            release_wake_lock(WAKE_LOCK_NAME);
+            // The SensorEventAckReceiver releases it when it's due
             mWakeLockAcquired = false;
+            mWakeLockReleaseTime = systemTime(SYSTEM_TIME_MONOTONIC)
+                    + ms2ns(WAKE_LOCK_RELEASE_DELAY_MS);
+            mLooper->wake();
         }
     }
 }
@@ -644,6 +706,21 @@ bool SensorService::isWakeLockAcquired() {
     return mWakeLockAcquired;
 }
 
+int SensorService::releaseWakeLockIfDue() {
+    Mutex::Autolock _l(mLock);
+    if (mWakeLockAcquired || !mWakeLockHeld) {
+        return -1;
+    }
+    const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+    if (now < mWakeLockReleaseTime) {
+        return toMillisecondTimeoutDelay(now, mWakeLockReleaseTime);
+    }
+    release_wake_lock(WAKE_LOCK_NAME);
+    mWakeLockHeld = false;
+    mWakeLockReleaseTime = 0;
+    return -1;
+}
+
 bool SensorService::SensorEventAckReceiver::threadLoop() {
     ALOGD("new thread SensorEventAckReceiver");
     sp<Looper> looper = mService->getLooper();
@@ -651,8 +728,12 @@ bool SensorService::SensorEventAckReceiver::threadLoop() {
         bool wakeLockAcquired = mService->isWakeLockAcquired();
         int timeout = -1;
         if (wakeLockAcquired) timeout = 5000;
+        // A wake lock that is no longer needed is released when its delay has elapsed, which
+        // is never when it's still acquired.
+        const int releaseTimeout = mService->releaseWakeLockIfDue();
+        if (releaseTimeout >= 0) timeout = releaseTimeout;
         int ret = looper->pollOnce(timeout);
-        if (ret == ALOOPER_POLL_TIMEOUT) {
+        if (ret == ALOOPER_POLL_TIMEOUT && releaseTimeout < 0) {
            mService->resetAllWakeLockRefCounts();
         }
     } while(!Thread::exitPending());
@@ -1246,22 +1327,12 @@ void SensorService::SensorRecord::clearAllPendingFlushConnections() {
 
 
 // ---------------------------------------------------------------------------
-SensorService::TrimmedSensorEvent::TrimmedSensorEvent(int sensorType) {
-    mTimestamp = -1;
-    const int numData = SensorService::getNumEventsForSensorType(sensorType);
-    if (sensorType == SENSOR_TYPE_STEP_COUNTER) {
-        mStepCounter = 0;
-    } else {
-        mData = new float[numData];
-        for (int i = 0; i < numData; ++i) {
-            mData[i] = -1.0;
-        }
-    }
-    mHour = mMin = mSec = INT32_MIN;
+SensorService::TrimmedSensorEvent::TrimmedSensorEvent()
+    : mStepCounter(0), mTimestamp(-1), mTime(-1) {
 }
 
 bool SensorService::TrimmedSensorEvent::isSentinel(const TrimmedSensorEvent& event) {
-    return (event.mHour == INT32_MIN && event.mMin == INT32_MIN && event.mSec == INT32_MIN);
+    return event.mTime == -1;
 }
 // --------------------------------------------------------------------------
 SensorService::CircularBuffer::CircularBuffer(int sensor_event_type) {
@@ -1272,51 +1343,51 @@ SensorService::CircularBuffer::CircularBuffer(int sensor_event_type) {
             sensor_event_type == SENSOR_TYPE_ACCELEROMETER) {
         mBufSize = CIRCULAR_BUF_SIZE * 5;
     }
-    mTrimmedSensorEventArr = new TrimmedSensorEvent *[mBufSize];
     mSensorType = sensor_event_type;
-    for (int i = 0; i < mBufSize; ++i) {
-        mTrimmedSensorEventArr[i] = new TrimmedSensorEvent(mSensorType);
+    mNumData = mSensorType == SENSOR_TYPE_STEP_COUNTER ? 0 :
+            SensorService::getNumEventsForSensorType(mSensorType);
+    mTrimmedSensorEventArr = new TrimmedSensorEvent[mBufSize];
+    mData = new float[mBufSize * mNumData];
+    for (int i = 0; i < mBufSize * mNumData; ++i) {
+        mData[i] = -1.0;
     }
 }
 
 void SensorService::CircularBuffer::addEvent(const sensors_event_t& sensor_event) {
-    TrimmedSensorEvent *curr_event = mTrimmedSensorEventArr[mNextInd];
-    curr_event->mTimestamp = sensor_event.timestamp;
+    TrimmedSensorEvent& curr_event(mTrimmedSensorEventArr[mNextInd]);
+    curr_event.mTimestamp = sensor_event.timestamp;
     if (mSensorType == SENSOR_TYPE_STEP_COUNTER) {
-        curr_event->mStepCounter = sensor_event.u64.step_counter;
+        curr_event.mStepCounter = sensor_event.u64.step_counter;
     } else {
-        memcpy(curr_event->mData, sensor_event.data,
-                 sizeof(float) * SensorService::getNumEventsForSensorType(mSensorType));
-    }
-    time_t rawtime = time(NULL);
-    struct tm * timeinfo = localtime(&rawtime);
-    curr_event->mHour = timeinfo->tm_hour;
-    curr_event->mMin = timeinfo->tm_min;
-    curr_event->mSec = timeinfo->tm_sec;
+        memcpy(&mData[mNextInd * mNumData], sensor_event.data, sizeof(float) * mNumData);
+    }
+    // Only converted to local time when dumped, which is much less often
+    curr_event.mTime = time(NULL);
     mNextInd = (mNextInd + 1) % mBufSize;
 }
 
 void SensorService::CircularBuffer::printBuffer(String8& result) const {
-    const int numData = SensorService::getNumEventsForSensorType(mSensorType);
     int i = mNextInd, eventNum = 1;
     result.appendFormat("last %d events = < ", mBufSize);
     do {
-        if (TrimmedSensorEvent::isSentinel(*mTrimmedSensorEventArr[i])) {
+        const TrimmedSensorEvent& event(mTrimmedSensorEventArr[i]);
+        if (TrimmedSensorEvent::isSentinel(event)) {
             // Sentinel, ignore.
             i = (i + 1) % mBufSize;
             continue;
         }
         result.appendFormat("%d) ", eventNum++);
         if (mSensorType == SENSOR_TYPE_STEP_COUNTER) {
-            result.appendFormat("%llu,", mTrimmedSensorEventArr[i]->mStepCounter);
+            result.appendFormat("%llu,", event.mStepCounter);
         } else {
-            for (int j = 0; j < numData; ++j) {
-                result.appendFormat("%5.1f,", mTrimmedSensorEventArr[i]->mData[j]);
+            for (int j = 0; j < mNumData; ++j) {
+                result.appendFormat("%5.1f,", mData[i * mNumData + j]);
             }
         }
-        result.appendFormat("%lld %02d:%02d:%02d ", mTrimmedSensorEventArr[i]->mTimestamp,
-                mTrimmedSensorEventArr[i]->mHour, mTrimmedSensorEventArr[i]->mMin,
-                mTrimmedSensorEventArr[i]->mSec);
+        struct tm timeinfo;
+        localtime_r(&event.mTime, &timeinfo);
+        result.appendFormat("%lld %02d:%02d:%02d ", event.mTimestamp,
+                timeinfo.tm_hour, timeinfo.tm_min, timeinfo.tm_sec);
         i = (i + 1) % mBufSize;
     } while (i != mNextInd);
     result.appendFormat(">\n");
@@ -1325,26 +1396,23 @@ void SensorService::CircularBuffer::printBuffer(String8& result) const {
 bool SensorService::CircularBuffer::populateLastEvent(sensors_event_t *event) {
     int lastEventInd = (mNextInd - 1 + mBufSize) % mBufSize;
     // Check if the buffer is empty.
-    if (TrimmedSensorEvent::isSentinel(*mTrimmedSensorEventArr[lastEventInd])) {
+    if (TrimmedSensorEvent::isSentinel(mTrimmedSensorEventArr[lastEventInd])) {
         return false;
     }
     event->version = sizeof(sensors_event_t);
     event->type = mSensorType;
-    event->timestamp = mTrimmedSensorEventArr[lastEventInd]->mTimestamp;
+    event->timestamp = mTrimmedSensorEventArr[lastEventInd].mTimestamp;
     if (mSensorType == SENSOR_TYPE_STEP_COUNTER) {
-          event->u64.step_counter = mTrimmedSensorEventArr[lastEventInd]->mStepCounter;
+          event->u64.step_counter = mTrimmedSensorEventArr[lastEventInd].mStepCounter;
     } else {
-        memcpy(event->data, mTrimmedSensorEventArr[lastEventInd]->mData,
-                 sizeof(float) * SensorService::getNumEventsForSensorType(mSensorType));
+        memcpy(event->data, &mData[lastEventInd * mNumData], sizeof(float) * mNumData);
     }
     return true;
 }
 
 SensorService::CircularBuffer::~CircularBuffer() {
-    for (int i = 0; i < mBufSize; ++i) {
-        delete mTrimmedSensorEventArr[i];
-    }
     delete [] mTrimmedSensorEventArr;
+    delete [] mData;
 }
 
 // ---------------------------------------------------------------------------
@@ -1354,7 +1422,8 @@ SensorService::SensorEventConnection::SensorEventConnection(
         const String16& opPackageName)
     : mService(service), mUid(uid), mWakeLockRefCount(0), mHasLooperCallbacks(false),
       mDead(false), mDataInjectionMode(isDataInjectionMode), mEventCache(NULL),
-      mCacheSize(0), mMaxCacheSize(0), mPackageName(packageName), mOpPackageName(opPackageName) {
+      mCacheStart(0), mCacheSize(0), mMaxCacheSize(0), mNumEventsDropped(0), mMaxCacheUsed(0),
+      mPackageName(packageName), mOpPackageName(opPackageName) {
     mChannel = new BitTube(mService->mSocketBufferSize);
 #if DEBUG_CONNECTIONS
     mEventsReceived = mEventsSentFromCache = mEventsSent = 0;
@@ -1366,7 +1435,7 @@ SensorService::SensorEventConnection::~SensorEventConnection() {
     ALOGD_IF(DEBUG_CONNECTIONS, "~SensorEventConnection(%p)", this);
     mService->cleanupConnection(this);
     if (mEventCache != NULL) {
-        delete mEventCache;
+        delete[] mEventCache;
     }
 }
 
@@ -1388,8 +1457,12 @@ void SensorService::SensorEventConnection::dump(String8& result) {
     Mutex::Autolock _l(mConnectionLock);
     result.appendFormat("\tOperating Mode: %s\n",mDataInjectionMode ? "DATA_INJECTION" : "NORMAL");
     result.appendFormat("\t %s | WakeLockRefCount %d | uid %d | cache size %d | "
-            "max cache size %d\n", mPackageName.string(), mWakeLockRefCount, mUid, mCacheSize,
-            mMaxCacheSize);
+            "max cache size %d | peak cache size %d | dropped %u\n", mPackageName.string(),
+            mWakeLockRefCount, mUid, mCacheSize, mMaxCacheSize, mMaxCacheUsed,
+            mNumEventsDropped);
+    if (mDirectRing != NULL) {
+        result.appendFormat("\t direct channel %zu events\n", mDirectRing->getCapacity());
+    }
     for (size_t i = 0; i < mSensorInfo.size(); ++i) {
         const FlushInfo& flushInfo = mSensorInfo.valueAt(i);
         result.appendFormat("\t %s 0x%08x | status: %s | pending flush events %d \n",
@@ -1442,6 +1515,31 @@ bool SensorService::SensorEventConnection::hasAnySensor() const {
     return mSensorInfo.size() ? true : false;
 }
 
+bool SensorService::SensorEventConnection::hasAnyOfSensors(
+        const SortedVector<int32_t>& handles) const {
+    Mutex::Autolock _l(mConnectionLock);
+    // Look up the smaller set in the larger one
+    if (handles.size() <= mSensorInfo.size()) {
+        for (size_t i = 0; i < handles.size(); ++i) {
+            if (mSensorInfo.indexOfKey(handles[i]) >= 0) {
+                return true;
+            }
+        }
+    } else {
+        for (size_t i = 0; i < mSensorInfo.size(); ++i) {
+            if (handles.indexOf(mSensorInfo.keyAt(i)) >= 0) {
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void SensorService::SensorEventConnection::sendPendingFlushEvents() {
+    Mutex::Autolock _l(mConnectionLock);
+    sendPendingFlushEventsLocked();
+}
+
 bool SensorService::SensorEventConnection::hasOneShotSensors() const {
     Mutex::Autolock _l(mConnectionLock);
     for (size_t i = 0; i < mSensorInfo.size(); ++i) {
@@ -1573,6 +1671,22 @@ status_t SensorService::SensorEventConnection::sendEvents(
                 continue;
             }
 
+            // The regular events of non wake-up sensors go straight from the buffer to the
+            // direct channel, if there is one. Wake-up events still need to be acknowledged
+            // through the socket, and flush complete events are rare.
+            if (mDirectRing != NULL && buffer[i].type != SENSOR_TYPE_META_DATA &&
+                    !mService->isWakeUpSensorEvent(buffer[i])) {
+                size_t start = i;
+                do {
+                    ++i;
+                } while (i < numEvents && buffer[i].sensor == sensor_handle &&
+                         buffer[i].type != SENSOR_TYPE_META_DATA);
+                // NOTE: ASensorEvent and sensors_event_t are the same type.
+                mDirectRing->write(reinterpret_cast<ASensorEvent const*>(&buffer[start]),
+                        i - start);
+                continue;
+            }
+
             do {
                 // Keep copying events into the scratch buffer as long as they are regular
                 // sensor_events are from the same sensor_handle OR they are flush_complete_events
@@ -1609,32 +1723,7 @@ status_t SensorService::SensorEventConnection::sendEvents(
     if (mCacheSize != 0) {
         // There are some events in the cache which need to be sent first. Copy this buffer to
         // the end of cache.
-        if (mCacheSize + count <= mMaxCacheSize) {
-            memcpy(&mEventCache[mCacheSize], scratch, count * sizeof(sensors_event_t));
-            mCacheSize += count;
-        } else {
-            // Check if any new sensors have registered on this connection which may have increased
-            // the max cache size that is desired.
-            if (mCacheSize + count < computeMaxCacheSizeLocked()) {
-                reAllocateCacheLocked(scratch, count);
-                return status_t(NO_ERROR);
-            }
-            // Some events need to be dropped.
-            int remaningCacheSize = mMaxCacheSize - mCacheSize;
-            if (remaningCacheSize != 0) {
-                memcpy(&mEventCache[mCacheSize], scratch,
-                                                remaningCacheSize * sizeof(sensors_event_t));
-            }
-            int numEventsDropped = count - remaningCacheSize;
-            countFlushCompleteEventsLocked(mEventCache, numEventsDropped);
-            // Drop the first "numEventsDropped" in the cache.
-            memmove(mEventCache, &mEventCache[numEventsDropped],
-                    (mCacheSize - numEventsDropped) * sizeof(sensors_event_t));
-
-            // Copy the remainingEvents in scratch buffer to the end of cache.
-            memcpy(&mEventCache[mCacheSize - numEventsDropped], scratch + remaningCacheSize,
-                                            numEventsDropped * sizeof(sensors_event_t));
-        }
+        cacheEventsLocked(scratch, count);
         return status_t(NO_ERROR);
     }
 
@@ -1662,13 +1751,7 @@ status_t SensorService::SensorEventConnection::sendEvents(
             --mTotalAcksNeeded;
 #endif
         }
-        if (mEventCache == NULL) {
-            mMaxCacheSize = computeMaxCacheSizeLocked();
-            mEventCache = new sensors_event_t[mMaxCacheSize];
-            mCacheSize = 0;
-        }
-        memcpy(&mEventCache[mCacheSize], scratch, count * sizeof(sensors_event_t));
-        mCacheSize += count;
+        cacheEventsLocked(scratch, count);
 
         // Add this file descriptor to the looper to get a callback when this fd is available for
         // writing.
@@ -1691,16 +1774,76 @@ void SensorService::SensorEventConnection::reAllocateCacheLocked(sensors_event_t
     const int new_cache_size = computeMaxCacheSizeLocked();
     // Allocate new cache, copy over events from the old cache & scratch, free up memory.
     eventCache_new = new sensors_event_t[new_cache_size];
-    memcpy(eventCache_new, mEventCache, mCacheSize * sizeof(sensors_event_t));
+    const int firstPart = helpers::min(mCacheSize, mMaxCacheSize - mCacheStart);
+    memcpy(eventCache_new, &mEventCache[mCacheStart], firstPart * sizeof(sensors_event_t));
+    memcpy(&eventCache_new[firstPart], mEventCache,
+            (mCacheSize - firstPart) * sizeof(sensors_event_t));
     memcpy(&eventCache_new[mCacheSize], scratch, count * sizeof(sensors_event_t));
 
     ALOGD_IF(DEBUG_CONNECTIONS, "reAllocateCacheLocked maxCacheSize=%d %d", mMaxCacheSize,
             new_cache_size);
 
-    delete mEventCache;
+    delete[] mEventCache;
     mEventCache = eventCache_new;
+    mCacheStart = 0;
     mCacheSize += count;
     mMaxCacheSize = new_cache_size;
+    mMaxCacheUsed = helpers::max(mMaxCacheUsed, mCacheSize);
+}
+
+void SensorService::SensorEventConnection::cacheEventsLocked(sensors_event_t const* scratch,
+                                                             int count) {
+    if (mEventCache == NULL) {
+        mMaxCacheSize = computeMaxCacheSizeLocked();
+        mEventCache = new sensors_event_t[mMaxCacheSize];
+        mCacheStart = 0;
+        mCacheSize = 0;
+    }
+    if (mCacheSize + count > mMaxCacheSize) {
+        // Check if any new sensors have registered on this connection which may have increased
+        // the max cache size that is desired.
+        if (mCacheSize + count < computeMaxCacheSizeLocked()) {
+            reAllocateCacheLocked(scratch, count);
+            return;
+        }
+        // Some events need to be dropped, the oldest first.
+        const int numEventsDropped = mCacheSize + count - mMaxCacheSize;
+        const int numCachedEventsDropped = helpers::min(numEventsDropped, mCacheSize);
+        dropFromCacheLocked(numCachedEventsDropped);
+        if (numEventsDropped > numCachedEventsDropped) {
+            // More events than the cache holds, only the last of them are kept
+            const int numNewEventsDropped = numEventsDropped - numCachedEventsDropped;
+            countFlushCompleteEventsLocked(scratch, numNewEventsDropped);
+            scratch += numNewEventsDropped;
+            count -= numNewEventsDropped;
+        }
+        mNumEventsDropped += numEventsDropped;
+    }
+    appendToCacheLocked(scratch, count);
+}
+
+void SensorService::SensorEventConnection::appendToCacheLocked(sensors_event_t const* scratch,
+                                                               int count) {
+    int end = mCacheStart + mCacheSize;
+    if (end >= mMaxCacheSize) {
+        end -= mMaxCacheSize;
+    }
+    const int firstPart = helpers::min(count, mMaxCacheSize - end);
+    memcpy(&mEventCache[end], scratch, firstPart * sizeof(sensors_event_t));
+    memcpy(mEventCache, scratch + firstPart, (count - firstPart) * sizeof(sensors_event_t));
+    mCacheSize += count;
+    mMaxCacheUsed = helpers::max(mMaxCacheUsed, mCacheSize);
+}
+
+void SensorService::SensorEventConnection::dropFromCacheLocked(int count) {
+    const int firstPart = helpers::min(count, mMaxCacheSize - mCacheStart);
+    countFlushCompleteEventsLocked(&mEventCache[mCacheStart], firstPart);
+    countFlushCompleteEventsLocked(mEventCache, count - firstPart);
+    mCacheStart += count;
+    if (mCacheStart >= mMaxCacheSize) {
+        mCacheStart -= mMaxCacheSize;
+    }
+    mCacheSize -= count;
 }
 
 void SensorService::SensorEventConnection::sendPendingFlushEventsLocked() {
@@ -1739,13 +1882,14 @@ void SensorService::SensorEventConnection::writeToSocketFromCache() {
     Mutex::Autolock _l(mConnectionLock);
     // Send pending flush complete events (if any)
     sendPendingFlushEventsLocked();
-    for (int numEventsSent = 0; numEventsSent < mCacheSize;) {
-        const int numEventsToWrite = helpers::min(mCacheSize - numEventsSent, maxWriteSize);
-        int index_wake_up_event =
-                  findWakeUpSensorEventLocked(mEventCache + numEventsSent, numEventsToWrite);
+    while (mCacheSize > 0) {
+        // Writes don't wrap around the end of the ring
+        const int numEventsToWrite = helpers::min(
+                helpers::min(mCacheSize, mMaxCacheSize - mCacheStart), maxWriteSize);
+        sensors_event_t* events = mEventCache + mCacheStart;
+        int index_wake_up_event = findWakeUpSensorEventLocked(events, numEventsToWrite);
         if (index_wake_up_event >= 0) {
-            mEventCache[index_wake_up_event + numEventsSent].flags |=
-                    WAKE_UP_SENSOR_EVENT_NEEDS_ACK;
+            events[index_wake_up_event].flags |= WAKE_UP_SENSOR_EVENT_NEEDS_ACK;
             ++mWakeLockRefCount;
 #if DEBUG_CONNECTIONS
             ++mTotalAcksNeeded;
@@ -1753,13 +1897,11 @@ void SensorService::SensorEventConnection::writeToSocketFromCache() {
         }
 
         ssize_t size = SensorEventQueue::write(mChannel,
-                          reinterpret_cast<ASensorEvent const*>(mEventCache + numEventsSent),
-                          numEventsToWrite);
+                          reinterpret_cast<ASensorEvent const*>(events), numEventsToWrite);
         if (size < 0) {
             if (index_wake_up_event >= 0) {
                 // If there was a wake_up sensor_event, reset the flag.
-                mEventCache[index_wake_up_event + numEventsSent].flags  &=
-                        ~WAKE_UP_SENSOR_EVENT_NEEDS_ACK;
+                events[index_wake_up_event].flags &= ~WAKE_UP_SENSOR_EVENT_NEEDS_ACK;
                 if (mWakeLockRefCount > 0) {
                     --mWakeLockRefCount;
                 }
@@ -1767,21 +1909,21 @@ void SensorService::SensorEventConnection::writeToSocketFromCache() {
                 --mTotalAcksNeeded;
 #endif
             }
-            memmove(mEventCache, &mEventCache[numEventsSent],
-                                 (mCacheSize - numEventsSent) * sizeof(sensors_event_t));
-            ALOGD_IF(DEBUG_CONNECTIONS, "wrote %d events from cache size==%d ",
-                    numEventsSent, mCacheSize);
-            mCacheSize -= numEventsSent;
+            ALOGD_IF(DEBUG_CONNECTIONS, "events left in cache size==%d ", mCacheSize);
             return;
         }
-        numEventsSent += numEventsToWrite;
+        mCacheStart += numEventsToWrite;
+        if (mCacheStart >= mMaxCacheSize) {
+            mCacheStart -= mMaxCacheSize;
+        }
+        mCacheSize -= numEventsToWrite;
 #if DEBUG_CONNECTIONS
         mEventsSentFromCache += numEventsToWrite;
 #endif
     }
-    ALOGD_IF(DEBUG_CONNECTIONS, "wrote all events from cache size=%d ", mCacheSize);
-    // All events from the cache have been sent. Reset cache size to zero.
-    mCacheSize = 0;
+    ALOGD_IF(DEBUG_CONNECTIONS, "wrote all events from cache");
+    // All events from the cache have been sent.
+    mCacheStart = 0;
     // There are no more events in the cache. We don't need to poll for write on the fd.
     // Update Looper registration.
     updateLooperRegistrationLocked(mService->getLooper());
@@ -1818,6 +1960,23 @@ sp<BitTube> SensorService::SensorEventConnection::getSensorChannel() const
     return mChannel;
 }
 
+sp<IMemoryHeap> SensorService::SensorEventConnection::createDirectChannel(size_t numEvents)
+{
+    Mutex::Autolock _l(mConnectionLock);
+    if (mDataInjectionMode) {
+        return NULL;
+    }
+    if (mDirectRing == NULL) {
+        mDirectRing = SensorEventRing::create(numEvents);
+        if (mDirectRing == NULL) {
+            return NULL;
+        }
+        ALOGD_IF(DEBUG_CONNECTIONS, "direct channel of %zu events for %s",
+                mDirectRing->getCapacity(), mPackageName.string());
+    }
+    return mDirectRing->getHeap();
+}
+
 status_t SensorService::SensorEventConnection::enableDisable(
         int handle, bool enabled, nsecs_t samplingPeriodNs, nsecs_t maxBatchReportLatencyNs,
         int reservedFlags)
@@ -1866,44 +2025,52 @@ int SensorService::SensorEventConnection::handleEvent(int fd, int events, void*
     }
 
     if (events & ALOOPER_EVENT_INPUT) {
+        // Read all the messages that are pending, so that acks sent by an app in a row only
+        // lead to one check of the wake lock state.
         unsigned char buf[sizeof(sensors_event_t)];
-        ssize_t numBytesRead = ::recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
         {
            Mutex::Autolock _l(mConnectionLock);
-           if (numBytesRead == sizeof(sensors_event_t)) {
-               if (!mDataInjectionMode) {
-                   ALOGE("Data injected in normal mode, dropping event"
-                         "package=%s uid=%d", mPackageName.string(), mUid);
-                   // Unregister call backs.
-                   return 0;
+           for (bool first = true; ; first = false) {
+               ssize_t numBytesRead = ::recv(fd, buf, sizeof(buf), MSG_DONTWAIT);
+               if (!first && numBytesRead < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) {
+                   break;
                }
-               SensorDevice& dev(SensorDevice::getInstance());
-               sensors_event_t sensor_event;
-               memset(&sensor_event, 0, sizeof(sensor_event));
-               memcpy(&sensor_event, buf, sizeof(sensors_event_t));
-               Sensor sensor = mService->getSensorFromHandle(sensor_event.sensor);
-               sensor_event.type = sensor.getType();
-               dev.injectSensorData(&sensor_event);
+               if (numBytesRead == sizeof(sensors_event_t)) {
+                   if (!mDataInjectionMode) {
+                       ALOGE("Data injected in normal mode, dropping event"
+                             "package=%s uid=%d", mPackageName.string(), mUid);
+                       // Unregister call backs.
+                       return 0;
+                   }
+                   SensorDevice& dev(SensorDevice::getInstance());
+                   sensors_event_t sensor_event;
+                   memset(&sensor_event, 0, sizeof(sensor_event));
+                   memcpy(&sensor_event, buf, sizeof(sensors_event_t));
+                   Sensor sensor = mService->getSensorFromHandle(sensor_event.sensor);
+                   sensor_event.type = sensor.getType();
+                   dev.injectSensorData(&sensor_event);
 #if DEBUG_CONNECTIONS
-               ++mEventsReceived;
+                   ++mEventsReceived;
+#endif
+               } else if (numBytesRead == sizeof(uint32_t)) {
+                   uint32_t numAcks = 0;
+                   memcpy(&numAcks, buf, numBytesRead);
+                   // Sanity check to ensure  there are no read errors in recv, numAcks is always
+                   // within the range and not zero. If any of the above don't hold reset
+                   // mWakeLockRefCount to zero.
+                   if (numAcks > 0 && numAcks < mWakeLockRefCount) {
+                       mWakeLockRefCount -= numAcks;
+                   } else {
+                       mWakeLockRefCount = 0;
+                   }
+#if DEBUG_CONNECTIONS
+                   mTotalAcksReceived += numAcks;
 #endif
-           } else if (numBytesRead == sizeof(uint32_t)) {
-               uint32_t numAcks = 0;
-               memcpy(&numAcks, buf, numBytesRead);
-               // Sanity check to ensure  there are no read errors in recv, numAcks is always
-               // within the range and not zero. If any of the above don't hold reset
-               // mWakeLockRefCount to zero.
-               if (numAcks > 0 && numAcks < mWakeLockRefCount) {
-                   mWakeLockRefCount -= numAcks;
                } else {
+                   // Read error, reset wakelock refcount.
                    mWakeLockRefCount = 0;
+                   break;
                }
-#if DEBUG_CONNECTIONS
-               mTotalAcksReceived += numAcks;
-#endif
-           } else {
-               // Read error, reset wakelock refcount.
-               mWakeLockRefCount = 0;
            }
         }
         // Check if wakelock can be released by sensorservice. mConnectionLock needs to be released
@@ -19,6 +19,7 @@
 
 #include <stdint.h>
 #include <sys/types.h>
+#include <time.h>
 
 #include <utils/Vector.h>
 #include <utils/SortedVector.h>
@@ -35,8 +36,11 @@
 #include <gui/BitTube.h>
 #include <gui/ISensorServer.h>
 #include <gui/ISensorEventConnection.h>
+#include <gui/SensorEventRing.h>
 
+#include "SensorEventRecorder.h"
 #include "SensorInterface.h"
+#include "SensorLatencyTracker.h"
 
 #if __clang__
 // Clang warns about SensorEventConnection::dump hiding BBinder::dump
@@ -55,6 +59,9 @@
 
 #define CIRCULAR_BUF_SIZE 10
 #define SENSOR_REGISTRATIONS_BUF_SIZE 20
+// The wake lock is only released once it hasn't been needed for this long, so that wake up
+// sensors reporting every few hundred milliseconds don't acquire and release it for each event.
+#define WAKE_LOCK_RELEASE_DELAY_MS 200
 
 struct sensors_poll_device_t;
 struct sensors_module_t;
@@ -141,6 +148,7 @@ class SensorService :
                                        nsecs_t maxBatchReportLatencyNs, int reservedFlags);
         virtual status_t setEventRate(int handle, nsecs_t samplingPeriodNs);
         virtual status_t flush();
+        virtual sp<IMemoryHeap> createDirectChannel(size_t numEvents);
         // Count the number of flush complete events which are about to be dropped in the buffer.
         // Increment mPendingFlushEventsToSend in mSensorInfo. These flush complete events will be
         // sent separately before the next batch of events.
@@ -170,6 +178,14 @@ class SensorService :
         // size, reallocate memory and copy over events from the older cache.
         void reAllocateCacheLocked(sensors_event_t const* scratch, int count);
 
+        // Appends events to mEventCache, allocating it if needed. When it is full the oldest
+        // events are dropped, from the cache and then from the events if they don't fit in it.
+        void cacheEventsLocked(sensors_event_t const* scratch, int count);
+        // Copies count events to the end of mEventCache, which must have room for them.
+        void appendToCacheLocked(sensors_event_t const* scratch, int count);
+        // Drops the oldest count events of mEventCache, counting their flush complete events.
+        void dropFromCacheLocked(int count);
+
         // LooperCallback method. If there is data to read on this fd, it is an ack from the
         // app that it has read events from a wake up sensor, decrement mWakeLockRefCount.
         // If this fd is available for writing send the data from the cache.
@@ -190,6 +206,9 @@ class SensorService :
 
         sp<SensorService> const mService;
         sp<BitTube> mChannel;
+        // If the client asked for a direct channel, the events of the non wake-up sensors
+        // are written here rather than to mChannel. Protected by mConnectionLock.
+        sp<SensorEventRing> mDirectRing;
         uid_t mUid;
         mutable Mutex mConnectionLock;
         // Number of events from wake up sensors which are still pending and haven't been delivered
@@ -219,8 +238,14 @@ class SensorService :
         };
         // protected by SensorService::mLock. Key for this vector is the sensor handle.
         KeyedVector<int, FlushInfo> mSensorInfo;
+        // A ring of mMaxCacheSize events, of which mCacheSize from mCacheStart, that couldn't be
+        // written to the socket yet. Being a ring, neither partial writes nor drops need moving
+        // the events which are left.
         sensors_event_t *mEventCache;
-        int mCacheSize, mMaxCacheSize;
+        int mCacheStart, mCacheSize, mMaxCacheSize;
+        // Events dropped because the cache was full, and the most events it held
+        uint32_t mNumEventsDropped;
+        int mMaxCacheUsed;
         String8 mPackageName;
         const String16 mOpPackageName;
 #if DEBUG_CONNECTIONS
@@ -237,6 +262,11 @@ class SensorService :
                 SensorEventConnection const * const * mapFlushEventsToConnections = NULL);
         bool hasSensor(int32_t handle) const;
         bool hasAnySensor() const;
+        // Returns true if this connection has registered for any of the given sensors.
+        bool hasAnyOfSensors(const SortedVector<int32_t>& handles) const;
+        // Sends the pending flush complete events, as sendEvents does when there are no
+        // events for this connection.
+        void sendPendingFlushEvents();
         bool hasOneShotSensors() const;
         bool addSensor(int32_t handle);
         bool removeSensor(int32_t handle);
@@ -273,41 +303,43 @@ class SensorService :
         SensorEventAckReceiver(const sp<SensorService>& service): mService(service) {}
     };
 
-    // sensor_event_t with only the data and the timestamp.
+    // sensor_event_t with only the timestamp and the step counter, the data of the other sensors
+    // being in the pool of their CircularBuffer.
     struct TrimmedSensorEvent {
-        union {
-            float *mData;
-            uint64_t mStepCounter;
-        };
+        uint64_t mStepCounter;
         // Timestamp from the sensor_event.
         int64_t mTimestamp;
-        // HH:MM:SS local time at which this sensor event is read at SensorService. Useful
-        // for debugging.
-        int32_t mHour, mMin, mSec;
+        // Time at which this sensor event is read at SensorService, which the dump shows as
+        // HH:MM:SS local time. Useful for debugging. -1 until an event is stored.
+        time_t mTime;
 
-        TrimmedSensorEvent(int sensorType);
+        TrimmedSensorEvent();
         static bool isSentinel(const TrimmedSensorEvent& event);
-
-        ~TrimmedSensorEvent() {
-            delete [] mData;
-        }
     };
 
     // A circular buffer of TrimmedSensorEvents. The size of this buffer is typically 10. The
     // last N events generated from the sensor are stored in this buffer. The buffer is NOT
     // cleared when the sensor unregisters and as a result one may see very old data in the
-    // dumpsys output but this is WAI.
+    // dumpsys output but this is WAI. The events and their data are each in one allocation,
+    // made when the buffer is created, and storing one only copies it.
     class CircularBuffer {
         int mNextInd;
         int mSensorType;
         int mBufSize;
-        TrimmedSensorEvent ** mTrimmedSensorEventArr;
+        // Number of floats of data of mSensorType's events, 0 for the step counter
+        int mNumData;
+        TrimmedSensorEvent* mTrimmedSensorEventArr;
+        // mNumData floats for each of the events
+        float* mData;
     public:
         CircularBuffer(int sensor_event_type);
         void addEvent(const sensors_event_t& sensor_event);
         void printBuffer(String8& buffer) const;
         bool populateLastEvent(sensors_event_t *event);
         ~CircularBuffer();
+    private:
+        CircularBuffer(const CircularBuffer&);
+        CircularBuffer& operator=(const CircularBuffer&);
     };
 
     struct SensorRegistrationInfo {
@@ -352,6 +384,9 @@ class SensorService :
     void checkWakeLockState();
     void checkWakeLockStateLocked();
     bool isWakeLockAcquired();
+    // Returns in how many milliseconds the wake lock, no longer needed, is to be released, or -1
+    // if it isn't, after releasing it if that's now.
+    int releaseWakeLockIfDue();
     bool isWakeUpSensorEvent(const sensors_event_t& event) const;
 
     SensorRecord * getSensorRecord(int handle);
@@ -364,7 +399,8 @@ class SensorService :
     void resetAllWakeLockRefCounts();
 
     // Acquire or release wake_lock. If wake_lock is acquired, set the timeout in the looper to
-    // 5 seconds and wake the looper.
+    // 5 seconds and wake the looper. Releasing it only takes effect after
+    // WAKE_LOCK_RELEASE_DELAY_MS, unless it is acquired again before.
     void setWakeLockAcquiredLocked(bool acquire);
 
     // Send events from the event cache for this particular connection.
@@ -402,8 +438,18 @@ class SensorService :
     DefaultKeyedVector<int, SensorInterface*> mActiveVirtualSensors;
     SortedVector< wp<SensorEventConnection> > mActiveConnections;
     bool mWakeLockAcquired;
+    // Whether the wake lock is actually held, which it still is after it was released until
+    // mWakeLockReleaseTime.
+    bool mWakeLockHeld;
+    nsecs_t mWakeLockReleaseTime;
     sensors_event_t *mSensorEventBuffer, *mSensorEventScratch;
     SensorEventConnection const **mMapFlushEventsToConnections;
+    // The sensors with events in mSensorEventBuffer, so that threadLoop only has the connections
+    // registered for them filter the buffer. Only used by threadLoop.
+    SortedVector<int32_t> mSensorHandlesInBuffer;
+    // Records the polled events, when started with "dumpsys sensorservice record <name>"
+    SensorEventRecorder mRecorder;
+    SensorLatencyTracker mLatencyTracker;
     Mode mCurrentOperatingMode;
     // This packagaName is set when SensorService is in RESTRICTED or DATA_INJECTION mode. Only
     // applications with this packageName are allowed to activate/deactivate or call flush on
@@ -12,3 +12,34 @@ LOCAL_MODULE:= test-sensorservice
 LOCAL_MODULE_TAGS := optional
 
 include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	../Fusion.cpp \
+	FusionBenchmark.cpp
+
+LOCAL_CFLAGS:= -DLOG_TAG=\"FusionBenchmark\"
+
+LOCAL_SHARED_LIBRARIES := \
+	liblog libutils
+
+LOCAL_MODULE:= FusionBenchmark
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
+
+include $(CLEAR_VARS)
+
+LOCAL_SRC_FILES:= \
+	SensorReplayBenchmark.cpp
+
+LOCAL_SHARED_LIBRARIES := \
+	libcutils libutils libui libgui
+
+LOCAL_MODULE:= SensorReplayBenchmark
+
+LOCAL_MODULE_TAGS := optional
+
+include $(BUILD_EXECUTABLE)
@@ -0,0 +1,229 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Fusion benchmarks: the cost of the EKF steps on an IMU log, that is the
+ * prediction run for each gyro sample and the updates run for each
+ * accelerometer and magnetometer sample, and its accuracy, measured as the
+ * angle between the up vector of the estimate and the accelerometer's
+ * before each update.
+ *
+ * Without -f, the log is synthesized: a device rocking around its x axis,
+ * with a 200Hz gyro, a 100Hz accelerometer and a 50Hz magnetometer, all a
+ * little noisy. With -f, it's read from a file instead, one
+ * "timestampNs type x y z" sample per line, type being the sensor type of
+ * the sample: 1 (accelerometer), 2 (magnetic field) or 4 (gyroscope).
+ *
+ * usage: FusionBenchmark [-i iterations] [-f log]
+ */
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include <vector>
+
+#include <hardware/sensors.h>
+
+#include <utils/Timers.h>
+
+#include "../Fusion.h"
+
+using namespace android;
+
+// ---------------------------------------------------------------------------
+
+struct Sample {
+    nsecs_t timestamp;
+    int type;
+    vec3_t data;
+};
+
+static vec3_t noisy(float x, float y, float z, float noise) {
+    vec3_t v;
+    v.x = x + noise * (drand48() - 0.5f);
+    v.y = y + noise * (drand48() - 0.5f);
+    v.z = z + noise * (drand48() - 0.5f);
+    return v;
+}
+
+static void synthesizeLog(std::vector<Sample>* log) {
+    static const float AMPLITUDE = 0.5f;        // rad
+    static const float FREQUENCY = 0.5f;        // Hz
+    static const nsecs_t GYRO_PERIOD = 5000000;
+    static const nsecs_t DURATION = 60000000000LL;
+
+    srand48(0);
+    for (nsecs_t t = 0; t < DURATION; t += GYRO_PERIOD) {
+        const float seconds = t * 0.000000001f;
+        const float phase = 2 * float(M_PI) * FREQUENCY * seconds;
+        const float angle = AMPLITUDE * sinf(phase);
+        const float rate = AMPLITUDE * 2 * float(M_PI) * FREQUENCY * cosf(phase);
+        const float c = cosf(angle);
+        const float s = sinf(angle);
+
+        Sample sample;
+        sample.timestamp = t;
+        sample.type = SENSOR_TYPE_GYROSCOPE;
+        sample.data = noisy(rate, 0, 0, 0.01f);
+        log->push_back(sample);
+        if ((t / GYRO_PERIOD) % 2 == 0) {
+            sample.type = SENSOR_TYPE_ACCELEROMETER;
+            sample.data = noisy(0, 9.81f * s, 9.81f * c, 0.1f);
+            log->push_back(sample);
+        }
+        if ((t / GYRO_PERIOD) % 4 == 0) {
+            // 30uT north, 30uT down
+            sample.type = SENSOR_TYPE_MAGNETIC_FIELD;
+            sample.data = noisy(0, 30 * c - 30 * s, -30 * s - 30 * c, 1.0f);
+            log->push_back(sample);
+        }
+    }
+}
+
+static bool readLog(const char* path, std::vector<Sample>* log) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "could not open %s\n", path);
+        return false;
+    }
+    char line[256];
+    while (fgets(line, sizeof(line), file)) {
+        long long timestamp;
+        Sample sample;
+        if (sscanf(line, "%lld %d %f %f %f", &timestamp, &sample.type,
+                &sample.data.x, &sample.data.y, &sample.data.z) == 5) {
+            sample.timestamp = timestamp;
+            log->push_back(sample);
+        }
+    }
+    fclose(file);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+
+struct Stats {
+    nsecs_t gyroTime;
+    size_t numGyro;
+    nsecs_t accTime;
+    size_t numAcc;
+    nsecs_t magTime;
+    size_t numMag;
+    double upError;
+    size_t numUpErrors;
+
+    Stats() : gyroTime(0), numGyro(0), accTime(0), numAcc(0),
+            magTime(0), numMag(0), upError(0), numUpErrors(0) {}
+};
+
+static void run(const std::vector<Sample>& log, bool measureError, Stats* stats) {
+    static const float RAD2DEG = 180 / float(M_PI);
+    vec3_t up;
+    up.x = 0;
+    up.y = 0;
+    up.z = 1;
+
+    Fusion fusion;
+    nsecs_t gyroTime = 0;
+    for (size_t i = 0; i < log.size(); i++) {
+        const Sample& sample = log[i];
+        nsecs_t start;
+        switch (sample.type) {
+            case SENSOR_TYPE_GYROSCOPE:
+                if (gyroTime != 0) {
+                    const float dT = (sample.timestamp - gyroTime) * 0.000000001f;
+                    start = systemTime();
+                    fusion.handleGyro(sample.data, dT);
+                    stats->gyroTime += systemTime() - start;
+                    stats->numGyro++;
+                }
+                gyroTime = sample.timestamp;
+                break;
+            case SENSOR_TYPE_ACCELEROMETER:
+                if (measureError && fusion.hasEstimate()) {
+                    const vec3_t estimated(fusion.getRotationMatrix() * up);
+                    const float l = length(sample.data);
+                    if (l > 0) {
+                        const float d = dot_product(estimated, sample.data) / l;
+                        stats->upError += acosf(fminf(fmaxf(d, -1.0f), 1.0f)) * RAD2DEG;
+                        stats->numUpErrors++;
+                    }
+                }
+                start = systemTime();
+                fusion.handleAcc(sample.data);
+                stats->accTime += systemTime() - start;
+                stats->numAcc++;
+                break;
+            case SENSOR_TYPE_MAGNETIC_FIELD:
+                start = systemTime();
+                fusion.handleMag(sample.data);
+                stats->magTime += systemTime() - start;
+                stats->numMag++;
+                break;
+        }
+    }
+}
+
+static double average(nsecs_t total, size_t n) {
+    return n ? total / static_cast<double>(n) : 0.0;
+}
+
+int main(int argc, char** argv)
+{
+    size_t iterations = 10;
+    const char* path = NULL;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "i:f:")) != -1) {
+        switch (opt) {
+            case 'i':
+                iterations = strtoul(optarg, NULL, 0);
+                break;
+            case 'f':
+                path = optarg;
+                break;
+            default:
+                fprintf(stderr, "usage: %s [-i iterations] [-f log]\n", argv[0]);
+                return EXIT_FAILURE;
+        }
+    }
+
+    std::vector<Sample> log;
+    if (path) {
+        if (!readLog(path, &log)) {
+            return EXIT_FAILURE;
+        }
+    } else {
+        synthesizeLog(&log);
+    }
+
+    Stats accuracy;
+    run(log, true, &accuracy);
+    Stats cost;
+    for (size_t n = 0; n < iterations; n++) {
+        run(log, false, &cost);
+    }
+
+    printf("FusionBenchmark: %zu samples, %zu iterations\n", log.size(), iterations);
+    printf("%-16s %8.1fns/sample\n", "gyro (predict)", average(cost.gyroTime, cost.numGyro));
+    printf("%-16s %8.1fns/sample\n", "acc (update)", average(cost.accTime, cost.numAcc));
+    printf("%-16s %8.1fns/sample\n", "mag (update)", average(cost.magTime, cost.numMag));
+    printf("%-16s %8.3fdeg\n", "up error",
+            accuracy.numUpErrors ? accuracy.upError / accuracy.numUpErrors : 0.0);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,256 @@
+/*
+ * Copyright (C) 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * Replays a recording of sensor events through SensorService's data
+ * injection mode, at the timing of the polls it was recorded from, and
+ * measures the throughput and latency of their delivery: from their
+ * injection to their reception by a client registered for their sensors,
+ * which covers SensorService's routing, and with -v of the virtual sensors
+ * fed by them, which also covers the fusion.
+ *
+ * The recording is made, and SensorService put in data injection mode for
+ * the package the benchmark uses, with:
+ *
+ *   $ adb shell dumpsys sensorservice record sensors.rec
+ *   $ adb shell dumpsys sensorservice record_stop
+ *   $ adb shell dumpsys sensorservice data_injection SensorReplayBenchmark
+ *
+ * which leaves the recording in /data/system/sensorservice/sensors.rec, a
+ * name that can't be reused until the file is removed.
+ *
+ * The event timestamps are rewritten to the time they are injected at, the
+ * latency being the time they're received at minus that one.
+ *
+ * usage: SensorReplayBenchmark [-p package] [-s speed] [-v] recording
+ */
+
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <algorithm>
+#include <vector>
+
+#include <android/sensor.h>
+#include <gui/Sensor.h>
+#include <gui/SensorEventQueue.h>
+#include <gui/SensorManager.h>
+#include <utils/Mutex.h>
+#include <utils/Thread.h>
+#include <utils/Timers.h>
+
+#include "../SensorEventRecorder.h"
+
+using namespace android;
+
+struct Batch {
+    nsecs_t pollTime;
+    std::vector<sensors_event_t> events;
+};
+
+static bool readRecording(const char* path, std::vector<Batch>* batches) {
+    FILE* file = fopen(path, "r");
+    if (!file) {
+        fprintf(stderr, "could not open %s\n", path);
+        return false;
+    }
+    SensorEventRecorder::Header header;
+    if (fread(&header, sizeof(header), 1, file) != 1
+            || header.magic != uint32_t(SensorEventRecorder::MAGIC)
+            || header.version != uint32_t(SensorEventRecorder::VERSION)
+            || header.eventSize != sizeof(sensors_event_t)) {
+        fprintf(stderr, "%s is not a recording of this device\n", path);
+        fclose(file);
+        return false;
+    }
+    SensorEventRecorder::BatchHeader batchHeader;
+    while (fread(&batchHeader, sizeof(batchHeader), 1, file) == 1) {
+        Batch batch;
+        batch.pollTime = batchHeader.pollTime;
+        batch.events.resize(batchHeader.count);
+        if (fread(&batch.events[0], sizeof(sensors_event_t), batchHeader.count, file)
+                != batchHeader.count) {
+            // truncated recording, keep what was read
+            break;
+        }
+        batches->push_back(batch);
+    }
+    fclose(file);
+    return true;
+}
+
+// ---------------------------------------------------------------------------
+
+class Receiver : public Thread {
+public:
+    explicit Receiver(const sp<SensorEventQueue>& queue) : mQueue(queue) {}
+
+    void getLatencies(std::vector<nsecs_t>* raw, std::vector<nsecs_t>* virt) {
+        Mutex::Autolock _l(mLock);
+        *raw = mRawLatencies;
+        *virt = mVirtualLatencies;
+    }
+
+private:
+    virtual bool threadLoop() {
+        ASensorEvent buffer[16];
+        if (mQueue->waitForEvent() != NO_ERROR) {
+            return true;
+        }
+        ssize_t n;
+        while ((n = mQueue->read(buffer, 16)) > 0) {
+            const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+            Mutex::Autolock _l(mLock);
+            for (ssize_t i = 0; i < n; i++) {
+                if (buffer[i].type == SENSOR_TYPE_META_DATA) {
+                    continue;
+                }
+                // The virtual sensors' handles are the AOSP ones, such as '_rov'
+                std::vector<nsecs_t>& latencies(buffer[i].sensor > 0xFFFFFF ?
+                        mVirtualLatencies : mRawLatencies);
+                latencies.push_back(now - buffer[i].timestamp);
+            }
+        }
+        return true;
+    }
+
+    sp<SensorEventQueue> mQueue;
+    Mutex mLock;
+    std::vector<nsecs_t> mRawLatencies;
+    std::vector<nsecs_t> mVirtualLatencies;
+};
+
+static void printLatencies(const char* name, std::vector<nsecs_t>& latencies) {
+    if (latencies.empty()) {
+        printf("%-8s no events\n", name);
+        return;
+    }
+    std::sort(latencies.begin(), latencies.end());
+    const size_t n = latencies.size();
+    printf("%-8s n=%-8zu p50=%8.1fus p90=%8.1fus p99=%8.1fus max=%8.1fus\n",
+            name, n, latencies[n / 2] / 1000.0, latencies[n * 90 / 100] / 1000.0,
+            latencies[n * 99 / 100] / 1000.0, latencies[n - 1] / 1000.0);
+}
+
+int main(int argc, char** argv)
+{
+    const char* package = "SensorReplayBenchmark";
+    float speed = 1.0f;
+    bool enableVirtualSensors = false;
+    int opt;
+
+    while ((opt = getopt(argc, argv, "p:s:v")) != -1) {
+        switch (opt) {
+            case 'p':
+                package = optarg;
+                break;
+            case 's':
+                speed = strtof(optarg, NULL);
+                break;
+            case 'v':
+                enableVirtualSensors = true;
+                break;
+            default:
+                break;
+        }
+    }
+    if (optind + 1 != argc || !(speed > 0)) {
+        fprintf(stderr, "usage: %s [-p package] [-s speed] [-v] recording\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    std::vector<Batch> batches;
+    if (!readRecording(argv[optind], &batches)) {
+        return EXIT_FAILURE;
+    }
+    if (batches.empty()) {
+        fprintf(stderr, "%s has no events\n", argv[optind]);
+        return EXIT_FAILURE;
+    }
+
+    SensorManager mgr(String16(package));
+    if (!mgr.isDataInjectionEnabled()) {
+        fprintf(stderr, "sensorservice is not in data injection mode, run:\n"
+                "  dumpsys sensorservice data_injection %s\n", package);
+        return EXIT_FAILURE;
+    }
+
+    // Register for the recorded sensors, at their fastest rate
+    sp<SensorEventQueue> queue = mgr.createEventQueue(String8(package));
+    sp<SensorEventQueue> injector = mgr.createEventQueue(String8(package), 1);
+    if (queue == NULL || injector == NULL) {
+        fprintf(stderr, "could not create the event queues\n");
+        return EXIT_FAILURE;
+    }
+    Sensor const* const* list;
+    const ssize_t count = mgr.getSensorList(&list);
+    for (ssize_t i = 0; i < count; i++) {
+        bool recorded = false;
+        for (size_t j = 0; j < batches.size() && !recorded; j++) {
+            for (size_t k = 0; k < batches[j].events.size() && !recorded; k++) {
+                recorded = batches[j].events[k].sensor == list[i]->getHandle();
+            }
+        }
+        const bool virt = enableVirtualSensors && list[i]->getHandle() > 0xFFFFFF;
+        if (recorded || virt) {
+            queue->enableSensor(list[i]->getHandle(), list[i]->getMinDelay(), 0, 0);
+        }
+    }
+
+    sp<Receiver> receiver = new Receiver(queue);
+    receiver->run("SensorReplayReceiver");
+
+    size_t numInjected = 0;
+    const nsecs_t firstPollTime = batches[0].pollTime;
+    const nsecs_t start = systemTime(SYSTEM_TIME_MONOTONIC);
+    for (size_t i = 0; i < batches.size(); i++) {
+        const nsecs_t when = start + nsecs_t((batches[i].pollTime - firstPollTime) / speed);
+        const nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        if (when > now) {
+            usleep(useconds_t(ns2us(when - now)));
+        }
+        for (size_t j = 0; j < batches[i].events.size(); j++) {
+            ASensorEvent event;
+            memcpy(&event, &batches[i].events[j], sizeof(event));
+            if (event.type == SENSOR_TYPE_META_DATA) {
+                continue;
+            }
+            event.timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
+            if (injector->injectSensorEvent(event) == NO_ERROR) {
+                numInjected++;
+            }
+        }
+    }
+    const nsecs_t elapsed = systemTime(SYSTEM_TIME_MONOTONIC) - start;
+
+    // Let the last events through
+    usleep(500000);
+    receiver->requestExit();
+    queue->wake();
+    receiver->join();
+
+    std::vector<nsecs_t> raw, virt;
+    receiver->getLatencies(&raw, &virt);
+    printf("SensorReplayBenchmark: %zu batches, %zu events injected in %.3fs (%.1f events/s), "
+            "%zu received\n", batches.size(), numInjected, elapsed / 1e9,
+            elapsed ? numInjected * 1e9 / elapsed : 0.0, raw.size() + virt.size());
+    printLatencies("raw", raw);
+    printLatencies("virtual", virt);
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,119 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+// #define LOG_NDEBUG 0
+
+#include <inttypes.h>
+
+#include <utils/Log.h>
+#include <utils/String8.h>
+
+#include "AdaptivePhaseOffset.h"
+
+namespace android {
+
+AdaptivePhaseOffset::AdaptivePhaseOffset(nsecs_t defaultOffset) :
+    mDefaultOffset(defaultOffset),
+    mOffset(defaultOffset),
+    mNumDurations(0),
+    mNextDuration(0),
+    mNumLater(0),
+    mNumFallbacks(0) {}
+
+void AdaptivePhaseOffset::setDefaultOffset(nsecs_t offset) {
+    mDefaultOffset = offset;
+    mOffset = offset;
+    reset();
+}
+
+void AdaptivePhaseOffset::reset() {
+    mNumDurations = 0;
+    mNextDuration = 0;
+}
+
+// Returns offset's phase within the vsync period, in [0, period)
+static nsecs_t normalize(nsecs_t offset, nsecs_t period) {
+    offset %= period;
+    return offset < 0 ? offset + period : offset;
+}
+
+bool AdaptivePhaseOffset::addFrame(nsecs_t duration, nsecs_t period,
+        nsecs_t* outOffset) {
+    if (period <= 0) {
+        return false;
+    }
+
+    // The time between wake-up and the refresh the frame is meant for
+    const nsecs_t budget = period - normalize(mOffset, period);
+
+    if (mOffset != mDefaultOffset && duration + SAFETY_MARGIN / 2 > budget) {
+        // This frame came close to (or did) miss its refresh, so wake up at
+        // the configured offset again and start measuring anew
+        ALOGV("addFrame: %" PRId64 " ns frame with a %" PRId64 " ns budget, "
+                "back to %" PRId64 " ns", duration, budget, mDefaultOffset);
+        mOffset = mDefaultOffset;
+        mNumFallbacks++;
+        reset();
+        *outOffset = mOffset;
+        return true;
+    }
+
+    mDurations[mNextDuration] = duration;
+    mNextDuration = (mNextDuration + 1) % NUM_FRAMES;
+    if (mNumDurations < NUM_FRAMES) {
+        mNumDurations++;
+        if (mNumDurations < NUM_FRAMES) {
+            return false;
+        }
+    }
+
+    nsecs_t longest = 0;
+    for (size_t i = 0; i < NUM_FRAMES; i++) {
+        if (mDurations[i] > longest) {
+            longest = mDurations[i];
+        }
+    }
+
+    // Wake up just early enough for the longest recent frame to make it,
+    // but never earlier than the configured offset
+    nsecs_t offset = period - longest - SAFETY_MARGIN;
+    if (offset <= normalize(mDefaultOffset, period)) {
+        offset = mDefaultOffset;
+    }
+    const nsecs_t current = normalize(mOffset, period);
+    if (offset == mOffset || (normalize(offset, period) > current &&
+            normalize(offset, period) - current < MIN_ADJUSTMENT)) {
+        return false;
+    }
+
+    ALOGV("addFrame: longest frame %" PRId64 " ns, offset %" PRId64 " -> %"
+            PRId64 " ns", longest, mOffset, offset);
+    if (normalize(offset, period) > current) {
+        mNumLater++;
+    }
+    mOffset = offset;
+    reset();
+    *outOffset = mOffset;
+    return true;
+}
+
+void AdaptivePhaseOffset::dump(String8& result) const {
+    result.appendFormat("adaptive sf phase %" PRId64 " ns (configured %"
+            PRId64 " ns), moved later %u times, fell back %u times\n",
+            mOffset, mDefaultOffset, mNumLater, mNumFallbacks);
+}
+
+}; // namespace android
@@ -0,0 +1,85 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_ADAPTIVEPHASEOFFSET_H
+#define ANDROID_ADAPTIVEPHASEOFFSET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/Timers.h>
+
+namespace android {
+
+class String8;
+
+// AdaptivePhaseOffset picks the phase offset at which SurfaceFlinger wakes up
+// relative to the hardware vsync from how long its recent frames took, from
+// wake-up to the HWComposer commit. The later SurfaceFlinger wakes up, the
+// later it latches buffers, and so the more recent the content (and the input
+// it reflects) that makes it to the next refresh.
+//
+// It never picks an offset earlier than the configured one, so that the
+// configured one keeps bounding the worst case. It moves the offset later
+// only once a full window of frames fit in the time that would leave, but
+// gives up the extra time as soon as a single frame comes close to missing
+// its deadline. It is *NOT* thread-safe, and is only used from the main
+// thread.
+class AdaptivePhaseOffset {
+public:
+    AdaptivePhaseOffset(nsecs_t defaultOffset);
+
+    // setDefaultOffset changes the configured offset, which is also the
+    // earliest one that can be picked
+    void setDefaultOffset(nsecs_t offset);
+
+    // addFrame records how long a frame took from wake-up to commit. It
+    // returns true if the offset should change, in which case the new offset
+    // is returned in outOffset.
+    bool addFrame(nsecs_t duration, nsecs_t period, nsecs_t* outOffset);
+
+    nsecs_t getOffset() const { return mOffset; }
+
+    void dump(String8& result) const;
+
+private:
+    // Number of frames the offset is computed from
+    static const size_t NUM_FRAMES = 64;
+    // Time kept between the longest recent frame and the deadline, to
+    // absorb scheduling jitter and the wake-up latency, which the measured
+    // durations don't include
+    static const nsecs_t SAFETY_MARGIN = 2000000;
+    // The offset is only moved later by at least this much, so that the
+    // DispSync listener isn't re-registered for every small variation
+    static const nsecs_t MIN_ADJUSTMENT = 500000;
+
+    void reset();
+
+    nsecs_t mDefaultOffset;
+    nsecs_t mOffset;
+
+    nsecs_t mDurations[NUM_FRAMES];
+    size_t mNumDurations;
+    size_t mNextDuration;
+
+    // Counters for dump()
+    uint32_t mNumLater;
+    uint32_t mNumFallbacks;
+};
+
+}; // namespace android
+
+#endif // ANDROID_ADAPTIVEPHASEOFFSET_H
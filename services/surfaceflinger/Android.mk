@@ -5,19 +5,28 @@ LOCAL_CLANG := true
 
 LOCAL_ADDITIONAL_DEPENDENCIES := $(LOCAL_PATH)/Android.mk
 LOCAL_SRC_FILES := \
+    AdaptivePhaseOffset.cpp \
     Client.cpp \
     DisplayDevice.cpp \
     DispSync.cpp \
     EventControlThread.cpp \
     EventThread.cpp \
+    FlatteningCache.cpp \
+    FrameTrace.cpp \
     FrameTracker.cpp \
+    JankTracker.cpp \
     Layer.cpp \
     LayerDim.cpp \
+    LayerMemoryBudget.cpp \
     MessageQueue.cpp \
     MonitoredProducer.cpp \
+    ReclaimThread.cpp \
+    RegionRecorder.cpp \
+    SchedulingPolicy.cpp \
     SurfaceFlinger.cpp \
     SurfaceFlingerConsumer.cpp \
     Transform.cpp \
+    WorkloadHint.cpp \
     DisplayHardware/FramebufferSurface.cpp \
     DisplayHardware/HWComposer.cpp \
     DisplayHardware/PowerHAL.cpp \
@@ -30,6 +39,7 @@ LOCAL_SRC_FILES := \
     RenderEngine/Program.cpp \
     RenderEngine/ProgramCache.cpp \
     RenderEngine/GLExtensions.cpp \
+    RenderEngine/GpuTimer.cpp \
     RenderEngine/RenderEngine.cpp \
     RenderEngine/Texture.cpp \
     RenderEngine/GLES10RenderEngine.cpp \
@@ -63,6 +73,13 @@ ifeq ($(TARGET_RUNNING_WITHOUT_SYNC_FRAMEWORK),true)
     LOCAL_CFLAGS += -DRUNNING_WITHOUT_SYNC_FRAMEWORK
 endif
 
+# File in which the compiled GLES programs are kept across boots, see
+# RenderEngine/ProgramCache.cpp; it must be in a directory surfaceflinger
+# can write to.
+ifneq ($(SF_PROGRAM_BINARY_CACHE_FILE),)
+    LOCAL_CFLAGS += -DPROGRAM_BINARY_CACHE_FILE=\"$(SF_PROGRAM_BINARY_CACHE_FILE)\"
+endif
+
 # See build/target/board/generic/BoardConfig.mk for a description of this setting.
 ifneq ($(VSYNC_EVENT_PHASE_OFFSET_NS),)
     LOCAL_CFLAGS += -DVSYNC_EVENT_PHASE_OFFSET_NS=$(VSYNC_EVENT_PHASE_OFFSET_NS)
@@ -35,7 +35,8 @@ const String16 sAccessSurfaceFlinger("android.permission.ACCESS_SURFACE_FLINGER"
 // ---------------------------------------------------------------------------
 
 Client::Client(const sp<SurfaceFlinger>& flinger)
-    : mFlinger(flinger)
+    : mFlinger(flinger),
+      mPid(IPCThreadState::self()->getCallingPid())
 {
 }
 
@@ -173,5 +174,17 @@ status_t Client::getLayerFrameStats(const sp<IBinder>& handle, FrameStats* outSt
     return NO_ERROR;
 }
 
+status_t Client::getLayerFrameStatsSummary(const sp<IBinder>& handle,
+        FrameStatsSummary* outSummary) const {
+    sp<Layer> layer = getLayerUser(handle);
+    if (layer == NULL) {
+        return NAME_NOT_FOUND;
+    }
+    FrameStats stats;
+    layer->getFrameStats(&stats);
+    stats.summarize(outSummary);
+    return NO_ERROR;
+}
+
 // ---------------------------------------------------------------------------
 }; // namespace android
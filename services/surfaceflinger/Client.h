@@ -50,6 +50,9 @@ public:
 
     sp<Layer> getLayerUser(const sp<IBinder>& handle) const;
 
+    // the process that created this client
+    pid_t getPid() const { return mPid; }
+
 private:
     // ISurfaceComposerClient interface
     virtual status_t createSurface(
@@ -64,11 +67,15 @@ private:
 
     virtual status_t getLayerFrameStats(const sp<IBinder>& handle, FrameStats* outStats) const;
 
+    virtual status_t getLayerFrameStatsSummary(const sp<IBinder>& handle,
+            FrameStatsSummary* outSummary) const;
+
     virtual status_t onTransact(
         uint32_t code, const Parcel& data, Parcel* reply, uint32_t flags);
 
     // constant
     sp<SurfaceFlinger> mFlinger;
+    const pid_t mPid;
 
     // protected by mLock
     DefaultKeyedVector< wp<IBinder>, wp<Layer> > mLayers;
@@ -20,6 +20,9 @@
 #define __STDC_LIMIT_MACROS
 
 #include <math.h>
+#include <stdlib.h>
+
+#include <algorithm>
 
 #include <cutils/log.h>
 
@@ -49,6 +52,21 @@ static const nsecs_t kErrorThreshold = 160000000000;    // 400 usec squared
 // vsync event.
 static const int64_t kPresentTimeOffset = PRESENT_TIME_OFFSET_FROM_VSYNC_NS;
 
+// Resync samples further than this from the fitted model are always accepted
+// as inliers, however consistent the other samples are.  It also is how far
+// recent vsync intervals must be from the estimated period to be taken as a
+// refresh rate change.
+static const nsecs_t kMinOutlierDistance = 100000;      // 100 usec
+
+// This is the root mean square distance between the resync samples and the
+// fitted model above which the model isn't trusted, and more hardware vsync
+// events are requested.
+static const nsecs_t kFitErrorThreshold = 200000;       // 200 usec
+
+// A model fitted without outliers and closer than this is taken as stable,
+// and hardware vsync is then turned off sooner once it's no longer needed.
+static const nsecs_t kStableFitError = 50000;           // 50 usec
+
 class DispSyncThread: public Thread {
 public:
 
@@ -288,6 +306,10 @@ private:
 };
 
 DispSync::DispSync() :
+        mModelUpdated(false),
+        mFitError(0),
+        mNumOutliers(0),
+        mNumModelRestarts(0),
         mRefreshSkipCount(0),
         mThread(new DispSyncThread()) {
 
@@ -316,6 +338,7 @@ void DispSync::reset() {
     mNumResyncSamples = 0;
     mFirstResyncSample = 0;
     mNumResyncSamplesSincePresent = 0;
+    mModelUpdated = false;
     resetErrorLocked();
 }
 
@@ -340,12 +363,13 @@ bool DispSync::addPresentFence(const sp<Fence>& fence) {
 
     updateErrorLocked();
 
-    return mPeriod == 0 || mError > kErrorThreshold;
+    return !mModelUpdated || mError > kErrorThreshold;
 }
 
 void DispSync::beginResync() {
     Mutex::Autolock lock(mMutex);
 
+    mModelUpdated = false;
     mNumResyncSamples = 0;
 }
 
@@ -376,7 +400,7 @@ bool DispSync::addResyncSample(nsecs_t timestamp) {
         return mThread->hasAnyEventListeners();
     }
 
-    return mPeriod == 0 || mError > kErrorThreshold;
+    return !mModelUpdated || mError > kErrorThreshold;
 }
 
 void DispSync::endResync() {
@@ -414,47 +438,171 @@ nsecs_t DispSync::getPeriod() {
     return mPeriod;
 }
 
-void DispSync::updateModelLocked() {
-    if (mNumResyncSamples >= MIN_RESYNC_SAMPLES_FOR_UPDATE) {
-        nsecs_t durationSum = 0;
-        for (size_t i = 1; i < mNumResyncSamples; i++) {
-            size_t idx = (mFirstResyncSample + i) % MAX_RESYNC_SAMPLES;
-            size_t prev = (idx + MAX_RESYNC_SAMPLES - 1) % MAX_RESYNC_SAMPLES;
-            durationSum += mResyncSamples[idx] - mResyncSamples[prev];
+// Fits sample = base + period * index by least squares over the samples
+// selected by inliers.  base is relative to samples[0].
+static bool fitVsyncModel(const nsecs_t* samples, const int64_t* indices,
+        const bool* inliers, size_t count, double* outPeriod,
+        double* outBase) {
+    double sumX = 0;
+    double sumY = 0;
+    size_t n = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (inliers[i]) {
+            sumX += double(indices[i]);
+            sumY += double(samples[i] - samples[0]);
+            n++;
         }
+    }
+    if (n < 2) {
+        return false;
+    }
 
-        mPeriod = durationSum / (mNumResyncSamples - 1);
-
-        double sampleAvgX = 0;
-        double sampleAvgY = 0;
-        double scale = 2.0 * M_PI / double(mPeriod);
-        for (size_t i = 0; i < mNumResyncSamples; i++) {
-            size_t idx = (mFirstResyncSample + i) % MAX_RESYNC_SAMPLES;
-            nsecs_t sample = mResyncSamples[idx];
-            double samplePhase = double(sample % mPeriod) * scale;
-            sampleAvgX += cos(samplePhase);
-            sampleAvgY += sin(samplePhase);
+    const double avgX = sumX / double(n);
+    const double avgY = sumY / double(n);
+    double sumXX = 0;
+    double sumXY = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (inliers[i]) {
+            double dx = double(indices[i]) - avgX;
+            double dy = double(samples[i] - samples[0]) - avgY;
+            sumXX += dx * dx;
+            sumXY += dx * dy;
         }
+    }
+    if (sumXX == 0) {
+        return false;
+    }
 
-        sampleAvgX /= double(mNumResyncSamples);
-        sampleAvgY /= double(mNumResyncSamples);
+    *outPeriod = sumXY / sumXX;
+    *outBase = avgY - *outPeriod * avgX;
+    return true;
+}
 
-        mPhase = nsecs_t(atan2(sampleAvgY, sampleAvgX) / scale);
+void DispSync::updateModelLocked() {
+    if (mNumResyncSamples < MIN_RESYNC_SAMPLES_FOR_UPDATE) {
+        return;
+    }
 
-        if (mPhase < 0) {
-            mPhase += mPeriod;
+    const size_t count = mNumResyncSamples;
+    nsecs_t samples[MAX_RESYNC_SAMPLES];
+    for (size_t i = 0; i < count; i++) {
+        samples[i] = mResyncSamples[(mFirstResyncSample + i) %
+                MAX_RESYNC_SAMPLES];
+    }
+
+    // The median interval between consecutive samples is a first estimate
+    // of the period that isn't thrown off by a missed or late vsync event.
+    nsecs_t intervals[MAX_RESYNC_SAMPLES];
+    for (size_t i = 1; i < count; i++) {
+        intervals[i - 1] = samples[i] - samples[i - 1];
+    }
+    std::sort(intervals, intervals + count - 1);
+    const nsecs_t interval = intervals[(count - 2) / 2];
+    if (interval <= 0) {
+        return;
+    }
+
+    // If the most recent intervals all disagree with it, the refresh rate
+    // has changed: start over from the samples taken since.
+    if (count > MIN_RESYNC_SAMPLES_FOR_UPDATE) {
+        bool rateChanged = true;
+        for (size_t i = count - MIN_RESYNC_SAMPLES_FOR_UPDATE + 1; i < count;
+                i++) {
+            nsecs_t delta = samples[i] - samples[i - 1];
+            nsecs_t multiple = ((delta + interval / 2) / interval) * interval;
+            if (llabs(delta - multiple) <= kMinOutlierDistance) {
+                rateChanged = false;
+                break;
+            }
+        }
+        if (rateChanged) {
+            ALOGD("updateModelLocked: vsync interval moved away from %" PRId64
+                    " ns, restarting the model", interval);
+            mFirstResyncSample = (mFirstResyncSample + count -
+                    MIN_RESYNC_SAMPLES_FOR_UPDATE) % MAX_RESYNC_SAMPLES;
+            mNumResyncSamples = MIN_RESYNC_SAMPLES_FOR_UPDATE;
+            mNumModelRestarts++;
+            updateModelLocked();
+            return;
         }
+    }
+
+    // Number the samples by the vsync they belong to, so that missed events
+    // don't bias the period, and fit a line through them.
+    int64_t indices[MAX_RESYNC_SAMPLES];
+    bool inliers[MAX_RESYNC_SAMPLES];
+    for (size_t i = 0; i < count; i++) {
+        indices[i] = llround(double(samples[i] - samples[0]) / double(interval));
+        // Two samples for the same vsync can't both be right
+        inliers[i] = i == 0 || indices[i] != indices[i - 1];
+    }
+
+    double period = 0;
+    double base = 0;
+    if (!fitVsyncModel(samples, indices, inliers, count, &period, &base)) {
+        return;
+    }
 
-        if (kTraceDetailedInfo) {
-            ATRACE_INT64("DispSync:Period", mPeriod);
-            ATRACE_INT64("DispSync:Phase", mPhase);
+    // Reject the samples that are far off the line compared to the others
+    // (e.g. a vsync interrupt that was handled late), and fit again without
+    // them.  The spread is estimated from the median absolute residual.
+    double residuals[MAX_RESYNC_SAMPLES];
+    size_t numResiduals = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (inliers[i]) {
+            residuals[numResiduals++] = fabs(double(samples[i] - samples[0]) -
+                    (base + period * double(indices[i])));
         }
+    }
+    std::sort(residuals, residuals + numResiduals);
+    const double sigma = 1.4826 * residuals[numResiduals / 2];
+    const double maxDistance = std::max(4.0 * sigma,
+            double(kMinOutlierDistance));
+
+    size_t numOutliers = count - numResiduals;
+    for (size_t i = 0; i < count; i++) {
+        if (inliers[i] && fabs(double(samples[i] - samples[0]) -
+                (base + period * double(indices[i]))) > maxDistance) {
+            inliers[i] = false;
+            numOutliers++;
+        }
+    }
+    if (numOutliers > count - numResiduals &&
+            !fitVsyncModel(samples, indices, inliers, count, &period, &base)) {
+        return;
+    }
 
-        // Artificially inflate the period if requested.
-        mPeriod += mPeriod * mRefreshSkipCount;
+    double sqErrSum = 0;
+    size_t numInliers = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (inliers[i]) {
+            double err = double(samples[i] - samples[0]) -
+                    (base + period * double(indices[i]));
+            sqErrSum += err * err;
+            numInliers++;
+        }
+    }
+    mFitError = nsecs_t(sqrt(sqErrSum / double(numInliers)));
+    mNumOutliers = numOutliers;
+    mModelUpdated = numInliers >= MIN_RESYNC_SAMPLES_FOR_UPDATE &&
+            mFitError < kFitErrorThreshold;
+
+    mPeriod = nsecs_t(period + 0.5);
+    mPhase = (samples[0] + nsecs_t(base)) % mPeriod;
+    if (mPhase < 0) {
+        mPhase += mPeriod;
+    }
 
-        mThread->updateModel(mPeriod, mPhase);
+    if (kTraceDetailedInfo) {
+        ATRACE_INT64("DispSync:Period", mPeriod);
+        ATRACE_INT64("DispSync:Phase", mPhase);
+        ATRACE_INT64("DispSync:FitError", mFitError);
     }
+
+    // Artificially inflate the period if requested.
+    mPeriod += mPeriod * mRefreshSkipCount;
+
+    mThread->updateModel(mPeriod, mPhase);
 }
 
 void DispSync::updateErrorLocked() {
@@ -507,6 +655,16 @@ nsecs_t DispSync::computeNextRefresh(int periodOffset) const {
     return (((now - mPhase) / mPeriod) + periodOffset + 1) * mPeriod + mPhase;
 }
 
+pid_t DispSync::getThreadId() const {
+    return mThread->getTid();
+}
+
+bool DispSync::isModelStable() const {
+    Mutex::Autolock lock(mMutex);
+    return mModelUpdated && mNumOutliers == 0 &&
+            mFitError < kStableFitError;
+}
+
 void DispSync::dump(String8& result) const {
     Mutex::Autolock lock(mMutex);
     result.appendFormat("present fences are %s\n",
@@ -520,6 +678,9 @@ void DispSync::dump(String8& result) const {
             mNumResyncSamplesSincePresent, MAX_RESYNC_SAMPLES_WITHOUT_PRESENT);
     result.appendFormat("mNumResyncSamples: %zd (max %d)\n",
             mNumResyncSamples, MAX_RESYNC_SAMPLES);
+    result.appendFormat("model %s: fit error %.1f us, %zu outliers rejected, "
+            "%u restarts\n", mModelUpdated ? "trusted" : "not trusted",
+            mFitError / 1000.0, mNumOutliers, mNumModelRestarts);
 
     result.appendFormat("mResyncSamples:\n");
     nsecs_t previous = -1;
@@ -127,6 +127,13 @@ public:
     // the refresh after next. etc.
     nsecs_t computeNextRefresh(int periodOffset) const;
 
+    // getThreadId returns the tid of the thread that calls the listeners.
+    pid_t getThreadId() const;
+
+    // isModelStable returns true if the model was fitted to the resync
+    // samples closely enough that hardware vsync can be turned off early.
+    bool isModelStable() const;
+
     // dump appends human-readable debug info to the result string.
     void dump(String8& result) const;
 
@@ -162,6 +169,19 @@ private:
     size_t mNumResyncSamples;
     int mNumResyncSamplesSincePresent;
 
+    // mModelUpdated is whether the model was fitted to enough resync samples
+    // since the last beginResync, closely enough to be trusted.
+    bool mModelUpdated;
+
+    // mFitError is the root mean square distance of the resync samples used
+    // to the model, and mNumOutliers the number of samples left out of it.
+    nsecs_t mFitError;
+    size_t mNumOutliers;
+
+    // mNumModelRestarts counts the refresh rate changes detected in the
+    // resync samples.
+    uint32_t mNumModelRestarts;
+
     // These member variables store information about the present fences used
     // to validate the currently computed model.
     sp<Fence> mPresentFences[NUM_PRESENT_SAMPLES];
@@ -31,6 +31,7 @@
 
 #include <hardware/hwcomposer_defs.h>
 
+#include "FlatteningCache.h"
 #include "Transform.h"
 
 struct ANativeWindow;
@@ -54,6 +55,10 @@ public:
     // region in screen space
     Region undefinedRegion;
     bool lastCompositionHadVisibleLayers;
+    // static framebuffer layers composited ahead of time
+    mutable FlatteningCache flatteningCache;
+    // the layers of the last HWC work list, see HWComposer::reuseGeometry
+    mutable Vector< wp<Layer> > hwcWorkListLayers;
 
     enum DisplayType {
         DISPLAY_ID_INVALID = -1,
@@ -570,6 +570,12 @@ status_t HWComposer::createWorkList(int32_t id, size_t numLayers) {
 
     if (mHwc) {
         DisplayData& disp(mDisplayData[id]);
+        disp.previousLayers.clear();
+        if (disp.list != NULL) {
+            disp.previousLayers.appendArray(disp.list->hwLayers,
+                    disp.list->numHwLayers);
+        }
+        disp.geometryChanges++;
         if (hwcHasApiVersion(mHwc, HWC_DEVICE_API_VERSION_1_1)) {
             // we need space for the HWC_FRAMEBUFFER_TARGET
             numLayers++;
@@ -619,6 +625,46 @@ status_t HWComposer::createWorkList(int32_t id, size_t numLayers) {
     return NO_ERROR;
 }
 
+// Returns whether the HWC can keep what it decided for layer a, if it's
+// given layer b instead
+static bool isSameGeometry(const hwc_layer_1_t& a, const hwc_layer_1_t& b) {
+    // HWC_IS_CURSOR_LAYER is set again after the geometry, for every frame
+    const uint32_t flagsMask = ~static_cast<uint32_t>(HWC_IS_CURSOR_LAYER);
+    // a sideband layer keeps its type until its geometry is reset
+    return a.compositionType != HWC_SIDEBAND &&
+            (a.flags & flagsMask) == (b.flags & flagsMask) &&
+            a.transform == b.transform &&
+            a.blending == b.blending &&
+            memcmp(&a.sourceCropf, &b.sourceCropf, sizeof(a.sourceCropf)) == 0 &&
+            memcmp(&a.displayFrame, &b.displayFrame, sizeof(a.displayFrame)) == 0 &&
+            a.planeAlpha == b.planeAlpha;
+}
+
+bool HWComposer::reuseGeometry(int32_t id) {
+    if (uint32_t(id)>31 || !mAllocatedDisplayIDs.hasBit(id)) {
+        return false;
+    }
+    DisplayData& disp(mDisplayData[id]);
+    if (!mHwc || disp.list == NULL ||
+            disp.previousLayers.size() != disp.list->numHwLayers) {
+        return false;
+    }
+    for (size_t i=0 ; i<disp.list->numHwLayers ; i++) {
+        if (!isSameGeometry(disp.previousLayers[i], disp.list->hwLayers[i])) {
+            return false;
+        }
+    }
+    for (size_t i=0 ; i<disp.list->numHwLayers ; i++) {
+        hwc_layer_1_t& l = disp.list->hwLayers[i];
+        l.compositionType = disp.previousLayers[i].compositionType;
+        l.hints = disp.previousLayers[i].hints;
+    }
+    disp.list->flags &= ~HWC_GEOMETRY_CHANGED;
+    disp.geometryChanges--;
+    disp.geometryReuses++;
+    return true;
+}
+
 status_t HWComposer::setFramebufferTarget(int32_t id,
         const sp<Fence>& acquireFence, const sp<GraphicBuffer>& buf) {
     if (uint32_t(id)>31 || !mAllocatedDisplayIDs.hasBit(id)) {
@@ -1182,6 +1228,9 @@ void HWComposer::dump(String8& result) const {
                 result.appendFormat(
                         "  numHwLayers=%zu, flags=%08x\n",
                         disp.list->numHwLayers, disp.list->flags);
+                result.appendFormat(
+                        "  geometry changes=%" PRIu64 ", reused=%" PRIu64 "\n",
+                        disp.geometryChanges, disp.geometryReuses);
 
                 result.append(
                         "    type   |  handle  | hint | flag | tr | blnd |   format    |     source crop (l,t,r,b)      |          frame         | name \n"
@@ -1316,6 +1365,7 @@ HWComposer::DisplayData::DisplayData()
     framebufferTarget(NULL), fbTargetHandle(0),
     lastRetireFence(Fence::NO_FENCE), lastDisplayFence(Fence::NO_FENCE),
     outbufHandle(NULL), outbufAcquireFence(Fence::NO_FENCE),
+    geometryChanges(0), geometryReuses(0),
     events(0)
 {}
 HWComposer::DisplayData::~DisplayData() {
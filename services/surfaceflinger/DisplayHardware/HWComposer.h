@@ -109,6 +109,13 @@ public:
     // create a work list for numLayers layer. sets HWC_GEOMETRY_CHANGED.
     status_t createWorkList(int32_t id, size_t numLayers);
 
+    // reuseGeometry is called once the geometry of the layers of a work list
+    // is set, if they are the same layers as in the previous list. If none of
+    // their geometry changed either, it clears HWC_GEOMETRY_CHANGED and gives
+    // the layers back the composition types the HWC picked for them, so that
+    // it can keep its decisions. Returns whether the geometry was reused.
+    bool reuseGeometry(int32_t id);
+
     bool supportsFramebufferTarget() const;
 
     // does this display have layers handled by HWC
@@ -350,6 +357,10 @@ private:
                                     // effect on screen
         buffer_handle_t outbufHandle;
         sp<Fence> outbufAcquireFence;
+        // the layers of the list createWorkList replaced, for reuseGeometry
+        Vector<hwc_layer_1_t> previousLayers;
+        uint64_t geometryChanges;
+        uint64_t geometryReuses;
 
         // protected by mEventControlLock
         int32_t events;
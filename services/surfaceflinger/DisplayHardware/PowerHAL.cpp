@@ -30,6 +30,10 @@ namespace android {
 // ---------------------------------------------------------------------------
 
 status_t PowerHAL::vsyncHint(bool enabled) {
+    return powerHint(POWER_HINT_VSYNC, enabled ? 1 : 0);
+}
+
+status_t PowerHAL::powerHint(int hintId, int data) {
     Mutex::Autolock _l(mlock);
     if (mPowerManager == NULL) {
         const String16 serviceName("power");
@@ -39,7 +43,7 @@ status_t PowerHAL::vsyncHint(bool enabled) {
         }
         mPowerManager = interface_cast<IPowerManager>(bs);
     }
-    status_t status = mPowerManager->powerHint(POWER_HINT_VSYNC, enabled ? 1 : 0);
+    status_t status = mPowerManager->powerHint(hintId, data);
     if(status == DEAD_OBJECT) {
         mPowerManager = NULL;
     }
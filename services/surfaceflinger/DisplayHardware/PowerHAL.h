@@ -32,6 +32,9 @@ class PowerHAL
 public:
     status_t vsyncHint(bool enabled);
 
+    // powerHint sends any hint to the power HAL through the power manager
+    status_t powerHint(int hintId, int data);
+
 private:
     sp<IPowerManager> mPowerManager;
     Mutex mlock;
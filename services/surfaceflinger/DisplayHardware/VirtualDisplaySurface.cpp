@@ -37,6 +37,21 @@ static const bool sForceHwcCopy = false;
 #define VDS_LOGV(msg, ...) ALOGV("[%s] " msg, \
         mDisplayName.string(), ##__VA_ARGS__)
 
+// Returns whether GLES renders to buffers of the given format, in which case
+// a sink taking them gains nothing from having the HWC copy GLES frames
+static bool isGlesRenderable(uint32_t format) {
+    switch (format) {
+        case HAL_PIXEL_FORMAT_RGBA_8888:
+        case HAL_PIXEL_FORMAT_RGBX_8888:
+        case HAL_PIXEL_FORMAT_RGB_888:
+        case HAL_PIXEL_FORMAT_RGB_565:
+        case HAL_PIXEL_FORMAT_BGRA_8888:
+            return true;
+        default:
+            return false;
+    }
+}
+
 static const char* dbgCompositionTypeStr(DisplaySurface::CompositionType type) {
     switch (type) {
         case DisplaySurface::COMPOSITION_UNKNOWN: return "UNKNOWN";
@@ -93,7 +108,11 @@ VirtualDisplaySurface::VirtualDisplaySurface(HWComposer& hwc, int32_t dispId,
     mDefaultOutputFormat = sinkFormat;
 #endif
     mOutputFormat = mDefaultOutputFormat;
-    if (sForceHwcCopy)
+    // The HWC copy is only there to convert GLES frames to a format GLES
+    // can't render to, so frames for a sink that takes RGB are rendered
+    // straight into its buffers
+    mForceHwcCopy = sForceHwcCopy && !isGlesRenderable(mDefaultOutputFormat);
+    if (mForceHwcCopy)
     {
         int scratchFormat;
         bqProducer->query(NATIVE_WINDOW_FORMAT, &scratchFormat);
@@ -136,7 +155,7 @@ status_t VirtualDisplaySurface::prepareFrame(CompositionType compositionType) {
     mDbgState = DBG_STATE_PREPARED;
 
     mCompositionType = compositionType;
-    if (sForceHwcCopy && mCompositionType == COMPOSITION_GLES) {
+    if (mForceHwcCopy && mCompositionType == COMPOSITION_GLES) {
         // Some hardware can do RGB->YUV conversion more efficiently in hardware
         // controlled by HWC than in hardware controlled by the video encoder.
         // Forcing GLES-composed frames to go through an extra copy by the HWC
@@ -273,7 +292,11 @@ void VirtualDisplaySurface::onFrameCommitted() {
     resetPerFrameState();
 }
 
-void VirtualDisplaySurface::dumpAsString(String8& /* result */) const {
+void VirtualDisplaySurface::dumpAsString(String8& result) const {
+    result.appendFormat("   VDS: %ux%u, format=%u, HWC copy of GLES frames=%s, "
+            "last composition=%s\n", mSinkBufferWidth, mSinkBufferHeight,
+            mDefaultOutputFormat, mForceHwcCopy ? "yes" : "no",
+            dbgCompositionTypeStr(mDbgLastCompositionType));
 }
 
 void VirtualDisplaySurface::resizeBuffers(const uint32_t w, const uint32_t h) {
@@ -146,6 +146,9 @@ private:
     const String8 mDisplayName;
     sp<IGraphicBufferProducer> mSource[2]; // indexed by SOURCE_*
     uint32_t mDefaultOutputFormat;
+    // Whether GLES-only frames are copied to the sink by the HWC, see
+    // prepareFrame()
+    bool mForceHwcCopy;
 
     //
     // Inter-frame state
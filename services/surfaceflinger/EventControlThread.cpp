@@ -14,22 +14,65 @@
  * limitations under the License.
  */
 
+#include <algorithm>
+
 #include "EventControlThread.h"
 #include "SurfaceFlinger.h"
 
 namespace android {
 
+// Bounds of how long hardware vsync is kept on for after it's last needed.
+static const nsecs_t kMinHoldTime = 50000000;   // 50 ms
+static const nsecs_t kMaxHoldTime = 1000000000; // 1 s
+
 EventControlThread::EventControlThread(const sp<SurfaceFlinger>& flinger):
         mFlinger(flinger),
-        mVsyncEnabled(false) {
+        mVsyncEnabled(false),
+        mOffTime(0),
+        mHoldTime(kMinHoldTime),
+        mNumHalCalls(0),
+        mNumDebounced(0) {
 }
 
 void EventControlThread::setVsyncEnabled(bool enabled) {
     Mutex::Autolock lock(mMutex);
+    if (enabled && mOffTime != 0) {
+        // Hardware vsync is wanted again before the deferred disable took
+        // effect; keep it on for longer next time.
+        mNumDebounced++;
+        mHoldTime = std::min(mHoldTime * 2, kMaxHoldTime);
+    }
+    mOffTime = 0;
     mVsyncEnabled = enabled;
     mCond.signal();
 }
 
+void EventControlThread::disableVsyncDeferred(bool modelStable) {
+    Mutex::Autolock lock(mMutex);
+    if (!mVsyncEnabled || mOffTime != 0) {
+        return;
+    }
+    if (modelStable) {
+        mHoldTime = std::max(mHoldTime / 2, kMinHoldTime);
+    }
+    mOffTime = systemTime(SYSTEM_TIME_MONOTONIC) + mHoldTime;
+    mCond.signal();
+}
+
+void EventControlThread::dump(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    result.appendFormat("EventControlThread: hw vsync %s",
+            mVsyncEnabled ? "on" : "off");
+    if (mOffTime != 0) {
+        nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+        result.appendFormat(" (off in %.1f ms)",
+                ns2us(std::max(mOffTime - now, nsecs_t(0))) / 1000.0);
+    }
+    result.appendFormat(", hold time %.1f ms\n", ns2us(mHoldTime) / 1000.0);
+    result.appendFormat("  %u HAL calls, %u toggles avoided\n",
+            mNumHalCalls, mNumDebounced);
+}
+
 bool EventControlThread::threadLoop() {
     Mutex::Autolock lock(mMutex);
 
@@ -37,9 +80,25 @@ bool EventControlThread::threadLoop() {
 
     mFlinger->eventControl(HWC_DISPLAY_PRIMARY, SurfaceFlinger::EVENT_VSYNC,
             mVsyncEnabled);
+    mNumHalCalls++;
 
     while (true) {
-        status_t err = mCond.wait(mMutex);
+        status_t err;
+        if (mOffTime != 0) {
+            nsecs_t now = systemTime(SYSTEM_TIME_MONOTONIC);
+            if (now >= mOffTime) {
+                mOffTime = 0;
+                mVsyncEnabled = false;
+                err = NO_ERROR;
+            } else {
+                err = mCond.waitRelative(mMutex, mOffTime - now);
+                if (err == TIMED_OUT) {
+                    continue;
+                }
+            }
+        } else {
+            err = mCond.wait(mMutex);
+        }
         if (err != NO_ERROR) {
             ALOGE("error waiting for new events: %s (%d)",
                 strerror(-err), err);
@@ -50,6 +109,7 @@ bool EventControlThread::threadLoop() {
             mFlinger->eventControl(HWC_DISPLAY_PRIMARY,
                     SurfaceFlinger::EVENT_VSYNC, mVsyncEnabled);
             vsyncEnabled = mVsyncEnabled;
+            mNumHalCalls++;
         }
     }
 
@@ -20,7 +20,9 @@
 #include <stddef.h>
 
 #include <utils/Mutex.h>
+#include <utils/String8.h>
 #include <utils/Thread.h>
+#include <utils/Timers.h>
 
 namespace android {
 
@@ -32,17 +34,39 @@ public:
     EventControlThread(const sp<SurfaceFlinger>& flinger);
     virtual ~EventControlThread() {}
 
+    // setVsyncEnabled turns hardware vsync on or off right away.  Turning it
+    // on also cancels any pending deferred disable.
     void setVsyncEnabled(bool enabled);
+
+    // disableVsyncDeferred turns hardware vsync off once it hasn't been
+    // asked for again for the current hold time.  The hold time grows each
+    // time vsync is re-enabled before it runs out, so that short gaps
+    // between animations don't toggle the HAL, and shrinks while the caller
+    // reports that the DispSync model is stable.
+    void disableVsyncDeferred(bool modelStable);
+
+    // dump appends human-readable debug info to the result string.
+    void dump(String8& result) const;
+
     virtual bool threadLoop();
 
 private:
     sp<SurfaceFlinger> mFlinger;
     bool mVsyncEnabled;
 
-    Mutex mMutex;
+    // mOffTime is when a deferred disable takes effect, or 0 if none is
+    // pending.  mHoldTime is how long the next one will be deferred for.
+    nsecs_t mOffTime;
+    nsecs_t mHoldTime;
+
+    // Statistics, reported by dump.
+    uint32_t mNumHalCalls;
+    uint32_t mNumDebounced;
+
+    mutable Mutex mMutex;
     Condition mCond;
 };
 
 }
 
-#endif // ANDROID_DISPSYNC_H
+#endif // ANDROID_EVENTCONTROLTHREAD_H
@@ -49,6 +49,27 @@ void EventLog::logFrameDurations(const String8& window,
             numDurations);
 }
 
+void EventLog::doLogFrameStats(const void* stats, size_t size) {
+    // too big for a TagBuffer, and a single string, so it's framed here
+    char storage[1 + sizeof(int32_t) + FRAME_STATS_MAX_SIZE];
+    if (size > FRAME_STATS_MAX_SIZE) {
+        ALOGW("couldn't log %zu bytes of frame stats: overflow.", size);
+        return;
+    }
+    const int32_t len = size;
+    storage[0] = EVENT_TYPE_STRING;
+    memcpy(&storage[1], &len, sizeof(len));
+    memcpy(&storage[1 + sizeof(len)], stats, size);
+    if (android_bWriteLog(LOGTAG_SF_FRAME_STATS, storage,
+            1 + sizeof(len) + size) < 0) {
+        ALOGE("couldn't log to EventLog: %s", strerror(errno));
+    }
+}
+
+void EventLog::logFrameStats(const void* stats, size_t size) {
+    EventLog::getInstance().doLogFrameStats(stats, size);
+}
+
 // ---------------------------------------------------------------------------
 
 EventLog::TagBuffer::TagBuffer(int32_t tag)
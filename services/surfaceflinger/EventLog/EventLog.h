@@ -30,9 +30,18 @@ class String8;
 class EventLog : public Singleton<EventLog> {
 
 public:
+    // The largest batch logFrameStats takes, which keeps its event within a
+    // log entry
+    enum { FRAME_STATS_MAX_SIZE = 4000 };
+
     static void logFrameDurations(const String8& window,
             const int32_t* durations, size_t numDurations);
 
+    // logFrameStats logs a batch of per-frame records, in the binary format
+    // described in FrameTrace.cpp, as the single string of an sf_frame_stats
+    // event
+    static void logFrameStats(const void* stats, size_t size);
+
 protected:
     EventLog();
 
@@ -73,9 +82,13 @@ private:
     EventLog(const EventLog&);
     EventLog& operator =(const EventLog&);
 
-    enum { LOGTAG_SF_FRAME_DUR = 60100 };
+    enum {
+        LOGTAG_SF_FRAME_DUR = 60100,
+        LOGTAG_SF_FRAME_STATS = 60101,
+    };
     void doLogFrameDurations(const String8& window, const int32_t* durations,
             size_t numDurations);
+    void doLogFrameStats(const void* stats, size_t size);
 };
 
 // ---------------------------------------------------------------------------
@@ -21,6 +21,8 @@
 
 #include <cutils/compiler.h>
 
+#include <binder/IMemory.h>
+
 #include <gui/BitTube.h>
 #include <gui/IDisplayEventConnection.h>
 #include <gui/DisplayEventReceiver.h>
@@ -46,6 +48,7 @@ static void vsyncOffCallback(union sigval val) {
 
 EventThread::EventThread(const sp<VSyncSource>& src)
     : mVSyncSource(src),
+      mControlBlock(DisplayEventControlBlock::create()),
       mUseSoftwareVSync(false),
       mVsyncEnabled(false),
       mDebugVsyncEnabled(false),
@@ -56,6 +59,11 @@ EventThread::EventThread(const sp<VSyncSource>& src)
         mVSyncEvent[i].header.id = 0;
         mVSyncEvent[i].header.timestamp = 0;
         mVSyncEvent[i].vsync.count =  0;
+        mVSyncEvent[i].vsync.expectedPresentTime = 0;
+    }
+    for (int32_t i=0 ; i<DisplayEventControlBlock::NUM_DISPLAYS ; i++) {
+        mPublishedTimestamp[i] = 0;
+        mPublishedCount[i] = 0;
     }
     struct sigevent se;
     se.sigev_notify = SIGEV_THREAD;
@@ -100,6 +108,15 @@ sp<EventThread::Connection> EventThread::createEventConnection() const {
 status_t EventThread::registerDisplayEventConnection(
         const sp<EventThread::Connection>& connection) {
     Mutex::Autolock _l(mLock);
+    // Connections that don't wait for vsync are only visited when other
+    // events are dispatched, so drop the ones that died in the meantime
+    for (size_t i=0 ; i<mDisplayEventConnections.size() ; ) {
+        if (mDisplayEventConnections[i].promote() == NULL) {
+            mDisplayEventConnections.removeAt(i);
+        } else {
+            i++;
+        }
+    }
     mDisplayEventConnections.add(connection);
     mCondition.broadcast();
     return NO_ERROR;
@@ -109,6 +126,50 @@ void EventThread::removeDisplayEventConnection(
         const wp<EventThread::Connection>& connection) {
     Mutex::Autolock _l(mLock);
     mDisplayEventConnections.remove(connection);
+    mOneShotConnections.remove(connection);
+    for (size_t i=0 ; i<mContinuousConnections.size() ; ) {
+        SortedVector< wp<Connection> >& group(
+                mContinuousConnections.editValueAt(i));
+        group.remove(connection);
+        if (group.isEmpty()) {
+            mContinuousConnections.removeItemsAt(i);
+        } else {
+            i++;
+        }
+    }
+}
+
+void EventThread::removeFromGroupLocked(
+        const wp<EventThread::Connection>& connection, int32_t count) {
+    if (count == 0) {
+        mOneShotConnections.remove(connection);
+    } else if (count > 0) {
+        ssize_t index = mContinuousConnections.indexOfKey(count);
+        if (index >= 0) {
+            SortedVector< wp<Connection> >& group(
+                    mContinuousConnections.editValueAt(size_t(index)));
+            group.remove(connection);
+            if (group.isEmpty()) {
+                mContinuousConnections.removeItemsAt(size_t(index));
+            }
+        }
+    }
+}
+
+void EventThread::setConnectionCountLocked(
+        const sp<EventThread::Connection>& connection, int32_t count) {
+    removeFromGroupLocked(connection, connection->count);
+    connection->count = count;
+    if (count == 0) {
+        mOneShotConnections.add(connection);
+    } else if (count > 0) {
+        ssize_t index = mContinuousConnections.indexOfKey(count);
+        if (index < 0) {
+            index = mContinuousConnections.add(count,
+                    SortedVector< wp<Connection> >());
+        }
+        mContinuousConnections.editValueAt(size_t(index)).add(connection);
+    }
 }
 
 void EventThread::setVsyncRate(uint32_t count,
@@ -117,7 +178,7 @@ void EventThread::setVsyncRate(uint32_t count,
         Mutex::Autolock _l(mLock);
         const int32_t new_count = (count == 0) ? -1 : count;
         if (connection->count != new_count) {
-            connection->count = new_count;
+            setConnectionCountLocked(connection, new_count);
             mCondition.broadcast();
         }
     }
@@ -127,7 +188,7 @@ void EventThread::requestNextVsync(
         const sp<EventThread::Connection>& connection) {
     Mutex::Autolock _l(mLock);
     if (connection->count < 0) {
-        connection->count = 0;
+        setConnectionCountLocked(connection, 0);
         mCondition.broadcast();
     }
 }
@@ -150,15 +211,47 @@ void EventThread::onScreenAcquired() {
     }
 }
 
-void EventThread::onVSyncEvent(nsecs_t timestamp) {
+void EventThread::onVSyncEvent(nsecs_t timestamp,
+        nsecs_t expectedPresentTime) {
     Mutex::Autolock _l(mLock);
     mVSyncEvent[0].header.type = DisplayEventReceiver::DISPLAY_EVENT_VSYNC;
     mVSyncEvent[0].header.id = 0;
     mVSyncEvent[0].header.timestamp = timestamp;
     mVSyncEvent[0].vsync.count++;
+    mVSyncEvent[0].vsync.expectedPresentTime = expectedPresentTime;
     mCondition.broadcast();
 }
 
+void EventThread::publishVsync(int32_t display, nsecs_t timestamp,
+        nsecs_t period) {
+    if (mControlBlock == NULL || period <= 0 ||
+            uint32_t(display) >= DisplayEventControlBlock::NUM_DISPLAYS) {
+        return;
+    }
+    Mutex::Autolock _l(mLock);
+    const nsecs_t last = mPublishedTimestamp[display];
+    if (last != 0) {
+        if (timestamp < last - period / 2) {
+            return;
+        }
+        // Samples come from hardware vsync and from the model, so count the
+        // refreshes in between rather than the samples.
+        mPublishedCount[display] += uint32_t((timestamp - last + period / 2) / period);
+    } else {
+        mPublishedCount[display] = 1;
+    }
+    mPublishedTimestamp[display] = timestamp;
+    mControlBlock->publishVsync(display, timestamp, mPublishedCount[display],
+            period);
+}
+
+sp<IMemoryHeap> EventThread::getControlBlockHeap() const {
+    if (mControlBlock == NULL) {
+        return NULL;
+    }
+    return mControlBlock->getHeap();
+}
+
 void EventThread::onHotplugReceived(int type, bool connected) {
     ALOGE_IF(type >= DisplayDevice::NUM_BUILTIN_DISPLAY_TYPES,
             "received hotplug event for an invalid display (id=%d)", type);
@@ -214,7 +307,6 @@ Vector< sp<EventThread::Connection> > EventThread::waitForEvent(
 
     do {
         bool eventPending = false;
-        bool waitForVSync = false;
 
         size_t vsyncCount = 0;
         nsecs_t timestamp = 0;
@@ -239,44 +331,60 @@ Vector< sp<EventThread::Connection> > EventThread::waitForEvent(
             }
         }
 
-        // find out connections waiting for events
-        size_t count = mDisplayEventConnections.size();
-        for (size_t i=0 ; i<count ; i++) {
-            sp<Connection> connection(mDisplayEventConnections[i].promote());
-            if (connection != NULL) {
-                bool added = false;
-                if (connection->count >= 0) {
-                    // we need vsync events because at least
-                    // one connection is waiting for it
-                    waitForVSync = true;
-                    if (timestamp) {
-                        // we consume the event only if it's time
-                        // (ie: we received a vsync event)
-                        if (connection->count == 0) {
-                            // fired this time around
-                            connection->count = -1;
-                            signalConnections.add(connection);
-                            added = true;
-                        } else if (connection->count == 1 ||
-                                (vsyncCount % connection->count) == 0) {
-                            // continuous event, and time to report it
+        // we need vsync events if at least one connection is waiting for it
+        const bool waitForVSync = !mOneShotConnections.isEmpty() ||
+                !mContinuousConnections.isEmpty();
+
+        if (timestamp) {
+            // one-shot requests fire this time around
+            const size_t oneShotCount = mOneShotConnections.size();
+            for (size_t i=0 ; i<oneShotCount ; i++) {
+                sp<Connection> connection(mOneShotConnections[i].promote());
+                if (connection != NULL) {
+                    connection->count = -1;
+                    signalConnections.add(connection);
+                }
+            }
+            mOneShotConnections.clear();
+
+            // continuous events are only reported to the groups whose
+            // turn it is; the others aren't even looked at
+            for (size_t i=0 ; i<mContinuousConnections.size() ; ) {
+                const int32_t rate = mContinuousConnections.keyAt(i);
+                SortedVector< wp<Connection> >& group(
+                        mContinuousConnections.editValueAt(i));
+                if (rate == 1 || (vsyncCount % size_t(rate)) == 0) {
+                    for (size_t j=0 ; j<group.size() ; ) {
+                        sp<Connection> connection(group[j].promote());
+                        if (connection != NULL) {
                             signalConnections.add(connection);
-                            added = true;
+                            j++;
+                        } else {
+                            // the connection has died, so clean-up!
+                            group.removeAt(j);
                         }
                     }
                 }
-
-                if (eventPending && !timestamp && !added) {
-                    // we don't have a vsync event to process
-                    // (timestamp==0), but we have some pending
-                    // messages.
+                if (group.isEmpty()) {
+                    mContinuousConnections.removeItemsAt(i);
+                } else {
+                    i++;
+                }
+            }
+        } else if (eventPending) {
+            // we don't have a vsync event to process (timestamp==0), but
+            // we have some pending messages for everybody.
+            size_t count = mDisplayEventConnections.size();
+            for (size_t i=0 ; i<count ; i++) {
+                sp<Connection> connection(mDisplayEventConnections[i].promote());
+                if (connection != NULL) {
                     signalConnections.add(connection);
+                } else {
+                    // we couldn't promote this reference, the connection has
+                    // died, so clean-up!
+                    mDisplayEventConnections.removeAt(i);
+                    --i; --count;
                 }
-            } else {
-                // we couldn't promote this reference, the connection has
-                // died, so clean-up!
-                mDisplayEventConnections.removeAt(i);
-                --i; --count;
             }
         }
 
@@ -322,6 +430,7 @@ Vector< sp<EventThread::Connection> > EventThread::waitForEvent(
                     mVSyncEvent[0].header.id = DisplayDevice::DISPLAY_PRIMARY;
                     mVSyncEvent[0].header.timestamp = systemTime(SYSTEM_TIME_MONOTONIC);
                     mVSyncEvent[0].vsync.count++;
+                    mVSyncEvent[0].vsync.expectedPresentTime = 0;
                 }
             } else {
                 // Nobody is interested in vsync, so we just want to sleep.
@@ -369,6 +478,13 @@ void EventThread::dump(String8& result) const {
     result.appendFormat("  numListeners=%zu,\n  events-delivered: %u\n",
             mDisplayEventConnections.size(),
             mVSyncEvent[DisplayDevice::DISPLAY_PRIMARY].vsync.count);
+    result.appendFormat("  one-shot requests: %zu\n",
+            mOneShotConnections.size());
+    for (size_t i=0 ; i<mContinuousConnections.size() ; i++) {
+        result.appendFormat("  rate %d: %zu listeners\n",
+                mContinuousConnections.keyAt(i),
+                mContinuousConnections.valueAt(i).size());
+    }
     for (size_t i=0 ; i<mDisplayEventConnections.size() ; i++) {
         sp<Connection> connection =
                 mDisplayEventConnections.itemAt(i).promote();
@@ -403,6 +519,10 @@ void EventThread::Connection::setVsyncRate(uint32_t count) {
     mEventThread->setVsyncRate(count, this);
 }
 
+sp<IMemoryHeap> EventThread::Connection::getControlBlock() const {
+    return mEventThread->getControlBlockHeap();
+}
+
 void EventThread::Connection::requestNextVsync() {
     mEventThread->requestNextVsync(this);
 }
@@ -20,10 +20,12 @@
 #include <stdint.h>
 #include <sys/types.h>
 
+#include <gui/DisplayEventControlBlock.h>
 #include <gui/DisplayEventReceiver.h>
 #include <gui/IDisplayEventConnection.h>
 
 #include <utils/Errors.h>
+#include <utils/KeyedVector.h>
 #include <utils/threads.h>
 #include <utils/SortedVector.h>
 
@@ -45,7 +47,10 @@ public:
     class Callback: public virtual RefBase {
     public:
         virtual ~Callback() {}
-        virtual void onVSyncEvent(nsecs_t when) = 0;
+        // expectedPresentTime is when the refresh that follows the event is
+        // expected to begin, or 0 if unknown
+        virtual void onVSyncEvent(nsecs_t when,
+                nsecs_t expectedPresentTime) = 0;
     };
 
     virtual ~VSyncSource() {}
@@ -63,6 +68,8 @@ class EventThread : public Thread, private VSyncSource::Callback {
         // count >= 1 : continuous event. count is the vsync rate
         // count == 0 : one-shot event that has not fired
         // count ==-1 : one-shot event that fired this round / disabled
+        // Only changed through EventThread::setConnectionCountLocked, which
+        // keeps the connection in the matching group.
         int32_t count;
 
     private:
@@ -71,6 +78,7 @@ class EventThread : public Thread, private VSyncSource::Callback {
         virtual sp<BitTube> getDataChannel() const;
         virtual void setVsyncRate(uint32_t count);
         virtual void requestNextVsync();    // asynchronous
+        virtual sp<IMemoryHeap> getControlBlock() const;
         sp<EventThread> const mEventThread;
         sp<BitTube> const mChannel;
     };
@@ -102,19 +110,31 @@ public:
 
     void setPhaseOffset(nsecs_t phaseOffset);
 
+    // Returns the shared memory in which vsyncs are published, or NULL
+    sp<IMemoryHeap> getControlBlockHeap() const;
+
+    // Publishes a vsync of a built-in display in the shared memory, whether
+    // or not vsync events are enabled
+    void publishVsync(int32_t display, nsecs_t timestamp, nsecs_t period);
+
 private:
     virtual bool        threadLoop();
     virtual void        onFirstRef();
 
-    virtual void onVSyncEvent(nsecs_t timestamp);
+    virtual void onVSyncEvent(nsecs_t timestamp, nsecs_t expectedPresentTime);
 
     void removeDisplayEventConnection(const wp<Connection>& connection);
+    void setConnectionCountLocked(const sp<Connection>& connection,
+            int32_t count);
+    void removeFromGroupLocked(const wp<Connection>& connection,
+            int32_t count);
     void enableVSyncLocked();
     void disableVSyncLocked();
     void sendVsyncHintOnLocked();
 
     // constants
     sp<VSyncSource> mVSyncSource;
+    sp<DisplayEventControlBlock> mControlBlock;
     PowerHAL mPowerHAL;
 
     mutable Mutex mLock;
@@ -122,10 +142,17 @@ private:
 
     // protected by mLock
     SortedVector< wp<Connection> > mDisplayEventConnections;
+    // The connections waiting for vsync: one-shot requests, and continuous
+    // ones grouped by rate, so that each vsync only visits the connections
+    // it's delivered to
+    SortedVector< wp<Connection> > mOneShotConnections;
+    KeyedVector< int32_t, SortedVector< wp<Connection> > > mContinuousConnections;
     Vector< DisplayEventReceiver::Event > mPendingEvents;
     DisplayEventReceiver::Event mVSyncEvent[DisplayDevice::NUM_BUILTIN_DISPLAY_TYPES];
     bool mUseSoftwareVSync;
     bool mVsyncEnabled;
+    nsecs_t mPublishedTimestamp[DisplayEventControlBlock::NUM_DISPLAYS];
+    uint32_t mPublishedCount[DisplayEventControlBlock::NUM_DISPLAYS];
 
     // for debugging
     bool mDebugVsyncEnabled;
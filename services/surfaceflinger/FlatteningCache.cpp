@@ -0,0 +1,273 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <inttypes.h>
+
+#include <ui/GraphicBuffer.h>
+#include <ui/PixelFormat.h>
+#include <ui/Region.h>
+
+#include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/Trace.h>
+
+#include <hardware/gralloc.h>
+
+#include "DisplayDevice.h"
+#include "FlatteningCache.h"
+#include "Layer.h"
+#include "Transform.h"
+
+#include "DisplayHardware/HWComposer.h"
+
+#include "RenderEngine/Mesh.h"
+#include "RenderEngine/RenderEngine.h"
+#include "RenderEngine/Texture.h"
+
+namespace android {
+
+FlatteningCache::FlatteningCache() :
+    mRunStart(0),
+    mRunEnd(0),
+    mEngine(NULL),
+    mDisplay(EGL_NO_DISPLAY),
+    mImage(EGL_NO_IMAGE_KHR),
+    mTexName(0),
+    mRenderCount(0),
+    mDrawCount(0) {}
+
+FlatteningCache::~FlatteningCache() {
+    release();
+}
+
+void FlatteningCache::invalidate() {
+    mLayers.clear();
+    mRunStart = mRunEnd = 0;
+}
+
+bool FlatteningCache::update(RenderEngine& engine, EGLDisplay display,
+        const sp<const DisplayDevice>& hw, HWComposer& hwc,
+        const Transform& tr) {
+    const int32_t id = hw->getHwcDisplayId();
+    const Vector< sp<Layer> >& layers(hw->getVisibleLayersSortedByZ());
+    const size_t count = layers.size();
+
+    Vector<LayerRecord> records;
+    records.setCapacity(count);
+    HWComposer::LayerListIterator cur = hwc.begin(id);
+    const HWComposer::LayerListIterator end = hwc.end(id);
+    for (size_t i=0 ; i<count && cur!=end ; ++i, ++cur) {
+        const sp<Layer>& layer(layers[i]);
+        LayerRecord record;
+        record.layer = layer.get();
+        record.frameNumber = layer->getCurrentFrameNumber();
+        record.staticFrames = 0;
+        record.flattenable = cur->getCompositionType() == HWC_FRAMEBUFFER &&
+                layer->canBeFlattened();
+        if (i < mLayers.size() && mLayers[i].layer == record.layer &&
+                mLayers[i].frameNumber == record.frameNumber) {
+            record.staticFrames = mLayers[i].staticFrames;
+            if (record.staticFrames < MIN_STATIC_FRAMES) {
+                record.staticFrames++;
+            }
+        }
+        records.add(record);
+    }
+    mLayers = records;
+
+    // The cached run stays valid as long as all of its layers are still
+    // composited by GLES with the buffer they had when it was rendered
+    for (size_t i = mRunStart; i < mRunEnd; i++) {
+        if (i >= mLayers.size() || !mLayers[i].flattenable ||
+                mLayers[i].staticFrames == 0) {
+            mRunStart = mRunEnd = 0;
+            break;
+        }
+    }
+    if (mRunEnd > mRunStart) {
+        return true;
+    }
+
+    // Otherwise look for the longest run of layers that have been static
+    // for long enough
+    size_t bestStart = 0;
+    size_t bestEnd = 0;
+    for (size_t i = 0; i < mLayers.size(); ) {
+        if (!mLayers[i].flattenable ||
+                mLayers[i].staticFrames < MIN_STATIC_FRAMES) {
+            i++;
+            continue;
+        }
+        size_t j = i + 1;
+        while (j < mLayers.size() && mLayers[j].flattenable &&
+                mLayers[j].staticFrames >= MIN_STATIC_FRAMES) {
+            j++;
+        }
+        if (j - i > bestEnd - bestStart) {
+            bestStart = i;
+            bestEnd = j;
+        }
+        i = j;
+    }
+    if (bestEnd - bestStart < MIN_RUN_LENGTH) {
+        return false;
+    }
+
+    status_t err = allocate(engine, display,
+            static_cast<uint32_t>(hw->getWidth()),
+            static_cast<uint32_t>(hw->getHeight()));
+    if (err == NO_ERROR) {
+        err = render(engine, hw, tr, bestStart, bestEnd);
+    }
+    if (err != NO_ERROR) {
+        // Don't retry until the geometry changes
+        ALOGE("update: failed to flatten layers [%zu, %zu) of %s (%d)",
+                bestStart, bestEnd, hw->getDisplayName().string(), err);
+        for (size_t i = bestStart; i < bestEnd; i++) {
+            mLayers.editItemAt(i).flattenable = false;
+        }
+        return false;
+    }
+    mRunStart = bestStart;
+    mRunEnd = bestEnd;
+    return true;
+}
+
+status_t FlatteningCache::allocate(RenderEngine& engine, EGLDisplay display,
+        uint32_t width, uint32_t height) {
+    if (mBuffer != NULL && mBuffer->getWidth() == width &&
+            mBuffer->getHeight() == height) {
+        return NO_ERROR;
+    }
+    release();
+
+    sp<GraphicBuffer> buffer = new GraphicBuffer(width, height,
+            PIXEL_FORMAT_RGBA_8888,
+            GRALLOC_USAGE_HW_RENDER | GRALLOC_USAGE_HW_TEXTURE);
+    status_t err = buffer->initCheck();
+    if (err != NO_ERROR) {
+        ALOGE("allocate: failed to allocate a %ux%u buffer (%d)",
+                width, height, err);
+        return err;
+    }
+
+    EGLint attrs[] = { EGL_IMAGE_PRESERVED_KHR, EGL_TRUE, EGL_NONE };
+    EGLImageKHR image = eglCreateImageKHR(display, EGL_NO_CONTEXT,
+            EGL_NATIVE_BUFFER_ANDROID,
+            static_cast<EGLClientBuffer>(buffer->getNativeBuffer()), attrs);
+    if (image == EGL_NO_IMAGE_KHR) {
+        ALOGE("allocate: eglCreateImageKHR failed (%#x)", eglGetError());
+        return UNKNOWN_ERROR;
+    }
+
+    mEngine = &engine;
+    mDisplay = display;
+    mBuffer = buffer;
+    mImage = image;
+    engine.genTextures(1, &mTexName);
+    engine.bindImageAsTexture(mImage, mTexName);
+    return NO_ERROR;
+}
+
+status_t FlatteningCache::render(RenderEngine& engine,
+        const sp<const DisplayDevice>& hw, const Transform& tr,
+        size_t start, size_t end) {
+    ATRACE_CALL();
+    const Vector< sp<Layer> >& layers(hw->getVisibleLayersSortedByZ());
+
+    // The layers' meshes are in screen space, and so is the viewport, so
+    // they can be drawn unchanged into a buffer the size of the screen
+    RenderEngine::BindImageAsFramebuffer imageBond(engine, mImage);
+    status_t err = imageBond.getStatus();
+    if (err != NO_ERROR) {
+        return err;
+    }
+
+    // Composing with premultiplied "source over" is associative, so the
+    // layers composed onto transparent black and then onto the framebuffer
+    // give the same result as when they're drawn directly
+    engine.clearWithColor(0, 0, 0, 0);
+    Region covered;
+    for (size_t i = start; i < end; i++) {
+        const sp<Layer>& layer(layers[i]);
+        const Region visible(tr.transform(layer->visibleRegion));
+        layer->draw(hw, visible);
+        covered.orSelf(visible);
+    }
+    covered.bounds().intersect(hw->getBounds(), &mBounds);
+    mRenderCount++;
+    return NO_ERROR;
+}
+
+void FlatteningCache::draw(RenderEngine& engine, const Region& dirty) const {
+    if (mRunEnd <= mRunStart || !dirty.intersects(mBounds)) {
+        return;
+    }
+
+    const float width = static_cast<float>(mBuffer->getWidth());
+    const float height = static_cast<float>(mBuffer->getHeight());
+    const float left = static_cast<float>(mBounds.left);
+    const float top = static_cast<float>(mBounds.top);
+    const float right = static_cast<float>(mBounds.right);
+    const float bottom = static_cast<float>(mBounds.bottom);
+
+    Mesh mesh(Mesh::TRIANGLE_FAN, 4, 2, 2);
+    Mesh::VertexArray<vec2> position(mesh.getPositionArray<vec2>());
+    position[0] = vec2(left, top);
+    position[1] = vec2(left, bottom);
+    position[2] = vec2(right, bottom);
+    position[3] = vec2(right, top);
+    // what's at the top of the screen is at the top of the texture
+    Mesh::VertexArray<vec2> texCoords(mesh.getTexCoordArray<vec2>());
+    texCoords[0] = vec2(left / width, 1.0f - top / height);
+    texCoords[1] = vec2(left / width, 1.0f - bottom / height);
+    texCoords[2] = vec2(right / width, 1.0f - bottom / height);
+    texCoords[3] = vec2(right / width, 1.0f - top / height);
+
+    Texture texture(Texture::TEXTURE_2D, mTexName);
+    texture.setDimensions(mBuffer->getWidth(), mBuffer->getHeight());
+    engine.setupLayerTexturing(texture);
+    engine.setupLayerBlending(true, false, 0xFF);
+    engine.drawMesh(mesh);
+    engine.disableBlending();
+    engine.disableTexturing();
+    mDrawCount++;
+}
+
+void FlatteningCache::release() {
+    mRunStart = mRunEnd = 0;
+    if (mEngine == NULL) {
+        return;
+    }
+    mEngine->deleteTextures(1, &mTexName);
+    eglDestroyImageKHR(mDisplay, mImage);
+    mEngine = NULL;
+    mDisplay = EGL_NO_DISPLAY;
+    mImage = EGL_NO_IMAGE_KHR;
+    mTexName = 0;
+    mBuffer.clear();
+}
+
+void FlatteningCache::dump(String8& result) const {
+    result.appendFormat("   flattening: run=[%zu, %zu) bounds=[%d,%d,%d,%d] "
+            "rendered=%" PRIu64 " drawn=%" PRIu64 "\n",
+            mRunStart, mRunEnd, mBounds.left, mBounds.top, mBounds.right,
+            mBounds.bottom, mRenderCount, mDrawCount);
+}
+
+}; // namespace android
@@ -0,0 +1,136 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_FLATTENINGCACHE_H
+#define ANDROID_FLATTENINGCACHE_H
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#include <ui/Rect.h>
+
+#include <utils/Errors.h>
+#include <utils/StrongPointer.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+class DisplayDevice;
+class GraphicBuffer;
+class HWComposer;
+class Layer;
+class Region;
+class RenderEngine;
+class String8;
+class Transform;
+
+// FlatteningCache keeps a run of consecutive HWC_FRAMEBUFFER layers of a
+// display pre-composited in an offscreen buffer, so that as long as none of
+// them changes, doComposeSurfaces() blends that one buffer instead of drawing
+// each of the layers again.
+//
+// A run is only cached once all of its layers have kept the same buffer for
+// MIN_STATIC_FRAMES compositions; the cache is forgotten whenever the HWC
+// geometry of the display changes, and a cached run is dropped as soon as one
+// of its layers latches a new buffer or stops being composited by GLES.
+//
+// Like the rest of the composition state it's only used from the main thread,
+// with the SurfaceFlinger EGLContext current.
+class FlatteningCache {
+public:
+    FlatteningCache();
+    ~FlatteningCache();
+
+    // invalidate forgets the cached run and the history of the layers. It
+    // must be called whenever the visible layers of the display or their
+    // geometry may have changed.
+    void invalidate();
+
+    // update records the layers composited in this frame and, if a run of
+    // them has been static long enough, renders it into the offscreen
+    // buffer. Since this rebinds the framebuffer, it must be called with hw
+    // current and before anything is drawn for this frame. It returns true
+    // if a run is cached for this frame.
+    bool update(RenderEngine& engine, EGLDisplay display,
+            const sp<const DisplayDevice>& hw, HWComposer& hwc,
+            const Transform& tr);
+
+    // Whether visible layer i is part of the cached run, in which case it
+    // must not be drawn by itself
+    bool isFlattened(size_t i) const {
+        return i >= mRunStart && i < mRunEnd;
+    }
+
+    // Whether visible layer i is the one at which the cached run is drawn
+    bool isFirstFlattened(size_t i) const {
+        return mRunEnd > mRunStart && i == mRunStart;
+    }
+
+    // draw blends the cached run onto the current framebuffer; dirty is the
+    // region being redrawn, in screen space.
+    void draw(RenderEngine& engine, const Region& dirty) const;
+
+    // release frees the offscreen buffer and its GL resources
+    void release();
+
+    void dump(String8& result) const;
+
+private:
+    // A run is only worth caching once its layers have been composited
+    // unchanged this many times
+    enum { MIN_STATIC_FRAMES = 2 };
+    // A single layer would be drawn twice per frame instead of once
+    enum { MIN_RUN_LENGTH = 2 };
+
+    struct LayerRecord {
+        const Layer* layer;
+        uint64_t frameNumber;
+        uint32_t staticFrames;
+        bool flattenable;
+    };
+
+    status_t allocate(RenderEngine& engine, EGLDisplay display,
+            uint32_t width, uint32_t height);
+    status_t render(RenderEngine& engine, const sp<const DisplayDevice>& hw,
+            const Transform& tr, size_t start, size_t end);
+
+    // The layers composited in the last frame update() was called for, in
+    // z-order. Only compared by address, and only while the HWC geometry
+    // (and so the visible layer list) is unchanged.
+    Vector<LayerRecord> mLayers;
+
+    // The cached run is [mRunStart, mRunEnd) and covers mBounds
+    size_t mRunStart;
+    size_t mRunEnd;
+    Rect mBounds;
+
+    RenderEngine* mEngine;
+    EGLDisplay mDisplay;
+    sp<GraphicBuffer> mBuffer;
+    EGLImageKHR mImage;
+    uint32_t mTexName;
+
+    // Counters for dump()
+    uint64_t mRenderCount;
+    mutable uint64_t mDrawCount;
+};
+
+}; // namespace android
+
+#endif // ANDROID_FLATTENINGCACHE_H
@@ -0,0 +1,406 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <inttypes.h>
+
+#include <cutils/trace.h>
+
+#include <ui/Fence.h>
+
+#include "FrameTrace.h"
+
+namespace android {
+
+// The binary dump is a sequence of fields in the native byte order (little
+// endian on all current devices), without padding, from the oldest frame
+// to the newest:
+//
+//   uint32 magic ('sftr'), uint32 version (1), uint32 number of frames
+//   then for each frame:
+//     uint64 frame number, uint32 flags (see FLAG_*)
+//     int64  wake-up, refresh, end, expected present and present times, and
+//            swap and commit durations, in ns
+//     uint32 layers composited by the HWC, by GLES
+//     uint32 number of latches recorded, number of latches not recorded
+//     then for each latch recorded:
+//       uint32 decision (see LatchDecision), uint64 BufferQueue frame number
+//       int64  latch duration, in ns
+//       uint32 length of the layer name, followed by the name (not
+//              terminated)
+static const uint32_t BINARY_MAGIC = 'sftr';
+static const uint32_t BINARY_VERSION = 1;
+
+// The frame stats batches given to EventLog::logFrameStats use the same
+// byte order, also without padding:
+//
+//   uint32 magic ('sfst'), uint32 version (1), uint32 number of records,
+//   uint32 vsync period, in ns
+//   int64  wake-up time of the first record, in ns
+//   then for each frame, in the order their present times became known:
+//     int32  wake-up time, relative to the first record's, in us
+//     uint32 time from the wake-up to the end of the frame, in us
+//     int32  present time, relative to the expected present time, in us, or
+//            INT32_MIN if it's unknown
+//     uint32 GPU composition time collected during the frame, in us
+//     uint8  layers composited by the HWC, by GLES, up to 255
+//     uint8  vsyncs missed, i.e. how many periods late the present was
+//     uint8  flags (see FLAG_*)
+static const uint32_t STATS_MAGIC = 'sfst';
+static const uint32_t STATS_VERSION = 1;
+
+template <typename T>
+static void appendValue(String8& result, T value) {
+    result.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+// atrace cookies are 32 bits, which is plenty to tell frames apart
+static int32_t cookieOf(uint64_t frameNumber) {
+    return static_cast<int32_t>(frameNumber & 0x7fffffff);
+}
+
+static int32_t usOf(nsecs_t duration) {
+    const nsecs_t us = duration / 1000;
+    return us > INT32_MAX ? INT32_MAX : us < -INT32_MAX ? -INT32_MAX : us;
+}
+
+static uint8_t saturatedUint8(uint64_t value) {
+    return value > UINT8_MAX ? UINT8_MAX : value;
+}
+
+FrameTrace::FrameTrace() :
+    mNumFrames(0),
+    mFrameOpen(false),
+    mStatsLogging(false),
+    mNumStats(0),
+    mStatsVsyncPeriod(0) {}
+
+void FrameTrace::beginFrame(nsecs_t wakeTime) {
+    Mutex::Autolock lock(mMutex);
+    if (mFrameOpen) {
+        endFrameLocked();
+    }
+    beginFrameLocked(wakeTime);
+}
+
+void FrameTrace::beginFrameLocked(nsecs_t wakeTime) {
+    FrameRecord& frame(mFrames[mNumFrames % MAX_FRAMES]);
+    frame.frameNumber = mNumFrames++;
+    frame.flags = 0;
+    frame.wakeTime = wakeTime;
+    frame.refreshTime = 0;
+    frame.endTime = 0;
+    frame.expectedPresentTime = 0;
+    frame.presentTime = -1;
+    frame.swapDuration = 0;
+    frame.commitDuration = 0;
+    frame.gpuDuration = 0;
+    frame.vsyncPeriod = 0;
+    frame.numHwcLayers = 0;
+    frame.numGlesLayers = 0;
+    frame.numLatches = 0;
+    frame.numDroppedLatches = 0;
+    frame.presentFence.clear();
+    mFrameOpen = true;
+    ATRACE_ASYNC_BEGIN("Frame", cookieOf(frame.frameNumber));
+}
+
+void FrameTrace::addTransaction() {
+    Mutex::Autolock lock(mMutex);
+    if (mFrameOpen) {
+        mFrames[(mNumFrames - 1) % MAX_FRAMES].flags |= FLAG_TRANSACTION;
+    }
+}
+
+void FrameTrace::addLatch(const String8& layerName, LatchDecision decision,
+        uint64_t frameNumber, nsecs_t duration) {
+    Mutex::Autolock lock(mMutex);
+    if (!mFrameOpen) {
+        return;
+    }
+    FrameRecord& frame(mFrames[(mNumFrames - 1) % MAX_FRAMES]);
+    if (frame.numLatches >= MAX_LATCHES) {
+        frame.numDroppedLatches++;
+        return;
+    }
+    LatchRecord& latch(frame.latches[frame.numLatches++]);
+    latch.layerName = layerName;
+    latch.decision = decision;
+    latch.frameNumber = frameNumber;
+    latch.duration = duration;
+}
+
+void FrameTrace::beginRefresh(nsecs_t refreshTime) {
+    Mutex::Autolock lock(mMutex);
+    if (!mFrameOpen) {
+        beginFrameLocked(refreshTime);
+    }
+    FrameRecord& frame(mFrames[(mNumFrames - 1) % MAX_FRAMES]);
+    frame.flags |= FLAG_REFRESH;
+    frame.refreshTime = refreshTime;
+}
+
+void FrameTrace::addPrepare(status_t err, bool geometryChanged,
+        uint32_t numHwcLayers, uint32_t numGlesLayers) {
+    Mutex::Autolock lock(mMutex);
+    if (!mFrameOpen) {
+        return;
+    }
+    FrameRecord& frame(mFrames[(mNumFrames - 1) % MAX_FRAMES]);
+    if (err != NO_ERROR) {
+        frame.flags |= FLAG_PREPARE_FAILED;
+    }
+    if (geometryChanged) {
+        frame.flags |= FLAG_GEOMETRY_CHANGED;
+    }
+    frame.numHwcLayers = numHwcLayers;
+    frame.numGlesLayers = numGlesLayers;
+}
+
+void FrameTrace::addSwap(nsecs_t duration) {
+    Mutex::Autolock lock(mMutex);
+    if (mFrameOpen) {
+        mFrames[(mNumFrames - 1) % MAX_FRAMES].swapDuration += duration;
+    }
+}
+
+void FrameTrace::addCommit(nsecs_t duration) {
+    Mutex::Autolock lock(mMutex);
+    if (mFrameOpen) {
+        mFrames[(mNumFrames - 1) % MAX_FRAMES].commitDuration += duration;
+    }
+}
+
+void FrameTrace::addGpuComposition(nsecs_t duration) {
+    Mutex::Autolock lock(mMutex);
+    if (mFrameOpen) {
+        mFrames[(mNumFrames - 1) % MAX_FRAMES].gpuDuration += duration;
+    }
+}
+
+void FrameTrace::endFrame(nsecs_t expectedPresentTime, nsecs_t vsyncPeriod,
+        const sp<Fence>& presentFence, bool skipped) {
+    String8 stats;
+    {
+        Mutex::Autolock lock(mMutex);
+        processFencesLocked();
+        if (mFrameOpen) {
+            FrameRecord& frame(mFrames[(mNumFrames - 1) % MAX_FRAMES]);
+            frame.expectedPresentTime = expectedPresentTime;
+            frame.vsyncPeriod = vsyncPeriod;
+            if (skipped) {
+                frame.flags |= FLAG_SKIPPED;
+            } else if (presentFence != NULL && presentFence->isValid()) {
+                frame.presentTime = 0;
+                frame.presentFence = presentFence;
+                ATRACE_ASYNC_BEGIN("Present", cookieOf(frame.frameNumber));
+            }
+            endFrameLocked();
+        }
+        if (!takeStatsLocked(stats)) {
+            return;
+        }
+    }
+    // outside of the lock, so that dumps don't wait on the log
+    EventLog::logFrameStats(stats.string(), stats.size());
+}
+
+void FrameTrace::endFrameLocked() {
+    FrameRecord& frame(mFrames[(mNumFrames - 1) % MAX_FRAMES]);
+    frame.endTime = systemTime();
+    mFrameOpen = false;
+    ATRACE_ASYNC_END("Frame", cookieOf(frame.frameNumber));
+    if (frame.presentFence == NULL) {
+        // there's no present time to wait for
+        addStatsLocked(frame);
+    }
+}
+
+void FrameTrace::setStatsLogging(bool enabled) {
+    Mutex::Autolock lock(mMutex);
+    mStatsLogging = enabled;
+    if (!enabled) {
+        mNumStats = 0;
+    }
+}
+
+void FrameTrace::addStatsLocked(const FrameRecord& frame) {
+    if (!mStatsLogging || mNumStats >= MAX_STATS_RECORDS) {
+        // a full batch is logged at the end of the current frame
+        return;
+    }
+    StatsRecord& stats(mStats[mNumStats++]);
+    stats.wakeTime = frame.wakeTime;
+    stats.cpuTimeUs = frame.endTime > frame.wakeTime ?
+            usOf(frame.endTime - frame.wakeTime) : 0;
+    stats.presentDelayUs = INT32_MIN;
+    stats.missedVsyncs = 0;
+    if (frame.presentTime > 0 && frame.expectedPresentTime > 0) {
+        const nsecs_t delay = frame.presentTime - frame.expectedPresentTime;
+        stats.presentDelayUs = usOf(delay);
+        if (delay > 0 && frame.vsyncPeriod > 0) {
+            stats.missedVsyncs = saturatedUint8(
+                    (delay + frame.vsyncPeriod / 2) / frame.vsyncPeriod);
+        }
+    }
+    stats.gpuTimeUs = usOf(frame.gpuDuration);
+    stats.numHwcLayers = saturatedUint8(frame.numHwcLayers);
+    stats.numGlesLayers = saturatedUint8(frame.numGlesLayers);
+    stats.flags = frame.flags;
+    if (frame.vsyncPeriod > 0) {
+        mStatsVsyncPeriod = frame.vsyncPeriod;
+    }
+}
+
+bool FrameTrace::takeStatsLocked(String8& batch) {
+    if (mNumStats == 0 || (mNumStats < MAX_STATS_RECORDS &&
+            systemTime() - mStats[0].wakeTime < STATS_FLUSH_PERIOD)) {
+        return false;
+    }
+    const nsecs_t baseTime = mStats[0].wakeTime;
+    appendValue(batch, STATS_MAGIC);
+    appendValue(batch, STATS_VERSION);
+    appendValue(batch, static_cast<uint32_t>(mNumStats));
+    appendValue(batch, static_cast<uint32_t>(mStatsVsyncPeriod));
+    appendValue(batch, static_cast<int64_t>(baseTime));
+    for (size_t i = 0; i < mNumStats; i++) {
+        const StatsRecord& stats(mStats[i]);
+        appendValue(batch, usOf(stats.wakeTime - baseTime));
+        appendValue(batch, stats.cpuTimeUs);
+        appendValue(batch, stats.presentDelayUs);
+        appendValue(batch, stats.gpuTimeUs);
+        appendValue(batch, stats.numHwcLayers);
+        appendValue(batch, stats.numGlesLayers);
+        appendValue(batch, stats.missedVsyncs);
+        appendValue(batch, stats.flags);
+    }
+    mNumStats = 0;
+    return true;
+}
+
+void FrameTrace::processFencesLocked() {
+    const uint64_t oldest = mNumFrames > MAX_FRAMES ?
+            mNumFrames - MAX_FRAMES : 0;
+    for (uint64_t i = oldest; i < mNumFrames; i++) {
+        FrameRecord& frame(mFrames[i % MAX_FRAMES]);
+        if (frame.presentFence == NULL) {
+            continue;
+        }
+        const nsecs_t presentTime = frame.presentFence->getSignalTime();
+        if (presentTime == INT64_MAX) {
+            // fences signal in order, so the newer ones are pending too
+            break;
+        }
+        frame.presentTime = presentTime > 0 ? presentTime : -1;
+        frame.presentFence.clear();
+        ATRACE_ASYNC_END("Present", cookieOf(frame.frameNumber));
+        addStatsLocked(frame);
+    }
+}
+
+static const char* latchDecisionStr(uint32_t decision) {
+    switch (decision) {
+        case FrameTrace::LATCH_LATCHED: return "latched";
+        case FrameTrace::LATCH_NOT_DUE: return "not due";
+        default:                        return "<INVALID>";
+    }
+}
+
+// Returns the time from start to time in ms, or -1 if either is unknown
+static double msSince(nsecs_t start, nsecs_t time) {
+    return start > 0 && time > 0 ? (time - start) / 1e6 : -1.0;
+}
+
+void FrameTrace::dumpFrameLocked(String8& result,
+        const FrameRecord& frame) const {
+    result.appendFormat("  frame %" PRIu64 " woke at %" PRId64 ": refresh "
+            "+%.3f ms, end +%.3f ms, present +%.3f ms (expected +%.3f ms)\n",
+            frame.frameNumber, frame.wakeTime,
+            msSince(frame.wakeTime, frame.refreshTime),
+            msSince(frame.wakeTime, frame.endTime),
+            msSince(frame.wakeTime, frame.presentTime),
+            msSince(frame.wakeTime, frame.expectedPresentTime));
+    result.appendFormat("    %s%s%s%s%s hwc=%u gles=%u swap=%.3f ms "
+            "commit=%.3f ms gpu=%.3f ms\n",
+            frame.flags & FLAG_TRANSACTION ? "transaction " : "",
+            frame.flags & FLAG_REFRESH ? "refresh " : "no-refresh ",
+            frame.flags & FLAG_SKIPPED ? "skipped " : "",
+            frame.flags & FLAG_GEOMETRY_CHANGED ? "geometry " : "",
+            frame.flags & FLAG_PREPARE_FAILED ? "prepare-failed " : "",
+            frame.numHwcLayers, frame.numGlesLayers,
+            frame.swapDuration / 1e6, frame.commitDuration / 1e6,
+            frame.gpuDuration / 1e6);
+    for (size_t i = 0; i < frame.numLatches; i++) {
+        const LatchRecord& latch(frame.latches[i]);
+        result.appendFormat("    %s '%s' frame %" PRIu64 " in %.3f ms\n",
+                latchDecisionStr(latch.decision), latch.layerName.string(),
+                latch.frameNumber, latch.duration / 1e6);
+    }
+    if (frame.numDroppedLatches > 0) {
+        result.appendFormat("    (%u more layers)\n", frame.numDroppedLatches);
+    }
+}
+
+void FrameTrace::dump(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    const uint64_t oldest = mNumFrames > MAX_FRAMES ?
+            mNumFrames - MAX_FRAMES : 0;
+    result.appendFormat("Last %" PRIu64 " frames of the main thread:\n",
+            mNumFrames - oldest);
+    for (uint64_t i = oldest; i < mNumFrames; i++) {
+        dumpFrameLocked(result, mFrames[i % MAX_FRAMES]);
+    }
+    if (mStatsLogging) {
+        result.appendFormat("Frame stats logging: %zu of %d records "
+                "pending\n", mNumStats, MAX_STATS_RECORDS);
+    }
+}
+
+void FrameTrace::dumpBinary(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    const uint64_t oldest = mNumFrames > MAX_FRAMES ?
+            mNumFrames - MAX_FRAMES : 0;
+    appendValue(result, BINARY_MAGIC);
+    appendValue(result, BINARY_VERSION);
+    appendValue(result, static_cast<uint32_t>(mNumFrames - oldest));
+    for (uint64_t i = oldest; i < mNumFrames; i++) {
+        const FrameRecord& frame(mFrames[i % MAX_FRAMES]);
+        appendValue(result, frame.frameNumber);
+        appendValue(result, frame.flags);
+        appendValue(result, static_cast<int64_t>(frame.wakeTime));
+        appendValue(result, static_cast<int64_t>(frame.refreshTime));
+        appendValue(result, static_cast<int64_t>(frame.endTime));
+        appendValue(result, static_cast<int64_t>(frame.expectedPresentTime));
+        appendValue(result, static_cast<int64_t>(frame.presentTime));
+        appendValue(result, static_cast<int64_t>(frame.swapDuration));
+        appendValue(result, static_cast<int64_t>(frame.commitDuration));
+        appendValue(result, frame.numHwcLayers);
+        appendValue(result, frame.numGlesLayers);
+        appendValue(result, frame.numLatches);
+        appendValue(result, frame.numDroppedLatches);
+        for (size_t j = 0; j < frame.numLatches; j++) {
+            const LatchRecord& latch(frame.latches[j]);
+            appendValue(result, latch.decision);
+            appendValue(result, latch.frameNumber);
+            appendValue(result, static_cast<int64_t>(latch.duration));
+            appendValue(result, static_cast<uint32_t>(latch.layerName.size()));
+            result.append(latch.layerName.string(), latch.layerName.size());
+        }
+    }
+}
+
+}; // namespace android
@@ -0,0 +1,194 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_FRAMETRACE_H
+#define ANDROID_FRAMETRACE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/Errors.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+
+#include "EventLog/EventLog.h"
+
+namespace android {
+
+class Fence;
+
+// FrameTrace keeps a record of each of the last MAX_FRAMES frames of the
+// main thread, from the vsync that woke it up to the present fence of what
+// it composited: which layer latched which BufferQueue frame and how long
+// that took, which ones had a frame that wasn't due yet, what prepare() left
+// to the HWC and to GLES, and how long swapping and committing took.
+//
+// Each frame is also an async atrace slice, "Frame", followed by a "Present"
+// slice that ends when its present fence signals, both with the frame's
+// number as their cookie, so that SurfaceFlinger's frames can be followed
+// across vsyncs in systrace.
+//
+// When stats logging is enabled, each frame also leaves a compact record
+// once its present time is known, and these are logged in batches to the
+// event log (see EventLog::logFrameStats), which keeps a long history of
+// frame times, composition and missed vsyncs for very little.
+//
+// It's updated from the main thread and dumped from binder threads (see
+// dumpsys SurfaceFlinger --frametrace), so it's thread-safe.
+class FrameTrace {
+public:
+    // What handlePageFlip decided for a layer with a queued frame
+    enum LatchDecision {
+        LATCH_LATCHED = 0,
+        // its frame's timestamp is for a later refresh
+        LATCH_NOT_DUE = 1,
+    };
+
+    FrameTrace();
+
+    // beginFrame starts the record of a frame, woken up at wakeTime. A frame
+    // still open, which didn't need a refresh, ends here.
+    void beginFrame(nsecs_t wakeTime);
+
+    // addTransaction records that the frame committed a transaction
+    void addTransaction();
+
+    // addLatch records the decision for a layer with a queued frame, and for
+    // a latched one, the BufferQueue frame number it latched and how long
+    // latching took
+    void addLatch(const String8& layerName, LatchDecision decision,
+            uint64_t frameNumber, nsecs_t duration);
+
+    // beginRefresh records that the frame is composited, starting at
+    // refreshTime; it starts a frame if there's none open
+    void beginRefresh(nsecs_t refreshTime);
+
+    // addPrepare records the outcome of HWComposer::prepare(), over all
+    // displays
+    void addPrepare(status_t err, bool geometryChanged, uint32_t numHwcLayers,
+            uint32_t numGlesLayers);
+
+    // addSwap and addCommit record how long eglSwapBuffers and
+    // HWComposer::commit() took, which is mostly spent waiting for fences
+    void addSwap(nsecs_t duration);
+    void addCommit(nsecs_t duration);
+
+    // addGpuComposition records a GPU composition time of an earlier frame,
+    // as GpuTimer returns them, against the current one
+    void addGpuComposition(nsecs_t duration);
+
+    // endFrame ends the frame, composited for the refresh at
+    // expectedPresentTime, and presented when presentFence signals. When
+    // skipped is true there was nothing new to composite.
+    void endFrame(nsecs_t expectedPresentTime, nsecs_t vsyncPeriod,
+            const sp<Fence>& presentFence, bool skipped);
+
+    // setStatsLogging turns the frame stats records on or off; records not
+    // logged yet are dropped when it's turned off
+    void setStatsLogging(bool enabled);
+
+    void dump(String8& result) const;
+
+    // dumpBinary appends the records in the binary format described in
+    // FrameTrace.cpp
+    void dumpBinary(String8& result) const;
+
+private:
+    enum { MAX_FRAMES = 128 };
+    // Latches recorded per frame; later ones are only counted
+    enum { MAX_LATCHES = 8 };
+    // Frame stats records per sf_frame_stats event, given the sizes of the
+    // format in FrameTrace.cpp
+    enum { STATS_HEADER_SIZE = 24, STATS_RECORD_SIZE = 20 };
+    enum { MAX_STATS_RECORDS = (EventLog::FRAME_STATS_MAX_SIZE -
+            STATS_HEADER_SIZE) / STATS_RECORD_SIZE };
+    // How long records wait at most for their batch to fill up
+    static const nsecs_t STATS_FLUSH_PERIOD = 60000000000LL;
+
+    enum {
+        FLAG_TRANSACTION = 0x1,
+        FLAG_REFRESH = 0x2,
+        FLAG_SKIPPED = 0x4,
+        FLAG_GEOMETRY_CHANGED = 0x8,
+        FLAG_PREPARE_FAILED = 0x10,
+    };
+
+    struct LatchRecord {
+        String8 layerName;
+        uint32_t decision;
+        uint64_t frameNumber;
+        nsecs_t duration;
+    };
+
+    struct FrameRecord {
+        uint64_t frameNumber;
+        uint32_t flags;
+        nsecs_t wakeTime;
+        nsecs_t refreshTime;
+        nsecs_t endTime;
+        nsecs_t expectedPresentTime;
+        // 0 while the present fence is pending, -1 if it's unknown
+        nsecs_t presentTime;
+        nsecs_t swapDuration;
+        nsecs_t commitDuration;
+        nsecs_t gpuDuration;
+        nsecs_t vsyncPeriod;
+        uint32_t numHwcLayers;
+        uint32_t numGlesLayers;
+        uint32_t numLatches;
+        uint32_t numDroppedLatches;
+        LatchRecord latches[MAX_LATCHES];
+        sp<Fence> presentFence;
+    };
+
+    // The part of a FrameRecord that's logged, see FrameTrace.cpp
+    struct StatsRecord {
+        nsecs_t wakeTime;
+        uint32_t cpuTimeUs;
+        int32_t presentDelayUs;
+        uint32_t gpuTimeUs;
+        uint8_t numHwcLayers;
+        uint8_t numGlesLayers;
+        uint8_t missedVsyncs;
+        uint8_t flags;
+    };
+
+    void beginFrameLocked(nsecs_t wakeTime);
+    void endFrameLocked();
+    void processFencesLocked();
+    void addStatsLocked(const FrameRecord& frame);
+    bool takeStatsLocked(String8& batch);
+    void dumpFrameLocked(String8& result, const FrameRecord& frame) const;
+
+    mutable Mutex mMutex;
+    FrameRecord mFrames[MAX_FRAMES];
+    // The number of frames begun so far; the current one is at
+    // (mNumFrames - 1) % MAX_FRAMES
+    uint64_t mNumFrames;
+    bool mFrameOpen;
+
+    bool mStatsLogging;
+    StatsRecord mStats[MAX_STATS_RECORDS];
+    size_t mNumStats;
+    // The vsync period of the newest record, which goes in the batch header
+    nsecs_t mStatsVsyncPeriod;
+};
+
+}; // namespace android
+
+#endif // ANDROID_FRAMETRACE_H
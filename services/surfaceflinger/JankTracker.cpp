@@ -0,0 +1,296 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+#include <string.h>
+
+#include <ui/Fence.h>
+
+#include "JankTracker.h"
+
+namespace android {
+
+// Upper limits of the composition duration buckets, in milliseconds
+static const nsecs_t COMPOSITION_BUCKETS_MS[JankTracker::NUM_BUCKETS - 1] =
+        { 1, 2, 4, 8, 16, 33 };
+
+// Upper limits of the latch to present latency buckets, in milliseconds
+static const nsecs_t LATENCY_BUCKETS_MS[JankTracker::NUM_BUCKETS - 1] =
+        { 8, 16, 24, 33, 50, 66 };
+
+// The binary dump is a sequence of fields in the native byte order (little
+// endian on all current devices), without padding:
+//
+//   uint32 magic (0x6a616e6b, "jank" read big endian), uint32 version (2)
+//   int64  duration the statistics cover, in ns
+//   uint64 frames presented, late frames, missed vsyncs, dropped frames
+//   uint32 number of displays, then for each of them:
+//     int32  HWC display id
+//     uint64 frames, GLES only frames, HWC only frames, mixed frames
+//     uint64 composition duration histogram[NUM_BUCKETS]
+//     uint64 GPU timed frames (version 2)
+//     uint64 GPU composition duration histogram[NUM_BUCKETS] (version 2)
+//   uint32 number of layers, then for each of them:
+//     uint32 length of the name, followed by the name (not terminated)
+//     uint64 frames
+//     uint64 latch to present latency histogram[NUM_BUCKETS]
+static const uint32_t BINARY_MAGIC = 0x6a616e6b;
+static const uint32_t BINARY_VERSION = 2;
+
+template <typename T>
+static void appendValue(String8& result, T value) {
+    result.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static size_t bucketOf(nsecs_t duration, const nsecs_t* limitsMs) {
+    for (size_t i = 0; i < JankTracker::NUM_BUCKETS - 1; i++) {
+        if (duration < ms2ns(limitsMs[i])) {
+            return i;
+        }
+    }
+    return JankTracker::NUM_BUCKETS - 1;
+}
+
+static void dumpHistogram(String8& result, const uint64_t* histogram,
+        const nsecs_t* limitsMs) {
+    for (size_t i = 0; i < JankTracker::NUM_BUCKETS - 1; i++) {
+        result.appendFormat(" <%" PRId64 "ms:%" PRIu64, limitsMs[i],
+                histogram[i]);
+    }
+    result.appendFormat(" >=%" PRId64 "ms:%" PRIu64 "\n",
+            limitsMs[JankTracker::NUM_BUCKETS - 2],
+            histogram[JankTracker::NUM_BUCKETS - 1]);
+}
+
+JankTracker::JankTracker() :
+    mPresentedFrames(0),
+    mLateFrames(0),
+    mMissedVsyncs(0),
+    mDroppedFrames(0),
+    mStartTime(systemTime()) {}
+
+JankTracker::DisplayStats& JankTracker::getDisplayLocked(int32_t displayId) {
+    ssize_t index = mDisplays.indexOfKey(displayId);
+    if (index < 0) {
+        DisplayStats stats;
+        memset(&stats, 0, sizeof(stats));
+        index = mDisplays.add(displayId, stats);
+    }
+    return mDisplays.editValueAt(static_cast<size_t>(index));
+}
+
+void JankTracker::addComposition(int32_t displayId, nsecs_t duration,
+        bool usesGles, bool usesHwc) {
+    Mutex::Autolock lock(mMutex);
+    DisplayStats& stats(getDisplayLocked(displayId));
+    stats.frames++;
+    if (usesGles && usesHwc) {
+        stats.mixedFrames++;
+    } else if (usesGles) {
+        stats.glesFrames++;
+    } else {
+        stats.hwcFrames++;
+    }
+    stats.compositionHistogram[bucketOf(duration, COMPOSITION_BUCKETS_MS)]++;
+}
+
+void JankTracker::addGpuComposition(int32_t displayId, nsecs_t duration) {
+    Mutex::Autolock lock(mMutex);
+    DisplayStats& stats(getDisplayLocked(displayId));
+    stats.gpuFrames++;
+    stats.gpuHistogram[bucketOf(duration, COMPOSITION_BUCKETS_MS)]++;
+}
+
+void JankTracker::addPresent(nsecs_t expectedPresentTime, nsecs_t period,
+        const sp<Fence>& presentFence, nsecs_t presentTime) {
+    Mutex::Autolock lock(mMutex);
+    processFencesLocked();
+
+    PendingFrame frame;
+    frame.startTime = expectedPresentTime;
+    frame.period = period;
+    if (presentFence != NULL && presentFence->isValid()) {
+        frame.presentFence = presentFence;
+        addPendingLocked(frame);
+    } else {
+        addPresentedLocked(frame, presentTime);
+    }
+}
+
+void JankTracker::addLatch(const String8& layerName, nsecs_t latchTime,
+        const sp<Fence>& presentFence, nsecs_t presentTime) {
+    Mutex::Autolock lock(mMutex);
+    PendingFrame frame;
+    frame.layerName = layerName;
+    frame.startTime = latchTime;
+    frame.period = 0;
+    if (presentFence != NULL && presentFence->isValid()) {
+        frame.presentFence = presentFence;
+        addPendingLocked(frame);
+    } else {
+        addPresentedLocked(frame, presentTime);
+    }
+}
+
+void JankTracker::addPendingLocked(const PendingFrame& frame) {
+    // Each composition adds one display frame and maybe some layer frames,
+    // so this bounds them all
+    if (mPendingFrames.size() >= MAX_PENDING * (MAX_LAYERS + 1)) {
+        mPendingFrames.removeAt(0);
+        mDroppedFrames++;
+    }
+    mPendingFrames.add(frame);
+}
+
+void JankTracker::processFencesLocked() {
+    // Fences signal in order, so stop at the first pending one
+    size_t numProcessed = 0;
+    while (numProcessed < mPendingFrames.size()) {
+        const PendingFrame& frame(mPendingFrames[numProcessed]);
+        const nsecs_t presentTime = frame.presentFence->getSignalTime();
+        if (presentTime == INT64_MAX) {
+            break;
+        }
+        if (presentTime > 0) {
+            addPresentedLocked(frame, presentTime);
+        } else {
+            mDroppedFrames++;
+        }
+        numProcessed++;
+    }
+    mPendingFrames.removeItemsAt(0, numProcessed);
+}
+
+void JankTracker::addPresentedLocked(const PendingFrame& frame,
+        nsecs_t presentTime) {
+    if (frame.layerName.isEmpty()) {
+        mPresentedFrames++;
+        // Each vsync this frame was late for displayed the previous one
+        // again
+        if (frame.period > 0 && presentTime > frame.startTime + frame.period / 2) {
+            const nsecs_t late = presentTime - frame.startTime;
+            mLateFrames++;
+            mMissedVsyncs += static_cast<uint64_t>(
+                    (late + frame.period / 2) / frame.period);
+        }
+        return;
+    }
+
+    ssize_t index = mLayers.indexOfKey(frame.layerName);
+    if (index < 0) {
+        if (mLayers.size() >= MAX_LAYERS) {
+            return;
+        }
+        LayerStats stats;
+        memset(&stats, 0, sizeof(stats));
+        index = mLayers.add(frame.layerName, stats);
+    }
+    LayerStats& stats(mLayers.editValueAt(static_cast<size_t>(index)));
+    stats.frames++;
+    stats.latencyHistogram[bucketOf(presentTime - frame.startTime,
+            LATENCY_BUCKETS_MS)]++;
+}
+
+void JankTracker::clear() {
+    Mutex::Autolock lock(mMutex);
+    clearLocked();
+}
+
+void JankTracker::clearLocked() {
+    mDisplays.clear();
+    mLayers.clear();
+    mPresentedFrames = 0;
+    mLateFrames = 0;
+    mMissedVsyncs = 0;
+    mDroppedFrames = 0;
+    mStartTime = systemTime();
+}
+
+void JankTracker::dump(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    result.appendFormat("Frame pacing stats over the last %.3f s:\n",
+            (systemTime() - mStartTime) / 1e9);
+    result.appendFormat("  primary display: %" PRIu64 " frames presented, %"
+            PRIu64 " late, %" PRIu64 " missed vsyncs, %" PRIu64 " dropped "
+            "from the stats\n", mPresentedFrames, mLateFrames, mMissedVsyncs,
+            mDroppedFrames);
+    for (size_t i = 0; i < mDisplays.size(); i++) {
+        const DisplayStats& stats(mDisplays.valueAt(i));
+        result.appendFormat("  display %d: %" PRIu64 " compositions (GLES %"
+                PRIu64 ", HWC %" PRIu64 ", mixed %" PRIu64 ")\n",
+                mDisplays.keyAt(i), stats.frames, stats.glesFrames,
+                stats.hwcFrames, stats.mixedFrames);
+        result.append("    composition time:");
+        dumpHistogram(result, stats.compositionHistogram,
+                COMPOSITION_BUCKETS_MS);
+        if (stats.gpuFrames > 0) {
+            result.appendFormat("    GPU composition time (%" PRIu64
+                    " frames):", stats.gpuFrames);
+            dumpHistogram(result, stats.gpuHistogram, COMPOSITION_BUCKETS_MS);
+        }
+    }
+    for (size_t i = 0; i < mLayers.size(); i++) {
+        const LayerStats& stats(mLayers.valueAt(i));
+        result.appendFormat("  layer '%s': %" PRIu64 " frames\n",
+                mLayers.keyAt(i).string(), stats.frames);
+        result.append("    latch to present:");
+        dumpHistogram(result, stats.latencyHistogram, LATENCY_BUCKETS_MS);
+    }
+}
+
+void JankTracker::dumpBinary(String8& result) {
+    Mutex::Autolock lock(mMutex);
+    appendValue(result, BINARY_MAGIC);
+    appendValue(result, BINARY_VERSION);
+    appendValue(result, static_cast<int64_t>(systemTime() - mStartTime));
+    appendValue(result, mPresentedFrames);
+    appendValue(result, mLateFrames);
+    appendValue(result, mMissedVsyncs);
+    appendValue(result, mDroppedFrames);
+
+    appendValue(result, static_cast<uint32_t>(mDisplays.size()));
+    for (size_t i = 0; i < mDisplays.size(); i++) {
+        const DisplayStats& stats(mDisplays.valueAt(i));
+        appendValue(result, mDisplays.keyAt(i));
+        appendValue(result, stats.frames);
+        appendValue(result, stats.glesFrames);
+        appendValue(result, stats.hwcFrames);
+        appendValue(result, stats.mixedFrames);
+        for (size_t j = 0; j < NUM_BUCKETS; j++) {
+            appendValue(result, stats.compositionHistogram[j]);
+        }
+        appendValue(result, stats.gpuFrames);
+        for (size_t j = 0; j < NUM_BUCKETS; j++) {
+            appendValue(result, stats.gpuHistogram[j]);
+        }
+    }
+
+    appendValue(result, static_cast<uint32_t>(mLayers.size()));
+    for (size_t i = 0; i < mLayers.size(); i++) {
+        const String8& name(mLayers.keyAt(i));
+        const LayerStats& stats(mLayers.valueAt(i));
+        appendValue(result, static_cast<uint32_t>(name.size()));
+        result.append(name.string(), name.size());
+        appendValue(result, stats.frames);
+        for (size_t j = 0; j < NUM_BUCKETS; j++) {
+            appendValue(result, stats.latencyHistogram[j]);
+        }
+    }
+
+    clearLocked();
+}
+
+}; // namespace android
@@ -0,0 +1,140 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_JANKTRACKER_H
+#define ANDROID_JANKTRACKER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/KeyedVector.h>
+#include <utils/Mutex.h>
+#include <utils/RefBase.h>
+#include <utils/String8.h>
+#include <utils/Timers.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+class Fence;
+
+// JankTracker accumulates frame pacing statistics for as long as
+// SurfaceFlinger runs, or until they're cleared:
+//  - per display, how long composition took, and how many frames were
+//    composited by GLES, by the HWC only, or both;
+//  - per display, how long the GPU took to run GLES composition, where it
+//    supports timer queries;
+//  - for the primary display, how many vsyncs frames were presented after
+//    the one they were composited for;
+//  - per layer, the latency from latching a buffer to presenting it.
+//
+// Present times are only known once the present fence of a frame signals, so
+// the frames are kept pending until a later composition finds their fence
+// signaled. Unlike FrameTracker it is thread-safe, since it's updated from
+// the main thread and dumped from binder threads.
+class JankTracker {
+public:
+    // Number of buckets of the duration histograms; the limits of all but
+    // the last one are given by COMPOSITION_BUCKETS_MS / LATENCY_BUCKETS_MS
+    enum { NUM_BUCKETS = 7 };
+
+    JankTracker();
+
+    // addComposition records a composition of the display with the given
+    // HWC id, which took duration, and whether any of it was composited by
+    // GLES and by the HWC
+    void addComposition(int32_t displayId, nsecs_t duration, bool usesGles,
+            bool usesHwc);
+
+    // addGpuComposition records how long the GPU took to run the GLES
+    // composition of a frame of the display with the given HWC id
+    void addGpuComposition(int32_t displayId, nsecs_t duration);
+
+    // addPresent records a frame of the primary display, composited for the
+    // refresh expected at expectedPresentTime. It's presented when
+    // presentFence signals or, if that fence isn't valid, at presentTime.
+    void addPresent(nsecs_t expectedPresentTime, nsecs_t period,
+            const sp<Fence>& presentFence, nsecs_t presentTime);
+
+    // addLatch records that a layer latched a buffer at latchTime, which is
+    // presented the same way as for addPresent
+    void addLatch(const String8& layerName, nsecs_t latchTime,
+            const sp<Fence>& presentFence, nsecs_t presentTime);
+
+    void clear();
+
+    // dump appends the statistics as text
+    void dump(String8& result) const;
+
+    // dumpBinary appends the statistics in the binary format described in
+    // JankTracker.cpp, and clears them, so that a collector polling it gets
+    // the statistics of each interval
+    void dumpBinary(String8& result);
+
+private:
+    // Statistics are kept for at most this many layers, the ones that
+    // latched their first frame first
+    enum { MAX_LAYERS = 64 };
+    // At most this many compositions' worth of frames are kept waiting for
+    // their present fence; older ones are dropped
+    enum { MAX_PENDING = 16 };
+
+    struct DisplayStats {
+        uint64_t frames;
+        uint64_t glesFrames;
+        uint64_t hwcFrames;
+        uint64_t mixedFrames;
+        uint64_t compositionHistogram[NUM_BUCKETS];
+        uint64_t gpuFrames;
+        uint64_t gpuHistogram[NUM_BUCKETS];
+    };
+
+    struct LayerStats {
+        uint64_t frames;
+        uint64_t latencyHistogram[NUM_BUCKETS];
+    };
+
+    // A frame waiting for its present fence; layerName is empty for the
+    // display's frames
+    struct PendingFrame {
+        String8 layerName;
+        nsecs_t startTime;
+        nsecs_t period;
+        sp<Fence> presentFence;
+    };
+
+    DisplayStats& getDisplayLocked(int32_t displayId);
+    void addPendingLocked(const PendingFrame& frame);
+    void processFencesLocked();
+    void addPresentedLocked(const PendingFrame& frame, nsecs_t presentTime);
+    void clearLocked();
+
+    mutable Mutex mMutex;
+
+    KeyedVector<int32_t, DisplayStats> mDisplays;
+    KeyedVector<String8, LayerStats> mLayers;
+    uint64_t mPresentedFrames;
+    uint64_t mLateFrames;
+    uint64_t mMissedVsyncs;
+    uint64_t mDroppedFrames;
+    nsecs_t mStartTime;
+
+    Vector<PendingFrame> mPendingFrames;
+};
+
+}; // namespace android
+
+#endif // ANDROID_JANKTRACKER_H
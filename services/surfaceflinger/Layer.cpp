@@ -16,6 +16,7 @@
 
 #define ATRACE_TAG ATRACE_TAG_GRAPHICS
 
+#include <inttypes.h>
 #include <stdlib.h>
 #include <stdint.h>
 #include <sys/types.h>
@@ -54,6 +55,15 @@ namespace android {
 
 // ---------------------------------------------------------------------------
 
+#ifdef TARGET_DISABLE_TRIPLE_BUFFERING
+#warning "disabling triple buffering"
+static const int DEFAULT_MAX_BUFFER_COUNT = 2;
+#else
+static const int DEFAULT_MAX_BUFFER_COUNT = 3;
+#endif
+// Buffer count of the layers trimmed by LayerMemoryBudget
+static const int TRIMMED_MAX_BUFFER_COUNT = 2;
+
 int32_t Layer::sSequence = 1;
 
 Layer::Layer(SurfaceFlinger* flinger, const sp<Client>& client,
@@ -73,6 +83,7 @@ Layer::Layer(SurfaceFlinger* flinger, const sp<Client>& client,
         mCurrentOpacity(true),
         mRefreshPending(false),
         mFrameLatencyNeeded(false),
+        mLastLatchTime(0),
         mFiltering(false),
         mNeedsFiltering(false),
         mMesh(Mesh::TRIANGLE_FAN, 4, 2, 2),
@@ -85,7 +96,9 @@ Layer::Layer(SurfaceFlinger* flinger, const sp<Client>& client,
         mQueueItems(),
         mLastFrameNumberReceived(0),
         mUpdateTexImageFailed(false),
-        mCaptureScreen(false)
+        mCaptureScreen(false),
+        mBuffersTrimmed(false),
+        mIdleBuffersDiscarded(false)
 {
     mCurrentCrop.makeInvalid();
     mFlinger->getRenderEngine().genTextures(1, &mTextureName);
@@ -128,18 +141,14 @@ void Layer::onFirstRef() {
     sp<IGraphicBufferProducer> producer;
     sp<IGraphicBufferConsumer> consumer;
     BufferQueue::createBufferQueue(&producer, &consumer);
+    consumer->setBufferPreallocation(mFlinger->mPreallocateBuffers);
     mProducer = new MonitoredProducer(producer, mFlinger);
     mSurfaceFlingerConsumer = new SurfaceFlingerConsumer(consumer, mTextureName);
     mSurfaceFlingerConsumer->setConsumerUsageBits(getEffectiveUsage(0));
     mSurfaceFlingerConsumer->setContentsChangedListener(this);
     mSurfaceFlingerConsumer->setName(mName);
 
-#ifdef TARGET_DISABLE_TRIPLE_BUFFERING
-#warning "disabling triple buffering"
-    mSurfaceFlingerConsumer->setDefaultMaxBufferCount(2);
-#else
-    mSurfaceFlingerConsumer->setDefaultMaxBufferCount(3);
-#endif
+    mSurfaceFlingerConsumer->setDefaultMaxBufferCount(DEFAULT_MAX_BUFFER_COUNT);
 
     const sp<const DisplayDevice> hw(mFlinger->getDefaultDisplayDevice());
     updateTransformHint(hw);
@@ -583,13 +592,12 @@ void Layer::setAcquireFence(const sp<const DisplayDevice>& /* hw */,
     layer.setAcquireFenceFd(fenceFd);
 }
 
-Rect Layer::getPosition(
-    const sp<const DisplayDevice>& hw)
+Rect Layer::getFrame() const
 {
     // this gives us only the "orientation" component of the transform
     const State& s(getCurrentState());
 
-    // apply the layer's transform, followed by the display's global transform
+    // apply the layer's transform
     // here we're guaranteed that the layer's transform preserves rects
     Rect win(s.active.w, s.active.h);
     if (!s.active.crop.isEmpty()) {
@@ -597,7 +605,14 @@ Rect Layer::getPosition(
     }
     // subtract the transparent region and snap to the bounds
     Rect bounds = reduce(win, s.activeTransparentRegion);
-    Rect frame(s.transform.transform(bounds));
+    return Rect(s.transform.transform(bounds));
+}
+
+Rect Layer::getPosition(
+    const sp<const DisplayDevice>& hw)
+{
+    // apply the layer's transform, followed by the display's global transform
+    Rect frame(getFrame());
     frame.intersect(hw->getViewport(), &frame);
     const Transform& tr(hw->getTransform());
     return Rect(tr.transform(frame));
@@ -904,6 +919,36 @@ void Layer::setVisibleRegion(const Region& visibleRegion) {
     this->visibleRegion = visibleRegion;
 }
 
+bool Layer::isVisibilityCacheValid(const Layer* above,
+        uint32_t layerStack) const {
+    const VisibilityCache& c(visibilityCache);
+    const State& s(getDrawingState());
+    return c.valid && !contentDirty &&
+            c.above == above &&
+            c.layerStack == layerStack &&
+            c.sequence == s.sequence &&
+            c.active == s.active &&
+            c.visible == isVisible() &&
+            c.opaque == isOpaque(s) &&
+            c.transparentRegion.isTriviallyEqual(s.activeTransparentRegion);
+}
+
+void Layer::updateVisibilityCache(const Layer* above,
+        const Region& aboveOpaqueLayers, const Region& aboveCoveredLayers) {
+    VisibilityCache& c(visibilityCache);
+    const State& s(getDrawingState());
+    c.valid = true;
+    c.above = above;
+    c.layerStack = s.layerStack;
+    c.sequence = s.sequence;
+    c.active = s.active;
+    c.visible = isVisible();
+    c.opaque = isOpaque(s);
+    c.transparentRegion = s.activeTransparentRegion;
+    c.aboveOpaqueLayers = aboveOpaqueLayers;
+    c.aboveCoveredLayers = aboveCoveredLayers;
+}
+
 void Layer::setCoveredRegion(const Region& coveredRegion) {
     // always called from main thread
     this->coveredRegion = coveredRegion;
@@ -1119,6 +1164,26 @@ void Layer::useEmptyDamage() {
     surfaceDamageRegion.clear();
 }
 
+Region Layer::getDamageInLayerSpace(const Region& bounds) const {
+    const Region& damage(mSurfaceFlingerConsumer->getSurfaceDamage());
+    // Producers that don't go through Surface leave the damage empty, so a
+    // new buffer without any damage is taken to be fully damaged
+    if (mFlinger->mForceFullDamage || damage.isEmpty() ||
+            damage.bounds() == Rect::INVALID_RECT) {
+        return bounds;
+    }
+
+    // The damage is in buffer coordinates. Only map it when the buffer is
+    // drawn 1:1 onto the layer, anything else falls back to the bounds.
+    const Rect bufferBounds(mActiveBuffer->getBounds());
+    if (mCurrentTransform != 0 ||
+            (!mCurrentCrop.isEmpty() && mCurrentCrop != bufferBounds) ||
+            bufferBounds != bounds.bounds()) {
+        return bounds;
+    }
+    return damage.intersect(bounds);
+}
+
 // ----------------------------------------------------------------------------
 // pageflip handling...
 // ----------------------------------------------------------------------------
@@ -1167,15 +1232,22 @@ void Layer::onPostComposition() {
 
         const HWComposer& hwc = mFlinger->getHwComposer();
         sp<Fence> presentFence = hwc.getDisplayFence(HWC_DISPLAY_PRIMARY);
+        nsecs_t presentTime = 0;
         if (presentFence->isValid()) {
             mFrameTracker.setActualPresentFence(presentFence);
         } else {
             // The HWC doesn't support present fences, so use the refresh
             // timestamp instead.
-            nsecs_t presentTime = hwc.getRefreshTimestamp(HWC_DISPLAY_PRIMARY);
+            presentTime = hwc.getRefreshTimestamp(HWC_DISPLAY_PRIMARY);
             mFrameTracker.setActualPresentTime(presentTime);
         }
 
+        mSurfaceFlingerConsumer->setFrameCompositionInfo(
+                mSurfaceFlingerConsumer->getFrameNumber(), mLastLatchTime,
+                presentFence, presentTime);
+        mFlinger->mJankTracker.addLatch(getName(), mLastLatchTime,
+                presentFence, presentTime);
+
         mFrameTracker.advanceFrame();
         mFrameLatencyNeeded = false;
     }
@@ -1187,6 +1259,80 @@ bool Layer::isVisible() const {
             && (mActiveBuffer != NULL || mSidebandStream != NULL);
 }
 
+bool Layer::canBeFlattened() const {
+    if (mActiveBuffer == NULL || mSidebandStream != NULL || isProtected()) {
+        return false;
+    }
+    // Pre-compositing only preserves premultiplied "source over" blending,
+    // or no blending at all
+    const Layer::State& s(mDrawingState);
+    return mPremultipliedAlpha || (isOpaque(s) && s.alpha == 0xFF);
+}
+
+// A layer that moves between overlays and GLES this many times without
+// keeping its composition type for STABLE_FRAMES compositions in between is
+// pinned to GLES, until it would have kept its type for PINNED_FRAMES
+static const uint32_t MAX_COMPOSITION_FLIPS = 4;
+static const uint32_t STABLE_FRAMES = 30;
+static const uint32_t PINNED_FRAMES = 120;
+
+bool Layer::updateCompositionHistory(int32_t hwcId, int32_t compositionType)
+{
+    ssize_t index = mCompositionHistory.indexOfKey(hwcId);
+    if (index < 0) {
+        CompositionHistory history;
+        history.type = compositionType;
+        history.flips = 0;
+        history.stableFrames = 0;
+        history.pinned = false;
+        mCompositionHistory.add(hwcId, history);
+        return false;
+    }
+
+    CompositionHistory& history(
+            mCompositionHistory.editValueAt(static_cast<size_t>(index)));
+    const bool wasGles = history.type == HWC_FRAMEBUFFER;
+    const bool isGles = compositionType == HWC_FRAMEBUFFER;
+    history.type = compositionType;
+    if (wasGles != isGles) {
+        history.flips++;
+        history.stableFrames = 0;
+    } else {
+        history.stableFrames++;
+    }
+
+    if (history.pinned) {
+        if (history.stableFrames >= PINNED_FRAMES) {
+            history.pinned = false;
+            history.flips = 0;
+            return true;
+        }
+        return false;
+    }
+    if (history.stableFrames >= STABLE_FRAMES) {
+        history.flips = 0;
+    }
+    if (history.flips >= MAX_COMPOSITION_FLIPS) {
+        ALOGV("[%s] flips between HWC and GLES, pinning it to GLES",
+                mName.string());
+        history.pinned = true;
+        history.stableFrames = 0;
+        return true;
+    }
+    return false;
+}
+
+bool Layer::isPinnedToGles(int32_t hwcId) const
+{
+    ssize_t index = mCompositionHistory.indexOfKey(hwcId);
+    return index >= 0 &&
+            mCompositionHistory.valueAt(static_cast<size_t>(index)).pinned;
+}
+
+uint64_t Layer::getCurrentFrameNumber() const {
+    return mSurfaceFlingerConsumer->getFrameNumber();
+}
+
 Region Layer::latchBuffer(bool& recomputeVisibleRegions)
 {
     ATRACE_CALL();
@@ -1370,6 +1516,9 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
             return outDirtyRegion;
         }
 
+        // The surface damage is relative to the previous frame, so it only
+        // describes the change since the last latch if no frame was dropped
+        bool droppedFrames = false;
         { // Autolock scope
             auto currentFrameNumber = mSurfaceFlingerConsumer->getFrameNumber();
 
@@ -1380,6 +1529,7 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
             while (mQueueItems[0].mFrameNumber != currentFrameNumber) {
                 mQueueItems.removeAt(0);
                 android_atomic_dec(&mQueuedFrames);
+                droppedFrames = true;
             }
 
             mQueueItems.removeAt(0);
@@ -1407,10 +1557,16 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
 
         mRefreshPending = true;
         mFrameLatencyNeeded = true;
+        mLastLatchTime = systemTime(SYSTEM_TIME_MONOTONIC);
+        mIdleBuffersDiscarded = false;
+        // Set if anything but the content of the buffer changed, or frames
+        // were dropped, in which case the whole layer has to be redrawn
+        bool geometryChanged = droppedFrames;
         if (oldActiveBuffer == NULL) {
              // the first time we receive a buffer, we need to trigger a
              // geometry invalidation.
             recomputeVisibleRegions = true;
+            geometryChanged = true;
          }
 
         Rect crop(mSurfaceFlingerConsumer->getCurrentCrop());
@@ -1424,6 +1580,7 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
             mCurrentTransform = transform;
             mCurrentScalingMode = scalingMode;
             recomputeVisibleRegions = true;
+            geometryChanged = true;
         }
 
         if (oldActiveBuffer != NULL) {
@@ -1432,16 +1589,21 @@ Region Layer::latchBuffer(bool& recomputeVisibleRegions)
             if (bufWidth != uint32_t(oldActiveBuffer->width) ||
                 bufHeight != uint32_t(oldActiveBuffer->height)) {
                 recomputeVisibleRegions = true;
+                geometryChanged = true;
             }
         }
 
         mCurrentOpacity = getOpacityForFormat(mActiveBuffer->format);
         if (oldOpacity != isOpaque(s)) {
             recomputeVisibleRegions = true;
+            geometryChanged = true;
         }
 
-        // FIXME: postedRegion should be dirty & bounds
         Region dirtyRegion(Rect(s.active.w, s.active.h));
+        if (!geometryChanged) {
+            // only what the producer says it redrew needs composing again
+            dirtyRegion = getDamageInLayerSpace(dirtyRegion);
+        }
 
         // transform the dirty region to window-manager space
         outDirtyRegion = (s.transform.transform(dirtyRegion));
@@ -1526,11 +1688,53 @@ void Layer::dump(String8& result, Colorizer& colorizer) const
             mFormat, w0, h0, s0,f0,
             mQueuedFrames, mRefreshPending);
 
+    uint32_t numBuffers = 0;
+    uint64_t bufferBytes = 0;
+    getBufferMemoryUsage(&numBuffers, &bufferBytes);
+    result.appendFormat("      allocated buffers=%u (%" PRIu64 " KiB)%s\n",
+            numBuffers, bufferBytes / 1024,
+            mBuffersTrimmed ? ", trimmed" : "");
+
     if (mSurfaceFlingerConsumer != 0) {
         mSurfaceFlingerConsumer->dump(result, "            ");
     }
 }
 
+void Layer::getBufferMemoryUsage(uint32_t* outBufferCount,
+        uint64_t* outBytes) const {
+    if (mSurfaceFlingerConsumer == NULL ||
+            mSurfaceFlingerConsumer->getBufferMemoryUsage(outBufferCount,
+                    outBytes) != NO_ERROR) {
+        *outBufferCount = 0;
+        *outBytes = 0;
+    }
+}
+
+void Layer::setBuffersTrimmed(bool trimmed) {
+    if (mSurfaceFlingerConsumer == NULL) {
+        return;
+    }
+    if (trimmed) {
+        // Producers that set their own buffer count keep it, but still lose
+        // the buffers they don't use
+        mSurfaceFlingerConsumer->setDefaultMaxBufferCount(
+                TRIMMED_MAX_BUFFER_COUNT);
+        mSurfaceFlingerConsumer->discardFreeBuffers();
+    } else if (mBuffersTrimmed) {
+        mSurfaceFlingerConsumer->setDefaultMaxBufferCount(
+                DEFAULT_MAX_BUFFER_COUNT);
+    }
+    mBuffersTrimmed = trimmed;
+}
+
+void Layer::discardIdleBuffers() {
+    if (mSurfaceFlingerConsumer != NULL) {
+        ATRACE_NAME(mName.string());
+        mSurfaceFlingerConsumer->discardFreeBuffers();
+    }
+    mIdleBuffersDiscarded = true;
+}
+
 void Layer::dumpFrameStats(String8& result) const {
     mFrameTracker.dumpStats(result);
 }
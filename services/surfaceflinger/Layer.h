@@ -23,6 +23,7 @@
 #include <EGL/egl.h>
 #include <EGL/eglext.h>
 
+#include <utils/KeyedVector.h>
 #include <utils/RefBase.h>
 #include <utils/String8.h>
 #include <utils/Timers.h>
@@ -117,6 +118,28 @@ public:
         Region requestedTransparentRegion;
     };
 
+    // The inputs and outcome of the last computeVisibleRegions pass over
+    // this layer. As long as none of the inputs changed and the same,
+    // unchanged layers are above it, its visible and covered regions are
+    // still current, and the pass can carry on from the opaque and covered
+    // regions accumulated down to this layer.
+    struct VisibilityCache {
+        VisibilityCache() : valid(false), above(NULL), sequence(0),
+                layerStack(0), visible(false), opaque(false) {}
+        bool valid;
+        // only compared, never dereferenced
+        const Layer* above;
+        int32_t sequence;
+        uint32_t layerStack;
+        Geometry active;
+        bool visible;
+        bool opaque;
+        Region transparentRegion;
+        Region aboveOpaqueLayers;
+        Region aboveCoveredLayers;
+    };
+    VisibilityCache visibilityCache;
+
     // -----------------------------------------------------------------------
 
     Layer(SurfaceFlinger* flinger, const sp<Client>& client,
@@ -144,6 +167,10 @@ public:
     void useSurfaceDamage();
     void useEmptyDamage();
 
+    // getDamageInLayerSpace returns the surface damage of the current buffer
+    // mapped to layer coordinates, or bounds if it can't be mapped exactly
+    Region getDamageInLayerSpace(const Region& bounds) const;
+
     uint32_t getTransactionFlags(uint32_t flags);
     uint32_t setTransactionFlags(uint32_t flags);
 
@@ -187,6 +214,28 @@ public:
      */
     virtual bool isVisible() const;
 
+    /*
+     * canBeFlattened - true if drawing this layer into a transparent
+     * offscreen buffer, and that buffer onto the framebuffer, gives the same
+     * result as drawing the layer directly (see FlatteningCache).
+     */
+    bool canBeFlattened() const;
+
+    /*
+     * updateCompositionHistory - records the composition type prepare()
+     * picked for this layer on the given HWC display. Layers the HWC keeps
+     * moving between overlays and GLES get pinned to GLES for a while, which
+     * avoids recomposing the framebuffer target whenever they move. Returns
+     * true when this pins or unpins the layer, which changes its geometry.
+     */
+    bool updateCompositionHistory(int32_t hwcId, int32_t compositionType);
+
+    /*
+     * isPinnedToGles - true if this layer should be composited by GLES on
+     * the given HWC display, see updateCompositionHistory
+     */
+    bool isPinnedToGles(int32_t hwcId) const;
+
     /*
      * isFixedSize - true if content has a fixed size
      */
@@ -202,15 +251,19 @@ protected:
 public:
     // -----------------------------------------------------------------------
 
-    void setGeometry(const sp<const DisplayDevice>& hw,
+    virtual void setGeometry(const sp<const DisplayDevice>& hw,
             HWComposer::HWCLayerInterface& layer);
-    void setPerFrameData(const sp<const DisplayDevice>& hw,
+    virtual void setPerFrameData(const sp<const DisplayDevice>& hw,
             HWComposer::HWCLayerInterface& layer);
     void setAcquireFence(const sp<const DisplayDevice>& hw,
             HWComposer::HWCLayerInterface& layer);
 
     Rect getPosition(const sp<const DisplayDevice>& hw);
 
+    // getFrame returns the layer's frame in the layer stack's space, before
+    // it's clipped to a display's viewport, see getPosition
+    Rect getFrame() const;
+
     /*
      * called after page-flip
      */
@@ -257,6 +310,22 @@ public:
      */
     void setCoveredRegion(const Region& coveredRegion);
 
+    /*
+     * isVisibilityCacheValid - returns whether the visible regions computed
+     * for this layer on layerStack are still current, given the layer that
+     * is now directly above it (NULL if none) and that this one and all
+     * the layers above it were found unchanged.
+     */
+    bool isVisibilityCacheValid(const Layer* above, uint32_t layerStack) const;
+
+    /*
+     * updateVisibilityCache - called after computing the visible regions of
+     * this layer, with the opaque and covered regions of the layers above
+     * it and including it.
+     */
+    void updateVisibilityCache(const Layer* above,
+            const Region& aboveOpaqueLayers, const Region& aboveCoveredLayers);
+
     /*
      * setVisibleNonTransparentRegion - called when the visible and
      * non-transparent region changes.
@@ -274,9 +343,35 @@ public:
 
     bool isPotentialCursor() const { return mPotentialCursor;}
 
+    sp<Client> getClient() const { return mClientRef.promote(); }
+
+    /*
+     * getBufferMemoryUsage - returns the number of buffers allocated in the
+     * layer's BufferQueue and the memory they take. Thread-safe.
+     */
+    void getBufferMemoryUsage(uint32_t* outBufferCount,
+            uint64_t* outBytes) const;
+
     /*
-     * called with the state lock when the surface is removed from the
-     * current list
+     * setBuffersTrimmed - limits the layer to double-buffering and discards
+     * its free buffers, or gives it its default buffer count back. See
+     * LayerMemoryBudget. Main thread only.
+     */
+    void setBuffersTrimmed(bool trimmed);
+    bool areBuffersTrimmed() const { return mBuffersTrimmed; }
+
+    /*
+     * discardIdleBuffers - discards the free buffers of the layer, which is
+     * then left with the buffer it shows until it latches a new one. See
+     * LayerMemoryBudget. Main thread only.
+     */
+    void discardIdleBuffers();
+    bool areIdleBuffersDiscarded() const { return mIdleBuffersDiscarded; }
+    nsecs_t getLastLatchTime() const { return mLastLatchTime; }
+
+    /*
+     * called from the ReclaimThread once the surface was removed from the
+     * drawing list
      */
     void onRemoved();
 
@@ -306,6 +401,9 @@ public:
     // only for debugging
     inline const sp<GraphicBuffer>& getActiveBuffer() const { return mActiveBuffer; }
 
+    // the frame number of the buffer last latched by latchBuffer()
+    uint64_t getCurrentFrameNumber() const;
+
     inline  const State&    getDrawingState() const { return mDrawingState; }
     inline  const State&    getCurrentState() const { return mCurrentState; }
     inline  State&          getCurrentState()       { return mCurrentState; }
@@ -393,6 +491,8 @@ private:
     bool mCurrentOpacity;
     bool mRefreshPending;
     bool mFrameLatencyNeeded;
+    // When the current buffer was latched, for its FrameTimestamps
+    nsecs_t mLastLatchTime;
     // Whether filtering is forced on or not
     bool mFiltering;
     // Whether filtering is needed b/c of the drawingstate
@@ -401,6 +501,14 @@ private:
     mutable Mesh mMesh;
     // The texture used to draw the layer in GLES composition mode
     mutable Texture mTexture;
+    // The recent HWC composition types of the layer, per HWC display
+    struct CompositionHistory {
+        int32_t type;
+        uint32_t flips;
+        uint32_t stableFrames;
+        bool pinned;
+    };
+    KeyedVector<int32_t, CompositionHistory> mCompositionHistory;
 
     // page-flip thread (currently main thread)
     bool mProtectedByApp; // application requires protected path to external sink
@@ -421,6 +529,8 @@ private:
     uint64_t mLastFrameNumberReceived;
     bool mUpdateTexImageFailed; // This is only modified from the main thread
     bool mCaptureScreen;
+    bool mBuffersTrimmed; // This is only modified from the main thread
+    bool mIdleBuffersDiscarded; // This is only modified from the main thread
 };
 
 // ---------------------------------------------------------------------------
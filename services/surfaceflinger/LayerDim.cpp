@@ -16,6 +16,7 @@
 
 #include <stdlib.h>
 #include <stdint.h>
+#include <string.h>
 #include <sys/types.h>
 
 #include <utils/Errors.h>
@@ -39,6 +40,81 @@ LayerDim::LayerDim(SurfaceFlinger* flinger, const sp<Client>& client,
 LayerDim::~LayerDim() {
 }
 
+// The h/w composer has no solid color layers, but it can compose a dim
+// layer as an opaque black buffer scaled over the layer's frame and
+// blended with the layer's plane alpha, which keeps dim backgrounds out
+// of GLES composition when there's an overlay to spare. The buffer is
+// shared by all the dim layers and stays allocated once created, since
+// the h/w composer may still be scanning it out. It's a fraction of the
+// first display's size, to stay within the scalers' ratio limits.
+static const uint32_t SOLID_BUFFER_SCALE = 8;
+
+sp<GraphicBuffer> LayerDim::getSolidBuffer(
+        const sp<const DisplayDevice>& hw) const {
+    static sp<GraphicBuffer> sBuffer;
+    static bool sFailed = false;
+    if (!mFlinger->mHwcDimLayers || sFailed) {
+        return NULL;
+    }
+    if (sBuffer == NULL) {
+        const uint32_t w = (uint32_t(hw->getWidth()) + SOLID_BUFFER_SCALE - 1)
+                / SOLID_BUFFER_SCALE;
+        const uint32_t h = (uint32_t(hw->getHeight()) + SOLID_BUFFER_SCALE - 1)
+                / SOLID_BUFFER_SCALE;
+        sp<GraphicBuffer> buffer(new GraphicBuffer(w, h,
+                PIXEL_FORMAT_RGBA_8888,
+                GraphicBuffer::USAGE_HW_COMPOSER |
+                GraphicBuffer::USAGE_HW_TEXTURE |
+                GraphicBuffer::USAGE_SW_WRITE_RARELY));
+        void* vaddr = NULL;
+        if (buffer->initCheck() != NO_ERROR ||
+                buffer->lock(GraphicBuffer::USAGE_SW_WRITE_RARELY,
+                        &vaddr) != NO_ERROR) {
+            ALOGW("can't allocate the dim layers' buffer, "
+                    "they will be composed with GLES");
+            sFailed = true;
+            return NULL;
+        }
+        uint32_t* pixels = static_cast<uint32_t*>(vaddr);
+        const size_t count = size_t(buffer->getStride()) * h;
+        for (size_t i = 0; i < count; i++) {
+            pixels[i] = 0xFF000000;
+        }
+        buffer->unlock();
+        sBuffer = buffer;
+    }
+    return sBuffer;
+}
+
+void LayerDim::setGeometry(const sp<const DisplayDevice>& hw,
+        HWComposer::HWCLayerInterface& layer)
+{
+    Layer::setGeometry(hw, layer);
+    sp<GraphicBuffer> buffer(getSolidBuffer(hw));
+    if (buffer != NULL) {
+        // the buffer is uniform, the whole of it can be scaled to the frame
+        // and it doesn't need to be rotated
+        layer.setCrop(FloatRect(0, 0,
+                buffer->getWidth(), buffer->getHeight()));
+        layer.setTransform(0);
+    }
+}
+
+void LayerDim::setPerFrameData(const sp<const DisplayDevice>& hw,
+        HWComposer::HWCLayerInterface& layer)
+{
+    sp<GraphicBuffer> buffer(getSolidBuffer(hw));
+    if (buffer == NULL) {
+        Layer::setPerFrameData(hw, layer);
+        return;
+    }
+    const Transform& tr = hw->getOriginalTransform();
+    Region visible = tr.transform(visibleRegion.intersect(hw->getViewport()));
+    layer.setVisibleRegionScreen(visible);
+    layer.setSurfaceDamage(surfaceDamageRegion);
+    layer.setBuffer(buffer);
+}
+
 void LayerDim::onDraw(const sp<const DisplayDevice>& hw,
         const Region& /* clip */, bool useIdentityTransform) const
 {
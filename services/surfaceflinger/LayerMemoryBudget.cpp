@@ -0,0 +1,208 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <inttypes.h>
+
+#include <algorithm>
+
+#include <utils/KeyedVector.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/Trace.h>
+#include <utils/Vector.h>
+
+#include "Client.h"
+#include "Layer.h"
+#include "LayerMemoryBudget.h"
+
+namespace android {
+
+namespace {
+
+struct Candidate {
+    Layer* layer;
+    uint64_t bytes;
+};
+
+bool isLarger(const Candidate& lhs, const Candidate& rhs) {
+    return lhs.bytes > rhs.bytes;
+}
+
+struct ClientUsage {
+    ClientUsage() : pid(-1), numLayers(0), numBuffers(0), bytes(0) {}
+    pid_t pid;
+    uint32_t numLayers;
+    uint32_t numBuffers;
+    uint64_t bytes;
+};
+
+} // anonymous namespace
+
+LayerMemoryBudget::LayerMemoryBudget() :
+    mBudget(0),
+    mIdleTimeout(0),
+    mLastUpdate(0),
+    mLastTotal(0),
+    mNumOverBudget(0),
+    mNumTrimmed(0),
+    mNumRestored(0),
+    mNumIdleDiscards(0) {
+}
+
+void LayerMemoryBudget::setBudget(uint64_t bytes) {
+    mBudget = bytes;
+}
+
+void LayerMemoryBudget::setIdleTimeout(nsecs_t timeout) {
+    mIdleTimeout = timeout;
+}
+
+void LayerMemoryBudget::update(const SortedVector< sp<Layer> >& layers,
+        const SortedVector<const Layer*>& visibleLayers, bool force,
+        nsecs_t now) {
+    if (!force && now - mLastUpdate < UPDATE_INTERVAL) {
+        return;
+    }
+    ATRACE_CALL();
+    mLastUpdate = now;
+
+    uint64_t total = 0;
+    Vector<Candidate> candidates;
+    for (size_t i = 0; i < layers.size(); i++) {
+        const sp<Layer>& layer(layers[i]);
+        uint32_t numBuffers = 0;
+        uint64_t bytes = 0;
+        layer->getBufferMemoryUsage(&numBuffers, &bytes);
+        total += bytes;
+
+        const bool visible = visibleLayers.indexOf(layer.get()) >= 0;
+        if (visible && layer->areBuffersTrimmed()) {
+            layer->setBuffersTrimmed(false);
+            mNumRestored++;
+        } else if (!visible && bytes > 0) {
+            Candidate candidate = { layer.get(), bytes };
+            candidates.add(candidate);
+        }
+    }
+
+    if (total > mBudget) {
+        mNumOverBudget++;
+        // Layers already trimmed are left alone: they're limited to
+        // double-buffering until they're visible again, so trimming them
+        // on every update would only churn their buffers
+        Candidate* begin = candidates.editArray();
+        std::sort(begin, begin + candidates.size(), isLarger);
+        for (size_t i = 0; i < candidates.size() && total > mBudget; i++) {
+            Layer* layer = candidates[i].layer;
+            if (layer->areBuffersTrimmed()) {
+                continue;
+            }
+            mNumTrimmed++;
+            layer->setBuffersTrimmed(true);
+            uint32_t numBuffers = 0;
+            uint64_t bytes = 0;
+            layer->getBufferMemoryUsage(&numBuffers, &bytes);
+            if (bytes < candidates[i].bytes) {
+                total -= candidates[i].bytes - bytes;
+            }
+        }
+        ALOGW_IF(total > mBudget && mLastTotal <= mBudget,
+                "layer buffers use %" PRIu64 " KiB, over the budget of %"
+                PRIu64 " KiB even after trimming background layers",
+                total / 1024, mBudget / 1024);
+    }
+    mLastTotal = total;
+}
+
+nsecs_t LayerMemoryBudget::discardIdleBuffers(
+        const SortedVector< sp<Layer> >& layers, nsecs_t now) {
+    ATRACE_CALL();
+    nsecs_t next = 0;
+    for (size_t i = 0; i < layers.size(); i++) {
+        const sp<Layer>& layer(layers[i]);
+        const nsecs_t lastLatchTime = layer->getLastLatchTime();
+        // Layers that never latched a buffer have nothing to keep
+        if (lastLatchTime == 0 || layer->areIdleBuffersDiscarded()) {
+            continue;
+        }
+        const nsecs_t deadline = lastLatchTime + mIdleTimeout;
+        if (now >= deadline) {
+            layer->discardIdleBuffers();
+            mNumIdleDiscards++;
+        } else if (next == 0 || deadline < next) {
+            next = deadline;
+        }
+    }
+    return next;
+}
+
+void LayerMemoryBudget::dump(String8& result,
+        const SortedVector< sp<Layer> >& layers) const {
+    KeyedVector<const Client*, ClientUsage> clients;
+    uint32_t totalBuffers = 0;
+    uint64_t total = 0;
+
+    result.append("  layer buffers (buffers, KiB, trimmed):\n");
+    for (size_t i = 0; i < layers.size(); i++) {
+        const sp<Layer>& layer(layers[i]);
+        uint32_t numBuffers = 0;
+        uint64_t bytes = 0;
+        layer->getBufferMemoryUsage(&numBuffers, &bytes);
+        totalBuffers += numBuffers;
+        total += bytes;
+        result.appendFormat("    %2u %8" PRIu64 " %c %s\n", numBuffers,
+                bytes / 1024, layer->areBuffersTrimmed() ? 'T' : '-',
+                layer->getName().string());
+
+        const sp<Client> client(layer->getClient());
+        ssize_t index = clients.indexOfKey(client.get());
+        if (index < 0) {
+            ClientUsage usage;
+            usage.pid = client != NULL ? client->getPid() : -1;
+            index = clients.add(client.get(), usage);
+        }
+        ClientUsage& usage(clients.editValueAt(index));
+        usage.numLayers++;
+        usage.numBuffers += numBuffers;
+        usage.bytes += bytes;
+    }
+
+    result.append("  per client (pid, layers, buffers, KiB):\n");
+    for (size_t i = 0; i < clients.size(); i++) {
+        const ClientUsage& usage(clients.valueAt(i));
+        result.appendFormat("    %5d %3u %3u %8" PRIu64 "\n", usage.pid,
+                usage.numLayers, usage.numBuffers, usage.bytes / 1024);
+    }
+
+    result.appendFormat("  total: %u buffers, %" PRIu64 " KiB", totalBuffers,
+            total / 1024);
+    if (mBudget > 0) {
+        result.appendFormat(", budget %" PRIu64 " KiB\n", mBudget / 1024);
+        result.appendFormat("  over budget %u times, %u layers trimmed, "
+                "%u restored\n", mNumOverBudget, mNumTrimmed, mNumRestored);
+    } else {
+        result.append(", no budget\n");
+    }
+    if (mIdleTimeout > 0) {
+        result.appendFormat("  idle timeout %" PRId64 " ms, free buffers of "
+                "idle layers discarded %u times\n", ns2ms(mIdleTimeout),
+                mNumIdleDiscards);
+    }
+}
+
+}; // namespace android
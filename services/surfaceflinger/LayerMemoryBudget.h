@@ -0,0 +1,97 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_LAYERMEMORYBUDGET_H
+#define ANDROID_LAYERMEMORYBUDGET_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/SortedVector.h>
+#include <utils/StrongPointer.h>
+#include <utils/Timers.h>
+
+namespace android {
+
+class Layer;
+class String8;
+
+// LayerMemoryBudget accounts for the buffers allocated in the BufferQueues of
+// all layers, and keeps their total under a budget. When the total goes over
+// it, the layers that aren't visible on any display are trimmed, the largest
+// first, until it fits again: they are limited to double-buffering and their
+// free buffers are discarded. This mostly reclaims the third buffer of the
+// SurfaceViews and windows of apps in the background, which keep their
+// surfaces until they're stopped. A trimmed layer gets its default buffer
+// count back as soon as it's visible again, whatever the total.
+//
+// Independently of the budget, the free buffers of a layer that hasn't
+// latched a new buffer for the idle timeout are discarded, which leaves
+// static wallpapers and windows with just the buffer they show. The
+// producer allocates new ones when it draws again.
+//
+// It is *NOT* thread-safe, and is only used from the main thread, except
+// for dump().
+class LayerMemoryBudget {
+public:
+    LayerMemoryBudget();
+
+    // setBudget sets the budget in bytes, 0 disables enforcement
+    void setBudget(uint64_t bytes);
+    bool isEnabled() const { return mBudget > 0; }
+
+    // setIdleTimeout sets how long a layer must go without latching a buffer
+    // before its free buffers are discarded, 0 disables it
+    void setIdleTimeout(nsecs_t timeout);
+    nsecs_t getIdleTimeout() const { return mIdleTimeout; }
+
+    // update accounts for the buffers of layers and trims or restores them
+    // as needed. visibleLayers are the layers drawn on a display that's on.
+    // Unless force is set, it does nothing if the previous update was less
+    // than UPDATE_INTERVAL ago.
+    void update(const SortedVector< sp<Layer> >& layers,
+            const SortedVector<const Layer*>& visibleLayers, bool force,
+            nsecs_t now);
+
+    // discardIdleBuffers discards the free buffers of the layers that have
+    // been idle for the idle timeout. It returns when it should be called
+    // again, or 0 if no layer can become idle before one latches a buffer.
+    nsecs_t discardIdleBuffers(const SortedVector< sp<Layer> >& layers,
+            nsecs_t now);
+
+    // dump prints the current usage of layers, per client and per layer
+    void dump(String8& result,
+            const SortedVector< sp<Layer> >& layers) const;
+
+private:
+    // How often the layers are accounted for when nothing changed
+    static const nsecs_t UPDATE_INTERVAL = 1000000000;
+
+    uint64_t mBudget;
+    nsecs_t mIdleTimeout;
+    nsecs_t mLastUpdate;
+    uint64_t mLastTotal;
+
+    // Counters for dump()
+    uint32_t mNumOverBudget;
+    uint32_t mNumTrimmed;
+    uint32_t mNumRestored;
+    uint32_t mNumIdleDiscards;
+};
+
+}; // namespace android
+
+#endif // ANDROID_LAYERMEMORYBUDGET_H
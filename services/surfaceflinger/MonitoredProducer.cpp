@@ -122,6 +122,20 @@ String8 MonitoredProducer::getConsumerName() const {
     return mProducer->getConsumerName();
 }
 
+status_t MonitoredProducer::getControlBlock(sp<IMemoryHeap>* outHeap) {
+    return mProducer->getControlBlock(outHeap);
+}
+
+status_t MonitoredProducer::queueBufferAsync(int slot,
+        const QueueBufferInput& input, int32_t serial) {
+    return mProducer->queueBufferAsync(slot, input, serial);
+}
+
+status_t MonitoredProducer::getFrameTimestamps(uint64_t frameNumber,
+        FrameTimestamps* outTimestamps) {
+    return mProducer->getFrameTimestamps(frameNumber, outTimestamps);
+}
+
 IBinder* MonitoredProducer::onAsBinder() {
     return IInterface::asBinder(mProducer).get();
 }
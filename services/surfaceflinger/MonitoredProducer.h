@@ -56,6 +56,11 @@ public:
     virtual status_t allowAllocation(bool allow);
     virtual status_t setGenerationNumber(uint32_t generationNumber);
     virtual String8 getConsumerName() const override;
+    virtual status_t getControlBlock(sp<IMemoryHeap>* outHeap) override;
+    virtual status_t queueBufferAsync(int slot, const QueueBufferInput& input,
+            int32_t serial) override;
+    virtual status_t getFrameTimestamps(uint64_t frameNumber,
+            FrameTimestamps* outTimestamps) override;
     virtual IBinder* onAsBinder();
 
 private:
@@ -0,0 +1,128 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <utils/Log.h>
+#include <utils/Trace.h>
+
+#include "Layer.h"
+#include "ReclaimThread.h"
+
+#include "RenderEngine/RenderEngine.h"
+
+namespace android {
+
+ReclaimThread::ReclaimThread(EGLDisplay display, RenderEngine& engine) :
+    Thread(false),
+    mDisplay(display),
+    mEngine(engine),
+    mContext(EGL_NO_CONTEXT),
+    mSurface(EGL_NO_SURFACE),
+    mContextCurrent(false) {
+    // The shared context must be of the same client API version
+    EGLint version = 0;
+    eglQueryContext(display, engine.getEGLContext(),
+            EGL_CONTEXT_CLIENT_VERSION, &version);
+    const EGLConfig config = engine.getEGLConfig();
+    if (config == EGL_NO_CONFIG) {
+        return;
+    }
+    const EGLint contextAttributes[] = {
+            EGL_CONTEXT_CLIENT_VERSION, version, EGL_NONE };
+    mContext = eglCreateContext(display, config, engine.getEGLContext(),
+            contextAttributes);
+    if (mContext == EGL_NO_CONTEXT) {
+        ALOGW("couldn't create a shared context (%#x), deleting textures "
+                "on the main thread", eglGetError());
+        return;
+    }
+    const EGLint surfaceAttributes[] = { EGL_WIDTH, 1, EGL_HEIGHT, 1, EGL_NONE };
+    mSurface = eglCreatePbufferSurface(display, config, surfaceAttributes);
+    if (mSurface == EGL_NO_SURFACE) {
+        ALOGW("couldn't create a pbuffer (%#x), deleting textures on the "
+                "main thread", eglGetError());
+        eglDestroyContext(display, mContext);
+        mContext = EGL_NO_CONTEXT;
+    }
+}
+
+ReclaimThread::~ReclaimThread() {
+    if (mSurface != EGL_NO_SURFACE) {
+        eglDestroySurface(mDisplay, mSurface);
+    }
+    if (mContext != EGL_NO_CONTEXT) {
+        eglDestroyContext(mDisplay, mContext);
+    }
+}
+
+status_t ReclaimThread::readyToRun() {
+    Mutex::Autolock lock(mMutex);
+    if (mContext != EGL_NO_CONTEXT) {
+        mContextCurrent = eglMakeCurrent(mDisplay, mSurface, mSurface,
+                mContext) == EGL_TRUE;
+        ALOGW_IF(!mContextCurrent, "couldn't make the shared context "
+                "current (%#x), deleting textures on the main thread",
+                eglGetError());
+    }
+    return NO_ERROR;
+}
+
+void ReclaimThread::reclaimLayer(const sp<Layer>& layer) {
+    Mutex::Autolock lock(mMutex);
+    mLayers.add(layer);
+    mCondition.signal();
+}
+
+bool ReclaimThread::deleteTexture(uint32_t texture) {
+    Mutex::Autolock lock(mMutex);
+    if (!mContextCurrent) {
+        return false;
+    }
+    mTextures.add(texture);
+    mCondition.signal();
+    return true;
+}
+
+bool ReclaimThread::threadLoop() {
+    Vector< sp<Layer> > layers;
+    Vector<uint32_t> textures;
+    { // Autolock scope
+        Mutex::Autolock lock(mMutex);
+        while (mLayers.isEmpty() && mTextures.isEmpty()) {
+            mCondition.wait(mMutex);
+        }
+        layers = mLayers;
+        mLayers.clear();
+        textures = mTextures;
+        mTextures.clear();
+    }
+
+    ATRACE_NAME("ReclaimThread");
+    for (size_t i = 0; i < layers.size(); i++) {
+        layers[i]->onRemoved();
+    }
+    // This is the last reference to most of them, and their destructors
+    // queue their textures back here
+    layers.clear();
+
+    if (!textures.isEmpty()) {
+        mEngine.deleteTextures(textures.size(), textures.array());
+    }
+    return true;
+}
+
+}; // namespace android
@@ -0,0 +1,75 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_RECLAIMTHREAD_H
+#define ANDROID_RECLAIMTHREAD_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <EGL/egl.h>
+
+#include <utils/Condition.h>
+#include <utils/Mutex.h>
+#include <utils/Thread.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+class Layer;
+class RenderEngine;
+
+// ReclaimThread tears down removed layers and deletes their textures at a
+// low priority, away from the main thread. Abandoning a layer's consumer
+// frees all of its buffers, which destroys their EGLImages and unmaps them,
+// and an app going away with many layers would otherwise have all of that
+// done between two frames.
+//
+// Textures are deleted in a context that shares the RenderEngine's. If it
+// can't be made current, deleteTexture declines them so that the caller
+// deletes them on the main thread as before.
+class ReclaimThread : public Thread {
+public:
+    ReclaimThread(EGLDisplay display, RenderEngine& engine);
+    virtual ~ReclaimThread();
+
+    // reclaimLayer tells layer that it's no longer drawn, and drops the
+    // reference that was keeping it alive, from this thread
+    void reclaimLayer(const sp<Layer>& layer);
+
+    // deleteTexture queues the deletion of texture. It returns false if it
+    // can't delete it, in which case the caller must.
+    bool deleteTexture(uint32_t texture);
+
+private:
+    virtual status_t readyToRun();
+    virtual bool threadLoop();
+
+    const EGLDisplay mDisplay;
+    RenderEngine& mEngine;
+    EGLContext mContext;
+    EGLSurface mSurface;
+
+    Mutex mMutex;
+    Condition mCondition;
+    bool mContextCurrent;
+    Vector< sp<Layer> > mLayers;
+    Vector<uint32_t> mTextures;
+};
+
+}; // namespace android
+
+#endif // ANDROID_RECLAIMTHREAD_H
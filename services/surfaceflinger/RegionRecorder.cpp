@@ -0,0 +1,156 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <ui/Rect.h>
+#include <ui/Region.h>
+
+#include "RegionRecorder.h"
+
+namespace android {
+
+// The binary dump is a sequence of fields in the native byte order (little
+// endian on all current devices), without padding:
+//
+//   uint32 magic ('rgns'), uint32 version (1)
+//   then for each call of computeVisibleRegions:
+//     uint32 layer stack
+//     uint32 number of layers, then for each of them, from the top down:
+//       uint32 flags (RECORD_*)
+//       if RECORD_CACHED is set:
+//         region above opaque layers, region above covered layers
+//       otherwise:
+//         int32 bounds left, top, right, bottom
+//         region transparent, region old visible, region old covered
+//
+// where each region is a uint32 size followed by the region as flattened by
+// Region::flatten(). RegionBenchmark -f replays such recordings.
+static const uint32_t BINARY_MAGIC = 'rgns';
+static const uint32_t BINARY_VERSION = 1;
+
+enum {
+    RECORD_CACHED = 0x1,
+    RECORD_OPAQUE = 0x2,
+    RECORD_CONTENT_DIRTY = 0x4,
+};
+
+template <typename T>
+static void appendValue(String8& result, T value) {
+    result.append(reinterpret_cast<const char*>(&value), sizeof(value));
+}
+
+static void appendRegion(String8& result, const Region& region) {
+    const size_t size = region.getFlattenedSize();
+    appendValue(result, static_cast<uint32_t>(size));
+    const size_t offset = result.size();
+    char* buffer = result.lockBuffer(offset + size);
+    if (buffer == NULL) {
+        return;
+    }
+    region.flatten(buffer + offset, size);
+    result.unlockBuffer(offset + size);
+}
+
+RegionRecorder::RegionRecorder() :
+    mRecording(false),
+    mTruncated(false),
+    mNumCalls(0),
+    mCallLayerStack(0),
+    mCallNumLayers(0) {}
+
+void RegionRecorder::start() {
+    Mutex::Autolock lock(mMutex);
+    mRecording = true;
+    mTruncated = false;
+    mNumCalls = 0;
+    mRecords.clear();
+}
+
+bool RegionRecorder::beginCall(uint32_t layerStack) {
+    Mutex::Autolock lock(mMutex);
+    if (!mRecording) {
+        return false;
+    }
+    mCall.clear();
+    mCallLayerStack = layerStack;
+    mCallNumLayers = 0;
+    return true;
+}
+
+void RegionRecorder::addCachedLayer(const Region& aboveOpaqueLayers,
+        const Region& aboveCoveredLayers) {
+    appendValue(mCall, static_cast<uint32_t>(RECORD_CACHED));
+    appendRegion(mCall, aboveOpaqueLayers);
+    appendRegion(mCall, aboveCoveredLayers);
+    mCallNumLayers++;
+}
+
+void RegionRecorder::addLayer(const Rect& bounds, bool opaque,
+        bool contentDirty, const Region& transparentRegion,
+        const Region& oldVisibleRegion, const Region& oldCoveredRegion) {
+    uint32_t flags = 0;
+    if (opaque) {
+        flags |= RECORD_OPAQUE;
+    }
+    if (contentDirty) {
+        flags |= RECORD_CONTENT_DIRTY;
+    }
+    appendValue(mCall, flags);
+    appendValue(mCall, static_cast<int32_t>(bounds.left));
+    appendValue(mCall, static_cast<int32_t>(bounds.top));
+    appendValue(mCall, static_cast<int32_t>(bounds.right));
+    appendValue(mCall, static_cast<int32_t>(bounds.bottom));
+    appendRegion(mCall, transparentRegion);
+    appendRegion(mCall, oldVisibleRegion);
+    appendRegion(mCall, oldCoveredRegion);
+    mCallNumLayers++;
+}
+
+void RegionRecorder::endCall() {
+    Mutex::Autolock lock(mMutex);
+    if (!mRecording) {
+        // Fetched while the call was recorded
+        return;
+    }
+    if (mRecords.size() + mCall.size() + 2 * sizeof(uint32_t) > MAX_SIZE) {
+        mRecording = false;
+        mTruncated = true;
+        return;
+    }
+    appendValue(mRecords, mCallLayerStack);
+    appendValue(mRecords, mCallNumLayers);
+    mRecords.append(mCall);
+    mNumCalls++;
+}
+
+void RegionRecorder::dump(String8& result) const {
+    Mutex::Autolock lock(mMutex);
+    result.appendFormat("Region recording: %s%s, %u calls, %zu bytes\n",
+            mRecording ? "recording" : "stopped",
+            mTruncated ? " (full)" : "", mNumCalls, mRecords.size());
+}
+
+void RegionRecorder::dumpBinary(String8& result) {
+    Mutex::Autolock lock(mMutex);
+    appendValue(result, BINARY_MAGIC);
+    appendValue(result, BINARY_VERSION);
+    result.append(mRecords);
+    mRecording = false;
+    mTruncated = false;
+    mNumCalls = 0;
+    mRecords.clear();
+}
+
+}; // namespace android
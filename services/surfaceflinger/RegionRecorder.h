@@ -0,0 +1,91 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_REGIONRECORDER_H
+#define ANDROID_REGIONRECORDER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/Mutex.h>
+#include <utils/String8.h>
+
+namespace android {
+
+class Rect;
+class Region;
+
+// RegionRecorder records the inputs of SurfaceFlinger::computeVisibleRegions,
+// layer by layer, from which the Region operations it runs can be replayed
+// exactly, by RegionBenchmark in libs/ui/tests. This is so that Region can be
+// optimized against the layer stacks of real devices.
+//
+// Recordings are started, and fetched in the binary format described in
+// RegionRecorder.cpp, with dumpsys SurfaceFlinger --regions. They're kept in
+// memory until then, up to MAX_SIZE bytes. It's updated from the main thread
+// and dumped from binder threads, so it's thread-safe, except that a call's
+// records are only ever added by the main thread.
+class RegionRecorder {
+public:
+    RegionRecorder();
+
+    // start discards any previous recording and starts a new one
+    void start();
+
+    // beginCall starts the records of a computeVisibleRegions call on
+    // layerStack, and returns whether it is being recorded. The layers are
+    // only added, from the top of the stack down, if it is.
+    bool beginCall(uint32_t layerStack);
+
+    // addCachedLayer records a layer whose visibility cache was valid, along
+    // with the regions it restored
+    void addCachedLayer(const Region& aboveOpaqueLayers,
+            const Region& aboveCoveredLayers);
+
+    // addLayer records a layer whose regions were computed: its bounds on
+    // screen (empty if it's hidden), whether it's opaque, whether its
+    // content was dirty, its transparent region and the visible and covered
+    // regions it had before
+    void addLayer(const Rect& bounds, bool opaque, bool contentDirty,
+            const Region& transparentRegion, const Region& oldVisibleRegion,
+            const Region& oldCoveredRegion);
+
+    void endCall();
+
+    // dump appends the state of the recording as text
+    void dump(String8& result) const;
+
+    // dumpBinary appends the recording, and ends it
+    void dumpBinary(String8& result);
+
+private:
+    enum { MAX_SIZE = 8 * 1024 * 1024 };
+
+    mutable Mutex mMutex;
+    bool mRecording;
+    bool mTruncated;
+    uint32_t mNumCalls;
+    String8 mRecords;
+
+    // The records of the call in progress, only used by the main thread
+    String8 mCall;
+    uint32_t mCallLayerStack;
+    uint32_t mCallNumLayers;
+};
+
+}; // namespace android
+
+#endif // ANDROID_REGIONRECORDER_H
@@ -40,7 +40,7 @@ namespace android {
 // ---------------------------------------------------------------------------
 
 GLES20RenderEngine::GLES20RenderEngine() :
-        mVpWidth(0), mVpHeight(0) {
+        mVpWidth(0), mVpHeight(0), mVertexBuffer(0), mVertexBufferOffset(0) {
 
     glGetIntegerv(GL_MAX_TEXTURE_SIZE, &mMaxTextureSize);
     glGetIntegerv(GL_MAX_VIEWPORT_DIMS, mMaxViewportDims);
@@ -58,12 +58,21 @@ GLES20RenderEngine::GLES20RenderEngine() :
     glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, 1, 1, 0,
             GL_RGB, GL_UNSIGNED_SHORT_5_6_5, protTexData);
 
+    glGenBuffers(1, &mVertexBuffer);
+    glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+    glBufferData(GL_ARRAY_BUFFER, VERTEX_BUFFER_SIZE, NULL, GL_STREAM_DRAW);
+    glBindBuffer(GL_ARRAY_BUFFER, 0);
+
     //mColorBlindnessCorrection = M;
 }
 
 GLES20RenderEngine::~GLES20RenderEngine() {
 }
 
+void GLES20RenderEngine::primeCache() {
+    ProgramCache::getInstance().primeCache();
+}
+
 
 size_t GLES20RenderEngine::getMaxTextureSize() const {
     return mMaxTextureSize;
@@ -221,26 +230,54 @@ void GLES20RenderEngine::drawMesh(const Mesh& mesh) {
 
     ProgramCache::getInstance().useProgram(mState);
 
+    // positions and texture coordinates are interleaved, starting with the
+    // position of the first vertex
+    const GLvoid* positions = mesh.getPositions();
+    const GLvoid* texCoords = mesh.getTexCoords();
+    const size_t size = mesh.getVertexCount() * mesh.getByteStride();
+    const bool useVertexBuffer = mVertexBuffer != 0 &&
+            size <= VERTEX_BUFFER_SIZE;
+    if (useVertexBuffer) {
+        glBindBuffer(GL_ARRAY_BUFFER, mVertexBuffer);
+        if (mVertexBufferOffset + size > VERTEX_BUFFER_SIZE) {
+            // orphan the buffer: the driver allocates a new one rather than
+            // waiting for the GPU to be done with the draws that use it
+            glBufferData(GL_ARRAY_BUFFER, VERTEX_BUFFER_SIZE, NULL,
+                    GL_STREAM_DRAW);
+            mVertexBufferOffset = 0;
+        }
+        glBufferSubData(GL_ARRAY_BUFFER, static_cast<GLintptr>(mVertexBufferOffset),
+                static_cast<GLsizeiptr>(size), positions);
+        // with a buffer bound, the pointers are offsets into it
+        positions = reinterpret_cast<const GLvoid*>(mVertexBufferOffset);
+        texCoords = reinterpret_cast<const GLvoid*>(mVertexBufferOffset +
+                mesh.getVertexSize() * sizeof(float));
+        mVertexBufferOffset += size;
+    }
+
     if (mesh.getTexCoordsSize()) {
         glEnableVertexAttribArray(Program::texCoords);
         glVertexAttribPointer(Program::texCoords,
                 mesh.getTexCoordsSize(),
                 GL_FLOAT, GL_FALSE,
                 mesh.getByteStride(),
-                mesh.getTexCoords());
+                texCoords);
     }
 
     glVertexAttribPointer(Program::position,
             mesh.getVertexSize(),
             GL_FLOAT, GL_FALSE,
             mesh.getByteStride(),
-            mesh.getPositions());
+            positions);
 
     glDrawArrays(mesh.getPrimitive(), 0, mesh.getVertexCount());
 
     if (mesh.getTexCoordsSize()) {
         glDisableVertexAttribArray(Program::texCoords);
     }
+    if (useVertexBuffer) {
+        glBindBuffer(GL_ARRAY_BUFFER, 0);
+    }
 }
 
 void GLES20RenderEngine::dump(String8& result) {
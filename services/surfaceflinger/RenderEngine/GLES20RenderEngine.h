@@ -43,6 +43,13 @@ class GLES20RenderEngine : public RenderEngine {
     GLuint mVpWidth;
     GLuint mVpHeight;
 
+    // Meshes are streamed through this buffer object, used as a ring and
+    // orphaned whenever it wraps around, rather than drawn from client-side
+    // arrays, which the driver would have to copy at every draw call
+    enum { VERTEX_BUFFER_SIZE = 64 * 1024 };
+    GLuint mVertexBuffer;
+    size_t mVertexBufferOffset;
+
     struct Group {
         GLuint texture;
         GLuint fbo;
@@ -75,6 +82,7 @@ protected:
     virtual mat4 setupColorTransform(const mat4& colorTransform);
     virtual void disableTexturing();
     virtual void disableBlending();
+    virtual void primeCache();
 
     virtual void drawMesh(const Mesh& mesh);
 
@@ -0,0 +1,183 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#include <inttypes.h>
+
+#include <EGL/egl.h>
+#include <GLES2/gl2ext.h>
+
+#include <utils/String8.h>
+
+#include "GLExtensions.h"
+#include "GpuTimer.h"
+
+#ifndef GL_TIME_ELAPSED_EXT
+#define GL_TIME_ELAPSED_EXT             0x88BF
+#endif
+#ifndef GL_QUERY_RESULT_EXT
+#define GL_QUERY_RESULT_EXT             0x8866
+#endif
+#ifndef GL_QUERY_RESULT_AVAILABLE_EXT
+#define GL_QUERY_RESULT_AVAILABLE_EXT   0x8867
+#endif
+#ifndef GL_GPU_DISJOINT_EXT
+#define GL_GPU_DISJOINT_EXT             0x8FBB
+#endif
+
+// ---------------------------------------------------------------------------
+namespace android {
+// ---------------------------------------------------------------------------
+
+GpuTimer* GpuTimer::create() {
+    if (!GLExtensions::getInstance().hasExtension(
+            "GL_EXT_disjoint_timer_query")) {
+        return NULL;
+    }
+
+    GpuTimer* timer = new GpuTimer();
+    timer->mGenQueries = reinterpret_cast<GenQueriesProc>(
+            eglGetProcAddress("glGenQueriesEXT"));
+    timer->mDeleteQueries = reinterpret_cast<DeleteQueriesProc>(
+            eglGetProcAddress("glDeleteQueriesEXT"));
+    timer->mBeginQuery = reinterpret_cast<BeginQueryProc>(
+            eglGetProcAddress("glBeginQueryEXT"));
+    timer->mEndQuery = reinterpret_cast<EndQueryProc>(
+            eglGetProcAddress("glEndQueryEXT"));
+    timer->mGetQueryObjectuiv = reinterpret_cast<GetQueryObjectuivProc>(
+            eglGetProcAddress("glGetQueryObjectuivEXT"));
+    timer->mGetQueryObjectui64v = reinterpret_cast<GetQueryObjectui64vProc>(
+            eglGetProcAddress("glGetQueryObjectui64vEXT"));
+    if (!timer->mGenQueries || !timer->mDeleteQueries || !timer->mBeginQuery ||
+            !timer->mEndQuery || !timer->mGetQueryObjectuiv ||
+            !timer->mGetQueryObjectui64v) {
+        delete timer;
+        return NULL;
+    }
+
+    GLuint ids[NUM_QUERIES];
+    timer->mGenQueries(NUM_QUERIES, ids);
+    for (size_t i = 0; i < NUM_QUERIES; i++) {
+        timer->mQueries[i].id = ids[i];
+    }
+    // Clear a disjoint event that happened before we started
+    GLint disjoint;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    return timer;
+}
+
+GpuTimer::GpuTimer() :
+    mGenQueries(NULL),
+    mDeleteQueries(NULL),
+    mBeginQuery(NULL),
+    mEndQuery(NULL),
+    mGetQueryObjectuiv(NULL),
+    mGetQueryObjectui64v(NULL),
+    mFirstPending(0),
+    mNumPending(0),
+    mRunning(false),
+    mNumMeasured(0),
+    mNumSkipped(0),
+    mNumDisjoint(0) {
+    for (size_t i = 0; i < NUM_QUERIES; i++) {
+        mQueries[i].id = 0;
+        mQueries[i].tag = 0;
+    }
+}
+
+GpuTimer::~GpuTimer() {
+    if (mDeleteQueries && mQueries[0].id) {
+        GLuint ids[NUM_QUERIES];
+        for (size_t i = 0; i < NUM_QUERIES; i++) {
+            ids[i] = mQueries[i].id;
+        }
+        mDeleteQueries(NUM_QUERIES, ids);
+    }
+}
+
+void GpuTimer::begin(int32_t tag) {
+    if (mRunning) {
+        return;
+    }
+    if (mNumPending == NUM_QUERIES) {
+        mNumSkipped++;
+        return;
+    }
+    Query& query(mQueries[(mFirstPending + mNumPending) % NUM_QUERIES]);
+    query.tag = tag;
+    mBeginQuery(GL_TIME_ELAPSED_EXT, query.id);
+    mRunning = true;
+}
+
+void GpuTimer::end() {
+    if (!mRunning) {
+        return;
+    }
+    mEndQuery(GL_TIME_ELAPSED_EXT);
+    mRunning = false;
+    mNumPending++;
+}
+
+bool GpuTimer::getResult(int32_t* outTag, nsecs_t* outDuration) {
+    if (mNumPending == 0) {
+        return false;
+    }
+
+    const Query& query(mQueries[mFirstPending]);
+    GLuint available = 0;
+    mGetQueryObjectuiv(query.id, GL_QUERY_RESULT_AVAILABLE_EXT, &available);
+    if (!available) {
+        return false;
+    }
+
+    // A disjoint operation, e.g. a GPU frequency change or a context
+    // switch, makes the results of the queries that overlap it meaningless;
+    // the flag doesn't say which, so drop all the finished ones.
+    GLint disjoint = 0;
+    glGetIntegerv(GL_GPU_DISJOINT_EXT, &disjoint);
+    if (disjoint) {
+        while (mNumPending > 0) {
+            const Query& top(mQueries[mFirstPending]);
+            mGetQueryObjectuiv(top.id, GL_QUERY_RESULT_AVAILABLE_EXT,
+                    &available);
+            if (!available) {
+                break;
+            }
+            mFirstPending = (mFirstPending + 1) % NUM_QUERIES;
+            mNumPending--;
+            mNumDisjoint++;
+        }
+        return false;
+    }
+
+    GLuint64 elapsed = 0;
+    mGetQueryObjectui64v(query.id, GL_QUERY_RESULT_EXT, &elapsed);
+    *outTag = query.tag;
+    *outDuration = static_cast<nsecs_t>(elapsed);
+    mFirstPending = (mFirstPending + 1) % NUM_QUERIES;
+    mNumPending--;
+    mNumMeasured++;
+    return true;
+}
+
+void GpuTimer::dump(String8& result) const {
+    result.appendFormat("GPU composition timing: %" PRIu64 " measured, %"
+            PRIu64 " skipped, %" PRIu64 " dropped as disjoint\n",
+            mNumMeasured, mNumSkipped, mNumDisjoint);
+}
+
+// ---------------------------------------------------------------------------
+}; // namespace android
+// ---------------------------------------------------------------------------
@@ -0,0 +1,102 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef SF_GPUTIMER_H_
+#define SF_GPUTIMER_H_
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <GLES2/gl2.h>
+#include <utils/Timers.h>
+
+// ---------------------------------------------------------------------------
+namespace android {
+// ---------------------------------------------------------------------------
+
+class String8;
+
+/*
+ * GpuTimer measures how long the GPU spends on the GL commands issued between
+ * begin() and end(), with GL_EXT_disjoint_timer_query. The results are only
+ * available once the GPU is done, so they're collected with getResult() a
+ * frame or more later, without ever waiting for them; a frame is skipped
+ * rather than waited for when all the queries are still pending.
+ *
+ * It must only be used on the thread, and with the context, it was created
+ * with.
+ */
+class GpuTimer {
+public:
+    // create returns NULL if the current context doesn't support
+    // GL_EXT_disjoint_timer_query
+    static GpuTimer* create();
+    ~GpuTimer();
+
+    // begin starts timing for tag, unless a query is already running
+    void begin(int32_t tag);
+    void end();
+
+    // getResult returns the oldest measurement the GPU has finished, in the
+    // order they were made, or false if there's none yet
+    bool getResult(int32_t* outTag, nsecs_t* outDuration);
+
+    void dump(String8& result) const;
+
+private:
+    enum { NUM_QUERIES = 8 };
+
+    typedef void (GL_APIENTRYP GenQueriesProc)(GLsizei n, GLuint* ids);
+    typedef void (GL_APIENTRYP DeleteQueriesProc)(GLsizei n, const GLuint* ids);
+    typedef void (GL_APIENTRYP BeginQueryProc)(GLenum target, GLuint id);
+    typedef void (GL_APIENTRYP EndQueryProc)(GLenum target);
+    typedef void (GL_APIENTRYP GetQueryObjectuivProc)(GLuint id, GLenum pname,
+            GLuint* params);
+    typedef void (GL_APIENTRYP GetQueryObjectui64vProc)(GLuint id,
+            GLenum pname, GLuint64* params);
+
+    struct Query {
+        GLuint id;
+        int32_t tag;
+    };
+
+    GpuTimer();
+
+    GenQueriesProc mGenQueries;
+    DeleteQueriesProc mDeleteQueries;
+    BeginQueryProc mBeginQuery;
+    EndQueryProc mEndQuery;
+    GetQueryObjectuivProc mGetQueryObjectuiv;
+    GetQueryObjectui64vProc mGetQueryObjectui64v;
+
+    // A ring of queries; the pending ones, ended but not collected yet,
+    // start at mFirstPending
+    Query mQueries[NUM_QUERIES];
+    size_t mFirstPending;
+    size_t mNumPending;
+    bool mRunning;
+
+    // Counters for dump()
+    uint64_t mNumMeasured;
+    uint64_t mNumSkipped;
+    uint64_t mNumDisjoint;
+};
+
+// ---------------------------------------------------------------------------
+}; // namespace android
+// ---------------------------------------------------------------------------
+
+#endif /* SF_GPUTIMER_H_ */
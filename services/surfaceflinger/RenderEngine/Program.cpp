@@ -15,6 +15,9 @@
  */
 
 #include <stdint.h>
+#include <string.h>
+
+#include <GLES2/gl2ext.h>
 
 #include <log/log.h>
 
@@ -53,24 +56,70 @@ Program::Program(const ProgramCache::Key& /*needs*/, const char* vertex, const c
         glDeleteShader(fragmentId);
         glDeleteProgram(programId);
     } else {
-        mProgram = programId;
         mVertexShader = vertexId;
         mFragmentShader = fragmentId;
-        mInitialized = true;
-
-        mColorMatrixLoc = glGetUniformLocation(programId, "colorMatrix");
-        mProjectionMatrixLoc = glGetUniformLocation(programId, "projection");
-        mTextureMatrixLoc = glGetUniformLocation(programId, "texture");
-        mSamplerLoc = glGetUniformLocation(programId, "sampler");
-        mColorLoc = glGetUniformLocation(programId, "color");
-        mAlphaPlaneLoc = glGetUniformLocation(programId, "alphaPlane");
-
-        // set-up the default values for our uniforms
-        glUseProgram(programId);
-        const GLfloat m[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
-        glUniformMatrix4fv(mProjectionMatrixLoc, 1, GL_FALSE, m);
-        glEnableVertexAttribArray(0);
+        initialize(programId);
+    }
+}
+
+Program::Program(const ProgramCache::Key& /*needs*/, GLenum binaryFormat,
+        const void* binary, GLsizei length)
+        : mInitialized(false), mVertexShader(0), mFragmentShader(0) {
+    GLuint programId = glCreateProgram();
+    glProgramBinaryOES(programId, binaryFormat, binary, length);
+
+    // the attribute locations bound at link time are part of the binary
+    GLint status;
+    glGetProgramiv(programId, GL_LINK_STATUS, &status);
+    if (status != GL_TRUE) {
+        // typically after a driver update; the caller compiles it again
+        glDeleteProgram(programId);
+    } else {
+        initialize(programId);
+    }
+}
+
+void Program::initialize(GLuint programId) {
+    mProgram = programId;
+    mInitialized = true;
+    mUniformsCached = false;
+
+    mColorMatrixLoc = glGetUniformLocation(programId, "colorMatrix");
+    mProjectionMatrixLoc = glGetUniformLocation(programId, "projection");
+    mTextureMatrixLoc = glGetUniformLocation(programId, "texture");
+    mSamplerLoc = glGetUniformLocation(programId, "sampler");
+    mColorLoc = glGetUniformLocation(programId, "color");
+    mAlphaPlaneLoc = glGetUniformLocation(programId, "alphaPlane");
+
+    // set-up the default values for our uniforms
+    glUseProgram(programId);
+    const GLfloat m[16] = {1,0,0,0, 0,1,0,0, 0,0,1,0, 0,0,0,1 };
+    glUniformMatrix4fv(mProjectionMatrixLoc, 1, GL_FALSE, m);
+    if (mSamplerLoc >= 0) {
+        // we only ever sample texture unit 0
+        glUniform1i(mSamplerLoc, 0);
+    }
+    glEnableVertexAttribArray(0);
+}
+
+bool Program::getBinary(GLenum* outFormat, Vector<uint8_t>* outBinary) const {
+    if (!mInitialized) {
+        return false;
     }
+    GLint length = 0;
+    glGetProgramiv(mProgram, GL_PROGRAM_BINARY_LENGTH_OES, &length);
+    if (length <= 0) {
+        return false;
+    }
+    outBinary->resize(static_cast<size_t>(length));
+    GLsizei written = 0;
+    glGetProgramBinaryOES(mProgram, length, &written, outFormat,
+            outBinary->editArray());
+    if (written <= 0) {
+        return false;
+    }
+    outBinary->resize(static_cast<size_t>(written));
+    return true;
 }
 
 Program::~Program() {
@@ -123,26 +172,50 @@ String8& Program::dumpShader(String8& result, GLenum /*type*/) {
     return result;
 }
 
+// Copies value into cached and returns true if it differs, or if force is set
+static bool updateCachedUniform(GLfloat* cached, const GLfloat* value,
+        size_t count, bool force) {
+    if (!force && memcmp(cached, value, count * sizeof(GLfloat)) == 0) {
+        return false;
+    }
+    memcpy(cached, value, count * sizeof(GLfloat));
+    return true;
+}
+
 void Program::setUniforms(const Description& desc) {
 
-    // TODO: we should have a mechanism here to not always reset uniforms that
-    // didn't change for this program.
+    // the uniforms are part of the program's state, so the ones that didn't
+    // change since this program was last used don't need to be set again
+    const bool force = !mUniformsCached;
+    mUniformsCached = true;
 
     if (mSamplerLoc >= 0) {
-        glUniform1i(mSamplerLoc, 0);
-        glUniformMatrix4fv(mTextureMatrixLoc, 1, GL_FALSE, desc.mTexture.getMatrix().asArray());
+        const GLfloat* m = desc.mTexture.getMatrix().asArray();
+        if (updateCachedUniform(mTextureMatrix, m, 16, force)) {
+            glUniformMatrix4fv(mTextureMatrixLoc, 1, GL_FALSE, m);
+        }
     }
     if (mAlphaPlaneLoc >= 0) {
-        glUniform1f(mAlphaPlaneLoc, desc.mPlaneAlpha);
+        if (updateCachedUniform(&mAlphaPlane, &desc.mPlaneAlpha, 1, force)) {
+            glUniform1f(mAlphaPlaneLoc, desc.mPlaneAlpha);
+        }
     }
     if (mColorLoc >= 0) {
-        glUniform4fv(mColorLoc, 1, desc.mColor);
+        if (updateCachedUniform(mColor, desc.mColor, 4, force)) {
+            glUniform4fv(mColorLoc, 1, desc.mColor);
+        }
     }
     if (mColorMatrixLoc >= 0) {
-        glUniformMatrix4fv(mColorMatrixLoc, 1, GL_FALSE, desc.mColorMatrix.asArray());
+        const GLfloat* m = desc.mColorMatrix.asArray();
+        if (updateCachedUniform(mColorMatrix, m, 16, force)) {
+            glUniformMatrix4fv(mColorMatrixLoc, 1, GL_FALSE, m);
+        }
     }
     // these uniforms are always present
-    glUniformMatrix4fv(mProjectionMatrixLoc, 1, GL_FALSE, desc.mProjectionMatrix.asArray());
+    const GLfloat* m = desc.mProjectionMatrix.asArray();
+    if (updateCachedUniform(mProjectionMatrix, m, 16, force)) {
+        glUniformMatrix4fv(mProjectionMatrixLoc, 1, GL_FALSE, m);
+    }
 }
 
 } /* namespace android */
@@ -21,6 +21,8 @@
 
 #include <GLES2/gl2.h>
 
+#include <utils/Vector.h>
+
 #include "Description.h"
 #include "ProgramCache.h"
 
@@ -37,6 +39,11 @@ public:
     enum { position=0, texCoords=1 };
 
     Program(const ProgramCache::Key& needs, const char* vertex, const char* fragment);
+
+    /* Loads a program saved by getBinary(), see GL_OES_get_program_binary.
+     * The result is not valid if the driver doesn't accept the binary. */
+    Program(const ProgramCache::Key& needs, GLenum binaryFormat,
+            const void* binary, GLsizei length);
     ~Program();
 
     /* whether this object is usable */
@@ -54,9 +61,13 @@ public:
     /* set-up uniforms from the description */
     void setUniforms(const Description& desc);
 
+    /* Retrieves the linked program in the driver's binary format */
+    bool getBinary(GLenum* outFormat, Vector<uint8_t>* outBinary) const;
+
 
 private:
     GLuint buildShader(const char* source, GLenum type);
+    void initialize(GLuint programId);
     String8& dumpShader(String8& result, GLenum type);
 
     // whether the initialization succeeded
@@ -84,6 +95,15 @@ private:
 
     /* location of the color uniform */
     GLint mColorLoc;
+
+    /* values last set for the uniforms above, so that unchanged ones aren't
+     * uploaded again; only meaningful once mUniformsCached is set */
+    bool mUniformsCached;
+    GLfloat mProjectionMatrix[16];
+    GLfloat mColorMatrix[16];
+    GLfloat mTextureMatrix[16];
+    GLfloat mAlphaPlane;
+    GLfloat mColor[4];
 };
 
 
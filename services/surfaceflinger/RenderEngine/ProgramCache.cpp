@@ -14,14 +14,21 @@
  * limitations under the License.
  */
 
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
 #include <GLES2/gl2.h>
 #include <GLES2/gl2ext.h>
 
+#include <utils/JenkinsHash.h>
 #include <utils/String8.h>
+#include <utils/Vector.h>
 
 #include "ProgramCache.h"
 #include "Program.h"
 #include "Description.h"
+#include "GLExtensions.h"
 
 namespace android {
 // -----------------------------------------------------------------------------------------------
@@ -77,10 +84,48 @@ Formatter& dedent(Formatter& f) {
 
 ANDROID_SINGLETON_STATIC_INSTANCE(ProgramCache)
 
-ProgramCache::ProgramCache() {
-    // Until surfaceflinger has a dependable blob cache on the filesystem,
-    // generate shaders on initialization so as to avoid jank.
-    primeCache();
+// Where cached programs are persisted, see saveBinaries(). Devices opt in by
+// setting SF_PROGRAM_BINARY_CACHE_FILE to a path writable by surfaceflinger.
+#ifdef PROGRAM_BINARY_CACHE_FILE
+static const char* const kBinaryCacheFile = PROGRAM_BINARY_CACHE_FILE;
+#else
+static const char* const kBinaryCacheFile = NULL;
+#endif
+
+// The binary cache file starts with this magic number and version, followed
+// by the GL renderer and version strings the binaries were produced with,
+// then for each program: key, hash of its sources, binary format, binary
+// length and the binary itself.
+static const uint32_t kBinaryCacheMagic = 0x73667062; // "sfpb"
+static const uint32_t kBinaryCacheVersion = 1;
+
+static bool hasProgramBinaries() {
+    if (!GLExtensions::getInstance().hasExtension("GL_OES_get_program_binary")) {
+        return false;
+    }
+    GLint numFormats = 0;
+    glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS_OES, &numFormats);
+    return numFormats > 0;
+}
+
+static String8 driverSignature() {
+    const GLExtensions& extensions(GLExtensions::getInstance());
+    return String8::format("%s %s %s", extensions.getVendor(),
+            extensions.getRenderer(), extensions.getVersion());
+}
+
+static bool readValue(FILE* file, uint32_t* value) {
+    return fread(value, sizeof(*value), 1, file) == 1;
+}
+
+static bool writeValue(FILE* file, uint32_t value) {
+    return fwrite(&value, sizeof(value), 1, file) == 1;
+}
+
+ProgramCache::ProgramCache() : mCurrentProgram(NULL) {
+    // The cache is primed by SurfaceFlinger once the first frame is out
+    // (see RenderEngine::primeCache); until then, programs are generated
+    // when they're first used.
 }
 
 ProgramCache::~ProgramCache() {
@@ -89,11 +134,18 @@ ProgramCache::~ProgramCache() {
 void ProgramCache::primeCache() {
     uint32_t shaderCount = 0;
     uint32_t keyMask = Key::BLEND_MASK | Key::OPACITY_MASK |
-                       Key::PLANE_ALPHA_MASK | Key::TEXTURE_MASK;
-    // Prime the cache for all combinations of the above masks,
-    // leaving off the experimental color matrix mask options.
+                       Key::PLANE_ALPHA_MASK | Key::TEXTURE_MASK |
+                       Key::COLOR_MATRIX_MASK;
+    // Prime the cache for all combinations of the above masks, including
+    // the color matrix ones, so that enabling daltonization or a color
+    // transform doesn't compile anything on the composition path.
 
     nsecs_t timeBefore = systemTime();
+    const bool persist = kBinaryCacheFile != NULL && hasProgramBinaries();
+    size_t loadedCount = 0;
+    if (persist) {
+        loadedCount = loadBinaries(kBinaryCacheFile);
+    }
     for (uint32_t keyVal = 0; keyVal <= keyMask; keyVal++) {
         Key shaderKey;
         shaderKey.set(keyMask, keyVal);
@@ -110,9 +162,112 @@ void ProgramCache::primeCache() {
             shaderCount++;
         }
     }
+    if (persist && shaderCount > 0) {
+        saveBinaries(kBinaryCacheFile);
+    }
     nsecs_t timeAfter = systemTime();
     float compileTimeMs = static_cast<float>(timeAfter - timeBefore) / 1.0E6;
-    ALOGD("shader cache generated - %u shaders in %f ms\n", shaderCount, compileTimeMs);
+    ALOGD("shader cache generated - %u shaders (%zu loaded) in %f ms\n",
+            shaderCount, loadedCount, compileTimeMs);
+}
+
+uint32_t ProgramCache::hashSources(const Key& needs) {
+    const String8 vs(generateVertexShader(needs));
+    const String8 fs(generateFragmentShader(needs));
+    uint32_t hash = JenkinsHashMixBytes(0,
+            reinterpret_cast<const uint8_t*>(vs.string()), vs.size());
+    hash = JenkinsHashMixBytes(hash,
+            reinterpret_cast<const uint8_t*>(fs.string()), fs.size());
+    return JenkinsHashWhiten(hash);
+}
+
+size_t ProgramCache::loadBinaries(const char* path) {
+    FILE* file = fopen(path, "rb");
+    if (file == NULL) {
+        return 0;
+    }
+
+    size_t loaded = 0;
+    uint32_t magic, version, signatureLength;
+    const String8 signature(driverSignature());
+    if (readValue(file, &magic) && magic == kBinaryCacheMagic &&
+            readValue(file, &version) && version == kBinaryCacheVersion &&
+            readValue(file, &signatureLength) &&
+            signatureLength == signature.size()) {
+        Vector<char> savedSignature;
+        savedSignature.resize(signatureLength);
+        if (fread(savedSignature.editArray(), 1, signatureLength, file) !=
+                signatureLength ||
+                memcmp(savedSignature.array(), signature.string(),
+                        signatureLength) != 0) {
+            // produced by another driver
+            fclose(file);
+            return 0;
+        }
+
+        uint32_t keyValue, hash, format, length;
+        Vector<uint8_t> binary;
+        while (readValue(file, &keyValue) && readValue(file, &hash) &&
+                readValue(file, &format) && readValue(file, &length)) {
+            binary.resize(length);
+            if (fread(binary.editArray(), 1, length, file) != length) {
+                break;
+            }
+            Key needs;
+            needs.mKey = keyValue;
+            if (mCache.indexOfKey(needs) >= 0 || hash != hashSources(needs)) {
+                continue;
+            }
+            Program* program = new Program(needs, format, binary.array(),
+                    static_cast<GLsizei>(length));
+            if (!program->isValid()) {
+                delete program;
+                continue;
+            }
+            mCache.add(needs, program);
+            loaded++;
+        }
+    }
+    fclose(file);
+    return loaded;
+}
+
+void ProgramCache::saveBinaries(const char* path) const {
+    // write a new file and rename it, so that a crash or reboot never
+    // leaves a truncated cache behind
+    const String8 tmpPath(String8::format("%s.tmp", path));
+    FILE* file = fopen(tmpPath.string(), "wb");
+    if (file == NULL) {
+        ALOGW("saveBinaries: can't create %s", tmpPath.string());
+        return;
+    }
+
+    const String8 signature(driverSignature());
+    bool ok = writeValue(file, kBinaryCacheMagic) &&
+            writeValue(file, kBinaryCacheVersion) &&
+            writeValue(file, static_cast<uint32_t>(signature.size())) &&
+            fwrite(signature.string(), 1, signature.size(), file) ==
+                    signature.size();
+    Vector<uint8_t> binary;
+    for (size_t i = 0; ok && i < mCache.size(); i++) {
+        GLenum format;
+        if (!mCache.valueAt(i)->getBinary(&format, &binary)) {
+            continue;
+        }
+        const Key& needs(mCache.keyAt(i));
+        ok = writeValue(file, needs.mKey) &&
+                writeValue(file, hashSources(needs)) &&
+                writeValue(file, format) &&
+                writeValue(file, static_cast<uint32_t>(binary.size())) &&
+                fwrite(binary.array(), 1, binary.size(), file) == binary.size();
+    }
+    if (fclose(file) != 0) {
+        ok = false;
+    }
+    if (!ok || rename(tmpPath.string(), path) != 0) {
+        ALOGW("saveBinaries: failed to write %s", path);
+        unlink(tmpPath.string());
+    }
 }
 
 ProgramCache::Key ProgramCache::computeKey(const Description& description) {
@@ -235,6 +390,8 @@ void ProgramCache::useProgram(const Description& description) {
         program = generateProgram(needs);
         mCache.add(needs, program);
         time += systemTime();
+        // linking it bound it
+        mCurrentProgram = NULL;
 
         //ALOGD(">>> generated new program: needs=%08X, time=%u ms (%d programs)",
         //        needs.mNeeds, uint32_t(ns2ms(time)), mCache.size());
@@ -242,7 +399,10 @@ void ProgramCache::useProgram(const Description& description) {
 
     // here we have a suitable program for this description
     if (program->isValid()) {
-        program->use();
+        if (program != mCurrentProgram) {
+            program->use();
+            mCurrentProgram = program;
+        }
         program->setUniforms(description);
     }
 }
@@ -111,9 +111,18 @@ public:
     // if none can be found.
     void useProgram(const Description& description);
 
-private:
     // Generate shaders to populate the cache
     void primeCache();
+
+private:
+    // Load the programs saved by saveBinaries() into the cache, skipping the
+    // ones whose shaders changed since; returns how many were loaded
+    size_t loadBinaries(const char* path);
+    // Save the cached programs in the driver's binary format, so that the
+    // next boot doesn't need to compile them
+    void saveBinaries(const char* path) const;
+    // hash of the shaders generated for a Key, to detect stale binaries
+    static uint32_t hashSources(const Key& needs);
     // compute a cache Key from a Description
     static Key computeKey(const Description& description);
     // generates a program from the Key
@@ -126,6 +135,10 @@ private:
     // Key/Value map used for caching Programs. Currently the cache
     // is never shrunk.
     DefaultKeyedVector<Key, Program*> mCache;
+
+    // The program last bound by useProgram(), or NULL if another one may
+    // have been bound since
+    Program* mCurrentProgram;
 };
 
 
@@ -23,6 +23,7 @@
 #include "GLES11RenderEngine.h"
 #include "GLES20RenderEngine.h"
 #include "GLExtensions.h"
+#include "GpuTimer.h"
 #include "Mesh.h"
 
 EGLAPI const char* eglQueryStringImplementationANDROID(EGLDisplay dpy, EGLint name);
@@ -78,18 +79,32 @@ RenderEngine* RenderEngine::create(EGLDisplay display, int hwcFormat) {
         LOG_ALWAYS_FATAL("no supported EGL_RENDERABLE_TYPEs");
     }
 
-    // Also create our EGLContext
+    // Also create our EGLContext. Ask for a high priority one when the
+    // driver can schedule contexts by priority, so that composition isn't
+    // held up behind the GPU work of applications. HAS_CONTEXT_PRIORITY
+    // boards support it without advertising it.
+#ifdef HAS_CONTEXT_PRIORITY
+    const bool usePriority = true;
+#else
+    const bool usePriority = findExtension(
+            eglQueryStringImplementationANDROID(display, EGL_EXTENSIONS),
+            "EGL_IMG_context_priority");
+#endif
     EGLint contextAttributes[] = {
             EGL_CONTEXT_CLIENT_VERSION, contextClientVersion,      // MUST be first
-#ifdef EGL_IMG_context_priority
-#ifdef HAS_CONTEXT_PRIORITY
-#warning "using EGL_IMG_context_priority"
             EGL_CONTEXT_PRIORITY_LEVEL_IMG, EGL_CONTEXT_PRIORITY_HIGH_IMG,
-#endif
-#endif
             EGL_NONE, EGL_NONE
     };
+    if (!usePriority) {
+        contextAttributes[2] = EGL_NONE;
+    }
     EGLContext ctxt = eglCreateContext(display, config, NULL, contextAttributes);
+    if (ctxt == EGL_NO_CONTEXT && usePriority) {
+        // a driver may refuse the priority, e.g. for lack of permission
+        ALOGW("can't create a high priority EGLContext, using the default");
+        contextAttributes[2] = EGL_NONE;
+        ctxt = eglCreateContext(display, config, NULL, contextAttributes);
+    }
 
     // if can't create a GL context, we can only abort.
     LOG_ALWAYS_FATAL_IF(ctxt==EGL_NO_CONTEXT, "EGLContext creation failed");
@@ -133,6 +148,11 @@ RenderEngine* RenderEngine::create(EGLDisplay display, int hwcFormat) {
         break;
     }
     engine->setEGLHandles(config, ctxt);
+    if (usePriority) {
+        eglQueryContext(display, ctxt, EGL_CONTEXT_PRIORITY_LEVEL_IMG,
+                &engine->mContextPriority);
+    }
+    engine->mGpuTimer = GpuTimer::create();
 
     ALOGI("OpenGL ES informations:");
     ALOGI("vendor    : %s", extensions.getVendor());
@@ -148,10 +168,12 @@ RenderEngine* RenderEngine::create(EGLDisplay display, int hwcFormat) {
     return engine;
 }
 
-RenderEngine::RenderEngine() : mEGLContext(EGL_NO_CONTEXT) {
+RenderEngine::RenderEngine() : mEGLContext(EGL_NO_CONTEXT),
+        mContextPriority(0), mGpuTimer(NULL) {
 }
 
 RenderEngine::~RenderEngine() {
+    delete mGpuTimer;
 }
 
 void RenderEngine::setEGLHandles(EGLConfig config, EGLContext ctxt) {
@@ -246,6 +268,11 @@ void RenderEngine::deleteTextures(size_t count, uint32_t const* names) {
     glDeleteTextures(count, names);
 }
 
+void RenderEngine::bindImageAsTexture(EGLImageKHR image, uint32_t texName) {
+    glBindTexture(GL_TEXTURE_2D, texName);
+    glEGLImageTargetTexture2DOES(GL_TEXTURE_2D, (GLeglImageOES)image);
+}
+
 void RenderEngine::readPixels(size_t l, size_t b, size_t w, size_t h, uint32_t* pixels) {
     glReadPixels(l, b, w, h, GL_RGBA, GL_UNSIGNED_BYTE, pixels);
 }
@@ -257,6 +284,14 @@ void RenderEngine::dump(String8& result) {
             extensions.getRenderer(),
             extensions.getVersion());
     result.appendFormat("%s\n", extensions.getExtension());
+    result.appendFormat("EGL context priority: %s\n",
+            mContextPriority == EGL_CONTEXT_PRIORITY_HIGH_IMG ? "high" :
+            mContextPriority == EGL_CONTEXT_PRIORITY_MEDIUM_IMG ? "medium" :
+            mContextPriority == EGL_CONTEXT_PRIORITY_LOW_IMG ? "low" :
+            "default");
+    if (mGpuTimer != NULL) {
+        mGpuTimer->dump(result);
+    }
 }
 
 // ---------------------------------------------------------------------------
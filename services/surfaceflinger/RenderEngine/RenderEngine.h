@@ -28,6 +28,14 @@
 
 #define EGL_NO_CONFIG ((EGLConfig)0)
 
+#ifndef EGL_IMG_context_priority
+#define EGL_IMG_context_priority 1
+#define EGL_CONTEXT_PRIORITY_LEVEL_IMG          0x3100
+#define EGL_CONTEXT_PRIORITY_HIGH_IMG           0x3101
+#define EGL_CONTEXT_PRIORITY_MEDIUM_IMG         0x3102
+#define EGL_CONTEXT_PRIORITY_LOW_IMG            0x3103
+#endif
+
 // ---------------------------------------------------------------------------
 namespace android {
 // ---------------------------------------------------------------------------
@@ -37,6 +45,7 @@ class Rect;
 class Region;
 class Mesh;
 class Texture;
+class GpuTimer;
 
 class RenderEngine {
     enum GlesVersion {
@@ -49,6 +58,9 @@ class RenderEngine {
 
     EGLConfig mEGLConfig;
     EGLContext mEGLContext;
+    // the EGL_CONTEXT_PRIORITY_LEVEL_IMG the context got, 0 if unknown
+    EGLint mContextPriority;
+    GpuTimer* mGpuTimer;
     void setEGLHandles(EGLConfig config, EGLContext ctxt);
 
     virtual void bindImageAsFramebuffer(EGLImageKHR image, uint32_t* texName, uint32_t* fbName, uint32_t* status) = 0;
@@ -66,6 +78,9 @@ public:
     // dump the extension strings. always call the base class.
     virtual void dump(String8& result);
 
+    // the GPU timer of the context, NULL if it has no timer queries
+    GpuTimer* getGpuTimer() const { return mGpuTimer; }
+
     // helpers
     void flush();
     void clearWithColor(float red, float green, float blue, float alpha);
@@ -77,6 +92,8 @@ public:
     void disableScissor();
     void genTextures(size_t count, uint32_t* names);
     void deleteTextures(size_t count, uint32_t const* names);
+    // makes image the storage of the GL_TEXTURE_2D texture texName
+    void bindImageAsTexture(EGLImageKHR image, uint32_t texName);
     void readPixels(size_t l, size_t b, size_t w, size_t h, uint32_t* pixels);
 
     class BindImageAsFramebuffer {
@@ -106,6 +123,10 @@ public:
     virtual void disableTexturing() = 0;
     virtual void disableBlending() = 0;
 
+    // generate ahead of time whatever composition might need later, e.g.
+    // shaders, so that it doesn't happen on the composition path
+    virtual void primeCache() { }
+
     // drawing
     virtual void drawMesh(const Mesh& mesh) = 0;
 
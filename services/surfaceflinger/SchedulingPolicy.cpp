@@ -0,0 +1,238 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/resource.h>
+
+#include <utils/Log.h>
+
+#include "SchedulingPolicy.h"
+
+namespace android {
+
+SchedulingPolicy::SchedulingPolicy() :
+    mCompositionPriority(0),
+    mVsyncPriority(0),
+    mHasCpuSet(false) {
+    CPU_ZERO(&mCpuSet);
+}
+
+void SchedulingPolicy::setCompositionPriority(int rtPriority) {
+    mCompositionPriority = rtPriority > 0 ? rtPriority : 0;
+}
+
+void SchedulingPolicy::setVsyncPriority(int rtPriority) {
+    mVsyncPriority = rtPriority > 0 ? rtPriority : 0;
+}
+
+bool SchedulingPolicy::setAffinity(const char* cpus) {
+    mAffinity = cpus;
+    CPU_ZERO(&mCpuSet);
+    if (cpus[0] == '\0') {
+        mHasCpuSet = false;
+        return true;
+    }
+    if (!strcmp(cpus, "big")) {
+        mHasCpuSet = findBigCpus(&mCpuSet);
+    } else {
+        mHasCpuSet = parseCpuList(cpus, &mCpuSet);
+    }
+    ALOGW_IF(!mHasCpuSet, "no CPU matches ro.sf.cpu_affinity=%s", cpus);
+    return mHasCpuSet;
+}
+
+void SchedulingPolicy::applyToCompositionThread(const char* name, pid_t tid) {
+    apply(name, tid, mCompositionPriority);
+}
+
+void SchedulingPolicy::applyToVsyncThread(const char* name, pid_t tid) {
+    apply(name, tid, mVsyncPriority);
+}
+
+void SchedulingPolicy::apply(const char* name, pid_t tid, int rtPriority) {
+    ThreadInfo info;
+    info.name = name;
+    info.tid = tid;
+    info.rtPriority = rtPriority;
+    info.error = 0;
+    if (tid <= 0) {
+        return;
+    }
+    if (rtPriority > 0) {
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        param.sched_priority = rtPriority;
+        if (sched_setscheduler(tid, SCHED_FIFO, &param) != 0) {
+            info.error = errno;
+            ALOGW("can't make %s (%d) SCHED_FIFO/%d: %s", name, tid,
+                    rtPriority, strerror(errno));
+        }
+    }
+    if (mHasCpuSet && sched_setaffinity(tid, sizeof(mCpuSet), &mCpuSet) != 0) {
+        if (info.error == 0) {
+            info.error = errno;
+        }
+        ALOGW("can't set the CPU affinity of %s (%d): %s", name, tid,
+                strerror(errno));
+    }
+    if (rtPriority > 0 || mHasCpuSet) {
+        mThreads.add(info);
+    }
+}
+
+bool SchedulingPolicy::parseCpuList(const char* list, cpu_set_t* set) {
+    const long numCpus = sysconf(_SC_NPROCESSORS_CONF);
+    bool any = false;
+    const char* p = list;
+    while (*p) {
+        char* end;
+        long first = strtol(p, &end, 10);
+        if (end == p) {
+            return false;
+        }
+        long last = first;
+        p = end;
+        if (*p == '-') {
+            last = strtol(p + 1, &end, 10);
+            if (end == p + 1) {
+                return false;
+            }
+            p = end;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            if (cpu >= 0 && cpu < numCpus && cpu < CPU_SETSIZE) {
+                CPU_SET(cpu, set);
+                any = true;
+            }
+        }
+        if (*p == ',') {
+            p++;
+        } else if (*p) {
+            return false;
+        }
+    }
+    return any;
+}
+
+bool SchedulingPolicy::findBigCpus(cpu_set_t* set) {
+    const long numCpus = sysconf(_SC_NPROCESSORS_CONF);
+    long maxFreqs[CPU_SETSIZE];
+    long highest = 0;
+    long lowest = 0;
+    for (long cpu = 0; cpu < numCpus && cpu < CPU_SETSIZE; cpu++) {
+        char path[80];
+        snprintf(path, sizeof(path),
+                "/sys/devices/system/cpu/cpu%ld/cpufreq/cpuinfo_max_freq", cpu);
+        maxFreqs[cpu] = 0;
+        FILE* file = fopen(path, "r");
+        if (file != NULL) {
+            if (fscanf(file, "%ld", &maxFreqs[cpu]) != 1) {
+                maxFreqs[cpu] = 0;
+            }
+            fclose(file);
+        }
+        if (maxFreqs[cpu] > highest) {
+            highest = maxFreqs[cpu];
+        }
+        if (maxFreqs[cpu] > 0 && (lowest == 0 || maxFreqs[cpu] < lowest)) {
+            lowest = maxFreqs[cpu];
+        }
+    }
+    if (highest == lowest) {
+        // all the CPUs are the same, or we can't tell them apart
+        return false;
+    }
+    for (long cpu = 0; cpu < numCpus && cpu < CPU_SETSIZE; cpu++) {
+        if (maxFreqs[cpu] == highest) {
+            CPU_SET(cpu, set);
+        }
+    }
+    return true;
+}
+
+void SchedulingPolicy::appendCpuSet(String8& result, const cpu_set_t& set) {
+    const char* separator = "";
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (!CPU_ISSET(cpu, &set)) {
+            continue;
+        }
+        int last = cpu;
+        while (last + 1 < CPU_SETSIZE && CPU_ISSET(last + 1, &set)) {
+            last++;
+        }
+        if (last > cpu) {
+            result.appendFormat("%s%d-%d", separator, cpu, last);
+        } else {
+            result.appendFormat("%s%d", separator, cpu);
+        }
+        separator = ",";
+        cpu = last;
+    }
+}
+
+void SchedulingPolicy::dump(String8& result) const {
+    result.append("Scheduling policy: composition ");
+    if (mCompositionPriority > 0) {
+        result.appendFormat("SCHED_FIFO/%d", mCompositionPriority);
+    } else {
+        result.append("default");
+    }
+    result.append(", vsync ");
+    if (mVsyncPriority > 0) {
+        result.appendFormat("SCHED_FIFO/%d", mVsyncPriority);
+    } else {
+        result.append("default");
+    }
+    if (mHasCpuSet) {
+        result.appendFormat(", affinity \"%s\" (cpus ", mAffinity.string());
+        appendCpuSet(result, mCpuSet);
+        result.append(")\n");
+    } else {
+        result.append(", no affinity\n");
+    }
+
+    for (size_t i = 0; i < mThreads.size(); i++) {
+        const ThreadInfo& info(mThreads[i]);
+        // what the thread is actually running with
+        const int policy = sched_getscheduler(info.tid);
+        struct sched_param param;
+        memset(&param, 0, sizeof(param));
+        sched_getparam(info.tid, &param);
+        errno = 0;
+        const int nice = getpriority(PRIO_PROCESS, info.tid);
+        result.appendFormat("  %-16s tid %d: %s/%d nice %d", info.name,
+                info.tid, policy == SCHED_FIFO ? "SCHED_FIFO" :
+                policy == SCHED_RR ? "SCHED_RR" : "SCHED_OTHER",
+                param.sched_priority, errno ? 0 : nice);
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        if (sched_getaffinity(info.tid, sizeof(set), &set) == 0) {
+            result.append(", cpus ");
+            appendCpuSet(result, set);
+        }
+        if (info.error) {
+            result.appendFormat(" (failed: %s)", strerror(info.error));
+        }
+        result.append("\n");
+    }
+}
+
+}; // namespace android
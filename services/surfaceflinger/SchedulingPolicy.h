@@ -0,0 +1,85 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+
+#ifndef ANDROID_SCHEDULINGPOLICY_H
+#define ANDROID_SCHEDULINGPOLICY_H
+
+#include <sched.h>
+#include <stdint.h>
+#include <sys/types.h>
+
+#include <utils/String8.h>
+#include <utils/Vector.h>
+
+namespace android {
+
+// SchedulingPolicy moves the threads that pace composition out of the way
+// of the rest of the system: the main thread, which composites, and the
+// DispSync, EventThread and EventControl threads, which deliver vsync.
+// Each group can be given a SCHED_FIFO priority, and all of them can be
+// pinned to a set of CPUs, typically the big cores of a HMP SoC.
+//
+// Nothing changes unless it's configured, with ro.sf.rt_priority,
+// ro.sf.vsync_rt_priority and ro.sf.cpu_affinity. Binder threads aren't
+// covered, the binder driver runs them at their caller's priority.
+//
+// It's set up from SurfaceFlinger::init() with mStateLock held, which
+// dump() is also called with.
+class SchedulingPolicy {
+public:
+    SchedulingPolicy();
+
+    // The SCHED_FIFO priority of the composition and vsync threads, 0 to
+    // leave them SCHED_OTHER
+    void setCompositionPriority(int rtPriority);
+    void setVsyncPriority(int rtPriority);
+
+    // Pin the threads to the given CPUs, either a list like "4-7" or "0,2",
+    // or "big" for the CPUs with the highest maximum frequency. Returns
+    // false, and doesn't pin anything, if there's no such CPU.
+    bool setAffinity(const char* cpus);
+
+    void applyToCompositionThread(const char* name, pid_t tid);
+    void applyToVsyncThread(const char* name, pid_t tid);
+
+    void dump(String8& result) const;
+
+private:
+    struct ThreadInfo {
+        const char* name;
+        pid_t tid;
+        int rtPriority;
+        int error;      // errno of the first call that failed, or 0
+    };
+
+    void apply(const char* name, pid_t tid, int rtPriority);
+
+    static bool parseCpuList(const char* list, cpu_set_t* set);
+    static bool findBigCpus(cpu_set_t* set);
+    static void appendCpuSet(String8& result, const cpu_set_t& set);
+
+    int mCompositionPriority;
+    int mVsyncPriority;
+    String8 mAffinity;
+    bool mHasCpuSet;
+    cpu_set_t mCpuSet;
+    Vector<ThreadInfo> mThreads;
+};
+
+}; // namespace android
+
+#endif // ANDROID_SCHEDULINGPOLICY_H
@@ -24,6 +24,8 @@
 #include <inttypes.h>
 #include <stdatomic.h>
 
+#include <algorithm>
+
 #include <EGL/egl.h>
 
 #include <cutils/log.h>
@@ -67,6 +69,7 @@
 #include "EventThread.h"
 #include "Layer.h"
 #include "LayerDim.h"
+#include "ReclaimThread.h"
 #include "SurfaceFlinger.h"
 
 #include "DisplayHardware/FramebufferSurface.h"
@@ -75,6 +78,7 @@
 
 #include "Effects/Daltonizer.h"
 
+#include "RenderEngine/GpuTimer.h"
 #include "RenderEngine/RenderEngine.h"
 #include <cutils/compiler.h>
 
@@ -129,6 +133,7 @@ SurfaceFlinger::SurfaceFlinger()
         mTransactionFlags(0),
         mTransactionPending(false),
         mAnimTransactionPending(false),
+        mTransactionSerial(0),
         mLayersRemoved(false),
         mRepaintEverything(0),
         mRenderEngine(NULL),
@@ -146,14 +151,29 @@ SurfaceFlinger::SurfaceFlinger()
         mLastTransactionTime(0),
         mBootFinished(false),
         mForceFullDamage(false),
+        mIncrementalVisibleRegions(true),
+        mDeferNonHwcComposition(true),
+        mSnapshotTransactions(true),
+        mSkipUnchangedComposition(true),
+        mFlattenStaticLayers(true),
+        mUseAdaptivePhaseOffset(false),
+        mGpuTiming(true),
+        mHwcDimLayers(true),
+        mParallelInit(true),
+        mProgramCachePrimed(false),
         mPrimaryHWVsyncEnabled(false),
         mHWVsyncAvailable(false),
         mDaltonize(false),
         mHasColorMatrix(false),
+        mHasColorTransform(false),
         mHasPoweredOff(false),
         mFrameBuckets(),
         mTotalTime(0),
-        mLastSwapTime(0)
+        mLastSwapTime(0),
+        mSkippedCompositions(0),
+        mIdleBufferCheckPending(false),
+        mAdaptivePhaseOffset(sfVsyncPhaseOffsetNs),
+        mFrameStartTime(0)
 {
     ALOGI("SurfaceFlinger is starting");
 
@@ -163,19 +183,64 @@ SurfaceFlinger::SurfaceFlinger()
     property_get("ro.bq.gpu_to_cpu_unsupported", value, "0");
     mGpuToCpuSupported = !atoi(value);
 
+    property_get("ro.sf.preallocate_buffers", value, "0");
+    mPreallocateBuffers = atoi(value);
+
     property_get("debug.sf.showupdates", value, "0");
     mDebugRegion = atoi(value);
 
+    property_get("debug.sf.incremental_visible_regions", value, "1");
+    mIncrementalVisibleRegions = atoi(value);
+
+    property_get("debug.sf.defer_non_hwc_composition", value, "1");
+    mDeferNonHwcComposition = atoi(value);
+
+    property_get("debug.sf.snapshot_transactions", value, "1");
+    mSnapshotTransactions = atoi(value);
+
+    property_get("debug.sf.skip_unchanged_composition", value, "1");
+    mSkipUnchangedComposition = atoi(value);
+
+    property_get("debug.sf.flatten_static_layers", value, "1");
+    mFlattenStaticLayers = atoi(value);
+
+    property_get("debug.sf.adaptive_phase_offset", value, "0");
+    mUseAdaptivePhaseOffset = atoi(value);
+
+    property_get("debug.sf.gpu_timing", value, "1");
+    mGpuTiming = atoi(value);
+
+    property_get("debug.sf.hwc_dim_layers", value, "1");
+    mHwcDimLayers = atoi(value);
+
+    property_get("debug.sf.frame_stats_log", value, "0");
+    mFrameTrace.setStatsLogging(atoi(value));
+
+    property_get("ro.sf.parallel_init", value, "1");
+    mParallelInit = atoi(value);
+
+    property_get("ro.sf.rt_priority", value, "0");
+    mSchedulingPolicy.setCompositionPriority(atoi(value));
+
+    property_get("ro.sf.vsync_rt_priority", value, "0");
+    mSchedulingPolicy.setVsyncPriority(atoi(value));
+
+    property_get("ro.sf.cpu_affinity", value, "");
+    mSchedulingPolicy.setAffinity(value);
+
+    property_get("debug.sf.workload_hint", value, "0");
+    mWorkloadHint.setMode(static_cast<WorkloadHint::Mode>(atoi(value)));
+
+    property_get("ro.sf.layer_memory_budget_mb", value, "0");
+    mLayerMemoryBudget.setBudget(static_cast<uint64_t>(atoi(value)) << 20);
+
+    property_get("ro.sf.idle_buffer_timeout_s", value, "0");
+    mLayerMemoryBudget.setIdleTimeout(s2ns(atoi(value)));
+
+    // the DDMS connection is started once the boot is finished
     property_get("debug.sf.ddms", value, "0");
     mDebugDDMS = atoi(value);
-    if (mDebugDDMS) {
-        if (!startDdmConnection()) {
-            // start failed, and DDMS debugging not enabled
-            mDebugDDMS = 0;
-        }
-    }
     ALOGI_IF(mDebugRegion, "showupdates enabled");
-    ALOGI_IF(mDebugDDMS, "DDMS debugging enabled");
 }
 
 void SurfaceFlinger::onFirstRef()
@@ -290,6 +355,15 @@ void SurfaceFlinger::bootFinished()
     ALOGI("Boot is finished (%ld ms)", long(ns2ms(duration)) );
     mBootFinished = true;
 
+    // this loads the VM, which has no business slowing the boot down
+    if (mDebugDDMS) {
+        if (!startDdmConnection()) {
+            // start failed, and DDMS debugging not enabled
+            mDebugDDMS = 0;
+        }
+    }
+    ALOGI_IF(mDebugDDMS, "DDMS debugging enabled");
+
     // wait patiently for the window manager death
     const String16 name("window");
     sp<IBinder> window(defaultServiceManager()->getService(name));
@@ -304,6 +378,10 @@ void SurfaceFlinger::bootFinished()
 }
 
 void SurfaceFlinger::deleteTextureAsync(uint32_t texture) {
+    if (mReclaimThread != NULL && mReclaimThread->deleteTexture(texture)) {
+        return;
+    }
+
     class MessageDestroyGLTexture : public MessageBase {
         RenderEngine& engine;
         uint32_t texture;
@@ -412,7 +490,7 @@ private:
         }
 
         if (callback != NULL) {
-            callback->onVSyncEvent(when);
+            callback->onVSyncEvent(when, mDispSync->computeNextRefresh(0));
         }
     }
 
@@ -432,6 +510,23 @@ private:
     bool mEnabled;
 };
 
+// Loading the EGL driver and the h/w composer HAL are the bulk of init(),
+// and they don't depend on each other; this does the former while the main
+// thread does the latter.
+class EGLInitThread : public Thread {
+public:
+    EGLInitThread() : Thread(false), mDisplay(EGL_NO_DISPLAY) { }
+    EGLDisplay getDisplay() const { return mDisplay; }
+private:
+    virtual bool threadLoop() {
+        ATRACE_NAME("eglInitialize");
+        mDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        eglInitialize(mDisplay, NULL, NULL);
+        return false;
+    }
+    EGLDisplay mDisplay;
+};
+
 void SurfaceFlinger::init() {
     ALOGI(  "SurfaceFlinger's main thread ready to run. "
             "Initializing graphics H/W...");
@@ -440,14 +535,37 @@ void SurfaceFlinger::init() {
     Mutex::Autolock _l(mStateLock);
 
     // initialize EGL for the default display
-    mEGLDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
-    eglInitialize(mEGLDisplay, NULL, NULL);
+    sp<EGLInitThread> eglInitThread;
+    if (mParallelInit) {
+        eglInitThread = new EGLInitThread();
+        if (eglInitThread->run("EGLInit", PRIORITY_URGENT_DISPLAY) != NO_ERROR) {
+            eglInitThread.clear();
+        }
+    }
+    if (eglInitThread == NULL) {
+        mEGLDisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+        eglInitialize(mEGLDisplay, NULL, NULL);
+    }
+
+    // the EventThreads only need DispSync, start them while the drivers load
+    sp<VSyncSource> vsyncSrc = new DispSyncSource(&mPrimaryDispSync,
+            vsyncPhaseOffsetNs, true, "app");
+    mEventThread = new EventThread(vsyncSrc);
+    sp<VSyncSource> sfVsyncSrc = new DispSyncSource(&mPrimaryDispSync,
+            sfVsyncPhaseOffsetNs, true, "sf");
+    mSFEventThread = new EventThread(sfVsyncSrc);
+    mEventQueue.setEventThread(mSFEventThread);
 
     // Initialize the H/W composer object.  There may or may not be an
     // actual hardware composer underneath.
     mHwc = new HWComposer(this,
             *static_cast<HWComposer::EventHandler *>(this));
 
+    if (eglInitThread != NULL) {
+        eglInitThread->join();
+        mEGLDisplay = eglInitThread->getDisplay();
+    }
+
     // get a RenderEngine for the given display / config (can't fail)
     mRenderEngine = RenderEngine::create(mEGLDisplay, mHwc->getVisualID());
 
@@ -498,18 +616,25 @@ void SurfaceFlinger::init() {
     // (which may happens before we render something)
     getDefaultDisplayDevice()->makeCurrent(mEGLDisplay, mEGLContext);
 
-    // start the EventThread
-    sp<VSyncSource> vsyncSrc = new DispSyncSource(&mPrimaryDispSync,
-            vsyncPhaseOffsetNs, true, "app");
-    mEventThread = new EventThread(vsyncSrc);
-    sp<VSyncSource> sfVsyncSrc = new DispSyncSource(&mPrimaryDispSync,
-            sfVsyncPhaseOffsetNs, true, "sf");
-    mSFEventThread = new EventThread(sfVsyncSrc);
-    mEventQueue.setEventThread(mSFEventThread);
+    // removed layers are torn down in the background
+    mReclaimThread = new ReclaimThread(mEGLDisplay, *mRenderEngine);
+    mReclaimThread->run("Reclaim", PRIORITY_BACKGROUND);
 
+    // this one calls into the HWC right away
     mEventControlThread = new EventControlThread(this);
     mEventControlThread->run("EventControl", PRIORITY_URGENT_DISPLAY);
 
+    // init() runs on the main thread, which composites
+    mSchedulingPolicy.applyToCompositionThread("main", gettid());
+    mSchedulingPolicy.applyToVsyncThread("DispSync",
+            mPrimaryDispSync.getThreadId());
+    mSchedulingPolicy.applyToVsyncThread("EventThread app",
+            mEventThread->getTid());
+    mSchedulingPolicy.applyToVsyncThread("EventThread sf",
+            mSFEventThread->getTid());
+    mSchedulingPolicy.applyToVsyncThread("EventControl",
+            mEventControlThread->getTid());
+
     // set a fake vsync period if there is no HWComposer
     if (mHwc->initCheck() != NO_ERROR) {
         mPrimaryDispSync.setPeriod(16666667);
@@ -712,6 +837,12 @@ void SurfaceFlinger::setActiveConfigInternal(const sp<DisplayDevice>& hw, int mo
 
     hw->setActiveConfig(mode);
     getHwComposer().setActiveConfig(type, mode);
+
+    if (type == DisplayDevice::DISPLAY_PRIMARY) {
+        // Start the vsync model over from the new refresh period rather than
+        // waiting for the samples to show the old one is off
+        resyncToHardwareVsync(false);
+    }
 }
 
 status_t SurfaceFlinger::setActiveConfig(const sp<IBinder>& display, int mode) {
@@ -760,6 +891,17 @@ status_t SurfaceFlinger::getAnimationFrameStats(FrameStats* outStats) const {
     return NO_ERROR;
 }
 
+status_t SurfaceFlinger::getAnimationFrameStatsSummary(
+        FrameStatsSummary* outSummary) const {
+    FrameStats stats;
+    { // Autolock scope
+        Mutex::Autolock _l(mStateLock);
+        mAnimFrameTracker.getStats(&stats);
+    }
+    stats.summarize(outSummary);
+    return NO_ERROR;
+}
+
 // ----------------------------------------------------------------------------
 
 sp<IDisplayEventConnection> SurfaceFlinger::createDisplayEventConnection() {
@@ -842,7 +984,15 @@ void SurfaceFlinger::disableHardwareVsync(bool makeUnavailable) {
     Mutex::Autolock _l(mHWVsyncLock);
     if (mPrimaryHWVsyncEnabled) {
         //eventControl(HWC_DISPLAY_PRIMARY, SurfaceFlinger::EVENT_VSYNC, false);
-        mEventControlThread->setVsyncEnabled(false);
+        if (makeUnavailable) {
+            mEventControlThread->setVsyncEnabled(false);
+        } else {
+            // Vsync events that arrive while the disable is deferred are
+            // ignored by onVSyncReceived; they only save the HAL a
+            // round-trip if hardware vsync is wanted again soon.
+            mEventControlThread->disableVsyncDeferred(
+                    mPrimaryDispSync.isModelStable());
+        }
         mPrimaryDispSync.endResync();
         mPrimaryHWVsyncEnabled = false;
     }
@@ -861,6 +1011,14 @@ void SurfaceFlinger::onVSyncReceived(int type, nsecs_t timestamp) {
         }
     }
 
+    if (mEventThread != NULL) {
+        nsecs_t period = type == 0 ? mPrimaryDispSync.getPeriod() : 0;
+        if (period <= 0) {
+            period = getHwComposer().getRefreshPeriod(type);
+        }
+        mEventThread->publishVsync(type, timestamp, period);
+    }
+
     if (needsHwVsync) {
         enableHardwareVsync();
     } else {
@@ -904,13 +1062,21 @@ void SurfaceFlinger::onMessageReceived(int32_t what) {
             break;
         }
         case MessageQueue::INVALIDATE: {
+            // INVALIDATE is sent on the SurfaceFlinger vsync, so this is
+            // where the time the frame takes starts
+            const nsecs_t frameStartTime = systemTime();
+            mFrameTrace.beginFrame(frameStartTime);
             bool refreshNeeded = handleMessageTransaction();
+            if (refreshNeeded) {
+                mFrameTrace.addTransaction();
+            }
             refreshNeeded |= handleMessageInvalidate();
             refreshNeeded |= mRepaintEverything;
             if (refreshNeeded) {
                 // Signal a refresh if a transaction modified the window state,
                 // a new buffer was latched, or if HWC has requested a full
                 // repaint
+                mFrameStartTime = frameStartTime;
                 signalRefresh();
             }
             break;
@@ -938,12 +1104,102 @@ bool SurfaceFlinger::handleMessageInvalidate() {
 
 void SurfaceFlinger::handleMessageRefresh() {
     ATRACE_CALL();
+    const nsecs_t frameStartTime = mFrameStartTime;
+    mFrameStartTime = 0;
+    // the refresh this frame is composited for
+    const nsecs_t expectedPresentTime = mPrimaryDispSync.computeNextRefresh(0);
+    mFrameTrace.beginRefresh(systemTime());
+
     preComposition();
+    const bool visibilityChanged = mVisibleRegionsDirty;
     rebuildLayerStacks();
+    if (mLayerMemoryBudget.isEnabled()) {
+        updateLayerMemoryBudget(visibilityChanged);
+    }
+    if (mLayerMemoryBudget.getIdleTimeout() > 0 && !mIdleBufferCheckPending) {
+        discardIdleLayerBuffers();
+    }
+    if (isCompositionUnchanged()) {
+        // A refresh can be requested for changes that end up not being
+        // visible, e.g. a buffer latched by an occluded layer. Presenting
+        // the same frame again would only cost a prepare and a commit.
+        ATRACE_NAME("skipComposition");
+        mSkippedCompositions++;
+        mFrameTrace.endFrame(expectedPresentTime,
+                mPrimaryDispSync.getPeriod(), Fence::NO_FENCE, true);
+        return;
+    }
     setUpHWComposer();
     doDebugFlashRegions();
     doComposition();
-    postComposition();
+    if (mWorkloadHint.isEnabled()) {
+        mWorkloadHint.frameComposited();
+    }
+    if (mUseAdaptivePhaseOffset && frameStartTime != 0) {
+        updatePhaseOffset(systemTime() - frameStartTime);
+    }
+    postComposition(expectedPresentTime);
+
+    if (!mProgramCachePrimed) {
+        // generate the programs the first frame didn't need, now that it
+        // is out rather than while booting
+        mProgramCachePrimed = true;
+        mRenderEngine->primeCache();
+    }
+}
+
+void SurfaceFlinger::updatePhaseOffset(nsecs_t frameDuration) {
+    // The frame is done once HWComposer has it, so this lets SurfaceFlinger
+    // wake up, and latch buffers, as late as recent frames allow
+    nsecs_t offset;
+    if (mAdaptivePhaseOffset.addFrame(frameDuration,
+            mPrimaryDispSync.getPeriod(), &offset)) {
+        ATRACE_INT("SfPhaseOffset", static_cast<int32_t>(offset / 1000));
+        mSFEventThread->setPhaseOffset(offset);
+    }
+}
+
+void SurfaceFlinger::updateLayerMemoryBudget(bool visibilityChanged) {
+    // Layers that aren't drawn on any display that's on are the background
+    // ones; a layer that becomes visible is restored with the next frame
+    SortedVector<const Layer*> visibleLayers;
+    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+        const sp<DisplayDevice>& hw(mDisplays[dpy]);
+        if (!hw->isDisplayOn()) {
+            continue;
+        }
+        const Vector< sp<Layer> >& layers(hw->getVisibleLayersSortedByZ());
+        for (size_t i=0 ; i<layers.size() ; i++) {
+            visibleLayers.add(layers[i].get());
+        }
+    }
+    mLayerMemoryBudget.update(mDrawingState.layersSortedByZ, visibleLayers,
+            visibilityChanged, systemTime());
+}
+
+void SurfaceFlinger::discardIdleLayerBuffers() {
+    class MessageDiscardIdleBuffers : public MessageBase {
+        SurfaceFlinger* flinger;
+    public:
+        MessageDiscardIdleBuffers(SurfaceFlinger* flinger)
+            : flinger(flinger) {
+        }
+        virtual bool handler() {
+            flinger->mIdleBufferCheckPending = false;
+            flinger->discardIdleLayerBuffers();
+            return true;
+        }
+    };
+
+    // A static screen doesn't refresh at all, so the layers are checked
+    // again when the next one can be idle rather than with each frame
+    const nsecs_t now = systemTime();
+    const nsecs_t next = mLayerMemoryBudget.discardIdleBuffers(
+            mDrawingState.layersSortedByZ, now);
+    if (next != 0) {
+        mIdleBufferCheckPending = true;
+        postMessageAsync(new MessageDiscardIdleBuffers(this), next - now);
+    }
 }
 
 void SurfaceFlinger::doDebugFlashRegions()
@@ -1001,7 +1257,7 @@ void SurfaceFlinger::preComposition()
     }
 }
 
-void SurfaceFlinger::postComposition()
+void SurfaceFlinger::postComposition(nsecs_t expectedPresentTime)
 {
     const LayerVector& layers(mDrawingState.layersSortedByZ);
     const size_t count = layers.size();
@@ -1020,6 +1276,19 @@ void SurfaceFlinger::postComposition()
         }
     }
 
+    // Hardware vsync is mostly off, so keep what receivers extrapolate from
+    // in step with the model.
+    const nsecs_t vsyncPeriod = mPrimaryDispSync.getPeriod();
+    if (mEventThread != NULL && vsyncPeriod > 0) {
+        mEventThread->publishVsync(0,
+                mPrimaryDispSync.computeNextRefresh(0) - vsyncPeriod, vsyncPeriod);
+    }
+
+    mJankTracker.addPresent(expectedPresentTime, mPrimaryDispSync.getPeriod(),
+            presentFence, hwc.getRefreshTimestamp(HWC_DISPLAY_PRIMARY));
+    mFrameTrace.endFrame(expectedPresentTime, mPrimaryDispSync.getPeriod(),
+            presentFence, false);
+
     const sp<const DisplayDevice> hw(getDefaultDisplayDevice());
     if (kIgnorePresentFences) {
         if (hw->isDisplayOn()) {
@@ -1078,20 +1347,29 @@ void SurfaceFlinger::rebuildLayerStacks() {
             const Transform& tr(hw->getOriginalTransform());
             const Rect bounds(hw->getBounds());
             if (hw->isDisplayOn()) {
-                SurfaceFlinger::computeVisibleRegions(layers,
-                        hw->getLayerStack(), dirtyRegion, opaqueRegion);
-
-                const size_t count = layers.size();
-                for (size_t i=0 ; i<count ; i++) {
+                // A layer stack mirrored on several displays has to be fully
+                // computed for each of them to get each one's dirty region
+                bool incremental = mIncrementalVisibleRegions;
+                for (size_t other=0 ; other<mDisplays.size() && incremental ; other++) {
+                    if (other != dpy && mDisplays[other]->isDisplayOn() &&
+                            mDisplays[other]->getLayerStack() == hw->getLayerStack()) {
+                        incremental = false;
+                    }
+                }
+                computeVisibleRegions(layers,
+                        hw->getLayerStack(), dirtyRegion, opaqueRegion,
+                        incremental);
+
+                size_t begin, end;
+                layers.getLayerStackRange(hw->getLayerStack(), &begin, &end);
+                layersSortedByZ.setCapacity(end - begin);
+                for (size_t i=begin ; i<end ; i++) {
                     const sp<Layer>& layer(layers[i]);
-                    const Layer::State& s(layer->getDrawingState());
-                    if (s.layerStack == hw->getLayerStack()) {
-                        Region drawRegion(tr.transform(
-                                layer->visibleNonTransparentRegion));
-                        drawRegion.andSelf(bounds);
-                        if (!drawRegion.isEmpty()) {
-                            layersSortedByZ.add(layer);
-                        }
+                    Region drawRegion(tr.transform(
+                            layer->visibleNonTransparentRegion));
+                    drawRegion.andSelf(bounds);
+                    if (!drawRegion.isEmpty()) {
+                        layersSortedByZ.add(layer);
                     }
                 }
             }
@@ -1103,6 +1381,22 @@ void SurfaceFlinger::rebuildLayerStacks() {
     }
 }
 
+bool SurfaceFlinger::isCompositionUnchanged() const {
+    // mHwWorkListDirty is set by all transactions and by any change of the
+    // visible regions, so this only leaves frames where no display has
+    // anything to redraw.
+    if (!mSkipUnchangedComposition || mHwWorkListDirty ||
+            mRepaintEverything || mDebugRegion) {
+        return false;
+    }
+    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+        if (!mDisplays[dpy]->getDirtyRegion(false).isEmpty()) {
+            return false;
+        }
+    }
+    return true;
+}
+
 void SurfaceFlinger::setUpHWComposer() {
     for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
         bool dirty = !mDisplays[dpy]->getDirtyRegion(false).isEmpty();
@@ -1135,25 +1429,41 @@ void SurfaceFlinger::setUpHWComposer() {
 
     HWComposer& hwc(getHwComposer());
     if (hwc.initCheck() == NO_ERROR) {
+        bool geometryChanged = false;
         // build the h/w work list
         if (CC_UNLIKELY(mHwWorkListDirty)) {
             mHwWorkListDirty = false;
             for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
                 sp<const DisplayDevice> hw(mDisplays[dpy]);
+                hw->flatteningCache.invalidate();
                 const int32_t id = hw->getHwcDisplayId();
                 if (id >= 0) {
                     const Vector< sp<Layer> >& currentLayers(
                         hw->getVisibleLayersSortedByZ());
                     const size_t count = currentLayers.size();
                     if (hwc.createWorkList(id, count) == NO_ERROR) {
+                        bool sameLayers =
+                                hw->hwcWorkListLayers.size() == count;
+                        hw->hwcWorkListLayers.resize(count);
                         HWComposer::LayerListIterator cur = hwc.begin(id);
                         const HWComposer::LayerListIterator end = hwc.end(id);
                         for (size_t i=0 ; cur!=end && i<count ; ++i, ++cur) {
                             const sp<Layer>& layer(currentLayers[i]);
                             layer->setGeometry(hw, *cur);
-                            if (mDebugDisableHWC || mDebugRegion || mDaltonize || mHasColorMatrix) {
+                            if (mDebugDisableHWC || mDebugRegion || mHasColorTransform ||
+                                    layer->isPinnedToGles(id)) {
                                 cur->setSkip(true);
                             }
+                            const wp<Layer> weakLayer(layer);
+                            if (hw->hwcWorkListLayers[i] != weakLayer) {
+                                hw->hwcWorkListLayers.editItemAt(i) = weakLayer;
+                                sameLayers = false;
+                            }
+                        }
+                        // Most transactions don't change what the HWC is
+                        // given, so let it keep its decisions when they don't
+                        if (!sameLayers || !hwc.reuseGeometry(id)) {
+                            geometryChanged = true;
                         }
                     }
                 }
@@ -1208,6 +1518,42 @@ void SurfaceFlinger::setUpHWComposer() {
             sp<const DisplayDevice> hw(mDisplays[dpy]);
             hw->prepareFrame(hwc);
         }
+
+        // Layers the HWC keeps moving between overlays and GLES need their
+        // geometry set again when they get pinned to GLES, or unpinned
+        uint32_t numHwcLayers = 0;
+        uint32_t numGlesLayers = 0;
+        for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+            sp<const DisplayDevice> hw(mDisplays[dpy]);
+            const int32_t id = hw->getHwcDisplayId();
+            if (id >= 0) {
+                const Vector< sp<Layer> >& currentLayers(
+                    hw->getVisibleLayersSortedByZ());
+                const size_t count = currentLayers.size();
+                HWComposer::LayerListIterator cur = hwc.begin(id);
+                const HWComposer::LayerListIterator end = hwc.end(id);
+                for (size_t i=0 ; cur!=end && i<count ; ++i, ++cur) {
+                    const int32_t type = cur->getCompositionType();
+                    if (type == HWC_FRAMEBUFFER) {
+                        numGlesLayers++;
+                    } else {
+                        numHwcLayers++;
+                    }
+                    if (currentLayers[i]->updateCompositionHistory(id, type)) {
+                        mHwWorkListDirty = true;
+                    }
+                }
+            }
+        }
+        mFrameTrace.addPrepare(err, geometryChanged, numHwcLayers,
+                numGlesLayers);
+        if (mWorkloadHint.isEnabled()) {
+            mWorkloadHint.framePrepared(numHwcLayers, numGlesLayers,
+                    mPrimaryDispSync.getPeriod());
+        }
+
+        // The HWC may have picked up or dropped a cursor layer
+        updateCursorState(false);
     }
 }
 
@@ -1216,21 +1562,98 @@ void SurfaceFlinger::doComposition() {
     const bool repaintEverything = android_atomic_and(0, &mRepaintEverything);
     for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
         const sp<DisplayDevice>& hw(mDisplays[dpy]);
-        if (hw->isDisplayOn()) {
-            // transform the dirty region into this screen's coordinate space
-            const Region dirtyRegion(hw->getDirtyRegion(repaintEverything));
+        if (!isCompositionDeferred(hw)) {
+            composeDisplay(hw, repaintEverything);
+        }
+    }
+    postFramebuffer();
 
-            // repaint the framebuffer (if needed)
-            doDisplayComposition(hw, dirtyRegion);
+    // Displays HWComposer doesn't know about (virtual displays beyond what
+    // it supports) don't take part in the commit, so they are composed once
+    // the other displays have been posted. Their GLES composition then no
+    // longer delays the frame of the primary display.
+    bool composedDeferred = false;
+    for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+        const sp<DisplayDevice>& hw(mDisplays[dpy]);
+        if (isCompositionDeferred(hw)) {
+            ATRACE_NAME("deferredComposition");
+            composeDisplay(hw, repaintEverything);
+            onDisplayPosted(hw);
+            composedDeferred = true;
+        }
+    }
+    if (composedDeferred) {
+        // see postFramebuffer
+        getDefaultDisplayDevice()->makeCurrent(mEGLDisplay, mEGLContext);
+    }
+}
 
-            hw->dirtyRegion.clear();
-            hw->flip(hw->swapRegion);
-            hw->swapRegion.clear();
+void SurfaceFlinger::composeDisplay(const sp<const DisplayDevice>& hw,
+        bool repaintEverything) {
+    const nsecs_t startTime = systemTime();
+    const int32_t id = hw->getHwcDisplayId();
+    GpuTimer* gpuTimer = mGpuTiming ? mRenderEngine->getGpuTimer() : NULL;
+    if (hw->isDisplayOn()) {
+        // transform the dirty region into this screen's coordinate space
+        const Region dirtyRegion(hw->getDirtyRegion(repaintEverything));
+
+        // repaint the framebuffer (if needed), timing the GPU's part of it
+        const bool timeGpu = gpuTimer != NULL &&
+                (id < 0 || getHwComposer().hasGlesComposition(id));
+        if (timeGpu) {
+            gpuTimer->begin(id);
+        }
+        doDisplayComposition(hw, dirtyRegion);
+        if (timeGpu) {
+            gpuTimer->end();
+        }
+
+        hw->dirtyRegion.clear();
+        hw->flip(hw->swapRegion);
+        hw->swapRegion.clear();
+    }
+    // inform the h/w that we're done compositing
+    hw->compositionComplete();
+
+    if (hw->isDisplayOn()) {
+        const HWComposer& hwc(getHwComposer());
+        mJankTracker.addComposition(id, systemTime() - startTime,
+                hwc.hasGlesComposition(id), hwc.hasHwcComposition(id));
+    }
+
+    // collect the GPU times of earlier frames the GPU is done with
+    int32_t gpuId;
+    nsecs_t gpuDuration;
+    while (gpuTimer != NULL && gpuTimer->getResult(&gpuId, &gpuDuration)) {
+        mJankTracker.addGpuComposition(gpuId, gpuDuration);
+        mFrameTrace.addGpuComposition(gpuDuration);
+    }
+}
+
+bool SurfaceFlinger::isCompositionDeferred(
+        const sp<const DisplayDevice>& hw) const {
+    return mDeferNonHwcComposition && hw->getHwcDisplayId() < 0 &&
+            hw->getDisplayType() != DisplayDevice::DISPLAY_PRIMARY;
+}
+
+void SurfaceFlinger::onDisplayPosted(const sp<const DisplayDevice>& hw)
+{
+    HWComposer& hwc(getHwComposer());
+    const Vector< sp<Layer> >& currentLayers(hw->getVisibleLayersSortedByZ());
+    hw->onSwapBuffersCompleted(hwc);
+    const size_t count = currentLayers.size();
+    int32_t id = hw->getHwcDisplayId();
+    if (id >=0 && hwc.initCheck() == NO_ERROR) {
+        HWComposer::LayerListIterator cur = hwc.begin(id);
+        const HWComposer::LayerListIterator end = hwc.end(id);
+        for (size_t i = 0; cur != end && i < count; ++i, ++cur) {
+            currentLayers[i]->onLayerDisplayed(hw, &*cur);
+        }
+    } else {
+        for (size_t i = 0; i < count; i++) {
+            currentLayers[i]->onLayerDisplayed(hw, NULL);
         }
-        // inform the h/w that we're done compositing
-        hw->compositionComplete();
     }
-    postFramebuffer();
 }
 
 void SurfaceFlinger::postFramebuffer()
@@ -1249,6 +1672,7 @@ void SurfaceFlinger::postFramebuffer()
             getDefaultDisplayDevice()->makeCurrent(mEGLDisplay, mEGLContext);
         }
         hwc.commit();
+        mFrameTrace.addCommit(systemTime() - now);
     }
 
     // make the default display current because the VirtualDisplayDevice code cannot
@@ -1259,20 +1683,8 @@ void SurfaceFlinger::postFramebuffer()
 
     for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
         sp<const DisplayDevice> hw(mDisplays[dpy]);
-        const Vector< sp<Layer> >& currentLayers(hw->getVisibleLayersSortedByZ());
-        hw->onSwapBuffersCompleted(hwc);
-        const size_t count = currentLayers.size();
-        int32_t id = hw->getHwcDisplayId();
-        if (id >=0 && hwc.initCheck() == NO_ERROR) {
-            HWComposer::LayerListIterator cur = hwc.begin(id);
-            const HWComposer::LayerListIterator end = hwc.end(id);
-            for (size_t i = 0; cur != end && i < count; ++i, ++cur) {
-                currentLayers[i]->onLayerDisplayed(hw, &*cur);
-            }
-        } else {
-            for (size_t i = 0; i < count; i++) {
-                currentLayers[i]->onLayerDisplayed(hw, NULL);
-            }
+        if (!isCompositionDeferred(hw)) {
+            onDisplayPosted(hw);
         }
     }
 
@@ -1294,19 +1706,38 @@ void SurfaceFlinger::handleTransaction(uint32_t transactionFlags)
     // mStateLock so that the side-effects of the State assignment
     // don't happen with mStateLock held (which can cause deadlocks).
     State drawingState(mDrawingState);
+    TransactionSnapshot snapshot;
+    bool snapshotted = false;
 
-    Mutex::Autolock _l(mStateLock);
     const nsecs_t now = systemTime();
     mDebugInTransaction = now;
 
-    // Here we're guaranteed that some transaction flags are set
-    // so we can call handleTransactionLocked() unconditionally.
-    // We call getTransactionFlags(), which will also clear the flags,
-    // with mStateLock held to guarantee that mCurrentState won't change
-    // until the transaction is committed.
+    { // Autolock scope
+        Mutex::Autolock _l(mStateLock);
 
-    transactionFlags = getTransactionFlags(eTransactionMask);
-    handleTransactionLocked(transactionFlags);
+        // Here we're guaranteed that some transaction flags are set
+        // so we can call handleTransactionLocked() unconditionally.
+        // We call getTransactionFlags(), which will also clear the flags,
+        // with mStateLock held to guarantee that mCurrentState won't change
+        // until the transaction is committed.
+
+        transactionFlags = getTransactionFlags(eTransactionMask);
+
+        // Display changes create and destroy DisplayDevices, which binder
+        // threads look up with mStateLock held, so those transactions are
+        // still handled entirely under the lock.
+        if (mSnapshotTransactions &&
+                !(transactionFlags & eDisplayTransactionNeeded)) {
+            latchTransactionLocked(transactionFlags, snapshot);
+            snapshotted = true;
+        } else {
+            handleTransactionLocked(transactionFlags);
+        }
+    }
+
+    if (snapshotted) {
+        commitTransactionSnapshot(snapshot);
+    }
 
     mLastTransactionTime = systemTime() - now;
     mDebugInTransaction = 0;
@@ -1314,10 +1745,69 @@ void SurfaceFlinger::handleTransaction(uint32_t transactionFlags)
     // here the transaction has been committed
 }
 
+void SurfaceFlinger::latchTransactionLocked(uint32_t transactionFlags,
+        TransactionSnapshot& outSnapshot)
+{
+    // The layers' own states are latched here, with mStateLock held, since
+    // that's what protects them from setClientStateLocked(). Everything
+    // else is done by commitTransactionSnapshot() on the copy of
+    // mCurrentState taken below, which is cheap thanks to Vector's
+    // copy-on-write semantics.
+    outSnapshot.transactionFlags = transactionFlags;
+    outSnapshot.state = mCurrentState;
+    outSnapshot.serial = mTransactionSerial;
+    outSnapshot.animTransactionPending = mAnimTransactionPending;
+    outSnapshot.layersRemoved = mLayersRemoved;
+    outSnapshot.layersPendingRemoval = mLayersPendingRemoval;
+    mLayersRemoved = false;
+    mLayersPendingRemoval.clear();
+
+    if (transactionFlags & eTraversalNeeded) {
+        handleLayerTransactionsLocked(outSnapshot.state.layersSortedByZ);
+    }
+}
+
+void SurfaceFlinger::commitTransactionSnapshot(TransactionSnapshot& snapshot)
+{
+    ATRACE_CALL();
+
+    // Only the main thread modifies mDisplays and mDrawingState, so none
+    // of this needs mStateLock.
+    const LayerVector& currentLayers(snapshot.state.layersSortedByZ);
+    if (snapshot.transactionFlags & eTraversalNeeded) {
+        updateTransformHints(currentLayers);
+    }
+    handleLayerListChanges(currentLayers, snapshot.layersRemoved);
+
+    // Notify removed layers now that they can't be drawn from
+    for (size_t i = 0; i < snapshot.layersPendingRemoval.size(); i++) {
+        mReclaimThread->reclaimLayer(snapshot.layersPendingRemoval[i]);
+    }
+    snapshot.layersPendingRemoval.clear();
+
+    // If this transaction is part of a window animation then the next frame
+    // we composite should be considered an animation as well.
+    mAnimCompositionPending = snapshot.animTransactionPending;
+
+    mDrawingState = snapshot.state;
+
+    { // Autolock scope
+        Mutex::Autolock _l(mStateLock);
+        // If another transaction was applied after the snapshot was taken,
+        // its caller will be released by the commit that follows this one.
+        if (mTransactionSerial == snapshot.serial) {
+            mTransactionPending = false;
+            mAnimTransactionPending = false;
+            mTransactionCV.broadcast();
+        }
+    }
+
+    updateCursorAsync();
+}
+
 void SurfaceFlinger::handleTransactionLocked(uint32_t transactionFlags)
 {
     const LayerVector& currentLayers(mCurrentState.layersSortedByZ);
-    const size_t count = currentLayers.size();
 
     /*
      * Traversal of the children
@@ -1325,15 +1815,7 @@ void SurfaceFlinger::handleTransactionLocked(uint32_t transactionFlags)
      */
 
     if (transactionFlags & eTraversalNeeded) {
-        for (size_t i=0 ; i<count ; i++) {
-            const sp<Layer>& layer(currentLayers[i]);
-            uint32_t trFlags = layer->getTransactionFlags(eTransactionNeeded);
-            if (!trFlags) continue;
-
-            const uint32_t flags = layer->doTransaction(0);
-            if (flags & Layer::eVisibleRegion)
-                mVisibleRegionsDirty = true;
-        }
+        handleLayerTransactionsLocked(currentLayers);
     }
 
     /*
@@ -1501,66 +1983,96 @@ void SurfaceFlinger::handleTransactionLocked(uint32_t transactionFlags)
         // The transform hint might have changed for some layers
         // (either because a display has changed, or because a layer
         // as changed).
-        //
-        // Walk through all the layers in currentLayers,
-        // and update their transform hint.
-        //
-        // If a layer is visible only on a single display, then that
-        // display is used to calculate the hint, otherwise we use the
-        // default display.
-        //
-        // NOTE: we do this here, rather than in rebuildLayerStacks() so that
-        // the hint is set before we acquire a buffer from the surface texture.
-        //
-        // NOTE: layer transactions have taken place already, so we use their
-        // drawing state. However, SurfaceFlinger's own transaction has not
-        // happened yet, so we must use the current state layer list
-        // (soon to become the drawing state list).
-        //
-        sp<const DisplayDevice> disp;
-        uint32_t currentlayerStack = 0;
-        for (size_t i=0; i<count; i++) {
-            // NOTE: we rely on the fact that layers are sorted by
-            // layerStack first (so we don't have to traverse the list
-            // of displays for every layer).
-            const sp<Layer>& layer(currentLayers[i]);
-            uint32_t layerStack = layer->getDrawingState().layerStack;
-            if (i==0 || currentlayerStack != layerStack) {
-                currentlayerStack = layerStack;
-                // figure out if this layerstack is mirrored
-                // (more than one display) if so, pick the default display,
-                // if not, pick the only display it's on.
-                disp.clear();
-                for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
-                    sp<const DisplayDevice> hw(mDisplays[dpy]);
-                    if (hw->getLayerStack() == currentlayerStack) {
-                        if (disp == NULL) {
-                            disp = hw;
-                        } else {
-                            disp = NULL;
-                            break;
-                        }
-                    }
-                }
-            }
-            if (disp == NULL) {
-                // NOTE: TEMPORARY FIX ONLY. Real fix should cause layers to
-                // redraw after transform hint changes. See bug 8508397.
-
-                // could be null when this layer is using a layerStack
-                // that is not visible on any display. Also can occur at
-                // screen off/on times.
-                disp = getDefaultDisplayDevice();
-            }
-            layer->updateTransformHint(disp);
-        }
+        updateTransformHints(currentLayers);
     }
 
-
     /*
      * Perform our own transaction if needed
      */
 
+    handleLayerListChanges(currentLayers, mLayersRemoved);
+    mLayersRemoved = false;
+
+    commitTransaction();
+
+    updateCursorAsync();
+}
+
+void SurfaceFlinger::handleLayerTransactionsLocked(
+        const LayerVector& currentLayers)
+{
+    const size_t count = currentLayers.size();
+    for (size_t i=0 ; i<count ; i++) {
+        const sp<Layer>& layer(currentLayers[i]);
+        uint32_t trFlags = layer->getTransactionFlags(eTransactionNeeded);
+        if (!trFlags) continue;
+
+        const uint32_t flags = layer->doTransaction(0);
+        if (flags & Layer::eVisibleRegion)
+            mVisibleRegionsDirty = true;
+    }
+}
+
+void SurfaceFlinger::updateTransformHints(const LayerVector& currentLayers)
+{
+    // Walk through all the layers in currentLayers,
+    // and update their transform hint.
+    //
+    // If a layer is visible only on a single display, then that
+    // display is used to calculate the hint, otherwise we use the
+    // default display.
+    //
+    // NOTE: we do this here, rather than in rebuildLayerStacks() so that
+    // the hint is set before we acquire a buffer from the surface texture.
+    //
+    // NOTE: layer transactions have taken place already, so we use their
+    // drawing state. However, SurfaceFlinger's own transaction has not
+    // happened yet, so we must use the current state layer list
+    // (soon to become the drawing state list).
+    //
+    const size_t count = currentLayers.size();
+    sp<const DisplayDevice> disp;
+    uint32_t currentlayerStack = 0;
+    for (size_t i=0; i<count; i++) {
+        // NOTE: we rely on the fact that layers are sorted by
+        // layerStack first (so we don't have to traverse the list
+        // of displays for every layer).
+        const sp<Layer>& layer(currentLayers[i]);
+        uint32_t layerStack = layer->getDrawingState().layerStack;
+        if (i==0 || currentlayerStack != layerStack) {
+            currentlayerStack = layerStack;
+            // figure out if this layerstack is mirrored
+            // (more than one display) if so, pick the default display,
+            // if not, pick the only display it's on.
+            disp.clear();
+            for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
+                sp<const DisplayDevice> hw(mDisplays[dpy]);
+                if (hw->getLayerStack() == currentlayerStack) {
+                    if (disp == NULL) {
+                        disp = hw;
+                    } else {
+                        disp = NULL;
+                        break;
+                    }
+                }
+            }
+        }
+        if (disp == NULL) {
+            // NOTE: TEMPORARY FIX ONLY. Real fix should cause layers to
+            // redraw after transform hint changes. See bug 8508397.
+
+            // could be null when this layer is using a layerStack
+            // that is not visible on any display. Also can occur at
+            // screen off/on times.
+            disp = getDefaultDisplayDevice();
+        }
+        layer->updateTransformHint(disp);
+    }
+}
+
+void SurfaceFlinger::handleLayerListChanges(const LayerVector& currentLayers,
+        bool layersRemoved)
+{
     const LayerVector& layers(mDrawingState.layersSortedByZ);
     if (currentLayers.size() > layers.size()) {
         // layers have been added
@@ -1569,8 +2081,7 @@ void SurfaceFlinger::handleTransactionLocked(uint32_t transactionFlags)
 
     // some layers might have been removed, so
     // we need to update the regions they're exposing.
-    if (mLayersRemoved) {
-        mLayersRemoved = false;
+    if (layersRemoved) {
         mVisibleRegionsDirty = true;
         const size_t count = layers.size();
         for (size_t i=0 ; i<count ; i++) {
@@ -1587,15 +2098,18 @@ void SurfaceFlinger::handleTransactionLocked(uint32_t transactionFlags)
             }
         }
     }
-
-    commitTransaction();
-
-    updateCursorAsync();
 }
 
 void SurfaceFlinger::updateCursorAsync()
+{
+    updateCursorState(true);
+}
+
+void SurfaceFlinger::updateCursorState(bool reposition)
 {
     HWComposer& hwc(getHwComposer());
+    Mutex::Autolock _l(mCursorLock);
+    mCursorState.layer.clear();
     for (size_t dpy=0 ; dpy<mDisplays.size() ; dpy++) {
         sp<const DisplayDevice> hw(mDisplays[dpy]);
         const int32_t id = hw->getHwcDisplayId();
@@ -1612,19 +2126,65 @@ void SurfaceFlinger::updateCursorAsync()
                 continue;
             }
             const sp<Layer>& layer(currentLayers[i]);
-            Rect cursorPos = layer->getPosition(hw);
-            hwc.setCursorPositionAsync(id, cursorPos);
-            break;
+            const Layer::State& s(layer->getCurrentState());
+            mCursorState.layer = layer;
+            mCursorState.hwcId = id;
+            mCursorState.x = s.transform.tx();
+            mCursorState.y = s.transform.ty();
+            mCursorState.frame = layer->getFrame();
+            mCursorState.viewport = hw->getViewport();
+            mCursorState.transform = hw->getTransform();
+            if (reposition) {
+                Rect cursorPos = layer->getPosition(hw);
+                hwc.setCursorPositionAsync(id, cursorPos);
+            }
+            return;
         }
     }
 }
 
+void SurfaceFlinger::moveCursorAsync(const Vector<ComposerState>& state)
+{
+    Mutex::Autolock _l(mCursorLock);
+    sp<Layer> cursor(mCursorState.layer.promote());
+    if (cursor == NULL) {
+        return;
+    }
+    for (size_t i=0 ; i<state.size() ; i++) {
+        const ComposerState& s(state[i]);
+        // Only pure moves can skip the transaction, anything else about the
+        // layer could change how (or whether) the HWC composes it
+        if (s.state.what != layer_state_t::ePositionChanged ||
+                s.client == NULL) {
+            continue;
+        }
+        // See setTransactionState for why the client needs checking
+        sp<IBinder> binder = IInterface::asBinder(s.client);
+        if (binder == NULL ||
+                binder->getInterfaceDescriptor() !=
+                        ISurfaceComposerClient::descriptor) {
+            continue;
+        }
+        sp<Client> client( static_cast<Client *>(s.client.get()) );
+        if (client->getLayerUser(s.state.surface) != cursor) {
+            continue;
+        }
+        ATRACE_CALL();
+        Rect frame(mCursorState.frame);
+        frame.offsetBy(static_cast<int32_t>(s.state.x - mCursorState.x),
+                static_cast<int32_t>(s.state.y - mCursorState.y));
+        frame.intersect(mCursorState.viewport, &frame);
+        const Rect cursorPos(mCursorState.transform.transform(frame));
+        getHwComposer().setCursorPositionAsync(mCursorState.hwcId, cursorPos);
+    }
+}
+
 void SurfaceFlinger::commitTransaction()
 {
     if (!mLayersPendingRemoval.isEmpty()) {
         // Notify removed layers now that they can't be drawn from
         for (size_t i = 0; i < mLayersPendingRemoval.size(); i++) {
-            mLayersPendingRemoval[i]->onRemoved();
+            mReclaimThread->reclaimLayer(mLayersPendingRemoval[i]);
         }
         mLayersPendingRemoval.clear();
     }
@@ -1641,7 +2201,7 @@ void SurfaceFlinger::commitTransaction()
 
 void SurfaceFlinger::computeVisibleRegions(
         const LayerVector& currentLayers, uint32_t layerStack,
-        Region& outDirtyRegion, Region& outOpaqueRegion)
+        Region& outDirtyRegion, Region& outOpaqueRegion, bool incremental)
 {
     ATRACE_CALL();
 
@@ -1651,16 +2211,35 @@ void SurfaceFlinger::computeVisibleRegions(
 
     outDirtyRegion.clear();
 
-    size_t i = currentLayers.size();
-    while (i--) {
+    // The layer last seen on this layer stack, and whether it or any layer
+    // above it changed
+    const Layer* above = NULL;
+    bool aboveChanged = !incremental;
+
+    // only consider the layers on the given layer stack
+    size_t begin, end;
+    currentLayers.getLayerStackRange(layerStack, &begin, &end);
+    const bool recording = mRegionRecorder.beginCall(layerStack);
+    size_t i = end;
+    while (i-- > begin) {
         const sp<Layer>& layer = currentLayers[i];
 
         // start with the whole surface at its current location
         const Layer::State& s(layer->getDrawingState());
 
-        // only consider the layers on the given layer stack
-        if (s.layerStack != layerStack)
+        if (!aboveChanged && layer->isVisibilityCacheValid(above, layerStack)) {
+            // Nothing changed above this layer or about it, so its regions
+            // are still current and nothing of it got exposed
+            aboveOpaqueLayers = layer->visibilityCache.aboveOpaqueLayers;
+            aboveCoveredLayers = layer->visibilityCache.aboveCoveredLayers;
+            if (recording) {
+                mRegionRecorder.addCachedLayer(aboveOpaqueLayers,
+                        aboveCoveredLayers);
+            }
+            above = layer.get();
             continue;
+        }
+        aboveChanged = true;
 
         /*
          * opaqueRegion: area of a surface that is fully opaque.
@@ -1725,6 +2304,13 @@ void SurfaceFlinger::computeVisibleRegions(
             }
         }
 
+        if (recording) {
+            mRegionRecorder.addLayer(visibleRegion.getBounds(),
+                    !opaqueRegion.isEmpty(), layer->contentDirty,
+                    transparentRegion, layer->visibleRegion,
+                    layer->coveredRegion);
+        }
+
         // Clip the covered region to the visible region
         coveredRegion = aboveCoveredLayers.intersect(visibleRegion);
 
@@ -1773,9 +2359,16 @@ void SurfaceFlinger::computeVisibleRegions(
         layer->setCoveredRegion(coveredRegion);
         layer->setVisibleNonTransparentRegion(
                 visibleRegion.subtract(transparentRegion));
+
+        layer->updateVisibilityCache(above, aboveOpaqueLayers,
+                aboveCoveredLayers);
+        above = layer.get();
     }
 
     outOpaqueRegion = aboveOpaqueLayers;
+    if (recording) {
+        mRegionRecorder.endCall();
+    }
 }
 
 void SurfaceFlinger::invalidateLayerStack(uint32_t layerStack,
@@ -1814,6 +2407,8 @@ bool SurfaceFlinger::handlePageFlip()
                 layersWithQueuedFrames.push_back(layer.get());
             } else {
                 layer->useEmptyDamage();
+                mFrameTrace.addLatch(layer->getName(),
+                        FrameTrace::LATCH_NOT_DUE, 0, 0);
             }
         } else {
             layer->useEmptyDamage();
@@ -1821,7 +2416,10 @@ bool SurfaceFlinger::handlePageFlip()
     }
     for (size_t i = 0, count = layersWithQueuedFrames.size() ; i<count ; i++) {
         Layer* layer = layersWithQueuedFrames[i];
+        const nsecs_t latchStart = systemTime();
         const Region dirty(layer->latchBuffer(visibleRegions));
+        mFrameTrace.addLatch(layer->getName(), FrameTrace::LATCH_LATCHED,
+                layer->getCurrentFrameNumber(), systemTime() - latchStart);
         layer->useSurfaceDamage();
         const Layer::State& s(layer->getDrawingState());
         invalidateLayerStack(s.layerStack, dirty);
@@ -1840,6 +2438,18 @@ bool SurfaceFlinger::handlePageFlip()
     return !layersWithQueuedFrames.empty();
 }
 
+void SurfaceFlinger::updateColorTransform()
+{
+    // Both are applied by the same shader matrix, the Daltonizer's first
+    mColorTransform = mHasColorMatrix ? mColorMatrix : mat4();
+    if (mDaltonize) {
+        mColorTransform = mColorTransform * mDaltonizer();
+    }
+    // Clients commonly "reset" the color matrix by sending the identity,
+    // which shouldn't cost the HWC
+    mHasColorTransform = mColorTransform != mat4();
+}
+
 void SurfaceFlinger::invalidateHwcGeometry()
 {
     mHwWorkListDirty = true;
@@ -1883,15 +2493,11 @@ void SurfaceFlinger::doDisplayComposition(const sp<const DisplayDevice>& hw,
         }
     }
 
-    if (CC_LIKELY(!mDaltonize && !mHasColorMatrix)) {
+    if (CC_LIKELY(!mHasColorTransform)) {
         if (!doComposeSurfaces(hw, dirtyRegion)) return;
     } else {
         RenderEngine& engine(getRenderEngine());
-        mat4 colorMatrix = mColorMatrix;
-        if (mDaltonize) {
-            colorMatrix = colorMatrix * mDaltonizer();
-        }
-        mat4 oldMatrix = engine.setupColorTransform(colorMatrix);
+        mat4 oldMatrix = engine.setupColorTransform(mColorTransform);
         doComposeSurfaces(hw, dirtyRegion);
         engine.setupColorTransform(oldMatrix);
     }
@@ -1900,7 +2506,69 @@ void SurfaceFlinger::doDisplayComposition(const sp<const DisplayDevice>& hw,
     hw->swapRegion.orSelf(dirtyRegion);
 
     // swap buffers (presentation)
+    const nsecs_t swapStart = systemTime();
     hw->swapBuffers(getHwComposer());
+    mFrameTrace.addSwap(systemTime() - swapStart);
+}
+
+// Returns the smallest rectangle containing both a and b
+static Rect unionOf(const Rect& a, const Rect& b) {
+    return Rect(std::min(a.left, b.left), std::min(a.top, b.top),
+            std::max(a.right, b.right), std::max(a.bottom, b.bottom));
+}
+
+static int64_t areaOf(const Rect& r) {
+    return r.isEmpty() ? 0 : int64_t(r.getWidth()) * r.getHeight();
+}
+
+// Splits the area to compose into the rectangles GLES composition is
+// scissored to, one pass each. Rectangles that don't leave much empty space
+// between them are merged, since each pass draws every layer again, and when
+// that still leaves too many passes, or the passes cover most of the screen
+// anyway, a single pass over the whole of it is used.
+static void computeCompositionPasses(const Region& dirty, const Rect& bounds,
+        Vector<Rect>* outPasses) {
+    // Maximum number of passes per frame
+    static const size_t MAX_PASSES = 4;
+
+    outPasses->clear();
+    for (Region::const_iterator r = dirty.begin(); r != dirty.end(); ++r) {
+        Rect rect(*r);
+        // merge it with any pass it's close to, until there are none
+        for (size_t i = 0; i < outPasses->size(); ) {
+            const Rect& pass(outPasses->itemAt(i));
+            const Rect merged(unionOf(rect, pass));
+            if (areaOf(merged) * 4 <= (areaOf(rect) + areaOf(pass)) * 5) {
+                rect = merged;
+                outPasses->removeAt(i);
+                i = 0;
+            } else {
+                i++;
+            }
+        }
+        outPasses->add(rect);
+    }
+
+    int64_t area = 0;
+    for (size_t i = 0; i < outPasses->size(); i++) {
+        area += areaOf(outPasses->itemAt(i));
+    }
+    if (outPasses->size() > MAX_PASSES || area * 4 >= areaOf(bounds) * 3) {
+        outPasses->clear();
+        outPasses->add(bounds);
+    }
+}
+
+// Restricts GLES drawing to rect, in display space
+static void scissorTo(RenderEngine& engine,
+        const sp<const DisplayDevice>& hw, const Rect& rect) {
+    if (rect == hw->getBounds()) {
+        engine.disableScissor();
+    } else {
+        const uint32_t height = hw->getHeight();
+        engine.setScissor(rect.left, height - rect.bottom,
+                rect.getWidth(), rect.getHeight());
+    }
 }
 
 bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const Region& dirty)
@@ -1908,10 +2576,11 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
     RenderEngine& engine(getRenderEngine());
     const int32_t id = hw->getHwcDisplayId();
     HWComposer& hwc(getHwComposer());
-    HWComposer::LayerListIterator cur = hwc.begin(id);
+    const HWComposer::LayerListIterator begin = hwc.begin(id);
     const HWComposer::LayerListIterator end = hwc.end(id);
 
     bool hasGlesComposition = hwc.hasGlesComposition(id);
+    bool flattened = false;
     if (hasGlesComposition) {
         if (!hw->makeCurrent(mEGLDisplay, mEGLContext)) {
             ALOGW("DisplayDevice::makeCurrent failed. Aborting surface composition for display %s",
@@ -1923,58 +2592,118 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
             return false;
         }
 
-        // Never touch the framebuffer if we don't have any framebuffer layers
-        const bool hasHwcComposition = hwc.hasHwcComposition(id);
-        if (hasHwcComposition) {
-            // when using overlays, we assume a fully transparent framebuffer
-            // NOTE: we could reduce how much we need to clear, for instance
-            // remove where there are opaque FB layers. however, on some
-            // GPUs doing a "clean slate" clear might be more efficient.
-            // We'll revisit later if needed.
-            engine.clearWithColor(0, 0, 0, 0);
-        } else {
-            // we start with the whole screen area
-            const Region bounds(hw->getBounds());
+        // This renders into an offscreen buffer, so it must happen before
+        // anything is drawn into the framebuffer
+        if (begin != end && mFlattenStaticLayers && !mHasColorTransform) {
+            flattened = hw->flatteningCache.update(engine, mEGLDisplay, hw,
+                    hwc, hw->getOriginalTransform());
+        }
+    }
 
-            // we remove the scissor part
-            // we're left with the letterbox region
-            // (common case is that letterbox ends-up being empty)
-            const Region letterbox(bounds.subtract(hw->getScissor()));
+    // GLES composition only touches the dirty area: when that's a small part
+    // of the screen, the GL scissor keeps the GPU from filling the rest of
+    // each layer, so that composition costs scale with the damage
+    const Rect& bounds(hw->getBounds());
+    Rect scissor(bounds);
+    if (hw->getDisplayType() != DisplayDevice::DISPLAY_PRIMARY) {
+        // just to be on the safe side, we don't set the
+        // scissor on the main display. It should never be needed
+        // anyways (though in theory it could since the API allows it).
+        scissor = hw->getScissor();
+    }
+    Vector<Rect> passes;
+    if (hasGlesComposition) {
+        computeCompositionPasses(dirty, bounds, &passes);
+    } else {
+        passes.add(bounds);
+    }
 
-            // compute the area to clear
-            Region region(hw->undefinedRegion.merge(letterbox));
+    for (size_t p = 0; p < passes.size(); p++) {
+        const Rect& pass(passes[p]);
+        if (hasGlesComposition) {
+            scissorTo(engine, hw, pass);
+            composeBackground(hw, dirty.intersect(pass));
+        }
 
-            // but limit it to the dirty region
-            region.andSelf(dirty);
+        // if the display's scissor doesn't match the screen's dimensions,
+        // everything outside of it was cleared above, and the GL scissor
+        // makes sure we don't draw any layer there
+        Rect passBounds;
+        if (!pass.intersect(scissor, &passBounds)) {
+            continue;
+        }
+        if (hasGlesComposition && passBounds != pass) {
+            scissorTo(engine, hw, passBounds);
+        }
+        composeLayers(hw, dirty.intersect(passBounds), hasGlesComposition,
+                flattened);
+    }
 
-            // screen is already cleared here
-            if (!region.isEmpty()) {
-                // can happen with SurfaceView
-                drawWormhole(hw, region);
-            }
+    // The layers' acquire fences are handed to the HWC once per frame, for
+    // however many passes they were drawn in
+    const Vector< sp<Layer> >& layers(hw->getVisibleLayersSortedByZ());
+    const size_t count = layers.size();
+    HWComposer::LayerListIterator cur = begin;
+    for (size_t i=0 ; i<count && cur!=end ; ++i, ++cur) {
+        layers[i]->setAcquireFence(hw, *cur);
+    }
+
+    // disable scissor at the end of the frame
+    engine.disableScissor();
+    return true;
+}
+
+void SurfaceFlinger::composeBackground(const sp<const DisplayDevice>& hw,
+        const Region& dirty) const
+{
+    // Never touch the framebuffer if we don't have any framebuffer layers
+    const bool hasHwcComposition =
+            getHwComposer().hasHwcComposition(hw->getHwcDisplayId());
+    if (hasHwcComposition) {
+        // when using overlays, we assume a fully transparent framebuffer
+        // NOTE: we could reduce how much we need to clear, for instance
+        // remove where there are opaque FB layers. however, on some
+        // GPUs doing a "clean slate" clear might be more efficient.
+        // We'll revisit later if needed.
+        const Rect bounds(dirty.bounds());
+        if (bounds == hw->getBounds()) {
+            getRenderEngine().clearWithColor(0, 0, 0, 0);
+        } else {
+            drawWormhole(hw, dirty);
         }
+    } else {
+        // we start with the whole screen area
+        const Region bounds(hw->getBounds());
 
-        if (hw->getDisplayType() != DisplayDevice::DISPLAY_PRIMARY) {
-            // just to be on the safe side, we don't set the
-            // scissor on the main display. It should never be needed
-            // anyways (though in theory it could since the API allows it).
-            const Rect& bounds(hw->getBounds());
-            const Rect& scissor(hw->getScissor());
-            if (scissor != bounds) {
-                // scissor doesn't match the screen's dimensions, so we
-                // need to clear everything outside of it and enable
-                // the GL scissor so we don't draw anything where we shouldn't
+        // we remove the scissor part
+        // we're left with the letterbox region
+        // (common case is that letterbox ends-up being empty)
+        const Region letterbox(bounds.subtract(hw->getScissor()));
 
-                // enable scissor for this frame
-                const uint32_t height = hw->getHeight();
-                engine.setScissor(scissor.left, height - scissor.bottom,
-                        scissor.getWidth(), scissor.getHeight());
-            }
+        // compute the area to clear
+        Region region(hw->undefinedRegion.merge(letterbox));
+
+        // but limit it to the dirty region
+        region.andSelf(dirty);
+
+        // screen is already cleared here
+        if (!region.isEmpty()) {
+            // can happen with SurfaceView
+            drawWormhole(hw, region);
         }
     }
+}
+
+void SurfaceFlinger::composeLayers(const sp<const DisplayDevice>& hw,
+        const Region& dirty, bool hasGlesComposition, bool flattened) const
+{
+    const int32_t id = hw->getHwcDisplayId();
+    HWComposer& hwc(getHwComposer());
+    HWComposer::LayerListIterator cur = hwc.begin(id);
+    const HWComposer::LayerListIterator end = hwc.end(id);
 
     /*
-     * and then, render the layers targeted at the framebuffer
+     * render the layers targeted at the framebuffer
      */
 
     const Vector< sp<Layer> >& layers(hw->getVisibleLayersSortedByZ());
@@ -1987,6 +2716,14 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
         // we're using h/w composer
         for (size_t i=0 ; i<count && cur!=end ; ++i, ++cur) {
             const sp<Layer>& layer(layers[i]);
+            if (flattened && hw->flatteningCache.isFlattened(i)) {
+                // the whole run is drawn from the cache, in place of its
+                // first layer
+                if (hw->flatteningCache.isFirstFlattened(i)) {
+                    hw->flatteningCache.draw(getRenderEngine(), dirty);
+                }
+                continue;
+            }
             const Region clip(dirty.intersect(tr.transform(layer->visibleRegion)));
             if (!clip.isEmpty()) {
                 switch (cur->getCompositionType()) {
@@ -2018,7 +2755,6 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
                     }
                 }
             }
-            layer->setAcquireFence(hw, *cur);
         }
     } else {
         // we're not using h/w composer
@@ -2031,10 +2767,6 @@ bool SurfaceFlinger::doComposeSurfaces(const sp<const DisplayDevice>& hw, const
             }
         }
     }
-
-    // disable scissor at the end of the frame
-    engine.disableScissor();
-    return true;
 }
 
 void SurfaceFlinger::drawWormhole(const sp<const DisplayDevice>& hw, const Region& region) const {
@@ -2098,6 +2830,10 @@ void SurfaceFlinger::setTransactionState(
         uint32_t flags)
 {
     ATRACE_CALL();
+    // Move the cursor right away, the transaction below still applies the
+    // same position so that the layer's state catches up with the HWC
+    moveCursorAsync(state);
+
     Mutex::Autolock _l(mStateLock);
     uint32_t transactionFlags = 0;
 
@@ -2146,6 +2882,8 @@ void SurfaceFlinger::setTransactionState(
     }
 
     if (transactionFlags) {
+        mTransactionSerial++;
+
         // this triggers the transaction
         setTransactionFlags(transactionFlags);
 
@@ -2558,6 +3296,7 @@ status_t SurfaceFlinger::dump(int fd, const Vector<String16>& args)
                     (args[index] == String16("--dispsync"))) {
                 index++;
                 mPrimaryDispSync.dump(result);
+                mEventControlThread->dump(result);
                 dumpAll = false;
             }
 
@@ -2567,6 +3306,56 @@ status_t SurfaceFlinger::dump(int fd, const Vector<String16>& args)
                 dumpStaticScreenStats(result);
                 dumpAll = false;
             }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--timestats"))) {
+                index++;
+                dumpTimeStats(args, index, result);
+                dumpAll = false;
+            }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--layer-memory"))) {
+                index++;
+                dumpLayerMemory(result);
+                dumpAll = false;
+            }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--sched"))) {
+                index++;
+                mSchedulingPolicy.dump(result);
+                dumpAll = false;
+            }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--frametrace"))) {
+                index++;
+                if (index < numArgs && args[index] == String16("-binary")) {
+                    index++;
+                    mFrameTrace.dumpBinary(result);
+                } else {
+                    mFrameTrace.dump(result);
+                }
+                dumpAll = false;
+            }
+
+            if ((index < numArgs) &&
+                    (args[index] == String16("--regions"))) {
+                index++;
+                if (index < numArgs && args[index] == String16("-start")) {
+                    index++;
+                    mRegionRecorder.start();
+                    mRegionRecorder.dump(result);
+                } else if (index < numArgs &&
+                        args[index] == String16("-binary")) {
+                    index++;
+                    mRegionRecorder.dumpBinary(result);
+                } else {
+                    mRegionRecorder.dump(result);
+                }
+                dumpAll = false;
+            }
         }
 
         if (dumpAll) {
@@ -2670,6 +3459,14 @@ void SurfaceFlinger::logFrameStats() {
     result.append(config);
 }
 
+void SurfaceFlinger::dumpLayerMemory(String8& result) const
+{
+    // Called from a binder thread with mStateLock held, which guards
+    // mCurrentState; mDrawingState can be replaced by the main thread.
+    result.append("Layer buffer memory:\n");
+    mLayerMemoryBudget.dump(result, mCurrentState.layersSortedByZ);
+}
+
 void SurfaceFlinger::dumpStaticScreenStats(String8& result) const
 {
     result.appendFormat("Static screen stats:\n");
@@ -2685,6 +3482,24 @@ void SurfaceFlinger::dumpStaticScreenStats(String8& result) const
             static_cast<float>(mFrameBuckets[NUM_BUCKETS - 1]) / mTotalTime;
     result.appendFormat("  %zd+ frames: %.3f s (%.1f%%)\n",
             NUM_BUCKETS - 1, bucketTimeSec, percent);
+    result.appendFormat("  Unchanged frames skipped: %" PRIu64 "\n",
+            mSkippedCompositions);
+}
+
+void SurfaceFlinger::dumpTimeStats(const Vector<String16>& args,
+        size_t& index, String8& result)
+{
+    if (index < args.size() && args[index] == String16("-binary")) {
+        // for periodic collection: each dump covers the time since the
+        // previous one
+        index++;
+        mJankTracker.dumpBinary(result);
+    } else if (index < args.size() && args[index] == String16("-clear")) {
+        index++;
+        mJankTracker.clear();
+    } else {
+        mJankTracker.dump(result);
+    }
 }
 
 void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
@@ -2732,11 +3547,22 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
         vsyncPhaseOffsetNs, sfVsyncPhaseOffsetNs, PRESENT_TIME_OFFSET_FROM_VSYNC_NS,
         mHwc->getRefreshPeriod(HWC_DISPLAY_PRIMARY));
     result.append("\n");
+    if (mUseAdaptivePhaseOffset) {
+        mAdaptivePhaseOffset.dump(result);
+    }
+    if (mWorkloadHint.isEnabled()) {
+        mWorkloadHint.dump(result);
+    }
+    mSchedulingPolicy.dump(result);
 
     // Dump static screen stats
     result.append("\n");
     dumpStaticScreenStats(result);
     result.append("\n");
+    dumpLayerMemory(result);
+    result.append("\n");
+    PermissionCache::dump(result);
+    result.append("\n");
 
     /*
      * Dump the visible layer list
@@ -2822,8 +3648,8 @@ void SurfaceFlinger::dumpAllLocked(const Vector<String16>& args, size_t& index,
     colorizer.reset(result);
     result.appendFormat("  h/w composer %s and %s\n",
             hwc.initCheck()==NO_ERROR ? "present" : "not present",
-                    (mDebugDisableHWC || mDebugRegion || mDaltonize
-                            || mHasColorMatrix) ? "disabled" : "enabled");
+                    (mDebugDisableHWC || mDebugRegion || mHasColorTransform) ?
+                            "disabled" : "enabled");
     hwc.dump(result);
 
     /*
@@ -2879,6 +3705,7 @@ status_t SurfaceFlinger::onTransact(
         case BOOT_FINISHED:
         case CLEAR_ANIMATION_FRAME_STATS:
         case GET_ANIMATION_FRAME_STATS:
+        case GET_ANIMATION_FRAME_STATS_SUMMARY:
         case SET_POWER_MODE:
         {
             // codes that require permission check
@@ -2985,6 +3812,7 @@ status_t SurfaceFlinger::onTransact(
                     mDaltonizer.setMode(Daltonizer::simulation);
                 }
                 mDaltonize = n > 0;
+                updateColorTransform();
                 invalidateHwcGeometry();
                 repaintEverything();
                 return NO_ERROR;
@@ -3005,6 +3833,7 @@ status_t SurfaceFlinger::onTransact(
                 } else {
                     mColorMatrix = mat4();
                 }
+                updateColorTransform();
                 invalidateHwcGeometry();
                 repaintEverything();
                 return NO_ERROR;
@@ -3027,8 +3856,23 @@ status_t SurfaceFlinger::onTransact(
                 return NO_ERROR;
             }
             case 1019: { // Modify SurfaceFlinger's phase offset
+                // mAdaptivePhaseOffset belongs to the main thread, which
+                // also moves the offset as frames complete
+                class MessageSetPhaseOffset : public MessageBase {
+                    SurfaceFlinger& mFlinger;
+                    nsecs_t mOffset;
+                public:
+                    MessageSetPhaseOffset(SurfaceFlinger& flinger, nsecs_t offset)
+                        : mFlinger(flinger), mOffset(offset) { }
+                    virtual bool handler() {
+                        mFlinger.mSFEventThread->setPhaseOffset(mOffset);
+                        mFlinger.mAdaptivePhaseOffset.setDefaultOffset(mOffset);
+                        return true;
+                    }
+                };
                 n = data.readInt32();
-                mSFEventThread->setPhaseOffset(static_cast<nsecs_t>(n));
+                postMessageSync(new MessageSetPhaseOffset(*this,
+                        static_cast<nsecs_t>(n)));
                 return NO_ERROR;
             }
         }
@@ -3313,19 +4157,18 @@ void SurfaceFlinger::renderScreenImplLocked(
     engine.clearWithColor(0, 0, 0, 1);
 
     const LayerVector& layers( mDrawingState.layersSortedByZ );
-    const size_t count = layers.size();
-    for (size_t i=0 ; i<count ; ++i) {
+    size_t begin, end;
+    layers.getLayerStackRange(hw->getLayerStack(), &begin, &end);
+    for (size_t i=begin ; i<end ; ++i) {
         const sp<Layer>& layer(layers[i]);
         const Layer::State& state(layer->getDrawingState());
-        if (state.layerStack == hw->getLayerStack()) {
-            if (state.z >= minLayerZ && state.z <= maxLayerZ) {
-                if (layer->isVisible()) {
-                    if (filtering) layer->setFiltering(true);
-                    layer->setCaptureScreen(true);
-                    layer->draw(hw, useIdentityTransform);
-                    layer->setCaptureScreen(false);
-                    if (filtering) layer->setFiltering(false);
-                }
+        if (state.z >= minLayerZ && state.z <= maxLayerZ) {
+            if (layer->isVisible()) {
+                if (filtering) layer->setFiltering(true);
+                layer->setCaptureScreen(true);
+                layer->draw(hw, useIdentityTransform);
+                layer->setCaptureScreen(false);
+                if (filtering) layer->setFiltering(false);
             }
         }
     }
@@ -3336,6 +4179,32 @@ void SurfaceFlinger::renderScreenImplLocked(
 }
 
 
+// Makes the GPU wait for fenceFd before executing the GL commands that
+// follow, so that the main thread doesn't have to. Falls back to waiting
+// here when the EGL implementation can't do that. Takes ownership of fenceFd.
+static void waitForFenceBeforeRendering(EGLDisplay dpy, int fenceFd) {
+    if (SyncFeatures::getInstance().useWaitSync()) {
+        EGLint attribs[] = {
+            EGL_SYNC_NATIVE_FENCE_FD_ANDROID, fenceFd,
+            EGL_NONE
+        };
+        EGLSyncKHR sync = eglCreateSyncKHR(dpy,
+                EGL_SYNC_NATIVE_FENCE_ANDROID, attribs);
+        if (sync != EGL_NO_SYNC_KHR) {
+            // the sync object owns fenceFd from now on
+            eglWaitSyncKHR(dpy, sync, 0);
+            EGLint eglErr = eglGetError();
+            ALOGW_IF(eglErr != EGL_SUCCESS,
+                    "captureScreen: error waiting for EGL fence: %#x", eglErr);
+            eglDestroySyncKHR(dpy, sync);
+            return;
+        }
+        ALOGW("captureScreen: error creating EGL fence: %#x", eglGetError());
+    }
+    sp<Fence> fence(new Fence(fenceFd));
+    fence->waitForever("captureScreen");
+}
+
 status_t SurfaceFlinger::captureScreenImplLocked(
         const sp<const DisplayDevice>& hw,
         const sp<IGraphicBufferProducer>& producer,
@@ -3380,10 +4249,11 @@ status_t SurfaceFlinger::captureScreenImplLocked(
 
         if (err == NO_ERROR) {
             ANativeWindowBuffer* buffer;
-            /* TODO: Once we have the sync framework everywhere this can use
-             * server-side waits on the fence that dequeueBuffer returns.
-             */
-            result = native_window_dequeue_buffer_and_wait(window,  &buffer);
+            // The buffer may still be read by its consumer: rather than
+            // waiting for that here, the GPU waits for the fence before
+            // rendering into it
+            int fenceFd = -1;
+            result = window->dequeueBuffer(window, &buffer, &fenceFd);
             if (result == NO_ERROR) {
                 int syncFd = -1;
                 // create an EGLImage from the buffer so we can later
@@ -3395,6 +4265,11 @@ status_t SurfaceFlinger::captureScreenImplLocked(
                     // duration of this scope.
                     RenderEngine::BindImageAsFramebuffer imageBond(getRenderEngine(), image);
                     if (imageBond.getStatus() == NO_ERROR) {
+                        if (fenceFd >= 0) {
+                            waitForFenceBeforeRendering(mEGLDisplay, fenceFd);
+                            fenceFd = -1;
+                        }
+
                         // this will in fact render into our dequeued buffer
                         // via an FBO, which means we didn't have to create
                         // an EGLSurface and therefore we're not
@@ -3457,6 +4332,11 @@ status_t SurfaceFlinger::captureScreenImplLocked(
                 } else {
                     result = BAD_VALUE;
                 }
+                if (fenceFd >= 0) {
+                    // nothing was rendered, so the buffer is ready when its
+                    // consumer is done with it
+                    syncFd = fenceFd;
+                }
                 // queueBuffer takes ownership of syncFd
                 result = window->queueBuffer(window, buffer, syncFd);
             }
@@ -3526,6 +4406,33 @@ int SurfaceFlinger::LayerVector::do_compare(const void* lhs,
     return l->sequence - r->sequence;
 }
 
+void SurfaceFlinger::LayerVector::getLayerStackRange(uint32_t layerStack,
+        size_t* outBegin, size_t* outEnd) const
+{
+    // the drawing list was sorted with what's now the layers' drawing state
+    size_t l = 0;
+    size_t h = size();
+    while (l < h) {
+        const size_t mid = l + (h - l) / 2;
+        if (itemAt(mid)->getDrawingState().layerStack < layerStack) {
+            l = mid + 1;
+        } else {
+            h = mid;
+        }
+    }
+    *outBegin = l;
+    h = size();
+    while (l < h) {
+        const size_t mid = l + (h - l) / 2;
+        if (itemAt(mid)->getDrawingState().layerStack <= layerStack) {
+            l = mid + 1;
+        } else {
+            h = mid;
+        }
+    }
+    *outEnd = l;
+}
+
 // ---------------------------------------------------------------------------
 
 SurfaceFlinger::DisplayDeviceState::DisplayDeviceState()
@@ -47,11 +47,18 @@
 
 #include <private/gui/LayerState.h>
 
+#include "AdaptivePhaseOffset.h"
 #include "Barrier.h"
 #include "DisplayDevice.h"
 #include "DispSync.h"
+#include "FrameTrace.h"
 #include "FrameTracker.h"
+#include "JankTracker.h"
+#include "LayerMemoryBudget.h"
 #include "MessageQueue.h"
+#include "RegionRecorder.h"
+#include "SchedulingPolicy.h"
+#include "WorkloadHint.h"
 
 #include "DisplayHardware/HWComposer.h"
 #include "Effects/Daltonizer.h"
@@ -69,6 +76,7 @@ class LayerDim;
 class Surface;
 class RenderEngine;
 class EventControlThread;
+class ReclaimThread;
 
 // ---------------------------------------------------------------------------
 
@@ -138,6 +146,7 @@ private:
     friend class Client;
     friend class DisplayEventConnection;
     friend class Layer;
+    friend class LayerDim;
     friend class MonitoredProducer;
 
     // This value is specified in number of frames.  Log frame stats at most
@@ -158,6 +167,13 @@ private:
         LayerVector();
         LayerVector(const LayerVector& rhs);
         virtual int do_compare(const void* lhs, const void* rhs) const;
+
+        // getLayerStackRange returns the range [outBegin, outEnd) of the
+        // layers of the drawing list on layerStack. They're contiguous, as
+        // layers are sorted by layer stack first, so each display only
+        // needs to go through its own layers.
+        void getLayerStackRange(uint32_t layerStack, size_t* outBegin,
+                size_t* outEnd) const;
     };
 
     struct DisplayDeviceState {
@@ -182,6 +198,17 @@ private:
         DefaultKeyedVector< wp<IBinder>, DisplayDeviceState> displays;
     };
 
+    // What handleTransaction() takes from under mStateLock so that the
+    // transaction can be committed without holding it
+    struct TransactionSnapshot {
+        uint32_t transactionFlags;
+        State state;
+        uint32_t serial;
+        bool animTransactionPending;
+        bool layersRemoved;
+        Vector< sp<Layer> > layersPendingRemoval;
+    };
+
     /* ------------------------------------------------------------------------
      * IBinder interface
      */
@@ -217,6 +244,8 @@ private:
     virtual status_t setActiveConfig(const sp<IBinder>& display, int id);
     virtual status_t clearAnimationFrameStats();
     virtual status_t getAnimationFrameStats(FrameStats* outStats) const;
+    virtual status_t getAnimationFrameStatsSummary(
+            FrameStatsSummary* outSummary) const;
 
     /* ------------------------------------------------------------------------
      * DeathRecipient interface
@@ -257,10 +286,38 @@ private:
 
     void handleMessageRefresh();
 
+    // feeds the duration of the frame just committed to mAdaptivePhaseOffset
+    // and moves the SurfaceFlinger vsync accordingly
+    void updatePhaseOffset(nsecs_t frameDuration);
+
+    // accounts for the buffers of all layers in mLayerMemoryBudget, and trims
+    // the background ones if they go over the budget
+    void updateLayerMemoryBudget(bool visibilityChanged);
+
+    // discards the free buffers of idle layers, and schedules the next check
+    // for when another layer can be idle, see LayerMemoryBudget
+    void discardIdleLayerBuffers();
+
     void handleTransaction(uint32_t transactionFlags);
     void handleTransactionLocked(uint32_t transactionFlags);
+    void latchTransactionLocked(uint32_t transactionFlags,
+            TransactionSnapshot& outSnapshot);
+    void commitTransactionSnapshot(TransactionSnapshot& snapshot);
+
+    void handleLayerTransactionsLocked(const LayerVector& currentLayers);
+    void updateTransformHints(const LayerVector& currentLayers);
+    void handleLayerListChanges(const LayerVector& currentLayers,
+            bool layersRemoved);
 
     void updateCursorAsync();
+    void updateCursorState(bool reposition);
+
+    /* moveCursorAsync - moves the HWC cursor to the position a transaction
+     * gives its layer, from the calling binder thread and without taking
+     * mStateLock, so that the pointer follows input even while the main
+     * thread is busy composing
+     */
+    void moveCursorAsync(const Vector<ComposerState>& state);
 
     /* handlePageFlip - latch a new buffer if available and compute the dirty
      * region. Returns whether a new buffer has been latched, i.e., whether it
@@ -373,21 +430,41 @@ private:
      * Compositing
      */
     void invalidateHwcGeometry();
-    static void computeVisibleRegions(
+    // When incremental is set, layers whose visibility can't have changed
+    // since the last call for the same layer stack are skipped; it must
+    // only be set if no other display shows that layer stack.
+    void computeVisibleRegions(
             const LayerVector& currentLayers, uint32_t layerStack,
-            Region& dirtyRegion, Region& opaqueRegion);
+            Region& dirtyRegion, Region& opaqueRegion, bool incremental);
 
     void preComposition();
-    void postComposition();
+    void postComposition(nsecs_t expectedPresentTime);
     void rebuildLayerStacks();
+    // whether the previous frame is still what every display should show,
+    // in which case there's no need to prepare and commit a new one
+    bool isCompositionUnchanged() const;
     void setUpHWComposer();
     void doComposition();
     void doDebugFlashRegions();
     void doDisplayComposition(const sp<const DisplayDevice>& hw, const Region& dirtyRegion);
 
+    // composes display hw, if it's on, and tells it composition is complete
+    void composeDisplay(const sp<const DisplayDevice>& hw, bool repaintEverything);
+
+    // whether the composition of display hw is left until after the
+    // HWComposer commit, see doComposition
+    bool isCompositionDeferred(const sp<const DisplayDevice>& hw) const;
+
+    // tells display hw and its visible layers that its frame was posted
+    void onDisplayPosted(const sp<const DisplayDevice>& hw);
+
     // compose surfaces for display hw. this fails if using GL and the surface
     // has been destroyed and is no longer valid.
     bool doComposeSurfaces(const sp<const DisplayDevice>& hw, const Region& dirty);
+    void composeBackground(const sp<const DisplayDevice>& hw,
+            const Region& dirty) const;
+    void composeLayers(const sp<const DisplayDevice>& hw, const Region& dirty,
+            bool hasGlesComposition, bool flattened) const;
 
     void postFramebuffer();
     void drawWormhole(const sp<const DisplayDevice>& hw, const Region& region) const;
@@ -419,6 +496,9 @@ private:
     void logFrameStats();
 
     void dumpStaticScreenStats(String8& result) const;
+    void dumpLayerMemory(String8& result) const;
+    void dumpTimeStats(const Vector<String16>& args, size_t& index,
+            String8& result);
 
     /* ------------------------------------------------------------------------
      * Attributes
@@ -431,6 +511,8 @@ private:
     Condition mTransactionCV;
     bool mTransactionPending;
     bool mAnimTransactionPending;
+    // Counts the transactions applied by setTransactionState()
+    uint32_t mTransactionSerial;
     Vector< sp<Layer> > mLayersPendingRemoval;
     SortedVector< wp<IBinder> > mGraphicBufferProducerList;
 
@@ -445,9 +527,11 @@ private:
     RenderEngine* mRenderEngine;
     nsecs_t mBootTime;
     bool mGpuToCpuSupported;
+    bool mPreallocateBuffers;
     sp<EventThread> mEventThread;
     sp<EventThread> mSFEventThread;
     sp<EventControlThread> mEventControlThread;
+    sp<ReclaimThread> mReclaimThread;
     EGLContext mEGLContext;
     EGLDisplay mEGLDisplay;
     sp<IBinder> mBuiltinDisplays[DisplayDevice::NUM_BUILTIN_DISPLAY_TYPES];
@@ -474,6 +558,19 @@ private:
     nsecs_t mLastTransactionTime;
     bool mBootFinished;
     bool mForceFullDamage;
+    bool mIncrementalVisibleRegions;
+    bool mDeferNonHwcComposition;
+    bool mSnapshotTransactions;
+    bool mSkipUnchangedComposition;
+    bool mFlattenStaticLayers;
+    bool mUseAdaptivePhaseOffset;
+    // time GLES composition on the GPU for the frame pacing stats
+    bool mGpuTiming;
+    // hand dim layers to the HWC as a solid black buffer, see LayerDim
+    bool mHwcDimLayers;
+    // initialize EGL and the HWC in parallel, see init()
+    bool mParallelInit;
+    bool mProgramCachePrimed;
 
     // these are thread safe
     mutable MessageQueue mEventQueue;
@@ -484,6 +581,21 @@ private:
     mutable Mutex mDestroyedLayerLock;
     Vector<Layer const *> mDestroyedLayers;
 
+    // The layer the HWC composes as a cursor, and what's needed to compute
+    // its position on screen without the main thread's state, protected by
+    // mCursorLock
+    struct CursorState {
+        wp<Layer> layer;
+        int32_t hwcId;
+        float x;
+        float y;
+        Rect frame;
+        Rect viewport;
+        Transform transform;
+    };
+    Mutex mCursorLock;
+    CursorState mCursorState;
+
     // protected by mHWVsyncLock
     Mutex mHWVsyncLock;
     bool mPrimaryHWVsyncEnabled;
@@ -499,12 +611,47 @@ private:
     mat4 mColorMatrix;
     bool mHasColorMatrix;
 
+    // The color matrix and the Daltonizer's transform combined, which GLES
+    // applies to the whole composition. mHasColorTransform is false when
+    // they leave colors unchanged, so that the HWC can be used.
+    void updateColorTransform();
+    mat4 mColorTransform;
+    bool mHasColorTransform;
+
     // Static screen stats
     bool mHasPoweredOff;
     static const size_t NUM_BUCKETS = 8; // < 1-7, 7+
     nsecs_t mFrameBuckets[NUM_BUCKETS];
     nsecs_t mTotalTime;
     nsecs_t mLastSwapTime;
+    uint64_t mSkippedCompositions;
+
+    // Frame pacing stats, see dumpsys SurfaceFlinger --timestats
+    JankTracker mJankTracker;
+
+    // Records of the last frames, see dumpsys SurfaceFlinger --frametrace
+    FrameTrace mFrameTrace;
+
+    // Tells the power HAL what the frames about to be composited cost
+    WorkloadHint mWorkloadHint;
+
+    // Real-time priorities and CPU affinity of the composition and vsync
+    // threads, see dumpsys SurfaceFlinger --sched
+    SchedulingPolicy mSchedulingPolicy;
+
+    // Keeps the buffers of all layers under ro.sf.layer_memory_budget_mb,
+    // see dumpsys SurfaceFlinger --layer-memory
+    LayerMemoryBudget mLayerMemoryBudget;
+    // whether a discardIdleLayerBuffers message is posted
+    bool mIdleBufferCheckPending;
+
+    // Recordings of computeVisibleRegions, see dumpsys SurfaceFlinger
+    // --regions
+    RegionRecorder mRegionRecorder;
+
+    // Adaptive SurfaceFlinger phase offset, see handleMessageRefresh
+    AdaptivePhaseOffset mAdaptivePhaseOffset;
+    nsecs_t mFrameStartTime;
 };
 
 }; // namespace android
@@ -127,6 +127,42 @@ sp<NativeHandle> SurfaceFlingerConsumer::getSidebandStream() const {
     return mConsumer->getSidebandStream();
 }
 
+void SurfaceFlingerConsumer::setFrameCompositionInfo(uint64_t frameNumber,
+        nsecs_t latchTime, const sp<Fence>& presentFence,
+        nsecs_t presentTime) {
+    mConsumer->setFrameCompositionInfo(frameNumber, latchTime, presentFence,
+            presentTime);
+}
+
+status_t SurfaceFlingerConsumer::getBufferMemoryUsage(uint32_t* outBufferCount,
+        uint64_t* outBytes) const {
+    sp<IGraphicBufferConsumer> consumer;
+    {
+        Mutex::Autolock lock(mMutex);
+        if (mAbandoned) {
+            *outBufferCount = 0;
+            *outBytes = 0;
+            return NO_INIT;
+        }
+        consumer = mConsumer;
+    }
+    return consumer->getBufferMemoryUsage(outBufferCount, outBytes);
+}
+
+status_t SurfaceFlingerConsumer::discardFreeBuffers() {
+    // Not called with mMutex held, onBuffersReleased locks it to let go of
+    // the buffers that were freed
+    sp<IGraphicBufferConsumer> consumer;
+    {
+        Mutex::Autolock lock(mMutex);
+        if (mAbandoned) {
+            return NO_INIT;
+        }
+        consumer = mConsumer;
+    }
+    return consumer->discardFreeBuffers();
+}
+
 // We need to determine the time when a buffer acquired now will be
 // displayed.  This can be calculated:
 //   time when previous buffer's actual-present fence was signaled
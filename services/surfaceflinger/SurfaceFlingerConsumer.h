@@ -72,6 +72,17 @@ public:
 
     sp<NativeHandle> getSidebandStream() const;
 
+    // See IGraphicBufferConsumer::setFrameCompositionInfo
+    void setFrameCompositionInfo(uint64_t frameNumber, nsecs_t latchTime,
+            const sp<Fence>& presentFence, nsecs_t presentTime);
+
+    // See IGraphicBufferConsumer::getBufferMemoryUsage
+    status_t getBufferMemoryUsage(uint32_t* outBufferCount,
+            uint64_t* outBytes) const;
+
+    // See IGraphicBufferConsumer::discardFreeBuffers
+    status_t discardFreeBuffers();
+
     nsecs_t computeExpectedPresent(const DispSync& dispSync);
 
 private:
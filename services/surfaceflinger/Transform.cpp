@@ -63,6 +63,12 @@ Transform Transform::operator * (const Transform& rhs) const
     if (rhs.mType == IDENTITY)
         return r;
 
+    if (mType <= TRANSLATE && rhs.mType <= TRANSLATE) {
+        // translations only, which is the case of most layers
+        r.set(tx() + rhs.tx(), ty() + rhs.ty());
+        return r;
+    }
+
     // TODO: we could use mType to optimize the matrix multiply
     const mat33& A(mMatrix);
     const mat33& B(rhs.mMatrix);
@@ -200,8 +206,37 @@ Rect Transform::makeBounds(int w, int h) const
     return transform( Rect(w, h) );
 }
 
+bool Transform::isRectilinearUnitScale() const
+{
+    // rotations by a multiple of 90 degrees and flips, without scaling:
+    // a, b, c and d are all 0, 1 or -1
+    const mat33& M(mMatrix);
+    return preserveRects() &&
+            (isZero(M[0][0]) || absIsOne(M[0][0])) &&
+            (isZero(M[1][0]) || absIsOne(M[1][0])) &&
+            (isZero(M[0][1]) || absIsOne(M[0][1])) &&
+            (isZero(M[1][1]) || absIsOne(M[1][1]));
+}
+
 Rect Transform::transform(const Rect& bounds) const
 {
+    if (CC_LIKELY(isRectilinearUnitScale())) {
+        // integer coordinates stay integers, so only the translation has to
+        // be rounded, and two opposite corners tell where all four go
+        const mat33& M(mMatrix);
+        const int a = static_cast<int>(M[0][0]);
+        const int b = static_cast<int>(M[1][0]);
+        const int c = static_cast<int>(M[0][1]);
+        const int d = static_cast<int>(M[1][1]);
+        const int x = static_cast<int>(floorf(tx() + 0.5f));
+        const int y = static_cast<int>(floorf(ty() + 0.5f));
+        const int x0 = a*bounds.left  + b*bounds.top    + x;
+        const int y0 = c*bounds.left  + d*bounds.top    + y;
+        const int x1 = a*bounds.right + b*bounds.bottom + x;
+        const int y1 = c*bounds.right + d*bounds.bottom + y;
+        return Rect(min(x0, x1), min(y0, y1), max(x0, x1), max(y0, y1));
+    }
+
     Rect r;
     vec2 lt( bounds.left,  bounds.top    );
     vec2 rt( bounds.right, bounds.top    );
@@ -225,7 +260,13 @@ Region Transform::transform(const Region& reg) const
 {
     Region out;
     if (CC_UNLIKELY(transformed())) {
-        if (CC_LIKELY(preserveRects())) {
+        const mat33& M(mMatrix);
+        if (isRectilinearUnitScale() && isZero(M[1][0])) {
+            // flips, which keep the spans of the region
+            const int xpos = floorf(tx() + 0.5f);
+            const int ypos = floorf(ty() + 0.5f);
+            out = reg.flip(M[0][0] < 0, M[1][1] < 0, xpos, ypos);
+        } else if (CC_LIKELY(preserveRects())) {
             Region::const_iterator it = reg.begin();
             Region::const_iterator const end = reg.end();
             while (it != end) {
@@ -100,6 +100,7 @@ private:
     vec2 transform(const vec2& v) const;
     vec3 transform(const vec3& v) const;
     uint32_t type() const;
+    bool isRectilinearUnitScale() const;
     static bool absIsOne(float f);
     static bool isZero(float f);
 
@@ -0,0 +1,122 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#define ATRACE_TAG ATRACE_TAG_GRAPHICS
+
+#include <inttypes.h>
+
+#include <utils/Errors.h>
+#include <utils/Log.h>
+#include <utils/String8.h>
+#include <utils/Trace.h>
+
+#include "WorkloadHint.h"
+
+namespace android {
+
+WorkloadHint::WorkloadHint() :
+    mMode(MODE_OFF),
+    mGles(false),
+    mPrepareTime(0),
+    mLastData(-1),
+    mBoostEndTime(0),
+    mNumHints(0),
+    mNumErrors(0) {
+    mAverage[0] = 0;
+    mAverage[1] = 0;
+}
+
+void WorkloadHint::setMode(Mode mode) {
+    mMode = mode;
+    mLastData = -1;
+    mBoostEndTime = 0;
+}
+
+nsecs_t WorkloadHint::predict(bool gles) const {
+    // Before the first GLES frame, assume it costs at least as much as the
+    // others
+    nsecs_t prediction = mAverage[gles ? 1 : 0];
+    if (gles && mAverage[0] > prediction) {
+        prediction = mAverage[0];
+    }
+    return prediction;
+}
+
+void WorkloadHint::framePrepared(uint32_t numHwcLayers,
+        uint32_t numGlesLayers, nsecs_t period) {
+    mPrepareTime = systemTime();
+    mGles = numGlesLayers > 0;
+    const nsecs_t prediction = predict(mGles);
+    status_t err = NO_ERROR;
+
+    if (mMode == MODE_FRAME) {
+        uint32_t numLayers = numHwcLayers + numGlesLayers;
+        int64_t units = prediction / 100000;
+        int32_t data = int32_t(
+                (uint32_t(units < 0xffff ? units : 0xffff) << 16) |
+                (mGles ? 0x100u : 0u) |
+                (numLayers < 0xff ? numLayers : 0xffu));
+        if (data == mLastData) {
+            return;
+        }
+        ATRACE_INT("WorkloadHint", data);
+        err = mPowerHAL.powerHint(POWER_HINT_SF_FRAME_WORKLOAD, data);
+        mLastData = data;
+    } else if (mMode == MODE_BOOST) {
+        if (prediction * 100 < period * BOOST_THRESHOLD_PERCENT) {
+            return;
+        }
+        // Boost again a refresh before the last boost runs out, for as long
+        // as frames stay heavy
+        const nsecs_t now = systemTime();
+        if (now + period < mBoostEndTime) {
+            return;
+        }
+        ATRACE_NAME("WorkloadHint boost");
+        err = mPowerHAL.powerHint(POWER_HINT_INTERACTION, BOOST_DURATION_MS);
+        mBoostEndTime = now + ms2ns(BOOST_DURATION_MS);
+    } else {
+        return;
+    }
+
+    mNumHints++;
+    if (err != NO_ERROR) {
+        mNumErrors++;
+        ALOGV("power hint failed: %d", err);
+    }
+}
+
+void WorkloadHint::frameComposited() {
+    if (mPrepareTime == 0) {
+        return;
+    }
+    const nsecs_t duration = systemTime() - mPrepareTime;
+    mPrepareTime = 0;
+    nsecs_t& average = mAverage[mGles ? 1 : 0];
+    if (average == 0) {
+        average = duration;
+    } else {
+        average += (duration - average) >> AVERAGE_SHIFT;
+    }
+}
+
+void WorkloadHint::dump(String8& result) const {
+    result.appendFormat("workload hint mode %d: predicted composition %" PRId64
+            " ns (%" PRId64 " ns with GLES), %u hints sent, %u failed\n",
+            mMode, mAverage[0], predict(true), mNumHints, mNumErrors);
+}
+
+}; // namespace android
@@ -0,0 +1,108 @@
+/*
+ * Copyright 2016 The Android Open Source Project
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *      http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+#ifndef ANDROID_WORKLOADHINT_H
+#define ANDROID_WORKLOADHINT_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include <utils/Timers.h>
+
+#include "DisplayHardware/PowerHAL.h"
+
+namespace android {
+
+class String8;
+
+// WorkloadHint tells the power HAL what each frame is about to cost, as soon
+// as HWComposer::prepare() has decided how it's composited, so that the
+// CPU/GPU can be boosted for the frames that need it before they run late
+// rather than after a missed refresh.
+//
+// The composition time of a frame is predicted from the recent frames that
+// were composited the same way, with or without GLES. In MODE_FRAME every
+// change of the workload is sent as a POWER_HINT_SF_FRAME_WORKLOAD hint,
+// which the power HAL has to know about. In MODE_BOOST, which any power HAL
+// supports, a frame predicted to take most of a refresh period sends a
+// POWER_HINT_INTERACTION boost instead.
+//
+// Hints are one-way binder calls to the power manager, so they don't block.
+// It is *NOT* thread-safe, and is only used from the main thread.
+class WorkloadHint {
+public:
+    enum Mode {
+        MODE_OFF = 0,
+        MODE_FRAME = 1,
+        MODE_BOOST = 2,
+    };
+
+    // The data of POWER_HINT_SF_FRAME_WORKLOAD packs the number of layers
+    // (bits 0-7, saturated), whether GLES composition is needed (bit 8) and
+    // the predicted composition time in units of 100us (bits 16-31).
+    static const int POWER_HINT_SF_FRAME_WORKLOAD = 0x53465746; // 'SFWF'
+
+    WorkloadHint();
+
+    void setMode(Mode mode);
+    bool isEnabled() const { return mMode != MODE_OFF; }
+
+    // framePrepared records how HWComposer::prepare() left the frame to be
+    // composited, and sends the hint for it
+    void framePrepared(uint32_t numHwcLayers, uint32_t numGlesLayers,
+            nsecs_t period);
+
+    // frameComposited records how long the frame took from the return of
+    // prepare(), when framePrepared() was called, to the HWComposer commit
+    void frameComposited();
+
+    void dump(String8& result) const;
+
+private:
+    // The weight of a new frame in the average composition times, as a
+    // power of two
+    static const int AVERAGE_SHIFT = 3;
+    // In MODE_BOOST, frames predicted to take more than this fraction of a
+    // refresh period boost for BOOST_DURATION_MS
+    static const int BOOST_THRESHOLD_PERCENT = 75;
+    static const int BOOST_DURATION_MS = 100;
+
+    nsecs_t predict(bool gles) const;
+
+    PowerHAL mPowerHAL;
+    Mode mMode;
+
+    // Whether the frame being composited needs GLES
+    bool mGles;
+
+    // When framePrepared() was called for the frame being composited, or 0
+    nsecs_t mPrepareTime;
+
+    // The average composition time of recent frames composited without and
+    // with GLES, 0 when there's none yet
+    nsecs_t mAverage[2];
+
+    int32_t mLastData;
+    nsecs_t mBoostEndTime;
+
+    // Counters for dump()
+    uint32_t mNumHints;
+    uint32_t mNumErrors;
+};
+
+}; // namespace android
+
+#endif // ANDROID_WORKLOADHINT_H